@@ -39,26 +39,55 @@ solution "TSDB"
     language "C++"
     kind "SharedLib"
     files  { "src/tsdb/*.h", "src/tsdb/*.cpp" }
-    links { "hdf5", "hdf5_hl", "boost_system-mt", "boost_date_time-mt" }
+    links { "hdf5", "hdf5_hl", "boost_system-mt", "boost_date_time-mt", "boost_thread-mt", "z" }
 
   project "tsdbcreate"
     language "C++"
     kind "ConsoleApp"
     files  { "src/tsdbcreate/*.h", "src/tsdbcreate/*.cpp" }
     includedirs { "src/tsdb" }
-    links { "tsdb", "hdf5", "hdf5_hl", "boost_system-mt", "boost_date_time-mt" }
+    links { "tsdb", "hdf5", "hdf5_hl", "boost_system-mt", "boost_date_time-mt", "boost_thread-mt", "z" }
 
   project "tsdbimport"
     language "C++"
     kind "ConsoleApp"
     files  {  "src/tsdbimport/*.h", "src/tsdbimport/*.cpp" }
     includedirs { "src/tsdb", "src/ticpp" }
-    links { "tsdb", "hdf5", "hdf5_hl", "boost_system-mt", "boost_date_time-mt", "ticpp" }
+    links { "tsdb", "hdf5", "hdf5_hl", "boost_system-mt", "boost_date_time-mt", "boost_thread-mt", "z", "ticpp" }
 
   project "tsdbview"
     language "C++"
     kind "ConsoleApp"
     files  { "src/tsdbview/*.h", "src/tsdbview/*.cpp" }
     includedirs { "src/tsdb" }
-    links { "tsdb", "hdf5", "hdf5_hl", "boost_system-mt", "boost_date_time-mt" }
- 
\ No newline at end of file
+    links { "tsdb", "hdf5", "hdf5_hl", "boost_system-mt", "boost_date_time-mt", "boost_thread-mt", "z" }
+
+  project "tsdbexport"
+    language "C++"
+    kind "ConsoleApp"
+    files  { "src/tsdbexport/*.h", "src/tsdbexport/*.cpp" }
+    includedirs { "src/tsdb" }
+    links { "tsdb", "hdf5", "hdf5_hl", "boost_system-mt", "boost_date_time-mt", "boost_thread-mt", "z" }
+ 
+  project "tsdbreindex"
+    language "C++"
+    kind "ConsoleApp"
+    files  { "src/tsdbreindex/*.h", "src/tsdbreindex/*.cpp" }
+    includedirs { "src/tsdb" }
+    links { "tsdb", "hdf5", "hdf5_hl", "boost_system-mt", "boost_date_time-mt", "boost_thread-mt", "z" }
+ 
+  project "tsdbtest"
+    language "C++"
+    kind "ConsoleApp"
+    files  { "src/tsdb/tests/*.cpp" }
+    includedirs { "src/tsdb" }
+    defines { "BOOST_TEST_DYN_LINK" }
+    links { "tsdb", "hdf5", "hdf5_hl", "boost_system-mt", "boost_date_time-mt", "boost_thread-mt", "boost_unit_test_framework-mt", "z" }
+ 
+  project "tsdbbench"
+    language "C++"
+    kind "ConsoleApp"
+    files  { "src/tsdbbench/*.h", "src/tsdbbench/*.cpp", "src/tsdbimport/importpipeline.h", "src/tsdbimport/importpipeline.cpp", "src/tsdbimport/boundedqueue.h",
+      "src/tsdbimport/inputstream.h", "src/tsdbimport/inputstream.cpp" }
+    includedirs { "src/tsdb", "src/tsdbimport" }
+    links { "tsdb", "hdf5", "hdf5_hl", "boost_system-mt", "boost_date_time-mt", "boost_thread-mt", "z" }
@@ -0,0 +1,554 @@
+/* STL includes */
+#include <string>
+#include <vector>
+#include <limits>
+#include <string.h>
+#include <boost/make_shared.hpp>
+#include <boost/algorithm/string.hpp>
+
+/* TSDB includes */
+#include "aggregate.h"
+#include "columnkernels.h"
+#include "memoryblock.h"
+#include "memoryblockptr.h"
+
+namespace tsdb {
+
+/* ====================================================================
+ * struct AggregateSpec - one aggregated column
+ * ====================================================================
+ */
+
+AggregateSpec::AggregateSpec(Function _function, const std::string& _field,
+	const std::string& _weight_field, const std::string& _name):
+	function(_function), field(_field), weight_field(_weight_field), name(_name) {}
+
+/** <summary>Returns the name of the column in the result</summary> */
+std::string AggregateSpec::outputName(void) const {
+	if(!name.empty()) {
+		return name;
+	}
+	if(field.empty()) {
+		return functionToString(function);
+	}
+	return functionToString(function) + "_" + field;
+}
+
+/** <summary>Returns the spec as fromString() parses it, without the name</summary> */
+std::string AggregateSpec::toString(void) const {
+	if(field.empty()) {
+		return functionToString(function);
+	}
+	if(function == WEIGHTED_MEAN) {
+		return functionToString(function) + "(" + field + "," + weight_field + ")";
+	}
+	return functionToString(function) + "(" + field + ")";
+}
+
+/** <summary>Parses a spec such as <c>max(price)</c>, <c>wmean(price,amount)</c> or <c>count</c></summary>
+ * <remarks>The functions are first, last, min, max, sum, count, mean and wmean, which may also be
+ * written vwap. Throws an AggregateException if <c>_spec</c> can not be parsed.</remarks>
+ */
+AggregateSpec AggregateSpec::fromString(const std::string& _spec) {
+	std::string spec = boost::algorithm::trim_copy(_spec);
+	std::string function_name = spec;
+	std::vector<std::string> args;
+
+	size_t open = spec.find('(');
+	if(open != std::string::npos) {
+		if(spec[spec.size() - 1] != ')') {
+			throw( AggregateException("missing ')' in '" + _spec + "'") );
+		}
+		function_name = boost::algorithm::trim_copy(spec.substr(0, open));
+		std::string arg_list = spec.substr(open + 1, spec.size() - open - 2);
+		if(!boost::algorithm::trim_copy(arg_list).empty()) {
+			boost::algorithm::split(args, arg_list, boost::algorithm::is_any_of(","));
+			for(size_t i = 0; i < args.size(); i++) {
+				boost::algorithm::trim(args[i]);
+			}
+		}
+	}
+	boost::algorithm::to_lower(function_name);
+
+	Function function;
+	size_t nargs = 1;
+	if(function_name == "first") {
+		function = FIRST;
+	} else if(function_name == "last") {
+		function = LAST;
+	} else if(function_name == "min") {
+		function = MIN;
+	} else if(function_name == "max") {
+		function = MAX;
+	} else if(function_name == "sum") {
+		function = SUM;
+	} else if(function_name == "mean") {
+		function = MEAN;
+	} else if(function_name == "wmean" || function_name == "vwap") {
+		function = WEIGHTED_MEAN;
+		nargs = 2;
+	} else if(function_name == "count") {
+		function = COUNT;
+		nargs = args.empty() ? 0 : 1;
+	} else {
+		throw( AggregateException("unknown function '" + function_name + "' in '" + _spec + "'") );
+	}
+
+	if(args.size() != nargs) {
+		throw( AggregateException("wrong number of fields in '" + _spec + "'") );
+	}
+
+	return AggregateSpec(function, nargs > 0 ? args[0] : "", nargs > 1 ? args[1] : "");
+}
+
+/** <summary>Returns the name of a function, as used by fromString()</summary> */
+std::string AggregateSpec::functionToString(Function _function) {
+	switch(_function) {
+		case FIRST: return "first";
+		case LAST: return "last";
+		case MIN: return "min";
+		case MAX: return "max";
+		case SUM: return "sum";
+		case COUNT: return "count";
+		case MEAN: return "mean";
+		case WEIGHTED_MEAN: return "wmean";
+	}
+	return "";
+}
+
+/* ====================================================================
+ * class Aggregator - reduces records to one row per time bucket
+ * ====================================================================
+ */
+
+namespace {
+
+/** Returns true if RecordView::toDouble() can read a field of this type */
+bool isNumeric(tsdb::Field::FieldType type) {
+	switch(type) {
+		case tsdb::Field::DOUBLE:
+		case tsdb::Field::INT32:
+		case tsdb::Field::INT8:
+		case tsdb::Field::TIMESTAMP:
+		case tsdb::Field::DATE:
+			return true;
+		default:
+			return false;
+	}
+}
+
+/** Returns a new field of the same type as <c>field</c> */
+tsdb::Field* copyFieldType(tsdb::Field* field, const std::string& name) {
+	switch(field->getFieldType()) {
+		case tsdb::Field::DOUBLE:
+			return new DoubleField(name);
+		case tsdb::Field::INT32:
+			return new Int32Field(name);
+		case tsdb::Field::INT8:
+			return new Int8Field(name);
+		case tsdb::Field::TIMESTAMP:
+			return new TimestampField(name);
+		case tsdb::Field::DATE:
+			return new DateField(name);
+		default:
+			return NULL;
+	}
+}
+
+/** Writes <c>value</c> to <c>dst</c> as a field of type <c>type</c> */
+void storeAs(tsdb::Field::FieldType type, tsdb::ieee64_t value, char* dst) {
+	switch(type) {
+		case tsdb::Field::DOUBLE:
+			memcpy(dst, &value, sizeof(value));
+			break;
+		case tsdb::Field::INT32: {
+			tsdb::int32_t v = (tsdb::int32_t) value;
+			memcpy(dst, &v, sizeof(v));
+			break; }
+		case tsdb::Field::INT8:
+			*(tsdb::int8_t*) dst = (tsdb::int8_t) value;
+			break;
+		case tsdb::Field::TIMESTAMP: {
+			tsdb::timestamp_t v = (tsdb::timestamp_t) value;
+			memcpy(dst, &v, sizeof(v));
+			break; }
+		case tsdb::Field::DATE: {
+			tsdb::date_t v = (tsdb::date_t) value;
+			memcpy(dst, &v, sizeof(v));
+			break; }
+		default:
+			break;
+	}
+}
+
+/** Reads a field of type <c>type</c> at <c>src</c> as a double */
+tsdb::ieee64_t loadAs(tsdb::Field::FieldType type, const char* src) {
+	switch(type) {
+		case tsdb::Field::DOUBLE: {
+			tsdb::ieee64_t v;
+			memcpy(&v, src, sizeof(v));
+			return v; }
+		case tsdb::Field::INT32: {
+			tsdb::int32_t v;
+			memcpy(&v, src, sizeof(v));
+			return (tsdb::ieee64_t) v; }
+		case tsdb::Field::INT8:
+			return (tsdb::ieee64_t) *(const tsdb::int8_t*) src;
+		case tsdb::Field::TIMESTAMP: {
+			tsdb::timestamp_t v;
+			memcpy(&v, src, sizeof(v));
+			return (tsdb::ieee64_t) v; }
+		case tsdb::Field::DATE: {
+			tsdb::date_t v;
+			memcpy(&v, src, sizeof(v));
+			return (tsdb::ieee64_t) v; }
+		default:
+			return std::numeric_limits<tsdb::ieee64_t>::quiet_NaN();
+	}
+}
+
+} // namespace
+
+/** <summary>Creates an Aggregator</summary>
+ * <remarks>Throws an AggregateException if a spec names a field that is not in <c>_input</c>, or that is
+ * not a number, or if <c>_bucket_size</c> is not positive.</remarks>
+ * <param name="_input">Structure of the records that will be added</param>
+ * <param name="_specs">The columns of the result, after the bucket timestamp</param>
+ * <param name="_bucket_size">Length of a bucket, in milliseconds</param>
+ */
+Aggregator::Aggregator(const boost::shared_ptr<tsdb::Structure>& _input, const std::vector<tsdb::AggregateSpec>& _specs,
+	tsdb::timestamp_t _bucket_size): my_input(_input), my_specs(_specs), my_bucket_size(_bucket_size) {
+
+	if(_bucket_size <= 0) {
+		throw( AggregateException("the bucket size must be positive") );
+	}
+
+	std::vector<Field*> fields;
+	fields.push_back(new TimestampField("_TSDB_timestamp"));
+
+	try {
+		for(size_t i = 0; i < my_specs.size(); i++) {
+			const AggregateSpec& spec = my_specs[i];
+			size_t ifield = 0;
+			size_t iweight = 0;
+
+			if(!spec.field.empty()) {
+				ifield = _input->getFieldIndexByName(spec.field);
+				if(!isNumeric(_input->getField(ifield)->getFieldType())) {
+					throw( AggregateException("field '" + spec.field + "' is not a number") );
+				}
+			} else if(spec.function != AggregateSpec::COUNT) {
+				throw( AggregateException(AggregateSpec::functionToString(spec.function) + " needs a field") );
+			}
+
+			if(spec.function == AggregateSpec::WEIGHTED_MEAN) {
+				iweight = _input->getFieldIndexByName(spec.weight_field);
+				if(!isNumeric(_input->getField(iweight)->getFieldType())) {
+					throw( AggregateException("field '" + spec.weight_field + "' is not a number") );
+				}
+			}
+
+			my_fields.push_back(ifield);
+			my_weight_fields.push_back(iweight);
+			my_field_sizes.push_back(_input->getSizeOfField(ifield));
+
+			switch(spec.function) {
+				case AggregateSpec::FIRST:
+				case AggregateSpec::LAST:
+				case AggregateSpec::MIN:
+				case AggregateSpec::MAX:
+					fields.push_back(copyFieldType(_input->getField(ifield), spec.outputName()));
+					break;
+				case AggregateSpec::COUNT:
+					fields.push_back(new Int32Field(spec.outputName()));
+					break;
+				default:
+					fields.push_back(new DoubleField(spec.outputName()));
+			}
+		}
+	} catch(StructureException& e) {
+		for(size_t j = 0; j < fields.size(); j++) {
+			delete fields[j];
+		}
+		throw( AggregateException(e.what()) );
+	} catch(AggregateException&) {
+		for(size_t j = 0; j < fields.size(); j++) {
+			delete fields[j];
+		}
+		throw;
+	}
+
+	my_structure = boost::make_shared<tsdb::Structure>(fields, true);
+	my_accumulators.resize(my_specs.size());
+	my_in_bucket = false;
+	my_bucket = 0;
+	my_count = 0;
+	my_nrows = 0;
+}
+
+/** <summary>Adds a record, which must not be before the records added so far</summary> */
+void Aggregator::add(const tsdb::RecordView& record) {
+	addRecords(record.raw(), 1);
+}
+
+/** <summary>Adds <c>nrecords</c> records, laid out as in the input Structure</summary>
+ * <remarks>The records must be in timestamp order, and not before the records added so far.</remarks>
+ */
+void Aggregator::addRecords(const char* records, size_t nrecords) {
+	size_t record_size = my_input->getSizeOf();
+	tsdb::StridedColumn timestamps(records, nrecords, *my_input, 0);
+	size_t i = 0;
+
+	while(i < nrecords) {
+		tsdb::timestamp_t timestamp;
+		memcpy(&timestamp, timestamps.data + i * record_size, sizeof(timestamp));
+		tsdb::timestamp_t bucket = bucketOf(timestamp);
+
+		if(!my_in_bucket || bucket != my_bucket) {
+			if(my_in_bucket) {
+				finishBucket();
+			}
+			startBucket(bucket);
+		}
+
+		// The records up to the start of the next bucket
+		size_t end = i + ColumnKernels::lowerBound(timestamps.slice(i, nrecords - i), bucket + my_bucket_size);
+		addRun(records + i * record_size, end - i);
+		i = end;
+	}
+}
+
+/** Adds records that are all in the current bucket */
+void Aggregator::addRun(const char* records, size_t nrecords) {
+	size_t record_size = my_input->getSizeOf();
+
+	for(size_t i = 0; i < my_specs.size(); i++) {
+		Accumulator& acc = my_accumulators[i];
+		tsdb::StridedColumn column;
+		tsdb::ieee64_t min, max, sum_vw, sum_w;
+
+		if(!my_specs[i].field.empty()) {
+			column = tsdb::StridedColumn(records, nrecords, *my_input, my_fields[i]);
+		}
+
+		switch(my_specs[i].function) {
+			case AggregateSpec::FIRST:
+				if(my_count == 0) {
+					memcpy(acc.first, column.data, my_field_sizes[i]);
+				}
+				break;
+			case AggregateSpec::LAST:
+				memcpy(acc.last, column.data + (nrecords - 1) * record_size, my_field_sizes[i]);
+				break;
+			case AggregateSpec::MIN:
+			case AggregateSpec::MAX:
+				if(ColumnKernels::minMax(column, &min, &max)) {
+					acc.min = (acc.nvalues == 0 || min < acc.min) ? min : acc.min;
+					acc.max = (acc.nvalues == 0 || max > acc.max) ? max : acc.max;
+					acc.nvalues++;
+				}
+				break;
+			case AggregateSpec::SUM:
+			case AggregateSpec::MEAN:
+				acc.sum += ColumnKernels::sum(column, &acc.nvalues);
+				break;
+			case AggregateSpec::WEIGHTED_MEAN:
+				acc.nvalues += ColumnKernels::weightedSums(column,
+					tsdb::StridedColumn(records, nrecords, *my_input, my_weight_fields[i]), &sum_vw, &sum_w);
+				acc.sum += sum_vw;
+				acc.weight += sum_w;
+				break;
+			case AggregateSpec::COUNT:
+				acc.nvalues += my_specs[i].field.empty() ? nrecords : ColumnKernels::count(column);
+				break;
+		}
+	}
+
+	my_count += nrecords;
+}
+
+/** <summary>Adds the rows of a finer aggregation of the records, as if the records were added</summary>
+ * <remarks><p>Each row is a bucket of <c>rows_structure</c>, with its start as its timestamp, and
+ * <c>columns[i]</c> is the column of the row that has the value of spec <c>i</c> for the bucket. The
+ * buckets of the rows must fit in those of the Aggregator, as they do when its bucket size is a
+ * multiple of theirs, and the rows must not be before the records or rows added so far.</p>
+ * <p>Only FIRST, LAST, MIN, MAX, SUM and COUNT can be computed from the rows; a Rollup only has those.
+ * The column of a COUNT is an Int32, and the column of a SUM a double.</p></remarks>
+ */
+void Aggregator::addRows(const char* rows, size_t nrows, const boost::shared_ptr<tsdb::Structure>& rows_structure,
+	const std::vector<size_t>& columns) {
+	size_t row_size = rows_structure->getSizeOf();
+
+	for(size_t r = 0; r < nrows; r++) {
+		const char* row = rows + r * row_size;
+		tsdb::timestamp_t timestamp;
+		memcpy(&timestamp, row + rows_structure->getOffsetOfField(0), sizeof(timestamp));
+		tsdb::timestamp_t bucket = bucketOf(timestamp);
+
+		if(!my_in_bucket || bucket != my_bucket) {
+			if(my_in_bucket) {
+				finishBucket();
+			}
+			startBucket(bucket);
+		}
+
+		for(size_t i = 0; i < my_specs.size(); i++) {
+			Accumulator& acc = my_accumulators[i];
+			const char* src = row + rows_structure->getOffsetOfField(columns[i]);
+			tsdb::ieee64_t value;
+			tsdb::int32_t count;
+
+			switch(my_specs[i].function) {
+				case AggregateSpec::FIRST:
+					if(my_count == 0) {
+						memcpy(acc.first, src, my_field_sizes[i]);
+					}
+					break;
+				case AggregateSpec::LAST:
+					memcpy(acc.last, src, my_field_sizes[i]);
+					break;
+				case AggregateSpec::MIN:
+				case AggregateSpec::MAX:
+					// A bucket without values has a NaN
+					value = loadAs(rows_structure->getField(columns[i])->getFieldType(), src);
+					if(value == value) {
+						acc.min = (acc.nvalues == 0 || value < acc.min) ? value : acc.min;
+						acc.max = (acc.nvalues == 0 || value > acc.max) ? value : acc.max;
+						acc.nvalues++;
+					}
+					break;
+				case AggregateSpec::SUM:
+					memcpy(&value, src, sizeof(value));
+					acc.sum += value;
+					break;
+				case AggregateSpec::COUNT:
+					memcpy(&count, src, sizeof(count));
+					acc.nvalues += count;
+					break;
+				default:
+					throw( AggregateException(AggregateSpec::functionToString(my_specs[i].function) +
+						" can not be computed from the rows of another aggregation") );
+			}
+		}
+
+		my_count++;
+	}
+}
+
+/** <summary>Returns a RecordSet with one row per bucket that had records</summary>
+ * <remarks>This finishes the current bucket, so no more records should be added after it.</remarks>
+ */
+tsdb::RecordSet Aggregator::result(void) {
+	if(my_in_bucket) {
+		finishBucket();
+		my_in_bucket = false;
+	}
+
+	if(my_nrows == 0) {
+		return tsdb::RecordSet(0, my_structure);
+	}
+
+	boost::shared_ptr<tsdb::MemoryBlock> memblk = boost::make_shared<tsdb::MemoryBlock>(my_rows.size());
+	tsdb::MemoryBlockPtr memblkptr(memblk, 0);
+	memblkptr.memCpy(&my_rows[0], my_rows.size());
+	return tsdb::RecordSet(memblkptr, my_nrows, my_structure);
+}
+
+/** <summary>Moves the rows of the buckets finished so far to <c>rows</c>, and returns how many there are</summary>
+ * <remarks>Unlike result(), this leaves the current bucket open, so more records can be added to it.</remarks>
+ */
+size_t Aggregator::takeRows(std::vector<char>* rows) {
+	size_t nrows = my_nrows;
+	rows->swap(my_rows);
+	my_rows.clear();
+	my_nrows = 0;
+	return nrows;
+}
+
+/** <summary>Writes the row of the current bucket, with the records added to it so far, to <c>row</c></summary>
+ * <remarks>Returns false if no records have been added since the last bucket was finished.</remarks>
+ */
+bool Aggregator::openRow(char* row) const {
+	if(!my_in_bucket) {
+		return false;
+	}
+	writeRow(row);
+	return true;
+}
+
+/** <summary>Returns the Structure of the result</summary> */
+const boost::shared_ptr<tsdb::Structure>& Aggregator::structure(void) const {
+	return my_structure;
+}
+
+/** The start of the bucket of a timestamp, rounding down for timestamps before the epoch too */
+tsdb::timestamp_t Aggregator::bucketOf(tsdb::timestamp_t timestamp) const {
+	tsdb::timestamp_t bucket = timestamp - timestamp % my_bucket_size;
+	if(timestamp % my_bucket_size < 0) {
+		bucket -= my_bucket_size;
+	}
+	return bucket;
+}
+
+void Aggregator::startBucket(tsdb::timestamp_t bucket) {
+	my_in_bucket = true;
+	my_bucket = bucket;
+	my_count = 0;
+	for(size_t i = 0; i < my_accumulators.size(); i++) {
+		my_accumulators[i].sum = 0;
+		my_accumulators[i].weight = 0;
+		my_accumulators[i].nvalues = 0;
+	}
+}
+
+void Aggregator::finishBucket(void) {
+	size_t record_size = my_structure->getSizeOf();
+	my_rows.resize(my_rows.size() + record_size);
+	writeRow(&my_rows[my_rows.size() - record_size]);
+	my_nrows++;
+}
+
+void Aggregator::writeRow(char* row) const {
+	my_structure->setMember(row, 0, &my_bucket);
+	for(size_t i = 0; i < my_specs.size(); i++) {
+		const Accumulator& acc = my_accumulators[i];
+		const tsdb::ieee64_t nan = std::numeric_limits<tsdb::ieee64_t>::quiet_NaN();
+		tsdb::ieee64_t value;
+		tsdb::int32_t count;
+
+		switch(my_specs[i].function) {
+			case AggregateSpec::FIRST:
+				my_structure->setMember(row, i + 1, acc.first);
+				break;
+			case AggregateSpec::LAST:
+				my_structure->setMember(row, i + 1, acc.last);
+				break;
+			case AggregateSpec::MIN:
+				// Only a DOUBLE field can have missing values, so NaN is only stored as a double
+				storeAs(my_structure->getField(i + 1)->getFieldType(), (acc.nvalues > 0) ? acc.min : nan,
+					row + my_structure->getOffsetOfField(i + 1));
+				break;
+			case AggregateSpec::MAX:
+				storeAs(my_structure->getField(i + 1)->getFieldType(), (acc.nvalues > 0) ? acc.max : nan,
+					row + my_structure->getOffsetOfField(i + 1));
+				break;
+			case AggregateSpec::COUNT:
+				count = (tsdb::int32_t) acc.nvalues;
+				my_structure->setMember(row, i + 1, &count);
+				break;
+			case AggregateSpec::SUM:
+				my_structure->setMember(row, i + 1, &acc.sum);
+				break;
+			case AggregateSpec::MEAN:
+				value = (acc.nvalues > 0) ? acc.sum / acc.nvalues : nan;
+				my_structure->setMember(row, i + 1, &value);
+				break;
+			case AggregateSpec::WEIGHTED_MEAN:
+				value = (acc.weight != 0) ? acc.sum / acc.weight : nan;
+				my_structure->setMember(row, i + 1, &value);
+				break;
+		}
+	}
+}
+
+} // namespace tsdb
@@ -0,0 +1,144 @@
+#pragma once
+
+/* STL Classes */
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+/* External Libraries */
+#include <boost/shared_ptr.hpp>
+
+/* TSDB Includes */
+#include "tsdb.h"
+#include "field.h"
+#include "structure.h"
+#include "recordset.h"
+#include "recordcursor.h"
+
+namespace tsdb {
+
+/* -----------------------------------------------------------------
+ * AggregateException. For runtime errors thrown by the Aggregator
+ * and AggregateSpec.
+ * -----------------------------------------------------------------
+ */
+class  AggregateException:
+	public std::runtime_error
+{
+public:
+	AggregateException(const std::string& what):
+	  std::runtime_error(std::string("AggregateException: ") + what) {}
+};
+
+/* -----------------------------------------------------------------
+ * AggregateSpec. One aggregated column.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>Describes one column of an aggregation: a function of a field</summary>
+ * <remarks><p>FIRST, LAST, MIN and MAX keep the type of the field. SUM, MEAN and WEIGHTED_MEAN are
+ * doubles, and COUNT, which does not need a field, is an Int32. WEIGHTED_MEAN weighs <c>field</c> by
+ * <c>weight_field</c>, so the volume weighted average price of a trade series is
+ * <c>AggregateSpec(AggregateSpec::WEIGHTED_MEAN, "price", "amount")</c>.</p>
+ * <p>The column is called <c>name</c>, or, if that is empty, after the function and the field, as in
+ * <c>max_price</c>.</p></remarks>
+ */
+struct AggregateSpec
+{
+	enum Function {
+		FIRST,
+		LAST,
+		MIN,
+		MAX,
+		SUM,
+		COUNT,
+		MEAN,
+		WEIGHTED_MEAN
+	};
+
+	AggregateSpec(Function _function, const std::string& _field = "",
+		const std::string& _weight_field = "", const std::string& _name = "");
+
+	std::string outputName(void) const;
+	std::string toString(void) const;
+
+	static AggregateSpec fromString(const std::string& _spec);
+	static std::string functionToString(Function _function);
+
+	Function function;
+	std::string field;
+	std::string weight_field;  // only for WEIGHTED_MEAN
+	std::string name;
+};
+
+/* -----------------------------------------------------------------
+ * Aggregator. Reduces records to one row per time bucket.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>Reduces a stream of records to one row per time bucket</summary>
+ * <remarks><p>Records must be added in timestamp order. A bucket is <c>bucket_size</c> milliseconds
+ * long, and starts at a multiple of <c>bucket_size</c> since the epoch. Each row of the result has the
+ * start of its bucket as its timestamp, followed by one column per AggregateSpec. Buckets without any
+ * records have no row.</p>
+ * <p>A NaN in a DOUBLE field is a missing value. MIN, MAX, SUM, MEAN and WEIGHTED_MEAN skip it, and
+ * COUNT of a field counts the values that are not missing; FIRST and LAST are those of the first and
+ * last records, missing or not.</p>
+ * <p>Only the current bucket and the finished rows are kept, so the memory used does not depend on
+ * the number of records that are added. addRecords() computes each bucket with the ColumnKernels,
+ * so adding records a block at a time is much faster than one by one.</p>
+ * <p>addRows() adds the rows of a finer aggregation instead of records, as read from a Rollup. A Rollup
+ * also keeps an Aggregator open as records are appended: takeRows() hands it the finished rows, and
+ * openRow() the row of the current bucket as it is so far.</p></remarks>
+ */
+class Aggregator
+{
+public:
+	Aggregator(const boost::shared_ptr<tsdb::Structure>& _input, const std::vector<tsdb::AggregateSpec>& _specs,
+		tsdb::timestamp_t _bucket_size);
+
+	void add(const tsdb::RecordView& record);
+	void addRecords(const char* records, size_t nrecords);
+	void addRows(const char* rows, size_t nrows, const boost::shared_ptr<tsdb::Structure>& rows_structure,
+		const std::vector<size_t>& columns);
+	tsdb::RecordSet result(void);
+	size_t takeRows(std::vector<char>* rows);
+	bool openRow(char* row) const;
+	const boost::shared_ptr<tsdb::Structure>& structure(void) const;
+
+private:
+	/* The state of one column in the current bucket */
+	struct Accumulator {
+		tsdb::ieee64_t min;
+		tsdb::ieee64_t max;
+		tsdb::ieee64_t sum;
+		tsdb::ieee64_t weight;
+		size_t nvalues;  // values that are not missing
+		char first[8];   // raw values, in the type of the field
+		char last[8];
+	};
+
+	void addRun(const char* records, size_t nrecords);
+	tsdb::timestamp_t bucketOf(tsdb::timestamp_t timestamp) const;
+	void startBucket(tsdb::timestamp_t bucket);
+	void finishBucket(void);
+	void writeRow(char* row) const;
+
+	boost::shared_ptr<tsdb::Structure> my_input;
+	std::vector<tsdb::AggregateSpec> my_specs;
+	std::vector<size_t> my_fields;          // index in the input of the field of each spec
+	std::vector<size_t> my_weight_fields;   // index in the input of the weight field of each spec
+	std::vector<size_t> my_field_sizes;
+	boost::shared_ptr<tsdb::Structure> my_structure;
+	tsdb::timestamp_t my_bucket_size;
+
+	bool my_in_bucket;
+	tsdb::timestamp_t my_bucket;            // start of the current bucket
+	tsdb::int32_t my_count;                 // records, or rows, in the current bucket
+	std::vector<Accumulator> my_accumulators;
+
+	std::vector<char> my_rows;              // the finished rows, laid out as in my_structure
+	size_t my_nrows;
+};
+
+} // namespace tsdb
@@ -0,0 +1,185 @@
+/* STL includes */
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <boost/bind.hpp>
+
+/* TSDB includes */
+#include "appendwriter.h"
+#include "timeseries.h"
+
+namespace tsdb {
+
+namespace {
+
+/* The writer joins at most this many waiting buffers into one write, and append() waits when more are queued */
+const size_t MAX_QUEUED_BUFFERS = 8;
+
+} // namespace
+
+/* ====================================================================
+ * class AppendWriter - commits appended records on a writer thread
+ * ====================================================================
+ */
+
+/** <summary>Starts a writer thread for <c>_timeseries</c></summary>
+ * <param name="_timeseries">The Timeseries to write to. It must outlive the AppendWriter.</param>
+ * <param name="_buffer_bytes">Size of a buffer in bytes. A buffer holds at least one record.</param>
+ */
+AppendWriter::AppendWriter(tsdb::Timeseries* _timeseries, size_t _buffer_bytes):
+	my_timeseries(_timeseries), my_ncurrent(0), my_writing(false), my_stop(false) {
+
+	my_record_size = _timeseries->structure()->getSizeOf();
+	my_buffer_records = _buffer_bytes / my_record_size;
+	if(my_buffer_records == 0) {
+		my_buffer_records = 1;
+	}
+
+	my_current_buffer = new Buffer();
+	my_current_buffer->records.resize(my_buffer_records * my_record_size);
+	my_buffers.push_back(my_current_buffer);
+	my_current = &my_current_buffer->records[0];
+
+	my_thread = boost::thread(boost::bind(&AppendWriter::run, this));
+}
+
+/** <summary>Writes the records that are left, and stops the writer thread</summary>
+ * <remarks>Errors are ignored; call commit() first to see them.</remarks>
+ */
+AppendWriter::~AppendWriter(void) {
+	try {
+		if(my_ncurrent > 0) {
+			handOver();
+		}
+	} catch(...) {
+	}
+
+	{
+		boost::lock_guard<boost::mutex> lock(my_mutex);
+		my_stop = true;
+	}
+	my_queued_cond.notify_all();
+	my_thread.join();
+
+	for(size_t i = 0; i < my_buffers.size(); i++) {
+		delete my_buffers[i];
+	}
+}
+
+/** <summary>Hands the records appended so far to the writer, and waits until they are written</summary> */
+void AppendWriter::commit(void) {
+	if(my_ncurrent > 0) {
+		handOver();
+	}
+	wait();
+}
+
+/** <summary>Waits until the writer has written the buffers handed to it</summary> */
+void AppendWriter::wait(void) {
+	boost::unique_lock<boost::mutex> lock(my_mutex);
+	while(!my_queue.empty() || my_writing) {
+		my_done_cond.wait(lock);
+	}
+	throwIfFailed();
+}
+
+/** <summary>Returns the number of records a buffer holds</summary> */
+size_t AppendWriter::bufferRecords(void) const {
+	return my_buffer_records;
+}
+
+/** <summary>Queues the current buffer for the writer, and takes a free buffer, or a new one</summary> */
+void AppendWriter::handOver(void) {
+	boost::unique_lock<boost::mutex> lock(my_mutex);
+	while(my_queue.size() >= MAX_QUEUED_BUFFERS && my_error.empty()) {
+		my_done_cond.wait(lock);
+	}
+	if(!my_error.empty()) {
+		my_ncurrent = 0; // the records are dropped, like the ones that were waiting
+		throwIfFailed();
+	}
+
+	my_current_buffer->nrecords = my_ncurrent;
+	my_queue.push_back(my_current_buffer);
+
+	if(!my_free.empty()) {
+		my_current_buffer = my_free.back();
+		my_free.pop_back();
+	} else {
+		my_current_buffer = new Buffer();
+		my_current_buffer->records.resize(my_buffer_records * my_record_size);
+		my_buffers.push_back(my_current_buffer);
+	}
+	my_current = &my_current_buffer->records[0];
+	my_ncurrent = 0;
+
+	lock.unlock();
+	my_queued_cond.notify_one();
+}
+
+/** <summary>Throws a TimeseriesException if the writer failed. my_mutex must be held.</summary> */
+void AppendWriter::throwIfFailed(void) {
+	if(!my_error.empty()) {
+		throw( TimeseriesException("The append writer failed: " + my_error) );
+	}
+}
+
+/** <summary>The writer thread. Writes the queued buffers until it is stopped.</summary> */
+void AppendWriter::run(void) {
+	std::vector<Buffer*> batch;
+	std::vector<char> joined;
+
+	for(;;) {
+		{
+			boost::unique_lock<boost::mutex> lock(my_mutex);
+			while(my_queue.empty() && !my_stop) {
+				my_queued_cond.wait(lock);
+			}
+			if(my_queue.empty()) {
+				return;
+			}
+			batch.assign(my_queue.begin(), my_queue.end());
+			my_queue.clear();
+			my_writing = true;
+		}
+
+		std::string error;
+		try {
+			if(batch.size() == 1) {
+				my_timeseries->appendAndIndex(batch[0]->nrecords, &batch[0]->records[0]);
+			} else {
+				// Join the buffers, so that they are written with one append
+				size_t nrecords = 0;
+				for(size_t i = 0; i < batch.size(); i++) {
+					nrecords += batch[i]->nrecords;
+				}
+				joined.resize(nrecords * my_record_size);
+				char* dst = &joined[0];
+				for(size_t i = 0; i < batch.size(); i++) {
+					memcpy(dst, &batch[i]->records[0], batch[i]->nrecords * my_record_size);
+					dst += batch[i]->nrecords * my_record_size;
+				}
+				my_timeseries->appendAndIndex(nrecords, &joined[0]);
+			}
+		} catch(std::exception& e) {
+			error = e.what();
+		} catch(...) {
+			error = "unknown error";
+		}
+
+		{
+			boost::lock_guard<boost::mutex> lock(my_mutex);
+			my_free.insert(my_free.end(), batch.begin(), batch.end());
+			if(!error.empty() && my_error.empty()) {
+				// Drop the buffers that are waiting
+				my_error = error;
+				my_free.insert(my_free.end(), my_queue.begin(), my_queue.end());
+				my_queue.clear();
+			}
+			my_writing = false;
+		}
+		my_done_cond.notify_all();
+	}
+}
+
+} // namespace tsdb
@@ -0,0 +1,93 @@
+#pragma once
+
+/* STL Classes */
+#include <string>
+#include <vector>
+#include <deque>
+#include <string.h>
+
+/* External Libraries */
+#include "boost/thread/thread.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/condition_variable.hpp"
+
+/* TSDB Includes */
+#include "tsdb.h"
+
+namespace tsdb {
+
+class Timeseries;
+
+/* -----------------------------------------------------------------
+ * AppendWriter. Commits appended records on a writer thread.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>Takes records appended one at a time, and writes and indexes them on a thread of its own</summary>
+ * <remarks><p>append() copies a record into the current buffer, and nothing else, unless that fills the
+ * buffer: then the buffer is handed to the writer thread, and the caller carries on with an empty one.
+ * The writer appends the buffers to the Timeseries and indexes them. When more than one buffer is waiting,
+ * it joins them and writes them with one append, so the writes get larger when the writer falls behind.
+ * Buffers are reused. If MAX_QUEUED_BUFFERS buffers are waiting, append() waits for the writer.</p>
+ * <p>commit() hands over the current buffer too, and waits until the writer has written everything.
+ * wait() only waits for the buffers handed over so far.</p>
+ * <p>If the writer fails, it drops the buffers that are waiting, and the next append(), commit() or wait()
+ * throws a TimeseriesException with the error.</p>
+ * <p>An AppendWriter belongs to a Timeseries (see Timeseries::setAsyncAppend()), which waits for the writer
+ * before anything else it does, so the writer is the only thread in the Timeseries while it writes.</p></remarks>
+ */
+class AppendWriter
+{
+public:
+	AppendWriter(tsdb::Timeseries* _timeseries, size_t _buffer_bytes);
+	~AppendWriter(void);
+
+	/** <summary>Adds a record, laid out as in the Structure of the Timeseries</summary> */
+	void append(const void* record) {
+		memcpy(my_current + my_ncurrent * my_record_size, record, my_record_size);
+		if(++my_ncurrent == my_buffer_records) {
+			handOver();
+		}
+	}
+
+	void commit(void);
+	void wait(void);
+	size_t bufferRecords(void) const;
+
+private:
+	/* AppendWriters own a thread, so they can't be copied */
+	AppendWriter(const AppendWriter&);
+	AppendWriter& operator=(const AppendWriter&);
+
+	struct Buffer {
+		std::vector<char> records;
+		size_t nrecords;
+	};
+
+	void handOver(void);
+	void run(void);
+	void throwIfFailed(void);
+
+	tsdb::Timeseries* my_timeseries;
+	size_t my_record_size;
+	size_t my_buffer_records;
+	std::vector<Buffer*> my_buffers;    // every buffer, for the destructor
+
+	/* The buffer the caller fills */
+	Buffer* my_current_buffer;
+	char* my_current;
+	size_t my_ncurrent;
+
+	/* State shared with the writer thread */
+	boost::mutex my_mutex;
+	boost::condition_variable my_queued_cond;  // a buffer was queued, or the writer should stop
+	boost::condition_variable my_done_cond;    // the writer wrote some buffers
+	std::deque<Buffer*> my_queue;              // buffers waiting for the writer
+	std::vector<Buffer*> my_free;              // buffers that can be filled again
+	bool my_writing;
+	bool my_stop;
+	std::string my_error;
+	boost::thread my_thread;
+};
+
+} // namespace tsdb
@@ -0,0 +1,1142 @@
+/* STL includes */
+#include <string>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <string.h>
+
+/* TSDB includes */
+#include "arrowipc.h"
+#include "timeseries.h"
+#include "bufferedrecordset.h"
+#include "symboltable.h"
+
+namespace tsdb {
+
+namespace {
+
+/* Arrow format constants, from Schema.fbs, Message.fbs and File.fbs */
+const int METADATA_V5 = 4;
+const int HEADER_SCHEMA = 1;
+const int HEADER_DICTIONARY_BATCH = 2;
+const int HEADER_RECORD_BATCH = 3;
+
+const int TYPE_NULL = 1;
+const int TYPE_INT = 2;
+const int TYPE_FLOATING_POINT = 3;
+const int TYPE_BINARY = 4;
+const int TYPE_UTF8 = 5;
+const int TYPE_BOOL = 6;
+const int TYPE_DECIMAL = 7;
+const int TYPE_DATE = 8;
+const int TYPE_TIME = 9;
+const int TYPE_TIMESTAMP = 10;
+const int TYPE_INTERVAL = 11;
+const int TYPE_FIXED_SIZE_BINARY = 15;
+const int TYPE_DURATION = 18;
+const int TYPE_LARGE_BINARY = 19;
+const int TYPE_LARGE_UTF8 = 20;
+
+const int UNIT_SECOND = 0;
+const int UNIT_MILLISECOND = 1;
+const int UNIT_MICROSECOND = 2;
+const int UNIT_NANOSECOND = 3;
+const int DATE_DAY = 0;
+const int DATE_MILLISECOND = 1;
+
+const char MAGIC[8] = { 'A', 'R', 'R', 'O', 'W', '1', 0, 0 };
+const unsigned int CONTINUATION = 0xFFFFFFFF;
+const long long MS_PER_DAY = 86400000LL;
+
+/* Arrow data is little endian; the columns are written as they are in memory, and the schema says which
+   order that is */
+bool hostIsLittleEndian(void) {
+	const unsigned short one = 1;
+	return *((const unsigned char*) &one) == 1;
+}
+
+void putLittleEndian(char* out, unsigned long long value, size_t size) {
+	for(size_t i = 0; i < size; i++) {
+		out[i] = (char) ((value >> (8 * i)) & 0xFF);
+	}
+}
+
+unsigned long long getLittleEndian(const char* in, size_t size) {
+	unsigned long long value = 0;
+	for(size_t i = 0; i < size; i++) {
+		value |= ((unsigned long long) (unsigned char) in[i]) << (8 * i);
+	}
+	return value;
+}
+
+long long floorDiv(long long value, long long divisor) {
+	long long q = value / divisor;
+	return (value % divisor != 0 && value < 0) ? q - 1 : q;
+}
+
+/* -----------------------------------------------------------------
+ * FlatBuilder. Builds the flatbuffers that hold Arrow metadata.
+ * -----------------------------------------------------------------
+ *
+ * A tree of tables, vectors and strings is described first, then
+ * laid out front to back: every object is written before the objects
+ * it refers to, since flatbuffer offsets point forward, and each
+ * table's vtable is written just before it. Scalars are aligned to
+ * their size, counting from the start of the buffer.
+ */
+class FlatBuilder
+{
+public:
+	struct Node;
+
+	struct Slot {
+		int index;
+		size_t size;
+		unsigned long long value;
+		Node* child;
+	};
+
+	struct Node {
+		enum Kind { TABLE, OFFSETS, STRUCTS, STRING } kind;
+		std::vector<Slot> slots;          // TABLE
+		std::vector<Node*> elements;      // OFFSETS
+		std::string bytes;                // STRUCTS and STRING
+		size_t nelements;                 // STRUCTS
+		size_t element_align;             // STRUCTS
+	};
+
+	~FlatBuilder(void) {
+		for(size_t i = 0; i < my_nodes.size(); i++) {
+			delete my_nodes[i];
+		}
+	}
+
+	Node* table(void) {
+		return node(Node::TABLE);
+	}
+
+	void scalar(Node* table, int index, size_t size, unsigned long long value) {
+		Slot slot = { index, size, value, NULL };
+		table->slots.push_back(slot);
+	}
+
+	void child(Node* table, int index, Node* child) {
+		Slot slot = { index, 4, 0, child };
+		table->slots.push_back(slot);
+	}
+
+	Node* string(const std::string& text) {
+		Node* n = node(Node::STRING);
+		n->bytes = text;
+		return n;
+	}
+
+	Node* offsets(void) {
+		return node(Node::OFFSETS);
+	}
+
+	Node* structs(const std::string& bytes, size_t nelements, size_t element_align) {
+		Node* n = node(Node::STRUCTS);
+		n->bytes = bytes;
+		n->nelements = nelements;
+		n->element_align = element_align;
+		return n;
+	}
+
+	/* Lays out the tree under <c>root</c>, padded to a multiple of 8 bytes */
+	std::string finish(Node* root) {
+		my_out.clear();
+		my_out.append(4, '\0');
+		size_t root_pos = put(root);
+		putLittleEndian(&my_out[0], root_pos, 4);
+		align(8);
+		return my_out;
+	}
+
+private:
+	Node* node(Node::Kind kind) {
+		Node* n = new Node();
+		n->kind = kind;
+		n->nelements = 0;
+		n->element_align = 1;
+		my_nodes.push_back(n);
+		return n;
+	}
+
+	void align(size_t alignment) {
+		while(my_out.size() % alignment != 0) {
+			my_out.push_back('\0');
+		}
+	}
+
+	void append(unsigned long long value, size_t size) {
+		char bytes[8];
+		putLittleEndian(bytes, value, size);
+		my_out.append(bytes, size);
+	}
+
+	void patchOffset(size_t at, size_t target) {
+		putLittleEndian(&my_out[at], target - at, 4);
+	}
+
+	size_t put(Node* n) {
+		size_t pos = 0;
+		switch(n->kind) {
+			case Node::TABLE: {
+				int nfields = 0;
+				for(size_t j = 0; j < n->slots.size(); j++) {
+					nfields = std::max(nfields, n->slots[j].index + 1);
+				}
+
+				// Widest scalars first, after the offset to the vtable
+				std::vector<size_t> field_offsets(nfields, 0);
+				std::vector<size_t> slot_offsets(n->slots.size(), 0);
+				size_t cursor = 4;
+				for(size_t size = 8; size >= 1; size /= 2) {
+					for(size_t j = 0; j < n->slots.size(); j++) {
+						if(n->slots[j].size == size) {
+							cursor = (cursor + size - 1) / size * size;
+							slot_offsets[j] = cursor;
+							field_offsets[n->slots[j].index] = cursor;
+							cursor += size;
+						}
+					}
+				}
+				size_t table_size = (cursor + 3) / 4 * 4;
+
+				align(2);
+				size_t vtable_pos = my_out.size();
+				append(4 + 2 * nfields, 2);
+				append(table_size, 2);
+				for(int i = 0; i < nfields; i++) {
+					append(field_offsets[i], 2);
+				}
+
+				align(8);
+				pos = my_out.size();
+				my_out.append(table_size, '\0');
+				putLittleEndian(&my_out[pos], pos - vtable_pos, 4);
+				for(size_t j = 0; j < n->slots.size(); j++) {
+					if(n->slots[j].child == NULL) {
+						putLittleEndian(&my_out[pos + slot_offsets[j]], n->slots[j].value, n->slots[j].size);
+					}
+				}
+				for(size_t j = 0; j < n->slots.size(); j++) {
+					if(n->slots[j].child != NULL) {
+						size_t child_pos = put(n->slots[j].child);
+						patchOffset(pos + slot_offsets[j], child_pos);
+					}
+				}
+				break;
+			}
+			case Node::OFFSETS: {
+				align(4);
+				pos = my_out.size();
+				append(n->elements.size(), 4);
+				my_out.append(4 * n->elements.size(), '\0');
+				for(size_t i = 0; i < n->elements.size(); i++) {
+					size_t child_pos = put(n->elements[i]);
+					patchOffset(pos + 4 + 4 * i, child_pos);
+				}
+				break;
+			}
+			case Node::STRUCTS: {
+				// The elements follow the length, and are aligned
+				while((my_out.size() + 4) % n->element_align != 0) {
+					my_out.push_back('\0');
+				}
+				pos = my_out.size();
+				append(n->nelements, 4);
+				my_out.append(n->bytes);
+				break;
+			}
+			case Node::STRING: {
+				align(4);
+				pos = my_out.size();
+				append(n->bytes.size(), 4);
+				my_out.append(n->bytes);
+				my_out.push_back('\0');
+				break;
+			}
+		}
+		return pos;
+	}
+
+	std::vector<Node*> my_nodes;
+	std::string my_out;
+};
+
+/* -----------------------------------------------------------------
+ * FlatReader. Bounds checked reads of a flatbuffer.
+ * -----------------------------------------------------------------
+ *
+ * Objects are addressed by their position in the buffer. Position 0
+ * holds the offset to the root table, so it stands for an absent
+ * object.
+ */
+class FlatReader
+{
+public:
+	FlatReader(const char* _buf, size_t _size): my_buf(_buf), my_size(_size) {}
+
+	size_t root(void) const {
+		return deref(0);
+	}
+
+	/* Position of field <c>index</c> of the table at <c>table</c>, or 0 if it is not set */
+	size_t field(size_t table, int index) const {
+		size_t vtable = (size_t) ((long long) table - (long long) (int) read(table, 4));
+		size_t vtable_size = (size_t) read(vtable, 2);
+		size_t at = 4 + 2 * (size_t) index;
+		if(at + 2 > vtable_size) {
+			return 0;
+		}
+		size_t offset = (size_t) read(vtable + at, 2);
+		return offset == 0 ? 0 : table + offset;
+	}
+
+	unsigned long long scalar(size_t table, int index, size_t size, unsigned long long default_value) const {
+		size_t pos = field(table, index);
+		return pos == 0 ? default_value : read(pos, size);
+	}
+
+	/* Position of the table, vector or string that field <c>index</c> refers to, or 0 */
+	size_t child(size_t table, int index) const {
+		size_t pos = field(table, index);
+		return pos == 0 ? 0 : deref(pos);
+	}
+
+	size_t length(size_t vector) const {
+		return vector == 0 ? 0 : (size_t) read(vector, 4);
+	}
+
+	/* Position of element <c>i</c> of a vector of tables */
+	size_t element(size_t vector, size_t i) const {
+		return deref(vector + 4 + 4 * i);
+	}
+
+	/* Position of element <c>i</c> of a vector of structs of <c>size</c> bytes */
+	size_t structElement(size_t vector, size_t i, size_t size) const {
+		size_t pos = vector + 4 + size * i;
+		check(pos, size);
+		return pos;
+	}
+
+	std::string string(size_t pos) const {
+		if(pos == 0) {
+			return std::string();
+		}
+		size_t n = (size_t) read(pos, 4);
+		check(pos + 4, n);
+		return std::string(my_buf + pos + 4, n);
+	}
+
+	unsigned long long read(size_t pos, size_t size) const {
+		check(pos, size);
+		return getLittleEndian(my_buf + pos, size);
+	}
+
+private:
+	size_t deref(size_t pos) const {
+		size_t target = pos + (size_t) read(pos, 4);
+		check(target, 4);
+		return target;
+	}
+
+	void check(size_t pos, size_t size) const {
+		if(pos > my_size || size > my_size - pos) {
+			throw ArrowException("Message metadata is corrupt.");
+		}
+	}
+
+	const char* my_buf;
+	size_t my_size;
+};
+
+/* Describes the column of field <c>ifield</c> of <c>structure</c> in an Arrow schema */
+FlatBuilder::Node* fieldTable(FlatBuilder& fb, tsdb::Structure& structure, size_t ifield) {
+	tsdb::Field* field = structure.getField(ifield);
+	FlatBuilder::Node* type = fb.table();
+	int type_type = 0;
+
+	switch(field->getFieldType()) {
+		case tsdb::Field::TIMESTAMP:
+			type_type = TYPE_TIMESTAMP;
+			fb.scalar(type, 0, 2, UNIT_MILLISECOND);
+			break;
+		case tsdb::Field::DOUBLE:
+			type_type = TYPE_FLOATING_POINT;
+			fb.scalar(type, 0, 2, 2);    // DOUBLE precision
+			break;
+		case tsdb::Field::INT32:
+			type_type = TYPE_INT;
+			fb.scalar(type, 0, 4, 32);
+			fb.scalar(type, 1, 1, 1);
+			break;
+		case tsdb::Field::INT8:
+			type_type = TYPE_INT;
+			fb.scalar(type, 0, 4, 8);
+			fb.scalar(type, 1, 1, 1);
+			break;
+		case tsdb::Field::RECORD:
+			type_type = TYPE_INT;
+			fb.scalar(type, 0, 4, 64);
+			fb.scalar(type, 1, 1, 0);
+			break;
+		case tsdb::Field::DATE:
+			type_type = TYPE_DATE;
+			fb.scalar(type, 0, 2, DATE_DAY);
+			break;
+		case tsdb::Field::CHAR:
+		case tsdb::Field::STRING:
+			type_type = TYPE_FIXED_SIZE_BINARY;
+			fb.scalar(type, 0, 4, structure.getSizeOfField(ifield));
+			break;
+		case tsdb::Field::SYMBOL:
+			type_type = TYPE_FIXED_SIZE_BINARY;
+			fb.scalar(type, 0, 4, ((tsdb::SymbolField*) field)->symbols()->maxLength());
+			break;
+		default:
+			throw ArrowException("Field '" + field->getName() + "' has a type that can not be written to Arrow.");
+	}
+
+	FlatBuilder::Node* table = fb.table();
+	fb.child(table, 0, fb.string(field->getName()));
+	fb.scalar(table, 1, 1, 0);           // not nullable
+	fb.scalar(table, 2, 1, type_type);
+	fb.child(table, 3, type);
+	fb.child(table, 5, fb.offsets());    // no children
+	return table;
+}
+
+FlatBuilder::Node* schemaTable(FlatBuilder& fb, tsdb::Structure& structure) {
+	FlatBuilder::Node* fields = fb.offsets();
+	for(size_t i = 0; i < structure.getNFields(); i++) {
+		fields->elements.push_back(fieldTable(fb, structure, i));
+	}
+
+	FlatBuilder::Node* schema = fb.table();
+	fb.scalar(schema, 0, 2, hostIsLittleEndian() ? 0 : 1);
+	fb.child(schema, 1, fields);
+	return schema;
+}
+
+/* Bytes of one value of a field in an Arrow column */
+size_t columnWidth(tsdb::Structure& structure, size_t ifield) {
+	switch(structure.getField(ifield)->getFieldType()) {
+		case tsdb::Field::INT32:
+		case tsdb::Field::DATE:
+			return 4;
+		case tsdb::Field::INT8:
+			return 1;
+		case tsdb::Field::SYMBOL:
+			return ((tsdb::SymbolField*) structure.getField(ifield))->symbols()->maxLength();
+		default:
+			return structure.getSizeOfField(ifield);
+	}
+}
+
+} // namespace
+
+
+/* ====================================================================
+ * class ArrowWriter
+ * ====================================================================
+ */
+
+/** <summary>Starts an Arrow IPC file with the schema of <c>_structure</c></summary>
+ * <remarks>Throws an ArrowException if a field has a type that Arrow can not hold, or the schema can
+ * not be written.</remarks>
+ */
+ArrowWriter::ArrowWriter(const boost::shared_ptr<tsdb::Structure>& _structure, FILE* _out):
+	my_structure(_structure), my_out(_out), my_bytes_written(0), my_closed(false) {
+
+	FlatBuilder fb;
+	FlatBuilder::Node* message = fb.table();
+	fb.scalar(message, 0, 2, METADATA_V5);
+	fb.scalar(message, 1, 1, HEADER_SCHEMA);
+	fb.child(message, 2, schemaTable(fb, *my_structure));
+	fb.scalar(message, 3, 8, 0);
+
+	writeBytes(MAGIC, sizeof(MAGIC));
+	Block block;
+	writeMessage(fb.finish(message), std::vector<char>(), &block);
+}
+
+/** <summary>Closes the file if close() was not called, ignoring errors</summary> */
+ArrowWriter::~ArrowWriter(void) {
+	if(!my_closed) {
+		try {
+			close();
+		} catch(...) {
+		}
+	}
+}
+
+/** <summary>Writes <c>nrecords</c> records as one record batch</summary>
+ * <remarks>Batches are read back one at a time, so blocks of a few thousand records or more are
+ * best. Nothing is written for an empty block.</remarks>
+ */
+void ArrowWriter::write(const char* records, size_t nrecords) {
+	if(my_closed) {
+		throw ArrowException("Can not write to a closed file.");
+	}
+	if(nrecords == 0) {
+		return;
+	}
+
+	const size_t nfields = my_structure->getNFields();
+	const size_t record_size = my_structure->getSizeOf();
+	std::string nodes;
+	std::string buffers;
+	char entry[16];
+
+	my_body.clear();
+	for(size_t i = 0; i < nfields; i++) {
+		const size_t offset = my_structure->getOffsetOfField(i);
+		const size_t size = my_structure->getSizeOfField(i);
+		const size_t width = columnWidth(*my_structure, i);
+
+		putLittleEndian(entry, nrecords, 8);
+		putLittleEndian(entry + 8, 0, 8);
+		nodes.append(entry, 16);
+
+		// An empty validity buffer, then the values
+		const size_t start = my_body.size();
+		putLittleEndian(entry, start, 8);
+		putLittleEndian(entry + 8, 0, 8);
+		buffers.append(entry, 16);
+		putLittleEndian(entry + 8, nrecords * width, 8);
+		buffers.append(entry, 16);
+
+		my_body.resize(start + (nrecords * width + 7) / 8 * 8, '\0');
+		char* out = &my_body[start];
+		const char* value = records + offset;
+
+		if(my_structure->getField(i)->getFieldType() == tsdb::Field::SYMBOL) {
+			// Symbols are written as the strings they stand for
+			tsdb::SymbolTable& dictionary = *((tsdb::SymbolField*) my_structure->getField(i))->symbols();
+			std::vector<std::string> symbols = dictionary.symbols(0);
+			for(size_t r = 0; r < nrecords; r++) {
+				tsdb::symbol_t code;
+				memcpy(&code, value, sizeof(code));
+				if(code < 0 || (size_t) code >= symbols.size()) {
+					symbols = dictionary.symbols(0);
+					dictionary.symbol(code);  // throws if the code is still unknown
+				}
+				memcpy(out, symbols[code].data(), symbols[code].size());
+				out += width;
+				value += record_size;
+			}
+		} else if(width == size) {
+			for(size_t r = 0; r < nrecords; r++) {
+				memcpy(out, value, width);
+				out += width;
+				value += record_size;
+			}
+		} else {
+			// INT32 and DATE values are longs in memory
+			for(size_t r = 0; r < nrecords; r++) {
+				long v;
+				memcpy(&v, value, sizeof(v));
+				int narrowed = (int) v;
+				memcpy(out, &narrowed, 4);
+				out += 4;
+				value += record_size;
+			}
+		}
+	}
+
+	FlatBuilder fb;
+	FlatBuilder::Node* batch = fb.table();
+	fb.scalar(batch, 0, 8, nrecords);
+	fb.child(batch, 1, fb.structs(nodes, nfields, 8));
+	fb.child(batch, 2, fb.structs(buffers, 2 * nfields, 8));
+
+	FlatBuilder::Node* message = fb.table();
+	fb.scalar(message, 0, 2, METADATA_V5);
+	fb.scalar(message, 1, 1, HEADER_RECORD_BATCH);
+	fb.child(message, 2, batch);
+	fb.scalar(message, 3, 8, my_body.size());
+
+	Block block;
+	writeMessage(fb.finish(message), my_body, &block);
+	my_batches.push_back(block);
+}
+
+/** <summary>Ends the stream of batches and writes the footer, which completes the file</summary>
+ * <remarks>Does not close or flush the FILE.</remarks>
+ */
+void ArrowWriter::close(void) {
+	if(my_closed) {
+		return;
+	}
+	my_closed = true;
+
+	char end_of_stream[8];
+	putLittleEndian(end_of_stream, CONTINUATION, 4);
+	putLittleEndian(end_of_stream + 4, 0, 4);
+	writeBytes(end_of_stream, sizeof(end_of_stream));
+
+	std::string blocks;
+	for(size_t i = 0; i < my_batches.size(); i++) {
+		char entry[24];
+		putLittleEndian(entry, my_batches[i].offset, 8);
+		putLittleEndian(entry + 8, my_batches[i].metadata_length, 4);
+		putLittleEndian(entry + 12, 0, 4);
+		putLittleEndian(entry + 16, my_batches[i].body_length, 8);
+		blocks.append(entry, 24);
+	}
+
+	FlatBuilder fb;
+	FlatBuilder::Node* footer = fb.table();
+	fb.scalar(footer, 0, 2, METADATA_V5);
+	fb.child(footer, 1, schemaTable(fb, *my_structure));
+	fb.child(footer, 2, fb.structs(std::string(), 0, 8));
+	fb.child(footer, 3, fb.structs(blocks, my_batches.size(), 8));
+	std::string footer_bytes = fb.finish(footer);
+
+	char footer_size[4];
+	putLittleEndian(footer_size, footer_bytes.size(), 4);
+	writeBytes(footer_bytes.data(), footer_bytes.size());
+	writeBytes(footer_size, sizeof(footer_size));
+	writeBytes(MAGIC, 6);
+}
+
+/** <summary>Returns the number of bytes written to the FILE so far</summary> */
+unsigned long long ArrowWriter::bytesWritten(void) const {
+	return my_bytes_written;
+}
+
+/** <summary>Writes the records of <c>ts</c> from <c>start</c> to <c>end</c>, inclusive, as an Arrow IPC
+ * file, and returns the number of records written</summary>
+ * <remarks>There is one record batch per buffer of a BufferedRecordSet, read ahead while the last one is
+ * written.</remarks>
+ */
+hsize_t ArrowWriter::writeRange(tsdb::Timeseries& ts, tsdb::timestamp_t start, tsdb::timestamp_t end, FILE* out) {
+	BufferedRecordSet records = ts.bufferedRecordSet(start, end);
+	ArrowWriter writer(ts.structure(), out);
+
+	if(records.size() > 0) {
+		records.setPrefetch(true);
+	}
+	hsize_t i = 0;
+	while(i < records.size()) {
+		hsize_t buf_first;
+		size_t nbufrecords;
+		const char* buf = records.buffer(i, &buf_first, &nbufrecords);
+		writer.write(buf, nbufrecords);
+		i = buf_first + nbufrecords;
+	}
+	writer.close();
+	return records.size();
+}
+
+/** <summary>Writes an encapsulated message: a continuation marker, the length of the metadata, the metadata
+ * and the body</summary>
+ */
+void ArrowWriter::writeMessage(const std::string& metadata, const std::vector<char>& body,
+	tsdb::ArrowWriter::Block* block) {
+
+	char prefix[8];
+	putLittleEndian(prefix, CONTINUATION, 4);
+	putLittleEndian(prefix + 4, metadata.size(), 4);
+
+	block->offset = (long long) my_bytes_written;
+	block->metadata_length = (long long) (sizeof(prefix) + metadata.size());
+	block->body_length = (long long) body.size();
+
+	writeBytes(prefix, sizeof(prefix));
+	writeBytes(metadata.data(), metadata.size());
+	if(!body.empty()) {
+		writeBytes(&body[0], body.size());
+	}
+}
+
+void ArrowWriter::writeBytes(const void* bytes, size_t nbytes) {
+	if(fwrite(bytes, 1, nbytes, my_out) != nbytes) {
+		throw ArrowException("Unable to write to the output file.");
+	}
+	my_bytes_written += nbytes;
+}
+
+
+/* ====================================================================
+ * class ArrowReader
+ * ====================================================================
+ */
+
+/** <summary>Reads the schema at the start of <c>_in</c> and matches its columns to the fields of
+ * <c>_structure</c></summary>
+ * <remarks>Throws an ArrowException if the input is not an Arrow IPC file or stream, or if a field has no
+ * column it can be read from.</remarks>
+ */
+ArrowReader::ArrowReader(const boost::shared_ptr<tsdb::Structure>& _structure, FILE* _in):
+	my_structure(_structure), my_in(_in), my_done(false) {
+
+	// A file starts with the magic string, and then is a stream
+	unsigned char first[4];
+	readBytes(first, sizeof(first));
+	bool found;
+	if(memcmp(first, MAGIC, 4) == 0) {
+		unsigned char rest[4];
+		readBytes(rest, sizeof(rest));
+		if(memcmp(rest, MAGIC + 4, 4) != 0) {
+			throw ArrowException("Input is not an Arrow IPC file or stream.");
+		}
+		found = readMessage(my_metadata);
+	} else {
+		found = readMessage(my_metadata, first);
+	}
+	if(!found) {
+		throw ArrowException("Input has no schema.");
+	}
+	readSchema(my_metadata);
+
+	// Match the fields to columns
+	for(size_t i = 0; i < my_structure->getNFields(); i++) {
+		tsdb::Field* field = my_structure->getField(i);
+		tsdb::Field::FieldType field_type = field->getFieldType();
+
+		int icolumn = -1;
+		for(size_t c = 0; c < my_columns.size() && icolumn < 0; c++) {
+			if(my_columns[c].name == field->getName()) {
+				icolumn = (int) c;
+			}
+		}
+		for(size_t c = 0; c < my_columns.size() && icolumn < 0 && field_type == tsdb::Field::TIMESTAMP; c++) {
+			if(my_columns[c].type == TYPE_TIMESTAMP) {
+				icolumn = (int) c;
+			}
+		}
+		if(icolumn < 0) {
+			throw ArrowException("No column for field '" + field->getName() + "'.");
+		}
+
+		const Column& column = my_columns[icolumn];
+		const bool is_int = column.type == TYPE_INT;
+		const bool is_float = column.type == TYPE_FLOATING_POINT && column.bit_width >= 32;
+		const bool is_time = column.type == TYPE_TIMESTAMP || column.type == TYPE_DATE;
+		const bool is_bytes = column.type == TYPE_FIXED_SIZE_BINARY || column.type == TYPE_BINARY ||
+			column.type == TYPE_UTF8 || column.type == TYPE_LARGE_BINARY || column.type == TYPE_LARGE_UTF8;
+
+		bool convertible = false;
+		switch(field_type) {
+			case tsdb::Field::TIMESTAMP:
+			case tsdb::Field::DATE:
+				convertible = is_time || is_int;
+				break;
+			case tsdb::Field::DOUBLE:
+				convertible = is_float || is_int;
+				break;
+			case tsdb::Field::INT32:
+			case tsdb::Field::INT8:
+			case tsdb::Field::RECORD:
+				convertible = is_int;
+				break;
+			case tsdb::Field::CHAR:
+			case tsdb::Field::STRING:
+			case tsdb::Field::SYMBOL:
+				convertible = is_bytes;
+				break;
+			default:
+				break;
+		}
+		if(!convertible) {
+			throw ArrowException("Column '" + column.name + "' can not be read into field '" +
+				field->getName() + "'.");
+		}
+		my_field_columns.push_back(icolumn);
+	}
+}
+
+ArrowReader::~ArrowReader(void) {
+}
+
+/** <summary>Reads the next record batch into <c>records</c>, and returns its number of records</summary>
+ * <remarks>Returns 0 at the end of the input. Empty batches are skipped.</remarks>
+ */
+size_t ArrowReader::readBatch(std::vector<char>& records) {
+	while(!my_done) {
+		if(!readMessage(my_metadata)) {
+			my_done = true;
+			break;
+		}
+
+		FlatReader fr(&my_metadata[0], my_metadata.size());
+		size_t message = fr.root();
+		int header_type = (int) fr.scalar(message, 1, 1, 0);
+		long long body_length = (long long) fr.scalar(message, 3, 8, 0);
+		if(body_length < 0) {
+			throw ArrowException("Message metadata is corrupt.");
+		}
+		my_body.resize((size_t) body_length);
+		if(body_length > 0) {
+			readBytes(&my_body[0], my_body.size());
+		}
+
+		if(header_type == HEADER_DICTIONARY_BATCH) {
+			throw ArrowException("Dictionary encoded columns are not supported.");
+		} else if(header_type != HEADER_RECORD_BATCH) {
+			continue;
+		}
+
+		size_t batch = fr.child(message, 2);
+		if(batch == 0) {
+			throw ArrowException("Record batch message has no record batch.");
+		}
+		if(fr.field(batch, 3) != 0) {
+			throw ArrowException("Compressed record batches are not supported.");
+		}
+		const size_t nrecords = (size_t) fr.scalar(batch, 0, 8, 0);
+		if(nrecords == 0) {
+			continue;
+		}
+		size_t nodes = fr.child(batch, 1);
+		size_t buffers = fr.child(batch, 2);
+
+		records.assign(nrecords * my_structure->getSizeOf(), '\0');
+		for(size_t i = 0; i < my_field_columns.size(); i++) {
+			const Column& column = my_columns[my_field_columns[i]];
+			const size_t node = fr.structElement(nodes, (size_t) my_field_columns[i], 16);
+			if(fr.read(node, 8) != nrecords) {
+				throw ArrowException("Column '" + column.name + "' is not as long as its record batch.");
+			}
+			const bool has_nulls = fr.read(node + 8, 8) != 0;
+
+			const char* pointers[3] = { NULL, NULL, NULL };
+			size_t lengths[3] = { 0, 0, 0 };
+			const int nbuffers = (column.type == TYPE_BINARY || column.type == TYPE_UTF8 ||
+				column.type == TYPE_LARGE_BINARY || column.type == TYPE_LARGE_UTF8) ? 3 : 2;
+			for(int b = 0; b < nbuffers; b++) {
+				const size_t buffer = fr.structElement(buffers, (size_t) (column.first_buffer + b), 16);
+				const unsigned long long offset = fr.read(buffer, 8);
+				const unsigned long long length = fr.read(buffer + 8, 8);
+				if(offset > my_body.size() || length > my_body.size() - offset) {
+					throw ArrowException("Buffer of column '" + column.name + "' is outside of its record batch.");
+				}
+				pointers[b] = my_body.empty() ? NULL : &my_body[0] + offset;
+				lengths[b] = (size_t) length;
+			}
+			if(!has_nulls || lengths[0] == 0) {
+				pointers[0] = NULL;
+			} else if(lengths[0] < (nrecords + 7) / 8) {
+				throw ArrowException("Validity buffer of column '" + column.name + "' is too short.");
+			}
+
+			convertColumn(i, column, nrecords, pointers[0], pointers[1], lengths[1], pointers[2], lengths[2],
+				&records[0]);
+		}
+		return nrecords;
+	}
+	return 0;
+}
+
+/** <summary>Returns the names of the columns in the input</summary> */
+const std::vector<std::string>& ArrowReader::columnNames(void) const {
+	return my_column_names;
+}
+
+/** <summary>Appends the records of the Arrow IPC file or stream <c>in</c> to <c>ts</c>, and returns the number of
+ * records appended</summary>
+ * <remarks>The records must be in timestamp order. Records before the end of the series are discarded if
+ * <c>discard_overlap</c> is true, and throw a TimeseriesException otherwise, as in
+ * Timeseries::appendRecords().</remarks>
+ */
+hsize_t ArrowReader::appendFile(tsdb::Timeseries& ts, FILE* in, bool discard_overlap) {
+	ArrowReader reader(ts.structure(), in);
+	std::vector<char> records;
+	hsize_t nappended = 0;
+	size_t nrecords;
+	while((nrecords = reader.readBatch(records)) > 0) {
+		int ndiscarded = ts.appendRecords(nrecords, &records[0], discard_overlap);
+		nappended += nrecords - (discard_overlap && ndiscarded > 0 ? ndiscarded : 0);
+	}
+	return nappended;
+}
+
+/** <summary>Reads an encapsulated message's metadata, and returns false at the end of the stream</summary>
+ * <remarks><c>first_word</c> is the first four bytes of the message, if they were read already. Messages
+ * without a continuation marker, written before Arrow 0.15, are read too.</remarks>
+ */
+bool ArrowReader::readMessage(std::vector<char>& metadata, const unsigned char* first_word) {
+	char word[4];
+	if(first_word != NULL) {
+		memcpy(word, first_word, 4);
+	} else {
+		size_t nread = fread(word, 1, 4, my_in);
+		if(nread == 0 && feof(my_in)) {
+			return false;
+		} else if(nread != 4) {
+			throw ArrowException("Input ends in the middle of a message.");
+		}
+	}
+
+	unsigned long long length = getLittleEndian(word, 4);
+	if(length == CONTINUATION) {
+		readBytes(word, 4);
+		length = getLittleEndian(word, 4);
+	}
+	if(length == 0) {
+		return false;
+	}
+	if(length > 0x7FFFFFFF) {
+		throw ArrowException("Message metadata is corrupt.");
+	}
+
+	metadata.resize((size_t) length);
+	readBytes(&metadata[0], metadata.size());
+	return true;
+}
+
+/** <summary>Reads the columns of a schema message</summary> */
+void ArrowReader::readSchema(const std::vector<char>& metadata) {
+	FlatReader fr(&metadata[0], metadata.size());
+	size_t message = fr.root();
+	if(fr.scalar(message, 1, 1, 0) != (unsigned long long) HEADER_SCHEMA) {
+		throw ArrowException("Input does not start with a schema.");
+	}
+	if(fr.scalar(message, 3, 8, 0) != 0) {
+		throw ArrowException("Schema message has a body.");
+	}
+	size_t schema = fr.child(message, 2);
+	if(schema == 0) {
+		throw ArrowException("Schema message has no schema.");
+	}
+	if((fr.scalar(schema, 0, 2, 0) == 0) != hostIsLittleEndian()) {
+		throw ArrowException("Input is not in the byte order of this machine.");
+	}
+
+	size_t fields = fr.child(schema, 1);
+	int next_buffer = 0;
+	for(size_t i = 0; i < fr.length(fields); i++) {
+		size_t field = fr.element(fields, i);
+		size_t type = fr.child(field, 3);
+
+		Column column;
+		column.name = fr.string(fr.child(field, 0));
+		column.type = (int) fr.scalar(field, 2, 1, 0);
+		column.bit_width = 0;
+		column.is_signed = true;
+		column.unit = 0;
+		column.byte_width = 0;
+		column.first_buffer = next_buffer;
+
+		if(fr.child(field, 4) != 0) {
+			throw ArrowException("Column '" + column.name + "' is dictionary encoded, which is not supported.");
+		}
+		if(fr.length(fr.child(field, 5)) != 0) {
+			throw ArrowException("Column '" + column.name + "' has a nested type, which is not supported.");
+		}
+
+		switch(column.type) {
+			case TYPE_NULL:
+				break;
+			case TYPE_INT:
+				column.bit_width = type == 0 ? 0 : (int) fr.scalar(type, 0, 4, 0);
+				column.is_signed = type == 0 ? false : fr.scalar(type, 1, 1, 0) != 0;
+				next_buffer += 2;
+				break;
+			case TYPE_FLOATING_POINT: {
+				int precision = type == 0 ? 0 : (int) fr.scalar(type, 0, 2, 0);
+				column.bit_width = precision == 2 ? 64 : (precision == 1 ? 32 : 16);
+				next_buffer += 2;
+				break;
+			}
+			case TYPE_TIMESTAMP:
+				column.bit_width = 64;
+				column.unit = type == 0 ? UNIT_SECOND : (int) fr.scalar(type, 0, 2, UNIT_SECOND);
+				next_buffer += 2;
+				break;
+			case TYPE_DATE:
+				column.unit = type == 0 ? DATE_MILLISECOND : (int) fr.scalar(type, 0, 2, DATE_MILLISECOND);
+				column.bit_width = column.unit == DATE_DAY ? 32 : 64;
+				next_buffer += 2;
+				break;
+			case TYPE_FIXED_SIZE_BINARY:
+				column.byte_width = type == 0 ? 0 : (int) fr.scalar(type, 0, 4, 0);
+				next_buffer += 2;
+				break;
+			case TYPE_BINARY:
+			case TYPE_UTF8:
+				column.bit_width = 32;    // of the offsets
+				next_buffer += 3;
+				break;
+			case TYPE_LARGE_BINARY:
+			case TYPE_LARGE_UTF8:
+				column.bit_width = 64;
+				next_buffer += 3;
+				break;
+			case TYPE_BOOL:
+			case TYPE_DECIMAL:
+			case TYPE_TIME:
+			case TYPE_INTERVAL:
+			case TYPE_DURATION:
+				next_buffer += 2;
+				break;
+			default:
+				throw ArrowException("Column '" + column.name + "' has a type that is not supported.");
+		}
+		if(column.type == TYPE_INT && column.bit_width != 8 && column.bit_width != 16 &&
+			column.bit_width != 32 && column.bit_width != 64) {
+			throw ArrowException("Column '" + column.name + "' has an integer width that is not supported.");
+		}
+
+		my_columns.push_back(column);
+		my_column_names.push_back(column.name);
+	}
+}
+
+void ArrowReader::readBytes(void* bytes, size_t nbytes) {
+	if(fread(bytes, 1, nbytes, my_in) != nbytes) {
+		throw ArrowException("Input ends in the middle of a message.");
+	}
+}
+
+/** <summary>Converts the values of <c>column</c> into field <c>ifield</c> of <c>nrecords</c> records</summary>
+ * <remarks><c>values</c> holds fixed width values, or the offsets of variable width ones into
+ * <c>data</c>. <c>validity</c> is NULL if no value is null.</remarks>
+ */
+void ArrowReader::convertColumn(size_t ifield, const Column& column, size_t nrecords, const char* validity,
+	const char* values, size_t values_length, const char* data, size_t data_length, char* records) {
+
+	const size_t record_size = my_structure->getSizeOf();
+	const size_t size = my_structure->getSizeOfField(ifield);
+	char* out = records + my_structure->getOffsetOfField(ifield);
+	const tsdb::Field::FieldType field_type = my_structure->getField(ifield)->getFieldType();
+
+	const bool var_width = column.type == TYPE_BINARY || column.type == TYPE_UTF8 ||
+		column.type == TYPE_LARGE_BINARY || column.type == TYPE_LARGE_UTF8;
+	const size_t width = column.type == TYPE_FIXED_SIZE_BINARY ? (size_t) column.byte_width :
+		(size_t) column.bit_width / 8;
+	const size_t needed = var_width ? (nrecords + 1) * width : nrecords * width;
+	if(values_length < needed || (needed > 0 && values == NULL)) {
+		throw ArrowException("Value buffer of column '" + column.name + "' is too short.");
+	}
+
+	for(size_t r = 0; r < nrecords; r++, out += record_size) {
+		const bool is_null = validity != NULL && ((validity[r / 8] >> (r % 8)) & 1) == 0;
+
+		if(field_type == tsdb::Field::CHAR || field_type == tsdb::Field::STRING || field_type == tsdb::Field::SYMBOL) {
+			if(is_null) {
+				continue;
+			}
+			const char* bytes = values + r * width;
+			size_t nbytes = width;
+			if(var_width) {
+				unsigned long long first = getLittleEndian(values + r * width, width);
+				unsigned long long last = getLittleEndian(values + (r + 1) * width, width);
+				if(first > last || last > data_length) {
+					throw ArrowException("Offsets of column '" + column.name + "' are outside of its data.");
+				}
+				bytes = data + first;
+				nbytes = (size_t) (last - first);
+			}
+			if(field_type == tsdb::Field::SYMBOL) {
+				// A fixed size column pads the symbol with NULs, which are not part of it
+				nbytes = std::find(bytes, bytes + nbytes, '\0') - bytes;
+				tsdb::symbol_t code = ((tsdb::SymbolField*) my_structure->getField(ifield))->symbols()->code(bytes, nbytes);
+				memcpy(out, &code, sizeof(code));
+				continue;
+			}
+			memcpy(out, bytes, std::min(nbytes, size));
+			continue;
+		}
+
+		if(column.type == TYPE_FLOATING_POINT) {
+			double v;
+			if(column.bit_width == 64) {
+				memcpy(&v, values + 8 * r, 8);
+			} else {
+				float f;
+				memcpy(&f, values + 4 * r, 4);
+				v = f;
+			}
+			if(is_null) {
+				v = std::numeric_limits<double>::quiet_NaN();
+			}
+			memcpy(out, &v, sizeof(v));
+			continue;
+		}
+
+		// Everything else is stored as integers
+		long long v = 0;
+		const char* value = values + r * width;
+		switch(column.bit_width) {
+			case 8:
+				v = column.is_signed ? (long long) *((const signed char*) value) : (long long) *((const unsigned char*) value);
+				break;
+			case 16: {
+				unsigned long long u = getLittleEndian(value, 2);
+				v = column.is_signed ? (long long) (short) u : (long long) u;
+				break;
+			}
+			case 32: {
+				unsigned long long u = getLittleEndian(value, 4);
+				v = column.is_signed ? (long long) (int) u : (long long) u;
+				break;
+			}
+			default:
+				memcpy(&v, value, 8);
+				break;
+		}
+
+		switch(field_type) {
+			case tsdb::Field::TIMESTAMP: {
+				if(is_null) {
+					throw ArrowException("Column '" + column.name + "' has a null timestamp.");
+				}
+				tsdb::timestamp_t ms = v;
+				if(column.type == TYPE_TIMESTAMP) {
+					ms = column.unit == UNIT_SECOND ? v * 1000 :
+						(column.unit == UNIT_MICROSECOND ? floorDiv(v, 1000) :
+						(column.unit == UNIT_NANOSECOND ? floorDiv(v, 1000000) : v));
+				} else if(column.type == TYPE_DATE && column.unit == DATE_DAY) {
+					ms = v * MS_PER_DAY;
+				}
+				memcpy(out, &ms, sizeof(ms));
+				break;
+			}
+			case tsdb::Field::DATE: {
+				tsdb::date_t days = (tsdb::date_t) v;
+				if(column.type == TYPE_TIMESTAMP) {
+					long long ms = column.unit == UNIT_SECOND ? v * 1000 :
+						(column.unit == UNIT_MICROSECOND ? floorDiv(v, 1000) :
+						(column.unit == UNIT_NANOSECOND ? floorDiv(v, 1000000) : v));
+					days = (tsdb::date_t) floorDiv(ms, MS_PER_DAY);
+				} else if(column.type == TYPE_DATE && column.unit == DATE_MILLISECOND) {
+					days = (tsdb::date_t) floorDiv(v, MS_PER_DAY);
+				}
+				if(is_null) {
+					days = 0;
+				}
+				memcpy(out, &days, sizeof(days));
+				break;
+			}
+			case tsdb::Field::DOUBLE: {
+				double d = is_null ? std::numeric_limits<double>::quiet_NaN() :
+					(column.is_signed ? (double) v : (double) (unsigned long long) v);
+				memcpy(out, &d, sizeof(d));
+				break;
+			}
+			case tsdb::Field::INT32: {
+				tsdb::int32_t i = is_null ? 0 : (tsdb::int32_t) v;
+				memcpy(out, &i, sizeof(i));
+				break;
+			}
+			case tsdb::Field::INT8: {
+				*((tsdb::int8_t*) out) = is_null ? 0 : (tsdb::int8_t) v;
+				break;
+			}
+			case tsdb::Field::RECORD: {
+				tsdb::record_t u = is_null ? 0 : (tsdb::record_t) v;
+				memcpy(out, &u, sizeof(u));
+				break;
+			}
+			default:
+				break;
+		}
+	}
+}
+
+} // namespace tsdb
@@ -0,0 +1,156 @@
+#pragma once
+
+/* STL Classes */
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <stdio.h>
+
+/* External Libraries */
+#include "hdf5.h"
+#include <boost/shared_ptr.hpp>
+
+/* TSDB Includes */
+#include "tsdb.h"
+#include "field.h"
+#include "structure.h"
+
+namespace tsdb {
+
+/* Forward declarations */
+class Timeseries;
+
+/* -----------------------------------------------------------------
+ * ArrowException. For runtime errors thrown while writing or reading
+ * Arrow IPC data.
+ * -----------------------------------------------------------------
+ */
+class  ArrowException:
+	public std::runtime_error
+{
+public:
+	ArrowException(const std::string& what):
+	  std::runtime_error(std::string("ArrowException: ") + what) {}
+};
+
+/* -----------------------------------------------------------------
+ * ArrowWriter. Writes records as an Arrow IPC file.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>Writes blocks of records to a FILE in the Arrow IPC file format, one record batch per block</summary>
+ * <remarks><p>This is the format of Feather version 2 files, which pandas, pyarrow, Spark and DuckDB read
+ * directly, so handing a range of a series to them does not go through text. Each field becomes a
+ * column:</p>
+ * <list type="table">
+ * <item><term>TimestampField</term><description>timestamp[ms], without a time zone</description></item>
+ * <item><term>DoubleField</term><description>float64</description></item>
+ * <item><term>Int32Field</term><description>int32</description></item>
+ * <item><term>Int8Field</term><description>int8</description></item>
+ * <item><term>DateField</term><description>date32, days since the epoch</description></item>
+ * <item><term>RecordField</term><description>uint64</description></item>
+ * <item><term>CharField</term><description>fixed_size_binary[1]</description></item>
+ * <item><term>StringField</term><description>fixed_size_binary[length], NUL padded as stored</description></item>
+ * <item><term>SymbolField</term><description>fixed_size_binary[maximum length], the symbol NUL padded, as for a
+ * StringField</description></item>
+ * </list>
+ * <p>The writer has no dependencies: it builds the flatbuffer metadata itself, and writes the columns
+ * uncompressed and without validity bitmaps, since fields can not be null. The file is only complete after
+ * close(), which writes the footer. The destructor closes the file if close() was not called, but does
+ * not report errors.</p></remarks>
+ */
+class ArrowWriter
+{
+public:
+	ArrowWriter(const boost::shared_ptr<tsdb::Structure>& _structure, FILE* _out);
+	~ArrowWriter(void);
+
+	void write(const char* records, size_t nrecords);
+	void close(void);
+	unsigned long long bytesWritten(void) const;
+
+	static hsize_t writeRange(tsdb::Timeseries& ts, tsdb::timestamp_t start, tsdb::timestamp_t end, FILE* out);
+
+private:
+	/* ArrowWriters write to a FILE they do not own, so they can't be copied */
+	ArrowWriter(const ArrowWriter&);
+	ArrowWriter& operator=(const ArrowWriter&);
+
+	struct Block {
+		long long offset;
+		long long metadata_length;
+		long long body_length;
+	};
+
+	void writeMessage(const std::string& metadata, const std::vector<char>& body, tsdb::ArrowWriter::Block* block);
+	void writeBytes(const void* bytes, size_t nbytes);
+
+	boost::shared_ptr<tsdb::Structure> my_structure;
+	FILE* my_out;
+	unsigned long long my_bytes_written;
+	bool my_closed;
+	std::vector<tsdb::ArrowWriter::Block> my_batches;
+	std::vector<char> my_body;
+};
+
+/* -----------------------------------------------------------------
+ * ArrowReader. Reads an Arrow IPC file or stream into records.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>Reads the record batches of an Arrow IPC file or stream into records of a Structure</summary>
+ * <remarks><p>Each field of the Structure is read from the column with the same name. The timestamp field
+ * is read from the first timestamp column if there is no column named after it, so files written by other
+ * tools import as they are. Columns without a field are skipped. Values are converted to the type of their
+ * field where that loses nothing but precision: integer columns to any numeric field, floating point columns
+ * to double fields, timestamp and date columns of any unit to timestamp and date fields, and binary, string
+ * and fixed size binary columns to string and char fields, truncated or NUL padded to fit, and to symbol
+ * fields, adding new symbols to the dictionary. Null values become NaN in double fields, the empty symbol
+ * in symbol fields, and zero elsewhere; a null timestamp is an error.</p>
+ * <p>Batches are read one at a time, from the start of the input to its end, so a FILE that can not seek,
+ * such as a pipe, is fine. Compressed batches, dictionary encoded columns and nested types are not
+ * supported, and throw an ArrowException.</p></remarks>
+ */
+class ArrowReader
+{
+public:
+	ArrowReader(const boost::shared_ptr<tsdb::Structure>& _structure, FILE* _in);
+	~ArrowReader(void);
+
+	size_t readBatch(std::vector<char>& records);
+	const std::vector<std::string>& columnNames(void) const;
+
+	static hsize_t appendFile(tsdb::Timeseries& ts, FILE* in, bool discard_overlap);
+
+private:
+	/* ArrowReaders read from a FILE they do not own, so they can't be copied */
+	ArrowReader(const ArrowReader&);
+	ArrowReader& operator=(const ArrowReader&);
+
+	struct Column {
+		std::string name;
+		int type;            // Arrow Type union value
+		int bit_width;       // integers and floating point
+		bool is_signed;
+		int unit;            // timestamps and dates
+		int byte_width;      // fixed size binary
+		int first_buffer;    // index of the column's validity buffer in a record batch
+	};
+
+	bool readMessage(std::vector<char>& metadata, const unsigned char* first_word = NULL);
+	void readSchema(const std::vector<char>& metadata);
+	void readBytes(void* bytes, size_t nbytes);
+	void convertColumn(size_t ifield, const Column& column, size_t nrecords, const char* validity,
+		const char* values, size_t values_length, const char* data, size_t data_length, char* records);
+
+	boost::shared_ptr<tsdb::Structure> my_structure;
+	FILE* my_in;
+	std::vector<tsdb::ArrowReader::Column> my_columns;
+	std::vector<std::string> my_column_names;
+	std::vector<int> my_field_columns;    // column index of each field
+	std::vector<char> my_metadata;
+	std::vector<char> my_body;
+	bool my_done;
+};
+
+} // namespace tsdb
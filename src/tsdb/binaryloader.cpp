@@ -0,0 +1,378 @@
+/* STL includes */
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <string.h>
+#include <ctype.h>
+
+/* TSDB includes */
+#include "binaryloader.h"
+#include "field.h"
+#include "filemapping.h"
+#include "reorderbuffer.h"
+#include "timeseries.h"
+
+namespace tsdb {
+
+/** <summary>Returns <c>s</c> in lower case</summary> */
+static std::string lowerCase(const std::string& s) {
+	std::string lower(s);
+	for(size_t i = 0; i < lower.size(); i++) {
+		lower[i] = (char) tolower((unsigned char) lower[i]);
+	}
+	return lower;
+}
+
+/** <summary>Returns true if this machine stores the least significant byte first</summary> */
+static bool hostLsbFirst(void) {
+	unsigned short one = 1;
+	return *((unsigned char*) &one) == 1;
+}
+
+/* ====================================================================
+ * class BinaryLayout - the layout of fixed size binary records
+ * ====================================================================
+ */
+
+/** <summary>Creates a layout of records of <c>_record_size</c> bytes, with no fields yet</summary> */
+BinaryLayout::BinaryLayout(size_t _record_size, ByteOrder _byte_order):
+	my_record_size(_record_size), my_byte_order(_byte_order) {
+	if(_record_size == 0) {
+		throw( BinaryLoaderException("the record size must be at least 1 byte") );
+	}
+}
+
+/** <summary>Adds a field at <c>offset</c> bytes into each record</summary>
+ * <remarks>Throws a BinaryLoaderException if the type is unknown, the size is not one the type can have,
+ * the field does not fit in the record, or there already is a field of that name.</remarks>
+ * <param name="name">Name of the field in the Structure</param>
+ * <param name="type">TSDB type of the field, such as "Double"</param>
+ * <param name="offset">Offset of the field in the input record</param>
+ * <param name="size">Size of the field in the input record, or 0 for the usual size of the type</param>
+ */
+void BinaryLayout::addField(const std::string& name, const std::string& type, size_t offset, size_t size) {
+	std::string lower = lowerCase(type);
+	size_t usual;
+	if(lower == "timestamp" || lower == "record" || lower == "double") {
+		usual = 8;
+	} else if(lower == "int32" || lower == "date") {
+		usual = 4;
+	} else if(lower == "int8" || lower == "char") {
+		usual = 1;
+	} else if(lower == "string") {
+		usual = 0;
+	} else {
+		throw( BinaryLoaderException("field '" + name + "' has an unknown type '" + type + "'") );
+	}
+
+	if(size == 0) {
+		size = usual;
+	}
+	bool integer = (lower != "double" && lower != "char" && lower != "string");
+	if(size == 0 || (integer && size != 1 && size != 2 && size != 4 && size != 8) ||
+		(!integer && lower != "string" && size != usual)) {
+		std::ostringstream msg;
+		msg << "field '" << name << "' can not be a " << type << " of " << size << " bytes";
+		throw( BinaryLoaderException(msg.str()) );
+	}
+
+	if(offset > my_record_size || size > my_record_size - offset) {
+		throw( BinaryLoaderException("field '" + name + "' does not fit in the record") );
+	}
+	for(size_t i = 0; i < my_fields.size(); i++) {
+		if(my_fields[i].name == name) {
+			throw( BinaryLoaderException("field '" + name + "' is in the layout twice") );
+		}
+	}
+
+	FieldLayout field;
+	field.name = name;
+	field.type = type;
+	field.offset = offset;
+	field.size = size;
+	my_fields.push_back(field);
+}
+
+/** <summary>Returns the size of an input record in bytes</summary> */
+size_t BinaryLayout::recordSize(void) const {
+	return my_record_size;
+}
+
+/** <summary>Returns the byte order of the input records</summary> */
+BinaryLayout::ByteOrder BinaryLayout::byteOrder(void) const {
+	return my_byte_order;
+}
+
+/** <summary>Returns the fields, in the order they were added</summary> */
+const std::vector<BinaryLayout::FieldLayout>& BinaryLayout::fields(void) const {
+	return my_fields;
+}
+
+/* ====================================================================
+ * class BinaryLoader - appends binary records to a Timeseries
+ * ====================================================================
+ */
+
+/** <summary>Checks <c>_layout</c> against <c>_structure</c>, and compiles the plan that converts between
+ * them</summary>
+ * <remarks>Throws a BinaryLoaderException if a field of the layout is not in the Structure or has another
+ * type, is larger than its field in the Structure, or if the layout has no timestamp.</remarks>
+ */
+BinaryLoader::BinaryLoader(const BinaryLayout& _layout, const boost::shared_ptr<tsdb::Structure>& _structure):
+	my_structure(_structure), my_in_size(_layout.recordSize()), my_out_size(_structure->getSizeOf()),
+	my_identity(false), my_has_gaps(false), my_discarded(0) {
+
+	bool host_lsb = hostLsbFirst();
+	bool lsb_first = (_layout.byteOrder() == BinaryLayout::NATIVE_ORDER) ? host_lsb :
+		(_layout.byteOrder() == BinaryLayout::LSB_FIRST);
+
+	size_t nfields = my_structure->getNFields();
+	std::vector<bool> in_layout(nfields, false);
+	const std::vector<BinaryLayout::FieldLayout>& fields = _layout.fields();
+
+	for(size_t f = 0; f < fields.size(); f++) {
+		const BinaryLayout::FieldLayout& in = fields[f];
+		size_t i;
+		try {
+			i = my_structure->getFieldIndexByName(in.name);
+		} catch(StructureException&) {
+			throw( BinaryLoaderException("field '" + in.name + "' is not in the series") );
+		}
+		Field* field = my_structure->getField(i);
+		if(lowerCase(field->getTSDBType()) != lowerCase(in.type)) {
+			throw( BinaryLoaderException("field '" + in.name + "' is a " + field->getTSDBType() +
+				" in the series, not a " + in.type) );
+		}
+		in_layout[i] = true;
+
+		Step step;
+		step.src_offset = in.offset;
+		step.src_size = in.size;
+		step.dst_offset = my_structure->getOffsetOfField(i);
+		step.dst_size = my_structure->getSizeOfField(i);
+		step.is_signed = (field->getFieldType() != Field::RECORD);
+		step.lsb_first = lsb_first;
+
+		if(in.size > step.dst_size) {
+			std::ostringstream msg;
+			msg << "field '" << in.name << "' has " << in.size << " bytes in the layout, but only "
+				<< step.dst_size << " in the series";
+			throw( BinaryLoaderException(msg.str()) );
+		}
+
+		switch(field->getFieldType()) {
+		case Field::SYMBOL:
+			// Codes only mean something with the dictionary they came from
+			throw( BinaryLoaderException("field '" + in.name + "' is a Symbol, which can not be loaded as binary") );
+		case Field::CHAR:
+		case Field::STRING:
+			// Shorter strings are padded with zeros
+			step.kind = Step::COPY;
+			step.dst_size = in.size;
+			my_steps.push_back(step);
+			if(in.size < my_structure->getSizeOfField(i)) {
+				Step pad = step;
+				pad.kind = Step::ZERO;
+				pad.dst_offset = step.dst_offset + in.size;
+				pad.dst_size = my_structure->getSizeOfField(i) - in.size;
+				my_steps.push_back(pad);
+			}
+			break;
+		case Field::DOUBLE:
+			step.kind = (lsb_first == host_lsb) ? Step::COPY : Step::SWAP;
+			my_steps.push_back(step);
+			break;
+		default:
+			if(in.size < step.dst_size) {
+				step.kind = Step::INTEGER;
+			} else if(in.size == 1 || lsb_first == host_lsb) {
+				step.kind = Step::COPY;
+			} else {
+				step.kind = Step::SWAP;
+			}
+			my_steps.push_back(step);
+			break;
+		}
+	}
+
+	for(size_t i = 0; i < nfields; i++) {
+		if(!in_layout[i]) {
+			if(my_structure->getField(i)->getName() == "_TSDB_timestamp") {
+				throw( BinaryLoaderException("the layout has no _TSDB_timestamp field") );
+			}
+			Step zero;
+			zero.kind = Step::ZERO;
+			zero.src_offset = 0;
+			zero.src_size = 0;
+			zero.dst_offset = my_structure->getOffsetOfField(i);
+			zero.dst_size = my_structure->getSizeOfField(i);
+			zero.is_signed = false;
+			zero.lsb_first = lsb_first;
+			my_steps.push_back(zero);
+		}
+	}
+
+	// Join copies that are next to each other in both records, and zeros that are next to each other
+	std::sort(my_steps.begin(), my_steps.end(), stepBefore);
+	std::vector<Step> joined;
+	size_t covered = 0;
+	for(size_t s = 0; s < my_steps.size(); s++) {
+		const Step& step = my_steps[s];
+		covered += step.dst_size;
+		if(!joined.empty()) {
+			Step& last = joined.back();
+			bool adjacent = (last.dst_offset + last.dst_size == step.dst_offset);
+			if(adjacent && last.kind == Step::COPY && step.kind == Step::COPY &&
+				last.src_offset + last.src_size == step.src_offset) {
+				last.src_size += step.src_size;
+				last.dst_size += step.dst_size;
+				continue;
+			}
+			if(adjacent && last.kind == Step::ZERO && step.kind == Step::ZERO) {
+				last.dst_size += step.dst_size;
+				continue;
+			}
+		}
+		joined.push_back(step);
+	}
+	my_steps.swap(joined);
+
+	my_has_gaps = (covered < my_out_size);
+	my_identity = (my_in_size == my_out_size && my_steps.size() == 1 && my_steps[0].kind == Step::COPY &&
+		my_steps[0].src_offset == 0 && my_steps[0].dst_offset == 0 && my_steps[0].dst_size == my_out_size);
+}
+
+/** <summary>Orders steps by where they write in the output record</summary> */
+bool BinaryLoader::stepBefore(const Step& a, const Step& b) {
+	return a.dst_offset < b.dst_offset;
+}
+
+/** <summary>Converts <c>nrecords</c> input records at <c>in</c> to records of the Structure at
+ * <c>out</c></summary>
+ * <remarks><c>out</c> must have room for <c>nrecords</c> records of the Structure. Each step of the plan
+ * runs over all the records before the next, so the inner loops are simple.</remarks>
+ */
+void BinaryLoader::convert(const char* in, size_t nrecords, void* out) const {
+	char* dst_records = (char*) out;
+	if(my_identity) {
+		memcpy(dst_records, in, nrecords * my_in_size);
+		return;
+	}
+	if(my_has_gaps) {
+		memset(dst_records, 0, nrecords * my_out_size);
+	}
+
+	for(size_t s = 0; s < my_steps.size(); s++) {
+		const Step& step = my_steps[s];
+		const char* src = in + step.src_offset;
+		char* dst = dst_records + step.dst_offset;
+
+		switch(step.kind) {
+		case Step::COPY:
+			for(size_t r = 0; r < nrecords; r++, src += my_in_size, dst += my_out_size) {
+				memcpy(dst, src, step.dst_size);
+			}
+			break;
+		case Step::ZERO:
+			if(!my_has_gaps) {
+				for(size_t r = 0; r < nrecords; r++, dst += my_out_size) {
+					memset(dst, 0, step.dst_size);
+				}
+			}
+			break;
+		case Step::SWAP:
+			for(size_t r = 0; r < nrecords; r++, src += my_in_size, dst += my_out_size) {
+				for(size_t b = 0; b < step.dst_size; b++) {
+					dst[b] = src[step.dst_size - 1 - b];
+				}
+			}
+			break;
+		case Step::INTEGER:
+			for(size_t r = 0; r < nrecords; r++, src += my_in_size, dst += my_out_size) {
+				const unsigned char* bytes = (const unsigned char*) src;
+				unsigned long long value = 0;
+				for(size_t b = 0; b < step.src_size; b++) {
+					value = (value << 8) | bytes[step.lsb_first ? step.src_size - 1 - b : b];
+				}
+				if(step.is_signed && step.src_size < 8 && ((value >> (8 * step.src_size - 1)) & 1)) {
+					value |= ~0ULL << (8 * step.src_size);
+				}
+
+				if(step.dst_size == 8) {
+					memcpy(dst, &value, 8);
+				} else if(step.dst_size == 4) {
+					unsigned int value32 = (unsigned int) value;
+					memcpy(dst, &value32, 4);
+				} else if(step.dst_size == 2) {
+					unsigned short value16 = (unsigned short) value;
+					memcpy(dst, &value16, 2);
+				} else {
+					*dst = (char) value;
+				}
+			}
+			break;
+		}
+	}
+}
+
+/** <summary>Appends the records in <c>nbytes</c> bytes at <c>data</c> to <c>timeseries</c>. Returns the
+ * number of records kept.</summary>
+ * <remarks>Throws a BinaryLoaderException if <c>nbytes</c> is not a whole number of records. With a
+ * ReorderBuffer, the records go to it instead of straight to the series, and all of them are kept; the
+ * caller flushes it. Otherwise, records before the end of the series are discarded, and counted by
+ * discarded().</remarks>
+ */
+long long BinaryLoader::load(const char* data, unsigned long long nbytes, tsdb::Timeseries* timeseries,
+	tsdb::ReorderBuffer* reorder) {
+	if(nbytes % my_in_size != 0) {
+		std::ostringstream msg;
+		msg << "the input is " << nbytes << " bytes, which is not a whole number of " << my_in_size
+			<< " byte records";
+		throw( BinaryLoaderException(msg.str()) );
+	}
+
+	unsigned long long nrecords = nbytes / my_in_size;
+	size_t block_records = std::max((size_t) 1, (size_t) (BUFFER_BYTES / my_out_size));
+	std::vector<char> block(std::min((unsigned long long) block_records, nrecords) * my_out_size + 1);
+
+	long long kept = 0;
+	for(unsigned long long first = 0; first < nrecords; first += block_records) {
+		size_t n = (size_t) std::min((unsigned long long) block_records, nrecords - first);
+		convert(data + first * my_in_size, n, &block[0]);
+		if(reorder != NULL) {
+			reorder->addRecords(n, &block[0]);
+			kept += n;
+		} else {
+			int ndiscarded = timeseries->appendRecords(n, &block[0], true);
+			my_discarded += ndiscarded;
+			kept += n - ndiscarded;
+		}
+	}
+	return kept;
+}
+
+/** <summary>Appends the records of the file <c>filename</c> to <c>timeseries</c>, mapping the file into
+ * memory. Returns the number of records kept.</summary>
+ * <remarks>See load(). Throws a FileMappingException if the file can not be mapped, as when it is
+ * empty.</remarks>
+ */
+long long BinaryLoader::loadFile(const std::string& filename, tsdb::Timeseries* timeseries,
+	tsdb::ReorderBuffer* reorder) {
+	FileMapping mapping(filename);
+	return load(mapping.data(), mapping.size(), timeseries, reorder);
+}
+
+/** <summary>Returns the size of an input record in bytes</summary> */
+size_t BinaryLoader::recordSize(void) const {
+	return my_in_size;
+}
+
+/** <summary>Returns the number of records load() has discarded for being before the end of the
+ * series</summary>
+ */
+unsigned long long BinaryLoader::discarded(void) const {
+	return my_discarded;
+}
+
+} // namespace tsdb
@@ -0,0 +1,140 @@
+#pragma once
+
+/* STL Classes */
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+/* External Libraries */
+#include <boost/shared_ptr.hpp>
+
+/* TSDB Includes */
+#include "tsdb.h"
+#include "structure.h"
+
+namespace tsdb {
+
+class Timeseries;
+class ReorderBuffer;
+
+/* -----------------------------------------------------------------
+ * BinaryLoaderException. For runtime errors thrown by BinaryLayout
+ * and BinaryLoader.
+ * -----------------------------------------------------------------
+ */
+class  BinaryLoaderException:
+	public std::runtime_error
+{
+public:
+	BinaryLoaderException(const std::string& what):
+	  std::runtime_error(std::string("BinaryLoaderException: ") + what) {}
+};
+
+/* -----------------------------------------------------------------
+ * BinaryLayout. Describes fixed size binary records made by another
+ * program.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>Describes the layout of fixed size binary records: the size of a record, the byte order, and
+ * the offset, type and size of each field</summary>
+ * <remarks><p>Types are the names of the TSDB types, as Field::getTSDBType() returns them, in any case:
+ * Timestamp, Date, Record, Int32, Int8, Double, Char and String. The size of a field in the input defaults
+ * to the usual size of its type (8 bytes for Timestamp, Record and Double, 4 for Int32 and Date, 1 for
+ * Int8 and Char). Integer fields may be 1, 2, 4 or 8 bytes. String fields need a size.</p>
+ * <p>Timestamps are milliseconds since the epoch, as in a Timeseries.</p></remarks>
+ */
+class BinaryLayout
+{
+public:
+	enum ByteOrder {
+		NATIVE_ORDER,
+		LSB_FIRST,   // little endian
+		MSB_FIRST    // big endian
+	};
+
+	struct FieldLayout {
+		std::string name;
+		std::string type;
+		size_t offset;
+		size_t size;
+	};
+
+	BinaryLayout(size_t _record_size, ByteOrder _byte_order = NATIVE_ORDER);
+
+	void addField(const std::string& name, const std::string& type, size_t offset, size_t size = 0);
+
+	size_t recordSize(void) const;
+	ByteOrder byteOrder(void) const;
+	const std::vector<FieldLayout>& fields(void) const;
+
+private:
+	size_t my_record_size;
+	ByteOrder my_byte_order;
+	std::vector<FieldLayout> my_fields;
+};
+
+/* -----------------------------------------------------------------
+ * BinaryLoader. Converts binary records to a Structure and appends
+ * them to a Timeseries.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>Appends fixed size binary records, described by a BinaryLayout, to a Timeseries without
+ * going through text</summary>
+ * <remarks><p>The constructor checks the layout against the Structure, and compiles a plan of the copies
+ * that turn an input record into a record of the Structure. Fields that are laid out the same way in both
+ * are copied together, fields in the other byte order are swapped, and integers narrower than their field
+ * are sign extended. When the input records already have the layout of the Structure, a block of them is
+ * copied with one memcpy. Fields of the Structure that are not in the layout are zero, except for the
+ * timestamp, which the layout must have.</p>
+ * <p>load() converts the records a block of BUFFER_BYTES at a time and appends each block, so it runs
+ * at the speed of reading the input and writing the series. loadFile() maps the input file into memory
+ * rather than reading it.</p>
+ * <p>As with RecordParser, records before the end of the series are discarded, unless they go through a
+ * ReorderBuffer.</p></remarks>
+ */
+class BinaryLoader
+{
+public:
+	BinaryLoader(const BinaryLayout& _layout, const boost::shared_ptr<tsdb::Structure>& _structure);
+
+	void convert(const char* in, size_t nrecords, void* out) const;
+	long long load(const char* data, unsigned long long nbytes, tsdb::Timeseries* timeseries,
+		tsdb::ReorderBuffer* reorder = NULL);
+	long long loadFile(const std::string& filename, tsdb::Timeseries* timeseries,
+		tsdb::ReorderBuffer* reorder = NULL);
+
+	size_t recordSize(void) const;
+	unsigned long long discarded(void) const;
+
+private:
+	/* One step of the plan: fills dst_size bytes of each output record */
+	struct Step {
+		enum Kind {
+			COPY,     // src_size bytes as they are
+			SWAP,     // one value with its bytes reversed
+			INTEGER,  // an integer of another size or byte order
+			ZERO      // no source
+		};
+		Kind kind;
+		size_t src_offset;
+		size_t src_size;
+		size_t dst_offset;
+		size_t dst_size;
+		bool is_signed;
+		bool lsb_first;   // byte order of the source, for INTEGER
+	};
+
+	static bool stepBefore(const Step& a, const Step& b);
+
+	boost::shared_ptr<tsdb::Structure> my_structure;
+	size_t my_in_size;
+	size_t my_out_size;
+	std::vector<Step> my_steps;
+	bool my_identity;     // the input records have the layout of the Structure
+	bool my_has_gaps;     // some output bytes, such as padding, are not written by a step
+	unsigned long long my_discarded;
+};
+
+} // namespace tsdb
@@ -1,8 +1,103 @@
 #include "bufferedrecordset.h"
+#include "recordcursor.h"
+#include "hdf5lock.h"
+#include <algorithm>
 #include <boost/make_shared.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
 
 namespace tsdb {
 
+/* ====================================================================
+ * class BufferPrefetcher - reads the next buffer of a BufferedRecordSet
+ * ====================================================================
+ */
+
+/** <summary>Reads one range of records from a Table on a background thread</summary>
+ * <remarks>The thread only calls into HDF5 through the Table, which holds the HDF5Lock while it reads.
+ * Its other state is only touched by the owning BufferedRecordSet after the thread has been joined.</remarks>
+ */
+class BufferPrefetcher
+{
+public:
+	BufferPrefetcher(tsdb::Table* _table): my_table(_table), my_first(0), my_last(0), my_failed(false) {}
+	~BufferPrefetcher(void) { wait(); }
+
+	/** <summary>Starts reading records <c>first</c> to <c>last</c> of the Table, into <c>spare</c> if
+	 * it is large enough</summary> */
+	void start(hsize_t first, hsize_t last, const boost::shared_ptr<tsdb::MemoryBlock>& spare) {
+		wait();
+
+		// An earlier read that was never taken can be recycled too
+		my_spare = spare;
+		if(!my_spare) {
+			my_spare = my_result.memoryBlock();
+		}
+		my_result = tsdb::MemoryBlockPtr();
+
+		my_first = first;
+		my_last = last;
+		my_failed = false;
+		my_thread.reset(new boost::thread(boost::bind(&BufferPrefetcher::run, this)));
+	}
+
+	/** <summary>Takes the records that were read ahead, if they include record <c>i</c> of the Table</summary>
+	 * <remarks>Waits for the read to finish. Returns false, and does not wait, if nothing is being read
+	 * or the read is of another range. Also returns false if the read failed; the caller reads the
+	 * records itself then, and gets the real error.</remarks>
+	 */
+	bool take(hsize_t i, hsize_t* first, hsize_t* last, tsdb::MemoryBlockPtr* result) {
+		if(!my_thread || i < my_first || i > my_last) {
+			return false;
+		}
+
+		wait();
+		if(my_failed) {
+			return false;
+		}
+
+		*first = my_first;
+		*last = my_last;
+		*result = my_result;
+		my_result = tsdb::MemoryBlockPtr();
+		return true;
+	}
+
+	void wait(void) {
+		if(my_thread) {
+			my_thread->join();
+			my_thread.reset();
+		}
+	}
+
+private:
+	BufferPrefetcher(const BufferPrefetcher&);
+	BufferPrefetcher& operator=(const BufferPrefetcher&);
+
+	void run(void) {
+		try {
+			my_result = my_table->recordsAsMemoryBlockPtr(my_first, my_last, my_spare);
+		} catch(std::exception&) {
+			my_failed = true;
+		}
+		my_spare.reset();
+	}
+
+	tsdb::Table* my_table;
+	hsize_t my_first;
+	hsize_t my_last;
+	bool my_failed;
+	boost::shared_ptr<tsdb::MemoryBlock> my_spare;
+	tsdb::MemoryBlockPtr my_result;
+	boost::scoped_ptr<boost::thread> my_thread;
+};
+
+/* ====================================================================
+ * class BufferedRecordSet - a range of records, read in buffers
+ * ====================================================================
+ */
+
 /** <summary>Create a new BufferedRecordSet linking to a set fo rows on a Table</summary>
  * <param name="table">Pointer to a Table to link to</param>
  * <param name="first">First record ID from table</param>
@@ -18,19 +113,63 @@ BufferedRecordSet::BufferedRecordSet(tsdb::Table* _table, hsize_t _first, hsize_
 	this->my_buf_first = 0;
 	this->my_nbufrecords = 0;
 	this->my_record_size = my_table->structure()->getSizeOf();
-	this->my_BUFFER_SIZE = 65000;
+	this->my_buffer_bytes = BUFFER_BYTES;
+	this->my_min_buffer_bytes = BUFFER_BYTES;
+	this->my_max_buffer_bytes = BUFFER_MAX_BYTES;
 	this->my_is_buffer_empty = false;
 	this->my_buffer_direction = true;
+	this->my_buffer_mapped = false;
+	this->my_prefetch = HDF5Lock::libraryIsThreadsafe();
 }
 
 BufferedRecordSet::BufferedRecordSet(void) {
 	// Initialize primative variables
 	this->my_buf_first = 0;
 	this->my_nbufrecords = 0;
+	this->my_table = NULL;
+	this->my_first = 0;
+	this->my_last = 0;
 	this->my_record_size = 0;
-	this->my_BUFFER_SIZE = 65000;
+	this->my_buffer_bytes = BUFFER_BYTES;
+	this->my_min_buffer_bytes = BUFFER_BYTES;
+	this->my_max_buffer_bytes = BUFFER_MAX_BYTES;
 	this->my_is_buffer_empty = true;
 	this->my_buffer_direction = true;
+	this->my_buffer_mapped = false;
+	this->my_prefetch = false;
+}
+
+/** <summary>Copies a BufferedRecordSet</summary>
+ * <remarks>The copy shares the buffer that is loaded, but has its own read ahead.</remarks>
+ */
+BufferedRecordSet::BufferedRecordSet(const BufferedRecordSet& _other) {
+	*this = _other;
+}
+
+BufferedRecordSet& BufferedRecordSet::operator=(const BufferedRecordSet& _other) {
+	if(this == &_other) {
+		return *this;
+	}
+
+	this->my_prefetcher.reset();
+	this->my_spare_block.reset();
+
+	this->my_is_buffer_empty = _other.my_is_buffer_empty;
+	this->my_buffer_direction = _other.my_buffer_direction;
+	this->my_table = _other.my_table;
+	this->my_first = _other.my_first;
+	this->my_last = _other.my_last;
+	this->my_buf_first = _other.my_buf_first;
+	this->my_nbufrecords = _other.my_nbufrecords;
+	this->my_buffer_ptr = _other.my_buffer_ptr;
+	this->my_buffer_block = _other.my_buffer_block;
+	this->my_buffer_mapped = _other.my_buffer_mapped;
+	this->my_record_size = _other.my_record_size;
+	this->my_buffer_bytes = _other.my_buffer_bytes;
+	this->my_min_buffer_bytes = _other.my_min_buffer_bytes;
+	this->my_max_buffer_bytes = _other.my_max_buffer_bytes;
+	this->my_prefetch = _other.my_prefetch;
+	return *this;
 }
 
 hsize_t BufferedRecordSet::firstRecordId() {
@@ -43,81 +182,219 @@ void BufferedRecordSet::set_my_buffer_direction(bool direction)
 	this->my_buffer_direction = direction;
 }
 
+/** <summary>Sets the size of the buffer, in bytes</summary>
+ * <remarks>Buffers start out at <c>bytes</c>, and grow up to <c>max_bytes</c> during a scan. A buffer
+ * always holds at least one record.</remarks>
+ * <param name="bytes">Initial size of a buffer (BUFFER_BYTES by default)</param>
+ * <param name="max_bytes">Largest size of a buffer (BUFFER_MAX_BYTES by default)</param>
+ */
+void BufferedRecordSet::setBufferSize(size_t bytes, size_t max_bytes) {
+	this->my_min_buffer_bytes = bytes;
+	this->my_max_buffer_bytes = std::max(bytes, max_bytes);
+	this->my_buffer_bytes = bytes;
+}
+
+/** <summary>Turns reading ahead on a background thread on or off</summary>
+ * <remarks><p>It is on by default only if the HDF5 library is thread safe. With a library that is not,
+ * reading ahead is still safe as long as every other HDF5 call made while the BufferedRecordSet exists
+ * goes through TSDB, or holds an HDF5Lock.</p></remarks>
+ */
+void BufferedRecordSet::setPrefetch(bool prefetch) {
+	this->my_prefetch = prefetch;
+	if(!prefetch) {
+		this->my_prefetcher.reset();
+	}
+}
+
 
 /** <summary>Returns a Record at index i</summary>
  * <remarks>Returns the i-th Record. The index starts from 0, and refers to the index in the
- * BufferedRecordSet (not the Record's index in the Table).</remarks>
+ * BufferedRecordSet (not the Record's index in the Table). Each Record is a copy with its own
+ * memory; use a RecordCursor to scan many records without copying them.</remarks>
  * <param name="i">Record index</param>
  */
 tsdb::Record BufferedRecordSet::record(hsize_t i) {	
+	hsize_t buf_first;
+	size_t nbufrecords;
+	const char* buf = this->buffer(i, &buf_first, &nbufrecords);
+
+	// allocate some new memory, copy the record over, and wrap it in a Record object
+	boost::shared_ptr<tsdb::MemoryBlock> recmemblk = 
+		boost::make_shared<tsdb::MemoryBlock>(my_record_size);
+	tsdb::MemoryBlockPtr recblkptr = tsdb::MemoryBlockPtr(recmemblk,0);
+	recblkptr.memCpy((void*) (buf + (i-buf_first)*this->my_record_size), this->my_record_size);
+	return tsdb::Record(recblkptr,boost::shared_ptr<tsdb::Structure>(my_table->structure()));
+}
+
+/** <summary>Returns the buffer that holds record i, reading it from the Table if necessary</summary>
+ * <remarks>The buffer is only valid until the next call to buffer() or record() that reads another
+ * part of the Table.</remarks>
+ * <param name="i">Record index</param>
+ * <param name="buf_first">Set to the index of the first record in the buffer</param>
+ * <param name="nbufrecords">Set to the number of records in the buffer</param>
+ */
+const char* BufferedRecordSet::buffer(hsize_t i, hsize_t* buf_first, size_t* nbufrecords) {
 	if(this->my_is_buffer_empty) {
 		throw std::runtime_error("empty BufferedRecordSet");
 	}
 
 	/* is the index valid? */
-	if(i <= (this->my_last - this->my_first)) {
-		/* is it in the buffer? */
-		if(this->my_buffer_ptr.memoryBlock() != 0 &&
-			i >= this->my_buf_first &&
-			i <= (this->my_buf_first + this->my_nbufrecords-1)) {
-		
-			// do nothing
+	if(i > (this->my_last - this->my_first)) {
+		throw std::runtime_error("index out of bounds");
+	}
 
-		} else {
+	/* is it in the buffer? */
+	if(this->my_buffer_ptr.memoryBlock() == 0 ||
+		i < this->my_buf_first ||
+		i > (this->my_buf_first + this->my_nbufrecords-1)) {
 
-			// get a new buffer
-			this->loadRecords(i,this->my_BUFFER_SIZE);
+		// get a new buffer
+		this->loadRecords(i);
+	}
 
-		}
+	*buf_first = this->my_buf_first;
+	*nbufrecords = this->my_nbufrecords;
+	return this->my_buffer_ptr.raw();
+}
 
-		// allocate some new memory, copy the record over, and wrap it in a Record object
-		boost::shared_ptr<tsdb::MemoryBlock> recmemblk = 
-			boost::make_shared<tsdb::MemoryBlock>(my_record_size);
-		tsdb::MemoryBlockPtr recblkptr = tsdb::MemoryBlockPtr(recmemblk,0);
-		recblkptr.memCpy(this->my_buffer_ptr.raw() + (i-this->my_buf_first)*this->my_record_size,
-			this->my_record_size);
-		return tsdb::Record(recblkptr,boost::shared_ptr<tsdb::Structure>(my_table->structure()));
+/** <summary>Returns a RecordCursor over the records of the set</summary>
+ * <param name="forward">True to go forward from the first record, false to go backward from the last</param>
+ */
+tsdb::RecordCursor BufferedRecordSet::cursor(bool forward) const {
+	return tsdb::RecordCursor(*this, forward);
+}
 
-	} else {
-		throw std::runtime_error("index out of bounds");
+/** <summary>Returns the Structure of the records</summary> */
+boost::shared_ptr<tsdb::Structure> BufferedRecordSet::structure() {
+	if(this->my_is_buffer_empty) {
+		return boost::shared_ptr<tsdb::Structure>();
 	}
+	return my_table->structure();
 }
 
-void BufferedRecordSet::loadRecords(hsize_t first, size_t nrecords) {
-	//loading the records depends on the buffer direction
-	if (this->my_buffer_direction)
-	{
-		// here, we assume that first starts the buffer set within the record
-		// nrecords is trimmed if it would put it outside the end of the BufferedRecordSet
-		if(this->my_first+first+nrecords-1 > this->my_last) {
-			nrecords = (size_t) (this->my_last - (this->my_first+first) + 1);
+/** <summary>Loads the buffer that holds record i</summary>
+ * <remarks>Takes the buffer from the read ahead if it was read there. If the Table is mapped (see
+ * Table::mapRecords()), the buffer points into the mapping instead, and runs from record i for as long as
+ * the records are contiguous in the file. Otherwise reads a buffer that starts at record i (or ends at it,
+ * in reverse), into a recycled block if there is one.</remarks>
+ */
+void BufferedRecordSet::loadRecords(hsize_t i) {
+	hsize_t nset = this->my_last - this->my_first + 1;
+	bool had_buffer = (this->my_buffer_block.get() != NULL);
+	hsize_t first, last;
+	tsdb::MemoryBlockPtr records;
+
+	bool prefetched = this->my_prefetcher &&
+		this->my_prefetcher->take(this->my_first + i, &first, &last, &records);
+
+	bool mapped = false;
+	if(!prefetched && this->my_table->isMapped()) {
+		hsize_t map_first = this->my_first + (this->my_buffer_direction ? i : 0);
+		hsize_t map_last = this->my_first + (this->my_buffer_direction ? nset - 1 : i);
+		records = my_table->mappedRecords(&map_first, &map_last, this->my_buffer_direction);
+		if(records.memoryBlock()) {
+			mapped = true;
+			first = map_first - this->my_first;
+			last = map_last - this->my_first;
 		}
+	}
 
-		this->my_buffer_ptr = my_table->recordsAsMemoryBlockPtr(
-			this->my_first+first,this->my_first+first+nrecords-1);
+	if(prefetched) {
+		first -= this->my_first;
+		last -= this->my_first;
+	} else if(!mapped) {
+		size_t nrecords = this->recordsPerBuffer();
+		if(this->my_buffer_direction) {
+			// the buffer starts at i, and is trimmed at the end of the BufferedRecordSet
+			first = i;
+			last = (nset - 1 - i < nrecords - 1) ? nset - 1 : i + (nrecords - 1);
+		} else {
+			// the buffer ends at i, and is trimmed at the beginning of the BufferedRecordSet
+			first = (i < nrecords - 1) ? 0 : i - (nrecords - 1);
+			last = i;
+		}
+	}
+
+	// A scan reads each buffer right after the previous one
+	bool sequential = had_buffer && (this->my_buffer_direction ?
+		first == this->my_buf_first + this->my_nbufrecords : last + 1 == this->my_buf_first);
+
+	// Recycle the old buffer, unless a copy of the set or a Record still uses it, or it is the mapping
+	this->my_buffer_ptr = tsdb::MemoryBlockPtr();
+	if(this->my_buffer_block && this->my_buffer_block.unique() && !this->my_buffer_mapped) {
+		this->my_spare_block = this->my_buffer_block;
+	}
+	this->my_buffer_block.reset();
+
+	if(!prefetched && !mapped) {
+		records = my_table->recordsAsMemoryBlockPtr(this->my_first + first, this->my_first + last,
+			this->my_spare_block);
+		this->my_spare_block.reset();
+	}
+
+	tsdb::TableCounters& counters = my_table->counters();
+	counters.buffer_loads.add();
+	if(prefetched) {
+		counters.prefetched_buffers.add();
+	} else if(mapped) {
+		counters.mapped_buffers.add();
+	}
 
+	this->my_buffer_ptr = records;
+	this->my_buffer_block = records.memoryBlock();
+	this->my_buffer_mapped = mapped;
+	this->my_buf_first = first;
+	this->my_nbufrecords = (size_t) (last - first + 1);
+
+	if(sequential) {
+		this->my_buffer_bytes = std::min(2 * this->my_buffer_bytes, this->my_max_buffer_bytes);
+	} else {
+		this->my_buffer_bytes = this->my_min_buffer_bytes;
+	}
 
-		this->my_buf_first = first;
-		this->my_nbufrecords = nrecords;
+	// Read the next buffer ahead if this looks like a scan
+	bool at_start = this->my_buffer_direction ? first == 0 : last == nset - 1;
+	if(this->my_prefetch && !mapped && (sequential || at_start)) {
+		this->prefetchNext();
 	}
-	else
-	{
-		// here, we assume that first starts the buffer set within the record
-		// nrecords is trimmed if it would put it outside the beginning of the BufferedRecordSet
-		if(first < (nrecords-1)) 
-			nrecords = (size_t) (first+1);
+}
+
+/** <summary>Starts reading the buffer after the current one, in the direction of the set</summary> */
+void BufferedRecordSet::prefetchNext(void) {
+	hsize_t nset = this->my_last - this->my_first + 1;
+	size_t nrecords = this->recordsPerBuffer();
+	hsize_t first, last;
 
-		this->my_buffer_ptr = my_table->recordsAsMemoryBlockPtr(
-			this->my_first+first-(nrecords-1),this->my_first+first);
+	if(this->my_buffer_direction) {
+		first = this->my_buf_first + this->my_nbufrecords;
+		if(first >= nset) {
+			return;
+		}
+		last = (nset - 1 - first < nrecords - 1) ? nset - 1 : first + (nrecords - 1);
+	} else {
+		if(this->my_buf_first == 0) {
+			return;
+		}
+		last = this->my_buf_first - 1;
+		first = (last < nrecords - 1) ? 0 : last - (nrecords - 1);
+	}
 
-		this->my_buf_first = first-(nrecords-1);
-		this->my_nbufrecords = nrecords;
+	if(!this->my_prefetcher) {
+		this->my_prefetcher = boost::make_shared<tsdb::BufferPrefetcher>(this->my_table);
 	}
+	this->my_prefetcher->start(this->my_first + first, this->my_first + last, this->my_spare_block);
+	this->my_spare_block.reset();
+}
+
+/** <summary>Returns the number of records in a buffer of the current size</summary> */
+size_t BufferedRecordSet::recordsPerBuffer(void) const {
+	size_t nrecords = this->my_record_size > 0 ? this->my_buffer_bytes / this->my_record_size : 1;
+	return nrecords > 0 ? nrecords : 1;
 }
 
 BufferedRecordSet::~BufferedRecordSet(void)
 {
-
+	// the prefetcher waits for its thread
 }
 
 /** <summary>Returns the number of records in the BufferedRecordSet</summary>
@@ -1,23 +1,49 @@
 #pragma once
 
+#include <boost/shared_ptr.hpp>
+
 #include "tsdb.h"
 #include "hdf5.h"
 #include "table.h"
 
 namespace tsdb {
+
+/* Forward declarations */
+class RecordCursor;
+class BufferPrefetcher;
+
+/** <summary>A range of records in a Table, read in blocks as they are accessed</summary>
+ * <remarks><p>The records are read one buffer at a time. The buffer is sized in bytes (BUFFER_BYTES to
+ * start with), and doubles, up to BUFFER_MAX_BYTES, each time the next buffer in the direction of the
+ * set is loaded right after the previous one, as happens during a scan.</p>
+ * <p>With read ahead on (see setPrefetch()), the next buffer of a scan is read on a background thread
+ * while the current one is being used, into memory recycled from an earlier buffer. Copies of a
+ * BufferedRecordSet share the buffer that is loaded, but not the read ahead.</p>
+ * <p>If the Table is mapped (see Table::mapRecords()), buffers are not read but point into the mapping,
+ * and there is no read ahead.</p></remarks>
+ */
 class BufferedRecordSet
 {
 public:
 	BufferedRecordSet(void);
 	BufferedRecordSet(tsdb::Table* _table, hsize_t _first, hsize_t _last);
+	BufferedRecordSet(const BufferedRecordSet& _other);
+	BufferedRecordSet& operator=(const BufferedRecordSet& _other);
 	tsdb::Record record(hsize_t i);
+	const char* buffer(hsize_t i, hsize_t* buf_first, size_t* nbufrecords);
+	tsdb::RecordCursor cursor(bool forward = true) const;
+	boost::shared_ptr<tsdb::Structure> structure();
 	hsize_t firstRecordId();
 	hsize_t size();
 	void set_my_buffer_direction(bool direction);
+	void setBufferSize(size_t bytes, size_t max_bytes);
+	void setPrefetch(bool prefetch);
 	~BufferedRecordSet(void);
 
 private:
-	void loadRecords(hsize_t first, size_t nrecords);
+	void loadRecords(hsize_t i);
+	void prefetchNext(void);
+	size_t recordsPerBuffer(void) const;
 	bool my_is_buffer_empty;
 	bool my_buffer_direction; //true by default; false indicates reverse buffer
 	tsdb::Table* my_table; 
@@ -26,7 +52,14 @@ private:
 	hsize_t my_buf_first;
 	size_t my_nbufrecords;
 	tsdb::MemoryBlockPtr my_buffer_ptr;
+	boost::shared_ptr<tsdb::MemoryBlock> my_buffer_block;	// the MemoryBlock of my_buffer_ptr
+	bool my_buffer_mapped;			// ... which wraps the Table's mapping
 	size_t my_record_size;
-	size_t my_BUFFER_SIZE;
+	size_t my_buffer_bytes;			// size of the next buffer
+	size_t my_min_buffer_bytes;		// ... when it is reset by a jump
+	size_t my_max_buffer_bytes;		// ... when it has grown during a scan
+	bool my_prefetch;
+	boost::shared_ptr<tsdb::BufferPrefetcher> my_prefetcher;
+	boost::shared_ptr<tsdb::MemoryBlock> my_spare_block;	// a recycled buffer
 };
 }
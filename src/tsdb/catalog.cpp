@@ -0,0 +1,226 @@
+/* STL includes */
+#include <string>
+#include <vector>
+#include <algorithm>
+
+/* HDF5 Includes */
+#include "hdf5.h"
+
+/* TSDB includes */
+#include "catalog.h"
+#include "hdf5lock.h"
+
+using namespace std;
+
+namespace tsdb {
+
+namespace {
+
+const char* CATALOG_NAME = "_TSDB_catalog";
+const hsize_t CATALOG_CHUNK_BYTES = 4096;
+
+} // namespace
+
+/* ====================================================================
+ * class Catalog - the names of the Timeseries at a location
+ * ====================================================================
+ */
+
+/** <summary>Adds the Timeseries <c>name</c> to the catalog at <c>loc_id</c></summary>
+ * <remarks>The Timeseries must already exist. A location without a catalog gets one, listing every series
+ * it has, so the catalog of an older file is complete from the first series added to it. Internal names
+ * are not added.</remarks>
+ */
+void Catalog::add(hid_t loc_id, const std::string& name) {
+	HDF5Lock lock;
+
+	if(isInternalName(name)) {
+		return;
+	}
+
+	if(!Catalog::exists(loc_id)) {
+		// The walk finds the new series as well
+		write(loc_id, walk(loc_id));
+		return;
+	}
+
+	hid_t dataset_id = H5Dopen2(loc_id, CATALOG_NAME, H5P_DEFAULT);
+	if(dataset_id < 0) {
+		throw( CatalogException("Error in H5Dopen2.") );
+	}
+
+	hid_t space_id = H5Dget_space(dataset_id);
+	hsize_t size = 0;
+	H5Sget_simple_extent_dims(space_id, &size, NULL);
+	H5Sclose(space_id);
+
+	hsize_t count = name.size() + 1;
+	hsize_t new_size = size + count;
+	herr_t status = H5Dset_extent(dataset_id, &new_size);
+	if(status >= 0) {
+		space_id = H5Dget_space(dataset_id);
+		hid_t mem_space_id = H5Screate_simple(1, &count, NULL);
+		status = H5Sselect_hyperslab(space_id, H5S_SELECT_SET, &size, NULL, &count, NULL);
+		if(status >= 0) {
+			status = H5Dwrite(dataset_id, H5T_NATIVE_CHAR, mem_space_id, space_id, H5P_DEFAULT, name.c_str());
+		}
+		H5Sclose(mem_space_id);
+		H5Sclose(space_id);
+	}
+	H5Dclose(dataset_id);
+
+	if(status < 0) {
+		throw( CatalogException("Error adding a series to the catalog.") );
+	}
+}
+
+/** <summary>Removes the Timeseries <c>name</c> from the catalog at <c>loc_id</c></summary>
+ * <remarks>Does nothing if there is no catalog, or the name is not in it.</remarks>
+ */
+void Catalog::remove(hid_t loc_id, const std::string& name) {
+	HDF5Lock lock;
+
+	if(!Catalog::exists(loc_id)) {
+		return;
+	}
+
+	vector<string> names = read(loc_id);
+	vector<string>::iterator it = std::find(names.begin(), names.end(), name);
+	if(it != names.end()) {
+		names.erase(it);
+		write(loc_id, names);
+	}
+}
+
+/** <summary>Returns the names of the Timeseries at <c>loc_id</c></summary>
+ * <remarks>Reads them from the catalog if there is one, and otherwise lists the links of the location,
+ * leaving out internal names.</remarks>
+ */
+std::vector<std::string> Catalog::seriesNames(hid_t loc_id) {
+	HDF5Lock lock;
+
+	if(Catalog::exists(loc_id)) {
+		return read(loc_id);
+	}
+	return walk(loc_id);
+}
+
+/** <summary>Writes the catalog at <c>loc_id</c> from the links of the location, replacing any catalog there</summary> */
+void Catalog::rebuild(hid_t loc_id) {
+	HDF5Lock lock;
+	write(loc_id, walk(loc_id));
+}
+
+/** <summary>Returns true if there is a catalog at <c>loc_id</c></summary> */
+bool Catalog::exists(hid_t loc_id) {
+	HDF5Lock lock;
+	return H5Lexists(loc_id, CATALOG_NAME, H5P_DEFAULT) > 0;
+}
+
+/** <summary>Returns true for the names TSDB uses for itself, which all start with "_TSDB_"</summary> */
+bool Catalog::isInternalName(const std::string& name) {
+	return name.compare(0, 6, "_TSDB_") == 0;
+}
+
+/** <summary>Reads the names in the catalog at <c>loc_id</c> with one read</summary> */
+std::vector<std::string> Catalog::read(hid_t loc_id) {
+	vector<string> names;
+
+	hid_t dataset_id = H5Dopen2(loc_id, CATALOG_NAME, H5P_DEFAULT);
+	if(dataset_id < 0) {
+		throw( CatalogException("Error in H5Dopen2.") );
+	}
+
+	hid_t space_id = H5Dget_space(dataset_id);
+	hsize_t size = 0;
+	H5Sget_simple_extent_dims(space_id, &size, NULL);
+	H5Sclose(space_id);
+
+	vector<char> buf((size_t) size + 1, '\0');
+	herr_t status = 0;
+	if(size > 0) {
+		status = H5Dread(dataset_id, H5T_NATIVE_CHAR, H5S_ALL, H5S_ALL, H5P_DEFAULT, &buf[0]);
+	}
+	H5Dclose(dataset_id);
+
+	if(status < 0) {
+		throw( CatalogException("Error in H5Dread.") );
+	}
+
+	size_t start = 0;
+	for(size_t i = 0; i < (size_t) size; i++) {
+		if(buf[i] == '\0') {
+			names.push_back(string(&buf[start], i - start));
+			start = i + 1;
+		}
+	}
+	return names;
+}
+
+/** <summary>Lists the links at <c>loc_id</c> in name order, leaving out internal names</summary> */
+std::vector<std::string> Catalog::walk(hid_t loc_id) {
+	vector<string> names;
+	H5G_info_t group_info;
+
+	if(H5Gget_info(loc_id, &group_info) < 0) {
+		throw( CatalogException("Error in H5Gget_info. Likely an invalid file or group id.") );
+	}
+
+	for(hsize_t i = 0; i < group_info.nlinks; i++) {
+		ssize_t size = H5Lget_name_by_idx(loc_id, ".", H5_INDEX_NAME, H5_ITER_INC, i, NULL, 0, H5P_DEFAULT);
+		if(size < 0) {
+			throw( CatalogException("Error in H5Lget_name_by_idx.") );
+		}
+		vector<char> name((size_t) size + 1, '\0');
+		H5Lget_name_by_idx(loc_id, ".", H5_INDEX_NAME, H5_ITER_INC, i, &name[0], (size_t) size + 1, H5P_DEFAULT);
+		if(!isInternalName(&name[0])) {
+			names.push_back(&name[0]);
+		}
+	}
+	return names;
+}
+
+/** <summary>Writes <c>names</c> as the whole catalog at <c>loc_id</c>, creating it if need be</summary> */
+void Catalog::write(hid_t loc_id, const std::vector<std::string>& names) {
+	string packed;
+	for(size_t i = 0; i < names.size(); i++) {
+		packed.append(names[i]);
+		packed.push_back('\0');
+	}
+	hsize_t size = packed.size();
+
+	hid_t dataset_id;
+	if(Catalog::exists(loc_id)) {
+		dataset_id = H5Dopen2(loc_id, CATALOG_NAME, H5P_DEFAULT);
+		if(dataset_id >= 0 && H5Dset_extent(dataset_id, &size) < 0) {
+			H5Dclose(dataset_id);
+			dataset_id = -1;
+		}
+	} else {
+		hsize_t dims = size;
+		hsize_t maxdims = H5S_UNLIMITED;
+		hsize_t chunk = CATALOG_CHUNK_BYTES;
+		hid_t space_id = H5Screate_simple(1, &dims, &maxdims);
+		hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+		H5Pset_chunk(dcpl, 1, &chunk);
+		dataset_id = H5Dcreate2(loc_id, CATALOG_NAME, H5T_NATIVE_CHAR, space_id, H5P_DEFAULT, dcpl, H5P_DEFAULT);
+		H5Pclose(dcpl);
+		H5Sclose(space_id);
+	}
+
+	if(dataset_id < 0) {
+		throw( CatalogException("Error creating or extending the catalog.") );
+	}
+
+	herr_t status = 0;
+	if(size > 0) {
+		status = H5Dwrite(dataset_id, H5T_NATIVE_CHAR, H5S_ALL, H5S_ALL, H5P_DEFAULT, packed.data());
+	}
+	H5Dclose(dataset_id);
+
+	if(status < 0) {
+		throw( CatalogException("Error in H5Dwrite.") );
+	}
+}
+
+} // namespace tsdb
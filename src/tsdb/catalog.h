@@ -0,0 +1,57 @@
+#pragma once
+
+/* STL Classes */
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+/* External Libraries */
+#include "hdf5.h"
+
+namespace tsdb {
+
+/* -----------------------------------------------------------------
+ * CatalogException. For runtime errors thrown by the Catalog.
+ * -----------------------------------------------------------------
+ */
+class  CatalogException:
+	public std::runtime_error
+{
+public:
+	CatalogException(const std::string& what):
+	  std::runtime_error(std::string("CatalogException: ") + what) {}
+};
+
+/* -----------------------------------------------------------------
+ * Catalog. The list of the Timeseries at a location.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>Lists the Timeseries of a file or group with one read</summary>
+ * <remarks><p>The catalog is a dataset "_TSDB_catalog" next to the series, holding their names one after
+ * the other, each ended by a NUL. Creating a Timeseries adds its name, so listing the series of a file
+ * with thousands of them is one read of a few kilobytes, rather than a walk over every link.</p>
+ * <p>Files written before there was a catalog have none, and seriesNames() walks the links of the
+ * location instead, as the bindings used to. rebuild() writes the catalog of such a file from that walk.
+ * Series created by older versions of TSDB after the catalog was written are missing from it until it is
+ * rebuilt.</p>
+ * <p>remove() takes a name out of the catalog, for a series whose link has been deleted.</p>
+ * <p>The Timeseries that TSDB keeps inside a series, such as "_TSDB_index", are not in the catalog.</p></remarks>
+ */
+class Catalog
+{
+public:
+	static void add(hid_t loc_id, const std::string& name);
+	static void remove(hid_t loc_id, const std::string& name);
+	static std::vector<std::string> seriesNames(hid_t loc_id);
+	static void rebuild(hid_t loc_id);
+	static bool exists(hid_t loc_id);
+	static bool isInternalName(const std::string& name);
+
+private:
+	static std::vector<std::string> read(hid_t loc_id);
+	static std::vector<std::string> walk(hid_t loc_id);
+	static void write(hid_t loc_id, const std::vector<std::string>& names);
+};
+
+} // namespace tsdb
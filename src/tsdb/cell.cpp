@@ -7,6 +7,7 @@
 #include "boost/date_time/posix_time/posix_time.hpp"
 #include <boost/make_shared.hpp>
 #include "memoryblock.h"
+#include "symboltable.h"
 
 namespace tsdb {
 
@@ -23,6 +24,14 @@ Cell::Cell(tsdb::MemoryBlockPtr& _memory_block_ptr, tsdb::Field::FieldType _fiel
 	this->my_size = _size;
 }
 
+/** <summary>Creates a cell of a SymbolField, which holds the code of a symbol in <c>_symbols</c></summary> */
+Cell::Cell(tsdb::MemoryBlockPtr& _memory_block_ptr, const boost::shared_ptr<tsdb::SymbolTable>& _symbols) {
+	this->my_memory_block_ptr = _memory_block_ptr;
+	this->my_field_type = tsdb::Field::SYMBOL;
+	this->my_size = sizeof(tsdb::symbol_t);
+	this->my_symbols = _symbols;
+}
+
 Cell::Cell(tsdb::Field::FieldType _field_type) {
 	this->my_field_type = _field_type;
 
@@ -78,7 +87,8 @@ Cell::Cell() {
  * the Cell(tsdb::MemoryBlockPtr& _memory_block_ptr, tsdb::Field::FieldType _field_type, 
  * size_t _size) constructor (this is the case when you create a cell from a record).
  * If you create the cell manually and do not call this constructor, you will get a
- * null string.</p></remarks>
+ * null string.</p><p>For symbol fields, the string is the symbol, looked up in the dictionary
+ * of the field.</p></remarks>
  */
 std::string Cell::toString() const {
 	using namespace boost::gregorian;
@@ -147,6 +157,15 @@ std::string Cell::toString() const {
 			ss << tmpstr;
 			delete[] tmpstr;
 			break;
+		case tsdb::Field::SYMBOL:
+			tsdb::symbol_t tmp_symbol;
+			tmp_symbol = *((tsdb::symbol_t*) this->my_memory_block_ptr.raw());
+			if(my_symbols) {
+				ss << my_symbols->symbol(tmp_symbol);
+			} else {
+				ss << tmp_symbol;
+			}
+			break;
 		default:
 			ss << "Undef";
 			break;
@@ -182,8 +201,8 @@ tsdb::ieee64_t Cell::toDouble() const {
 }
 
 /** <summary>Returns the value of a Cell as a 32-bit integer (tsdb::int32_t)</summary>
- * <remarks>FieldTypes of INT32, INT8 and DATE can be converted to int32_t.
- * Others throw type_conversion_error.</remarks>
+ * <remarks>FieldTypes of INT32, INT8 and DATE can be converted to int32_t, and SYMBOL to the code
+ * of the symbol. Others throw type_conversion_error.</remarks>
  */
 tsdb::int32_t Cell::toInt32() const {
 	switch(this->my_field_type) {
@@ -196,6 +215,9 @@ tsdb::int32_t Cell::toInt32() const {
 		case tsdb::Field::DATE:
 			return (tsdb::int32_t) *((tsdb::date_t*) this->my_memory_block_ptr.raw());
 			break;
+		case tsdb::Field::SYMBOL:
+			return (tsdb::int32_t) *((tsdb::symbol_t*) this->my_memory_block_ptr.raw());
+			break;
 		default:
 			throw tsdb::type_conversion_error("cannot convert type to int32");
 			break;
@@ -393,7 +415,8 @@ tsdb::Cell& Cell::operator=(const tsdb::char_t &rhs) {
  * <remarks>FieldTypes of INT32, INT8, DOUBLE, TIMESTAMP, and DATE support
  *  assignment of signed 32-bit integers. For cells with field types of TIMESTAMP,
  *  rhs is treated as a date number (meaning the number of days since Jan 1, 1970), 
- * then converted to a timestamp at 00:00 hours on that day.
+ * then converted to a timestamp at 00:00 hours on that day. For SYMBOL cells, rhs is
+ * the code of a symbol in the dictionary.
  * Others field types throw type_conversion_error.</remarks>
  */
 tsdb::Cell& Cell::operator=(const tsdb::int32_t &rhs) {
@@ -422,6 +445,14 @@ tsdb::Cell& Cell::operator=(const tsdb::int32_t &rhs) {
 			temp_double = (tsdb::ieee64_t) rhs;
 			memcpy(this->my_memory_block_ptr.raw(),&temp_double,sizeof(tsdb::ieee64_t));
 			break;
+		case tsdb::Field::SYMBOL:
+			if(rhs < 0 || (my_symbols && (size_t) rhs >= my_symbols->size())) {
+				throw tsdb::type_conversion_error("int32 is not the code of a symbol");
+			}
+			tsdb::symbol_t temp_symbol;
+			temp_symbol = (tsdb::symbol_t) rhs;
+			memcpy(this->my_memory_block_ptr.raw(),&temp_symbol,sizeof(tsdb::symbol_t));
+			break;
 		default:
 			throw tsdb::type_conversion_error("the cell's field type does not support conversion from int8");
 			break;
@@ -452,8 +483,9 @@ tsdb::Field::FieldType Cell::fieldType() const {
 }
 
 /** <summary>Parses a string and sets it as the cell's payload</summary>
- * <remarks>This works for field types of CHAR, DOUBLE, INT8, and INT32.
- * For char, the first character of the string is used. If the string is empty,
+ * <remarks>This works for field types of CHAR, DOUBLE, INT8, INT32, STRING and SYMBOL.
+ * For char, the first character of the string is used. A symbol new to the dictionary
+ * of a SYMBOL cell is added to it. If the string is empty,
  * then the cell is set to '\0'. For DOUBLE, INT32, and INT8, no range checking
  * exists at this time. Numbers out of range for these datatypes have undefined
  * behaivor.</remarks>
@@ -495,6 +527,18 @@ tsdb::Cell& Cell::operator=(const std::string &rhs) {
 			memcpy(my_memory_block_ptr.raw(),rhs.c_str(),
 				(rhs.length() > my_size ? my_size : rhs.length()));
 			break;
+		case tsdb::Field::SYMBOL:
+			if(!my_symbols) {
+				throw tsdb::type_conversion_error("the symbol cell has no dictionary");
+			}
+			tsdb::symbol_t tmp_symbol;
+			try {
+				tmp_symbol = my_symbols->code(rhs);
+			} catch(std::exception& e) {
+				throw tsdb::type_conversion_error(e.what());
+			}
+			memcpy(my_memory_block_ptr.raw(),&tmp_symbol,sizeof(tsdb::symbol_t));
+			break;
 		default:
 			throw tsdb::type_conversion_error("cannot convert string to this cell's field type");
 			break;
@@ -22,6 +22,7 @@ class Cell
 public:
 	Cell(tsdb::MemoryBlockPtr& _memory_block_ptr, tsdb::Field::FieldType _field_type);
 	Cell(tsdb::MemoryBlockPtr& _memory_block_ptr, tsdb::Field::FieldType _field_type, size_t _size);
+	Cell(tsdb::MemoryBlockPtr& _memory_block_ptr, const boost::shared_ptr<tsdb::SymbolTable>& _symbols);
 	Cell(tsdb::Field::FieldType _field_type);
 	Cell();
 	
@@ -52,6 +53,7 @@ private:
 	tsdb::MemoryBlockPtr my_memory_block_ptr;
 	tsdb::Field::FieldType my_field_type;
 	size_t my_size;
+	boost::shared_ptr<tsdb::SymbolTable> my_symbols;  // of a SYMBOL cell
 
 };
 
@@ -0,0 +1,190 @@
+/* STL includes */
+#include <string>
+#include <vector>
+
+/* TSDB includes */
+#include "chunkcache.h"
+
+namespace tsdb {
+
+/* ====================================================================
+ * struct ChunkCacheStats - what a ChunkCache has done
+ * ====================================================================
+ */
+
+/** <summary>Returns the statistics as a list of names and values</summary> */
+tsdb::StatList ChunkCacheStats::items(void) const {
+	tsdb::StatList items;
+	items.push_back(std::make_pair(std::string("hits"), hits));
+	items.push_back(std::make_pair(std::string("misses"), misses));
+	items.push_back(std::make_pair(std::string("stale"), stale));
+	items.push_back(std::make_pair(std::string("insertions"), insertions));
+	items.push_back(std::make_pair(std::string("evictions"), evictions));
+	items.push_back(std::make_pair(std::string("invalidations"), invalidations));
+	items.push_back(std::make_pair(std::string("bytes"), bytes));
+	items.push_back(std::make_pair(std::string("entries"), entries));
+	return items;
+}
+
+/* ====================================================================
+ * class ChunkCache - decompressed chunks, least recently used last
+ * ====================================================================
+ */
+
+/** <summary>Creates an empty cache that holds up to <c>_capacity</c> bytes of chunks</summary> */
+ChunkCache::ChunkCache(size_t _capacity): my_capacity(_capacity), my_bytes(0) {
+}
+
+/** <summary>Returns chunk <c>chunk</c> of <c>dataset</c>, or NULL if it is not cached</summary>
+ * <remarks><c>address</c> and <c>stored_size</c> are where the chunk is in the file now, and its size
+ * there. A cached chunk that was somewhere else, or had another size, has been rewritten, and is dropped.</remarks>
+ */
+ChunkCache::ChunkPtr ChunkCache::find(const std::string& dataset, hsize_t chunk, haddr_t address, hsize_t stored_size) {
+	boost::lock_guard<boost::mutex> lock(my_mutex);
+	std::map<Key, EntryList::iterator>::iterator found = my_by_key.find(Key(dataset, chunk));
+	if(found == my_by_key.end()) {
+		my_stats.misses++;
+		return ChunkPtr();
+	}
+	if(found->second->address != address || found->second->stored_size != stored_size) {
+		my_stats.misses++;
+		my_stats.stale++;
+		erase(found);
+		return ChunkPtr();
+	}
+	my_stats.hits++;
+	my_entries.splice(my_entries.begin(), my_entries, found->second);
+	return found->second->data;
+}
+
+/** <summary>Adds chunk <c>chunk</c> of <c>dataset</c>, decompressed, and drops the least recently used
+ * chunks if the cache is over its capacity</summary>
+ * <remarks>A chunk larger than the capacity is not added.</remarks>
+ */
+void ChunkCache::insert(const std::string& dataset, hsize_t chunk, haddr_t address, hsize_t stored_size,
+	const ChunkPtr& data) {
+	size_t capacity;
+	{
+		boost::lock_guard<boost::mutex> lock(my_mutex);
+		if(data->size() > my_capacity) {
+			return;
+		}
+
+		Key key(dataset, chunk);
+		std::map<Key, EntryList::iterator>::iterator found = my_by_key.find(key);
+		if(found != my_by_key.end()) {
+			erase(found);
+		}
+
+		Entry entry;
+		entry.key = key;
+		entry.address = address;
+		entry.stored_size = stored_size;
+		entry.data = data;
+		my_entries.push_front(entry);
+		my_by_key[key] = my_entries.begin();
+		my_bytes += data->size();
+		my_stats.insertions++;
+		capacity = my_capacity;
+	}
+	shrinkTo(capacity);
+}
+
+/** <summary>Drops the chunks of <c>dataset</c> from number <c>first_chunk</c> on</summary>
+ * <remarks>Tables call this for the chunks they write or truncate.</remarks>
+ */
+void ChunkCache::invalidate(const std::string& dataset, hsize_t first_chunk) {
+	boost::lock_guard<boost::mutex> lock(my_mutex);
+	std::map<Key, EntryList::iterator>::iterator it = my_by_key.lower_bound(Key(dataset, first_chunk));
+	while(it != my_by_key.end() && it->first.first == dataset) {
+		std::map<Key, EntryList::iterator>::iterator next = it;
+		++next;
+		erase(it);
+		my_stats.invalidations++;
+		it = next;
+	}
+}
+
+/** <summary>Drops every cached chunk</summary> */
+void ChunkCache::clear(void) {
+	EntryList dropped;
+
+	{
+		boost::lock_guard<boost::mutex> lock(my_mutex);
+		my_stats.invalidations += my_entries.size();
+		dropped.swap(my_entries);
+		my_by_key.clear();
+		my_bytes = 0;
+	}
+}
+
+/** <summary>Sets the number of bytes of chunks the cache may hold, and drops the least recently used ones above it</summary>
+ * <remarks>0 turns the cache off.</remarks>
+ */
+void ChunkCache::setCapacity(size_t _capacity) {
+	{
+		boost::lock_guard<boost::mutex> lock(my_mutex);
+		my_capacity = _capacity;
+	}
+	shrinkTo(_capacity);
+}
+
+/** <summary>Returns the number of bytes of chunks the cache may hold</summary> */
+size_t ChunkCache::capacity(void) {
+	boost::lock_guard<boost::mutex> lock(my_mutex);
+	return my_capacity;
+}
+
+/** <summary>Returns the number of bytes of chunks the cache holds</summary> */
+size_t ChunkCache::size(void) {
+	boost::lock_guard<boost::mutex> lock(my_mutex);
+	return my_bytes;
+}
+
+/** <summary>Returns a copy of the statistics of the cache</summary> */
+tsdb::ChunkCacheStats ChunkCache::stats(void) {
+	boost::lock_guard<boost::mutex> lock(my_mutex);
+	tsdb::ChunkCacheStats stats = my_stats;
+	stats.bytes = my_bytes;
+	stats.entries = my_entries.size();
+	return stats;
+}
+
+/** <summary>Sets the counters of the statistics back to zero</summary> */
+void ChunkCache::resetStats(void) {
+	boost::lock_guard<boost::mutex> lock(my_mutex);
+	my_stats = tsdb::ChunkCacheStats();
+}
+
+/** <summary>Returns the cache that Tables use</summary>
+ * <remarks>It is never destroyed, as with SeriesCache::global().</remarks>
+ */
+tsdb::ChunkCache& ChunkCache::global(void) {
+	static ChunkCache* cache = new ChunkCache();
+	return *cache;
+}
+
+/* Drops an entry. The caller holds my_mutex. */
+void ChunkCache::erase(std::map<Key, EntryList::iterator>::iterator found) {
+	my_bytes -= found->second->data->size();
+	my_entries.erase(found->second);
+	my_by_key.erase(found);
+}
+
+/** <summary>Drops the least recently used chunks until at most <c>nbytes</c> are cached</summary> */
+void ChunkCache::shrinkTo(size_t nbytes) {
+	std::vector<ChunkPtr> dropped;
+
+	{
+		boost::lock_guard<boost::mutex> lock(my_mutex);
+		while(my_bytes > nbytes && !my_entries.empty()) {
+			dropped.push_back(my_entries.back().data);
+			my_bytes -= my_entries.back().data->size();
+			my_by_key.erase(my_entries.back().key);
+			my_entries.pop_back();
+			my_stats.evictions++;
+		}
+	}
+}
+
+} // namespace tsdb
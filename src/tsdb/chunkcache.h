@@ -0,0 +1,109 @@
+#pragma once
+
+/* STL Classes */
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <utility>
+#include <stddef.h>
+
+/* External Libraries */
+#include "hdf5.h"
+#include "boost/shared_ptr.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/locks.hpp"
+
+/* TSDB Includes */
+#include "tsdb.h"
+#include "stats.h"
+
+namespace tsdb {
+
+/* -----------------------------------------------------------------
+ * ChunkCacheStats. What a ChunkCache has done so far.
+ * -----------------------------------------------------------------
+ */
+struct ChunkCacheStats
+{
+	ChunkCacheStats(void): hits(0), misses(0), stale(0), insertions(0), evictions(0), invalidations(0),
+		bytes(0), entries(0) {}
+
+	unsigned long long hits;           // chunks find() returned
+	unsigned long long misses;         // ... that it did not have
+	unsigned long long stale;          // ... of the misses, chunks it had, but that had been rewritten
+	unsigned long long insertions;     // chunks insert() added
+	unsigned long long evictions;      // chunks dropped to stay within the capacity
+	unsigned long long invalidations;  // chunks dropped by invalidate() or clear()
+	unsigned long long bytes;          // bytes of decompressed chunks held now
+	unsigned long long entries;        // ... and the number of chunks
+
+	tsdb::StatList items(void) const;
+};
+
+/* -----------------------------------------------------------------
+ * ChunkCache. Decompressed chunks, shared by every Table.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>Keeps decompressed chunks of datasets for reuse, within a budget of bytes for the whole process</summary>
+ * <remarks><p>HDF5 gives each open dataset a chunk cache of its own, so every Timeseries, every level of
+ * its index, and every copy of a series opened by another caller decompresses the same chunks again. The
+ * ChunkReader of a Table looks its chunks up here first instead: a chunk is keyed by the file name and
+ * path of its dataset and its number, so all of the Tables of a dataset share it, and a query over the
+ * same window as the last one does not decompress anything.</p>
+ * <p>Each chunk is stored with the address and size it has in the file, and find() only returns it if
+ * they still match, so a chunk that has been rewritten since, by this process or another one, is read
+ * again. The Tables of this process also invalidate() the chunks they write.</p>
+ * <p>The cache holds at most capacity() bytes of chunks, and drops the least recently used ones to stay
+ * within it; a capacity of 0 turns it off. The chunks are handed out as shared pointers, so a chunk that
+ * is dropped stays valid while a reader copies out of it. Tables use global(). A ChunkCache is thread
+ * safe.</p></remarks>
+ */
+class ChunkCache
+{
+public:
+	typedef boost::shared_ptr<const std::vector<unsigned char> > ChunkPtr;
+
+	ChunkCache(size_t _capacity = CHUNK_CACHE_BYTES);
+
+	ChunkPtr find(const std::string& dataset, hsize_t chunk, haddr_t address, hsize_t stored_size);
+	void insert(const std::string& dataset, hsize_t chunk, haddr_t address, hsize_t stored_size,
+		const ChunkPtr& data);
+	void invalidate(const std::string& dataset, hsize_t first_chunk = 0);
+	void clear(void);
+
+	void setCapacity(size_t _capacity);
+	size_t capacity(void);
+	size_t size(void);
+	tsdb::ChunkCacheStats stats(void);
+	void resetStats(void);
+
+	static tsdb::ChunkCache& global(void);
+
+private:
+	/* ChunkCaches hold a mutex, so they can't be copied */
+	ChunkCache(const ChunkCache&);
+	ChunkCache& operator=(const ChunkCache&);
+
+	typedef std::pair<std::string, hsize_t> Key;
+	struct Entry {
+		Key key;
+		haddr_t address;       // where the chunk was in the file
+		hsize_t stored_size;   // ... and its size there
+		ChunkPtr data;
+	};
+	typedef std::list<Entry> EntryList;
+
+	void erase(std::map<Key, EntryList::iterator>::iterator found);
+	void shrinkTo(size_t nbytes);
+
+	boost::mutex my_mutex;
+	size_t my_capacity;
+	size_t my_bytes;
+	EntryList my_entries;                              // most recently used first
+	std::map<Key, EntryList::iterator> my_by_key;      // sorted by dataset, then chunk
+	tsdb::ChunkCacheStats my_stats;
+};
+
+} // namespace tsdb
@@ -0,0 +1,349 @@
+/* STL includes */
+#include <string>
+#include <vector>
+#include <string.h>
+
+/* External Libraries */
+#include "hdf5.h"
+#include "zlib.h"
+#include <boost/make_shared.hpp>
+
+/* TSDB includes */
+#include "chunkreader.h"
+#include "codec.h"
+#include "hdf5lock.h"
+#include "chunkcache.h"
+
+namespace tsdb {
+
+/* ====================================================================
+ * class ChunkReader - reads raw chunks and unfilters them in TSDB
+ * ====================================================================
+ */
+
+/** <summary>Creates a ChunkReader for a dataset, if its layout and filters allow it</summary>
+ * <remarks>This never throws. If the dataset can not be read chunk by chunk, supported() returns false.</remarks>
+ * <param name="_dataset_id">An open 1-D dataset, which must stay open while the ChunkReader is used</param>
+ * <param name="_mem_type_id">The memory type the elements are read as</param>
+ */
+ChunkReader::ChunkReader(hid_t _dataset_id, hid_t _mem_type_id) {
+	HDF5Lock lock;
+
+	my_dataset_id = _dataset_id;
+	my_supported = false;
+	my_chunk_records = 0;
+	my_element_size = 0;
+
+#ifdef TSDB_HAVE_READ_CHUNK
+	hid_t file_type_id = H5Dget_type(my_dataset_id);
+	if(file_type_id < 0) {
+		return;
+	}
+	bool same_type = (H5Tequal(file_type_id, _mem_type_id) > 0);
+	H5Tclose(file_type_id);
+	if(!same_type) {
+		return;
+	}
+	my_element_size = H5Tget_size(_mem_type_id);
+
+	hid_t dcpl = H5Dget_create_plist(my_dataset_id);
+	if(dcpl < 0) {
+		return;
+	}
+
+	bool ok = (H5Pget_layout(dcpl) == H5D_CHUNKED && H5Pget_chunk(dcpl, 1, &my_chunk_records) == 1);
+
+	int nfilters = ok ? H5Pget_nfilters(dcpl) : 0;
+	for(int i = 0; ok && i < nfilters; i++) {
+		Filter filter;
+		unsigned int flags, filter_config;
+		unsigned int cd_values[16];
+		size_t cd_nelmts = 16;
+		char name[64];
+
+		filter.id = H5Pget_filter2(dcpl, (unsigned int) i, &flags, &cd_nelmts, cd_values,
+			sizeof(name), name, &filter_config);
+		filter.cd_values.assign(cd_values, cd_values + (cd_nelmts < 16 ? cd_nelmts : 16));
+
+		switch(filter.id) {
+		case H5Z_FILTER_DEFLATE:
+			break;
+		case H5Z_FILTER_SHUFFLE:
+			ok = (filter.cd_values.size() >= 1 && filter.cd_values[0] > 0);
+			break;
+		case Codec::FILTER_ID:
+			ok = (filter.cd_values.size() >= 3 && filter.cd_values[0] <= Codec::VERSION && filter.cd_values[2] > 0);
+			break;
+		default:
+			ok = false;
+		}
+		my_filters.push_back(filter);
+	}
+	H5Pclose(dcpl);
+
+	my_supported = ok && my_chunk_records > 0 && my_element_size > 0;
+
+	// The chunks are cached under the name of the file and the path of the dataset in it
+	ssize_t file_name_size = my_supported ? H5Fget_name(my_dataset_id, NULL, 0) : -1;
+	ssize_t path_size = my_supported ? H5Iget_name(my_dataset_id, NULL, 0) : -1;
+	if(file_name_size > 0 && path_size > 0) {
+		std::vector<char> file_name((size_t) file_name_size + 1, '\0');
+		std::vector<char> path((size_t) path_size + 1, '\0');
+		if(H5Fget_name(my_dataset_id, &file_name[0], file_name.size()) > 0 &&
+			H5Iget_name(my_dataset_id, &path[0], path.size()) > 0) {
+			my_cache_key = std::string(&file_name[0]) + ":" + &path[0];
+		}
+	}
+#endif
+}
+
+/** <summary>Returns true if the dataset can be read with read()</summary> */
+bool ChunkReader::supported(void) const {
+	return my_supported;
+}
+
+/** <summary>Returns the number of elements in a chunk of the dataset</summary> */
+hsize_t ChunkReader::chunkRecords(void) const {
+	return my_chunk_records;
+}
+
+/** <summary>Returns true if read() goes through the ChunkCache</summary> */
+bool ChunkReader::cached(void) const {
+	return my_supported && !my_cache_key.empty() && tsdb::ChunkCache::global().capacity() > 0;
+}
+
+/** <summary>Reads <c>nrecords</c> elements starting at <c>first</c> into <c>buf</c></summary>
+ * <remarks><p>Returns false if the elements could not be read this way. <c>buf</c> may then have been
+ * partly written, and the caller should read the whole range with <c>H5Dread()</c>. This does not
+ * check the bounds of the request.</p>
+ * <p>With a <c>field_size</c>, only the <c>field_size</c> bytes at <c>field_offset</c> of each element
+ * are copied, one after the other, as when a Table reads just the timestamps of its records.</p></remarks>
+ */
+bool ChunkReader::read(hsize_t first, hsize_t nrecords, void* buf, size_t field_offset, size_t field_size) {
+#ifdef TSDB_HAVE_READ_CHUNK
+	if(!my_supported || nrecords == 0 || field_offset + field_size > my_element_size) {
+		return false;
+	}
+	if(field_size == 0) {
+		field_offset = 0;
+		field_size = my_element_size;
+	}
+
+	boost::mutex::scoped_try_lock guard(my_mutex);
+	if(!guard.owns_lock()) {
+		return false;
+	}
+
+	size_t chunk_bytes = (size_t) my_chunk_records * my_element_size;
+	hsize_t end = first + nrecords;
+	char* out = (char*) buf;
+	tsdb::ChunkCache& cache = tsdb::ChunkCache::global();
+	bool use_cache = cached();
+
+	for(hsize_t chunk = first / my_chunk_records; chunk * my_chunk_records < end; chunk++) {
+		hsize_t offset = chunk * my_chunk_records;
+		haddr_t address = HADDR_UNDEF;
+		hsize_t nbytes = 0;
+		uint32_t filter_mask = 0;
+
+		{
+			HDF5Lock lock;
+			if(!locateChunk(offset, &address, &nbytes)) {
+				return false;
+			}
+		}
+
+		tsdb::ChunkCache::ChunkPtr cached_chunk;
+		if(use_cache) {
+			cached_chunk = cache.find(my_cache_key, chunk, address, nbytes);
+		}
+
+		if(cached_chunk.get() == NULL) {
+			{
+				HDF5Lock lock;
+				my_data.resize((size_t) nbytes);
+				if(H5Dread_chunk(my_dataset_id, H5P_DEFAULT, &offset, &filter_mask, &my_data[0]) < 0) {
+					return false;
+				}
+			}
+
+			// The lock is released, so other threads can use HDF5 while this one decompresses
+			if(!unfilter(filter_mask) || my_data.size() != chunk_bytes) {
+				return false;
+			}
+
+			if(use_cache) {
+				boost::shared_ptr<std::vector<unsigned char> > decompressed =
+					boost::make_shared<std::vector<unsigned char> >();
+				decompressed->swap(my_data);
+				cached_chunk = decompressed;
+				cache.insert(my_cache_key, chunk, address, nbytes, cached_chunk);
+			}
+		}
+
+		const unsigned char* data = (cached_chunk.get() != NULL) ? &(*cached_chunk)[0] : &my_data[0];
+		hsize_t from = (first > offset) ? first : offset;
+		hsize_t to = (end < offset + my_chunk_records) ? end : offset + my_chunk_records;
+		const unsigned char* src = data + (size_t) (from - offset) * my_element_size;
+		size_t n = (size_t) (to - from);
+		if(field_size == my_element_size) {
+			memcpy(out, src, n * my_element_size);
+			out += n * my_element_size;
+		} else {
+			src += field_offset;
+			for(size_t i = 0; i < n; i++, src += my_element_size, out += field_size) {
+				memcpy(out, src, field_size);
+			}
+		}
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+/** <summary>Drops the cached chunks of the dataset from the one that holds element <c>first</c> on</summary>
+ * <remarks>The Table calls this for the elements it writes, or truncates.</remarks>
+ */
+void ChunkReader::invalidate(hsize_t first) {
+	if(my_supported && !my_cache_key.empty()) {
+		tsdb::ChunkCache::global().invalidate(my_cache_key, first / my_chunk_records);
+	}
+}
+
+/** <summary>Finds the address and stored size of the chunk that starts at element <c>offset</c></summary>
+ * <remarks>Returns false if the chunk has not been written. The address is HADDR_UNDEF if HDF5 is too
+ * old to tell it. The caller holds the HDF5Lock.</remarks>
+ */
+bool ChunkReader::locateChunk(hsize_t offset, haddr_t* address, hsize_t* nbytes) {
+#if defined(TSDB_HAVE_CHUNK_INFO)
+	unsigned int filter_mask = 0;
+	if(H5Dget_chunk_info_by_coord(my_dataset_id, &offset, &filter_mask, address, nbytes) < 0) {
+		return false;
+	}
+	return *address != HADDR_UNDEF && *nbytes > 0;
+#elif defined(TSDB_HAVE_READ_CHUNK)
+	*address = HADDR_UNDEF;
+	return H5Dget_chunk_storage_size(my_dataset_id, &offset, nbytes) >= 0 && *nbytes > 0;
+#else
+	return false;
+#endif
+}
+
+/** <summary>Undoes the filters of the chunk in my_data, last filter first</summary>
+ * <remarks>Bit <c>i</c> of <c>filter_mask</c> is set if filter <c>i</c> was skipped for this chunk.</remarks>
+ */
+bool ChunkReader::unfilter(unsigned int filter_mask) {
+	for(size_t i = my_filters.size(); i-- > 0; ) {
+		if(filter_mask & (1u << i)) {
+			continue;
+		}
+
+		bool ok;
+		switch(my_filters[i].id) {
+		case H5Z_FILTER_DEFLATE:
+			ok = inflate();
+			break;
+		case H5Z_FILTER_SHUFFLE:
+			ok = unshuffle(my_filters[i].cd_values[0]);
+			break;
+		case Codec::FILTER_ID:
+			ok = decode(my_filters[i].cd_values);
+			break;
+		default:
+			ok = false;
+		}
+		if(!ok) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/** <summary>Inflates my_data, which was compressed by HDF5's deflate filter</summary> */
+bool ChunkReader::inflate(void) {
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	if(inflateInit(&stream) != Z_OK) {
+		return false;
+	}
+
+	// Most chunks inflate to exactly one chunk, so start there
+	size_t chunk_bytes = (size_t) my_chunk_records * my_element_size;
+	my_scratch.resize(chunk_bytes > my_data.size() ? chunk_bytes : 2 * my_data.size());
+
+	stream.next_in = &my_data[0];
+	stream.avail_in = (uInt) my_data.size();
+
+	int status;
+	for(;;) {
+		stream.next_out = &my_scratch[stream.total_out];
+		stream.avail_out = (uInt) (my_scratch.size() - stream.total_out);
+		status = ::inflate(&stream, Z_NO_FLUSH);
+		if(status == Z_STREAM_END || (status != Z_OK && status != Z_BUF_ERROR)) {
+			break;
+		}
+		if(stream.avail_out == 0) {
+			my_scratch.resize(2 * my_scratch.size());
+		} else if(stream.avail_in == 0) {
+			break;  // truncated input
+		}
+	}
+
+	size_t nbytes = stream.total_out;
+	inflateEnd(&stream);
+	if(status != Z_STREAM_END) {
+		return false;
+	}
+
+	my_scratch.resize(nbytes);
+	my_data.swap(my_scratch);
+	return true;
+}
+
+/** <summary>Undoes HDF5's shuffle filter, which stores byte <c>b</c> of every element together</summary>
+ * <remarks>As in HDF5, the bytes after the last whole element are not shuffled.</remarks>
+ */
+bool ChunkReader::unshuffle(size_t element_size) {
+	size_t nbytes = my_data.size();
+	size_t nelements = nbytes / element_size;
+	if(element_size <= 1 || nelements <= 1) {
+		return true;
+	}
+
+	my_scratch.resize(nbytes);
+	const unsigned char* in = &my_data[0];
+	unsigned char* out = &my_scratch[0];
+	for(size_t b = 0; b < element_size; b++) {
+		for(size_t j = 0; j < nelements; j++) {
+			out[j * element_size + b] = in[j];
+		}
+		in += nelements;
+	}
+	memcpy(out + nelements * element_size, in, nbytes - nelements * element_size);
+
+	my_data.swap(my_scratch);
+	return true;
+}
+
+/** <summary>Decodes my_data, which was encoded by the Codec filter</summary> */
+bool ChunkReader::decode(const std::vector<unsigned int>& cd_values) {
+	Codec::Kind kind = (Codec::Kind) cd_values[1];
+	size_t value_size = cd_values[2];
+
+	if(my_data.empty()) {
+		return false;
+	}
+	size_t nbytes = Codec::decodedSize(&my_data[0], my_data.size(), value_size);
+	my_scratch.resize(nbytes > 0 ? nbytes : 1);
+	if(!Codec::decode(kind, value_size, &my_data[0], my_data.size(), &my_scratch[0])) {
+		return false;
+	}
+
+	my_scratch.resize(nbytes);
+	my_data.swap(my_scratch);
+	return true;
+}
+
+} // namespace tsdb
@@ -0,0 +1,91 @@
+#pragma once
+
+/* STL Classes */
+#include <string>
+#include <vector>
+
+/* External Libraries */
+#include "hdf5.h"
+#include "boost/thread/mutex.hpp"
+
+/* TSDB Includes */
+#include "tsdb.h"
+
+/* H5Dread_chunk() is new in HDF5 1.10.2 */
+#if (H5_VERS_MAJOR > 1) || (H5_VERS_MAJOR == 1 && H5_VERS_MINOR > 10) || \
+	(H5_VERS_MAJOR == 1 && H5_VERS_MINOR == 10 && H5_VERS_RELEASE >= 2)
+	#define TSDB_HAVE_READ_CHUNK
+#endif
+
+/* H5Dget_chunk_info_by_coord() is new in HDF5 1.10.5 */
+#if (H5_VERS_MAJOR > 1) || (H5_VERS_MAJOR == 1 && H5_VERS_MINOR > 10) || \
+	(H5_VERS_MAJOR == 1 && H5_VERS_MINOR == 10 && H5_VERS_RELEASE >= 5)
+	#define TSDB_HAVE_CHUNK_INFO
+#endif
+
+namespace tsdb {
+
+/* -----------------------------------------------------------------
+ * ChunkReader. Reads the raw chunks of a dataset and decompresses
+ * them outside of the HDF5 library.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>Reads a range of elements of a chunked 1-D dataset, undoing its filters in TSDB</summary>
+ * <remarks><p>HDF5 decompresses chunks inside the library, while the HDF5Lock is held, so threads that
+ * read different series wait for each other's decompression. A ChunkReader only holds the lock while
+ * it reads the compressed chunks with <c>H5Dread_chunk()</c>; it undoes the filters, and copies the
+ * elements out, after releasing it.</p>
+ * <p>It knows the deflate, shuffle and Codec filters, which are the ones StorageOptions uses by default.
+ * A dataset with any other filter, a dataset that is not chunked, or one whose type in the file is not
+ * exactly the memory type, is not supported(), and must be read with <c>H5Dread()</c>. read() may also
+ * fail later (for instance on a chunk that was never written), and the caller then reads the range with
+ * <c>H5Dread()</c> instead.</p>
+ * <p>While the ChunkCache is on, read() looks each chunk up in ChunkCache::global() before reading it, and
+ * adds the chunks it decompresses, so the chunks are shared with every other Table of the dataset. A Table
+ * then reads through its ChunkReader however few records it reads. invalidate() drops the chunks that the
+ * Table writes.</p>
+ * <p>A ChunkReader keeps its scratch buffers between reads. If another thread is reading through the
+ * same ChunkReader, read() does not wait for it, but returns false.</p></remarks>
+ */
+class ChunkReader
+{
+public:
+	ChunkReader(hid_t _dataset_id, hid_t _mem_type_id);
+
+	bool supported(void) const;
+	hsize_t chunkRecords(void) const;
+	bool cached(void) const;
+	bool read(hsize_t first, hsize_t nrecords, void* buf, size_t field_offset = 0, size_t field_size = 0);
+	void invalidate(hsize_t first);
+
+private:
+	/* ChunkReaders hold a mutex, so they can't be copied */
+	ChunkReader(const ChunkReader&);
+	ChunkReader& operator=(const ChunkReader&);
+
+	struct Filter {
+		H5Z_filter_t id;
+		std::vector<unsigned int> cd_values;
+	};
+
+	bool locateChunk(hsize_t offset, haddr_t* address, hsize_t* nbytes);
+	bool unfilter(unsigned int filter_mask);
+	bool inflate(void);
+	bool unshuffle(size_t element_size);
+	bool decode(const std::vector<unsigned int>& cd_values);
+
+	hid_t my_dataset_id;   // owned by the Table
+	bool my_supported;
+	hsize_t my_chunk_records;
+	size_t my_element_size;
+	std::vector<Filter> my_filters;
+	std::string my_cache_key;  // file name and path of the dataset, the key of its chunks in the ChunkCache
+
+	/* Scratch space. my_data holds the chunk as it is being unfiltered. */
+	std::vector<unsigned char> my_data;
+	std::vector<unsigned char> my_scratch;
+	boost::mutex my_mutex;     // guards the scratch space
+};
+
+} // namespace tsdb
@@ -0,0 +1,470 @@
+/* STL includes */
+#include <cstring>
+
+/* HDF5 Includes */
+#include "hdf5.h"
+
+/* TSDB includes */
+#include "codec.h"
+
+using namespace std;
+
+namespace tsdb {
+
+/* -----------------------------------------------------------------
+ * Helpers for the block encodings
+ * -----------------------------------------------------------------
+ */
+namespace {
+
+/* Mode byte at the start of a block */
+const unsigned char MODE_RAW = 0;
+const unsigned char MODE_ENCODED = 1;
+
+inline uint64_t zigzag(uint64_t v) {
+	return (v << 1) ^ (uint64_t) (((int64_t) v) >> 63);
+}
+
+inline uint64_t unzigzag(uint64_t v) {
+	return (v >> 1) ^ (~(v & 1) + 1);
+}
+
+inline unsigned char* putVarint(unsigned char* p, uint64_t v) {
+	while(v >= 0x80) {
+		*p++ = (unsigned char) (v | 0x80);
+		v >>= 7;
+	}
+	*p++ = (unsigned char) v;
+	return p;
+}
+
+/* Reads a varint. Returns NULL if the varint runs past <c>end</c>. */
+inline const unsigned char* getVarint(const unsigned char* p, const unsigned char* end, uint64_t* v) {
+	if(p < end && *p < 0x80) {  // the common case: one byte
+		*v = *p;
+		return p + 1;
+	}
+
+	uint64_t result = 0;
+	for(int shift = 0; shift < 64 && p < end; shift += 7) {
+		uint64_t b = *p++;
+		result |= (b & 0x7f) << shift;
+		if(b < 0x80) {
+			*v = result;
+			return p;
+		}
+	}
+	return NULL;
+}
+
+/* Integers are stored in native byte order, sign extended to 64 bits */
+inline uint64_t loadInteger(const unsigned char* p, size_t size) {
+	switch(size) {
+	case 1: { signed char v; memcpy(&v, p, 1); return (uint64_t) (int64_t) v; }
+	case 2: { short v; memcpy(&v, p, 2); return (uint64_t) (int64_t) v; }
+	case 4: { int v; memcpy(&v, p, 4); return (uint64_t) (int64_t) v; }
+	default: { uint64_t v; memcpy(&v, p, 8); return v; }
+	}
+}
+
+inline void storeInteger(unsigned char* p, size_t size, uint64_t v) {
+	switch(size) {
+	case 1: { signed char t = (signed char) v; memcpy(p, &t, 1); break; }
+	case 2: { short t = (short) v; memcpy(p, &t, 2); break; }
+	case 4: { int t = (int) v; memcpy(p, &t, 4); break; }
+	default: memcpy(p, &v, 8); break;
+	}
+}
+
+inline int leadingZeros(uint64_t v) {
+#ifdef __GNUC__
+	return __builtin_clzll(v);
+#else
+	int n = 0;
+	while(!(v & 0x8000000000000000ULL)) { v <<= 1; n++; }
+	return n;
+#endif
+}
+
+inline int trailingZeros(uint64_t v) {
+#ifdef __GNUC__
+	return __builtin_ctzll(v);
+#else
+	int n = 0;
+	while(!(v & 1)) { v >>= 1; n++; }
+	return n;
+#endif
+}
+
+/* Writes bits most significant first */
+class BitWriter {
+public:
+	BitWriter(unsigned char* _p): my_p(_p), my_acc(0), my_nbits(0) {}
+
+	/* Writes the low <c>n</c> bits of <c>v</c>; <c>n</c> is at most 32 */
+	inline void put(uint64_t v, int n) {
+		my_acc = (my_acc << n) | v;
+		my_nbits += n;
+		while(my_nbits >= 8) {
+			my_nbits -= 8;
+			*my_p++ = (unsigned char) (my_acc >> my_nbits);
+		}
+		my_acc &= (((uint64_t) 1) << my_nbits) - 1;
+	}
+
+	inline void put64(uint64_t v, int n) {
+		if(n > 32) {
+			put(v >> 32, n - 32);
+			put(v & 0xffffffffULL, 32);
+		} else {
+			put(v, n);
+		}
+	}
+
+	unsigned char* finish(void) {
+		if(my_nbits > 0) {
+			*my_p++ = (unsigned char) (my_acc << (8 - my_nbits));
+		}
+		return my_p;
+	}
+
+private:
+	unsigned char* my_p;
+	uint64_t my_acc;
+	int my_nbits;
+};
+
+/* Reads bits written by BitWriter. Reads past the end return zeros. */
+class BitReader {
+public:
+	BitReader(const unsigned char* _p, const unsigned char* _end): my_p(_p), my_end(_end), my_acc(0), my_nbits(0) {}
+
+	/* Reads <c>n</c> bits; <c>n</c> is at most 32 */
+	inline uint64_t get(int n) {
+		while(my_nbits < n) {
+			my_acc = (my_acc << 8) | (my_p < my_end ? *my_p++ : 0);
+			my_nbits += 8;
+		}
+		my_nbits -= n;
+		return (my_acc >> my_nbits) & ((((uint64_t) 1) << n) - 1);
+	}
+
+	inline uint64_t get64(int n) {
+		if(n > 32) {
+			uint64_t hi = get(n - 32);
+			return (hi << 32) | get(32);
+		}
+		return get(n);
+	}
+
+private:
+	const unsigned char* my_p;
+	const unsigned char* my_end;
+	uint64_t my_acc;
+	int my_nbits;
+};
+
+unsigned char* encodeDeltaOfDelta(const unsigned char* in, size_t n, size_t size, unsigned char* p) {
+	uint64_t prev = 0, prev_delta = 0;
+	for(size_t i = 0; i < n; i++) {
+		uint64_t v = loadInteger(in + i * size, size);
+		uint64_t delta = v - prev;
+		p = putVarint(p, zigzag(delta - prev_delta));
+		prev = v;
+		prev_delta = delta;
+	}
+	return p;
+}
+
+bool decodeDeltaOfDelta(const unsigned char* p, const unsigned char* end, size_t n, size_t size, unsigned char* out) {
+	uint64_t v = 0, delta = 0, dod;
+	for(size_t i = 0; i < n; i++) {
+		p = getVarint(p, end, &dod);
+		if(p == NULL) {
+			return false;
+		}
+		delta += unzigzag(dod);
+		v += delta;
+		storeInteger(out + i * size, size, v);
+	}
+	return true;
+}
+
+unsigned char* encodeZigzag(const unsigned char* in, size_t n, size_t size, bool delta, unsigned char* p) {
+	uint64_t prev = 0;
+	for(size_t i = 0; i < n; i++) {
+		uint64_t v = loadInteger(in + i * size, size);
+		p = putVarint(p, zigzag(v - prev));
+		if(delta) {
+			prev = v;
+		}
+	}
+	return p;
+}
+
+bool decodeZigzag(const unsigned char* p, const unsigned char* end, size_t n, size_t size, bool delta, unsigned char* out) {
+	uint64_t prev = 0, v;
+	for(size_t i = 0; i < n; i++) {
+		p = getVarint(p, end, &v);
+		if(p == NULL) {
+			return false;
+		}
+		v = unzigzag(v) + prev;
+		storeInteger(out + i * size, size, v);
+		if(delta) {
+			prev = v;
+		}
+	}
+	return true;
+}
+
+/* Control bits: 0 if the value repeats, 10 if the XOR fits in the previous window of meaningful
+   bits, 11 followed by 5 bits of leading zeros and 6 bits of length-1 for a new window. */
+unsigned char* encodeXor(const unsigned char* in, size_t n, unsigned char* p) {
+	BitWriter bits(p);
+	uint64_t prev = 0;
+	int prev_lead = 65, prev_trail = 0;  // no window yet
+	for(size_t i = 0; i < n; i++) {
+		uint64_t v;
+		memcpy(&v, in + i * 8, 8);
+		uint64_t x = v ^ prev;
+		prev = v;
+
+		if(x == 0) {
+			bits.put(0, 1);
+			continue;
+		}
+
+		int lead = leadingZeros(x);
+		int trail = trailingZeros(x);
+		if(lead > 31) {
+			lead = 31;
+		}
+
+		if(lead >= prev_lead && trail >= prev_trail) {
+			bits.put(2, 2);
+			bits.put64(x >> prev_trail, 64 - prev_lead - prev_trail);
+		} else {
+			int length = 64 - lead - trail;
+			bits.put(3, 2);
+			bits.put((uint64_t) lead, 5);
+			bits.put((uint64_t) (length - 1), 6);
+			bits.put64(x >> trail, length);
+			prev_lead = lead;
+			prev_trail = trail;
+		}
+	}
+	return bits.finish();
+}
+
+bool decodeXor(const unsigned char* p, const unsigned char* end, size_t n, unsigned char* out) {
+	BitReader bits(p, end);
+	uint64_t v = 0;
+	int lead = 0, trail = 0;
+	for(size_t i = 0; i < n; i++) {
+		if(bits.get(1)) {
+			if(bits.get(1)) {
+				lead = (int) bits.get(5);
+				int length = (int) bits.get(6) + 1;
+				trail = 64 - lead - length;
+				if(trail < 0) {
+					return false;
+				}
+			}
+			v ^= bits.get64(64 - lead - trail) << trail;
+		}
+		memcpy(out + i * 8, &v, 8);
+	}
+	return true;
+}
+
+/* The HDF5 filter. cd_values are the encoding VERSION, the Kind and the size of a value. */
+size_t codecFilter(unsigned int flags, size_t cd_nelmts, const unsigned int cd_values[],
+	size_t nbytes, size_t* buf_size, void** buf) {
+
+	if(cd_nelmts < 3 || cd_values[0] > Codec::VERSION || cd_values[2] == 0) {
+		return 0;
+	}
+	Codec::Kind kind = (Codec::Kind) cd_values[1];
+	size_t value_size = cd_values[2];
+	const unsigned char* in = (const unsigned char*) *buf;
+	unsigned char* out;
+	size_t out_size;
+
+	if(flags & H5Z_FLAG_REVERSE) {
+		out_size = Codec::decodedSize(in, nbytes, value_size);
+		out = (unsigned char*) H5allocate_memory(out_size > 0 ? out_size : 1, false);
+		if(out == NULL) {
+			return 0;
+		}
+		if(!Codec::decode(kind, value_size, in, nbytes, out)) {
+			H5free_memory(out);
+			return 0;
+		}
+	} else {
+		size_t nvalues = nbytes / value_size;
+		out = (unsigned char*) H5allocate_memory(Codec::maxEncodedSize(nvalues, value_size), false);
+		if(out == NULL) {
+			return 0;
+		}
+		out_size = Codec::encode(kind, value_size, in, nvalues, out);
+	}
+
+	H5free_memory(*buf);
+	*buf = out;
+	*buf_size = out_size;
+	return out_size;
+}
+
+} // anonymous namespace
+
+/* ====================================================================
+ * class Codec - time series aware encoding of a column
+ * ====================================================================
+ */
+
+/** <summary>Returns the encoding used for a field type</summary>
+ * <remarks>Returns NONE for the types the Codec does not encode (chars and strings).</remarks>
+ */
+Codec::Kind Codec::kindOf(Field::FieldType _type) {
+	switch(_type) {
+	case Field::TIMESTAMP:
+		return DELTA_OF_DELTA;
+	case Field::DOUBLE:
+		return XOR_DOUBLE;
+	case Field::INT32:
+	case Field::INT8:
+	case Field::SYMBOL:
+		return ZIGZAG;
+	case Field::RECORD:
+	case Field::DATE:
+		return DELTA_ZIGZAG;
+	default:
+		return NONE;
+	}
+}
+
+/** <summary>Returns the largest size of an encoded block of <c>nvalues</c> values</summary> */
+size_t Codec::maxEncodedSize(size_t nvalues, size_t value_size) {
+	// A varint of a 64-bit value is at most 10 bytes, as is a value in the XOR encoding
+	size_t encoded = nvalues * 10;
+	size_t raw = nvalues * value_size;
+	return 1 + 10 + (encoded > raw ? encoded : raw);
+}
+
+/** <summary>Encodes <c>nvalues</c> values of <c>value_size</c> bytes into <c>out</c></summary>
+ * <remarks>Returns the size of the encoded block. The values are stored as is if the encoding would
+ * not be smaller, or if <c>_kind</c> does not apply to values of this size.</remarks>
+ */
+size_t Codec::encode(Kind _kind, size_t value_size, const void* in, size_t nvalues, unsigned char* out) {
+	const unsigned char* values = (const unsigned char*) in;
+	unsigned char* p = putVarint(out + 1, nvalues);
+	unsigned char* end = NULL;
+	size_t raw = nvalues * value_size;
+	bool integer_size = (value_size == 1 || value_size == 2 || value_size == 4 || value_size == 8);
+
+	switch(_kind) {
+	case DELTA_OF_DELTA:
+		if(integer_size) {
+			end = encodeDeltaOfDelta(values, nvalues, value_size, p);
+		}
+		break;
+	case XOR_DOUBLE:
+		if(value_size == 8) {
+			end = encodeXor(values, nvalues, p);
+		}
+		break;
+	case ZIGZAG:
+	case DELTA_ZIGZAG:
+		if(integer_size) {
+			end = encodeZigzag(values, nvalues, value_size, _kind == DELTA_ZIGZAG, p);
+		}
+		break;
+	default:
+		break;
+	}
+
+	if(end != NULL && (size_t) (end - p) < raw) {
+		out[0] = MODE_ENCODED;
+		return end - out;
+	}
+
+	out[0] = MODE_RAW;
+	memcpy(p, values, raw);
+	return (p - out) + raw;
+}
+
+/** <summary>Returns the size of the values in an encoded block, or 0 if the block is not valid</summary> */
+size_t Codec::decodedSize(const unsigned char* in, size_t nbytes, size_t value_size) {
+	uint64_t nvalues;
+	if(nbytes < 2 || getVarint(in + 1, in + nbytes, &nvalues) == NULL) {
+		return 0;
+	}
+	return (size_t) nvalues * value_size;
+}
+
+/** <summary>Decodes a block written by <c>encode()</c> into <c>out</c></summary>
+ * <remarks><c>out</c> must hold <c>decodedSize()</c> bytes. Returns false if the block is not valid.</remarks>
+ */
+bool Codec::decode(Kind _kind, size_t value_size, const unsigned char* in, size_t nbytes, void* out) {
+	const unsigned char* end = in + nbytes;
+	unsigned char* values = (unsigned char*) out;
+	uint64_t nvalues;
+
+	if(nbytes < 2) {
+		return false;
+	}
+	const unsigned char* p = getVarint(in + 1, end, &nvalues);
+	if(p == NULL) {
+		return false;
+	}
+
+	if(in[0] == MODE_RAW) {
+		if((size_t) (end - p) < nvalues * value_size) {
+			return false;
+		}
+		memcpy(values, p, (size_t) nvalues * value_size);
+		return true;
+	}
+
+	if(in[0] != MODE_ENCODED) {
+		return false;
+	}
+
+	switch(_kind) {
+	case DELTA_OF_DELTA:
+		return decodeDeltaOfDelta(p, end, (size_t) nvalues, value_size, values);
+	case XOR_DOUBLE:
+		return decodeXor(p, end, (size_t) nvalues, values);
+	case ZIGZAG:
+	case DELTA_ZIGZAG:
+		return decodeZigzag(p, end, (size_t) nvalues, value_size, _kind == DELTA_ZIGZAG, values);
+	default:
+		return false;
+	}
+}
+
+/** <summary>Registers the Codec as an HDF5 filter</summary>
+ * <remarks>This may be called more than once. Returns false if HDF5 refuses the filter.</remarks>
+ */
+bool Codec::registerFilter(void) {
+	static bool registered = false;
+	if(registered) {
+		return true;
+	}
+
+	H5Z_class2_t filter_class;
+	filter_class.version = H5Z_CLASS_T_VERS;
+	filter_class.id = FILTER_ID;
+	filter_class.encoder_present = 1;
+	filter_class.decoder_present = 1;
+	filter_class.name = "TSDB codec";
+	filter_class.can_apply = NULL;
+	filter_class.set_local = NULL;
+	filter_class.filter = codecFilter;
+
+	registered = (H5Zregister(&filter_class) >= 0);
+	return registered;
+}
+
+} // namespace tsdb
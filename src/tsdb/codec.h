@@ -0,0 +1,66 @@
+#pragma once
+
+/* STL Classes */
+#include <string>
+#include <stdexcept>
+
+/* External Libraries */
+#include "hdf5.h"
+
+/* TSDB Includes */
+#include "field.h"
+
+namespace tsdb {
+
+/* -----------------------------------------------------------------
+ * Codec. Time series aware encoding of a column.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>Encodes and decodes columns of timestamps, doubles and integers</summary>
+ * <remarks><p>The Codec encodes a block of values of one field, and is registered as an HDF5 filter
+ * so it can be applied to the columns of a columnar Table (see <c>StorageOptions::CODEC</c>).
+ * The encoding depends on the field type:</p>
+ * <ul>
+ * <li>DELTA_OF_DELTA, for timestamps: zig-zag varints of the change in the difference between
+ * consecutive values. Regularly spaced or repeated timestamps take one byte each.</li>
+ * <li>XOR_DOUBLE, for doubles: each value is XORed with the previous one, and only the bits that
+ * differ are stored, as in Facebook's Gorilla. A repeated value takes one bit.</li>
+ * <li>ZIGZAG, for small integers: zig-zag varints of the values.</li>
+ * <li>DELTA_ZIGZAG, for record ids and dates: zig-zag varints of the difference between
+ * consecutive values.</li>
+ * </ul>
+ * <p>An encoded block starts with a mode byte and the number of values. If the encoding would be
+ * larger than the values, the values are stored as is.</p>
+ * <p>The filter id is in the range HDF5 reserves for testing, and is not registered with The HDF Group.
+ * Files that use the Codec can only be read by programs that link TSDB and call <c>registerFilter()</c>,
+ * which the Table constructors do.</p></remarks>
+ */
+class Codec
+{
+public:
+	enum Kind {
+		NONE,
+		DELTA_OF_DELTA,
+		XOR_DOUBLE,
+		ZIGZAG,
+		DELTA_ZIGZAG
+	};
+
+	/* Filter id and version of the encoding */
+	static const H5Z_filter_t FILTER_ID = 305;
+	static const unsigned int VERSION = 1;
+
+	static Kind kindOf(Field::FieldType _type);
+
+	/* Block encoding. <c>out</c> must hold maxEncodedSize() bytes. */
+	static size_t maxEncodedSize(size_t nvalues, size_t value_size);
+	static size_t encode(Kind _kind, size_t value_size, const void* in, size_t nvalues, unsigned char* out);
+	static size_t decodedSize(const unsigned char* in, size_t nbytes, size_t value_size);
+	static bool decode(Kind _kind, size_t value_size, const unsigned char* in, size_t nbytes, void* out);
+
+	/* HDF5 filter */
+	static bool registerFilter(void);
+};
+
+} // namespace tsdb
@@ -0,0 +1,421 @@
+/* STL includes */
+#include <vector>
+#include <limits>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TSDB_KERNELS_SSE2
+#endif
+
+/* TSDB includes */
+#include "columnkernels.h"
+#include "cell.h"
+
+namespace tsdb {
+
+/* ====================================================================
+ * struct StridedColumn - one field of a block of records
+ * ====================================================================
+ */
+
+/** <summary>Makes a column of field <c>ifield</c> of <c>nrecords</c> records laid out as in <c>_structure</c></summary> */
+StridedColumn::StridedColumn(const char* records, size_t nrecords, tsdb::Structure& _structure, size_t ifield) {
+	data = records + _structure.getOffsetOfField(ifield);
+	stride = _structure.getSizeOf();
+	size = nrecords;
+	type = _structure.getField(ifield)->getFieldType();
+}
+
+/** <summary>Makes a column of field <c>ifield</c> of a RecordSet</summary> */
+StridedColumn::StridedColumn(const tsdb::RecordSet& records, size_t ifield) {
+	// An empty RecordSet may not have any memory
+	data = (records.size() > 0) ? records.memoryBlockPtr().raw() + records.structure()->getOffsetOfField(ifield) : NULL;
+	stride = records.structure()->getSizeOf();
+	size = records.size();
+	type = records.structure()->getField(ifield)->getFieldType();
+}
+
+/* ====================================================================
+ * class ColumnKernels - computations over whole columns
+ * ====================================================================
+ */
+
+namespace {
+
+/* The number of values staged at a time */
+const size_t BLOCK_SIZE = 256;
+
+template <class T>
+void stageAs(const char* p, size_t stride, size_t n, tsdb::ieee64_t* out) {
+	for(size_t i = 0; i < n; i++, p += stride) {
+		T value;
+		memcpy(&value, p, sizeof(T));
+		out[i] = (tsdb::ieee64_t) value;
+	}
+}
+
+/** Returns values <c>first</c> to <c>first + n - 1</c> of a column as doubles, copied into <c>out</c>,
+ * which has room for <c>n</c> values, or in place for a contiguous DOUBLE column */
+const tsdb::ieee64_t* stage(const tsdb::StridedColumn& column, size_t first, size_t n, tsdb::ieee64_t* out) {
+	const char* p = column.data + first * column.stride;
+
+	switch(column.type) {
+		case tsdb::Field::DOUBLE:
+			if(column.stride == sizeof(tsdb::ieee64_t) && (size_t) p % sizeof(tsdb::ieee64_t) == 0) {
+				return (const tsdb::ieee64_t*) p;
+			}
+			stageAs<tsdb::ieee64_t>(p, column.stride, n, out);
+			break;
+		case tsdb::Field::INT32:
+			stageAs<tsdb::int32_t>(p, column.stride, n, out);
+			break;
+		case tsdb::Field::INT8:
+			stageAs<tsdb::int8_t>(p, column.stride, n, out);
+			break;
+		case tsdb::Field::TIMESTAMP:
+			stageAs<tsdb::timestamp_t>(p, column.stride, n, out);
+			break;
+		case tsdb::Field::DATE:
+			stageAs<tsdb::date_t>(p, column.stride, n, out);
+			break;
+		default:
+			throw tsdb::type_conversion_error("cannot convert type to double");
+	}
+	return out;
+}
+
+/** Adds the values of <c>x</c> that are not NaN to <c>*sum</c>, and their number to <c>*count</c>.
+ * If <c>squares</c> is true, adds the squares of their differences from <c>center</c> instead. */
+void sumBlock(const tsdb::ieee64_t* x, size_t n, tsdb::ieee64_t center, bool squares,
+	tsdb::ieee64_t* sum, size_t* count) {
+	size_t i = 0;
+	size_t k = 0;
+	tsdb::ieee64_t s = 0;
+
+#ifdef TSDB_KERNELS_SSE2
+	__m128d acc0 = _mm_setzero_pd();
+	__m128d acc1 = _mm_setzero_pd();
+	__m128d c = _mm_set1_pd(center);
+	for(; i + 4 <= n; i += 4) {
+		__m128d v0 = _mm_loadu_pd(x + i);
+		__m128d v1 = _mm_loadu_pd(x + i + 2);
+		__m128d m0 = _mm_cmpord_pd(v0, v0);
+		__m128d m1 = _mm_cmpord_pd(v1, v1);
+		if(squares) {
+			v0 = _mm_sub_pd(v0, c);
+			v1 = _mm_sub_pd(v1, c);
+			v0 = _mm_mul_pd(v0, v0);
+			v1 = _mm_mul_pd(v1, v1);
+		}
+		acc0 = _mm_add_pd(acc0, _mm_and_pd(m0, v0));
+		acc1 = _mm_add_pd(acc1, _mm_and_pd(m1, v1));
+		int bits = _mm_movemask_pd(m0) | (_mm_movemask_pd(m1) << 2);
+		k += (bits & 1) + ((bits >> 1) & 1) + ((bits >> 2) & 1) + ((bits >> 3) & 1);
+	}
+	acc0 = _mm_add_pd(acc0, acc1);
+	tsdb::ieee64_t lanes[2];
+	_mm_storeu_pd(lanes, acc0);
+	s = lanes[0] + lanes[1];
+#endif
+
+	for(; i < n; i++) {
+		tsdb::ieee64_t v = x[i];
+		if(v == v) {
+			s += squares ? (v - center) * (v - center) : v;
+			k++;
+		}
+	}
+
+	*sum += s;
+	*count += k;
+}
+
+/** Lowers <c>*min</c> and raises <c>*max</c> to the values of <c>x</c> that are not NaN */
+void minMaxBlock(const tsdb::ieee64_t* x, size_t n, tsdb::ieee64_t* min, tsdb::ieee64_t* max) {
+	size_t i = 0;
+	tsdb::ieee64_t lo = *min;
+	tsdb::ieee64_t hi = *max;
+
+#ifdef TSDB_KERNELS_SSE2
+	const tsdb::ieee64_t inf = std::numeric_limits<tsdb::ieee64_t>::infinity();
+	__m128d vlo = _mm_set1_pd(lo);
+	__m128d vhi = _mm_set1_pd(hi);
+	__m128d pinf = _mm_set1_pd(inf);
+	__m128d ninf = _mm_set1_pd(-inf);
+	for(; i + 2 <= n; i += 2) {
+		__m128d v = _mm_loadu_pd(x + i);
+		__m128d m = _mm_cmpord_pd(v, v);
+		// NaNs become +inf for the minimum, and -inf for the maximum
+		vlo = _mm_min_pd(vlo, _mm_or_pd(_mm_and_pd(m, v), _mm_andnot_pd(m, pinf)));
+		vhi = _mm_max_pd(vhi, _mm_or_pd(_mm_and_pd(m, v), _mm_andnot_pd(m, ninf)));
+	}
+	tsdb::ieee64_t lanes[2];
+	_mm_storeu_pd(lanes, vlo);
+	lo = lanes[0] < lanes[1] ? lanes[0] : lanes[1];
+	_mm_storeu_pd(lanes, vhi);
+	hi = lanes[0] > lanes[1] ? lanes[0] : lanes[1];
+#endif
+
+	for(; i < n; i++) {
+		if(x[i] < lo) {
+			lo = x[i];
+		}
+		if(x[i] > hi) {
+			hi = x[i];
+		}
+	}
+
+	*min = lo;
+	*max = hi;
+}
+
+/** Adds <c>v[i] * w[i]</c> to <c>*sum_vw</c> and <c>w[i]</c> to <c>*sum_w</c> where neither is NaN */
+void weightedBlock(const tsdb::ieee64_t* v, const tsdb::ieee64_t* w, size_t n,
+	tsdb::ieee64_t* sum_vw, tsdb::ieee64_t* sum_w, size_t* count) {
+	size_t i = 0;
+	size_t k = 0;
+	tsdb::ieee64_t svw = 0;
+	tsdb::ieee64_t sw = 0;
+
+#ifdef TSDB_KERNELS_SSE2
+	__m128d acc_vw = _mm_setzero_pd();
+	__m128d acc_w = _mm_setzero_pd();
+	for(; i + 2 <= n; i += 2) {
+		__m128d a = _mm_loadu_pd(v + i);
+		__m128d b = _mm_loadu_pd(w + i);
+		__m128d m = _mm_and_pd(_mm_cmpord_pd(a, a), _mm_cmpord_pd(b, b));
+		acc_vw = _mm_add_pd(acc_vw, _mm_and_pd(m, _mm_mul_pd(a, b)));
+		acc_w = _mm_add_pd(acc_w, _mm_and_pd(m, b));
+		int bits = _mm_movemask_pd(m);
+		k += (bits & 1) + ((bits >> 1) & 1);
+	}
+	tsdb::ieee64_t lanes[2];
+	_mm_storeu_pd(lanes, acc_vw);
+	svw = lanes[0] + lanes[1];
+	_mm_storeu_pd(lanes, acc_w);
+	sw = lanes[0] + lanes[1];
+#endif
+
+	for(; i < n; i++) {
+		if(v[i] == v[i] && w[i] == w[i]) {
+			svw += v[i] * w[i];
+			sw += w[i];
+			k++;
+		}
+	}
+
+	*sum_vw += svw;
+	*sum_w += sw;
+	*count += k;
+}
+
+/** Sums the column, or the squares of its differences from <c>center</c> */
+size_t sumColumn(const tsdb::StridedColumn& column, tsdb::ieee64_t center, bool squares, tsdb::ieee64_t* sum) {
+	tsdb::ieee64_t staged[BLOCK_SIZE];
+	size_t count = 0;
+
+	*sum = 0;
+	for(size_t first = 0; first < column.size; first += BLOCK_SIZE) {
+		size_t n = (column.size - first < BLOCK_SIZE) ? column.size - first : BLOCK_SIZE;
+		sumBlock(stage(column, first, n, staged), n, center, squares, sum, &count);
+	}
+	return count;
+}
+
+tsdb::timestamp_t timestampAt(const tsdb::StridedColumn& column, size_t i) {
+	tsdb::timestamp_t timestamp;
+	memcpy(&timestamp, column.data + i * column.stride, sizeof(timestamp));
+	return timestamp;
+}
+
+} // namespace
+
+/** <summary>Returns the number of values in the column that are not missing</summary> */
+size_t ColumnKernels::count(const tsdb::StridedColumn& column) {
+	if(column.type != tsdb::Field::DOUBLE) {
+		stage(column, 0, 0, NULL);  // checks the type
+		return column.size;
+	}
+
+	tsdb::ieee64_t sum;
+	return sumColumn(column, 0, false, &sum);
+}
+
+/** <summary>Returns the sum of the values in the column that are not missing, or 0 if there are none</summary>
+ * <remarks>If <c>count</c> is not NULL, the number of values that were summed is added to it.</remarks>
+ */
+tsdb::ieee64_t ColumnKernels::sum(const tsdb::StridedColumn& column, size_t* count) {
+	tsdb::ieee64_t sum;
+	size_t n = sumColumn(column, 0, false, &sum);
+	if(count != NULL) {
+		*count += n;
+	}
+	return sum;
+}
+
+/** <summary>Finds the smallest and the largest value in the column that are not missing</summary>
+ * <remarks>Returns false, and sets both to NaN, if there are no such values.</remarks>
+ */
+bool ColumnKernels::minMax(const tsdb::StridedColumn& column, tsdb::ieee64_t* min, tsdb::ieee64_t* max) {
+	tsdb::ieee64_t staged[BLOCK_SIZE];
+
+	*min = std::numeric_limits<tsdb::ieee64_t>::infinity();
+	*max = -std::numeric_limits<tsdb::ieee64_t>::infinity();
+	for(size_t first = 0; first < column.size; first += BLOCK_SIZE) {
+		size_t n = (column.size - first < BLOCK_SIZE) ? column.size - first : BLOCK_SIZE;
+		minMaxBlock(stage(column, first, n, staged), n, min, max);
+	}
+
+	if(*min > *max) {
+		// Nothing lowered the minimum, so every value was missing (an infinite value is not missing)
+		*min = std::numeric_limits<tsdb::ieee64_t>::quiet_NaN();
+		*max = *min;
+		return false;
+	}
+	return true;
+}
+
+/** <summary>Returns the mean of the values in the column that are not missing, or NaN if there are none</summary> */
+tsdb::ieee64_t ColumnKernels::mean(const tsdb::StridedColumn& column) {
+	tsdb::ieee64_t sum;
+	size_t count = sumColumn(column, 0, false, &sum);
+	return (count > 0) ? sum / count : std::numeric_limits<tsdb::ieee64_t>::quiet_NaN();
+}
+
+/** <summary>Returns the sample variance of the values in the column that are not missing</summary>
+ * <remarks>The variance is computed in two passes, from the differences from the mean, which is more
+ * accurate than the sum of squares. It is NaN if there are fewer than two values.</remarks>
+ */
+tsdb::ieee64_t ColumnKernels::variance(const tsdb::StridedColumn& column) {
+	tsdb::ieee64_t sum;
+	size_t count = sumColumn(column, 0, false, &sum);
+	if(count < 2) {
+		return std::numeric_limits<tsdb::ieee64_t>::quiet_NaN();
+	}
+
+	tsdb::ieee64_t squares;
+	sumColumn(column, sum / count, true, &squares);
+	return squares / (count - 1);
+}
+
+/** <summary>Sums <c>values[i] * weights[i]</c> and <c>weights[i]</c> over the records where neither is missing</summary>
+ * <remarks>The weighted mean of <c>values</c> is <c>*sum_vw / *sum_w</c>. The columns must be the same
+ * size. Returns the number of records that were summed.</remarks>
+ */
+size_t ColumnKernels::weightedSums(const tsdb::StridedColumn& values, const tsdb::StridedColumn& weights,
+	tsdb::ieee64_t* sum_vw, tsdb::ieee64_t* sum_w) {
+	tsdb::ieee64_t staged_values[BLOCK_SIZE];
+	tsdb::ieee64_t staged_weights[BLOCK_SIZE];
+	size_t count = 0;
+
+	*sum_vw = 0;
+	*sum_w = 0;
+	for(size_t first = 0; first < values.size; first += BLOCK_SIZE) {
+		size_t n = (values.size - first < BLOCK_SIZE) ? values.size - first : BLOCK_SIZE;
+		weightedBlock(stage(values, first, n, staged_values), stage(weights, first, n, staged_weights), n,
+			sum_vw, sum_w, &count);
+	}
+	return count;
+}
+
+/** <summary>Selects the records with a timestamp from <c>start</c> to <c>end</c> (inclusive)</summary>
+ * <remarks>The indexes of the records are appended to <c>selection</c>, which is cleared first. The
+ * timestamps do not have to be sorted. Returns the number of records selected.</remarks>
+ */
+size_t ColumnKernels::timestampRange(const tsdb::StridedColumn& timestamps, tsdb::timestamp_t start,
+	tsdb::timestamp_t end, std::vector<size_t>& selection) {
+	if(timestamps.type != tsdb::Field::TIMESTAMP) {
+		throw tsdb::type_conversion_error("cannot convert type to timestamp");
+	}
+
+	selection.clear();
+	const char* p = timestamps.data;
+	for(size_t i = 0; i < timestamps.size; i++, p += timestamps.stride) {
+		tsdb::timestamp_t timestamp;
+		memcpy(&timestamp, p, sizeof(timestamp));
+		if(timestamp >= start && timestamp <= end) {
+			selection.push_back(i);
+		}
+	}
+	return selection.size();
+}
+
+/** <summary>Returns the index of the first timestamp that is not before <c>timestamp</c>, or the size of the
+ * column if there is none</summary>
+ * <remarks>The timestamps must be sorted, as they are in a Timeseries.</remarks>
+ */
+size_t ColumnKernels::lowerBound(const tsdb::StridedColumn& timestamps, tsdb::timestamp_t timestamp) {
+	if(timestamps.type != tsdb::Field::TIMESTAMP) {
+		throw tsdb::type_conversion_error("cannot convert type to timestamp");
+	}
+
+	size_t first = 0;
+	size_t n = timestamps.size;
+	while(n > 0) {
+		size_t half = n / 2;
+		if(timestampAt(timestamps, first + half) < timestamp) {
+			first += half + 1;
+			n -= half + 1;
+		} else {
+			n = half;
+		}
+	}
+	return first;
+}
+
+/** <summary>Copies the column into <c>out</c> as doubles</summary>
+ * <remarks><c>out</c> must have room for <c>column.size</c> values.</remarks>
+ */
+void ColumnKernels::toDoubles(const tsdb::StridedColumn& column, tsdb::ieee64_t* out) {
+	if(column.type == tsdb::Field::DOUBLE && column.stride == sizeof(tsdb::ieee64_t)) {
+		memcpy(out, column.data, column.size * sizeof(tsdb::ieee64_t));
+		return;
+	}
+
+	const tsdb::ieee64_t* values = stage(column, 0, column.size, out);
+	if(values != out) {
+		memcpy(out, values, column.size * sizeof(tsdb::ieee64_t));
+	}
+}
+
+/** <summary>Copies an INT32, INT8, DATE or SYMBOL column into <c>out</c> as ints</summary>
+ * <remarks><c>out</c> must have room for <c>column.size</c> values. Other types throw a
+ * type_conversion_error, as Cell::toInt32() does.</remarks>
+ */
+void ColumnKernels::toInts(const tsdb::StridedColumn& column, int* out) {
+	const char* p = column.data;
+
+	switch(column.type) {
+		case tsdb::Field::INT32:
+			for(size_t i = 0; i < column.size; i++, p += column.stride) {
+				tsdb::int32_t value;
+				memcpy(&value, p, sizeof(value));
+				out[i] = (int) value;
+			}
+			break;
+		case tsdb::Field::INT8:
+			for(size_t i = 0; i < column.size; i++, p += column.stride) {
+				out[i] = (int) *(const tsdb::int8_t*) p;
+			}
+			break;
+		case tsdb::Field::DATE:
+			for(size_t i = 0; i < column.size; i++, p += column.stride) {
+				tsdb::date_t value;
+				memcpy(&value, p, sizeof(value));
+				out[i] = (int) value;
+			}
+			break;
+		case tsdb::Field::SYMBOL:
+			for(size_t i = 0; i < column.size; i++, p += column.stride) {
+				tsdb::symbol_t value;
+				memcpy(&value, p, sizeof(value));
+				out[i] = (int) value;
+			}
+			break;
+		default:
+			throw tsdb::type_conversion_error("cannot convert type to int32");
+	}
+}
+
+} // namespace tsdb
@@ -0,0 +1,76 @@
+#pragma once
+
+/* STL Classes */
+#include <vector>
+
+/* TSDB Includes */
+#include "tsdb.h"
+#include "field.h"
+#include "structure.h"
+#include "recordset.h"
+
+namespace tsdb {
+
+/* -----------------------------------------------------------------
+ * StridedColumn. One field of a block of records.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>A field of a block of records, seen as a column</summary>
+ * <remarks>Value <c>i</c> of the column is at <c>data + i * stride</c>, where <c>data</c> points to the
+ * field in the first record and <c>stride</c> is the size of a record (Structure::getSizeOf()). A
+ * StridedColumn does not own its memory, so it is only valid while the records are.</remarks>
+ */
+struct StridedColumn
+{
+	StridedColumn(void): data(NULL), stride(0), size(0), type(tsdb::Field::UNDEFINED) {}
+	StridedColumn(const char* _data, size_t _stride, size_t _size, tsdb::Field::FieldType _type):
+		data(_data), stride(_stride), size(_size), type(_type) {}
+	StridedColumn(const char* records, size_t nrecords, tsdb::Structure& _structure, size_t ifield);
+	StridedColumn(const tsdb::RecordSet& records, size_t ifield);
+
+	/** <summary>Returns values <c>first</c> to <c>first + n - 1</c> of the column</summary> */
+	StridedColumn slice(size_t first, size_t n) const {
+		return StridedColumn(data + first * stride, stride, n, type);
+	}
+
+	const char* data;
+	size_t stride;
+	size_t size;
+	tsdb::Field::FieldType type;
+};
+
+/* -----------------------------------------------------------------
+ * ColumnKernels. Computations over whole columns.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>Sums, extremes and filters over StridedColumns, without going through Record and Cell</summary>
+ * <remarks><p>The kernels take columns of DOUBLE, INT32, INT8, TIMESTAMP and DATE fields, and compute
+ * in doubles. Any other type throws a type_conversion_error, as Cell::toDouble() does. A NaN in a
+ * DOUBLE column is a missing value: it is not counted, and does not take part in sums or extremes.</p>
+ * <p>Each kernel copies the column, a block at a time, into a contiguous buffer of doubles, with a
+ * loop that is specialized for the field type at compile time; the arithmetic then runs over that
+ * buffer, two values at a time with SSE2 where it is available. A contiguous DOUBLE column is read in
+ * place.</p></remarks>
+ */
+class ColumnKernels
+{
+public:
+	static size_t count(const tsdb::StridedColumn& column);
+	static tsdb::ieee64_t sum(const tsdb::StridedColumn& column, size_t* count = NULL);
+	static bool minMax(const tsdb::StridedColumn& column, tsdb::ieee64_t* min, tsdb::ieee64_t* max);
+	static tsdb::ieee64_t mean(const tsdb::StridedColumn& column);
+	static tsdb::ieee64_t variance(const tsdb::StridedColumn& column);
+	static size_t weightedSums(const tsdb::StridedColumn& values, const tsdb::StridedColumn& weights,
+		tsdb::ieee64_t* sum_vw, tsdb::ieee64_t* sum_w);
+
+	static size_t timestampRange(const tsdb::StridedColumn& timestamps, tsdb::timestamp_t start,
+		tsdb::timestamp_t end, std::vector<size_t>& selection);
+	static size_t lowerBound(const tsdb::StridedColumn& timestamps, tsdb::timestamp_t timestamp);
+
+	static void toDoubles(const tsdb::StridedColumn& column, tsdb::ieee64_t* out);
+	static void toInts(const tsdb::StridedColumn& column, int* out);
+};
+
+} // namespace tsdb
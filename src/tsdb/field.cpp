@@ -10,6 +10,8 @@
 /* TSDB Includes */
 #include "field.h"
 #include "tsdb.h"
+#include "hdf5lock.h"
+#include "symboltable.h"
 
 using namespace std;
 
@@ -442,6 +444,8 @@ const string CharField::toString(const void* fld) {
  */
 StringField::StringField(std::string new_name, int _length):
 Field(new_name, 0, 0, tsdb::Field::STRING) {
+	HDF5Lock lock;
+
 	hid_t strtype;
 	herr_t status;
 	strtype = H5Tcopy(H5T_C_S1);
@@ -485,4 +489,70 @@ const string StringField::toString(const void* fld) {
 	return sout.str();
 }
 
+
+/* ====================================================================
+ * class SymbolField 
+ * ====================================================================
+ */
+
+/**
+ * <summary>
+ * Creates a new symbol field, with an empty dictionary.
+ * </summary>
+ * <param name="new_name">A name for this Field.</param>
+ * <param name="_max_length">The most characters a symbol may have.</param>
+ */
+SymbolField::SymbolField(std::string new_name, int _max_length):
+Field(new_name, H5T_NATIVE_INT, sizeof(tsdb::symbol_t), tsdb::Field::SYMBOL) {
+	if(_max_length < 1) {
+		throw( SymbolTableException("the maximum length of a symbol must be at least 1") );
+	}
+	my_symbols = boost::shared_ptr<tsdb::SymbolTable>(new SymbolTable((size_t) _max_length));
+}
+
+/**
+ * <summary>
+ * Creates a new symbol field that shares the dictionary <c>_symbols</c>.
+ * </summary>
+ * <param name="new_name">A name for this Field.</param>
+ * <param name="_symbols">The dictionary of the field</param>
+ */
+SymbolField::SymbolField(std::string new_name, const boost::shared_ptr<tsdb::SymbolTable>& _symbols):
+Field(new_name, H5T_NATIVE_INT, sizeof(tsdb::symbol_t), tsdb::Field::SYMBOL), my_symbols(_symbols) {
+}
+
+/**
+ * <summary>
+ * Returns the TSDB type of the Field. 
+ * </summary>
+ * <remarks>
+ * For SymbolField, this is "Symbol(max length)"
+ * </remarks>
+ */
+const string SymbolField::getTSDBType() {
+	std::stringstream ss;
+	ss << "Symbol(" << my_symbols->maxLength() << ")";
+	return ss.str();
+}
+
+/**
+ * <summary>
+ * Returns the symbol of the code in the record.
+ * </summary>
+ * <param name="fld">A pointer to a memory block containing a code
+ * which will be looked up in the dictionary.</param>
+ */
+const string SymbolField::toString(const void* fld) {
+	return my_symbols->symbol(*((const tsdb::symbol_t*) fld));
+}
+
+/**
+ * <summary>
+ * Returns the dictionary of the field.
+ * </summary>
+ */
+const boost::shared_ptr<tsdb::SymbolTable>& SymbolField::symbols(void) const {
+	return my_symbols;
+}
+
 } // namespace tsdb
\ No newline at end of file
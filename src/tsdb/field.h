@@ -5,6 +5,7 @@
 
 /* External Libraries */
 #include "hdf5.h"
+#include "boost/shared_ptr.hpp"
 
 
 #include "tsdb.h"
@@ -25,8 +26,10 @@ typedef long long int64_t;
 typedef unsigned long long uint64_t;
 typedef unsigned long long record_t;
 typedef long date_t;
+typedef int symbol_t;
 
 /* Forward declarations */
+class SymbolTable;
 
 /* -----------------------------------------------------------------
  * Base Field class. This class is not created in practice.
@@ -50,6 +53,7 @@ public:
 		TIMESTAMP,
 		DATE,
 		STRING,
+		SYMBOL,
 		UNDEFINED
 	};
 
@@ -59,7 +63,7 @@ public:
 	const FieldType getFieldType(void);
 	virtual const std::string toString(const void* fld);
 	virtual const std::string getTSDBType();
-	~Field(void);
+	virtual ~Field(void);
 
 protected:
 	
@@ -236,6 +240,34 @@ public:
 
 };
 
+/* -----------------------------------------------------------------
+ * SymbolField class. Represents a string from a dictionary
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>Represents a string stored as its 32-bit code in a dictionary</summary>
+ * <remarks><p>A symbol, venue or side column repeats a few strings over and over. A SymbolField keeps
+ * each of them once, in a SymbolTable, and stores the code of the string in the record, so records are
+ * narrower than with a StringField, and symbols compare as integers.</p>
+ * <p>The SymbolTable is shared by the copies of the field, such as the ones in projected Structures,
+ * so the codes mean the same in all of them. The Table of the field saves the symbols in a dataset of its
+ * own. <c>_max_length</c> is the longest a symbol may be.</p></remarks>
+ */
+class  SymbolField: public Field
+{
+public:
+
+	SymbolField(std::string new_name, int _max_length);
+	SymbolField(std::string new_name, const boost::shared_ptr<tsdb::SymbolTable>& _symbols);
+	const std::string toString(const void* fld);
+	const std::string getTSDBType();
+	const boost::shared_ptr<tsdb::SymbolTable>& symbols(void) const;
+
+private:
+	boost::shared_ptr<tsdb::SymbolTable> my_symbols;
+
+};
+
 } // namespace tsdb
 
 	
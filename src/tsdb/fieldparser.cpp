@@ -1,7 +1,13 @@
 /* STL Classes */
 #include <iostream>
 #include <locale>
+#include <cctype>
+#include <sstream>
+#include <limits>
+#include <algorithm>
 #include <stdlib.h>
+#include <string.h>
+#include <locale.h>
 
 /* Boost */
 #include "boost/date_time.hpp"
@@ -10,6 +16,7 @@
 #include "tsdb.h"
 #include "recordparser.h"
 #include "fieldparser.h"
+#include "symboltable.h"
 
 
 namespace tsdb {
@@ -24,13 +31,112 @@ namespace tsdb {
  */
 FieldParser::FieldParser(void)
 {
+	this->record_parser = NULL;
+	this->field_id = 0;
+	this->missing_tokens_ok = false;
 }
 
 FieldParser::~FieldParser(void)
 {
 }
 
+/** <summary>
+ * Parses a vector of token strings, and writes the result to a record.
+ * </summary>
+ * <remarks>There are two entry points, for tokens as strings and as TokenViews. By default each one
+ * converts the tokens and calls the other, so a subclass must override at least one of them. The
+ * FieldParsers in TSDB override the TokenView one, which does not copy the tokens.</remarks>
+ * <param name="tokens">A vector of token strings</param>
+ * <param name="record">A pointer to a already-allocated block of memory to save the record to.</param>
+ */
 void FieldParser::writeParsedTokensToRecord(const std::vector<std::string> &tokens, void* record) {
+	this->token_views.resize(tokens.size());
+	for(size_t i = 0; i < tokens.size(); i++) {
+		this->token_views[i] = TokenView(tokens[i]);
+	}
+	writeParsedTokensToRecord(this->token_views, record);
+}
+
+/** <summary>
+ * Parses a vector of TokenViews, and writes the result to a record.
+ * </summary>
+ * <param name="tokens">A vector of TokenViews</param>
+ * <param name="record">A pointer to a already-allocated block of memory to save the record to.</param>
+ */
+void FieldParser::writeParsedTokensToRecord(const std::vector<tsdb::TokenView> &tokens, void* record) {
+	this->token_strings.resize(tokens.size());
+	for(size_t i = 0; i < tokens.size(); i++) {
+		this->token_strings[i].assign(tokens[i].data, tokens[i].size);
+	}
+	writeParsedTokensToRecord(this->token_strings, record);
+}
+
+/** <summary>
+ * Returns token <c>i</c>, or the missing token replacement if there is no such token and missing
+ * tokens are ok.
+ * </summary>
+ * <remarks>Throws std::out_of_range if the token is missing and missing tokens are not ok.</remarks>
+ */
+tsdb::TokenView FieldParser::consumeToken(const std::vector<tsdb::TokenView> &tokens, size_t i) {
+	if(i >= tokens.size() && this->missing_tokens_ok) {
+		return TokenView(this->missing_token_replacement);
+	}
+	return tokens.at(i);
+}
+
+/** <summary>
+ * Parses the field of every row of a TokenTable, and writes it to consecutive records.
+ * </summary>
+ * <remarks><p>Row <c>r</c> goes to the record at <c>records + r * record_size</c>. <c>errors</c> has an
+ * element per row: a row that a FieldParser fails on gets the error there, and the FieldParsers after
+ * it skip the row. The other rows carry on.</p>
+ * <p>By default, each row is handed to writeParsedTokensToRecord(). The numeric FieldParsers override
+ * this with one loop over their column, which is what makes RecordParser::parseLines() faster than
+ * parsing line by line.</p></remarks>
+ * <param name="table">The tokens of each row</param>
+ * <param name="records">Pointer to a record for each row, zeroed</param>
+ * <param name="record_size">Size of a record</param>
+ * <param name="errors">The error of each row, or an empty string</param>
+ */
+void FieldParser::parseColumn(const tsdb::TokenTable& table, char* records, size_t record_size,
+	std::vector<std::string>& errors) {
+	for(size_t r = 0; r < table.size(); r++) {
+		if(!errors[r].empty()) {
+			continue;
+		}
+		this->row_tokens.assign(table.row(r), table.row(r) + table.ntokens(r));
+		try {
+			writeParsedTokensToRecord(this->row_tokens, records + r * record_size);
+		} catch(std::exception& e) {
+			errors[r] = e.what();
+		}
+	}
+}
+
+/** <summary>
+ * Gets token <c>i</c> of a row of a TokenTable, or the missing token replacement, as consumeToken() does.
+ * </summary>
+ * <remarks>Returns false if a FieldParser has already failed on the row, or if the token is missing and
+ * missing tokens are not ok, which is the error of the row then.</remarks>
+ */
+bool FieldParser::consumeColumnToken(const tsdb::TokenTable& table, size_t row, size_t i,
+	std::vector<std::string>& errors, tsdb::TokenView* token) {
+	if(!errors[row].empty()) {
+		return false;
+	}
+	if(i < table.ntokens(row)) {
+		*token = table.row(row)[i];
+		return true;
+	}
+	if(this->missing_tokens_ok) {
+		*token = TokenView(this->missing_token_replacement);
+		return true;
+	}
+
+	std::ostringstream msg;
+	msg << "token " << i << " is missing, and there is no missing token replacement";
+	errors[row] = FieldParserException(msg.str()).what();
+	return false;
 }
 
 void FieldParser::setMissingTokenReplacement(std::string _missing_token_replacement) {
@@ -74,6 +180,10 @@ void FieldParser::bindToRecordParser(tsdb::RecordParser* new_record_parser) {
  * as being in GMT, with no leap seconds. This method uses the Boost library for date parsing.
  * Format tokens are similar, but not identical, to the UNIX function strptime. For a complete
  * list of tokens, see http://www.crystalclearsoftware.com/libraries/date_time/release_1_33/date_time/date_time_io.html#date_time.format_flags
+ * <p>Formats that use only %Y, %m, %d, %H, %M, %S, %F (and %%) with literal characters and spaces are
+ * compiled into a list of fixed-width matchers and parsed without Boost, which is much faster. If the
+ * tokens do not match the compiled format, or the format uses other flags, Boost parses the tokens
+ * instead.</p>
  * </remarks>
  * <param name="new_consume_tokens">A vector of token numbers to be joined (with spaces) then parsed
  * into a timestamp</param>
@@ -93,32 +203,217 @@ TimestampFieldParser::TimestampFieldParser(std::vector<size_t> new_consume_token
 		new boost::posix_time::time_input_facet(this->format));
 	this->epoch = boost::posix_time::ptime(boost::gregorian::date(1970,1,1),
 		boost::posix_time::time_duration(0,0,0,0));
+	this->fast_format = compileFormat(this->format);
 }
 
 /** <summary>
- * Parses a vector of token strings, and writes the result to a record.
+ * Compiles a format string for fastParse(). Returns false if the format uses a flag that fastParse()
+ * does not support, or has no date.
  * </summary>
- * <param name="tokens">A vector of token strings</param>
- * <param name="record">A pointer to a already-allocated block of memory to save the record to.</param>
  */
-void TimestampFieldParser::writeParsedTokensToRecord(const std::vector<std::string> &tokens, void* record) {
-	using namespace std;
+bool TimestampFieldParser::compileFormat(const std::string& format) {
+	bool has_year = false, has_month = false, has_day = false;
+	FormatItem item;
+
+	this->compiled_format.clear();
+	for(size_t i = 0; i < format.size(); i++) {
+		item.literal = format[i];
+		if(format[i] == '%') {
+			if(++i >= format.size()) {
+				return false;
+			}
+			switch(format[i]) {
+			case 'Y': has_year = true; break;
+			case 'm': has_month = true; break;
+			case 'd': has_day = true; break;
+			case 'H': case 'M': case 'S': case 'F': break;
+			case '%': 
+				item.type = 'L';
+				item.literal = '%';
+				this->compiled_format.push_back(item);
+				continue;
+			default:
+				return false;
+			}
+			item.type = format[i];
+		} else if(isspace((unsigned char) format[i])) {
+			item.type = ' ';
+		} else {
+			item.type = 'L';
+		}
+		this->compiled_format.push_back(item);
+	}
 
-	if(this->record_parser == NULL) {
-		throw(FieldParserException("not bound to record parser"));
+	return has_year && has_month && has_day;
+}
+
+namespace {
+
+/* Walks the characters of the tokens joined with spaces (" token0 token1 ...") without joining them */
+class TokenCursor {
+public:
+	TokenCursor(const std::vector<TokenView>& _tokens): 
+		tokens(_tokens), itoken(0), p(NULL), end(NULL), at_gap(!_tokens.empty()) {}
+
+	/* Returns false at the end */
+	inline bool get(char* c) const {
+		if(at_gap) {
+			*c = ' ';
+			return true;
+		}
+		if(p != end) {
+			*c = *p;
+			return true;
+		}
+		return false;
+	}
+
+	inline void next(void) {
+		if(at_gap) {
+			at_gap = false;
+			p = tokens[itoken].data;
+			end = p + tokens[itoken].size;
+			itoken++;
+		} else {
+			p++;
+		}
+		if(p == end && itoken < tokens.size()) {
+			at_gap = true;
+		}
+	}
+
+	/* Reads exactly <c>width</c> digits */
+	inline bool digits(int width, int* value) {
+		int v = 0;
+		char c;
+		for(int i = 0; i < width; i++) {
+			if(!get(&c) || (unsigned int) (c - '0') > 9) {
+				return false;
+			}
+			v = v * 10 + (c - '0');
+			next();
+		}
+		*value = v;
+		return true;
+	}
+
+private:
+	const std::vector<TokenView>& tokens;
+	size_t itoken;
+	const char* p;
+	const char* end;
+	bool at_gap;
+};
+
+/* Days since 1970-01-01 of a date in the proleptic Gregorian calendar */
+inline long long daysFromCivil(int y, int m, int d) {
+	y -= m <= 2;
+	long long era = (y >= 0 ? y : y - 399) / 400;
+	long long yoe = y - era * 400;
+	long long doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	long long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + doe - 719468;
+}
+
+inline int daysInMonth(int y, int m) {
+	static const int days[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+	if(m == 2 && (y % 4 == 0 && (y % 100 != 0 || y % 400 == 0))) {
+		return 29;
+	}
+	return days[m - 1];
+}
+
+} // anonymous namespace
+
+/** <summary>
+ * Parses the tokens in <c>consumed</c> with the compiled format. Returns false if they do not match.
+ * </summary>
+ * <remarks><p>The tokens are read as if they were joined with spaces, as in boostParse(), but are not
+ * copied. Leading whitespace is skipped, and a space in the format matches one whitespace character.</p>
+ * <p>Fractional seconds (%F) are optional. They are kept to the microsecond, and the result is
+ * truncated to milliseconds, as Boost does.</p></remarks>
+ */
+bool TimestampFieldParser::fastParse(timestamp_t* timestamp) {
+	int year = 1970, month = 1, day = 1, hour = 0, minute = 0, second = 0, micros = 0;
+	TokenCursor cursor(this->consumed);
+	char c;
+
+	while(cursor.get(&c) && isspace((unsigned char) c)) {
+		cursor.next();
+	}
+
+	for(size_t i = 0; i < this->compiled_format.size(); i++) {
+		const FormatItem& item = this->compiled_format[i];
+		switch(item.type) {
+		case ' ':
+			if(!cursor.get(&c) || !isspace((unsigned char) c)) { return false; }
+			cursor.next();
+			break;
+		case 'L':
+			if(!cursor.get(&c) || c != item.literal) { return false; }
+			cursor.next();
+			break;
+		case 'Y':
+			if(!cursor.digits(4, &year)) { return false; }
+			break;
+		case 'm':
+			if(!cursor.digits(2, &month) || month < 1 || month > 12) { return false; }
+			break;
+		case 'd':
+			if(!cursor.digits(2, &day) || day < 1) { return false; }
+			break;
+		case 'H':
+			if(!cursor.digits(2, &hour) || hour > 23) { return false; }
+			break;
+		case 'M':
+			if(!cursor.digits(2, &minute) || minute > 59) { return false; }
+			break;
+		case 'S':
+			if(!cursor.digits(2, &second) || second > 59) { return false; }
+			break;
+		case 'F':
+			if(cursor.get(&c) && c == '.') {
+				cursor.next();
+				int ndigits = 0;
+				while(cursor.get(&c) && (unsigned int) (c - '0') <= 9) {
+					if(ndigits < 6) {
+						micros = micros * 10 + (c - '0');
+					}
+					ndigits++;
+					cursor.next();
+				}
+				if(ndigits == 0) {
+					return false;
+				}
+				for(; ndigits < 6; ndigits++) {
+					micros *= 10;
+				}
+			}
+			break;
+		}
 	}
 
+	if(day > daysInMonth(year, month)) {
+		return false;
+	}
+
+	long long seconds = ((daysFromCivil(year, month, day) * 24 + hour) * 60 + minute) * 60 + second;
+	*timestamp = (seconds * 1000000 + micros) / 1000;
+	return true;
+}
+
+/** <summary>
+ * Joins the tokens in <c>consumed</c> with spaces and parses them with Boost.
+ * </summary>
+ */
+timestamp_t TimestampFieldParser::boostParse(void) {
+	using namespace std;
+
 	string token_string = "";
 	boost::posix_time::ptime pt;
 
-	for(size_t i = 0;i<this->consume_tokens.size();i++) {
-		if(consume_tokens.at(i) >= tokens.size() && this->missing_tokens_ok) {
-			token_string = token_string + " " + this->missing_token_replacement;
-		} else {
-			// note: this will throw an exception if missing_tokens_ok = false and 
-			// the token to be consumed is out of bounds
-			token_string = token_string + " " + tokens.at(consume_tokens.at(i));
-		}
+	for(size_t i = 0; i < this->consumed.size(); i++) {
+		token_string = token_string + " " + this->consumed[i].str();
 	}
 
 	/* Now, the actual parsing of the timestamp string */
@@ -126,7 +421,32 @@ void TimestampFieldParser::writeParsedTokensToRecord(const std::vector<std::stri
 	is.imbue(locale_format);
 	is >> pt;
 
-	timestamp_t timestamp = (pt - this->epoch).total_milliseconds();
+	return (pt - this->epoch).total_milliseconds();
+}
+
+/** <summary>
+ * Parses a vector of TokenViews, and writes the result to a record.
+ * </summary>
+ * <param name="tokens">A vector of TokenViews</param>
+ * <param name="record">A pointer to a already-allocated block of memory to save the record to.</param>
+ */
+void TimestampFieldParser::writeParsedTokensToRecord(const std::vector<tsdb::TokenView> &tokens, void* record) {
+	if(this->record_parser == NULL) {
+		throw(FieldParserException("not bound to record parser"));
+	}
+
+	// note: this will throw an exception if missing_tokens_ok = false and 
+	// a token to be consumed is out of bounds
+	this->consumed.resize(this->consume_tokens.size());
+	for(size_t i = 0;i<this->consume_tokens.size();i++) {
+		this->consumed[i] = consumeToken(tokens, this->consume_tokens[i]);
+	}
+
+	/* Now, the actual parsing of the timestamp string */
+	timestamp_t timestamp;
+	if(!this->fast_format || !fastParse(&timestamp)) {
+		timestamp = boostParse();
+	}
 	
 	// Write the timestamp to the record
 	this->record_parser->getRecordStructure()->setMember(record,this->field_id,&timestamp);
@@ -155,46 +475,232 @@ StringFieldParser::StringFieldParser(std::vector<size_t> new_consume_tokens,
 }
 
 /** <summary>
- * Parses a vector of token strings, and writes the result to a record.
+ * Parses a vector of TokenViews, and writes the result to a record.
  * </summary>
- * <param name="tokens">A vector of token strings</param>
+ * <param name="tokens">A vector of TokenViews</param>
  * <param name="record">A pointer to a already-allocated block of memory to save the record to.</param>
  */
-void StringFieldParser::writeParsedTokensToRecord(const std::vector<std::string> &tokens, void* record) {
-	using namespace std;
-
+void StringFieldParser::writeParsedTokensToRecord(const std::vector<tsdb::TokenView> &tokens, void* record) {
 	if(this->record_parser == NULL) {
 		throw(FieldParserException("not bound to record parser"));
 	}
 
-	string token_string;
-	token_string = tokens.at(consume_tokens.at(0));
+	// The tokens are joined with spaces, and cut off at the size of the field
+	size_t size = this->record_parser->getRecordStructure()->getSizeOfField(this->field_id);
+	this->string_buffer.assign(size, '\0');
+	size_t used = 0;
 
-	for(size_t i = 1;i<this->consume_tokens.size();i++) {
-		if(consume_tokens.at(i) >= tokens.size() && this->missing_tokens_ok) {
-			token_string = token_string + " " + this->missing_token_replacement;
+	for(size_t i = 0;i<this->consume_tokens.size() && used < size;i++) {
+		TokenView token;
+		if(i == 0) {
+			token = tokens.at(consume_tokens.at(0));
 		} else {
 			// note: this will throw an exception if missing_tokens_ok = false and 
 			// the token to be consumed is out of bounds
-			token_string = token_string + " " + tokens.at(consume_tokens.at(i));
+			token = consumeToken(tokens, consume_tokens.at(i));
+			this->string_buffer[used++] = ' ';
 		}
+
+		size_t n = (token.size > size - used ? size - used : token.size);
+		if(n > 0) {
+			memcpy(&this->string_buffer[used], token.data, n);
+		}
+		used += n;
+	}
+	
+	// Write the string to the record
+	if(size > 0) {
+		this->record_parser->getRecordStructure()->setMember(record,this->field_id,&this->string_buffer[0]);
 	}
+}
 
-	// create some scratch memory to put the string in
-	size_t size = this->record_parser->getRecordStructure()->getSizeOfField(this->field_id);
-	char* tmpstr = new char[size];
-	memset(tmpstr,0,size);
+namespace {
 
-	// use the min of token_string.length() or the size of the field
-	size = (token_string.length() > size ? size : token_string.length());
-	memcpy(tmpstr,token_string.c_str(),size);
-	
-	// Write the timestamp to the record
-	this->record_parser->getRecordStructure()->setMember(record,this->field_id,tmpstr);
+/* Eight characters, the first in the lowest byte, whatever the byte order of the machine */
+inline unsigned long long loadEight(const char* p) {
+	unsigned long long v = 0;
+	for(int i = 7; i >= 0; i--) {
+		v = (v << 8) | (unsigned char) p[i];
+	}
+	return v;
+}
 
-	delete[] tmpstr;
+/* True if all eight characters are digits. Adding 0x46 carries into the top bit of a byte above '9',
+   and subtracting 0x30 borrows into it below '0'. */
+inline bool isEightDigits(unsigned long long v) {
+	return (((v + 0x4646464646464646ULL) | (v - 0x3030303030303030ULL)) & 0x8080808080808080ULL) == 0;
 }
 
+/* The value of eight digits, combining pairs of digits, then pairs of pairs, with one multiplication
+   for each step (SWAR) */
+inline unsigned long long eightDigitsValue(unsigned long long v) {
+	v = ((v & 0x0F0F0F0F0F0F0F0FULL) * 2561) >> 8;
+	v = ((v & 0x00FF00FF00FF00FFULL) * 6553601) >> 16;
+	return ((v & 0x0000FFFF0000FFFFULL) * 42949672960001ULL) >> 32;
+}
+
+/* Parses an integer like atol(): leading whitespace, an optional sign, then digits up to the
+   first character that is not a digit. Runs of eight digits are converted at once. */
+inline long long parseInteger(const TokenView& token) {
+	const char* p = token.data;
+	const char* end = token.data + token.size;
+	bool negative = false;
+	unsigned long long value = 0;
+
+	while(p < end && isspace((unsigned char) *p)) {
+		p++;
+	}
+	if(p < end && (*p == '-' || *p == '+')) {
+		negative = (*p == '-');
+		p++;
+	}
+	while(end - p >= 8) {
+		unsigned long long eight = loadEight(p);
+		if(!isEightDigits(eight)) {
+			break;
+		}
+		value = value * 100000000ULL + eightDigitsValue(eight);
+		p += 8;
+	}
+	while(p < end && (unsigned int) (*p - '0') <= 9) {
+		value = value * 10 + (*p - '0');
+		p++;
+	}
+	return negative ? (long long) (0 - value) : (long long) value;
+}
+
+/* The powers of ten a double holds exactly */
+const double EXACT_POWERS_OF_TEN[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+/* Parses a decimal number, [sign] digits [. digits] [e [sign] digits], when it can be done exactly:
+   with at most 19 significant digits that make a mantissa below 2^53, and a power of ten up to 22,
+   the mantissa and the power are both exact doubles, and one multiplication or division rounds
+   correctly (Clinger's fast path). Characters after the number are ignored, as atof() does. Returns
+   false for anything else, such as more digits, a larger exponent, hexadecimal, inf or nan. */
+inline bool fastParseDouble(const char* p, const char* end, double* value) {
+	bool negative = false;
+	if(p < end && (*p == '-' || *p == '+')) {
+		negative = (*p == '-');
+		p++;
+	}
+
+	unsigned long long mantissa = 0;
+	int ndigits = 0;     // significant digits in the mantissa
+	int exponent = 0;
+	bool any_digits = false;
+
+	while(p < end && (unsigned int) (*p - '0') <= 9) {
+		if(mantissa != 0 || *p != '0') {
+			if(++ndigits > 19) {
+				return false;
+			}
+			mantissa = mantissa * 10 + (*p - '0');
+		}
+		any_digits = true;
+		p++;
+	}
+	if(p < end && *p == '.') {
+		p++;
+		while(end - p >= 8 && ndigits + 8 <= 19 && isEightDigits(loadEight(p))) {
+			mantissa = mantissa * 100000000ULL + eightDigitsValue(loadEight(p));
+			ndigits += (mantissa != 0) ? 8 : 0;
+			exponent -= 8;
+			any_digits = true;
+			p += 8;
+		}
+		while(p < end && (unsigned int) (*p - '0') <= 9) {
+			if(mantissa != 0 || *p != '0') {
+				if(++ndigits > 19) {
+					return false;
+				}
+				mantissa = mantissa * 10 + (*p - '0');
+			}
+			exponent--;
+			any_digits = true;
+			p++;
+		}
+	}
+	if(!any_digits) {
+		return false;
+	}
+	if(p < end && (*p == 'x' || *p == 'X')) {
+		return false;
+	}
+
+	// An exponent only counts if it has digits, as in "1e" atof() reads 1
+	if(p < end && (*p == 'e' || *p == 'E')) {
+		const char* q = p + 1;
+		bool negative_exponent = false;
+		if(q < end && (*q == '-' || *q == '+')) {
+			negative_exponent = (*q == '-');
+			q++;
+		}
+		if(q < end && (unsigned int) (*q - '0') <= 9) {
+			int e = 0;
+			while(q < end && (unsigned int) (*q - '0') <= 9) {
+				if(e > 10000) {
+					return false;
+				}
+				e = e * 10 + (*q - '0');
+				q++;
+			}
+			exponent += negative_exponent ? -e : e;
+		}
+	}
+
+	if(mantissa > (1ULL << 53)) {
+		return false;
+	}
+	double result = (double) mantissa;
+	if(mantissa != 0 && exponent != 0) {
+		if(exponent > 22 || exponent < -22) {
+			return false;
+		}
+		result = (exponent > 0) ? result * EXACT_POWERS_OF_TEN[exponent] : result / EXACT_POWERS_OF_TEN[-exponent];
+	}
+	*value = negative ? -result : result;
+	return true;
+}
+
+/* Parses a double with strtod(), but always with '.' as the decimal point. strtod() reads the decimal
+   point of the current locale, so a '.' is swapped for it, and the number ends at the locale's own
+   decimal point, as it would in the "C" locale. */
+double parseDoubleWithStrtod(const TokenView& token) {
+	char point = *localeconv()->decimal_point;
+	std::string text = token.str();
+	if(point != '.' && point != '\0') {
+		std::string::size_type cut = text.find(point);
+		if(cut != std::string::npos) {
+			text.erase(cut);
+		}
+		std::replace(text.begin(), text.end(), '.', point);
+	}
+	return strtod(text.c_str(), NULL);
+}
+
+/* Parses a double like atof() in the "C" locale. An empty token, or one of spaces, is a quiet NaN. */
+inline double parseDouble(const TokenView& token) {
+	TokenView trimmed = tsdb::RecordParser::trim(token);
+	if(trimmed.empty()) {
+		return std::numeric_limits<double>::quiet_NaN();
+	}
+
+	const char* p = trimmed.data;
+	const char* end = trimmed.data + trimmed.size;
+	while(p < end && isspace((unsigned char) *p)) {
+		p++;
+	}
+
+	double value;
+	if(fastParseDouble(p, end, &value)) {
+		return value;
+	}
+	return parseDoubleWithStrtod(trimmed);
+}
+
+} // anonymous namespace
+
 /* ====================================================================
  * class Int32FieldParser - Parser for 32 Bit Integers
  * ====================================================================
@@ -217,35 +723,44 @@ Int32FieldParser::Int32FieldParser(size_t token, std::string new_field_name) {
 }
 
 /** <summary>
- * Parses a vector of token strings, and writes the result to a record.
+ * Parses a vector of TokenViews, and writes the result to a record.
  * </summary>
- * <param name="tokens">A vector of token strings</param>
+ * <param name="tokens">A vector of TokenViews</param>
  * <param name="record">A pointer to a already-allocated block of memory to save the record to.</param>
  */
-void Int32FieldParser::writeParsedTokensToRecord(const std::vector<std::string> &tokens, void* record) {
-	using namespace std;
-
+void Int32FieldParser::writeParsedTokensToRecord(const std::vector<tsdb::TokenView> &tokens, void* record) {
 	if(this->record_parser == NULL) {
 		throw(FieldParserException("not bound to record parser"));
 	}
 
-
 	/* Now, the actual parsing of the string */
-	tsdb::int32_t int32;
-	if(this->missing_tokens_ok) {
-		if(this->consume_token >= tokens.size()) {
-			int32 = atol(this->missing_token_replacement.c_str());
-		} else {
-			int32 = atol(tokens.at(this->consume_token).c_str());
-		}
-	} else {
-		int32 = atol(tokens.at(this->consume_token).c_str());
-	}
+	tsdb::int32_t int32 = (tsdb::int32_t) parseInteger(consumeToken(tokens, this->consume_token));
 	
-	// Write the timestamp to the record
+	// Write the integer to the record
 	this->record_parser->getRecordStructure()->setMember(record,this->field_id,&int32);
 }
 
+/** <summary>
+ * Parses the token of every row of a TokenTable, and writes the integers to consecutive records.
+ * </summary>
+ * <remarks>See FieldParser::parseColumn().</remarks>
+ */
+void Int32FieldParser::parseColumn(const tsdb::TokenTable& table, char* records, size_t record_size,
+	std::vector<std::string>& errors) {
+	if(this->record_parser == NULL) {
+		throw(FieldParserException("not bound to record parser"));
+	}
+
+	char* field = records + this->record_parser->getRecordStructure()->getOffsetOfField(this->field_id);
+	TokenView token;
+	for(size_t r = 0; r < table.size(); r++, field += record_size) {
+		if(consumeColumnToken(table, r, this->consume_token, errors, &token)) {
+			tsdb::int32_t int32 = (tsdb::int32_t) parseInteger(token);
+			memcpy(field, &int32, sizeof(int32));
+		}
+	}
+}
+
 /* ====================================================================
  * class Int8FieldParser - Parser for 8 Bit Integers
  * ====================================================================
@@ -268,42 +783,56 @@ Int8FieldParser::Int8FieldParser(size_t token, std::string new_field_name) {
 }
 
 /** <summary>
- * Parses a vector of token strings, and writes the result to a record.
+ * Parses a vector of TokenViews, and writes the result to a record.
  * </summary>
- * <param name="tokens">A vector of token strings</param>
+ * <param name="tokens">A vector of TokenViews</param>
  * <param name="record">A pointer to a already-allocated block of memory to save the record to.</param>
  */
-void Int8FieldParser::writeParsedTokensToRecord(const std::vector<std::string> &tokens, void* record) {
-	using namespace std;
-
+void Int8FieldParser::writeParsedTokensToRecord(const std::vector<tsdb::TokenView> &tokens, void* record) {
 	if(this->record_parser == NULL) {
 		throw(FieldParserException("not bound to record parser"));
 	}
 
-
 	/* Now, the actual parsing of the string */
-	tsdb::int8_t int8;
-	int integer;
-	if(this->missing_tokens_ok) {
-		if(this->consume_token >= tokens.size()) {
-			integer = atol(this->missing_token_replacement.c_str());
-		} else {
-			integer = atol(tokens.at(this->consume_token).c_str());
-		}
-	} else {
-		integer = atol(tokens.at(this->consume_token).c_str());
-	}
+	long long integer = parseInteger(consumeToken(tokens, this->consume_token));
 
 	if(integer > 127 || integer < -127) {
 		throw(FieldParserException("Integer out of bounds."));
 	}
 
-	int8 = (tsdb::int8_t) integer;
+	tsdb::int8_t int8 = (tsdb::int8_t) integer;
 	
-	// Write the timestamp to the record
+	// Write the integer to the record
 	this->record_parser->getRecordStructure()->setMember(record,this->field_id,&int8);
 }
 
+/** <summary>
+ * Parses the token of every row of a TokenTable, and writes the integers to consecutive records.
+ * </summary>
+ * <remarks>See FieldParser::parseColumn(). A row with an integer out of bounds fails, as it does in
+ * writeParsedTokensToRecord().</remarks>
+ */
+void Int8FieldParser::parseColumn(const tsdb::TokenTable& table, char* records, size_t record_size,
+	std::vector<std::string>& errors) {
+	if(this->record_parser == NULL) {
+		throw(FieldParserException("not bound to record parser"));
+	}
+
+	char* field = records + this->record_parser->getRecordStructure()->getOffsetOfField(this->field_id);
+	TokenView token;
+	for(size_t r = 0; r < table.size(); r++, field += record_size) {
+		if(consumeColumnToken(table, r, this->consume_token, errors, &token)) {
+			long long integer = parseInteger(token);
+			if(integer > 127 || integer < -127) {
+				errors[r] = FieldParserException("Integer out of bounds.").what();
+				continue;
+			}
+			tsdb::int8_t int8 = (tsdb::int8_t) integer;
+			memcpy(field, &int8, sizeof(int8));
+		}
+	}
+}
+
 
 /* ====================================================================
  * class CharFieldParser - Parser for 8-bit characters
@@ -327,34 +856,22 @@ CharFieldParser::CharFieldParser(size_t token, std::string new_field_name) {
 }
 
 /** <summary>
- * Parses a vector of token strings, and writes the result to a record.
+ * Parses a vector of TokenViews, and writes the result to a record.
  * </summary>
- * <param name="tokens">A vector of token strings</param>
+ * <param name="tokens">A vector of TokenViews</param>
  * <param name="record">A pointer to a already-allocated block of memory to save the record to.</param>
  */
-void CharFieldParser::writeParsedTokensToRecord(const std::vector<std::string> &tokens, void* record) {
-	using namespace std;
-
+void CharFieldParser::writeParsedTokensToRecord(const std::vector<tsdb::TokenView> &tokens, void* record) {
 	if(this->record_parser == NULL) {
 		throw(FieldParserException("not bound to record parser"));
 	}
 
-
-	/* Now, the actual parsing of the string */
-	const char* charptr;
-	if(this->missing_tokens_ok) {
-		if(this->consume_token >= tokens.size()) {
-			charptr = this->missing_token_replacement.c_str();
-		} else {
-			charptr = tokens.at(this->consume_token).c_str();
-		}
-	} else {
-		charptr = tokens.at(this->consume_token).c_str();
-	}
-
+	/* Now, the actual parsing of the string. An empty token is a NUL character. */
+	TokenView token = consumeToken(tokens, this->consume_token);
+	tsdb::char_t character = token.empty() ? '\0' : token.data[0];
 	
-	// Write the timestamp to the record
-	this->record_parser->getRecordStructure()->setMember(record,this->field_id,charptr);
+	// Write the character to the record
+	this->record_parser->getRecordStructure()->setMember(record,this->field_id,&character);
 }
 
 
@@ -369,10 +886,10 @@ void CharFieldParser::writeParsedTokensToRecord(const std::vector<std::string> &
  * <remarks><p>Creates a parser for 64-bit IEEE floating point numbers.
  * This FieldParser only supports parsing one
  * token (no aggregation of tokens).</p>
- * <p>IEEE floating points support a number of special values (infinities or nan).
- * This function uses the system's atof() to parse the token strings, so it is dependent 
- * on it to correctly parse these special values. The only special case which is handled directly
- * is if the token string is null or all spaces. In this case, the value stored is a quiet NaN.</p>
+ * <p>Tokens are parsed as atof() would in the "C" locale, whatever the locale of the program: the
+ * decimal point is always '.'. Decimal numbers of up to 19 significant digits, with a small exponent,
+ * are parsed exactly without atof(); anything else, including infinities, nan and hexadecimal, goes to
+ * the system's strtod(). If the token string is null or all spaces, the value stored is a quiet NaN.</p>
  * </remarks>
  * <param name="token">The token number to parse</param>
  * <param name="new_field_name">The field name to save the token when bound to a RecordParser</param>
@@ -385,42 +902,113 @@ DoubleFieldParser::DoubleFieldParser(size_t token, std::string new_field_name) {
 }
 
 /** <summary>
- * Parses a vector of token strings, and writes the result to a record.
+ * Parses a vector of TokenViews, and writes the result to a record.
  * </summary>
- * <param name="tokens">A vector of token strings</param>
+ * <param name="tokens">A vector of TokenViews</param>
  * <param name="record">A pointer to a already-allocated block of memory to save the record to.</param>
  */
-void DoubleFieldParser::writeParsedTokensToRecord(const std::vector<std::string> &tokens, void* record) {
-	using namespace std;
-	string this_str;
+void DoubleFieldParser::writeParsedTokensToRecord(const std::vector<tsdb::TokenView> &tokens, void* record) {
 	if(this->record_parser == NULL) {
 		throw(FieldParserException("not bound to record parser"));
 	}
 
-
 	/* Now, the actual parsing of the string */
-	tsdb::ieee64_t ieee64;
+	tsdb::ieee64_t ieee64 = parseDouble(consumeToken(tokens, this->consume_token));
+	
+	// Write the double to the record
+	this->record_parser->getRecordStructure()->setMember(record,this->field_id,&ieee64);
+}
 
-	if(this->missing_tokens_ok) {
-		if(this->consume_token >= tokens.size()) {
-			this_str = this->missing_token_replacement;
-		} else {
-			this_str = tokens.at(this->consume_token);
+/** <summary>
+ * Parses the token of every row of a TokenTable, and writes the doubles to consecutive records.
+ * </summary>
+ * <remarks>See FieldParser::parseColumn().</remarks>
+ */
+void DoubleFieldParser::parseColumn(const tsdb::TokenTable& table, char* records, size_t record_size,
+	std::vector<std::string>& errors) {
+	if(this->record_parser == NULL) {
+		throw(FieldParserException("not bound to record parser"));
+	}
+
+	char* field = records + this->record_parser->getRecordStructure()->getOffsetOfField(this->field_id);
+	TokenView token;
+	for(size_t r = 0; r < table.size(); r++, field += record_size) {
+		if(consumeColumnToken(table, r, this->consume_token, errors, &token)) {
+			tsdb::ieee64_t ieee64 = parseDouble(token);
+			memcpy(field, &ieee64, sizeof(ieee64));
 		}
-	} else {
-		this_str = tokens.at(this->consume_token);
 	}
+}
 
-	tsdb::RecordParser::trim(this_str);
-	
-	if(this_str == "") {
-		ieee64 = std::numeric_limits<double>::quiet_NaN();
-	} else {
-		ieee64 = atof(tokens.at(this->consume_token).c_str());
+/* ====================================================================
+ * class SymbolFieldParser - Parser for Symbols
+ * ====================================================================
+ */
+
+/** <summary>
+ * SymbolFieldParser constructor.
+ * </summary>
+ * <remarks> Creates a parser for a SymbolField. This FieldParser only supports parsing one
+ * token (no aggregation of tokens).
+ * </remarks>
+ * <param name="token">The token number to parse</param>
+ * <param name="new_field_name">The field name to save the token when bound to a RecordParser</param>
+ */
+SymbolFieldParser::SymbolFieldParser(size_t token, std::string new_field_name) {
+	this->consume_token = token;
+	this->field_name = new_field_name;
+	this->missing_tokens_ok = false;
+}
+
+/** <summary>
+ * Parses a vector of TokenViews, and writes the result to a record.
+ * </summary>
+ * <param name="tokens">A vector of TokenViews</param>
+ * <param name="record">A pointer to a already-allocated block of memory to save the record to.</param>
+ */
+void SymbolFieldParser::writeParsedTokensToRecord(const std::vector<tsdb::TokenView> &tokens, void* record) {
+	TokenView token = consumeToken(tokens, this->consume_token);
+	tsdb::symbol_t code = symbols().code(token.data, token.size);
+
+	// Write the code to the record
+	this->record_parser->getRecordStructure()->setMember(record,this->field_id,&code);
+}
+
+/** <summary>
+ * Parses the token of every row of a TokenTable, and writes the codes to consecutive records.
+ * </summary>
+ * <remarks>See FieldParser::parseColumn(). The dictionary is hashed into where each token is, so
+ * a token is not copied unless it is a new symbol.</remarks>
+ */
+void SymbolFieldParser::parseColumn(const tsdb::TokenTable& table, char* records, size_t record_size,
+	std::vector<std::string>& errors) {
+	tsdb::SymbolTable& dictionary = symbols();
+
+	char* field = records + this->record_parser->getRecordStructure()->getOffsetOfField(this->field_id);
+	TokenView token;
+	for(size_t r = 0; r < table.size(); r++, field += record_size) {
+		if(consumeColumnToken(table, r, this->consume_token, errors, &token)) {
+			try {
+				tsdb::symbol_t code = dictionary.code(token.data, token.size);
+				memcpy(field, &code, sizeof(code));
+			} catch(std::exception& e) {
+				errors[r] = e.what();
+			}
+		}
 	}
-	
-	// Write the timestamp to the record
-	this->record_parser->getRecordStructure()->setMember(record,this->field_id,&ieee64);
+}
+
+/* The dictionary of the field the parser is bound to */
+tsdb::SymbolTable& SymbolFieldParser::symbols(void) {
+	if(this->record_parser == NULL) {
+		throw(FieldParserException("not bound to record parser"));
+	}
+
+	tsdb::Field* field = this->record_parser->getRecordStructure()->getField(this->field_id);
+	if(field->getFieldType() != tsdb::Field::SYMBOL) {
+		throw(FieldParserException("field '" + this->field_name + "' is not a Symbol"));
+	}
+	return *((tsdb::SymbolField*) field)->symbols();
 }
 
 
@@ -6,10 +6,12 @@
 
 #include "boost/date_time.hpp"
 #include "tsdb.h"
+#include "tokenizer.h"
 
 /* Forward Declarations */
 namespace tsdb {
 	class RecordParser;
+	class SymbolTable;
 }
 
 
@@ -38,13 +40,19 @@ public:
 
 	/* Methods */
 	virtual void writeParsedTokensToRecord(const std::vector<std::string> &tokens, void* record);
+	virtual void writeParsedTokensToRecord(const std::vector<tsdb::TokenView> &tokens, void* record);
+	virtual void parseColumn(const tsdb::TokenTable& table, char* records, size_t record_size,
+		std::vector<std::string>& errors);
 	void bindToRecordParser(tsdb::RecordParser* new_record_parser);
 	void setMissingTokenReplacement(std::string _missing_token_replacement);
 
 	~FieldParser(void);
 protected:
 	FieldParser(void);
-	
+	tsdb::TokenView consumeToken(const std::vector<tsdb::TokenView> &tokens, size_t i);
+	bool consumeColumnToken(const tsdb::TokenTable& table, size_t row, size_t i, std::vector<std::string>& errors,
+		tsdb::TokenView* token);
+
 	RecordParser* record_parser;
 
 	std::string field_name;
@@ -54,6 +62,12 @@ protected:
 	bool missing_tokens_ok;
 	std::string missing_token_replacement;
 
+private:
+	/* Scratch space for converting between the two kinds of tokens */
+	std::vector<tsdb::TokenView> token_views;
+	std::vector<std::string> token_strings;
+	std::vector<tsdb::TokenView> row_tokens;  // a row of a TokenTable, for parseColumn()
+
 };
 
 class  TimestampFieldParser : public FieldParser
@@ -64,13 +78,27 @@ public:
 		std::string new_field_name);
 
 	/* Other Methods */
-	void writeParsedTokensToRecord(const std::vector<std::string> &tokens, void* record);
+	using FieldParser::writeParsedTokensToRecord;
+	void writeParsedTokensToRecord(const std::vector<tsdb::TokenView> &tokens, void* record);
 
 private:
 	std::locale	locale_format;
 	boost::posix_time::ptime epoch;
 	std::vector<size_t> consume_tokens;
 
+	/* One step of a compiled format string */
+	struct FormatItem {
+		char type;    // a format flag (Y, m, d, H, M, S, F), ' ' for whitespace or 'L' for a literal
+		char literal;
+	};
+
+	bool compileFormat(const std::string& format);
+	bool fastParse(timestamp_t* timestamp);
+	timestamp_t boostParse(void);
+
+	std::vector<FormatItem> compiled_format;
+	bool fast_format;  // true if the format string compiled
+	std::vector<tsdb::TokenView> consumed;  // the tokens being parsed
 };
 
 class  DoubleFieldParser : public FieldParser
@@ -81,7 +109,10 @@ public:
 		std::string new_field_name);
 
 	/* Other Methods */
-	void writeParsedTokensToRecord(const std::vector<std::string> &tokens, void* record);
+	using FieldParser::writeParsedTokensToRecord;
+	void writeParsedTokensToRecord(const std::vector<tsdb::TokenView> &tokens, void* record);
+	void parseColumn(const tsdb::TokenTable& table, char* records, size_t record_size,
+		std::vector<std::string>& errors);
 
 private:
 	size_t consume_token;
@@ -96,7 +127,10 @@ public:
 		std::string new_field_name);
 
 	/* Other Methods */
-	void writeParsedTokensToRecord(const std::vector<std::string> &tokens, void* record);
+	using FieldParser::writeParsedTokensToRecord;
+	void writeParsedTokensToRecord(const std::vector<tsdb::TokenView> &tokens, void* record);
+	void parseColumn(const tsdb::TokenTable& table, char* records, size_t record_size,
+		std::vector<std::string>& errors);
 
 private:
 	size_t consume_token;
@@ -111,7 +145,10 @@ public:
 		std::string new_field_name);
 
 	/* Other Methods */
-	void writeParsedTokensToRecord(const std::vector<std::string> &tokens, void* record);
+	using FieldParser::writeParsedTokensToRecord;
+	void writeParsedTokensToRecord(const std::vector<tsdb::TokenView> &tokens, void* record);
+	void parseColumn(const tsdb::TokenTable& table, char* records, size_t record_size,
+		std::vector<std::string>& errors);
 
 private:
 	size_t consume_token;
@@ -119,6 +156,30 @@ private:
 };
 
 
+/** <summary>Parses a token into a SymbolField, as the code of the token in the dictionary of the field</summary>
+ * <remarks>A token that is new to the dictionary is added to it. One that is new and longer than the
+ * longest symbol of the field is an error of its line.</remarks>
+ */
+class  SymbolFieldParser : public FieldParser
+{
+public:
+	/* Constructor */
+	SymbolFieldParser(size_t new_consume_token,
+		std::string new_field_name);
+
+	/* Other Methods */
+	using FieldParser::writeParsedTokensToRecord;
+	void writeParsedTokensToRecord(const std::vector<tsdb::TokenView> &tokens, void* record);
+	void parseColumn(const tsdb::TokenTable& table, char* records, size_t record_size,
+		std::vector<std::string>& errors);
+
+private:
+	tsdb::SymbolTable& symbols(void);
+
+	size_t consume_token;
+
+};
+
 class  CharFieldParser : public FieldParser
 {
 public:
@@ -127,7 +188,8 @@ public:
 		std::string new_field_name);
 
 	/* Other Methods */
-	void writeParsedTokensToRecord(const std::vector<std::string> &tokens, void* record);
+	using FieldParser::writeParsedTokensToRecord;
+	void writeParsedTokensToRecord(const std::vector<tsdb::TokenView> &tokens, void* record);
 
 private:
 	size_t consume_token;
@@ -142,10 +204,12 @@ public:
 		std::string new_field_name);
 
 	/* Other Methods */
-	void writeParsedTokensToRecord(const std::vector<std::string> &tokens, void* record);
+	using FieldParser::writeParsedTokensToRecord;
+	void writeParsedTokensToRecord(const std::vector<tsdb::TokenView> &tokens, void* record);
 
 private:
 	std::vector<size_t> consume_tokens;
+	std::vector<char> string_buffer;  // the joined tokens
 
 };
 
@@ -0,0 +1,101 @@
+/* STL includes */
+#include <string>
+#include <limits>
+
+#ifdef WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/* TSDB includes */
+#include "filemapping.h"
+
+namespace tsdb {
+
+/* ====================================================================
+ * class FileMapping - a file mapped read only into memory
+ * ====================================================================
+ */
+
+/** <summary>Maps the file <c>_filename</c></summary>
+ * <remarks>Throws a FileMappingException if the file can not be opened or mapped, or is empty.</remarks>
+ */
+FileMapping::FileMapping(const std::string& _filename): my_data(NULL), my_size(0) {
+#ifdef WIN32
+	my_file = CreateFileA(_filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(my_file == INVALID_HANDLE_VALUE) {
+		throw FileMappingException("Unable to open '" + _filename + "'.");
+	}
+
+	LARGE_INTEGER size;
+	if(!GetFileSizeEx((HANDLE) my_file, &size) || size.QuadPart <= 0 ||
+		(unsigned long long) size.QuadPart > (unsigned long long) std::numeric_limits<size_t>::max()) {
+		CloseHandle((HANDLE) my_file);
+		throw FileMappingException("'" + _filename + "' is empty or too large to map.");
+	}
+	my_size = (unsigned long long) size.QuadPart;
+
+	my_mapping = CreateFileMapping((HANDLE) my_file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if(my_mapping == NULL) {
+		CloseHandle((HANDLE) my_file);
+		throw FileMappingException("Unable to map '" + _filename + "'.");
+	}
+
+	my_data = (const char*) MapViewOfFile((HANDLE) my_mapping, FILE_MAP_READ, 0, 0, 0);
+	if(my_data == NULL) {
+		CloseHandle((HANDLE) my_mapping);
+		CloseHandle((HANDLE) my_file);
+		throw FileMappingException("Unable to map '" + _filename + "'.");
+	}
+#else
+	int fd = open(_filename.c_str(), O_RDONLY);
+	if(fd < 0) {
+		throw FileMappingException("Unable to open '" + _filename + "'.");
+	}
+
+	struct stat finfo;
+	if(fstat(fd, &finfo) != 0 || finfo.st_size <= 0 ||
+		(unsigned long long) finfo.st_size > (unsigned long long) std::numeric_limits<size_t>::max()) {
+		close(fd);
+		throw FileMappingException("'" + _filename + "' is empty or too large to map.");
+	}
+	my_size = (unsigned long long) finfo.st_size;
+
+	void* data = mmap(NULL, (size_t) my_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);  // the mapping keeps the file open
+	if(data == MAP_FAILED) {
+		throw FileMappingException("Unable to map '" + _filename + "'.");
+	}
+	my_data = (const char*) data;
+#endif
+}
+
+/** <summary>Unmaps the file</summary> */
+FileMapping::~FileMapping(void) {
+#ifdef WIN32
+	UnmapViewOfFile(my_data);
+	CloseHandle((HANDLE) my_mapping);
+	CloseHandle((HANDLE) my_file);
+#else
+	munmap((void*) my_data, (size_t) my_size);
+#endif
+}
+
+/** <summary>Returns the first byte of the file</summary> */
+const char* FileMapping::data(void) const {
+	return my_data;
+}
+
+/** <summary>Returns the number of bytes mapped, which is the size of the file when it was mapped</summary> */
+unsigned long long FileMapping::size(void) const {
+	return my_size;
+}
+
+} // namespace tsdb
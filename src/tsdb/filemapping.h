@@ -0,0 +1,54 @@
+#pragma once
+
+/* STL Classes */
+#include <string>
+#include <stdexcept>
+
+namespace tsdb {
+
+/* -----------------------------------------------------------------
+ * FileMappingException. For runtime errors thrown by a FileMapping.
+ * -----------------------------------------------------------------
+ */
+class  FileMappingException:
+	public std::runtime_error
+{
+public:
+	FileMappingException(const std::string& what):
+	  std::runtime_error(std::string("FileMappingException: ") + what) {}
+};
+
+/* -----------------------------------------------------------------
+ * FileMapping. A whole file mapped read only into memory.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>Maps a whole file into memory, read only</summary>
+ * <remarks><p>Reading the mapping costs no system calls and no copies once the pages are in the page
+ * cache. The mapping has the size the file had when it was mapped; later writes to the file within that
+ * size show through, and anything appended after it does not.</p>
+ * <p>Writing to the mapping is an access violation.</p></remarks>
+ */
+class FileMapping
+{
+public:
+	FileMapping(const std::string& _filename);
+	~FileMapping(void);
+
+	const char* data(void) const;
+	unsigned long long size(void) const;
+
+private:
+	/* FileMappings own the mapping, so they can't be copied */
+	FileMapping(const FileMapping&);
+	FileMapping& operator=(const FileMapping&);
+
+	const char* my_data;
+	unsigned long long my_size;
+#ifdef WIN32
+	void* my_file;      // HANDLEs
+	void* my_mapping;
+#endif
+};
+
+} // namespace tsdb
@@ -0,0 +1,35 @@
+/* HDF5 Includes */
+#include "hdf5.h"
+
+/* TSDB Includes */
+#include "hdf5lock.h"
+
+namespace tsdb {
+
+namespace {
+	/* Constructed before main() runs, so before any other thread can use it */
+	boost::recursive_mutex hdf5_mutex;
+}
+
+/** <summary>Returns the mutex that serializes HDF5 calls</summary> */
+boost::recursive_mutex& HDF5Lock::mutex(void) {
+	return hdf5_mutex;
+}
+
+/** <summary>Returns true if the HDF5 library was built thread safe</summary> */
+bool HDF5Lock::libraryIsThreadsafe(void) {
+#if H5_VERS_MAJOR > 1 || (H5_VERS_MAJOR == 1 && (H5_VERS_MINOR > 8 || (H5_VERS_MINOR == 8 && H5_VERS_RELEASE >= 16)))
+	hbool_t threadsafe = 0;
+	if(H5is_library_threadsafe(&threadsafe) < 0) {
+		return false;
+	}
+	return threadsafe != 0;
+#elif defined(H5_HAVE_THREADSAFE)
+	// older versions only say so at compile time
+	return true;
+#else
+	return false;
+#endif
+}
+
+} // namespace tsdb
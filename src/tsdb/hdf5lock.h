@@ -0,0 +1,37 @@
+#pragma once
+
+/* Boost */
+#include "boost/thread/recursive_mutex.hpp"
+#include "boost/thread/locks.hpp"
+
+namespace tsdb {
+
+/* -----------------------------------------------------------------
+ * HDF5Lock. Serializes calls into the HDF5 library.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>Holds the library wide HDF5 mutex for as long as it is in scope</summary>
+ * <remarks><p>The usual builds of HDF5 are not thread safe, so only one thread at a time may call into
+ * the library. Table and Timeseries take this lock around their HDF5 calls, which lets TSDB read ahead
+ * on a background thread (see BufferedRecordSet::setPrefetch()).</p>
+ * <p>An application that reads ahead with a non thread safe HDF5, and that calls HDF5 itself (to open
+ * or close files, for example), must hold an HDF5Lock around those calls too. The mutex is recursive,
+ * so taking it again on the same thread is fine.</p></remarks>
+ */
+class HDF5Lock
+{
+public:
+	HDF5Lock(void): my_lock(mutex()) {}
+
+	static boost::recursive_mutex& mutex(void);
+	static bool libraryIsThreadsafe(void);
+
+private:
+	HDF5Lock(const HDF5Lock&);
+	HDF5Lock& operator=(const HDF5Lock&);
+
+	boost::lock_guard<boost::recursive_mutex> my_lock;
+};
+
+} // namespace tsdb
@@ -1,13 +1,50 @@
 #include "memoryblock.h"
+#include "memorypool.h"
 
 namespace tsdb {
+
+namespace {
+
+/* Gives the memory of a MemoryBlock back to its pool */
+struct PoolRelease {
+	PoolRelease(tsdb::MemoryPool* _pool, size_t _size): pool(_pool), size(_size) {}
+	void operator()(char* memory) const {
+		pool->release(memory, size);
+	}
+	tsdb::MemoryPool* pool;
+	size_t size;
+};
+
+/* Keeps the owner of wrapped memory alive, and frees nothing */
+struct OwnerRelease {
+	OwnerRelease(const boost::shared_ptr<void>& _owner): owner(_owner) {}
+	void operator()(char*) const {
+	}
+	boost::shared_ptr<void> owner;
+};
+
+} // namespace
+
 MemoryBlock::MemoryBlock(void)
 {
 	my_size = 0;
 }
 
 MemoryBlock::MemoryBlock(size_t _size) {
-	this->my_memory = boost::shared_array<char>(new char[_size]);
+	tsdb::MemoryPool& pool = tsdb::MemoryPool::global();
+	this->my_memory = boost::shared_array<char>(pool.allocate(_size), PoolRelease(&pool, _size));
+	this->my_size = _size;
+}
+
+/** <summary>Allocates the memory from <c>_pool</c>, which must outlive every copy of the block</summary> */
+MemoryBlock::MemoryBlock(size_t _size, tsdb::MemoryPool& _pool) {
+	this->my_memory = boost::shared_array<char>(_pool.allocate(_size), PoolRelease(&_pool, _size));
+	this->my_size = _size;
+}
+
+/** <summary>Wraps <c>_size</c> bytes at <c>_memory</c>, which stay valid for as long as <c>_owner</c> does</summary> */
+MemoryBlock::MemoryBlock(char* _memory, size_t _size, const boost::shared_ptr<void>& _owner) {
+	this->my_memory = boost::shared_array<char>(_memory, OwnerRelease(_owner));
 	this->my_size = _size;
 }
 
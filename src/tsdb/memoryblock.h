@@ -1,15 +1,25 @@
 #pragma once
 
 #include <boost/shared_array.hpp>
+#include <boost/shared_ptr.hpp>
 
 
 namespace tsdb {
 
+class MemoryPool;
+
+/** <summary>A block of memory, shared by the copies of the MemoryBlock</summary>
+ * <remarks>The memory comes from a MemoryPool, the global one unless another is given, and is aligned to
+ * MemoryPool::ALIGNMENT bytes. It goes back to the pool when the last copy is destroyed. A block can also
+ * wrap memory that something else owns, such as a FileMapping, and then keeps the owner alive instead.</remarks>
+ */
 class MemoryBlock
 {
 public:
 	MemoryBlock(void);
 	MemoryBlock(size_t _size);
+	MemoryBlock(size_t _size, tsdb::MemoryPool& _pool);
+	MemoryBlock(char* _memory, size_t _size, const boost::shared_ptr<void>& _owner);
 	~MemoryBlock(void);
 	size_t size();
 	boost::shared_array<char> sharedArray();
@@ -0,0 +1,199 @@
+/* STL includes */
+#include <vector>
+#include <new>
+#include <stdlib.h>
+
+#ifdef WIN32
+#include <malloc.h>
+#endif
+
+/* TSDB includes */
+#include "memorypool.h"
+
+namespace tsdb {
+
+namespace {
+
+const size_t MIN_CLASS_BYTES = 64;
+const size_t NCLASSES = 21;   // 64 bytes to 64 MB
+
+/** <summary>Returns the size class of a block of <c>nbytes</c>, or NCLASSES if it is too large to cache</summary> */
+size_t sizeClass(size_t nbytes) {
+	size_t k = 0;
+	size_t class_bytes = MIN_CLASS_BYTES;
+	while(class_bytes < nbytes && k < NCLASSES) {
+		class_bytes <<= 1;
+		k++;
+	}
+	return k;
+}
+
+/** <summary>Returns the number of bytes of the blocks of size class <c>k</c></summary> */
+size_t classBytes(size_t k) {
+	return MIN_CLASS_BYTES << k;
+}
+
+char* alignedAlloc(size_t nbytes) {
+	void* memory = NULL;
+#ifdef WIN32
+	memory = _aligned_malloc(nbytes, MemoryPool::ALIGNMENT);
+#else
+	if(posix_memalign(&memory, MemoryPool::ALIGNMENT, nbytes) != 0) {
+		memory = NULL;
+	}
+#endif
+	if(memory == NULL) {
+		throw std::bad_alloc();
+	}
+	return (char*) memory;
+}
+
+void alignedFree(char* memory) {
+#ifdef WIN32
+	_aligned_free(memory);
+#else
+	free(memory);
+#endif
+}
+
+} // namespace
+
+/* ====================================================================
+ * class MemoryPool - size class free lists of aligned blocks
+ * ====================================================================
+ */
+
+/** <summary>Creates an empty pool that caches up to <c>_capacity</c> bytes</summary> */
+MemoryPool::MemoryPool(size_t _capacity): my_capacity(_capacity), my_free(NCLASSES) {
+}
+
+/** <summary>Frees the cached blocks</summary>
+ * <remarks>Blocks that are still allocated must not be released to the pool afterwards.</remarks>
+ */
+MemoryPool::~MemoryPool(void) {
+	shrinkTo(0);
+}
+
+/** <summary>Returns a block of at least <c>nbytes</c> bytes, aligned to ALIGNMENT bytes</summary>
+ * <remarks>Throws std::bad_alloc if the system is out of memory. The block must be given back with
+ * release(), with the same <c>nbytes</c>.</remarks>
+ */
+char* MemoryPool::allocate(size_t nbytes) {
+	size_t k = sizeClass(nbytes);
+	size_t block_bytes = (k < NCLASSES) ? classBytes(k) : nbytes;
+	char* memory = NULL;
+
+	{
+		boost::lock_guard<boost::mutex> lock(my_mutex);
+		my_stats.allocations++;
+		my_stats.bytes_in_use += block_bytes;
+		if(my_stats.bytes_in_use > my_stats.peak_bytes_in_use) {
+			my_stats.peak_bytes_in_use = my_stats.bytes_in_use;
+		}
+
+		if(k < NCLASSES && !my_free[k].empty()) {
+			memory = my_free[k].back();
+			my_free[k].pop_back();
+			my_stats.bytes_cached -= block_bytes;
+			my_stats.reused++;
+			return memory;
+		}
+		my_stats.system_allocations++;
+	}
+
+	// Allocate outside of the lock
+	try {
+		memory = alignedAlloc(block_bytes > 0 ? block_bytes : 1);
+	} catch(...) {
+		boost::lock_guard<boost::mutex> lock(my_mutex);
+		my_stats.bytes_in_use -= block_bytes;
+		throw;
+	}
+	return memory;
+}
+
+/** <summary>Gives a block back to the pool, which keeps it unless the cache is full</summary>
+ * <param name="memory">A block from allocate(), or NULL</param>
+ * <param name="nbytes">The size the block was allocated with</param>
+ */
+void MemoryPool::release(char* memory, size_t nbytes) {
+	if(memory == NULL) {
+		return;
+	}
+
+	size_t k = sizeClass(nbytes);
+	size_t block_bytes = (k < NCLASSES) ? classBytes(k) : nbytes;
+
+	{
+		boost::lock_guard<boost::mutex> lock(my_mutex);
+		my_stats.releases++;
+		my_stats.bytes_in_use -= block_bytes;
+
+		if(k < NCLASSES && my_stats.bytes_cached + block_bytes <= my_capacity) {
+			my_free[k].push_back(memory);
+			my_stats.bytes_cached += block_bytes;
+			return;
+		}
+		my_stats.system_frees++;
+	}
+
+	alignedFree(memory);
+}
+
+/** <summary>Sets the number of bytes the pool may keep for reuse, and frees cached blocks above it</summary> */
+void MemoryPool::setCapacity(size_t _capacity) {
+	{
+		boost::lock_guard<boost::mutex> lock(my_mutex);
+		my_capacity = _capacity;
+	}
+	shrinkTo(_capacity);
+}
+
+/** <summary>Returns the number of bytes the pool may keep for reuse</summary> */
+size_t MemoryPool::capacity(void) {
+	boost::lock_guard<boost::mutex> lock(my_mutex);
+	return my_capacity;
+}
+
+/** <summary>Frees every cached block</summary> */
+void MemoryPool::trim(void) {
+	shrinkTo(0);
+}
+
+/** <summary>Returns a copy of the statistics of the pool</summary> */
+tsdb::MemoryPoolStats MemoryPool::stats(void) {
+	boost::lock_guard<boost::mutex> lock(my_mutex);
+	return my_stats;
+}
+
+/** <summary>Returns the pool that MemoryBlocks use by default</summary>
+ * <remarks>It is never destroyed, so blocks can still be released to it while the program exits.</remarks>
+ */
+tsdb::MemoryPool& MemoryPool::global(void) {
+	static MemoryPool* pool = new MemoryPool();
+	return *pool;
+}
+
+/** <summary>Frees cached blocks, the largest first, until at most <c>nbytes</c> are cached</summary> */
+void MemoryPool::shrinkTo(size_t nbytes) {
+	std::vector<char*> freed;
+
+	{
+		boost::lock_guard<boost::mutex> lock(my_mutex);
+		for(size_t k = NCLASSES; k > 0 && my_stats.bytes_cached > nbytes; k--) {
+			std::vector<char*>& list = my_free[k - 1];
+			while(!list.empty() && my_stats.bytes_cached > nbytes) {
+				freed.push_back(list.back());
+				list.pop_back();
+				my_stats.bytes_cached -= classBytes(k - 1);
+				my_stats.system_frees++;
+			}
+		}
+	}
+
+	for(size_t i = 0; i < freed.size(); i++) {
+		alignedFree(freed[i]);
+	}
+}
+
+} // namespace tsdb
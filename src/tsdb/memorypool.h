@@ -0,0 +1,81 @@
+#pragma once
+
+/* STL Classes */
+#include <vector>
+#include <stddef.h>
+
+/* Boost */
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/locks.hpp"
+
+/* TSDB Includes */
+#include "tsdb.h"
+
+namespace tsdb {
+
+/* -----------------------------------------------------------------
+ * MemoryPoolStats. What a MemoryPool has done so far.
+ * -----------------------------------------------------------------
+ */
+struct MemoryPoolStats
+{
+	MemoryPoolStats(void): allocations(0), reused(0), system_allocations(0), releases(0),
+		system_frees(0), bytes_in_use(0), peak_bytes_in_use(0), bytes_cached(0) {}
+
+	size_t allocations;         // calls to allocate()
+	size_t reused;              // ... that were given a cached block
+	size_t system_allocations;  // ... that had to allocate memory from the system
+	size_t releases;            // calls to release()
+	size_t system_frees;        // ... whose block went back to the system, because the cache was full
+	size_t bytes_in_use;        // bytes of the blocks that are allocated, rounded up to their size class
+	size_t peak_bytes_in_use;
+	size_t bytes_cached;        // bytes of the blocks that are kept for reuse
+};
+
+/* -----------------------------------------------------------------
+ * MemoryPool. Keeps released memory for reuse.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>Hands out 64 byte aligned blocks of memory, and keeps released blocks to hand out again</summary>
+ * <remarks><p>Requests are rounded up to a size class, a power of two from 64 bytes to 64 MB, and a
+ * released block goes to the free list of its class. An allocation takes a block from that list when there
+ * is one, so a program that reads the same sizes over and over, as queries do, soon stops allocating from
+ * the system. Larger blocks are not cached.</p>
+ * <p>The cache holds at most capacity() bytes; a block released while it is full goes back to the system.
+ * Lowering the capacity with setCapacity() frees cached blocks right away.</p>
+ * <p>MemoryBlocks draw from global() unless they are given another pool, which must then outlive them.
+ * A MemoryPool is thread safe.</p></remarks>
+ */
+class MemoryPool
+{
+public:
+	static const size_t ALIGNMENT = 64;
+
+	MemoryPool(size_t _capacity = POOL_CAPACITY_BYTES);
+	~MemoryPool(void);
+
+	char* allocate(size_t nbytes);
+	void release(char* memory, size_t nbytes);
+
+	void setCapacity(size_t _capacity);
+	size_t capacity(void);
+	void trim(void);
+	tsdb::MemoryPoolStats stats(void);
+
+	static tsdb::MemoryPool& global(void);
+
+private:
+	/* MemoryPools own their free lists, so they can't be copied */
+	MemoryPool(const MemoryPool&);
+	MemoryPool& operator=(const MemoryPool&);
+
+	void shrinkTo(size_t nbytes);
+
+	boost::mutex my_mutex;
+	size_t my_capacity;
+	std::vector<std::vector<char*> > my_free;  // the free list of each size class
+	tsdb::MemoryPoolStats my_stats;
+};
+
+} // namespace tsdb
@@ -0,0 +1,121 @@
+/* STL includes */
+#include <string>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+/* TSDB includes */
+#include "multiseriesquery.h"
+#include "timeseries.h"
+
+namespace tsdb {
+
+/* ====================================================================
+ * class MultiSeriesQuery - reads many Timeseries on worker threads
+ * ====================================================================
+ */
+
+/** <summary>Creates a query of the Timeseries <c>_names</c></summary>
+ * <remarks>The query reads all of the fields, with one worker per processor (see setThreads()).</remarks>
+ * <param name="_loc_id">A HDF5 <c>hid_t</c> (group or file id) where the Timeseries are</param>
+ * <param name="_names">Names of the Timeseries</param>
+ */
+MultiSeriesQuery::MultiSeriesQuery(hid_t _loc_id, const std::vector<std::string>& _names):
+	my_loc_id(_loc_id), my_names(_names), my_next(0) {
+	setThreads(0);
+}
+
+/** <summary>Reads only the fields <c>_field_names</c> of each series, in that order</summary>
+ * <remarks>Every series must have these fields. An empty list reads all of the fields.</remarks>
+ */
+void MultiSeriesQuery::setFields(const std::vector<std::string>& _field_names) {
+	my_field_names = _field_names;
+}
+
+/** <summary>Sets the number of worker threads</summary>
+ * <remarks>0 means one per processor. run() never starts more workers than there are series, and with
+ * one worker it reads the series on the calling thread.</remarks>
+ */
+void MultiSeriesQuery::setThreads(size_t _nthreads) {
+	if(_nthreads == 0) {
+		_nthreads = boost::thread::hardware_concurrency();
+	}
+	my_nthreads = (_nthreads > 0) ? _nthreads : 1;
+}
+
+/** <summary>Returns the number of worker threads</summary> */
+size_t MultiSeriesQuery::threads(void) const {
+	return my_nthreads;
+}
+
+/** <summary>Reads the records from <c>start</c> to <c>end</c> of every series</summary>
+ * <remarks>Returns one RecordSet per series, in the order of the names. Throws a
+ * MultiSeriesQueryException if any series could not be read.</remarks>
+ */
+std::vector<tsdb::RecordSet> MultiSeriesQuery::run(tsdb::timestamp_t start, tsdb::timestamp_t end) {
+	std::vector<tsdb::RecordSet> results(my_names.size());
+	size_t nthreads = (my_nthreads < my_names.size()) ? my_nthreads : my_names.size();
+
+	my_next = 0;
+	my_error.clear();
+
+	if(nthreads <= 1) {
+		work(start, end, &results);
+	} else {
+		boost::thread_group workers;
+		for(size_t i = 0; i < nthreads; i++) {
+			workers.create_thread(boost::bind(&MultiSeriesQuery::work, this, start, end, &results));
+		}
+		workers.join_all();
+	}
+
+	if(!my_error.empty()) {
+		throw( MultiSeriesQueryException(my_error) );
+	}
+	return results;
+}
+
+/** <summary>Reads the records from <c>start</c> to <c>end</c> of every series</summary> */
+std::vector<tsdb::RecordSet> MultiSeriesQuery::run(boost::posix_time::ptime start, boost::posix_time::ptime end) {
+	return run(tsdb::ptime_to_timestamp(start), tsdb::ptime_to_timestamp(end));
+}
+
+void MultiSeriesQuery::work(tsdb::timestamp_t start, tsdb::timestamp_t end, std::vector<tsdb::RecordSet>* results) {
+	size_t i;
+
+	while(nextSeries(&i)) {
+		try {
+			tsdb::Timeseries ts(my_loc_id, my_names[i]);
+			if(my_field_names.empty()) {
+				(*results)[i] = ts.recordSet(start, end);
+			} else {
+				(*results)[i] = ts.recordSet(start, end, my_field_names);
+			}
+		} catch(std::exception& e) {
+			fail(i, e.what());
+		} catch(...) {
+			fail(i, "unknown error");
+		}
+	}
+}
+
+/** <summary>Hands the next series to a worker. Returns false when there are none, or after an error.</summary> */
+bool MultiSeriesQuery::nextSeries(size_t* i) {
+	boost::mutex::scoped_lock lock(my_mutex);
+
+	if(!my_error.empty() || my_next >= my_names.size()) {
+		return false;
+	}
+	*i = my_next++;
+	return true;
+}
+
+void MultiSeriesQuery::fail(size_t i, const std::string& what) {
+	boost::mutex::scoped_lock lock(my_mutex);
+
+	if(my_error.empty()) {
+		my_error = "Error reading '" + my_names[i] + "': " + what;
+	}
+}
+
+} // namespace tsdb
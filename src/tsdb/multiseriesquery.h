@@ -0,0 +1,81 @@
+#pragma once
+
+/* STL Classes */
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+/* External Libraries */
+#include "hdf5.h"
+#include "boost/date_time/posix_time/posix_time.hpp"
+#include "boost/thread/mutex.hpp"
+
+/* TSDB Includes */
+#include "tsdb.h"
+#include "recordset.h"
+
+namespace tsdb {
+
+/* -----------------------------------------------------------------
+ * MultiSeriesQueryException. For runtime errors thrown by a
+ * MultiSeriesQuery.
+ * -----------------------------------------------------------------
+ */
+class  MultiSeriesQueryException:
+	public std::runtime_error
+{
+public:
+	MultiSeriesQueryException(const std::string& what):
+	  std::runtime_error(std::string("MultiSeriesQueryException: ") + what) {}
+};
+
+/* -----------------------------------------------------------------
+ * MultiSeriesQuery. Reads a time range from many Timeseries at once.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>Reads the same time range from a list of Timeseries, on a pool of worker threads</summary>
+ * <remarks><p>Each worker takes the next series from the list, opens it, and reads the records from
+ * <c>start</c> to <c>end</c> into a RecordSet, until the list is done. run() returns the RecordSets in the
+ * order of the names.</p>
+ * <p>The HDF5 library is serialized by the HDF5Lock, so the workers take turns in it. What runs in
+ * parallel is everything the library does not do: the decompression of chunks that the Table reads with
+ * its ChunkReader, the copying of columns into records, and the timestamp lookups in the in-memory index.
+ * With the default storage options, where the decompression is most of the work, this is most of a
+ * query.</p>
+ * <p>If reading a series fails, the workers stop taking new series, and run() throws a
+ * MultiSeriesQueryException with the name of the series and the original error.</p></remarks>
+ */
+class MultiSeriesQuery
+{
+public:
+	MultiSeriesQuery(hid_t _loc_id, const std::vector<std::string>& _names);
+
+	void setFields(const std::vector<std::string>& _field_names);
+	void setThreads(size_t _nthreads);
+	size_t threads(void) const;
+
+	std::vector<tsdb::RecordSet> run(tsdb::timestamp_t start, tsdb::timestamp_t end);
+	std::vector<tsdb::RecordSet> run(boost::posix_time::ptime start, boost::posix_time::ptime end);
+
+private:
+	/* MultiSeriesQueries hold a mutex, so they can't be copied */
+	MultiSeriesQuery(const MultiSeriesQuery&);
+	MultiSeriesQuery& operator=(const MultiSeriesQuery&);
+
+	void work(tsdb::timestamp_t start, tsdb::timestamp_t end, std::vector<tsdb::RecordSet>* results);
+	bool nextSeries(size_t* i);
+	void fail(size_t i, const std::string& what);
+
+	hid_t my_loc_id;
+	std::vector<std::string> my_names;
+	std::vector<std::string> my_field_names;  // empty for all of the fields
+	size_t my_nthreads;
+
+	/* State shared by the workers during run() */
+	boost::mutex my_mutex;
+	size_t my_next;        // index in my_names of the next series to read
+	std::string my_error;  // the first error, if any
+};
+
+} // namespace tsdb
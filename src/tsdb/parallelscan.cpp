@@ -0,0 +1,179 @@
+/* STL includes */
+#include <string>
+#include <map>
+#include <stdlib.h>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+/* TSDB includes */
+#include "parallelscan.h"
+#include "table.h"
+
+namespace tsdb {
+
+/* ====================================================================
+ * class ParallelScan - reads a Table in order, on worker threads
+ * ====================================================================
+ */
+
+/** <summary>Creates a scan of records <c>_first</c> to <c>_first + _nrecords - 1</c> of a Table</summary>
+ * <remarks>The scan reads with one worker per processor (see setThreads()).</remarks>
+ * <param name="_loc_id">A HDF5 <c>hid_t</c> (group or file id) where the Table is</param>
+ * <param name="_table_name">Name of the Table</param>
+ * <param name="_first">The first record to read</param>
+ * <param name="_nrecords">The number of records to read</param>
+ * <param name="_block_nrecords">The number of records in each block, but the last</param>
+ */
+ParallelScan::ParallelScan(hid_t _loc_id, const std::string& _table_name, hsize_t _first, hsize_t _nrecords,
+	size_t _block_nrecords): my_loc_id(_loc_id), my_table_name(_table_name), my_first(_first),
+	my_nrecords(_nrecords), my_block_nrecords(_block_nrecords > 0 ? _block_nrecords : 1), my_next(0),
+	my_taken(0), my_ahead(0) {
+	setThreads(0);
+}
+
+/** <summary>Sets the number of worker threads</summary>
+ * <remarks>0 means one per processor. With one worker, run() reads the blocks on the calling thread.</remarks>
+ */
+void ParallelScan::setThreads(size_t _nthreads) {
+	if(_nthreads == 0) {
+		_nthreads = boost::thread::hardware_concurrency();
+	}
+	my_nthreads = (_nthreads > 0) ? _nthreads : 1;
+}
+
+/** <summary>Returns the number of worker threads</summary> */
+size_t ParallelScan::threads(void) const {
+	return my_nthreads;
+}
+
+/** <summary>Reads the records, and calls <c>consumer</c> with each block of them in order</summary>
+ * <remarks>The records passed to the consumer are freed after it returns.</remarks>
+ */
+void ParallelScan::run(const Consumer& consumer) {
+	size_t nthreads = (my_nthreads < nblocks()) ? my_nthreads : nblocks();
+
+	if(nthreads <= 1) {
+		void* records = NULL;
+		try {
+			tsdb::Table table(my_loc_id, my_table_name);
+			for(size_t b = 0; b < nblocks(); b++) {
+				hsize_t first = my_first + b * my_block_nrecords;
+				size_t n = (size_t) ((my_nrecords - b * my_block_nrecords < my_block_nrecords) ?
+					my_nrecords - b * my_block_nrecords : my_block_nrecords);
+				table.getRecords(first, first + n - 1, &records);
+				consumer(first, n, (const char*) records);
+				free(records);
+				records = NULL;
+			}
+		} catch(std::exception& e) {
+			free(records);
+			throw( ParallelScanException(e.what()) );
+		}
+		return;
+	}
+
+	my_next = 0;
+	my_taken = 0;
+	my_ahead = 2 * nthreads;
+	my_read.clear();
+	my_error.clear();
+
+	boost::thread_group workers;
+	for(size_t i = 0; i < nthreads; i++) {
+		workers.create_thread(boost::bind(&ParallelScan::work, this));
+	}
+
+	for(size_t b = 0; b < nblocks(); b++) {
+		void* records = NULL;
+		{
+			boost::mutex::scoped_lock lock(my_mutex);
+			while(my_error.empty() && my_read.find(b) == my_read.end()) {
+				my_block_read.wait(lock);
+			}
+			if(!my_error.empty()) {
+				break;
+			}
+			records = my_read[b];
+			my_read.erase(b);
+			my_taken++;
+		}
+		my_block_taken.notify_all();
+
+		hsize_t first = my_first + b * my_block_nrecords;
+		size_t n = (size_t) ((my_nrecords - b * my_block_nrecords < my_block_nrecords) ?
+			my_nrecords - b * my_block_nrecords : my_block_nrecords);
+		try {
+			consumer(first, n, (const char*) records);
+		} catch(std::exception& e) {
+			fail(e.what());
+		} catch(...) {
+			fail("unknown error");
+		}
+		free(records);
+	}
+
+	workers.join_all();
+
+	for(std::map<size_t, void*>::iterator it = my_read.begin(); it != my_read.end(); ++it) {
+		free(it->second);
+	}
+	my_read.clear();
+
+	if(!my_error.empty()) {
+		throw( ParallelScanException(my_error) );
+	}
+}
+
+void ParallelScan::work(void) {
+	try {
+		tsdb::Table table(my_loc_id, my_table_name);
+
+		for(;;) {
+			size_t b;
+			{
+				boost::mutex::scoped_lock lock(my_mutex);
+				while(my_error.empty() && my_next < nblocks() && my_next >= my_taken + my_ahead) {
+					my_block_taken.wait(lock);
+				}
+				if(!my_error.empty() || my_next >= nblocks()) {
+					return;
+				}
+				b = my_next++;
+			}
+
+			hsize_t first = my_first + b * my_block_nrecords;
+			hsize_t n = (my_nrecords - b * my_block_nrecords < my_block_nrecords) ?
+				my_nrecords - b * my_block_nrecords : my_block_nrecords;
+			void* records = NULL;
+			table.getRecords(first, first + n - 1, &records);
+
+			{
+				boost::mutex::scoped_lock lock(my_mutex);
+				my_read[b] = records;
+			}
+			my_block_read.notify_all();
+		}
+	} catch(std::exception& e) {
+		fail(e.what());
+	} catch(...) {
+		fail("unknown error");
+	}
+}
+
+/* Stops the workers and the consumer, keeping the first error */
+void ParallelScan::fail(const std::string& what) {
+	{
+		boost::mutex::scoped_lock lock(my_mutex);
+		if(my_error.empty()) {
+			my_error = what;
+		}
+	}
+	my_block_read.notify_all();
+	my_block_taken.notify_all();
+}
+
+size_t ParallelScan::nblocks(void) const {
+	return (size_t) ((my_nrecords + my_block_nrecords - 1) / my_block_nrecords);
+}
+
+} // namespace tsdb
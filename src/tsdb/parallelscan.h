@@ -0,0 +1,89 @@
+#pragma once
+
+/* STL Classes */
+#include <string>
+#include <map>
+#include <stdexcept>
+
+/* External Libraries */
+#include "hdf5.h"
+#include "boost/function.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/condition_variable.hpp"
+
+/* TSDB Includes */
+#include "tsdb.h"
+
+namespace tsdb {
+
+/* -----------------------------------------------------------------
+ * ParallelScanException. For runtime errors thrown by a
+ * ParallelScan.
+ * -----------------------------------------------------------------
+ */
+class  ParallelScanException:
+	public std::runtime_error
+{
+public:
+	ParallelScanException(const std::string& what):
+	  std::runtime_error(std::string("ParallelScanException: ") + what) {}
+};
+
+/* -----------------------------------------------------------------
+ * ParallelScan. Reads a whole Table in order, on worker threads.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>Reads the records of a Table a block at a time on a pool of worker threads, and hands the
+ * blocks to the caller in order</summary>
+ * <remarks><p>Each worker opens the Table for itself and reads the next block that no other worker has
+ * taken. run() calls the consumer with each block on the calling thread, in record order, so the consumer
+ * can carry state from one block to the next, as building an index does.</p>
+ * <p>As with MultiSeriesQuery, what the workers do in parallel is the decompression of chunks by their
+ * ChunkReaders, outside of the HDF5Lock. The workers stay at most two blocks per worker ahead of the
+ * consumer, which bounds the memory a scan takes.</p>
+ * <p>If a worker fails, or the consumer throws, the workers stop, and run() throws a ParallelScanException
+ * with the original error.</p></remarks>
+ */
+class ParallelScan
+{
+public:
+	/* Called with the record id of the first record of a block, the number of records, and the records */
+	typedef boost::function<void (hsize_t, size_t, const char*)> Consumer;
+
+	ParallelScan(hid_t _loc_id, const std::string& _table_name, hsize_t _first, hsize_t _nrecords,
+		size_t _block_nrecords);
+
+	void setThreads(size_t _nthreads);
+	size_t threads(void) const;
+
+	void run(const Consumer& consumer);
+
+private:
+	/* ParallelScans hold a mutex, so they can't be copied */
+	ParallelScan(const ParallelScan&);
+	ParallelScan& operator=(const ParallelScan&);
+
+	void work(void);
+	void fail(const std::string& what);
+	size_t nblocks(void) const;
+
+	hid_t my_loc_id;
+	std::string my_table_name;
+	hsize_t my_first;
+	hsize_t my_nrecords;
+	size_t my_block_nrecords;
+	size_t my_nthreads;
+
+	/* State shared by the workers and the consumer during run() */
+	boost::mutex my_mutex;
+	boost::condition_variable my_block_read;   // a worker put a block in my_read
+	boost::condition_variable my_block_taken;  // the consumer took one
+	std::map<size_t, void*> my_read;           // blocks read, that the consumer has not taken yet
+	size_t my_next;                            // the next block to read
+	size_t my_taken;                           // blocks the consumer has taken
+	size_t my_ahead;                           // how many blocks the workers may be ahead of it
+	std::string my_error;                      // the first error, if any
+};
+
+} // namespace tsdb
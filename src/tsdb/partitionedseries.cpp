@@ -0,0 +1,403 @@
+/* STL includes */
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstdio>
+#include <string.h>
+#include <boost/make_shared.hpp>
+#include "boost/date_time/gregorian/gregorian.hpp"
+
+/* HDF5 Includes */
+#include "hdf5.h"
+#include "hdf5_hl.h"
+
+/* TSDB includes */
+#include "partitionedseries.h"
+#include "timeseries.h"
+#include "multiseriesquery.h"
+#include "recordsort.h"
+#include "catalog.h"
+#include "hdf5lock.h"
+
+using namespace std;
+
+namespace tsdb {
+
+namespace {
+
+const char* TEMPLATE_NAME = "_TSDB_template";
+const tsdb::timestamp_t MS_PER_DAY = 86400000LL;
+
+/* Reads the string attribute <c>attr</c> of <c>name</c>, or returns "" if it has none */
+std::string readStringAttribute(hid_t loc_id, const std::string& name, const char* attr) {
+	hsize_t dims;
+	H5T_class_t type_class;
+	size_t attr_size;
+
+	if(H5Aexists_by_name(loc_id, name.c_str(), attr, H5P_DEFAULT) > 0 &&
+		H5LTget_attribute_info(loc_id, name.c_str(), attr, &dims, &type_class, &attr_size) >= 0) {
+		string value(attr_size, '\0');
+		if(H5LTget_attribute_string(loc_id, name.c_str(), attr, &value[0]) >= 0) {
+			return string(value.c_str());
+		}
+	}
+	return "";
+}
+
+} // namespace
+
+/* ====================================================================
+ * class PartitionedSeries - a series with one Timeseries per period
+ * ====================================================================
+ */
+
+/** <summary>Creates a partitioned series, with no partitions yet</summary>
+ * <remarks>Like the Timeseries create constructor, <c>_fields</c> should not include the "_TSDB_timestamp"
+ * field, and the series takes ownership of the fields.</remarks>
+ * <param name="_loc_id">A HDF5 hid_t (group or file id) where the series will be created</param>
+ * <param name="_name">A name for the series, which is the name of its group</param>
+ * <param name="_title">The title of the series and of each partition</param>
+ * <param name="_fields">The fields of the records</param>
+ * <param name="_period">How much time each partition covers</param>
+ * <param name="_file_prefix">Start of the file name of each partition, or "" to keep the partitions in
+ * the group</param>
+ * <param name="_options">Storage options of the partitions</param>
+ */
+PartitionedSeries::PartitionedSeries(hid_t _loc_id, const std::string& _name, const std::string& _title,
+	const std::vector<Field*>& _fields, Period _period, const std::string& _file_prefix,
+	const tsdb::StorageOptions& _options): my_name(_name), my_title(_title), my_period(_period),
+	my_file_prefix(_file_prefix), my_options(_options), my_nthreads(0) {
+	HDF5Lock lock;
+
+	if(H5Lexists(_loc_id, _name.c_str(), H5P_DEFAULT) > 0) {
+		throw( PartitionedSeriesException("'" + _name + "' already exists.") );
+	}
+
+	my_group_id = H5Gcreate2(_loc_id, _name.c_str(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+	if(my_group_id < 0) {
+		throw( PartitionedSeriesException("Error in H5Gcreate2.") );
+	}
+
+	herr_t status = H5LTset_attribute_string(_loc_id, _name.c_str(), "TSDB_PARTITION",
+		my_period == MONTH ? "Month" : "Day");
+	if(status >= 0) {
+		status = H5LTset_attribute_string(_loc_id, _name.c_str(), "TSDB_PARTITION_FILES", my_file_prefix.c_str());
+	}
+	if(status < 0) {
+		H5Gclose(my_group_id);
+		throw( PartitionedSeriesException("Error in H5LTset_attribute_string.") );
+	}
+	my_options.save(_loc_id, _name);
+
+	tsdb::Timeseries templ(my_group_id, TEMPLATE_NAME, my_title, _fields, my_options);
+	my_structure = templ.structure();
+}
+
+/** <summary>Opens an existing partitioned series</summary>
+ * <param name="_loc_id">A HDF5 hid_t (group or file id) where the series is</param>
+ * <param name="_name">The name of the series</param>
+ */
+PartitionedSeries::PartitionedSeries(hid_t _loc_id, const std::string& _name): my_name(_name), my_nthreads(0) {
+	HDF5Lock lock;
+
+	if(!PartitionedSeries::exists(_loc_id, _name)) {
+		throw( PartitionedSeriesException("'" + _name + "' is not a partitioned series.") );
+	}
+
+	my_group_id = H5Gopen2(_loc_id, _name.c_str(), H5P_DEFAULT);
+	if(my_group_id < 0) {
+		throw( PartitionedSeriesException("Error in H5Gopen2.") );
+	}
+
+	my_period = (readStringAttribute(_loc_id, _name, "TSDB_PARTITION") == "Month") ? MONTH : DAY;
+	my_file_prefix = readStringAttribute(_loc_id, _name, "TSDB_PARTITION_FILES");
+	my_options = tsdb::StorageOptions::load(_loc_id, _name);
+
+	tsdb::Timeseries templ(my_group_id, TEMPLATE_NAME);
+	my_structure = templ.structure();
+	my_title = templ.dataTable()->title();
+}
+
+PartitionedSeries::~PartitionedSeries(void) {
+	HDF5Lock lock;
+	my_partitions.clear();
+	H5Gclose(my_group_id);
+}
+
+/** <summary>Appends records, splitting them among the partitions of their timestamps</summary>
+ * <remarks><p>The records are sorted in place first if they need to be, as by Timeseries::appendRecords().
+ * The records of the head partition are appended to it, and records after it start new partitions.</p>
+ * <p>Records before the last record of the series overlap. With <c>discard_overlap</c> they are dropped,
+ * and counted in the return value; otherwise a PartitionedSeriesException or a TimeseriesException is
+ * thrown. Records of earlier partitions are never appended, so a partition that has been dropped stays
+ * dropped.</p></remarks>
+ * <param name="nrecords">Number of records</param>
+ * <param name="records">The records, with the Structure of the series</param>
+ * <param name="discard_overlap">If <c>true</c>, records that overlap with existing records are discarded</param>
+ */
+int PartitionedSeries::appendRecords(size_t nrecords, void* records, bool discard_overlap) {
+	if(nrecords == 0) {
+		return 0;
+	}
+
+	char* records_c = (char*) records;
+	size_t record_size = my_structure->getSizeOf();
+	if(!RecordSort::isSorted(records, nrecords, record_size)) {
+		RecordSort::sort(records, nrecords, record_size);
+	}
+
+	std::vector<std::string> names = partitionNames();
+	std::string head = names.empty() ? "" : names.back();
+	int discarded = 0;
+
+	for(size_t i = 0; i < nrecords; ) {
+		std::string key = partitionKey(*(tsdb::timestamp_t*) (records_c + i * record_size));
+		tsdb::timestamp_t end = partitionEnd(key);
+		size_t j = i + 1;
+		while(j < nrecords && *(tsdb::timestamp_t*) (records_c + j * record_size) <= end) {
+			j++;
+		}
+
+		if(!head.empty() && key < head) {
+			if(!discard_overlap) {
+				throw( PartitionedSeriesException("Records are before the head partition, and discard_overlap=false.") );
+			}
+			discarded += (int) (j - i);
+		} else {
+			boost::shared_ptr<tsdb::Timeseries> ts = (key == head) ? partition(key) : createPartition(key);
+			discarded += ts->appendRecords(j - i, records_c + i * record_size, discard_overlap);
+			head = key;
+		}
+		i = j;
+	}
+	return discarded;
+}
+
+/** <summary>Appends the records of a RecordSet. See appendRecords().</summary> */
+void PartitionedSeries::appendRecordSet(const tsdb::RecordSet& recset, bool discard_overlap) {
+	if(recset.size() > 0 && recset.structure()->getSizeOf() != my_structure->getSizeOf()) {
+		throw( PartitionedSeriesException("The records do not have the Structure of the series.") );
+	}
+	this->appendRecords(recset.size(), recset.memoryBlockPtr().raw(), discard_overlap);
+}
+
+/** <summary>Reads the records between two timestamps (inclusive), one RecordSet per partition</summary>
+ * <remarks>Only the partitions that overlap the range are opened. They are read in parallel by a
+ * MultiSeriesQuery, and returned in time order. Throws a MultiSeriesQueryException if a partition can
+ * not be read.</remarks>
+ */
+std::vector<tsdb::RecordSet> PartitionedSeries::recordSets(tsdb::timestamp_t start, tsdb::timestamp_t end) {
+	std::vector<std::string> names = partitionNames(start, end);
+	if(names.empty()) {
+		return std::vector<tsdb::RecordSet>();
+	}
+
+	tsdb::MultiSeriesQuery query(my_group_id, names);
+	query.setThreads(my_nthreads);
+	return query.run(start, end);
+}
+
+/** <summary>Reads the records between two timestamps (inclusive) into one RecordSet</summary>
+ * <remarks>Reads the partitions as recordSets() does, and copies them together.</remarks>
+ */
+tsdb::RecordSet PartitionedSeries::recordSet(tsdb::timestamp_t start, tsdb::timestamp_t end) {
+	std::vector<tsdb::RecordSet> parts = recordSets(start, end);
+	size_t nrecords = 0;
+	for(size_t i = 0; i < parts.size(); i++) {
+		nrecords += parts[i].size();
+	}
+
+	tsdb::RecordSet result(nrecords, my_structure);
+	size_t record_size = my_structure->getSizeOf();
+	char* dest = result.memoryBlockPtr().raw();
+	for(size_t i = 0; i < parts.size(); i++) {
+		if(parts[i].size() > 0) {
+			memcpy(dest, parts[i].memoryBlockPtr().raw(), parts[i].size() * record_size);
+			dest += parts[i].size() * record_size;
+		}
+	}
+	return result;
+}
+
+/** <summary>Sets the number of threads that read partitions; 0 means one per processor</summary> */
+void PartitionedSeries::setThreads(size_t _nthreads) {
+	my_nthreads = _nthreads;
+}
+
+/** <summary>Returns the keys of the partitions, in time order</summary> */
+std::vector<std::string> PartitionedSeries::partitionNames(void) {
+	std::vector<std::string> names = tsdb::Catalog::seriesNames(my_group_id);
+	// Keys have a fixed width, so their order is the order of time
+	std::sort(names.begin(), names.end());
+	return names;
+}
+
+/** <summary>Returns the keys of the partitions that overlap the range from <c>start</c> to <c>end</c></summary> */
+std::vector<std::string> PartitionedSeries::partitionNames(tsdb::timestamp_t start, tsdb::timestamp_t end) {
+	std::vector<std::string> names = partitionNames();
+	std::vector<std::string> overlapping;
+	for(size_t i = 0; i < names.size(); i++) {
+		if(partitionEnd(names[i]) >= start && partitionStart(names[i]) <= end) {
+			overlapping.push_back(names[i]);
+		}
+	}
+	return overlapping;
+}
+
+/** <summary>Returns the partition <c>key</c>, opening it the first time</summary>
+ * <remarks>Throws a PartitionedSeriesException if there is no such partition.</remarks>
+ */
+boost::shared_ptr<tsdb::Timeseries> PartitionedSeries::partition(const std::string& key) {
+	HDF5Lock lock;
+
+	std::map<std::string, boost::shared_ptr<tsdb::Timeseries> >::iterator it = my_partitions.find(key);
+	if(it != my_partitions.end()) {
+		return it->second;
+	}
+
+	if(Catalog::isInternalName(key) || H5Lexists(my_group_id, key.c_str(), H5P_DEFAULT) <= 0) {
+		throw( PartitionedSeriesException("There is no partition '" + key + "'.") );
+	}
+	boost::shared_ptr<tsdb::Timeseries> ts = boost::make_shared<tsdb::Timeseries>(my_group_id, key);
+	my_partitions[key] = ts;
+	return ts;
+}
+
+/** <summary>Returns the key of the partition that holds <c>timestamp</c></summary> */
+std::string PartitionedSeries::partitionKey(tsdb::timestamp_t timestamp) const {
+	tsdb::timestamp_t days = timestamp / MS_PER_DAY;
+	if(timestamp % MS_PER_DAY < 0) {
+		days--;
+	}
+	boost::gregorian::date day = boost::gregorian::date(1970, 1, 1) + boost::gregorian::date_duration((long) days);
+	std::string key = boost::gregorian::to_iso_string(day);
+	return (my_period == MONTH) ? key.substr(0, 6) : key;
+}
+
+/** <summary>Returns the first timestamp of the partition <c>key</c></summary>
+ * <remarks>Throws a PartitionedSeriesException if <c>key</c> is not a key of this series.</remarks>
+ */
+tsdb::timestamp_t PartitionedSeries::partitionStart(const std::string& key) const {
+	boost::gregorian::date day;
+	try {
+		day = boost::gregorian::from_undelimited_string(my_period == MONTH ? key + "01" : key);
+	} catch(std::exception&) {
+		throw( PartitionedSeriesException("'" + key + "' is not a partition key.") );
+	}
+	return (tsdb::timestamp_t) (day - boost::gregorian::date(1970, 1, 1)).days() * MS_PER_DAY;
+}
+
+/** <summary>Returns the last timestamp of the partition <c>key</c></summary> */
+tsdb::timestamp_t PartitionedSeries::partitionEnd(const std::string& key) const {
+	tsdb::timestamp_t start = partitionStart(key);
+	if(my_period == DAY) {
+		return start + MS_PER_DAY - 1;
+	}
+	boost::gregorian::date next = boost::gregorian::from_undelimited_string(key + "01") + boost::gregorian::months(1);
+	return (tsdb::timestamp_t) (next - boost::gregorian::date(1970, 1, 1)).days() * MS_PER_DAY - 1;
+}
+
+/** <summary>Drops every partition that ends before <c>timestamp</c>. Returns the number dropped.</summary>
+ * <remarks>This is the retention of the series: no records are read or rewritten. A partition that
+ * holds <c>timestamp</c> is kept whole.</remarks>
+ */
+size_t PartitionedSeries::dropPartitionsBefore(tsdb::timestamp_t timestamp) {
+	std::vector<std::string> names = partitionNames();
+	size_t ndropped = 0;
+	for(size_t i = 0; i < names.size(); i++) {
+		if(partitionEnd(names[i]) < timestamp) {
+			dropPartition(names[i]);
+			ndropped++;
+		}
+	}
+	return ndropped;
+}
+
+/** <summary>Drops the partition <c>key</c>, and deletes its file if it has one</summary>
+ * <remarks>A Timeseries of the partition from partition() must not be used afterwards. Throws a
+ * PartitionedSeriesException if there is no such partition.</remarks>
+ */
+void PartitionedSeries::dropPartition(const std::string& key) {
+	HDF5Lock lock;
+
+	if(Catalog::isInternalName(key) || H5Lexists(my_group_id, key.c_str(), H5P_DEFAULT) <= 0) {
+		throw( PartitionedSeriesException("There is no partition '" + key + "'.") );
+	}
+	my_partitions.erase(key);
+
+	if(H5Ldelete(my_group_id, key.c_str(), H5P_DEFAULT) < 0) {
+		throw( PartitionedSeriesException("Error in H5Ldelete.") );
+	}
+	Catalog::remove(my_group_id, key);
+
+	if(!my_file_prefix.empty() && std::remove(partitionFile(key).c_str()) != 0) {
+		throw( PartitionedSeriesException("Unable to delete '" + partitionFile(key) + "'.") );
+	}
+}
+
+/** <summary>Returns the number of records in all of the partitions</summary> */
+hsize_t PartitionedSeries::getNRecords(void) {
+	std::vector<std::string> names = partitionNames();
+	hsize_t nrecords = 0;
+	for(size_t i = 0; i < names.size(); i++) {
+		nrecords += partition(names[i])->getNRecords();
+	}
+	return nrecords;
+}
+
+/** <summary>Returns the Structure of the records, which starts with the "_TSDB_timestamp" field</summary> */
+boost::shared_ptr<tsdb::Structure> PartitionedSeries::structure(void) {
+	return my_structure;
+}
+
+/** <summary>Returns how much time each partition covers</summary> */
+PartitionedSeries::Period PartitionedSeries::period(void) const {
+	return my_period;
+}
+
+/** <summary>Returns true if there is a partitioned series <c>name</c> at <c>loc_id</c></summary> */
+bool PartitionedSeries::exists(hid_t loc_id, const std::string& name) {
+	HDF5Lock lock;
+	return H5Lexists(loc_id, name.c_str(), H5P_DEFAULT) > 0 &&
+		H5Aexists_by_name(loc_id, name.c_str(), "TSDB_PARTITION", H5P_DEFAULT) > 0;
+}
+
+/** <summary>Creates the partition <c>key</c>, in the group or in a file of its own</summary> */
+boost::shared_ptr<tsdb::Timeseries> PartitionedSeries::createPartition(const std::string& key) {
+	HDF5Lock lock;
+
+	if(my_file_prefix.empty()) {
+		boost::shared_ptr<tsdb::Timeseries> ts =
+			boost::make_shared<tsdb::Timeseries>(my_group_id, key, my_title, my_structure, my_options);
+		my_partitions[key] = ts;
+		return ts;
+	}
+
+	// The partition is a Timeseries of the same name in its own file, which the group links to
+	std::string filename = partitionFile(key);
+	hid_t file_id = H5Fcreate(filename.c_str(), H5F_ACC_EXCL, H5P_DEFAULT, H5P_DEFAULT);
+	if(file_id < 0) {
+		throw( PartitionedSeriesException("Unable to create '" + filename + "'.") );
+	}
+	try {
+		tsdb::Timeseries ts(file_id, key, my_title, my_structure, my_options);
+	} catch(...) {
+		H5Fclose(file_id);
+		throw;
+	}
+	H5Fclose(file_id);
+
+	if(H5Lcreate_external(filename.c_str(), ("/" + key).c_str(), my_group_id, key.c_str(), H5P_DEFAULT, H5P_DEFAULT) < 0) {
+		throw( PartitionedSeriesException("Error in H5Lcreate_external.") );
+	}
+	Catalog::add(my_group_id, key);
+	return partition(key);
+}
+
+/** <summary>Returns the name of the file of the partition <c>key</c></summary> */
+std::string PartitionedSeries::partitionFile(const std::string& key) const {
+	return my_file_prefix + key + ".h5";
+}
+
+} // namespace tsdb
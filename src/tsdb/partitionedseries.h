@@ -0,0 +1,118 @@
+#pragma once
+
+/* STL Classes */
+#include <string>
+#include <vector>
+#include <map>
+#include <stdexcept>
+
+/* External Libraries */
+#include "hdf5.h"
+#include <boost/shared_ptr.hpp>
+
+/* TSDB Includes */
+#include "tsdb.h"
+#include "structure.h"
+#include "recordset.h"
+#include "storageoptions.h"
+
+namespace tsdb {
+
+class Timeseries;
+
+/* -----------------------------------------------------------------
+ * PartitionedSeriesException. For runtime errors thrown by a
+ * PartitionedSeries.
+ * -----------------------------------------------------------------
+ */
+class  PartitionedSeriesException:
+	public std::runtime_error
+{
+public:
+	PartitionedSeriesException(const std::string& what):
+	  std::runtime_error(std::string("PartitionedSeriesException: ") + what) {}
+};
+
+/* -----------------------------------------------------------------
+ * PartitionedSeries. A series split into one Timeseries per day or
+ * per month.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>A series stored as one Timeseries per day or per month, so that old data can be dropped</summary>
+ * <remarks><p>The series is a group holding its partitions, each an ordinary Timeseries named after the
+ * period it covers: "20261015" for a day, or "202610" for a month (UTC). The Catalog of the group lists
+ * them, and an empty Timeseries "_TSDB_template" keeps the fields and title for new partitions. Any
+ * Timeseries method can be used on a partition from partition().</p>
+ * <p>With a file prefix, each partition is a file of its own, <c>&lt;prefix&gt;&lt;key&gt;.h5</c>, holding a
+ * Timeseries with the same name, and the group only holds an external link to it. The prefix is used as
+ * it is, so it should be absolute, or relative to both the working directory and the main file.</p>
+ * <p>Appends go to the head partition, the latest one, and start a new partition when the records reach
+ * the next period. Records before the head partition are overlapping, as records before the last one are
+ * for a Timeseries.</p>
+ * <p>Queries only open the partitions that overlap the time range, and read them on a pool of threads
+ * with a MultiSeriesQuery.</p>
+ * <p>Retention is dropPartitionsBefore(), which unlinks whole partitions and deletes their files. Without
+ * a file prefix, HDF5 does not give the space of an unlinked partition back until the file is repacked
+ * (with h5repack), so series that drop old data should use separate files.</p></remarks>
+ */
+class PartitionedSeries
+{
+public:
+	enum Period {
+		DAY,
+		MONTH
+	};
+
+	PartitionedSeries(hid_t _loc_id, const std::string& _name, const std::string& _title,
+		const std::vector<Field*>& _fields, Period _period, const std::string& _file_prefix = "",
+		const tsdb::StorageOptions& _options = tsdb::StorageOptions());
+	PartitionedSeries(hid_t _loc_id, const std::string& _name);
+	~PartitionedSeries(void);
+
+	/* Methods to write data to the series */
+	int appendRecords(size_t nrecords, void* records, bool discard_overlap);
+	void appendRecordSet(const tsdb::RecordSet& recset, bool discard_overlap);
+
+	/* Methods to read the series */
+	std::vector<tsdb::RecordSet> recordSets(tsdb::timestamp_t start, tsdb::timestamp_t end);
+	tsdb::RecordSet recordSet(tsdb::timestamp_t start, tsdb::timestamp_t end);
+	void setThreads(size_t _nthreads);
+
+	/* Methods on the partitions */
+	std::vector<std::string> partitionNames(void);
+	std::vector<std::string> partitionNames(tsdb::timestamp_t start, tsdb::timestamp_t end);
+	boost::shared_ptr<tsdb::Timeseries> partition(const std::string& key);
+	std::string partitionKey(tsdb::timestamp_t timestamp) const;
+	tsdb::timestamp_t partitionStart(const std::string& key) const;
+	tsdb::timestamp_t partitionEnd(const std::string& key) const;
+	size_t dropPartitionsBefore(tsdb::timestamp_t timestamp);
+	void dropPartition(const std::string& key);
+
+	/* Methods to get information about the series */
+	hsize_t getNRecords(void);
+	boost::shared_ptr<tsdb::Structure> structure(void);
+	Period period(void) const;
+
+	static bool exists(hid_t loc_id, const std::string& name);
+
+private:
+	/* PartitionedSeries hold open partitions and a group, so they can't be copied */
+	PartitionedSeries(const PartitionedSeries&);
+	PartitionedSeries& operator=(const PartitionedSeries&);
+
+	boost::shared_ptr<tsdb::Timeseries> createPartition(const std::string& key);
+	std::string partitionFile(const std::string& key) const;
+
+	hid_t my_group_id;
+	std::string my_name;
+	std::string my_title;
+	Period my_period;
+	std::string my_file_prefix;		// empty to keep the partitions in the group
+	tsdb::StorageOptions my_options;
+	boost::shared_ptr<tsdb::Structure> my_structure;
+	size_t my_nthreads;
+	std::map<std::string, boost::shared_ptr<tsdb::Timeseries> > my_partitions; // the ones opened so far
+};
+
+} // namespace tsdb
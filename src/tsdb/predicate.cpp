@@ -0,0 +1,741 @@
+/* STL includes */
+#include <string>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+#include <iomanip>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+/* External Libraries */
+#include <boost/make_shared.hpp>
+#include <boost/algorithm/string.hpp>
+
+/* TSDB includes */
+#include "predicate.h"
+#include "columnkernels.h"
+#include "zonemap.h"
+#include "symboltable.h"
+
+namespace tsdb {
+
+namespace {
+
+/* The number of records select() evaluates at a time */
+const size_t BLOCK_SIZE = 512;
+
+bool isNumericType(tsdb::Field::FieldType type) {
+	switch(type) {
+		case tsdb::Field::DOUBLE:
+		case tsdb::Field::INT32:
+		case tsdb::Field::INT8:
+		case tsdb::Field::TIMESTAMP:
+		case tsdb::Field::DATE:
+			return true;
+		default:
+			return false;
+	}
+}
+
+bool isComparison(tsdb::Predicate::Operator op) {
+	return op == tsdb::Predicate::LT || op == tsdb::Predicate::LE || op == tsdb::Predicate::GT ||
+		op == tsdb::Predicate::GE || op == tsdb::Predicate::EQ || op == tsdb::Predicate::NE;
+}
+
+/* The operator that gives the same result with its sides swapped, as in 100 < amount */
+tsdb::Predicate::Operator swapSides(tsdb::Predicate::Operator op) {
+	switch(op) {
+		case tsdb::Predicate::LT: return tsdb::Predicate::GT;
+		case tsdb::Predicate::LE: return tsdb::Predicate::GE;
+		case tsdb::Predicate::GT: return tsdb::Predicate::LT;
+		case tsdb::Predicate::GE: return tsdb::Predicate::LE;
+		default: return op;
+	}
+}
+
+const char* operatorToString(tsdb::Predicate::Operator op) {
+	switch(op) {
+		case tsdb::Predicate::LT: return "<";
+		case tsdb::Predicate::LE: return "<=";
+		case tsdb::Predicate::GT: return ">";
+		case tsdb::Predicate::GE: return ">=";
+		case tsdb::Predicate::EQ: return "==";
+		case tsdb::Predicate::NE: return "!=";
+		case tsdb::Predicate::AND: return "&&";
+		case tsdb::Predicate::OR: return "||";
+		default: return "";
+	}
+}
+
+template <class Compare>
+void compareValues(const tsdb::ieee64_t* values, size_t n, tsdb::ieee64_t constant, unsigned char* mask, Compare cmp) {
+	for(size_t i = 0; i < n; i++) {
+		mask[i] = (unsigned char) cmp(values[i], constant);
+	}
+}
+
+/* The comparisons, as functors so that compareValues() inlines them. All are false for a NaN. */
+struct Less { bool operator()(tsdb::ieee64_t a, tsdb::ieee64_t b) const { return a < b; } };
+struct LessEqual { bool operator()(tsdb::ieee64_t a, tsdb::ieee64_t b) const { return a <= b; } };
+struct Greater { bool operator()(tsdb::ieee64_t a, tsdb::ieee64_t b) const { return a > b; } };
+struct GreaterEqual { bool operator()(tsdb::ieee64_t a, tsdb::ieee64_t b) const { return a >= b; } };
+struct Equal { bool operator()(tsdb::ieee64_t a, tsdb::ieee64_t b) const { return a == b; } };
+struct NotEqual { bool operator()(tsdb::ieee64_t a, tsdb::ieee64_t b) const { return a < b || a > b; } };
+
+/* ----------------------------------------------------------------
+ * PredicateParser. Reads the text form of a Predicate.
+ * ----------------------------------------------------------------
+ */
+class PredicateParser
+{
+public:
+	PredicateParser(const std::string& _text): my_text(_text), my_pos(0) {
+		next();
+	}
+
+	tsdb::Predicate parse(void) {
+		tsdb::Predicate predicate = parseOr();
+		if(my_kind != END) {
+			fail("unexpected '" + my_token + "'");
+		}
+		return predicate;
+	}
+
+private:
+	enum Kind {
+		END,
+		NAME,
+		NUMBER,
+		STRING,
+		SYMBOL
+	};
+
+	tsdb::Predicate parseOr(void) {
+		tsdb::Predicate predicate = parseAnd();
+		while(isSymbol("||") || isSymbol("|") || isWord("or")) {
+			next();
+			predicate = tsdb::Predicate::either(predicate, parseAnd());
+		}
+		return predicate;
+	}
+
+	tsdb::Predicate parseAnd(void) {
+		tsdb::Predicate predicate = parseUnary();
+		while(isSymbol("&&") || isSymbol("&") || isWord("and")) {
+			next();
+			predicate = tsdb::Predicate::both(predicate, parseUnary());
+		}
+		return predicate;
+	}
+
+	tsdb::Predicate parseUnary(void) {
+		if(isSymbol("!") || isWord("not")) {
+			next();
+			return tsdb::Predicate::negate(parseUnary());
+		}
+		if(isSymbol("(")) {
+			next();
+			tsdb::Predicate predicate = parseOr();
+			expect(")");
+			return predicate;
+		}
+		if(isWord("isnan") || isWord("is.nan") || isWord("is.na")) {
+			next();
+			expect("(");
+			if(my_kind != NAME) {
+				fail("expected a field name after isnan(");
+			}
+			std::string field = my_token;
+			next();
+			expect(")");
+			return tsdb::Predicate::isNaN(field);
+		}
+		return parseComparison();
+	}
+
+	tsdb::Predicate parseComparison(void) {
+		Kind left_kind = my_kind;
+		std::string left = my_token;
+		if(left_kind == END || left_kind == SYMBOL) {
+			fail(left_kind == END ? "unexpected end" : "unexpected '" + left + "'");
+		}
+		next();
+
+		tsdb::Predicate::Operator op = tsdb::Predicate::EQ;
+		if(isSymbol("==") || isSymbol("=")) {
+			op = tsdb::Predicate::EQ;
+		} else if(isSymbol("!=") || isSymbol("<>")) {
+			op = tsdb::Predicate::NE;
+		} else if(isSymbol("<")) {
+			op = tsdb::Predicate::LT;
+		} else if(isSymbol("<=")) {
+			op = tsdb::Predicate::LE;
+		} else if(isSymbol(">")) {
+			op = tsdb::Predicate::GT;
+		} else if(isSymbol(">=")) {
+			op = tsdb::Predicate::GE;
+		} else {
+			fail("expected a comparison after '" + left + "'");
+		}
+		next();
+
+		Kind right_kind = my_kind;
+		std::string right = my_token;
+		if(right_kind == END || right_kind == SYMBOL) {
+			fail(right_kind == END ? "unexpected end" : "unexpected '" + right + "'");
+		}
+		next();
+
+		// The field may be on either side
+		if(left_kind != NAME) {
+			if(right_kind != NAME) {
+				fail("a comparison needs a field name");
+			}
+			std::swap(left, right);
+			std::swap(left_kind, right_kind);
+			op = swapSides(op);
+		}
+		if(right_kind == NAME) {
+			fail("can't compare field '" + left + "' with field '" + right + "'");
+		}
+
+		if(right_kind == STRING) {
+			return tsdb::Predicate::compare(left, op, right);
+		}
+		return tsdb::Predicate::compare(left, op, strtod(right.c_str(), NULL));
+	}
+
+	/* Moves to the next token */
+	void next(void) {
+		while(my_pos < my_text.size() && isspace((unsigned char) my_text[my_pos])) {
+			my_pos++;
+		}
+		my_token.clear();
+		if(my_pos >= my_text.size()) {
+			my_kind = END;
+			return;
+		}
+
+		const char* start = my_text.c_str() + my_pos;
+		char c = *start;
+		char c2 = (my_pos + 1 < my_text.size()) ? start[1] : '\0';
+
+		if(isdigit((unsigned char) c) || ((c == '.' || c == '-' || c == '+') &&
+			(isdigit((unsigned char) c2) || c2 == '.'))) {
+			char* end;
+			strtod(start, &end);
+			if(end == start) {
+				fail("bad number");
+			}
+			my_kind = NUMBER;
+			my_token.assign(start, end - start);
+			my_pos += end - start;
+		} else if(isalpha((unsigned char) c) || c == '_') {
+			size_t end = my_pos;
+			while(end < my_text.size() && (isalnum((unsigned char) my_text[end]) || my_text[end] == '_' ||
+				my_text[end] == '.')) {
+				end++;
+			}
+			my_kind = NAME;
+			my_token = my_text.substr(my_pos, end - my_pos);
+			my_pos = end;
+		} else if(c == '\'' || c == '"') {
+			size_t end = my_text.find(c, my_pos + 1);
+			if(end == std::string::npos) {
+				fail("missing closing quote");
+			}
+			my_kind = STRING;
+			my_token = my_text.substr(my_pos + 1, end - my_pos - 1);
+			my_pos = end + 1;
+		} else {
+			static const char* symbols[] = { "==", "!=", "<>", "<=", ">=", "&&", "||",
+				"=", "<", ">", "&", "|", "!", "(", ")", NULL };
+			for(size_t i = 0; symbols[i] != NULL; i++) {
+				if(my_text.compare(my_pos, strlen(symbols[i]), symbols[i]) == 0) {
+					my_kind = SYMBOL;
+					my_token = symbols[i];
+					my_pos += my_token.size();
+					return;
+				}
+			}
+			fail(std::string("unexpected '") + c + "'");
+		}
+	}
+
+	bool isSymbol(const char* symbol) const {
+		return my_kind == SYMBOL && my_token == symbol;
+	}
+
+	bool isWord(const char* word) const {
+		return my_kind == NAME && boost::algorithm::iequals(my_token, word);
+	}
+
+	void expect(const char* symbol) {
+		if(!isSymbol(symbol)) {
+			fail(std::string("expected '") + symbol + "'");
+		}
+		next();
+	}
+
+	void fail(const std::string& message) const {
+		throw( PredicateException(message + " in '" + my_text + "'") );
+	}
+
+	std::string my_text;
+	size_t my_pos;
+	Kind my_kind;
+	std::string my_token;
+};
+
+} // namespace
+
+/* ====================================================================
+ * class Predicate - a condition on the fields of a record
+ * ====================================================================
+ */
+
+/** <summary>Creates a Predicate that matches every record</summary> */
+Predicate::Predicate(void) {
+}
+
+Predicate::Predicate(const boost::shared_ptr<const Node>& _root): my_root(_root) {
+}
+
+/** <summary>Makes the comparison <c>field op value</c> of a numeric field</summary>
+ * <remarks>Throws a PredicateException if <c>op</c> is not a comparison or <c>value</c> is NaN.</remarks>
+ */
+Predicate Predicate::compare(const std::string& field, Operator op, tsdb::ieee64_t value) {
+	if(!isComparison(op)) {
+		throw( PredicateException("not a comparison operator") );
+	}
+	if(value != value) {
+		throw( PredicateException("can't compare '" + field + "' with NaN, use isNaN()") );
+	}
+	boost::shared_ptr<Node> node = boost::make_shared<Node>();
+	node->op = op;
+	node->field = field;
+	node->number = value;
+	node->is_text = false;
+	return Predicate(node);
+}
+
+/** <summary>Makes the comparison <c>field op value</c> of a String, Char or Symbol field</summary>
+ * <remarks>Throws a PredicateException if <c>op</c> is not EQ or NE.</remarks>
+ */
+Predicate Predicate::compare(const std::string& field, Operator op, const std::string& value) {
+	if(op != EQ && op != NE) {
+		throw( PredicateException("strings can only be compared with == and !=") );
+	}
+	boost::shared_ptr<Node> node = boost::make_shared<Node>();
+	node->op = op;
+	node->field = field;
+	node->number = 0;
+	node->text = value;
+	node->is_text = true;
+	return Predicate(node);
+}
+
+/** <summary>Makes a Predicate that matches records where <c>field</c> is NaN</summary> */
+Predicate Predicate::isNaN(const std::string& field) {
+	boost::shared_ptr<Node> node = boost::make_shared<Node>();
+	node->op = IS_NAN;
+	node->field = field;
+	node->number = 0;
+	node->is_text = false;
+	return Predicate(node);
+}
+
+/** <summary>Makes a Predicate that matches records where <c>field</c> is not NaN</summary> */
+Predicate Predicate::notNaN(const std::string& field) {
+	boost::shared_ptr<Node> node = boost::make_shared<Node>();
+	node->op = NOT_NAN;
+	node->field = field;
+	node->number = 0;
+	node->is_text = false;
+	return Predicate(node);
+}
+
+/** <summary>Makes a Predicate that matches the records that both <c>a</c> and <c>b</c> match</summary> */
+Predicate Predicate::both(const Predicate& a, const Predicate& b) {
+	if(a.matchesAll()) {
+		return b;
+	}
+	if(b.matchesAll()) {
+		return a;
+	}
+	boost::shared_ptr<Node> node = boost::make_shared<Node>();
+	node->op = AND;
+	node->number = 0;
+	node->is_text = false;
+	node->left = a.my_root;
+	node->right = b.my_root;
+	return Predicate(node);
+}
+
+/** <summary>Makes a Predicate that matches the records that <c>a</c> or <c>b</c> matches</summary> */
+Predicate Predicate::either(const Predicate& a, const Predicate& b) {
+	if(a.matchesAll()) {
+		return a;
+	}
+	if(b.matchesAll()) {
+		return b;
+	}
+	boost::shared_ptr<Node> node = boost::make_shared<Node>();
+	node->op = OR;
+	node->number = 0;
+	node->is_text = false;
+	node->left = a.my_root;
+	node->right = b.my_root;
+	return Predicate(node);
+}
+
+/** <summary>Makes a Predicate that matches the records that <c>a</c> does not match</summary>
+ * <remarks>Comparisons are false for a missing value, so the negation of one is true for it:
+ * <c>!(price &gt; 100)</c> matches missing prices, and <c>price &lt;= 100</c> does not. Throws a
+ * PredicateException if <c>a</c> matches every record.</remarks>
+ */
+Predicate Predicate::negate(const Predicate& a) {
+	if(a.matchesAll()) {
+		throw( PredicateException("can't negate a predicate that matches every record") );
+	}
+	boost::shared_ptr<Node> node = boost::make_shared<Node>();
+	node->op = NOT;
+	node->number = 0;
+	node->is_text = false;
+	node->left = a.my_root;
+	return Predicate(node);
+}
+
+/** <summary>Reads a Predicate from text, such as <c>side == 1 &amp;&amp; amount &gt; 100</c></summary>
+ * <remarks>An expression that is empty or all spaces matches every record. Throws a PredicateException
+ * if the expression is not valid.</remarks>
+ */
+Predicate Predicate::parse(const std::string& expression) {
+	if(boost::algorithm::trim_copy(expression).empty()) {
+		return Predicate();
+	}
+	return PredicateParser(expression).parse();
+}
+
+/** <summary>Returns true if this Predicate has no condition, and matches every record</summary> */
+bool Predicate::matchesAll(void) const {
+	return my_root.get() == NULL;
+}
+
+/** <summary>Returns the Predicate as text that parse() reads back</summary> */
+std::string Predicate::toString(void) const {
+	if(matchesAll()) {
+		return "";
+	}
+	return nodeToString(*my_root);
+}
+
+std::string Predicate::nodeToString(const Node& node) {
+	std::ostringstream out;
+	switch(node.op) {
+		case AND:
+		case OR:
+			out << "(" << nodeToString(*node.left) << " " << operatorToString(node.op) << " "
+				<< nodeToString(*node.right) << ")";
+			break;
+		case NOT:
+			out << "!(" << nodeToString(*node.left) << ")";
+			break;
+		case IS_NAN:
+			out << "isnan(" << node.field << ")";
+			break;
+		case NOT_NAN:
+			out << "!isnan(" << node.field << ")";
+			break;
+		default:
+			out << node.field << " " << operatorToString(node.op) << " ";
+			if(node.is_text) {
+				out << (node.text.find('\'') == std::string::npos ? '\'' : '"') << node.text
+					<< (node.text.find('\'') == std::string::npos ? '\'' : '"');
+			} else {
+				out << std::setprecision(17) << node.number;
+			}
+			break;
+	}
+	return out.str();
+}
+
+/* ====================================================================
+ * class CompiledPredicate - a Predicate bound to a Structure
+ * ====================================================================
+ */
+
+/** <summary>Binds <c>_predicate</c> to the fields of <c>_structure</c></summary>
+ * <remarks>Throws a PredicateException if a field is not in the Structure, if a numeric comparison
+ * or NaN check is on a field that is not a number, or if a string comparison is on a field that is
+ * not a String, Char or Symbol.</remarks>
+ */
+CompiledPredicate::CompiledPredicate(const tsdb::Predicate& _predicate,
+	const boost::shared_ptr<tsdb::Structure>& _structure): my_structure(_structure), my_depth(0) {
+	if(!_predicate.matchesAll()) {
+		compile(*_predicate.my_root, 1);
+	}
+}
+
+int CompiledPredicate::compile(const tsdb::Predicate::Node& node, size_t depth) {
+	my_depth = std::max(my_depth, depth);
+	int istep = (int) my_steps.size();
+	my_steps.push_back(Step());
+	Step step;
+	step.op = node.op;
+	step.ifield = 0;
+	step.offset = 0;
+	step.size = 0;
+	step.type = tsdb::Field::UNDEFINED;
+	step.number = node.number;
+	step.text = node.text;
+	step.is_text = node.is_text;
+	step.left = -1;
+	step.right = -1;
+
+	if(node.op == tsdb::Predicate::AND || node.op == tsdb::Predicate::OR || node.op == tsdb::Predicate::NOT) {
+		step.left = compile(*node.left, depth + 1);
+		if(node.right.get() != NULL) {
+			step.right = compile(*node.right, depth + 1);
+		}
+	} else {
+		size_t nfields = my_structure->getNFields();
+		for(step.ifield = 0; step.ifield < nfields; step.ifield++) {
+			if(my_structure->getField(step.ifield)->getName() == node.field) {
+				break;
+			}
+		}
+		if(step.ifield == nfields) {
+			throw( PredicateException("there is no field '" + node.field + "'") );
+		}
+		step.offset = my_structure->getOffsetOfField(step.ifield);
+		step.size = my_structure->getSizeOfField(step.ifield);
+		step.type = my_structure->getField(step.ifield)->getFieldType();
+
+		if(node.is_text) {
+			if(step.type != tsdb::Field::STRING && step.type != tsdb::Field::CHAR && step.type != tsdb::Field::SYMBOL) {
+				throw( PredicateException("field '" + node.field + "' is not a string") );
+			}
+			if(step.type == tsdb::Field::CHAR && step.text.size() != 1) {
+				throw( PredicateException("field '" + node.field + "' is a Char, and '" + step.text +
+					"' is not one character") );
+			}
+		} else if(!isNumericType(step.type)) {
+			throw( PredicateException("field '" + node.field + "' is not a number") );
+		}
+	}
+
+	my_steps[istep] = step;
+	return istep;
+}
+
+/** <summary>Returns true if every record matches, without evaluating anything</summary> */
+bool CompiledPredicate::matchesAll(void) const {
+	return my_steps.empty();
+}
+
+/** <summary>Appends the index of each of <c>nrecords</c> records at <c>records</c> that matches to
+ * <c>selection</c>, and returns how many matched</summary>
+ * <remarks>The records are laid out as in the Structure the Predicate was compiled for.</remarks>
+ */
+size_t CompiledPredicate::select(const char* records, size_t nrecords, std::vector<size_t>& selection) const {
+	if(matchesAll()) {
+		for(size_t i = 0; i < nrecords; i++) {
+			selection.push_back(i);
+		}
+		return nrecords;
+	}
+
+	std::vector<unsigned char> masks(my_depth * BLOCK_SIZE);
+	std::vector<tsdb::ieee64_t> values(BLOCK_SIZE);
+	size_t record_size = my_structure->getSizeOf();
+	size_t nselected = 0;
+
+	for(size_t first = 0; first < nrecords; first += BLOCK_SIZE) {
+		size_t n = std::min(BLOCK_SIZE, nrecords - first);
+		evaluate(0, records + first * record_size, n, &masks[0], &values[0]);
+		for(size_t i = 0; i < n; i++) {
+			if(masks[i]) {
+				selection.push_back(first + i);
+				nselected++;
+			}
+		}
+	}
+	return nselected;
+}
+
+/* Evaluates step istep for n records into masks[0..n). The masks after the first BLOCK_SIZE are
+ * scratch for the steps below it. */
+void CompiledPredicate::evaluate(int istep, const char* records, size_t n, unsigned char* masks,
+	tsdb::ieee64_t* values) const {
+	const Step& step = my_steps[istep];
+
+	switch(step.op) {
+		case tsdb::Predicate::AND:
+		case tsdb::Predicate::OR: {
+			evaluate(step.left, records, n, masks, values);
+			bool any = false;
+			bool all = true;
+			for(size_t i = 0; i < n; i++) {
+				any = any || masks[i];
+				all = all && masks[i];
+			}
+			if((step.op == tsdb::Predicate::AND && !any) || (step.op == tsdb::Predicate::OR && all)) {
+				return;  // the right side can't change the result
+			}
+			unsigned char* right = masks + BLOCK_SIZE;
+			evaluate(step.right, records, n, right, values);
+			if(step.op == tsdb::Predicate::AND) {
+				for(size_t i = 0; i < n; i++) {
+					masks[i] &= right[i];
+				}
+			} else {
+				for(size_t i = 0; i < n; i++) {
+					masks[i] |= right[i];
+				}
+			}
+			return;
+		}
+		case tsdb::Predicate::NOT:
+			evaluate(step.left, records, n, masks, values);
+			for(size_t i = 0; i < n; i++) {
+				masks[i] ^= 1;
+			}
+			return;
+		default:
+			break;
+	}
+
+	if(step.is_text && step.type == tsdb::Field::SYMBOL) {
+		compareSymbol(step, records, n, masks);
+		return;
+	}
+	if(step.is_text) {
+		compareText(step, records, n, masks);
+		return;
+	}
+
+	tsdb::ColumnKernels::toDoubles(tsdb::StridedColumn(records + step.offset, my_structure->getSizeOf(), n,
+		step.type), values);
+	switch(step.op) {
+		case tsdb::Predicate::LT: compareValues(values, n, step.number, masks, Less()); break;
+		case tsdb::Predicate::LE: compareValues(values, n, step.number, masks, LessEqual()); break;
+		case tsdb::Predicate::GT: compareValues(values, n, step.number, masks, Greater()); break;
+		case tsdb::Predicate::GE: compareValues(values, n, step.number, masks, GreaterEqual()); break;
+		case tsdb::Predicate::EQ: compareValues(values, n, step.number, masks, Equal()); break;
+		case tsdb::Predicate::NE: compareValues(values, n, step.number, masks, NotEqual()); break;
+		case tsdb::Predicate::IS_NAN:
+			for(size_t i = 0; i < n; i++) {
+				masks[i] = (unsigned char) (values[i] != values[i]);
+			}
+			break;
+		case tsdb::Predicate::NOT_NAN:
+			for(size_t i = 0; i < n; i++) {
+				masks[i] = (unsigned char) (values[i] == values[i]);
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+/* Compares a String or Char field, which is padded with '\0' and may fill its whole size, with the text
+ * of the step */
+void CompiledPredicate::compareText(const Step& step, const char* records, size_t n, unsigned char* mask) const {
+	size_t record_size = my_structure->getSizeOf();
+	size_t length = step.text.size();
+	const char* text = step.text.data();
+	unsigned char equal_value = (step.op == tsdb::Predicate::EQ) ? 1 : 0;
+
+	for(size_t i = 0; i < n; i++) {
+		const char* value = records + i * record_size + step.offset;
+		bool equal = length <= step.size && memcmp(value, text, length) == 0 &&
+			(length == step.size || value[length] == '\0');
+		mask[i] = equal ? equal_value : (unsigned char) (1 - equal_value);
+	}
+}
+
+/* Compares a Symbol field with the text of the step by its code. The text is looked up in the dictionary
+ * for each block, as a symbol that was not there when the Predicate was compiled may be added since. */
+void CompiledPredicate::compareSymbol(const Step& step, const char* records, size_t n, unsigned char* mask) const {
+	size_t record_size = my_structure->getSizeOf();
+	unsigned char equal_value = (step.op == tsdb::Predicate::EQ) ? 1 : 0;
+
+	tsdb::symbol_t code;
+	tsdb::SymbolField* field = (tsdb::SymbolField*) my_structure->getField(step.ifield);
+	if(!field->symbols()->find(step.text.data(), step.text.size(), &code)) {
+		memset(mask, 1 - equal_value, n);
+		return;
+	}
+
+	for(size_t i = 0; i < n; i++) {
+		tsdb::symbol_t value;
+		memcpy(&value, records + i * record_size + step.offset, sizeof(value));
+		mask[i] = (value == code) ? equal_value : (unsigned char) (1 - equal_value);
+	}
+}
+
+/** <summary>Returns false if no record of block <c>block</c> of <c>zones</c> can match</summary>
+ * <remarks>Comparisons of a numeric field are checked against the minimum and maximum of the block,
+ * and NaN checks against its counts. Comparisons of the timestamp use the first and last timestamps of
+ * the block. Anything else may match.</remarks>
+ */
+bool CompiledPredicate::mayMatch(const tsdb::ZoneMap& zones, size_t block) const {
+	if(matchesAll()) {
+		return true;
+	}
+	return stepMayMatch(0, zones, block);
+}
+
+bool CompiledPredicate::stepMayMatch(int istep, const tsdb::ZoneMap& zones, size_t block) const {
+	const Step& step = my_steps[istep];
+
+	switch(step.op) {
+		case tsdb::Predicate::AND:
+			return stepMayMatch(step.left, zones, block) && stepMayMatch(step.right, zones, block);
+		case tsdb::Predicate::OR:
+			return stepMayMatch(step.left, zones, block) || stepMayMatch(step.right, zones, block);
+		case tsdb::Predicate::NOT:
+			return true;
+		default:
+			break;
+	}
+	if(step.is_text) {
+		return true;
+	}
+
+	tsdb::ieee64_t min;
+	tsdb::ieee64_t max;
+	hsize_t count;
+	hsize_t nans;
+	if(step.ifield == 0) {
+		min = (tsdb::ieee64_t) zones.firstTimestamp(block);
+		max = (tsdb::ieee64_t) zones.lastTimestamp(block);
+		count = zones.nrecords(block);
+		nans = 0;
+	} else if(zones.hasField(step.ifield)) {
+		const tsdb::ZoneStats& stats = zones.stats(block, step.ifield);
+		min = stats.min;
+		max = stats.max;
+		count = stats.count;
+		nans = stats.nans;
+	} else {
+		return true;
+	}
+
+	tsdb::ieee64_t v = step.number;
+	switch(step.op) {
+		case tsdb::Predicate::LT: return count > 0 && min < v;
+		case tsdb::Predicate::LE: return count > 0 && min <= v;
+		case tsdb::Predicate::GT: return count > 0 && max > v;
+		case tsdb::Predicate::GE: return count > 0 && max >= v;
+		case tsdb::Predicate::EQ: return count > 0 && min <= v && v <= max;
+		case tsdb::Predicate::NE: return count > 0 && !(min == v && max == v);
+		case tsdb::Predicate::IS_NAN: return nans > 0;
+		case tsdb::Predicate::NOT_NAN: return count > 0;
+		default: return true;
+	}
+}
+
+} // namespace tsdb
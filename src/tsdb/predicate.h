@@ -0,0 +1,156 @@
+#pragma once
+
+/* STL Classes */
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+/* External Libraries */
+#include <boost/shared_ptr.hpp>
+
+/* TSDB Includes */
+#include "tsdb.h"
+#include "field.h"
+#include "structure.h"
+
+namespace tsdb {
+
+class ZoneMap;
+
+/* -----------------------------------------------------------------
+ * PredicateException. For runtime errors thrown by Predicate and
+ * CompiledPredicate.
+ * -----------------------------------------------------------------
+ */
+class  PredicateException:
+	public std::runtime_error
+{
+public:
+	PredicateException(const std::string& what):
+	  std::runtime_error(std::string("PredicateException: ") + what) {}
+};
+
+/* -----------------------------------------------------------------
+ * Predicate. A condition on the fields of a record.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>A condition on the fields of a record, such as <c>side == 1 &amp;&amp; amount &gt; 100</c></summary>
+ * <remarks><p>A Predicate is a tree of comparisons of a field with a constant, NaN checks, and AND, OR
+ * and NOT. It names its fields, and does not know the Structure it will be used on; CompiledPredicate
+ * binds it to one. The default Predicate has no condition, and matches every record.</p>
+ * <p>Numeric fields (Double, Int32, Int8, Timestamp and Date) are compared as doubles. A NaN in a Double
+ * field is a missing value, as in the ColumnKernels: every comparison with it is false, NE included, so
+ * <c>price != 0</c> does not match missing prices. Use isNaN() and notNaN() to test for them. String,
+ * Char and Symbol fields can be compared for EQ and NE with a string; a Symbol field compares the code of
+ * the string in its dictionary with the codes in the records.</p>
+ * <p>parse() reads the same conditions from text, which is how the language bindings pass them. It
+ * accepts <c>==</c> (or <c>=</c>), <c>!=</c> (or <c>&lt;&gt;</c>), <c>&lt;</c>, <c>&lt;=</c>, <c>&gt;</c>
+ * and <c>&gt;=</c> between a field and a number or a quoted string, <c>isnan(field)</c> (or R's
+ * <c>is.nan</c> and <c>is.na</c>), <c>&amp;&amp;</c>, <c>||</c> and <c>!</c> (or R's <c>&amp;</c> and
+ * <c>|</c>, or <c>and</c>, <c>or</c> and <c>not</c>), and parentheses.</p></remarks>
+ */
+class Predicate
+{
+public:
+	enum Operator {
+		LT,
+		LE,
+		GT,
+		GE,
+		EQ,
+		NE,
+		IS_NAN,
+		NOT_NAN,
+		AND,
+		OR,
+		NOT
+	};
+
+	Predicate(void);
+
+	static Predicate compare(const std::string& field, Operator op, tsdb::ieee64_t value);
+	static Predicate compare(const std::string& field, Operator op, const std::string& value);
+	static Predicate isNaN(const std::string& field);
+	static Predicate notNaN(const std::string& field);
+	static Predicate both(const Predicate& a, const Predicate& b);
+	static Predicate either(const Predicate& a, const Predicate& b);
+	static Predicate negate(const Predicate& a);
+	static Predicate parse(const std::string& expression);
+
+	bool matchesAll(void) const;
+	std::string toString(void) const;
+
+private:
+	friend class CompiledPredicate;
+
+	/* A node of the tree. Nodes are never changed once made, so Predicates share them. */
+	struct Node {
+		Operator op;
+		std::string field;         // comparisons and NaN checks
+		tsdb::ieee64_t number;     // ... the constant of a numeric comparison
+		std::string text;          // ... or of a string comparison
+		bool is_text;
+		boost::shared_ptr<const Node> left;   // AND, OR and NOT
+		boost::shared_ptr<const Node> right;  // AND and OR
+	};
+
+	Predicate(const boost::shared_ptr<const Node>& _root);
+	static std::string nodeToString(const Node& node);
+
+	boost::shared_ptr<const Node> my_root;  // NULL matches every record
+};
+
+/* -----------------------------------------------------------------
+ * CompiledPredicate. A Predicate bound to a Structure.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>A Predicate bound to the fields of a Structure, to select records a block at a time</summary>
+ * <remarks><p>The constructor looks up the fields of the Predicate, and throws a PredicateException if a
+ * field is missing or can't be compared with its constant.</p>
+ * <p>select() evaluates the Predicate over a block of records a column at a time: each comparison
+ * converts its field for a few hundred records into doubles, as the ColumnKernels do, and compares them
+ * in one tight loop into a mask, and AND, OR and NOT combine the masks. The right side of an AND is not
+ * evaluated for records that the left side rules out.</p>
+ * <p>mayMatch() tells from the ZoneMap of a Timeseries whether a block between two index points can
+ * have any matching record, so that Timeseries::scan() does not read the blocks that can't.</p>
+ * <p>A CompiledPredicate is not changed by select(), so several threads can use one.</p></remarks>
+ */
+class CompiledPredicate
+{
+public:
+	CompiledPredicate(const tsdb::Predicate& _predicate, const boost::shared_ptr<tsdb::Structure>& _structure);
+
+	size_t select(const char* records, size_t nrecords, std::vector<size_t>& selection) const;
+	bool mayMatch(const tsdb::ZoneMap& zones, size_t block) const;
+	bool matchesAll(void) const;
+
+private:
+	/* A node of the Predicate, with its field looked up */
+	struct Step {
+		tsdb::Predicate::Operator op;
+		size_t ifield;
+		size_t offset;
+		size_t size;
+		tsdb::Field::FieldType type;
+		tsdb::ieee64_t number;
+		std::string text;
+		bool is_text;
+		int left;     // index of a Step, or -1
+		int right;
+	};
+
+	int compile(const tsdb::Predicate::Node& node, size_t depth);
+	void evaluate(int istep, const char* records, size_t nrecords, unsigned char* masks,
+		tsdb::ieee64_t* values) const;
+	void compareText(const Step& step, const char* records, size_t nrecords, unsigned char* mask) const;
+	void compareSymbol(const Step& step, const char* records, size_t nrecords, unsigned char* mask) const;
+	bool stepMayMatch(int istep, const tsdb::ZoneMap& zones, size_t block) const;
+
+	boost::shared_ptr<tsdb::Structure> my_structure;
+	std::vector<Step> my_steps;  // the root is step 0
+	size_t my_depth;             // levels of the tree, which is the number of masks evaluate() needs
+};
+
+} // namespace tsdb
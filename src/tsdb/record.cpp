@@ -33,6 +33,9 @@ tsdb::Cell Record::operator[](size_t i) {
 	tsdb::MemoryBlockPtr cellmemblkptr = tsdb::MemoryBlockPtr(
 		my_memory_block_ptr,
 		my_structure->getOffsetOfField(i));
+	if(my_structure->getField(i)->getFieldType() == tsdb::Field::SYMBOL) {
+		return tsdb::Cell(cellmemblkptr,((tsdb::SymbolField*) my_structure->getField(i))->symbols());
+	}
 	return tsdb::Cell(cellmemblkptr,my_structure->getField(i)->getFieldType(),my_structure->getField(i)->getSizeOf());
 }
 
@@ -0,0 +1,199 @@
+/* STL Includes */
+#include <stdexcept>
+#include <boost/make_shared.hpp>
+
+/* TSDB Includes */
+#include "recordcursor.h"
+#include "cell.h"
+#include "memoryblock.h"
+#include "memoryblockptr.h"
+
+namespace tsdb {
+
+/* ====================================================================
+ * class RecordView - a record in a RecordCursor's buffer
+ * ====================================================================
+ */
+
+/** <summary>Returns field <c>ifield</c> as a double</summary>
+ * <remarks>Throws a type_conversion_error if the field is not a number, as Cell::toDouble() does.</remarks>
+ */
+tsdb::ieee64_t RecordView::toDouble(size_t ifield) const {
+	switch(my_types[ifield]) {
+		case tsdb::Field::DOUBLE:
+			return get<tsdb::ieee64_t>(ifield);
+		case tsdb::Field::INT32:
+			return (tsdb::ieee64_t) get<tsdb::int32_t>(ifield);
+		case tsdb::Field::INT8:
+			return (tsdb::ieee64_t) get<tsdb::int8_t>(ifield);
+		case tsdb::Field::TIMESTAMP:
+			return (tsdb::ieee64_t) get<tsdb::timestamp_t>(ifield);
+		case tsdb::Field::DATE:
+			return (tsdb::ieee64_t) get<tsdb::date_t>(ifield);
+		default:
+			throw tsdb::type_conversion_error("cannot convert type to double");
+	}
+}
+
+/** <summary>Returns field <c>ifield</c> as a 32 bit integer</summary>
+ * <remarks>Throws a type_conversion_error if the field is not an integer, as Cell::toInt32() does.</remarks>
+ */
+tsdb::int32_t RecordView::toInt32(size_t ifield) const {
+	switch(my_types[ifield]) {
+		case tsdb::Field::INT32:
+			return get<tsdb::int32_t>(ifield);
+		case tsdb::Field::INT8:
+			return (tsdb::int32_t) get<tsdb::int8_t>(ifield);
+		case tsdb::Field::DATE:
+			return (tsdb::int32_t) get<tsdb::date_t>(ifield);
+		case tsdb::Field::SYMBOL:
+			return (tsdb::int32_t) get<tsdb::symbol_t>(ifield);
+		default:
+			throw tsdb::type_conversion_error("cannot convert type to int32");
+	}
+}
+
+/** <summary>Returns field <c>ifield</c> as a timestamp</summary>
+ * <remarks>Throws a type_conversion_error if the field is not a timestamp.</remarks>
+ */
+tsdb::timestamp_t RecordView::toTimestamp(size_t ifield) const {
+	if(my_types[ifield] != tsdb::Field::TIMESTAMP) {
+		throw tsdb::type_conversion_error("cannot convert type to timestamp");
+	}
+	return get<tsdb::timestamp_t>(ifield);
+}
+
+/** <summary>Copies the record into a free Record, which stays valid after the cursor moves on</summary>
+ * <param name="_structure">Structure of the record, from RecordCursor::structure()</param>
+ */
+tsdb::Record RecordView::toRecord(const boost::shared_ptr<tsdb::Structure>& _structure) const {
+	size_t size = _structure->getSizeOf();
+	boost::shared_ptr<tsdb::MemoryBlock> memblk = boost::make_shared<tsdb::MemoryBlock>(size);
+	tsdb::MemoryBlockPtr memblkptr(memblk, 0);
+	memblkptr.memCpy((void*) my_data, size);
+	return tsdb::Record(memblkptr, _structure);
+}
+
+/* ====================================================================
+ * class RecordCursor - iterates over a BufferedRecordSet
+ * ====================================================================
+ */
+
+/** <summary>Creates a cursor over no records</summary> */
+RecordCursor::RecordCursor(void) {
+	my_offsets = NULL;
+	my_forward = true;
+	my_size = 0;
+	reset();
+}
+
+/** <summary>Creates a cursor over a BufferedRecordSet</summary>
+ * <param name="_set">The records to iterate over. The cursor reads them through its own copy of the
+ * set, so it does not disturb the buffer of <c>_set</c>.</param>
+ * <param name="_forward">True to start at the first record and go forward, false to start at the last
+ * record and go backward</param>
+ */
+RecordCursor::RecordCursor(const tsdb::BufferedRecordSet& _set, bool _forward): my_set(_set) {
+	my_offsets = NULL;
+	my_forward = _forward;
+	my_size = my_set.size();
+	my_set.set_my_buffer_direction(_forward);
+
+	if(my_size > 0) {
+		my_structure = my_set.structure();
+		my_offsets = my_structure->getOffsetOfFieldsAsArray();
+		for(size_t i = 0; i < my_structure->getNFields(); i++) {
+			my_types.push_back(my_structure->getField(i)->getFieldType());
+		}
+	}
+	reset();
+}
+
+/** <summary>Moves to the next record. Returns false, and stays put, when there are no more records.</summary>
+ * <remarks>The first call moves to the first record (the last record of the set, for a backward cursor).</remarks>
+ */
+bool RecordCursor::next(void) {
+	hsize_t i;
+
+	if(!my_started) {
+		if(my_size == 0) {
+			return false;
+		}
+		i = my_forward ? 0 : my_size - 1;
+	} else if(my_forward) {
+		if(my_position + 1 >= my_size) {
+			return false;
+		}
+		i = my_position + 1;
+	} else {
+		if(my_position == 0) {
+			return false;
+		}
+		i = my_position - 1;
+	}
+
+	if(my_buffer == NULL || i < my_buf_first || i >= my_buf_first + my_nbufrecords) {
+		loadBuffer(i);
+	}
+
+	my_current = my_buffer + (i - my_buf_first) * my_record_size;
+	my_position = i;
+	my_started = true;
+	return true;
+}
+
+/** <summary>Moves back to before the first record</summary> */
+void RecordCursor::reset(void) {
+	my_position = 0;
+	my_started = false;
+	my_buf_first = 0;
+	my_nbufrecords = 0;
+	my_buffer = NULL;
+	my_current = NULL;
+	my_record_size = 0;
+}
+
+/** <summary>Makes record <c>i</c> (an index in the set) the current record</summary>
+ * <remarks>Throws std::out_of_range if there is no record <c>i</c>. The next call to next() moves on
+ * from record <c>i</c>.</remarks>
+ */
+void RecordCursor::seek(hsize_t i) {
+	if(i >= my_size) {
+		throw std::out_of_range("RecordCursor::seek: index out of bounds");
+	}
+
+	if(my_buffer == NULL || i < my_buf_first || i >= my_buf_first + my_nbufrecords) {
+		loadBuffer(i);
+	}
+
+	my_current = my_buffer + (i - my_buf_first) * my_record_size;
+	my_position = i;
+	my_started = true;
+}
+
+/** <summary>Returns the index (in the set) of the current record</summary> */
+hsize_t RecordCursor::position(void) const {
+	return my_position;
+}
+
+/** <summary>Returns the number of records the cursor iterates over</summary> */
+hsize_t RecordCursor::size(void) const {
+	return my_size;
+}
+
+/** <summary>Returns true if the cursor goes forward</summary> */
+bool RecordCursor::forward(void) const {
+	return my_forward;
+}
+
+/** <summary>Returns the Structure of the records, or an empty pointer if there are none</summary> */
+const boost::shared_ptr<tsdb::Structure>& RecordCursor::structure(void) const {
+	return my_structure;
+}
+
+void RecordCursor::loadBuffer(hsize_t i) {
+	my_buffer = my_set.buffer(i, &my_buf_first, &my_nbufrecords);
+	my_record_size = my_structure->getSizeOf();
+}
+
+} // namespace tsdb
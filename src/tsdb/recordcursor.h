@@ -0,0 +1,125 @@
+#pragma once
+
+/* STL Classes */
+#include <vector>
+#include <string.h>
+
+/* External Libraries */
+#include "hdf5.h"
+#include <boost/shared_ptr.hpp>
+
+/* TSDB Includes */
+#include "tsdb.h"
+#include "field.h"
+#include "structure.h"
+#include "record.h"
+#include "bufferedrecordset.h"
+
+namespace tsdb {
+
+/* -----------------------------------------------------------------
+ * RecordView. A record that points into a buffer it does not own.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>A lightweight view of one record in a RecordCursor's buffer</summary>
+ * <remarks><p>A RecordView is a pointer to the record and to the field layout of the cursor. Making one
+ * does not allocate or copy anything, and it is only valid until the cursor that returned it advances.
+ * Use toRecord() to keep a copy of the record.</p>
+ * <p><c>get&lt;T&gt;()</c> reads a field as the C type <c>T</c>, which must be the type the field is
+ * stored as (for example <c>tsdb::ieee64_t</c> for a DOUBLE field). It is not checked. The
+ * <c>toXxx()</c> methods check the field type, and convert in the same way as the Cell class.</p></remarks>
+ */
+class RecordView
+{
+public:
+	RecordView(void): my_data(NULL), my_offsets(NULL), my_types(NULL) {}
+	RecordView(const char* _data, const size_t* _offsets, const tsdb::Field::FieldType* _types):
+		my_data(_data), my_offsets(_offsets), my_types(_types) {}
+
+	/** <summary>Returns a pointer to the start of the record</summary> */
+	const char* raw(void) const { return my_data; }
+
+	/** <summary>Returns a pointer to field <c>ifield</c> of the record</summary> */
+	const char* pointerToMember(size_t ifield) const { return my_data + my_offsets[ifield]; }
+
+	/** <summary>Returns the type of field <c>ifield</c></summary> */
+	tsdb::Field::FieldType fieldType(size_t ifield) const { return my_types[ifield]; }
+
+	/** <summary>Reads field <c>ifield</c> as a <c>T</c>, without checking the field type</summary> */
+	template <class T>
+	T get(size_t ifield) const {
+		T value;
+		memcpy(&value, my_data + my_offsets[ifield], sizeof(T));
+		return value;
+	}
+
+	/** <summary>Returns the timestamp of the record, which is always the first field</summary> */
+	tsdb::timestamp_t timestamp(void) const { return get<tsdb::timestamp_t>(0); }
+
+	tsdb::ieee64_t toDouble(size_t ifield) const;
+	tsdb::int32_t toInt32(size_t ifield) const;
+	tsdb::timestamp_t toTimestamp(size_t ifield) const;
+
+	tsdb::Record toRecord(const boost::shared_ptr<tsdb::Structure>& _structure) const;
+
+private:
+	const char* my_data;
+	const size_t* my_offsets;
+	const tsdb::Field::FieldType* my_types;
+};
+
+/* -----------------------------------------------------------------
+ * RecordCursor. Iterates over a BufferedRecordSet.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>Walks through a BufferedRecordSet, forward or backward, one RecordView at a time</summary>
+ * <remarks><p>The cursor reads the records in blocks, like the BufferedRecordSet, and returns views
+ * into the current block, so stepping from one record to the next costs a pointer increment. This
+ * is much cheaper than <c>BufferedRecordSet::record()</c>, which allocates and copies every record.</p>
+ * <p>A new cursor is positioned before its first record, so the usual loop is
+ * <c>while(cursor.next()) { ... cursor.record() ... }</c>. A backward cursor starts at the last record of
+ * the set, and reads its blocks backward.</p>
+ * <p>The cursor keeps a pointer to the Table of the set, so the Timeseries it came from must stay open
+ * while it is used.</p></remarks>
+ */
+class RecordCursor
+{
+public:
+	RecordCursor(void);
+	RecordCursor(const tsdb::BufferedRecordSet& _set, bool _forward = true);
+
+	bool next(void);
+	void reset(void);
+	void seek(hsize_t i);
+
+	/** <summary>Returns the current record. Only valid after next() or seek().</summary> */
+	tsdb::RecordView record(void) const {
+		return tsdb::RecordView(my_current, my_offsets, my_types.empty() ? NULL : &my_types[0]);
+	}
+
+	hsize_t position(void) const;
+	hsize_t size(void) const;
+	bool forward(void) const;
+	const boost::shared_ptr<tsdb::Structure>& structure(void) const;
+
+private:
+	void loadBuffer(hsize_t i);
+
+	tsdb::BufferedRecordSet my_set;
+	boost::shared_ptr<tsdb::Structure> my_structure;
+	const size_t* my_offsets;	// owned by my_structure
+	std::vector<tsdb::Field::FieldType> my_types;
+	bool my_forward;
+	hsize_t my_size;
+	hsize_t my_position;		// index (in the set) of the current record
+	bool my_started;			// false before the first call to next()
+	hsize_t my_buf_first;		// index (in the set) of the first record in the buffer
+	size_t my_nbufrecords;
+	const char* my_buffer;
+	const char* my_current;		// the current record, in my_buffer
+	size_t my_record_size;
+};
+
+} // namespace tsdb
@@ -0,0 +1,468 @@
+/* STL includes */
+#include <string>
+#include <vector>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+/* TSDB includes */
+#include "recordformatter.h"
+#include "symboltable.h"
+
+using namespace std;
+
+namespace tsdb {
+
+namespace {
+
+const char DIGIT_PAIRS[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+const double POWERS_OF_TEN[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8 };
+const int MAX_FAST_DECIMALS = 8;
+
+/* Below this, a value times 10^MAX_FAST_DECIMALS is an exact integer in a double (2^53) */
+const double MAX_FAST_DOUBLE = 9.0e7;
+
+const long long MS_PER_DAY = 86400000LL;
+
+/** <summary>Writes the two digits of <c>value</c> (0 to 99) at <c>out</c></summary> */
+inline char* twoDigits(char* out, unsigned value) {
+	out[0] = DIGIT_PAIRS[2 * value];
+	out[1] = DIGIT_PAIRS[2 * value + 1];
+	return out + 2;
+}
+
+/** <summary>Writes <c>value</c> with exactly <c>ndigits</c> digits, zero padded</summary> */
+inline char* fixedDigits(char* out, unsigned long long value, int ndigits) {
+	for(int i = ndigits - 1; i >= 0; i--) {
+		out[i] = (char) ('0' + value % 10);
+		value /= 10;
+	}
+	return out + ndigits;
+}
+
+/** <summary>Converts days since 1970-01-01 to a year, month and day of the proleptic Gregorian calendar</summary>
+ * <remarks>This is the civil_from_days() algorithm of Howard Hinnant, which works on 400 year eras.</remarks>
+ */
+void civilFromDays(long long days, long long* year, unsigned* month, unsigned* day) {
+	days += 719468;
+	long long era = (days >= 0 ? days : days - 146096) / 146097;
+	unsigned doe = (unsigned) (days - era * 146097);
+	unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	unsigned mp = (5 * doy + 2) / 153;
+	*day = doy - (153 * mp + 2) / 5 + 1;
+	*month = mp < 10 ? mp + 3 : mp - 9;
+	*year = (long long) yoe + era * 400 + (*month <= 2 ? 1 : 0);
+}
+
+/** <summary>Writes the date <c>days</c> after 1970-01-01 as YYYY-MM-DD</summary> */
+char* isoDate(char* out, long long days) {
+	long long year;
+	unsigned month, day;
+	civilFromDays(days, &year, &month, &day);
+
+	if(year >= 0 && year <= 9999) {
+		out = twoDigits(out, (unsigned) (year / 100));
+		out = twoDigits(out, (unsigned) (year % 100));
+	} else {
+		out = RecordFormatter::formatInt(out, year);
+	}
+	*out++ = '-';
+	out = twoDigits(out, month);
+	*out++ = '-';
+	return twoDigits(out, day);
+}
+
+/** <summary>Splits <c>timestamp</c> into whole days since the epoch and milliseconds into the day</summary> */
+inline void splitTimestamp(tsdb::timestamp_t timestamp, long long* days, long long* ms) {
+	*days = timestamp / MS_PER_DAY;
+	*ms = timestamp % MS_PER_DAY;
+	if(*ms < 0) {
+		*ms += MS_PER_DAY;
+		(*days)--;
+	}
+}
+
+/** <summary>Writes the time of day <c>ms</c> as Thh:mm:ss.fff</summary> */
+inline char* isoTime(char* out, long long ms) {
+	unsigned seconds = (unsigned) (ms / 1000);
+	*out++ = 'T';
+	out = twoDigits(out, seconds / 3600);
+	*out++ = ':';
+	out = twoDigits(out, (seconds / 60) % 60);
+	*out++ = ':';
+	out = twoDigits(out, seconds % 60);
+	*out++ = '.';
+	return fixedDigits(out, (unsigned long long) (ms % 1000), 3);
+}
+
+} // namespace
+
+/* ====================================================================
+ * class RecordFormatter - records to delimited text
+ * ====================================================================
+ */
+
+/** <summary>Creates a formatter of records laid out as <c>_structure</c>, writing to <c>_out</c></summary>
+ * <remarks>The delimiters are "," and "\n", timestamps are ISO 8601 and record ids are not written,
+ * until they are set otherwise.</remarks>
+ * <param name="_out">An open FILE, which the formatter does not close</param>
+ * <param name="_buffer_bytes">Size of the output buffer. It grows if one record does not fit.</param>
+ */
+RecordFormatter::RecordFormatter(const boost::shared_ptr<tsdb::Structure>& _structure, FILE* _out,
+	size_t _buffer_bytes): my_structure(_structure), my_out(_out), my_buffer(_buffer_bytes > 0 ? _buffer_bytes : 1),
+	my_used(0), my_bytes_written(0), my_timestamp_format(ISO), my_record_ids(false), my_cached_day(0),
+	my_cached_valid(false) {
+
+	for(size_t i = 0; i < my_structure->getNFields(); i++) {
+		my_types.push_back(my_structure->getField(i)->getFieldType());
+	}
+	my_symbols.resize(my_types.size());
+	setDelimiters(",", "\n");
+}
+
+/** <summary>Writes what is left in the buffer</summary> */
+RecordFormatter::~RecordFormatter(void) {
+	try {
+		flush();
+	} catch(...) {
+	}
+}
+
+/** <summary>Sets the text written between two fields, and after each record</summary> */
+void RecordFormatter::setDelimiters(const std::string& _field_delim, const std::string& _record_delim) {
+	my_field_delim = _field_delim;
+	my_record_delim = _record_delim;
+
+	my_max_record_chars = MAX_VALUE_CHARS + my_record_delim.size();
+	for(size_t i = 0; i < my_types.size(); i++) {
+		my_max_record_chars += my_field_delim.size();
+		if(my_types[i] == tsdb::Field::STRING) {
+			my_max_record_chars += my_structure->getSizeOfField(i);
+		} else if(my_types[i] == tsdb::Field::SYMBOL) {
+			my_max_record_chars += ((tsdb::SymbolField*) my_structure->getField(i))->symbols()->maxLength();
+		} else {
+			my_max_record_chars += MAX_VALUE_CHARS;
+		}
+	}
+}
+
+/** <summary>Sets how the values of TIMESTAMP fields are written</summary> */
+void RecordFormatter::setTimestampFormat(TimestampFormat _format) {
+	my_timestamp_format = _format;
+}
+
+/** <summary>With <c>true</c>, the record id is written before the fields of each record</summary> */
+void RecordFormatter::setRecordIds(bool _record_ids) {
+	my_record_ids = _record_ids;
+}
+
+/** <summary>Writes a line with the names of the fields</summary>
+ * <remarks>The record id column, if there is one, is called "_TSDB_record".</remarks>
+ */
+void RecordFormatter::writeHeader(void) {
+	string header;
+	if(my_record_ids) {
+		header.append("_TSDB_record");
+	}
+	for(size_t i = 0; i < my_types.size(); i++) {
+		if(i > 0 || my_record_ids) {
+			header.append(my_field_delim);
+		}
+		header.append(my_structure->getNameOfFieldsAsArray()[i]);
+	}
+	header.append(my_record_delim);
+
+	char* p = reserve(header.size());
+	memcpy(p, header.data(), header.size());
+	my_used += header.size();
+}
+
+/** <summary>Writes <c>nrecords</c> records, laid out as the Structure, one after the other</summary>
+ * <param name="first_id">The record id of the first record, if record ids are written</param>
+ */
+void RecordFormatter::write(const char* records, size_t nrecords, hsize_t first_id) {
+	size_t record_size = my_structure->getSizeOf();
+	const size_t* offsets = my_structure->getOffsetOfFieldsAsArray();
+	const size_t* sizes = my_structure->getSizeOfFieldsAsArray();
+	size_t nfields = my_types.size();
+	const char* field_delim = my_field_delim.data();
+	size_t field_delim_size = my_field_delim.size();
+
+	for(size_t r = 0; r < nrecords; r++, records += record_size) {
+		char* p = reserve(my_max_record_chars);
+
+		if(my_record_ids) {
+			p = formatUnsigned(p, (unsigned long long) (first_id + r));
+		}
+
+		for(size_t i = 0; i < nfields; i++) {
+			if(i > 0 || my_record_ids) {
+				memcpy(p, field_delim, field_delim_size);
+				p += field_delim_size;
+			}
+
+			const char* value = records + offsets[i];
+			switch(my_types[i]) {
+				case tsdb::Field::TIMESTAMP: {
+					tsdb::timestamp_t v;
+					memcpy(&v, value, sizeof(v));
+					p = writeTimestamp(p, v);
+					break;
+				}
+				case tsdb::Field::DOUBLE: {
+					tsdb::ieee64_t v;
+					memcpy(&v, value, sizeof(v));
+					p = formatDouble(p, v);
+					break;
+				}
+				case tsdb::Field::INT32: {
+					tsdb::int32_t v;
+					memcpy(&v, value, sizeof(v));
+					p = formatInt(p, (long long) v);
+					break;
+				}
+				case tsdb::Field::INT8: {
+					p = formatInt(p, (long long) *((const tsdb::int8_t*) value));
+					break;
+				}
+				case tsdb::Field::CHAR: {
+					*p++ = *value;
+					break;
+				}
+				case tsdb::Field::RECORD: {
+					tsdb::record_t v;
+					memcpy(&v, value, sizeof(v));
+					p = formatUnsigned(p, (unsigned long long) v);
+					break;
+				}
+				case tsdb::Field::DATE: {
+					tsdb::date_t v;
+					memcpy(&v, value, sizeof(v));
+					p = formatDate(p, (long) v);
+					break;
+				}
+				case tsdb::Field::STRING: {
+					const char* end = (const char*) memchr(value, '\0', sizes[i]);
+					size_t length = end ? (size_t) (end - value) : sizes[i];
+					memcpy(p, value, length);
+					p += length;
+					break;
+				}
+				case tsdb::Field::SYMBOL: {
+					tsdb::symbol_t v;
+					memcpy(&v, value, sizeof(v));
+					const std::string& s = symbol(i, v);
+					memcpy(p, s.data(), s.size());
+					p += s.size();
+					break;
+				}
+				default:
+					break;
+			}
+		}
+
+		memcpy(p, my_record_delim.data(), my_record_delim.size());
+		p += my_record_delim.size();
+		my_used = p - &my_buffer[0];
+	}
+}
+
+/** <summary>Writes the buffer to the FILE, and flushes the FILE</summary>
+ * <remarks>Throws a RecordFormatterException if the output can not be written.</remarks>
+ */
+void RecordFormatter::flush(void) {
+	if(my_used > 0) {
+		size_t written = fwrite(&my_buffer[0], 1, my_used, my_out);
+		my_bytes_written += written;
+		bool failed = (written != my_used);
+		my_used = 0;
+		if(failed) {
+			throw( RecordFormatterException("could not write the output.") );
+		}
+	}
+	if(fflush(my_out) != 0) {
+		throw( RecordFormatterException("could not flush the output.") );
+	}
+}
+
+/** <summary>Returns the number of bytes written to the FILE so far</summary> */
+unsigned long long RecordFormatter::bytesWritten(void) const {
+	return my_bytes_written;
+}
+
+/** <summary>Returns a pointer to room for <c>nbytes</c> bytes at the end of the buffer</summary>
+ * <remarks>Writes the buffer out first if it does not have the room. The caller advances my_used.</remarks>
+ */
+char* RecordFormatter::reserve(size_t nbytes) {
+	if(my_used + nbytes > my_buffer.size()) {
+		if(my_used > 0) {
+			size_t written = fwrite(&my_buffer[0], 1, my_used, my_out);
+			my_bytes_written += written;
+			bool failed = (written != my_used);
+			my_used = 0;
+			if(failed) {
+				throw( RecordFormatterException("could not write the output.") );
+			}
+		}
+		if(nbytes > my_buffer.size()) {
+			my_buffer.resize(nbytes);
+		}
+	}
+	return &my_buffer[my_used];
+}
+
+/** <summary>Writes a timestamp in the format that was set, reusing the date of the previous one</summary> */
+char* RecordFormatter::writeTimestamp(char* out, tsdb::timestamp_t timestamp) {
+	if(my_timestamp_format == MILLISECONDS) {
+		return formatInt(out, timestamp);
+	}
+
+	long long days, ms;
+	splitTimestamp(timestamp, &days, &ms);
+	if(!my_cached_valid || days != my_cached_day) {
+		char date[MAX_VALUE_CHARS];
+		if(isoDate(date, days) - date != 10) {
+			// Years outside of 0 to 9999 are not cached
+			return isoTime(isoDate(out, days), ms);
+		}
+		memcpy(my_cached_date, date, 10);
+		my_cached_day = days;
+		my_cached_valid = true;
+	}
+	memcpy(out, my_cached_date, 10);
+	return isoTime(out + 10, ms);
+}
+
+/** <summary>Returns the symbol of <c>code</c> in a SYMBOL field, copying the dictionary again only for
+ * codes added since it was last copied</summary>
+ * <remarks>Throws a SymbolTableException for a code that is not in the dictionary.</remarks>
+ */
+const std::string& RecordFormatter::symbol(size_t field, tsdb::symbol_t code) {
+	std::vector<std::string>& symbols = my_symbols[field];
+	if(code < 0 || (size_t) code >= symbols.size()) {
+		symbols = ((tsdb::SymbolField*) my_structure->getField(field))->symbols()->symbols(0);
+		if(code < 0 || (size_t) code >= symbols.size()) {
+			symbols.clear();
+			((tsdb::SymbolField*) my_structure->getField(field))->symbols()->symbol(code);
+		}
+	}
+	return symbols[code];
+}
+
+/** <summary>Writes <c>value</c> in decimal</summary> */
+char* RecordFormatter::formatInt(char* out, long long value) {
+	if(value < 0) {
+		*out++ = '-';
+		return formatUnsigned(out, 0ULL - (unsigned long long) value);
+	}
+	return formatUnsigned(out, (unsigned long long) value);
+}
+
+/** <summary>Writes <c>value</c> in decimal</summary>
+ * <remarks>The digits are made two at a time from a table, from the right, and copied into place.</remarks>
+ */
+char* RecordFormatter::formatUnsigned(char* out, unsigned long long value) {
+	char digits[20];
+	char* p = digits + sizeof(digits);
+
+	while(value >= 100) {
+		p -= 2;
+		twoDigits(p, (unsigned) (value % 100));
+		value /= 100;
+	}
+	if(value >= 10) {
+		p -= 2;
+		twoDigits(p, (unsigned) value);
+	} else {
+		*--p = (char) ('0' + value);
+	}
+
+	size_t length = digits + sizeof(digits) - p;
+	memcpy(out, p, length);
+	return out + length;
+}
+
+/** <summary>Writes the shortest decimal text that reads back as <c>value</c></summary>
+ * <remarks><p>Values below MAX_FAST_DOUBLE with at most MAX_FAST_DECIMALS decimals, which are most prices
+ * and sizes, take the fast path: the first <c>k</c> for which round(|value| * 10^k) / 10^k gives back
+ * |value| is the number of decimals. Both operands of that division are exact, so it rounds the same way
+ * as reading the text would, and the text is exact.</p>
+ * <p>Other values are written with <c>snprintf()</c> at 15, 16 and then 17 significant digits, taking the
+ * first that reads back as the value. 17 always does. NaN and infinities are written as "nan", "inf" and
+ * "-inf".</p></remarks>
+ */
+char* RecordFormatter::formatDouble(char* out, double value) {
+	if(value != value) {
+		memcpy(out, "nan", 3);
+		return out + 3;
+	}
+
+	bool negative = value < 0 || (value == 0 && 1.0 / value < 0);
+	double a = negative ? -value : value;
+
+	if(a > 1.7976931348623157e308) {
+		if(negative) {
+			*out++ = '-';
+		}
+		memcpy(out, "inf", 3);
+		return out + 3;
+	}
+
+	if(a < MAX_FAST_DOUBLE) {
+		for(int k = 0; k <= MAX_FAST_DECIMALS; k++) {
+			double n = floor(a * POWERS_OF_TEN[k] + 0.5);
+			if(n / POWERS_OF_TEN[k] != a) {
+				continue;
+			}
+
+			if(negative) {
+				*out++ = '-';
+			}
+			unsigned long long digits = (unsigned long long) n;
+			unsigned long long scale = (unsigned long long) POWERS_OF_TEN[k];
+			out = formatUnsigned(out, digits / scale);
+			if(k > 0) {
+				*out++ = '.';
+				out = fixedDigits(out, digits % scale, k);
+			}
+			return out;
+		}
+	}
+
+	char text[MAX_VALUE_CHARS];
+	int length = 0;
+	for(int precision = 15; precision <= 17; precision++) {
+		length = snprintf(text, sizeof(text), "%.*g", precision, value);
+		if(precision == 17 || strtod(text, NULL) == value) {
+			break;
+		}
+	}
+	memcpy(out, text, (size_t) length);
+	return out + length;
+}
+
+/** <summary>Writes a timestamp as ISO 8601 with milliseconds, as TimestampField::toString() does</summary> */
+char* RecordFormatter::formatTimestamp(char* out, tsdb::timestamp_t timestamp) {
+	long long days, ms;
+	splitTimestamp(timestamp, &days, &ms);
+	return isoTime(isoDate(out, days), ms);
+}
+
+/** <summary>Writes a date, in days since 1970-01-01, as YYYY-MM-DD, as DateField::toString() does</summary> */
+char* RecordFormatter::formatDate(char* out, long days) {
+	return isoDate(out, days);
+}
+
+} // namespace tsdb
@@ -0,0 +1,113 @@
+#pragma once
+
+/* STL Classes */
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <stdio.h>
+
+/* External Libraries */
+#include "hdf5.h"
+#include <boost/shared_ptr.hpp>
+
+/* TSDB Includes */
+#include "tsdb.h"
+#include "field.h"
+#include "structure.h"
+
+namespace tsdb {
+
+/* -----------------------------------------------------------------
+ * RecordFormatterException. For runtime errors thrown by a
+ * RecordFormatter.
+ * -----------------------------------------------------------------
+ */
+class  RecordFormatterException:
+	public std::runtime_error
+{
+public:
+	RecordFormatterException(const std::string& what):
+	  std::runtime_error(std::string("RecordFormatterException: ") + what) {}
+};
+
+/* -----------------------------------------------------------------
+ * RecordFormatter. Writes records as delimited text.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>Writes blocks of records to a FILE as delimited text, through one reusable buffer</summary>
+ * <remarks><p>Structure::structsToString() builds a std::string by concatenation, with a Field::toString()
+ * string per value, which is quadratic in the size of the output. A RecordFormatter writes each value
+ * straight into its output buffer with the format functions below, which do not allocate, and hands the
+ * buffer to <c>fwrite()</c> when it is full. Exporting a series is then bound by reading it and by the
+ * output, not by the formatting.</p>
+ * <p>Values are formatted as Field::toString() does, except for doubles: they get the fewest digits that
+ * read back as the same double, where toString() rounds to six significant digits. Timestamps are ISO
+ * 8601 with milliseconds, or milliseconds since the epoch with setTimestampFormat(). Strings are written
+ * as they are stored, up to the first NUL, without quoting.</p>
+ * <p>The destructor writes what is left in the buffer, but does not report errors; call flush() to find
+ * out whether the output could be written.</p></remarks>
+ */
+class RecordFormatter
+{
+public:
+	enum TimestampFormat {
+		ISO,            // 2008-02-01T10:00:00.000, as TimestampField::toString()
+		MILLISECONDS    // milliseconds since the epoch
+	};
+
+	/* Longest text of one numeric, timestamp or date value */
+	static const size_t MAX_VALUE_CHARS = 32;
+
+	RecordFormatter(const boost::shared_ptr<tsdb::Structure>& _structure, FILE* _out,
+		size_t _buffer_bytes = FORMAT_BUFFER_BYTES);
+	~RecordFormatter(void);
+
+	void setDelimiters(const std::string& _field_delim, const std::string& _record_delim);
+	void setTimestampFormat(TimestampFormat _format);
+	void setRecordIds(bool _record_ids);
+
+	void writeHeader(void);
+	void write(const char* records, size_t nrecords, hsize_t first_id = 0);
+	void flush(void);
+	unsigned long long bytesWritten(void) const;
+
+	/* Allocation-free formatting. Each writes at most MAX_VALUE_CHARS characters at out, and returns
+	   a pointer past the last one. */
+	static char* formatInt(char* out, long long value);
+	static char* formatUnsigned(char* out, unsigned long long value);
+	static char* formatDouble(char* out, double value);
+	static char* formatTimestamp(char* out, tsdb::timestamp_t timestamp);
+	static char* formatDate(char* out, long days);
+
+private:
+	/* RecordFormatters own a buffer, so they can't be copied */
+	RecordFormatter(const RecordFormatter&);
+	RecordFormatter& operator=(const RecordFormatter&);
+
+	char* reserve(size_t nbytes);
+	char* writeTimestamp(char* out, tsdb::timestamp_t timestamp);
+	const std::string& symbol(size_t field, tsdb::symbol_t code);
+
+	boost::shared_ptr<tsdb::Structure> my_structure;
+	FILE* my_out;
+	std::vector<char> my_buffer;
+	size_t my_used;
+	unsigned long long my_bytes_written;
+	std::string my_field_delim;
+	std::string my_record_delim;
+	TimestampFormat my_timestamp_format;
+	bool my_record_ids;
+	std::vector<tsdb::Field::FieldType> my_types;
+	size_t my_max_record_chars;    // longest text of one record, delimiters included
+
+	/* The symbols of each SYMBOL field, copied from its dictionary as codes are first seen */
+	std::vector<std::vector<std::string> > my_symbols;
+
+	/* The date of the last timestamp formatted, which rarely changes between records */
+	long long my_cached_day;
+	bool my_cached_valid;
+	char my_cached_date[10];
+};
+
+} // namespace tsdb
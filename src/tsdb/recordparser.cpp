@@ -43,6 +43,20 @@ RecordParser::RecordParser(void) {
 	this->esc = "\\";
 	this->quote = "\"'";
 	this->simple_parse = false;
+	this->last_route = -1;
+	configureTokenizer();
+}
+
+/** <summary>
+ * Sets up the Tokenizer from the delimiter, escape and quote settings.
+ * </summary>
+ */
+void RecordParser::configureTokenizer(void) {
+	if(this->simple_parse) {
+		this->line_tokenizer.setSimple(this->delim.empty() ? ',' : this->delim[0]);
+	} else {
+		this->line_tokenizer.setExtended(this->delim, this->esc, this->quote);
+	}
 }
 
 RecordParser::~RecordParser(void) {
@@ -81,6 +95,37 @@ void RecordParser::addTokenFilter(TokenFilter* new_token_filter) {
 	this->token_filters.push_back(new_token_filter);
 }
 
+/** <summary>
+ * Sets the RecordRouter that picks the destination of each record, or clears it with an empty pointer.
+ * </summary>
+ * <remarks>
+ * The router runs after the TokenFilters and before the FieldParsers, so lines whose key has no route
+ * are not parsed. lastRoute() returns the destination of the last record parsed. The parsers of
+ * several threads can share one router.
+ * </remarks>
+ * <param name="new_router">The RecordRouter to use</param>
+ */
+void RecordParser::setRouter(const boost::shared_ptr<tsdb::RecordRouter>& new_router) {
+	this->record_router = new_router;
+	this->last_route = -1;
+}
+
+/** <summary>
+ * Returns the RecordRouter, which is empty if there is none.
+ * </summary>
+ */
+const boost::shared_ptr<tsdb::RecordRouter>& RecordParser::router(void) const {
+	return this->record_router;
+}
+
+/** <summary>
+ * Returns the destination the RecordRouter picked for the last record parsed.
+ * </summary>
+ */
+long RecordParser::lastRoute(void) const {
+	return this->last_route;
+}
+
 /** <summary>
  * Links the RecordParser to a Structure.
  * </summary>
@@ -141,12 +186,22 @@ void* RecordParser::parseTokens(const std::vector<std::string> &tokens) {
 	if(this->record_struct == NULL) {
 		throw(RecordParserException("not bound to structure"));
 	}
+	this->parse_stats.lines++;
 
 	// Use the TokenFilters to filter the record out before any of the
 	// tokens are parsed into data points.
 	for(i=0; i<this->token_filters.size(); i++) {
 		// If the TokenFilter evaluates to true, then the record is excluded.
 		if(this->token_filters.at(i)->evaluateFilterOnTokens(tokens)) {
+			this->parse_stats.filtered++;
+			return NULL;
+		}
+	}
+
+	if(this->record_router.get() != NULL) {
+		this->last_route = this->record_router->route(tokens);
+		if(this->last_route < 0) {
+			this->parse_stats.unrouted++;
 			return NULL;
 		}
 	}
@@ -165,10 +220,12 @@ void* RecordParser::parseTokens(const std::vector<std::string> &tokens) {
 			this->field_parsers.at(i)->writeParsedTokensToRecord(tokens,record);
 		}
 	} catch(...) {
+		this->parse_stats.failed++;
 		free(record);
 		throw;
 	}
 
+	this->parse_stats.parsed++;
 	return record;
 
 }
@@ -196,12 +253,22 @@ bool RecordParser::parseTokens(const std::vector<std::string> &tokens, void* rec
 	if(this->record_struct == NULL) {
 		throw(RecordParserException("not bound to structure"));
 	}
+	this->parse_stats.lines++;
 
 	// Use the TokenFilters to filter the record out before any of the
 	// tokens are parsed into data points.
 	for(i=0; i<this->token_filters.size(); i++) {
 		// If the TokenFilter evaluates to true, then the record is excluded.
 		if(this->token_filters.at(i)->evaluateFilterOnTokens(tokens)) {
+			this->parse_stats.filtered++;
+			return false;
+		}
+	}
+
+	if(this->record_router.get() != NULL) {
+		this->last_route = this->record_router->route(tokens);
+		if(this->last_route < 0) {
+			this->parse_stats.unrouted++;
 			return false;
 		}
 	}
@@ -215,13 +282,171 @@ bool RecordParser::parseTokens(const std::vector<std::string> &tokens, void* rec
 			this->field_parsers.at(i)->writeParsedTokensToRecord(tokens,record);
 		}
 	} catch(...) {
+		this->parse_stats.failed++;
 		throw;
 	}
 
+	this->parse_stats.parsed++;
 	return true;
 
 }
 
+/** <summary>
+ * Parses tokens and saves to a block of memory.
+ * </summary>
+ * <remarks>
+ * <p>This is the same as parseTokens() for a vector of strings, but the tokens are TokenViews
+ * into a line, so nothing is copied.</p>
+ * </remarks>
+ * <param name="tokens">A vector of TokenViews</param>
+ * <param name="record">Pointer to memory for a record</param>
+ */
+bool RecordParser::parseTokens(const std::vector<tsdb::TokenView> &tokens, void* record) {
+	size_t i;
+	
+	if(this->record_struct == NULL) {
+		throw(RecordParserException("not bound to structure"));
+	}
+	this->parse_stats.lines++;
+
+	if(!acceptTokens(tokens)) {
+		return false;
+	}
+
+	memset(record, 0, this->record_struct->getSizeOf());
+
+	/* Call each of the FieldParsers */
+	try {
+		for(i = 0; i<this->field_parsers.size(); i++) {
+			this->field_parsers[i]->writeParsedTokensToRecord(tokens,record);
+		}
+	} catch(...) {
+		this->parse_stats.failed++;
+		throw;
+	}
+
+	this->parse_stats.parsed++;
+	return true;
+}
+
+/** <summary>
+ * Splits a line into tokens, then parses the tokens to a record using the TokenFilters and
+ * FieldParsers. Saves the result to the memory block pointed to by record.
+ * </summary>
+ * <remarks>
+ * <p>The line is split with the delimiter, escape and quote settings, in simple or extended mode
+ * (see setSimpleParse()), by a Tokenizer. The tokens point into the line; the line does not have to be
+ * NUL-terminated, and nothing is copied. In simple mode, parsing a line does not allocate memory once
+ * the buffers have grown to the number of tokens in a line.</p>
+ * <p>Returns false if a TokenFilter excludes the line, and rethrows any parsing exception.</p>
+ * </remarks>
+ * <param name="line">Pointer to the first character of the line</param>
+ * <param name="length">Length of the line, without the line terminator</param>
+ * <param name="record">Pointer to memory for a record</param>
+ */
+bool RecordParser::parseLine(const char* line, size_t length, void* record) {
+	this->line_tokenizer.split(line, length, this->viewbuf);
+	return this->parseTokens(this->viewbuf, record);
+}
+
+/** <summary>
+ * Parses a batch of lines into consecutive records, a column at a time.
+ * </summary>
+ * <remarks>
+ * <p>The lines are split and run through the TokenFilters and the RecordRouter one by one, as in
+ * parseLine(), and the tokens of the ones that are kept go into a TokenTable. Then each FieldParser
+ * parses its field of every line with FieldParser::parseColumn(), in one loop, rather than every
+ * FieldParser being called for each line.</p>
+ * <p>A line that a FieldParser fails on is skipped, and its index and the error are added to
+ * <c>errors</c>; the lines after it are still parsed. The records of the other lines are written to
+ * <c>records</c>, one after the other, and the route of each is added to <c>routes</c> if there is a
+ * router. Returns the number of records written.</p>
+ * <p>The tokens point into the lines, which must not change until this returns.</p>
+ * </remarks>
+ * <param name="lines">The lines, without their line terminators</param>
+ * <param name="records">Pointer to memory for as many records as there are lines</param>
+ * <param name="routes">Where to add the route of each record, or NULL</param>
+ * <param name="errors">Where to add the lines that could not be parsed, or NULL</param>
+ */
+size_t RecordParser::parseLines(const std::vector<tsdb::TokenView>& lines, void* records,
+	std::vector<long>* routes, std::vector<tsdb::LineError>* errors) {
+	if(this->record_struct == NULL) {
+		throw(RecordParserException("not bound to structure"));
+	}
+
+	this->batch_tokens.clear();
+	this->batch_lines.clear();
+	this->batch_routes.clear();
+	for(size_t i = 0; i < lines.size(); i++) {
+		this->parse_stats.lines++;
+		this->line_tokenizer.split(lines[i].data, lines[i].size, this->viewbuf);
+		if(acceptTokens(this->viewbuf)) {
+			this->batch_tokens.addRow(this->viewbuf, lines[i].data, lines[i].size);
+			this->batch_lines.push_back(i);
+			this->batch_routes.push_back(this->last_route);
+		}
+	}
+
+	size_t record_size = this->record_struct->getSizeOf();
+	size_t nrows = this->batch_tokens.size();
+	char* out = (char*) records;
+	memset(out, 0, nrows * record_size);
+	this->batch_errors.assign(nrows, std::string());
+
+	for(size_t i = 0; i < this->field_parsers.size(); i++) {
+		this->field_parsers[i]->parseColumn(this->batch_tokens, out, record_size, this->batch_errors);
+	}
+
+	/* Close the gaps the failed lines leave */
+	size_t nrecords = 0;
+	for(size_t r = 0; r < nrows; r++) {
+		if(!this->batch_errors[r].empty()) {
+			this->parse_stats.failed++;
+			if(errors != NULL) {
+				errors->push_back(tsdb::LineError(this->batch_lines[r], this->batch_errors[r]));
+			}
+			continue;
+		}
+		if(nrecords != r) {
+			memmove(out + nrecords * record_size, out + r * record_size, record_size);
+		}
+		if(routes != NULL && this->record_router.get() != NULL) {
+			routes->push_back(this->batch_routes[r]);
+		}
+		this->last_route = this->batch_routes[r];
+		nrecords++;
+	}
+
+	this->parse_stats.parsed += nrecords;
+	return nrecords;
+}
+
+/** <summary>
+ * Runs the TokenFilters and the RecordRouter on the tokens of a line. Returns false if the line is
+ * filtered out, or has no route.
+ * </summary>
+ */
+bool RecordParser::acceptTokens(const std::vector<tsdb::TokenView>& tokens) {
+	// Use the TokenFilters to filter the record out before any of the
+	// tokens are parsed into data points.
+	for(size_t i = 0; i < this->token_filters.size(); i++) {
+		// If the TokenFilter evaluates to true, then the record is excluded.
+		if(this->token_filters[i]->evaluateFilterOnTokens(tokens)) {
+			this->parse_stats.filtered++;
+			return false;
+		}
+	}
+
+	if(this->record_router.get() != NULL) {
+		this->last_route = this->record_router->route(tokens);
+		if(this->last_route < 0) {
+			this->parse_stats.unrouted++;
+			return false;
+		}
+	}
+	return true;
+}
+
 /** <summary>
  * Sets the field delimiter to use when parsing a string into a record.
  * </summary>
@@ -233,6 +458,7 @@ bool RecordParser::parseTokens(const std::vector<std::string> &tokens, void* rec
  */
 void RecordParser::setDelimiter(std::string new_delim) {
 	this->delim = new_delim;
+	configureTokenizer();
 }
 
 /** <summary>
@@ -244,6 +470,7 @@ void RecordParser::setDelimiter(std::string new_delim) {
  */
 void RecordParser::setSimpleParse(bool _simple_parse) {
 	this->simple_parse = _simple_parse;
+	configureTokenizer();
 }
 
 /** <summary>
@@ -258,6 +485,7 @@ void RecordParser::setSimpleParse(bool _simple_parse) {
  */
 void RecordParser::setEscapeCharacter(std::string new_esc) {
 	this->esc = new_esc;
+	configureTokenizer();
 }
 
 /** <summary>
@@ -272,6 +500,7 @@ void RecordParser::setEscapeCharacter(std::string new_esc) {
  */
 void RecordParser::setQuoteCharacter(std::string new_quote) {
 	this->quote = new_quote;
+	configureTokenizer();
 }
 
 /** <summary>
@@ -357,42 +586,12 @@ bool RecordParser::parseBasicString(const std::string &line, void * record) {
  * </summary>
  * <remarks>
  * <p>Note that this function tokenizes the line, then calls RecordParser::parseTokens() to convert the
- * tokens to a record. It then writes the result out to record.</p>
+ * tokens to a record. It then writes the result out to record. It is the same as parseLine().</p>
  * </remarks>
  * <param name="line">A line to parse to tokens, then to a record.</param>
  */
 bool RecordParser::parseString(const std::string &line, void * record) {
-	using namespace std;
-	using namespace boost;
-
-	if(!this->simple_parse) {
-		escaped_list_separator<char> els(this->esc,this->delim,this->quote);
-		tokenizer<escaped_list_separator<char> > tok(line,els); 
-		this->tokenbuf.clear();
-		for(tokenizer<escaped_list_separator<char> >::iterator beg=tok.begin();
-			beg!=tok.end(); ++beg) {
-				this->tokenbuf.push_back(*beg);
-		}
-	} else {
-	
-		stringstream ss(line);
-		unsigned int counter = 0;
-		std::string item;
-		char delimchar = this->delim.c_str()[0];
-		while(std::getline(ss,item,delimchar)) {
-			if(counter < this->tokenbuf.size()) {
-				this->tokenbuf[counter] = item;
-			} else {
-				this->tokenbuf.push_back(item);
-			}
-			counter++;
-		}
-		this->tokenbuf.resize(counter);
-	}
-
-		
-	return this->parseTokens(this->tokenbuf, record);
-
+	return this->parseLine(line.data(), line.size(), record);
 }
 
 /** <summary>
@@ -454,8 +653,76 @@ void RecordParser::trim(std::string& str) {
 	else str.erase(str.begin(), str.end());
 }
 
+/** <summary>
+ * Returns a TokenView without the spaces at the beginning and end of <c>token</c>.
+ * </summary>
+ */
+tsdb::TokenView RecordParser::trim(const tsdb::TokenView& token) {
+	const char* start = token.data;
+	const char* end = token.data + token.size;
+	while(start < end && *start == ' ') {
+		start++;
+	}
+	while(end > start && *(end - 1) == ' ') {
+		end--;
+	}
+	return tsdb::TokenView(start, end - start);
+}
+
 std::vector<tsdb::FieldParser*>& RecordParser::fieldParsers() {
 	return this->field_parsers;
 }
 
+/** <summary>
+ * Returns how many lines the RecordParser has been given, and what became of them.
+ * </summary>
+ * <remarks>
+ * Every parseTokens(), parseLine() and parseString() call counts as a line. The counters are plain
+ * integers, which cost next to nothing to keep, so the RecordParser must not be shared between threads
+ * (it can not be anyway). Use RecordParserStats::merge() to add up the parsers of several threads.
+ * </remarks>
+ */
+const tsdb::RecordParserStats& RecordParser::stats(void) const {
+	return this->parse_stats;
+}
+
+/** <summary>
+ * Sets the counters of the RecordParser back to zero.
+ * </summary>
+ */
+void RecordParser::resetStats(void) {
+	this->parse_stats = tsdb::RecordParserStats();
+}
+
+/* ====================================================================
+ * struct RecordParserStats - what a RecordParser has parsed
+ * ====================================================================
+ */
+
+/** <summary>
+ * Adds the counters of another RecordParser to these.
+ * </summary>
+ */
+void RecordParserStats::merge(const RecordParserStats& other) {
+	this->lines += other.lines;
+	this->parsed += other.parsed;
+	this->filtered += other.filtered;
+	this->failed += other.failed;
+	this->unrouted += other.unrouted;
+}
+
+/** <summary>
+ * Returns the counters as name, value pairs, with <c>prefix</c> in front of each name.
+ * </summary>
+ */
+tsdb::StatList RecordParserStats::items(const std::string& prefix) const {
+	tsdb::StatList items;
+	items.push_back(std::make_pair(prefix + "lines", this->lines));
+	items.push_back(std::make_pair(prefix + "parsed", this->parsed));
+	items.push_back(std::make_pair(prefix + "filtered", this->filtered));
+	items.push_back(std::make_pair(prefix + "failed", this->failed));
+	items.push_back(std::make_pair(prefix + "unrouted", this->unrouted));
+	return items;
+}
+
 } // namespace tsdb
\ No newline at end of file
@@ -1,9 +1,13 @@
 #pragma once
 
 #include <vector>
+#include <boost/shared_ptr.hpp>
 #include "structure.h"
 #include "tokenfilter.h"
+#include "recordrouter.h"
+#include "tokenizer.h"
 #include "tsdb.h"
+#include "stats.h"
 
 
 namespace tsdb {
@@ -11,6 +15,35 @@ namespace tsdb {
 /* Forward Declarations */
 class FieldParser;
 
+/* -----------------------------------------------------------------
+ * RecordParserStats. What a RecordParser has parsed so far.
+ * -----------------------------------------------------------------
+ */
+struct RecordParserStats
+{
+	RecordParserStats(void): lines(0), parsed(0), filtered(0), failed(0), unrouted(0) {}
+
+	unsigned long long lines;     // lines or sets of tokens handed to the parser
+	unsigned long long parsed;    // ... that became a record
+	unsigned long long filtered;  // ... that a TokenFilter excluded
+	unsigned long long failed;    // ... that a FieldParser threw on
+	unsigned long long unrouted;  // ... whose key the RecordRouter has no route for
+
+	void merge(const RecordParserStats& other);
+	tsdb::StatList items(const std::string& prefix = "") const;
+};
+
+/* -----------------------------------------------------------------
+ * LineError. A line that RecordParser::parseLines() could not parse.
+ * -----------------------------------------------------------------
+ */
+struct LineError
+{
+	LineError(size_t _line, const std::string& _what): line(_line), what(_what) {}
+
+	size_t line;       // index of the line in the batch
+	std::string what;  // the error a FieldParser threw
+};
 
 class  RecordParser 
 {
@@ -21,28 +54,50 @@ public:
 	Structure* getRecordStructure();
 	void* parseTokens(const std::vector<std::string> &tokens);
 	bool parseTokens(const std::vector<std::string> &tokens, void* record);
+	bool parseTokens(const std::vector<tsdb::TokenView> &tokens, void* record);
+	bool parseLine(const char* line, size_t length, void* record);
+	size_t parseLines(const std::vector<tsdb::TokenView>& lines, void* records,
+		std::vector<long>* routes = NULL, std::vector<tsdb::LineError>* errors = NULL);
 	void* parseString(const std::string &line);
 	void* parseBasicString(const std::string &line);
 	bool parseBasicString(const std::string &line, void * record);
 	bool parseString(const std::string &line, void * record);
 	void addFieldParser(tsdb::FieldParser*);
 	void addTokenFilter(tsdb::TokenFilter*);
+	void setRouter(const boost::shared_ptr<tsdb::RecordRouter>& new_router);
+	const boost::shared_ptr<tsdb::RecordRouter>& router(void) const;
+	long lastRoute(void) const;
 	void setDelimiter(std::string new_delim);
 	void setEscapeCharacter(std::string new_esc);
 	void setQuoteCharacter(std::string new_quote);
 	void setSimpleParse(bool _simple_parse);
 	std::vector<tsdb::FieldParser*>& fieldParsers();
+	const tsdb::RecordParserStats& stats(void) const;
+	void resetStats(void);
 	static void trim(std::string& str);
+	static tsdb::TokenView trim(const tsdb::TokenView& token);
 	~RecordParser(void);
 private:
+	void configureTokenizer(void);
+	bool acceptTokens(const std::vector<tsdb::TokenView>& tokens);
+
 	Structure* record_struct;
 	std::vector<tsdb::FieldParser*> field_parsers;
 	std::vector<tsdb::TokenFilter*> token_filters;
+	boost::shared_ptr<tsdb::RecordRouter> record_router;
+	long last_route;  // destination of the last record parsed, if there is a router
 	bool simple_parse;
 	std::string delim;
 	std::string esc;
 	std::string quote;
 	std::vector<std::string> tokenbuf;
+	tsdb::Tokenizer line_tokenizer;
+	std::vector<tsdb::TokenView> viewbuf;
+	tsdb::TokenTable batch_tokens;         // the lines of parseLines() that were not filtered
+	std::vector<size_t> batch_lines;       // ... their index in the batch
+	std::vector<long> batch_routes;        // ... and their routes
+	std::vector<std::string> batch_errors; // the error of each of them, or an empty string
+	tsdb::RecordParserStats parse_stats;  // plain counters, since a RecordParser is used by one thread
 };
 
 } // namespace tsdb;
\ No newline at end of file
@@ -0,0 +1,62 @@
+/* STL includes */
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/* TSDB includes */
+#include "recordrouter.h"
+
+namespace tsdb {
+
+/* ====================================================================
+ * class RecordRouter - picks the destination of a line
+ * ====================================================================
+ */
+
+/** <summary>Creates a router that keys lines on the tokens numbered in <c>_key_tokens</c>, with no routes
+ * yet</summary>
+ */
+RecordRouter::RecordRouter(const std::vector<size_t>& _key_tokens):
+	my_key_tokens(_key_tokens), my_ndestinations(0) {
+	if(_key_tokens.empty()) {
+		throw( RecordRouterException("no key tokens specified") );
+	}
+}
+
+/** <summary>Sends lines with the key <c>key</c> to <c>destination</c></summary>
+ * <remarks>Throws a RecordRouterException if the key has a route already.</remarks>
+ */
+void RecordRouter::addRoute(const std::string& key, size_t destination) {
+	size_t nkeys = my_keys.size();
+	if(my_keys.add(key) < (long) nkeys) {
+		throw( RecordRouterException("the key '" + key + "' has two routes") );
+	}
+	my_destinations.push_back(destination);
+	my_ndestinations = std::max(my_ndestinations, destination + 1);
+}
+
+/** <summary>Returns the destination of a line with these tokens, or -1 if its key has no route</summary>
+ * <remarks>Throws a RecordRouterException if there are not enough tokens for the key.</remarks>
+ */
+long RecordRouter::route(const std::vector<tsdb::TokenView>& tokens) const {
+	for(size_t i = 0; i < my_key_tokens.size(); i++) {
+		if(tokens.size() <= my_key_tokens[i]) {
+			throw( RecordRouterException("not enough tokens in token array for the key") );
+		}
+	}
+	long key = my_keys.find(tokens, my_key_tokens);
+	return key >= 0 ? (long) my_destinations[key] : -1;
+}
+
+/** <summary>Returns the destination of a line with these tokens, or -1 if its key has no route</summary> */
+long RecordRouter::route(const std::vector<std::string>& tokens) const {
+	std::vector<TokenView> views(tokens.begin(), tokens.end());
+	return route(views);
+}
+
+/** <summary>Returns one more than the highest destination of a route</summary> */
+size_t RecordRouter::nDestinations(void) const {
+	return my_ndestinations;
+}
+
+} // namespace tsdb
@@ -0,0 +1,61 @@
+#pragma once
+
+/* STL Classes */
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "tsdb.h"
+#include "tokenizer.h"
+#include "tokenset.h"
+
+namespace tsdb {
+
+/* -----------------------------------------------------------------
+ * RecordRouterException. For runtime errors thrown by the
+ * RecordRouter class.
+ * -----------------------------------------------------------------
+ */
+class  RecordRouterException:
+	public std::runtime_error
+{
+public:
+	RecordRouterException(const std::string& what):
+	  std::runtime_error(std::string("RecordRouterException: ") + what) {}
+};
+
+/* -----------------------------------------------------------------
+ * RecordRouter. Picks the destination of a line from a key token.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>Picks which of several destinations a line goes to, from the value of its key tokens</summary>
+ * <remarks><p>A vendor file often has the records of many symbols mixed together. Rather than reading the
+ * file once per symbol with a TokenFilter that keeps one of them, a RecordParser with a RecordRouter parses
+ * each line once, and tells the caller where the record goes: RecordParser::lastRoute() is the
+ * destination of the last record parsed. ImportPipeline uses it to append each record to its own
+ * Timeseries.</p>
+ * <p>The key tokens are joined with spaces, as for a TokenFilter, and looked up in a TokenSet of the keys
+ * that have a route. Several keys can go to the same destination. Lines with a key that has no route are
+ * skipped by the RecordParser, and counted as unrouted.</p>
+ * <p>route() does not change the router, so the parsers of several threads can share one.</p></remarks>
+ */
+class RecordRouter
+{
+public:
+	RecordRouter(const std::vector<size_t>& _key_tokens);
+
+	void addRoute(const std::string& key, size_t destination);
+	long route(const std::vector<tsdb::TokenView>& tokens) const;
+	long route(const std::vector<std::string>& tokens) const;
+
+	size_t nDestinations(void) const;
+
+private:
+	std::vector<size_t> my_key_tokens;
+	tsdb::TokenSet my_keys;
+	std::vector<size_t> my_destinations;  // destination of each key in my_keys
+	size_t my_ndestinations;
+};
+
+} // namespace tsdb
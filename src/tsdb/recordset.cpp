@@ -2,10 +2,26 @@
 #include "record.h"
 #include "structure.h"
 #include "memoryblock.h"
+#include "columnkernels.h"
+#include "cell.h"
 
+#include <string.h>
 #include <boost/make_shared.hpp>
 
 namespace tsdb {
+
+namespace {
+
+/* Copies n values of N bytes that are stride bytes apart into out */
+template <size_t N>
+void gather(const char* p, size_t stride, size_t n, char* out) {
+	for(size_t i = 0; i < n; i++, p += stride, out += N) {
+		memcpy(out, p, N);
+	}
+}
+
+} // anonymous namespace
+
 RecordSet::RecordSet(tsdb::MemoryBlockPtr& _memory_block_ptr, size_t _nrecords, boost::shared_ptr<tsdb::Structure>& _structure) {
 	this->my_memory_block_ptr = _memory_block_ptr;
 	this->my_structure = _structure;
@@ -48,4 +64,85 @@ size_t RecordSet::size() const {
 const tsdb::MemoryBlockPtr& RecordSet::memoryBlockPtr(void) const {
 	return this->my_memory_block_ptr;
 }
+
+const boost::shared_ptr<tsdb::Structure>& RecordSet::structure(void) const {
+	return this->my_structure;
+}
+
+/** <summary>Copies field <c>ifield</c> of every record into <c>out</c>, as stored</summary>
+ * <remarks>This is extractColumn() without the type. The copy of each value has a size that is known at
+ * compile time for the sizes of the fixed width fields, and the whole column is one memcpy when the
+ * records have only this field.</remarks>
+ * <param name="ifield">The index of the field</param>
+ * <param name="out">Room for size() values of <c>value_size</c> bytes</param>
+ * <param name="value_size">The size of a value in <c>out</c>, which must be the size of the field</param>
+ */
+void RecordSet::extractRaw(size_t ifield, void* out, size_t value_size) const {
+	if(this->my_structure->getSizeOfField(ifield) != value_size) {
+		throw tsdb::type_conversion_error("the size of the values does not match the size of field " +
+			this->my_structure->getField(ifield)->getName());
+	}
+	if(this->my_nrecords == 0) {
+		return;
+	}
+
+	const char* p = this->my_memory_block_ptr.raw() + this->my_structure->getOffsetOfField(ifield);
+	size_t stride = this->my_structure->getSizeOf();
+	char* dest = (char*) out;
+
+	if(stride == value_size) {
+		memcpy(dest, p, this->my_nrecords * value_size);
+		return;
+	}
+
+	switch(value_size) {
+		case 1: gather<1>(p, stride, this->my_nrecords, dest); break;
+		case 2: gather<2>(p, stride, this->my_nrecords, dest); break;
+		case 4: gather<4>(p, stride, this->my_nrecords, dest); break;
+		case 8: gather<8>(p, stride, this->my_nrecords, dest); break;
+		default:
+			for(size_t i = 0; i < this->my_nrecords; i++, p += stride, dest += value_size) {
+				memcpy(dest, p, value_size);
+			}
+	}
+}
+
+/** <summary>Copies a numeric field of every record into <c>out</c> as doubles</summary>
+ * <remarks>Timestamps stay in milliseconds since the epoch. A field that is not DOUBLE, INT32, INT8,
+ * TIMESTAMP or DATE throws a type_conversion_error. See ColumnKernels::toDoubles().</remarks>
+ */
+void RecordSet::extractDoubles(size_t ifield, tsdb::ieee64_t* out) const {
+	if(this->my_nrecords > 0) {
+		tsdb::ColumnKernels::toDoubles(tsdb::StridedColumn(*this, ifield), out);
+	}
+}
+
+/** <summary>Copies an INT32, INT8, DATE or SYMBOL field of every record into <c>out</c> as ints</summary>
+ * <remarks>See ColumnKernels::toInts().</remarks>
+ */
+void RecordSet::extractInts(size_t ifield, int* out) const {
+	if(this->my_nrecords > 0) {
+		tsdb::ColumnKernels::toInts(tsdb::StridedColumn(*this, ifield), out);
+	}
+}
+
+/** <summary>Copies a TIMESTAMP field of every record into <c>out</c> as seconds since the epoch</summary>
+ * <remarks>These are the values of an R POSIXct vector. Other types throw a type_conversion_error.</remarks>
+ */
+void RecordSet::extractPosixSeconds(size_t ifield, tsdb::ieee64_t* out) const {
+	if(this->my_structure->getField(ifield)->getFieldType() != tsdb::Field::TIMESTAMP) {
+		throw tsdb::type_conversion_error("cannot convert type to POSIX seconds");
+	}
+	if(this->my_nrecords == 0) {
+		return;
+	}
+
+	const char* p = this->my_memory_block_ptr.raw() + this->my_structure->getOffsetOfField(ifield);
+	size_t stride = this->my_structure->getSizeOf();
+	for(size_t i = 0; i < this->my_nrecords; i++, p += stride) {
+		tsdb::timestamp_t value;
+		memcpy(&value, p, sizeof(value));
+		out[i] = (tsdb::ieee64_t) value / 1000.0;
+	}
+}
 } // namespace tsdb
\ No newline at end of file
@@ -6,6 +6,13 @@
 #include "memoryblockptr.h"
 
 namespace tsdb {
+
+/** <summary>A block of records of one Structure, held in a MemoryBlock</summary>
+ * <remarks>Besides record access through operator[], a RecordSet can copy a whole field into an array
+ * with one strided pass over its memory, which is how the language bindings fill their vectors:
+ * extractColumn() copies the values as they are stored, and extractDoubles(), extractInts() and
+ * extractPosixSeconds() convert them on the way.</remarks>
+ */
 class RecordSet
 {
 public:
@@ -13,10 +20,26 @@ public:
 	RecordSet(size_t _nrecords, boost::shared_ptr<tsdb::Structure>& _structure);
 	RecordSet();
 	const tsdb::MemoryBlockPtr& memoryBlockPtr(void) const;
+	const boost::shared_ptr<tsdb::Structure>& structure(void) const;
 	tsdb::Record operator[](size_t i);
 	size_t size(void) const;
 	~RecordSet(void);
+
+	/** <summary>Copies field <c>ifield</c> of every record into <c>out</c>, as stored</summary>
+	 * <remarks><c>out</c> must have room for size() values. <c>T</c> must have the size of the field,
+	 * or a type_conversion_error is thrown.</remarks>
+	 */
+	template <class T>
+	void extractColumn(size_t ifield, T* out) const {
+		extractRaw(ifield, out, sizeof(T));
+	}
+
+	void extractDoubles(size_t ifield, tsdb::ieee64_t* out) const;
+	void extractInts(size_t ifield, int* out) const;
+	void extractPosixSeconds(size_t ifield, tsdb::ieee64_t* out) const;
 protected:
+	void extractRaw(size_t ifield, void* out, size_t value_size) const;
+
 	size_t my_nrecords;
 	tsdb::MemoryBlockPtr my_memory_block_ptr;
 	boost::shared_ptr<tsdb::Structure> my_structure;
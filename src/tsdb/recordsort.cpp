@@ -0,0 +1,192 @@
+/* STL includes */
+#include <vector>
+#include <algorithm>
+#include <string.h>
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/thread/thread.hpp>
+
+/* TSDB includes */
+#include "recordsort.h"
+
+namespace tsdb {
+
+namespace {
+
+/* A timestamp as an unsigned key that sorts the same way, and the position of its record */
+struct SortItem {
+	boost::uint64_t key;
+	size_t position;
+};
+
+const unsigned RADIX_BITS = 8;
+const size_t RADIX = 1 << RADIX_BITS;
+
+/** <summary>Counts the keys of items <c>first</c> to <c>last - 1</c> by digit</summary> */
+void countDigits(const SortItem* items, size_t first, size_t last, unsigned shift, size_t* counts) {
+	for(size_t i = first; i < last; i++) {
+		counts[(items[i].key >> shift) & (RADIX - 1)]++;
+	}
+}
+
+/** <summary>Moves items <c>first</c> to <c>last - 1</c> to the next free place of their digit</summary> */
+void scatterItems(const SortItem* src, SortItem* dst, size_t first, size_t last, unsigned shift, size_t* offsets) {
+	for(size_t i = first; i < last; i++) {
+		dst[offsets[(src[i].key >> shift) & (RADIX - 1)]++] = src[i];
+	}
+}
+
+/** <summary>Copies the records of items <c>first</c> to <c>last - 1</c> to their sorted places</summary> */
+void gatherRecords(const char* src, char* dst, const SortItem* items, size_t first, size_t last, size_t record_size) {
+	for(size_t i = first; i < last; i++) {
+		memcpy(dst + i * record_size, src + items[i].position * record_size, record_size);
+	}
+}
+
+/** <summary>Returns the number of threads to sort <c>nrecords</c> records with</summary> */
+size_t sortThreads(size_t nrecords, size_t nthreads) {
+	if(nrecords < PARALLEL_SORT_GE) {
+		return 1;
+	}
+	if(nthreads == 0) {
+		nthreads = boost::thread::hardware_concurrency();
+	}
+	return (nthreads > 0) ? nthreads : 1;
+}
+
+/** <summary>Returns the first item of slice <c>t</c> of <c>nthreads</c></summary> */
+size_t sliceStart(size_t nitems, size_t nthreads, size_t t) {
+	return (size_t) (((boost::uint64_t) nitems * t) / nthreads);
+}
+
+/** <summary>Sorts the records into items, sorted by key</summary>
+ * <remarks>Returns the sorted items, which are in <c>items</c> or <c>scratch</c>.</remarks>
+ */
+SortItem* sortItems(const char* records, size_t nrecords, size_t record_size, size_t nthreads,
+	std::vector<SortItem>& items, std::vector<SortItem>& scratch) {
+
+	items.resize(nrecords);
+	scratch.resize(nrecords);
+
+	// Flipping the sign bit makes the order of the unsigned keys that of the signed timestamps
+	boost::uint64_t all_or = 0;
+	boost::uint64_t all_and = ~((boost::uint64_t) 0);
+	for(size_t i = 0; i < nrecords; i++) {
+		timestamp_t ts;
+		memcpy(&ts, records + i * record_size, sizeof(ts));
+		items[i].key = ((boost::uint64_t) ts) ^ (((boost::uint64_t) 1) << 63);
+		items[i].position = i;
+		all_or |= items[i].key;
+		all_and &= items[i].key;
+	}
+	boost::uint64_t varying = all_or ^ all_and; // the bits that are not the same in every key
+
+	SortItem* src = &items[0];
+	SortItem* dst = &scratch[0];
+	std::vector<size_t> counts(nthreads * RADIX);
+
+	for(unsigned shift = 0; shift < 64; shift += RADIX_BITS) {
+		if(((varying >> shift) & (RADIX - 1)) == 0) {
+			continue;
+		}
+
+		std::fill(counts.begin(), counts.end(), 0);
+		if(nthreads == 1) {
+			countDigits(src, 0, nrecords, shift, &counts[0]);
+		} else {
+			boost::thread_group workers;
+			for(size_t t = 0; t < nthreads; t++) {
+				workers.create_thread(boost::bind(&countDigits, src, sliceStart(nrecords, nthreads, t),
+					sliceStart(nrecords, nthreads, t + 1), shift, &counts[t * RADIX]));
+			}
+			workers.join_all();
+		}
+
+		// Turn the counts into the place of the first item of each digit of each slice
+		size_t offset = 0;
+		for(size_t digit = 0; digit < RADIX; digit++) {
+			for(size_t t = 0; t < nthreads; t++) {
+				size_t count = counts[t * RADIX + digit];
+				counts[t * RADIX + digit] = offset;
+				offset += count;
+			}
+		}
+
+		if(nthreads == 1) {
+			scatterItems(src, dst, 0, nrecords, shift, &counts[0]);
+		} else {
+			boost::thread_group workers;
+			for(size_t t = 0; t < nthreads; t++) {
+				workers.create_thread(boost::bind(&scatterItems, src, dst, sliceStart(nrecords, nthreads, t),
+					sliceStart(nrecords, nthreads, t + 1), shift, &counts[t * RADIX]));
+			}
+			workers.join_all();
+		}
+		std::swap(src, dst);
+	}
+
+	return src;
+}
+
+} // namespace
+
+/* ====================================================================
+ * class RecordSort - stable radix sort of records by timestamp
+ * ====================================================================
+ */
+
+/** <summary>Returns true if the records are in order by timestamp</summary> */
+bool RecordSort::isSorted(const void* records, size_t nrecords, size_t record_size) {
+	const char* records_c = (const char*) records;
+	timestamp_t prevts, ts;
+
+	if(nrecords < 2) {
+		return true;
+	}
+
+	memcpy(&prevts, records_c, sizeof(prevts));
+	for(size_t i = 1; i < nrecords; i++) {
+		memcpy(&ts, records_c + i * record_size, sizeof(ts));
+		if(ts < prevts) {
+			return false;
+		}
+		prevts = ts;
+	}
+	return true;
+}
+
+/** <summary>Sorts records by timestamp, keeping the order of records with the same timestamp</summary>
+ * <remarks>Records that are already sorted are not moved. The sort needs memory for two (timestamp,
+ * position) pairs and one copy of each record.</remarks>
+ * <param name="records">Pointer to the records, which are sorted in place</param>
+ * <param name="nrecords">Number of records</param>
+ * <param name="record_size">Size of a record, with the timestamp at offset zero</param>
+ * <param name="nthreads">Number of threads for batches of at least PARALLEL_SORT_GE records. 0 means
+ * one per processor.</param>
+ */
+void RecordSort::sort(void* records, size_t nrecords, size_t record_size, size_t nthreads) {
+	if(isSorted(records, nrecords, record_size)) {
+		return;
+	}
+
+	char* records_c = (char*) records;
+	nthreads = sortThreads(nrecords, nthreads);
+
+	std::vector<SortItem> items, scratch;
+	const SortItem* sorted = sortItems(records_c, nrecords, record_size, nthreads, items, scratch);
+
+	std::vector<char> moved(nrecords * record_size);
+	if(nthreads == 1) {
+		gatherRecords(records_c, &moved[0], sorted, 0, nrecords, record_size);
+	} else {
+		boost::thread_group workers;
+		for(size_t t = 0; t < nthreads; t++) {
+			workers.create_thread(boost::bind(&gatherRecords, records_c, &moved[0], sorted,
+				sliceStart(nrecords, nthreads, t), sliceStart(nrecords, nthreads, t + 1), record_size));
+		}
+		workers.join_all();
+	}
+	memcpy(records_c, &moved[0], nrecords * record_size);
+}
+
+} // namespace tsdb
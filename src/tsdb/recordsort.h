@@ -0,0 +1,30 @@
+#pragma once
+
+/* TSDB Includes */
+#include "tsdb.h"
+
+namespace tsdb {
+
+/* -----------------------------------------------------------------
+ * RecordSort. Sorts blocks of records by timestamp.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>A stable radix sort of records on their timestamp</summary>
+ * <remarks><p>The records are sorted by a least significant digit radix sort of (timestamp, position)
+ * pairs, a byte of the timestamp per pass, and then moved to their places with one gather. Passes over
+ * bytes that are the same in every timestamp, which are most of them for the timestamps of one batch,
+ * are skipped. The sort is stable, so records with the same timestamp keep their order.</p>
+ * <p>Batches of at least PARALLEL_SORT_GE records are sorted on several threads: each thread counts and
+ * moves the pairs of its own slice of the batch, which keeps the sort stable, and gathers its slice of the
+ * records.</p>
+ * <p>As everywhere in TSDB, the timestamp is the first field of a record.</p></remarks>
+ */
+class RecordSort
+{
+public:
+	static bool isSorted(const void* records, size_t nrecords, size_t record_size);
+	static void sort(void* records, size_t nrecords, size_t record_size, size_t nthreads = 0);
+};
+
+} // namespace tsdb
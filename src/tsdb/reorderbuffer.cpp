@@ -0,0 +1,132 @@
+/* STL includes */
+#include <vector>
+#include <string.h>
+
+/* TSDB includes */
+#include "reorderbuffer.h"
+#include "timeseries.h"
+#include "recordsort.h"
+
+namespace tsdb {
+
+/* ====================================================================
+ * class ReorderBuffer - puts late records in order before writing
+ * ====================================================================
+ */
+
+/** <summary>Creates a ReorderBuffer that writes to <c>_timeseries</c></summary>
+ * <remarks>Throws a ReorderBufferException if the horizon is negative. A horizon of 0 still sorts the
+ * records added between two checks.</remarks>
+ * <param name="_timeseries">The Timeseries to write to. The caller keeps ownership, and it must outlive the
+ * ReorderBuffer.</param>
+ * <param name="_horizon">How late a record can be, in milliseconds, and still be written in place</param>
+ */
+ReorderBuffer::ReorderBuffer(tsdb::Timeseries* _timeseries, tsdb::timestamp_t _horizon):
+	my_timeseries(_timeseries), my_horizon(_horizon), my_release_every(APPEND_BUFFER_SIZE),
+	my_nadded(0), my_max_ts(0), my_has_max_ts(false), my_nlate(0) {
+
+	if(_horizon < 0) {
+		throw( ReorderBufferException("the horizon can not be negative") );
+	}
+
+	my_structure = _timeseries->structure();
+	my_record_size = my_structure->getSizeOf();
+}
+
+/** <summary>Writes the records that are left, ignoring errors</summary> */
+ReorderBuffer::~ReorderBuffer(void) {
+	try {
+		flush();
+	} catch(...) {
+	}
+}
+
+/** <summary>Adds records, in any order</summary>
+ * <param name="nrecords">Number of records</param>
+ * <param name="records">The records, laid out as in the Structure of the Timeseries. They are copied.</param>
+ */
+void ReorderBuffer::addRecords(size_t nrecords, const void* records) {
+	if(nrecords == 0) {
+		return;
+	}
+
+	const char* records_c = (const char*) records;
+	for(size_t i = 0; i < nrecords; i++) {
+		timestamp_t ts = *((timestamp_t*) (records_c + i * my_record_size));
+		if(!my_has_max_ts || ts > my_max_ts) {
+			my_max_ts = ts;
+			my_has_max_ts = true;
+		}
+	}
+	my_records.insert(my_records.end(), records_c, records_c + nrecords * my_record_size);
+
+	my_nadded += nrecords;
+	if(my_nadded >= my_release_every) {
+		release(false);
+	}
+}
+
+/** <summary>Adds one record</summary>
+ * <remarks>The record must use the Structure of the Timeseries.</remarks>
+ */
+void ReorderBuffer::addRecord(tsdb::Record& record) {
+	if(record.structure() != my_structure) {
+		throw( ReorderBufferException("attempted to add a record with a different structure") );
+	}
+	addRecords(1, record.memoryBlockPtr().raw());
+}
+
+/** <summary>Writes all of the records held back to the Timeseries</summary> */
+void ReorderBuffer::flush(void) {
+	release(true);
+}
+
+/** <summary>Checks for records older than the horizon after every <c>nrecords</c> records added</summary>
+ * <remarks>The default is APPEND_BUFFER_SIZE. Larger values sort less often, and hold back more records.</remarks>
+ */
+void ReorderBuffer::setReleaseEvery(size_t nrecords) {
+	my_release_every = nrecords > 0 ? nrecords : 1;
+}
+
+/** <summary>Returns the horizon, in milliseconds</summary> */
+tsdb::timestamp_t ReorderBuffer::horizon(void) const {
+	return my_horizon;
+}
+
+/** <summary>Returns the number of records held back</summary> */
+size_t ReorderBuffer::size(void) const {
+	return my_records.size() / my_record_size;
+}
+
+/** <summary>Returns the number of records that came after the horizon, and were merged into the Timeseries</summary> */
+hsize_t ReorderBuffer::lateRecords(void) const {
+	return my_nlate;
+}
+
+/** <summary>Sorts the records held back, and writes the ones older than the horizon, or all of them</summary> */
+void ReorderBuffer::release(bool all) {
+	my_nadded = 0;
+
+	size_t nrecords = size();
+	if(nrecords == 0) {
+		return;
+	}
+
+	RecordSort::sort(&my_records[0], nrecords, my_record_size);
+
+	size_t nrelease = nrecords;
+	if(!all) {
+		timestamp_t cutoff = my_max_ts - my_horizon;
+		nrelease = 0;
+		while(nrelease < nrecords && *((timestamp_t*) (&my_records[nrelease * my_record_size])) < cutoff) {
+			nrelease++;
+		}
+	}
+
+	if(nrelease > 0) {
+		my_nlate += my_timeseries->mergeRecords(nrelease, &my_records[0]);
+		my_records.erase(my_records.begin(), my_records.begin() + nrelease * my_record_size);
+	}
+}
+
+} // namespace tsdb
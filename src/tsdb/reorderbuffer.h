@@ -0,0 +1,85 @@
+#pragma once
+
+/* STL Classes */
+#include <vector>
+#include <stdexcept>
+
+/* External Libraries */
+#include "hdf5.h"
+#include <boost/shared_ptr.hpp>
+
+/* TSDB Includes */
+#include "tsdb.h"
+#include "structure.h"
+#include "record.h"
+
+namespace tsdb {
+
+class Timeseries;
+
+/* -----------------------------------------------------------------
+ * ReorderBufferException. For runtime errors thrown by a
+ * ReorderBuffer.
+ * -----------------------------------------------------------------
+ */
+class  ReorderBufferException:
+	public std::runtime_error
+{
+public:
+	ReorderBufferException(const std::string& what):
+	  std::runtime_error(std::string("ReorderBufferException: ") + what) {}
+};
+
+/* -----------------------------------------------------------------
+ * ReorderBuffer. Holds back recent records, so that records that
+ * arrive a little out of order are written in order.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>Writes records that arrive out of order to a Timeseries in order, without dropping any</summary>
+ * <remarks><p>A ReorderBuffer keeps the records added to it in memory until they are older than the
+ * horizon: until a record more than <c>horizon</c> milliseconds later has been added. Those records are
+ * then sorted and written to the Timeseries, so a record that is at most <c>horizon</c> late is put in
+ * its place before it reaches the file, and the writes are plain appends.</p>
+ * <p>A record that is later than that goes to Timeseries::mergeRecords(), which rewrites the records of
+ * the series after it. lateRecords() counts them, so an import can tell if the horizon is too short. No
+ * record is discarded.</p>
+ * <p>The buffer checks for old records after every setReleaseEvery() records added, since every check
+ * sorts the records it holds. flush() writes out everything; the destructor calls it too, but can not
+ * report errors.</p></remarks>
+ */
+class ReorderBuffer
+{
+public:
+	ReorderBuffer(tsdb::Timeseries* _timeseries, tsdb::timestamp_t _horizon);
+	~ReorderBuffer(void);
+
+	void addRecords(size_t nrecords, const void* records);
+	void addRecord(tsdb::Record& record);
+	void flush(void);
+
+	void setReleaseEvery(size_t nrecords);
+	tsdb::timestamp_t horizon(void) const;
+	size_t size(void) const;
+	hsize_t lateRecords(void) const;
+
+private:
+	/* ReorderBuffers write to a Timeseries when they are destroyed, so they can't be copied */
+	ReorderBuffer(const ReorderBuffer&);
+	ReorderBuffer& operator=(const ReorderBuffer&);
+
+	void release(bool all);
+
+	tsdb::Timeseries* my_timeseries;
+	boost::shared_ptr<tsdb::Structure> my_structure;
+	tsdb::timestamp_t my_horizon;
+	size_t my_record_size;
+	std::vector<char> my_records;   // the records held back, in the order they were added
+	size_t my_release_every;
+	size_t my_nadded;               // records added since the last check
+	tsdb::timestamp_t my_max_ts;    // the latest timestamp added so far
+	bool my_has_max_ts;
+	hsize_t my_nlate;
+};
+
+} // namespace tsdb
@@ -0,0 +1,255 @@
+/* STL includes */
+#include <string>
+#include <vector>
+#include <sstream>
+#include <boost/make_shared.hpp>
+#include <boost/algorithm/string.hpp>
+
+/* HDF5 includes */
+#include "hdf5_hl.h"
+
+/* TSDB includes */
+#include "rollup.h"
+#include "timeseries.h"
+#include "hdf5lock.h"
+
+namespace tsdb {
+
+/* ====================================================================
+ * class Rollup - a downsampled copy of a Timeseries, kept up to date
+ * ====================================================================
+ */
+
+/** <summary>Creates an empty rollup in the group of a Timeseries</summary>
+ * <remarks>Throws a RollupException if a spec is not FIRST, LAST, MIN, MAX, SUM or COUNT, and an
+ * AggregateException if the specs do not fit the fields of the series.</remarks>
+ * <param name="_loc_id">The HDF5 group of the Timeseries</param>
+ * <param name="_input">The Structure of the records of the Timeseries</param>
+ * <param name="_bucket_size">Length of a bucket, in milliseconds</param>
+ * <param name="_specs">The aggregated columns</param>
+ * <param name="_options">Storage options for the rollup series</param>
+ */
+Rollup::Rollup(hid_t _loc_id, const boost::shared_ptr<tsdb::Structure>& _input, tsdb::timestamp_t _bucket_size,
+	const std::vector<tsdb::AggregateSpec>& _specs, const tsdb::StorageOptions& _options):
+	my_input(_input), my_bucket_size(_bucket_size), my_specs(_specs), my_open_written(false) {
+
+	std::string packed;
+	for(size_t i = 0; i < my_specs.size(); i++) {
+		switch(my_specs[i].function) {
+			case AggregateSpec::FIRST:
+			case AggregateSpec::LAST:
+			case AggregateSpec::MIN:
+			case AggregateSpec::MAX:
+			case AggregateSpec::SUM:
+			case AggregateSpec::COUNT:
+				break;
+			default:
+				throw( RollupException(my_specs[i].toString() + " can not be rolled up; roll up the sum and the count instead") );
+		}
+		packed += (i > 0 ? ";" : "") + my_specs[i].toString();
+	}
+
+	my_aggregator = boost::make_shared<tsdb::Aggregator>(my_input, my_specs, my_bucket_size);
+
+	HDF5Lock lock;
+	std::string series_name = name(my_bucket_size);
+	my_series = boost::make_shared<tsdb::Timeseries>(_loc_id, series_name, "TSDB: Rollup", my_aggregator->structure(), _options);
+
+	long long bucket_size = (long long) my_bucket_size;
+	if(H5LTset_attribute_long_long(_loc_id, series_name.c_str(), "TSDB_ROLLUP_BUCKET", &bucket_size, 1) < 0 ||
+		H5LTset_attribute_string(_loc_id, series_name.c_str(), "TSDB_ROLLUP_SPECS", packed.c_str()) < 0) {
+		throw( RollupException("Error setting the attributes of '" + series_name + "'.") );
+	}
+}
+
+/** <summary>Opens a rollup of a Timeseries</summary>
+ * <remarks>The rollup has to be resumed before records are added to it.</remarks>
+ * <param name="_loc_id">The HDF5 group of the Timeseries</param>
+ * <param name="_name">The name of the rollup series, see names()</param>
+ * <param name="_input">The Structure of the records of the Timeseries</param>
+ */
+Rollup::Rollup(hid_t _loc_id, const std::string& _name, const boost::shared_ptr<tsdb::Structure>& _input):
+	my_input(_input), my_open_written(false) {
+
+	HDF5Lock lock;
+	long long bucket_size = 0;
+	hsize_t dims;
+	H5T_class_t type_class;
+	size_t attr_size = 0;
+	if(H5LTget_attribute_long_long(_loc_id, _name.c_str(), "TSDB_ROLLUP_BUCKET", &bucket_size) < 0 ||
+		H5LTget_attribute_info(_loc_id, _name.c_str(), "TSDB_ROLLUP_SPECS", &dims, &type_class, &attr_size) < 0) {
+		throw( RollupException("'" + _name + "' does not have the attributes of a rollup.") );
+	}
+	std::string packed(attr_size, '\0');
+	if(H5LTget_attribute_string(_loc_id, _name.c_str(), "TSDB_ROLLUP_SPECS", &packed[0]) < 0) {
+		throw( RollupException("Error in H5LTget_attribute_string.") );
+	}
+	my_bucket_size = (tsdb::timestamp_t) bucket_size;
+
+	my_series = boost::make_shared<tsdb::Timeseries>(_loc_id, _name);
+	boost::shared_ptr<tsdb::Structure> structure = my_series->structure();
+
+	// The names of the columns are those of the fields of the rollup series
+	std::vector<std::string> specs;
+	std::string trimmed = packed.c_str();
+	if(!trimmed.empty()) {
+		boost::algorithm::split(specs, trimmed, boost::algorithm::is_any_of(";"));
+	}
+	if(structure->getNFields() != specs.size() + 1) {
+		throw( RollupException("the specs of '" + _name + "' do not match its fields") );
+	}
+	for(size_t i = 0; i < specs.size(); i++) {
+		my_specs.push_back(AggregateSpec::fromString(specs[i]));
+		my_specs.back().name = structure->getField(i + 1)->getName();
+	}
+}
+
+/** <summary>Adds records that were just appended to the Timeseries</summary>
+ * <remarks>The last row, the open bucket, is replaced, and the rows of the buckets after it are appended.
+ * Throws a RollupException if the rollup has not been resumed since it was opened.</remarks>
+ */
+void Rollup::addRecords(const char* records, size_t nrecords) {
+	if(!resumed()) {
+		throw( RollupException("records can not be added to a rollup before it is resumed") );
+	}
+	my_aggregator->addRecords(records, nrecords);
+	writeRows();
+}
+
+/** <summary>Starts the open bucket again from the records of the Timeseries that are in it</summary>
+ * <remarks>The rows at and after <c>bucket</c> are removed, and the row of <c>records</c> is written in their
+ * place. With no records, as for an empty series, every row is removed.</remarks>
+ * <param name="bucket">The start of the bucket of the last record of the Timeseries</param>
+ * <param name="records">The records of the Timeseries from the start of that bucket to its last record</param>
+ * <param name="nrecords">Number of records</param>
+ */
+void Rollup::resume(tsdb::timestamp_t bucket, const char* records, size_t nrecords) {
+	hsize_t keep = 0;
+	if(nrecords > 0 && my_series->recordId_GE(bucket, &keep) < 0) {
+		keep = my_series->getNRecords();
+	}
+	my_series->truncate(keep);
+
+	my_aggregator = boost::make_shared<tsdb::Aggregator>(my_input, my_specs, my_bucket_size);
+	my_open_written = false;
+	if(nrecords > 0) {
+		my_aggregator->addRecords(records, nrecords);
+		writeRows();
+	}
+}
+
+/** <summary>Returns true if records can be added, that is if the rollup knows its open bucket</summary> */
+bool Rollup::resumed(void) const {
+	return my_aggregator.get() != 0;
+}
+
+/** <summary>Forgets the open bucket, as when records are removed from the Timeseries</summary> */
+void Rollup::invalidate(void) {
+	my_aggregator.reset();
+	my_open_written = false;
+}
+
+/** <summary>Returns true if the rows can answer an aggregation with <c>specs</c> and <c>bucket_size</c></summary>
+ * <remarks>They can if <c>bucket_size</c> is a multiple of the bucket size of the rollup, so that each bucket
+ * of the aggregation is made of whole buckets of the rollup, and if the rollup has a column with the function
+ * and field of every spec. <c>columns</c> gets the column of the rollup series for each spec, as
+ * Aggregator::addRows() takes them.</remarks>
+ */
+bool Rollup::covers(tsdb::timestamp_t bucket_size, const std::vector<tsdb::AggregateSpec>& specs,
+	std::vector<size_t>* columns) const {
+	if(bucket_size < my_bucket_size || bucket_size % my_bucket_size != 0) {
+		return false;
+	}
+
+	columns->clear();
+	for(size_t i = 0; i < specs.size(); i++) {
+		size_t j = 0;
+		while(j < my_specs.size() && (my_specs[j].function != specs[i].function || my_specs[j].field != specs[i].field)) {
+			j++;
+		}
+		if(j == my_specs.size()) {
+			return false;
+		}
+		columns->push_back(j + 1);
+	}
+	return true;
+}
+
+/** <summary>Returns the length of a bucket, in milliseconds</summary> */
+tsdb::timestamp_t Rollup::bucketSize(void) const {
+	return my_bucket_size;
+}
+
+/** <summary>Returns the start of the bucket of a timestamp, as Aggregator has it</summary> */
+tsdb::timestamp_t Rollup::bucketOf(tsdb::timestamp_t timestamp) const {
+	tsdb::timestamp_t bucket = timestamp - timestamp % my_bucket_size;
+	if(timestamp % my_bucket_size < 0) {
+		bucket -= my_bucket_size;
+	}
+	return bucket;
+}
+
+/** <summary>Returns the aggregated columns, named as the fields of the rollup series</summary> */
+const std::vector<tsdb::AggregateSpec>& Rollup::specs(void) const {
+	return my_specs;
+}
+
+/** <summary>Returns the series the rows are saved in</summary> */
+const boost::shared_ptr<tsdb::Timeseries>& Rollup::series(void) const {
+	return my_series;
+}
+
+/** <summary>Returns the name of the series of a rollup with buckets of <c>bucket_size</c> milliseconds</summary> */
+std::string Rollup::name(tsdb::timestamp_t bucket_size) {
+	std::ostringstream name;
+	name << "_TSDB_rollup_" << bucket_size;
+	return name.str();
+}
+
+/** <summary>Lists the rollup series in the group of a Timeseries</summary> */
+std::vector<std::string> Rollup::names(hid_t loc_id) {
+	HDF5Lock lock;
+	std::vector<std::string> names;
+	H5G_info_t group_info;
+
+	if(H5Gget_info(loc_id, &group_info) < 0) {
+		throw( RollupException("Error in H5Gget_info.") );
+	}
+
+	for(hsize_t i = 0; i < group_info.nlinks; i++) {
+		ssize_t size = H5Lget_name_by_idx(loc_id, ".", H5_INDEX_NAME, H5_ITER_INC, i, NULL, 0, H5P_DEFAULT);
+		if(size < 0) {
+			throw( RollupException("Error in H5Lget_name_by_idx.") );
+		}
+		std::vector<char> name((size_t) size + 1, '\0');
+		H5Lget_name_by_idx(loc_id, ".", H5_INDEX_NAME, H5_ITER_INC, i, &name[0], (size_t) size + 1, H5P_DEFAULT);
+		if(std::string(&name[0]).compare(0, 13, "_TSDB_rollup_") == 0) {
+			names.push_back(&name[0]);
+		}
+	}
+	return names;
+}
+
+/* Writes the finished rows, and the open bucket in place of the last row if that was the open bucket */
+void Rollup::writeRows(void) {
+	std::vector<char> rows;
+	size_t nrows = my_aggregator->takeRows(&rows);
+	size_t row_size = my_aggregator->structure()->getSizeOf();
+
+	rows.resize((nrows + 1) * row_size);
+	bool open = my_aggregator->openRow(&rows[nrows * row_size]);
+	if(open) {
+		nrows++;
+	}
+	if(nrows == 0) {
+		return;
+	}
+
+	if(my_open_written) {
+		my_series->truncate(my_series->getNRecords() - 1);
+	}
+	my_series->appendRecords(nrows, &rows[0], false);
+	my_open_written = open;
+}
+
+} // namespace tsdb
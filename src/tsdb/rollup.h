@@ -0,0 +1,93 @@
+#pragma once
+
+/* STL Classes */
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+/* External Libraries */
+#include "hdf5.h"
+#include <boost/shared_ptr.hpp>
+
+/* TSDB Includes */
+#include "tsdb.h"
+#include "structure.h"
+#include "storageoptions.h"
+#include "aggregate.h"
+
+namespace tsdb {
+
+/* -----------------------------------------------------------------
+ * Typedefs/Forward Declarations.
+ * -----------------------------------------------------------------
+ */
+class Timeseries;
+
+/* -----------------------------------------------------------------
+ * RollupException. For runtime errors thrown by a Rollup.
+ * -----------------------------------------------------------------
+ */
+class  RollupException:
+	public std::runtime_error
+{
+public:
+	RollupException(const std::string& what):
+	  std::runtime_error(std::string("RollupException: ") + what) {}
+};
+
+/* -----------------------------------------------------------------
+ * Rollup. A downsampled copy of a Timeseries, kept up to date.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>The records of a Timeseries aggregated to one row per time bucket, saved with the series and kept
+ * up to date as records are appended</summary>
+ * <remarks><p>A Rollup is what Timeseries::aggregate() would return for the whole series, with its bucket size
+ * and specs, such as the open, high, low, close and volume of one second or one minute bars. It is saved as a
+ * Timeseries of its own called "_TSDB_rollup_<bucket size>" in the group of the series, with the bucket size
+ * and the specs as attributes. Only FIRST, LAST, MIN, MAX, SUM and COUNT can be rolled up, since the rows of
+ * those can be aggregated again into longer buckets; for a MEAN, roll up the SUM and the COUNT.</p>
+ * <p>The last row is the open bucket, the one the last record appended is in. The Rollup keeps an Aggregator
+ * with that bucket in memory, so addRecords() only rewrites the last row and appends the rows of the buckets
+ * after it. After the Rollup is opened, or the series truncated, resume() starts the Aggregator again from
+ * the records of the open bucket, which the Timeseries reads from its data table.</p>
+ * <p>covers() tells Timeseries::aggregate() whether the rows can answer an aggregation; see there.</p></remarks>
+ */
+class Rollup
+{
+public:
+	Rollup(hid_t _loc_id, const boost::shared_ptr<tsdb::Structure>& _input, tsdb::timestamp_t _bucket_size,
+		const std::vector<tsdb::AggregateSpec>& _specs, const tsdb::StorageOptions& _options);
+	Rollup(hid_t _loc_id, const std::string& _name, const boost::shared_ptr<tsdb::Structure>& _input);
+
+	void addRecords(const char* records, size_t nrecords);
+	void resume(tsdb::timestamp_t bucket, const char* records, size_t nrecords);
+	bool resumed(void) const;
+	void invalidate(void);
+
+	bool covers(tsdb::timestamp_t bucket_size, const std::vector<tsdb::AggregateSpec>& specs,
+		std::vector<size_t>* columns) const;
+	tsdb::timestamp_t bucketSize(void) const;
+	tsdb::timestamp_t bucketOf(tsdb::timestamp_t timestamp) const;
+	const std::vector<tsdb::AggregateSpec>& specs(void) const;
+	const boost::shared_ptr<tsdb::Timeseries>& series(void) const;
+
+	static std::string name(tsdb::timestamp_t bucket_size);
+	static std::vector<std::string> names(hid_t loc_id);
+
+private:
+	/* Rollups hold the series they write to, so they can't be copied */
+	Rollup(const Rollup&);
+	Rollup& operator=(const Rollup&);
+
+	void writeRows(void);
+
+	boost::shared_ptr<tsdb::Structure> my_input;
+	tsdb::timestamp_t my_bucket_size;
+	std::vector<tsdb::AggregateSpec> my_specs;
+	boost::shared_ptr<tsdb::Timeseries> my_series;
+	boost::shared_ptr<tsdb::Aggregator> my_aggregator;  // the open bucket, once resumed
+	bool my_open_written;                               // the last row of my_series is the open bucket
+};
+
+} // namespace tsdb
@@ -0,0 +1,324 @@
+/* STL includes */
+#include <string>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <boost/make_shared.hpp>
+
+/* HDF5 includes */
+#include "hdf5_hl.h"
+
+/* TSDB includes */
+#include "segmentindex.h"
+
+namespace tsdb {
+
+/* ====================================================================
+ * class SegmentIndex - piecewise linear timestamp to record id mapping
+ * ====================================================================
+ */
+
+/** <summary>Creates an empty segment index for a Timeseries</summary>
+ * <param name="_loc_id">The HDF5 group of the Timeseries</param>
+ * <param name="_max_error">How far, in records, a prediction may be from the record it predicts</param>
+ * <param name="_options">Storage options for the segment table</param>
+ */
+SegmentIndex::SegmentIndex(hid_t _loc_id, size_t _max_error, const tsdb::StorageOptions& _options):
+	my_max_error(_max_error) {
+
+	makeRowStructure();
+	my_table = boost::make_shared<tsdb::Table>(_loc_id, "_TSDB_segments", "TSDB: Segment Index", my_row_structure, _options);
+
+	unsigned long max_error = (unsigned long) my_max_error;
+	if(H5LTset_attribute_ulong(_loc_id, "_TSDB_segments", "TSDB_MAX_ERROR", &max_error, 1) < 0) {
+		throw( SegmentIndexException("Error in H5LTset_attribute_ulong.") );
+	}
+
+	resume();
+}
+
+/** <summary>Opens the segment index of a Timeseries, and loads it into memory</summary>
+ * <param name="_loc_id">The HDF5 group of the Timeseries</param>
+ */
+SegmentIndex::SegmentIndex(hid_t _loc_id) {
+	makeRowStructure();
+	my_table = boost::make_shared<tsdb::Table>(_loc_id, "_TSDB_segments");
+	if(my_table->structure()->getNFields() != my_row_structure->getNFields()) {
+		throw( SegmentIndexException("the segment table does not have the expected columns") );
+	}
+	my_row_structure = my_table->structure();
+
+	unsigned long max_error = SEGMENT_MAX_ERROR;
+	if(H5LTget_attribute_ulong(_loc_id, "_TSDB_segments", "TSDB_MAX_ERROR", &max_error) < 0) {
+		throw( SegmentIndexException("Error in H5LTget_attribute_ulong.") );
+	}
+	my_max_error = (size_t) max_error;
+
+	loadSegments();
+	resume();
+}
+
+/** <summary>Adds the timestamps of the records from nextRecordId() on</summary>
+ * <remarks>The timestamps must be in order, and continue the ones added so far.</remarks>
+ * <param name="timestamps">The first timestamp</param>
+ * <param name="ntimestamps">Number of timestamps</param>
+ * <param name="stride">Bytes from one timestamp to the next, which is the record size for records</param>
+ */
+void SegmentIndex::addTimestamps(const char* timestamps, size_t ntimestamps, size_t stride) {
+	for(size_t i = 0; i < ntimestamps; i++) {
+		tsdb::timestamp_t ts;
+		memcpy(&ts, timestamps + i * stride, sizeof(ts));
+		if(my_have_key && ts <= my_key_ts) {
+			if(ts < my_key_ts) {
+				throw( SegmentIndexException("timestamps must be added in order") );
+			}
+			continue; // the same timestamp as the record before
+		}
+		addKey(ts, my_next_id + i);
+	}
+	my_next_id += ntimestamps;
+}
+
+/** <summary>Returns the record id of the next record that addTimestamps() expects</summary> */
+hsize_t SegmentIndex::nextRecordId(void) const {
+	return my_next_id;
+}
+
+/** <summary>Drops the segments that cover record <c>nrecords</c> or any after it, and the open segment</summary>
+ * <remarks>This is used when the records from <c>nrecords</c> on are rewritten. The next addTimestamps()
+ * starts right after the first record of the last timestamp of the kept segments.</remarks>
+ */
+void SegmentIndex::truncate(hsize_t nrecords) {
+	size_t keep = my_last_ids.size();
+	while(keep > 0 && my_last_ids[keep - 1] >= nrecords) {
+		keep--;
+	}
+	if(keep < my_last_ids.size()) {
+		my_table->truncate(keep);
+		my_first_ts.resize(keep);
+		my_first_ids.resize(keep);
+		my_last_ts.resize(keep);
+		my_last_ids.resize(keep);
+		my_slopes.resize(keep);
+	}
+	resume();
+}
+
+/** <summary>Writes the saved segments out to the file, for SWMR readers</summary> */
+void SegmentIndex::flush(void) {
+	my_table->flush();
+}
+
+/** <summary>Loads the segments saved since the SegmentIndex was opened, or last refreshed</summary>
+ * <remarks>For a reader of a series that another writer appends to. The open segment is discarded.</remarks>
+ */
+void SegmentIndex::refresh(void) {
+	my_table->refresh();
+	loadSegments();
+	resume();
+}
+
+/** <summary>Narrows down where the first record with a timestamp at or after <c>timestamp</c> is</summary>
+ * <remarks>Returns true and sets [<c>first</c>, <c>last</c>] to the records it is in, at most
+ * 2 * maxError() + 3 of them, if the segments cover <c>timestamp</c>. Returns false for a timestamp after
+ * the last one added, for which that record may not have been added yet.</remarks>
+ */
+bool SegmentIndex::bounds(tsdb::timestamp_t timestamp, hsize_t* first, hsize_t* last) const {
+	size_t nsaved = my_first_ts.size();
+	if(nsaved == 0 && !my_open) {
+		return false;
+	}
+	tsdb::timestamp_t covered_ts = my_open ? my_open_last_ts : my_last_ts.back();
+	if(timestamp > covered_ts) {
+		return false;
+	}
+
+	tsdb::timestamp_t x0;
+	hsize_t y0, y1;
+	double slope;
+	if(my_open && timestamp >= my_open_first_ts) {
+		x0 = my_open_first_ts;
+		y0 = my_open_first_id;
+		y1 = my_open_last_id;
+		slope = (my_open_slope_hi == std::numeric_limits<double>::infinity()) ? my_open_slope_lo :
+			(my_open_slope_lo + my_open_slope_hi) / 2;
+	} else {
+		size_t s = std::upper_bound(my_first_ts.begin(), my_first_ts.end(), timestamp) - my_first_ts.begin();
+		if(s == 0) {
+			// Before the first record, which is in the open segment if none has been saved yet
+			*first = *last = (nsaved > 0) ? my_first_ids[0] : my_open_first_id;
+			return true;
+		}
+		s--;
+		x0 = my_first_ts[s];
+		y0 = my_first_ids[s];
+		y1 = my_last_ids[s];
+		slope = my_slopes[s];
+	}
+	if(timestamp < x0) {
+		*first = *last = y0;
+		return true;
+	}
+
+	// One more record on either side than the maximum error, for rounding
+	double predicted = (double) y0 + slope * (double) (timestamp - x0);
+	double lo = floor(predicted) - (double) my_max_error - 1;
+	double hi = ceil(predicted) + (double) my_max_error + 1;
+	*first = (lo <= (double) y0) ? y0 : (lo >= (double) y1) ? y1 : (hsize_t) lo;
+	*last = (hi >= (double) y1) ? y1 : (hi <= (double) y0) ? y0 : (hsize_t) hi;
+	if(*first > *last) {
+		*first = *last;
+	}
+	return true;
+}
+
+/** <summary>Returns the number of segments, with the open one</summary> */
+size_t SegmentIndex::size(void) const {
+	return my_first_ts.size() + (my_open ? 1 : 0);
+}
+
+/** <summary>Returns how far, in records, a prediction may be from the record it predicts</summary> */
+size_t SegmentIndex::maxError(void) const {
+	return my_max_error;
+}
+
+/** <summary>Checks if there is a segment index in the group of a Timeseries</summary> */
+bool SegmentIndex::exists(hid_t loc_id) {
+	return tsdb::Table::exists(loc_id, "_TSDB_segments");
+}
+
+void SegmentIndex::makeRowStructure(void) {
+	std::vector<Field*> fields;
+	fields.push_back(new TimestampField("_TSDB_timestamp"));
+	fields.push_back(new RecordField("record_id"));
+	fields.push_back(new TimestampField("last_timestamp"));
+	fields.push_back(new RecordField("last_record_id"));
+	fields.push_back(new DoubleField("slope"));
+
+	my_row_structure = boost::make_shared<tsdb::Structure>(fields, true);
+}
+
+/* Loads the segments of the table after the ones already loaded */
+void SegmentIndex::loadSegments(void) {
+	hsize_t first = my_first_ts.size();
+	hsize_t nsegments = my_table->size();
+	if(nsegments <= first) {
+		return;
+	}
+
+	void* rows = NULL;
+	my_table->getRecords(first, nsegments - 1, &rows);
+
+	for(hsize_t s = 0; s < nsegments - first; s++) {
+		const char* row = (const char*) rows + s * my_row_structure->getSizeOf();
+		tsdb::timestamp_t ts;
+		hsize_t id;
+		double slope;
+
+		memcpy(&ts, row + my_row_structure->getOffsetOfField(0), sizeof(ts));
+		my_first_ts.push_back(ts);
+		memcpy(&id, row + my_row_structure->getOffsetOfField(1), sizeof(id));
+		my_first_ids.push_back(id);
+		memcpy(&ts, row + my_row_structure->getOffsetOfField(2), sizeof(ts));
+		my_last_ts.push_back(ts);
+		memcpy(&id, row + my_row_structure->getOffsetOfField(3), sizeof(id));
+		my_last_ids.push_back(id);
+		memcpy(&slope, row + my_row_structure->getOffsetOfField(4), sizeof(slope));
+		my_slopes.push_back(slope);
+	}
+
+	free(rows);
+}
+
+/* Discards the open segment, and continues after the last saved one */
+void SegmentIndex::resume(void) {
+	my_open = false;
+	my_have_key = !my_last_ts.empty();
+	my_key_ts = my_have_key ? my_last_ts.back() : 0;
+	my_next_id = my_have_key ? my_last_ids.back() + 1 : 0;
+}
+
+/* Adds the first record of a new timestamp. Every timestamp after the one before it, up to this one,
+   predicts this record, so the points (previous timestamp + 1, record_id) and (timestamp, record_id) must
+   both fit the segment. */
+void SegmentIndex::addKey(tsdb::timestamp_t timestamp, hsize_t record_id) {
+	if(!my_have_key) {
+		openSegment(timestamp, record_id);
+	} else {
+		tsdb::timestamp_t after_key = my_key_ts + 1;
+		double slope_lo = my_open_slope_lo;
+		double slope_hi = my_open_slope_hi;
+		if(!my_open || record_id - my_open_first_id >= SEGMENT_MAX_RECORDS ||
+			!narrow(after_key, record_id, &slope_lo, &slope_hi) || !narrow(timestamp, record_id, &slope_lo, &slope_hi)) {
+			if(my_open) {
+				closeSegment();
+			}
+			openSegment(after_key, record_id);
+			narrow(timestamp, record_id, &my_open_slope_lo, &my_open_slope_hi);
+		} else {
+			my_open_slope_lo = slope_lo;
+			my_open_slope_hi = slope_hi;
+		}
+	}
+
+	my_open_last_ts = timestamp;
+	my_open_last_id = record_id;
+	my_key_ts = timestamp;
+	my_have_key = true;
+}
+
+/* Starts the open segment at a point */
+void SegmentIndex::openSegment(tsdb::timestamp_t timestamp, hsize_t record_id) {
+	my_open = true;
+	my_open_first_ts = timestamp;
+	my_open_first_id = record_id;
+	my_open_last_ts = timestamp;
+	my_open_last_id = record_id;
+	my_open_slope_lo = 0;
+	my_open_slope_hi = std::numeric_limits<double>::infinity();
+}
+
+/* Saves the open segment as the next segment, with the slope in the middle of the ones that fit */
+void SegmentIndex::closeSegment(void) {
+	double slope = (my_open_slope_hi == std::numeric_limits<double>::infinity()) ? my_open_slope_lo :
+		(my_open_slope_lo + my_open_slope_hi) / 2;
+
+	std::vector<char> row(my_row_structure->getSizeOf(), 0);
+	my_row_structure->setMember(&row[0], 0, &my_open_first_ts);
+	my_row_structure->setMember(&row[0], 1, &my_open_first_id);
+	my_row_structure->setMember(&row[0], 2, &my_open_last_ts);
+	my_row_structure->setMember(&row[0], 3, &my_open_last_id);
+	my_row_structure->setMember(&row[0], 4, &slope);
+	my_table->appendRecords(1, &row[0]);
+
+	my_first_ts.push_back(my_open_first_ts);
+	my_first_ids.push_back(my_open_first_id);
+	my_last_ts.push_back(my_open_last_ts);
+	my_last_ids.push_back(my_open_last_id);
+	my_slopes.push_back(slope);
+	my_open = false;
+}
+
+/* Narrows the slopes of the open segment to the ones that predict record_id for timestamp within the
+   maximum error. Returns false, and leaves them, if none does. */
+bool SegmentIndex::narrow(tsdb::timestamp_t timestamp, hsize_t record_id, double* slope_lo, double* slope_hi) const {
+	double dy = (double) record_id - (double) my_open_first_id;
+	if(timestamp == my_open_first_ts) {
+		return fabs(dy) <= (double) my_max_error;
+	}
+
+	double dx = (double) (timestamp - my_open_first_ts);
+	double lo = std::max(*slope_lo, (dy - (double) my_max_error) / dx);
+	double hi = std::min(*slope_hi, (dy + (double) my_max_error) / dx);
+	if(lo > hi) {
+		return false;
+	}
+	*slope_lo = lo;
+	*slope_hi = hi;
+	return true;
+}
+
+} // namespace tsdb
@@ -0,0 +1,106 @@
+#pragma once
+
+/* STL Classes */
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+/* External Libraries */
+#include "hdf5.h"
+#include <boost/shared_ptr.hpp>
+
+/* TSDB Includes */
+#include "tsdb.h"
+#include "structure.h"
+#include "table.h"
+#include "storageoptions.h"
+
+namespace tsdb {
+
+/* -----------------------------------------------------------------
+ * SegmentIndexException. For runtime errors thrown by the
+ * SegmentIndex class.
+ * -----------------------------------------------------------------
+ */
+class  SegmentIndexException:
+	public std::runtime_error
+{
+public:
+	SegmentIndexException(const std::string& what):
+	  std::runtime_error(std::string("SegmentIndexException: ") + what) {}
+};
+
+/* -----------------------------------------------------------------
+ * SegmentIndex. Piecewise linear timestamp to record id mapping.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>Predicts the record id of a timestamp with line segments, each within a maximum error</summary>
+ * <remarks><p>The timestamps of a session of ticks grow almost linearly with the record id, so a few
+ * straight lines can stand in for the index points of a long series. Each segment starts at a timestamp
+ * and a record id, and has a slope; the record id it predicts for a timestamp is off by at most
+ * maxError() from the first record with a timestamp at or after it. bounds() turns the prediction into a
+ * range of a few records to search, without reading anything.</p>
+ * <p>The segments are fitted as the timestamps are added, one pass and constant work per record: a segment
+ * keeps the range of slopes that still fits all of its records, and a new segment starts when the next
+ * timestamp no longer fits, or when the segment covers SEGMENT_MAX_RECORDS records. A timestamp that
+ * repeats more than about twice the maximum error also starts a new segment.</p>
+ * <p>The SegmentIndex is saved as a Table called "_TSDB_segments" in the group of the Timeseries, with one
+ * row per segment, and is loaded into memory when it is opened. The open segment, the last one, is only
+ * saved once the next one starts, so after a Timeseries is reopened its records are added again, as for
+ * the open block of a ZoneMap; until then, timestamps after the saved segments are not covered.</p></remarks>
+ */
+class SegmentIndex
+{
+public:
+	SegmentIndex(hid_t _loc_id, size_t _max_error, const tsdb::StorageOptions& _options);
+	SegmentIndex(hid_t _loc_id);
+
+	void addTimestamps(const char* timestamps, size_t ntimestamps, size_t stride);
+	hsize_t nextRecordId(void) const;
+	void truncate(hsize_t nrecords);
+	void flush(void);
+	void refresh(void);
+
+	bool bounds(tsdb::timestamp_t timestamp, hsize_t* first, hsize_t* last) const;
+	size_t size(void) const;
+	size_t maxError(void) const;
+
+	static bool exists(hid_t loc_id);
+
+private:
+	void makeRowStructure(void);
+	void loadSegments(void);
+	void resume(void);
+	void addKey(tsdb::timestamp_t timestamp, hsize_t record_id);
+	void openSegment(tsdb::timestamp_t timestamp, hsize_t record_id);
+	void closeSegment(void);
+	bool narrow(tsdb::timestamp_t timestamp, hsize_t record_id, double* slope_lo, double* slope_hi) const;
+
+	boost::shared_ptr<tsdb::Structure> my_row_structure;
+	boost::shared_ptr<tsdb::Table> my_table;
+	size_t my_max_error;
+
+	/* The saved segments */
+	std::vector<tsdb::timestamp_t> my_first_ts;
+	std::vector<hsize_t> my_first_ids;
+	std::vector<tsdb::timestamp_t> my_last_ts;  // the last timestamp the segment covers
+	std::vector<hsize_t> my_last_ids;           // ... and its first record id
+	std::vector<double> my_slopes;
+
+	/* The open segment, which the next addTimestamps() continues */
+	bool my_open;
+	tsdb::timestamp_t my_open_first_ts;
+	hsize_t my_open_first_id;
+	tsdb::timestamp_t my_open_last_ts;
+	hsize_t my_open_last_id;
+	double my_open_slope_lo;   // the slopes that fit every record of the open segment
+	double my_open_slope_hi;
+
+	/* Where adding stopped */
+	hsize_t my_next_id;
+	bool my_have_key;
+	tsdb::timestamp_t my_key_ts;   // the last timestamp added
+};
+
+} // namespace tsdb
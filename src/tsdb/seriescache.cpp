@@ -0,0 +1,171 @@
+/* STL includes */
+#include <vector>
+
+/* Boost */
+#include <boost/make_shared.hpp>
+
+/* TSDB includes */
+#include "seriescache.h"
+#include "timeseries.h"
+
+namespace tsdb {
+
+/* ====================================================================
+ * class SeriesCache - opened Timeseries, least recently opened last
+ * ====================================================================
+ */
+
+/** <summary>Creates an empty cache that keeps up to <c>_capacity</c> series open</summary> */
+SeriesCache::SeriesCache(size_t _capacity): my_capacity(_capacity) {
+}
+
+/** <summary>Drops every cached series</summary> */
+SeriesCache::~SeriesCache(void) {
+	clear();
+}
+
+/** <summary>Returns the Timeseries <c>name</c> at <c>loc_id</c>, opening it if it is not cached</summary>
+ * <remarks>Throws what the Timeseries open constructor throws if the series can not be opened. The series
+ * is opened outside of the cache's lock, so if two threads miss on the same series at once, the one that
+ * finishes last uses the Timeseries the other one cached.</remarks>
+ */
+boost::shared_ptr<tsdb::Timeseries> SeriesCache::open(hid_t loc_id, const std::string& name) {
+	Key key(loc_id, name);
+
+	{
+		boost::lock_guard<boost::mutex> lock(my_mutex);
+		std::map<Key, EntryList::iterator>::iterator found = my_by_key.find(key);
+		if(found != my_by_key.end()) {
+			my_stats.hits++;
+			my_entries.splice(my_entries.begin(), my_entries, found->second);
+			return found->second->second;
+		}
+		my_stats.misses++;
+	}
+
+	boost::shared_ptr<tsdb::Timeseries> series = boost::make_shared<tsdb::Timeseries>(loc_id, name);
+
+	{
+		boost::lock_guard<boost::mutex> lock(my_mutex);
+		std::map<Key, EntryList::iterator>::iterator found = my_by_key.find(key);
+		if(found != my_by_key.end()) {
+			my_entries.splice(my_entries.begin(), my_entries, found->second);
+			return found->second->second;
+		}
+		if(my_capacity == 0) {
+			return series;
+		}
+		my_entries.push_front(Entry(key, series));
+		my_by_key[key] = my_entries.begin();
+	}
+
+	shrinkTo(my_capacity);
+	return series;
+}
+
+/** <summary>Drops the series <c>name</c> at <c>loc_id</c>, if it is cached</summary>
+ * <remarks>The next open() reopens it from the file.</remarks>
+ */
+void SeriesCache::invalidate(hid_t loc_id, const std::string& name) {
+	boost::shared_ptr<tsdb::Timeseries> dropped;
+
+	{
+		boost::lock_guard<boost::mutex> lock(my_mutex);
+		std::map<Key, EntryList::iterator>::iterator found = my_by_key.find(Key(loc_id, name));
+		if(found == my_by_key.end()) {
+			return;
+		}
+		dropped = found->second->second;
+		my_entries.erase(found->second);
+		my_by_key.erase(found);
+		my_stats.invalidations++;
+	}
+	// The Timeseries is closed here, outside of the lock
+}
+
+/** <summary>Drops every cached series that was opened at <c>loc_id</c></summary>
+ * <remarks>Call this before closing the file or group <c>loc_id</c>.</remarks>
+ */
+void SeriesCache::invalidateLocation(hid_t loc_id) {
+	std::vector<boost::shared_ptr<tsdb::Timeseries> > dropped;
+
+	{
+		boost::lock_guard<boost::mutex> lock(my_mutex);
+		EntryList::iterator it = my_entries.begin();
+		while(it != my_entries.end()) {
+			if(it->first.first == loc_id) {
+				dropped.push_back(it->second);
+				my_by_key.erase(it->first);
+				it = my_entries.erase(it);
+				my_stats.invalidations++;
+			} else {
+				++it;
+			}
+		}
+	}
+}
+
+/** <summary>Drops every cached series</summary> */
+void SeriesCache::clear(void) {
+	EntryList dropped;
+
+	{
+		boost::lock_guard<boost::mutex> lock(my_mutex);
+		my_stats.invalidations += my_entries.size();
+		dropped.swap(my_entries);
+		my_by_key.clear();
+	}
+}
+
+/** <summary>Sets the number of series the cache may keep open, and drops the least recently opened ones above it</summary> */
+void SeriesCache::setCapacity(size_t _capacity) {
+	{
+		boost::lock_guard<boost::mutex> lock(my_mutex);
+		my_capacity = _capacity;
+	}
+	shrinkTo(_capacity);
+}
+
+/** <summary>Returns the number of series the cache may keep open</summary> */
+size_t SeriesCache::capacity(void) {
+	boost::lock_guard<boost::mutex> lock(my_mutex);
+	return my_capacity;
+}
+
+/** <summary>Returns the number of series the cache has open</summary> */
+size_t SeriesCache::size(void) {
+	boost::lock_guard<boost::mutex> lock(my_mutex);
+	return my_entries.size();
+}
+
+/** <summary>Returns a copy of the statistics of the cache</summary> */
+tsdb::SeriesCacheStats SeriesCache::stats(void) {
+	boost::lock_guard<boost::mutex> lock(my_mutex);
+	return my_stats;
+}
+
+/** <summary>Returns the cache that the bindings use</summary>
+ * <remarks>It is never destroyed, since the HDF5 library may already be shut down when the program
+ * exits. Clear it before calling H5close().</remarks>
+ */
+tsdb::SeriesCache& SeriesCache::global(void) {
+	static SeriesCache* cache = new SeriesCache();
+	return *cache;
+}
+
+/** <summary>Drops the least recently opened series until at most <c>nentries</c> are cached</summary> */
+void SeriesCache::shrinkTo(size_t nentries) {
+	std::vector<boost::shared_ptr<tsdb::Timeseries> > dropped;
+
+	{
+		boost::lock_guard<boost::mutex> lock(my_mutex);
+		while(my_entries.size() > nentries) {
+			dropped.push_back(my_entries.back().second);
+			my_by_key.erase(my_entries.back().first);
+			my_entries.pop_back();
+			my_stats.evictions++;
+		}
+	}
+}
+
+} // namespace tsdb
@@ -0,0 +1,93 @@
+#pragma once
+
+/* STL Classes */
+#include <string>
+#include <list>
+#include <map>
+#include <utility>
+#include <stddef.h>
+
+/* External Libraries */
+#include "hdf5.h"
+#include "boost/shared_ptr.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/locks.hpp"
+
+/* TSDB Includes */
+#include "tsdb.h"
+
+namespace tsdb {
+
+/* Forward declarations */
+class Timeseries;
+
+/* -----------------------------------------------------------------
+ * SeriesCacheStats. What a SeriesCache has done so far.
+ * -----------------------------------------------------------------
+ */
+struct SeriesCacheStats
+{
+	SeriesCacheStats(void): hits(0), misses(0), evictions(0), invalidations(0) {}
+
+	size_t hits;           // calls to open() that were given a cached Timeseries
+	size_t misses;         // ... that had to open the Timeseries
+	size_t evictions;      // Timeseries dropped because the cache was full
+	size_t invalidations;  // Timeseries dropped by invalidate(), invalidateLocation() or clear()
+};
+
+/* -----------------------------------------------------------------
+ * SeriesCache. Keeps opened Timeseries for reuse.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>Keeps Timeseries open, keyed by the location and name they were opened with</summary>
+ * <remarks><p>Opening a Timeseries opens its group and data table, reads the attributes of every field to
+ * rebuild the Structure, and opens the index chain and zone map. open() does that once per series and
+ * hands out the same Timeseries afterwards, along with its in-memory index, until the series is
+ * invalidated or evicted. This is meant for the bindings, where every call names a series by file id and
+ * name.</p>
+ * <p>The key is the <c>hid_t</c> the series was opened at, so the entries of a file must be dropped with
+ * invalidateLocation() before the file is closed; a cached Timeseries keeps its handles open, and HDF5
+ * would keep the file open with them. Writes through the cached Timeseries keep it current. Anything that
+ * changes a series some other way must invalidate() it.</p>
+ * <p>The cache holds at most capacity() series, and drops the least recently opened one when it is full.
+ * A Timeseries handed out stays valid after it is dropped, for as long as the caller holds it. The
+ * bindings use global(). A SeriesCache is thread safe, but the Timeseries it hands out are not.</p></remarks>
+ */
+class SeriesCache
+{
+public:
+	SeriesCache(size_t _capacity = SERIES_CACHE_ENTRIES);
+	~SeriesCache(void);
+
+	boost::shared_ptr<tsdb::Timeseries> open(hid_t loc_id, const std::string& name);
+	void invalidate(hid_t loc_id, const std::string& name);
+	void invalidateLocation(hid_t loc_id);
+	void clear(void);
+
+	void setCapacity(size_t _capacity);
+	size_t capacity(void);
+	size_t size(void);
+	tsdb::SeriesCacheStats stats(void);
+
+	static tsdb::SeriesCache& global(void);
+
+private:
+	/* SeriesCaches hold a mutex, so they can't be copied */
+	SeriesCache(const SeriesCache&);
+	SeriesCache& operator=(const SeriesCache&);
+
+	typedef std::pair<hid_t, std::string> Key;
+	typedef std::pair<Key, boost::shared_ptr<tsdb::Timeseries> > Entry;
+	typedef std::list<Entry> EntryList;
+
+	void shrinkTo(size_t nentries);
+
+	boost::mutex my_mutex;
+	size_t my_capacity;
+	EntryList my_entries;                              // most recently opened first
+	std::map<Key, EntryList::iterator> my_by_key;
+	tsdb::SeriesCacheStats my_stats;
+};
+
+} // namespace tsdb
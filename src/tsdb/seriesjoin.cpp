@@ -0,0 +1,204 @@
+/* STL includes */
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <string.h>
+
+/* TSDB includes */
+#include "seriesjoin.h"
+#include "timeseries.h"
+#include "bufferedrecordset.h"
+
+namespace tsdb {
+
+/* ====================================================================
+ * class MergeCursor - merges the records of many cursors by timestamp
+ * ====================================================================
+ */
+
+/** <summary>Creates a cursor over no records</summary> */
+MergeCursor::MergeCursor(void): my_current(0), my_started(false) {}
+
+/** <summary>Creates a cursor over the records of <c>_sources</c></summary>
+ * <remarks>The cursor steps its own copies of the sources. Throws a SeriesJoinException if a source goes
+ * backward.</remarks>
+ */
+MergeCursor::MergeCursor(const std::vector<tsdb::RecordCursor>& _sources):
+	my_sources(_sources), my_current(0), my_started(false) {
+	for(size_t i = 0; i < my_sources.size(); i++) {
+		if(!my_sources[i].forward()) {
+			throw SeriesJoinException("Can not merge a backward cursor.");
+		}
+	}
+	my_heap.reserve(my_sources.size());
+	for(size_t i = 0; i < my_sources.size(); i++) {
+		if(my_sources[i].next()) {
+			pushSource(i);
+		}
+	}
+}
+
+/** <summary>Moves to the earliest record not returned yet. Returns false when there are no more.</summary> */
+bool MergeCursor::next(void) {
+	// The current record stays in its source's buffer until now, so only advance its source here
+	if(my_started && my_sources[my_current].next()) {
+		pushSource(my_current);
+	}
+	if(my_heap.empty()) {
+		return false;
+	}
+	std::pop_heap(my_heap.begin(), my_heap.end(), HeadAfter());
+	my_current = my_heap.back().source;
+	my_heap.pop_back();
+	my_started = true;
+	return true;
+}
+
+/** <summary>Returns the number of sources</summary> */
+size_t MergeCursor::sources(void) const {
+	return my_sources.size();
+}
+
+/** <summary>Returns the Structure of source <c>isource</c>, which is empty if the source has no records</summary> */
+const boost::shared_ptr<tsdb::Structure>& MergeCursor::structure(size_t isource) const {
+	return my_sources.at(isource).structure();
+}
+
+void MergeCursor::pushSource(size_t isource) {
+	Head head;
+	head.timestamp = my_sources[isource].record().timestamp();
+	head.source = isource;
+	my_heap.push_back(head);
+	std::push_heap(my_heap.begin(), my_heap.end(), HeadAfter());
+}
+
+/* ====================================================================
+ * class AsofJoinCursor - joins each left record to the latest right one
+ * ====================================================================
+ */
+
+/** <summary>Creates a cursor over no records</summary> */
+AsofJoinCursor::AsofJoinCursor(void): my_tolerance(-1), my_right_offsets(NULL), my_right_pending(false),
+	my_has_match(false), my_match_timestamp(0), my_matched(false) {}
+
+/** <summary>Creates a join of <c>_left</c> to <c>_right</c></summary>
+ * <param name="_left">The records to return, in order</param>
+ * <param name="_right">The records to match to them. To match the first left records, this should
+ * start at or before the first of them.</param>
+ * <param name="_tolerance">Largest distance, in milliseconds, from a left record back to its match;
+ * negative for no limit</param>
+ */
+AsofJoinCursor::AsofJoinCursor(const tsdb::RecordCursor& _left, const tsdb::RecordCursor& _right,
+	tsdb::timestamp_t _tolerance): my_left(_left), my_right(_right), my_tolerance(_tolerance),
+	my_right_offsets(NULL), my_right_pending(false), my_has_match(false), my_match_timestamp(0),
+	my_matched(false) {
+	if(!my_left.forward() || !my_right.forward()) {
+		throw SeriesJoinException("Can not join a backward cursor.");
+	}
+	if(my_right.size() > 0) {
+		const boost::shared_ptr<tsdb::Structure>& structure = my_right.structure();
+		my_right_offsets = structure->getOffsetOfFieldsAsArray();
+		for(size_t i = 0; i < structure->getNFields(); i++) {
+			my_right_types.push_back(structure->getField(i)->getFieldType());
+		}
+		my_match.resize(structure->getSizeOf());
+	}
+}
+
+/** <summary>Moves to the next left record, and finds its match. Returns false when there are no more.</summary> */
+bool AsofJoinCursor::next(void) {
+	if(!my_left.next()) {
+		return false;
+	}
+	tsdb::timestamp_t timestamp = my_left.record().timestamp();
+
+	// Take every right record up to the left timestamp; the last one taken is the match
+	while(my_right_pending || my_right.next()) {
+		tsdb::RecordView candidate = my_right.record();
+		if(candidate.timestamp() > timestamp) {
+			my_right_pending = true;
+			break;
+		}
+		my_right_pending = false;
+		memcpy(&my_match[0], candidate.raw(), my_match.size());
+		my_match_timestamp = candidate.timestamp();
+		my_has_match = true;
+	}
+
+	my_matched = my_has_match && (my_tolerance < 0 || timestamp - my_match_timestamp <= my_tolerance);
+	return true;
+}
+
+/** <summary>Returns the Structure of the left records, which is empty if there are none</summary> */
+const boost::shared_ptr<tsdb::Structure>& AsofJoinCursor::leftStructure(void) const {
+	return my_left.structure();
+}
+
+/** <summary>Returns the Structure of the right records, which is empty if there are none</summary> */
+const boost::shared_ptr<tsdb::Structure>& AsofJoinCursor::rightStructure(void) const {
+	return my_right.structure();
+}
+
+/* ====================================================================
+ * Operators on Timeseries
+ * ====================================================================
+ */
+
+/** <summary>Merges the records of many Timeseries between two timestamps (inclusive) in timestamp order</summary>
+ * <remarks>Source <c>i</c> of the MergeCursor is <c>series[i]</c>. The series do not need to have the
+ * same fields; use MergeCursor::structure() to read the records of each.</remarks>
+ * <param name="series">The series to merge, which must stay open while the cursor is used</param>
+ * <param name="start">First timestamp to include</param>
+ * <param name="end">Last timestamp to include</param>
+ */
+tsdb::MergeCursor mergeSeries(const std::vector<tsdb::Timeseries*>& series, tsdb::timestamp_t start,
+	tsdb::timestamp_t end) {
+	std::vector<tsdb::RecordCursor> sources;
+	sources.reserve(series.size());
+	for(size_t i = 0; i < series.size(); i++) {
+		tsdb::BufferedRecordSet records = series[i]->bufferedRecordSet(start, end);
+		records.setBufferSize(BUFFER_BYTES, BUFFER_BYTES);
+		sources.push_back(tsdb::RecordCursor(records));
+	}
+	return tsdb::MergeCursor(sources);
+}
+
+/** <summary>Joins the records of <c>left</c> between two timestamps (inclusive) to the latest records of
+ * <c>right</c> at or before them</summary>
+ * <remarks>The right records start at the last one at or before <c>start</c>, so that the first left
+ * records are matched to the record that prevailed at <c>start</c>.</remarks>
+ * <param name="left">The series to return the records of</param>
+ * <param name="right">The series to match them to</param>
+ * <param name="start">First timestamp to include</param>
+ * <param name="end">Last timestamp to include</param>
+ * <param name="tolerance">Largest distance, in milliseconds, from a left record back to its match;
+ * negative for no limit</param>
+ */
+tsdb::AsofJoinCursor asofJoin(tsdb::Timeseries& left, tsdb::Timeseries& right, tsdb::timestamp_t start,
+	tsdb::timestamp_t end, tsdb::timestamp_t tolerance) {
+	tsdb::RecordCursor left_cursor = left.cursor(start, end);
+	if(left_cursor.size() == 0) {
+		return tsdb::AsofJoinCursor();
+	}
+
+	// The right records run from the one that prevailed at start up to the last one at or before end
+	tsdb::RecordCursor right_cursor;
+	hsize_t first = 0;
+	hsize_t last = 0;
+	if(right.recordId_LE(start, &first) == -1 && right.recordId_GE(start, &first) == -1) {
+		return tsdb::AsofJoinCursor(left_cursor, right_cursor, tolerance);
+	}
+	hsize_t after = 0;
+	if(end == std::numeric_limits<tsdb::timestamp_t>::max() || right.recordId_GE(end + 1, &after) == -1) {
+		last = right.getNRecords() - 1;
+	} else if(after > first) {
+		last = after - 1;
+	} else {
+		return tsdb::AsofJoinCursor(left_cursor, right_cursor, tolerance);
+	}
+	right_cursor = right.cursor(first, last);
+
+	return tsdb::AsofJoinCursor(left_cursor, right_cursor, tolerance);
+}
+
+} // namespace tsdb
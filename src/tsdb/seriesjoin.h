@@ -0,0 +1,144 @@
+#pragma once
+
+/* STL Classes */
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+/* External Libraries */
+#include "hdf5.h"
+#include <boost/shared_ptr.hpp>
+
+/* TSDB Includes */
+#include "tsdb.h"
+#include "structure.h"
+#include "recordcursor.h"
+
+namespace tsdb {
+
+class Timeseries;
+
+/* -----------------------------------------------------------------
+ * SeriesJoinException. For runtime errors thrown by a MergeCursor
+ * or an AsofJoinCursor.
+ * -----------------------------------------------------------------
+ */
+class  SeriesJoinException:
+	public std::runtime_error
+{
+public:
+	SeriesJoinException(const std::string& what):
+	  std::runtime_error(std::string("SeriesJoinException: ") + what) {}
+};
+
+/* -----------------------------------------------------------------
+ * MergeCursor. Merges the records of many cursors by timestamp.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>Walks through the records of many forward RecordCursors in timestamp order</summary>
+ * <remarks><p>The cursor keeps the current record of each source in a heap, so each step costs one
+ * step of a source cursor and <c>O(log k)</c> comparisons for <c>k</c> sources. Every record is read
+ * once, and nothing is copied: record() is a view into the buffer of the source it came from, and
+ * source() is the index of that source. Records with the same timestamp come out in the order of their
+ * sources, and records of one source keep their order.</p>
+ * <p>Memory is one buffer per source; mergeSeries() keeps the buffers at BUFFER_BYTES, since a merge
+ * moves back and forth between its sources rather than scanning any one of them.</p>
+ * <p>The usual loop is <c>while(merge.next()) { ... merge.source() ... merge.record() ... }</c>. As with
+ * a RecordCursor, the Timeseries of the sources must stay open while the cursor is used.</p></remarks>
+ */
+class MergeCursor
+{
+public:
+	MergeCursor(void);
+	MergeCursor(const std::vector<tsdb::RecordCursor>& _sources);
+
+	bool next(void);
+
+	/** <summary>Returns the current record. Only valid after next() returned true.</summary> */
+	tsdb::RecordView record(void) const { return my_sources[my_current].record(); }
+
+	/** <summary>Returns the index of the source of the current record</summary> */
+	size_t source(void) const { return my_current; }
+
+	size_t sources(void) const;
+	const boost::shared_ptr<tsdb::Structure>& structure(size_t isource) const;
+
+private:
+	struct Head {
+		tsdb::timestamp_t timestamp;
+		size_t source;
+	};
+	struct HeadAfter {
+		bool operator()(const Head& a, const Head& b) const {
+			return a.timestamp > b.timestamp || (a.timestamp == b.timestamp && a.source > b.source);
+		}
+	};
+
+	void pushSource(size_t isource);
+
+	std::vector<tsdb::RecordCursor> my_sources;
+	std::vector<Head> my_heap;	// the next record of each source that has one, earliest on top
+	size_t my_current;			// source of the current record
+	bool my_started;			// false before the first call to next()
+};
+
+/* -----------------------------------------------------------------
+ * AsofJoinCursor. Joins each record of one cursor to the latest
+ * record of another.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>Walks through the records of a left cursor, each joined to the latest record of a right
+ * cursor at or before its timestamp</summary>
+ * <remarks><p>Both cursors go forward once, in step: before each left record, the right cursor is moved
+ * up to the left timestamp, and the last right record it passes is the match. So the join reads every
+ * record of both cursors once, and holds one buffer of each plus a copy of the matched right record,
+ * however long the ranges are. This is the join of trades to the quote that prevailed at each trade.</p>
+ * <p>A left record is matched() if there is a right record at or before it, no more than
+ * <c>tolerance</c> milliseconds earlier. A negative tolerance means no limit. When there is no match,
+ * the left record is still returned, and right() must not be used.</p>
+ * <p>Throws a SeriesJoinException if either cursor goes backward.</p></remarks>
+ */
+class AsofJoinCursor
+{
+public:
+	AsofJoinCursor(void);
+	AsofJoinCursor(const tsdb::RecordCursor& _left, const tsdb::RecordCursor& _right,
+		tsdb::timestamp_t _tolerance = -1);
+
+	bool next(void);
+
+	/** <summary>Returns the current left record. Only valid after next() returned true.</summary> */
+	tsdb::RecordView left(void) const { return my_left.record(); }
+
+	/** <summary>Returns true if the current left record has a right record within the tolerance</summary> */
+	bool matched(void) const { return my_matched; }
+
+	/** <summary>Returns the right record matched to the current left record. Only valid if matched().</summary> */
+	tsdb::RecordView right(void) const {
+		return tsdb::RecordView(&my_match[0], my_right_offsets, &my_right_types[0]);
+	}
+
+	const boost::shared_ptr<tsdb::Structure>& leftStructure(void) const;
+	const boost::shared_ptr<tsdb::Structure>& rightStructure(void) const;
+
+private:
+	tsdb::RecordCursor my_left;
+	tsdb::RecordCursor my_right;
+	tsdb::timestamp_t my_tolerance;
+	const size_t* my_right_offsets;	// owned by the structure of my_right
+	std::vector<tsdb::Field::FieldType> my_right_types;
+	bool my_right_pending;			// my_right is on a record later than the last left record
+	bool my_has_match;				// my_match holds a right record
+	std::vector<char> my_match;		// copy of the latest right record at or before the left record
+	tsdb::timestamp_t my_match_timestamp;
+	bool my_matched;
+};
+
+tsdb::MergeCursor mergeSeries(const std::vector<tsdb::Timeseries*>& series, tsdb::timestamp_t start,
+	tsdb::timestamp_t end);
+tsdb::AsofJoinCursor asofJoin(tsdb::Timeseries& left, tsdb::Timeseries& right, tsdb::timestamp_t start,
+	tsdb::timestamp_t end, tsdb::timestamp_t tolerance);
+
+} // namespace tsdb
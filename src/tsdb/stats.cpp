@@ -0,0 +1,48 @@
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+/* TSDB includes */
+#include "stats.h"
+
+namespace tsdb {
+
+/* ====================================================================
+ * class StatCounter - an always on counter
+ * ====================================================================
+ */
+
+/** <summary>Raises the counter to <c>n</c>, if it is lower</summary> */
+void StatCounter::max(unsigned long long n) {
+	unsigned long long current = my_value.load(boost::memory_order_relaxed);
+	while(current < n && !my_value.compare_exchange_weak(current, n, boost::memory_order_relaxed)) {
+		// compare_exchange_weak() reloaded current; try again
+	}
+}
+
+/* ====================================================================
+ * class StatTimer - times a scope
+ * ====================================================================
+ */
+
+/** <summary>Returns a monotonic time in microseconds, from an arbitrary start</summary> */
+unsigned long long StatTimer::now(void) {
+#ifdef WIN32
+	static LARGE_INTEGER frequency;
+	if(frequency.QuadPart == 0) {
+		QueryPerformanceFrequency(&frequency);
+	}
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return (unsigned long long) (counter.QuadPart / frequency.QuadPart) * 1000000ULL +
+		(unsigned long long) (counter.QuadPart % frequency.QuadPart) * 1000000ULL / frequency.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000ULL + (unsigned long long) ts.tv_nsec / 1000ULL;
+#endif
+}
+
+} // namespace tsdb
@@ -0,0 +1,72 @@
+#pragma once
+
+/* STL Classes */
+#include <string>
+#include <vector>
+#include <utility>
+
+/* Boost */
+#include "boost/atomic.hpp"
+
+namespace tsdb {
+
+/* A list of named counter values, in the order they are reported */
+typedef std::vector<std::pair<std::string, unsigned long long> > StatList;
+
+/* -----------------------------------------------------------------
+ * StatCounter. A counter that any thread can add to.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>An always on counter that any thread can add to without a lock</summary>
+ * <remarks><p>Adding is a single relaxed atomic add, so counters can sit on the hot paths of reads,
+ * lookups and appends in release builds. Counters only promise that every addition is counted; a value
+ * read while other threads add to it is some value the counter passed through.</p>
+ * <p>The classes that keep counters hand out copies of their values as plain structs, such as
+ * TableStats and TimeseriesStats.</p></remarks>
+ */
+class StatCounter
+{
+public:
+	StatCounter(void): my_value(0) {}
+
+	void add(unsigned long long n = 1) { my_value.fetch_add(n, boost::memory_order_relaxed); }
+	void max(unsigned long long n);
+	unsigned long long value(void) const { return my_value.load(boost::memory_order_relaxed); }
+	void reset(void) { my_value.store(0, boost::memory_order_relaxed); }
+
+private:
+	/* A copy would not be atomic with the original, so StatCounters can't be copied */
+	StatCounter(const StatCounter&);
+	StatCounter& operator=(const StatCounter&);
+
+	boost::atomic<unsigned long long> my_value;
+};
+
+/* -----------------------------------------------------------------
+ * StatTimer. Adds the time a scope takes to a StatCounter.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>Adds the microseconds between its construction and destruction to a StatCounter</summary>
+ * <remarks>The clock is monotonic, and reading it costs no system call on Linux or Windows, so timers
+ * are cheap next to the HDF5 calls and lookups they time. They are too coarse for anything much
+ * shorter.</remarks>
+ */
+class StatTimer
+{
+public:
+	StatTimer(tsdb::StatCounter& _counter): my_counter(_counter), my_start(now()) {}
+	~StatTimer(void) { my_counter.add(now() - my_start); }
+
+	static unsigned long long now(void);
+
+private:
+	StatTimer(const StatTimer&);
+	StatTimer& operator=(const StatTimer&);
+
+	tsdb::StatCounter& my_counter;
+	unsigned long long my_start;
+};
+
+} // namespace tsdb
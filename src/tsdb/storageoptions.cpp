@@ -0,0 +1,329 @@
+/* STL includes */
+#include <string>
+
+/* HDF5 Includes */
+#include "hdf5.h"
+#include "hdf5_hl.h"
+
+/* TSDB includes */
+#include "storageoptions.h"
+#include "codec.h"
+
+using namespace std;
+
+namespace tsdb {
+
+/* ====================================================================
+ * class StorageOptions - how a Table is stored on disk
+ * ====================================================================
+ */
+
+/** <summary>Default storage options</summary>
+ * <remarks>The defaults are the layout TSDB has always used: a row layout with chunks of 
+ * 4096 records, deflate level 1 and HDF5's default chunk cache.</remarks>
+ */
+StorageOptions::StorageOptions(void) {
+	my_layout = ROW;
+	my_chunk_records = 4096;
+	my_chunk_bytes = 0;
+	my_compression = DEFLATE;
+	my_compression_level = 1;
+	my_cache_nslots = H5D_CHUNK_CACHE_NSLOTS_DEFAULT;
+	my_cache_nbytes = H5D_CHUNK_CACHE_NBYTES_DEFAULT;
+	my_cache_w0 = H5D_CHUNK_CACHE_W0_DEFAULT;
+	my_cache_set = false;
+}
+
+/** <summary>Sets the layout of the Table</summary> */
+void StorageOptions::setLayout(Layout _layout) {
+	my_layout = _layout;
+}
+
+StorageOptions::Layout StorageOptions::layout(void) const {
+	return my_layout;
+}
+
+/** <summary>Sets the chunk size as a number of records</summary> */
+void StorageOptions::setChunkRecords(hsize_t _chunk_records) {
+	if(_chunk_records == 0) {
+		throw( StorageOptionsException("The chunk size must be at least one record.") );
+	}
+	my_chunk_records = _chunk_records;
+	my_chunk_bytes = 0;
+}
+
+/** <summary>Sets the chunk size in bytes</summary>
+ * <remarks>The number of records per chunk is rounded down, but is at least one.</remarks>
+ */
+void StorageOptions::setChunkBytes(size_t _chunk_bytes) {
+	if(_chunk_bytes == 0) {
+		throw( StorageOptionsException("The chunk size must be at least one byte.") );
+	}
+	my_chunk_bytes = _chunk_bytes;
+}
+
+/** <summary>Returns the number of records per chunk for records of <c>record_size</c> bytes</summary> */
+hsize_t StorageOptions::chunkRecords(size_t record_size) const {
+	if(my_chunk_bytes == 0 || record_size == 0) {
+		return my_chunk_records;
+	}
+
+	hsize_t chunk_records = my_chunk_bytes / record_size;
+	return chunk_records > 0 ? chunk_records : 1;
+}
+
+/** <summary>Sets the filter pipeline</summary>
+ * <param name="_compression">The compression filter</param>
+ * <param name="_level">The compression level. Ignored by NONE and LZ4. For CODEC, the level of the
+ * deflate filter that follows the Codec, or 0 for no deflate.</param>
+ */
+void StorageOptions::setCompression(Compression _compression, int _level) {
+	my_compression = _compression;
+	my_compression_level = _level;
+}
+
+StorageOptions::Compression StorageOptions::compression(void) const {
+	return my_compression;
+}
+
+int StorageOptions::compressionLevel(void) const {
+	return my_compression_level;
+}
+
+/** <summary>Sets the chunk cache used when the Table is opened</summary>
+ * <remarks>See <c>H5Pset_chunk_cache()</c>. <c>_nslots</c> should be a prime number, about 100 times
+ * the number of chunks that fit in <c>_nbytes</c>.</remarks>
+ */
+void StorageOptions::setChunkCache(size_t _nslots, size_t _nbytes, double _w0) {
+	my_cache_nslots = _nslots;
+	my_cache_nbytes = _nbytes;
+	my_cache_w0 = _w0;
+	my_cache_set = true;
+}
+
+/** <summary>Returns a dataset creation property list with the chunking and filters</summary>
+ * <remarks>Throws a StorageOptionsException if the filter is not available.</remarks>
+ * <param name="record_size">Size of the records (or of the values in a column)</param>
+ * <param name="field_type">Type of the values in a column, or UNDEFINED for compound records</param>
+ */
+hid_t StorageOptions::createPropertyList(size_t record_size, Field::FieldType field_type) const {
+	herr_t status;
+	hsize_t chunk_dims = chunkRecords(record_size);
+
+	if(!filterAvailable(my_compression)) {
+		throw( StorageOptionsException("The " + compressionToString(my_compression) + " filter is not available.") );
+	}
+	if(my_compression == CODEC && field_type == Field::UNDEFINED) {
+		throw( StorageOptionsException("The Codec needs the columnar layout.") );
+	}
+
+	hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+	if(dcpl < 0) {
+		throw( StorageOptionsException("Error in H5Pcreate.") );
+	}
+
+	status = H5Pset_chunk(dcpl, 1, &chunk_dims);
+
+	if(status >= 0) {
+		switch(my_compression) {
+		case NONE:
+			break;
+		case DEFLATE:
+			status = H5Pset_deflate(dcpl, my_compression_level);
+			break;
+		case SHUFFLE_DEFLATE:
+			status = H5Pset_shuffle(dcpl);
+			if(status >= 0) {
+				status = H5Pset_deflate(dcpl, my_compression_level);
+			}
+			break;
+		case LZ4: {
+			unsigned int cd_values[1] = { 0 }; // default block size
+			status = H5Pset_filter(dcpl, LZ4_FILTER_ID, H5Z_FLAG_OPTIONAL, 1, cd_values);
+			break; }
+		case ZSTD: {
+			unsigned int cd_values[1] = { (unsigned int) my_compression_level };
+			status = H5Pset_filter(dcpl, ZSTD_FILTER_ID, H5Z_FLAG_OPTIONAL, 1, cd_values);
+			break; }
+		case BLOSC: {
+			// The first four values are filled in by the filter. Then level, shuffle, blosclz.
+			unsigned int cd_values[7] = { 0, 0, 0, 0, (unsigned int) my_compression_level, 1, 0 };
+			status = H5Pset_filter(dcpl, BLOSC_FILTER_ID, H5Z_FLAG_OPTIONAL, 7, cd_values);
+			break; }
+		case CODEC: {
+			Codec::Kind kind = Codec::kindOf(field_type);
+			if(kind == Codec::NONE) {
+				// Chars and strings are not encoded, so they always get deflate
+				status = H5Pset_deflate(dcpl, my_compression_level > 0 ? my_compression_level : 1);
+				break;
+			}
+			unsigned int cd_values[3] = { Codec::VERSION, (unsigned int) kind, (unsigned int) record_size };
+			status = H5Pset_filter(dcpl, Codec::FILTER_ID, H5Z_FLAG_MANDATORY, 3, cd_values);
+			if(status >= 0 && my_compression_level > 0) {
+				status = H5Pset_deflate(dcpl, my_compression_level);
+			}
+			break; }
+		}
+	}
+
+	if(status < 0) {
+		H5Pclose(dcpl);
+		throw( StorageOptionsException("Error setting up the dataset creation property list.") );
+	}
+
+	return dcpl;
+}
+
+/** <summary>Returns a dataset access property list with the chunk cache settings</summary> */
+hid_t StorageOptions::accessPropertyList(void) const {
+	hid_t dapl = H5Pcreate(H5P_DATASET_ACCESS);
+	if(dapl < 0) {
+		throw( StorageOptionsException("Error in H5Pcreate.") );
+	}
+
+	if(my_cache_set) {
+		if(H5Pset_chunk_cache(dapl, my_cache_nslots, my_cache_nbytes, my_cache_w0) < 0) {
+			H5Pclose(dapl);
+			throw( StorageOptionsException("Error in H5Pset_chunk_cache.") );
+		}
+	}
+
+	return dapl;
+}
+
+/** <summary>Saves the options as attributes of the dataset <c>name</c> at <c>loc_id</c></summary> */
+void StorageOptions::save(hid_t loc_id, const std::string& name) const {
+	herr_t status;
+	unsigned long chunk_records = (unsigned long) my_chunk_records;
+	unsigned long chunk_bytes = (unsigned long) my_chunk_bytes;
+	unsigned long cache[2] = { (unsigned long) my_cache_nslots, (unsigned long) my_cache_nbytes };
+
+	status = H5LTset_attribute_string(loc_id, name.c_str(), "TSDB_LAYOUT", my_layout == COLUMNAR ? "Columnar" : "Row");
+	if(status >= 0) {
+		status = H5LTset_attribute_ulong(loc_id, name.c_str(), "TSDB_CHUNK_RECORDS", &chunk_records, 1);
+	}
+	if(status >= 0) {
+		status = H5LTset_attribute_ulong(loc_id, name.c_str(), "TSDB_CHUNK_BYTES", &chunk_bytes, 1);
+	}
+	if(status >= 0) {
+		status = H5LTset_attribute_string(loc_id, name.c_str(), "TSDB_COMPRESSION",
+			compressionToString(my_compression).c_str());
+	}
+	if(status >= 0) {
+		status = H5LTset_attribute_int(loc_id, name.c_str(), "TSDB_COMPRESSION_LEVEL", &my_compression_level, 1);
+	}
+	if(status >= 0 && my_cache_set) {
+		status = H5LTset_attribute_ulong(loc_id, name.c_str(), "TSDB_CHUNK_CACHE", cache, 2);
+		if(status >= 0) {
+			status = H5LTset_attribute_double(loc_id, name.c_str(), "TSDB_CHUNK_CACHE_W0", &my_cache_w0, 1);
+		}
+	}
+
+	if(status < 0) {
+		throw( StorageOptionsException("Error saving the storage options as attributes.") );
+	}
+}
+
+/** <summary>Loads the options saved with <c>save()</c></summary>
+ * <remarks>Tables created before storage options existed have no such attributes. In that case,
+ * or for any attribute that is missing, the default is used.</remarks>
+ */
+StorageOptions StorageOptions::load(hid_t loc_id, const std::string& name) {
+	StorageOptions options;
+	unsigned long chunk_records, chunk_bytes;
+	unsigned long cache[2];
+	double w0;
+	int level;
+	hsize_t dims;
+	H5T_class_t type_class;
+	size_t attr_size;
+
+	if(H5Aexists_by_name(loc_id, name.c_str(), "TSDB_LAYOUT", H5P_DEFAULT) > 0 &&
+		H5LTget_attribute_info(loc_id, name.c_str(), "TSDB_LAYOUT", &dims, &type_class, &attr_size) >= 0) {
+		string value(attr_size, '\0');
+		if(H5LTget_attribute_string(loc_id, name.c_str(), "TSDB_LAYOUT", &value[0]) >= 0) {
+			options.my_layout = (string(value.c_str()) == "Columnar") ? COLUMNAR : ROW;
+		}
+	}
+
+	if(H5Aexists_by_name(loc_id, name.c_str(), "TSDB_CHUNK_RECORDS", H5P_DEFAULT) > 0 &&
+		H5LTget_attribute_ulong(loc_id, name.c_str(), "TSDB_CHUNK_RECORDS", &chunk_records) >= 0) {
+		options.my_chunk_records = chunk_records;
+	}
+
+	if(H5Aexists_by_name(loc_id, name.c_str(), "TSDB_CHUNK_BYTES", H5P_DEFAULT) > 0 &&
+		H5LTget_attribute_ulong(loc_id, name.c_str(), "TSDB_CHUNK_BYTES", &chunk_bytes) >= 0) {
+		options.my_chunk_bytes = (size_t) chunk_bytes;
+	}
+
+	if(H5Aexists_by_name(loc_id, name.c_str(), "TSDB_COMPRESSION", H5P_DEFAULT) > 0 &&
+		H5LTget_attribute_info(loc_id, name.c_str(), "TSDB_COMPRESSION", &dims, &type_class, &attr_size) >= 0) {
+		string value(attr_size, '\0');
+		if(H5LTget_attribute_string(loc_id, name.c_str(), "TSDB_COMPRESSION", &value[0]) >= 0) {
+			options.my_compression = compressionFromString(string(value.c_str()));
+		}
+	}
+
+	if(H5Aexists_by_name(loc_id, name.c_str(), "TSDB_COMPRESSION_LEVEL", H5P_DEFAULT) > 0 &&
+		H5LTget_attribute_int(loc_id, name.c_str(), "TSDB_COMPRESSION_LEVEL", &level) >= 0) {
+		options.my_compression_level = level;
+	}
+
+	if(H5Aexists_by_name(loc_id, name.c_str(), "TSDB_CHUNK_CACHE", H5P_DEFAULT) > 0 &&
+		H5LTget_attribute_ulong(loc_id, name.c_str(), "TSDB_CHUNK_CACHE", cache) >= 0 &&
+		H5LTget_attribute_double(loc_id, name.c_str(), "TSDB_CHUNK_CACHE_W0", &w0) >= 0) {
+		options.setChunkCache((size_t) cache[0], (size_t) cache[1], w0);
+	}
+
+	return options;
+}
+
+/** <summary>Checks if the filter for <c>_compression</c> can be used</summary> */
+bool StorageOptions::filterAvailable(Compression _compression) {
+	switch(_compression) {
+	case NONE:
+		return true;
+	case DEFLATE:
+		return H5Zfilter_avail(H5Z_FILTER_DEFLATE) > 0;
+	case SHUFFLE_DEFLATE:
+		return H5Zfilter_avail(H5Z_FILTER_DEFLATE) > 0 && H5Zfilter_avail(H5Z_FILTER_SHUFFLE) > 0;
+	case LZ4:
+		return H5Zfilter_avail(LZ4_FILTER_ID) > 0;
+	case ZSTD:
+		return H5Zfilter_avail(ZSTD_FILTER_ID) > 0;
+	case BLOSC:
+		return H5Zfilter_avail(BLOSC_FILTER_ID) > 0;
+	case CODEC:
+		return Codec::registerFilter() && H5Zfilter_avail(H5Z_FILTER_DEFLATE) > 0;
+	}
+	return false;
+}
+
+std::string StorageOptions::compressionToString(Compression _compression) {
+	switch(_compression) {
+	case NONE: return "None";
+	case DEFLATE: return "Deflate";
+	case SHUFFLE_DEFLATE: return "ShuffleDeflate";
+	case LZ4: return "LZ4";
+	case ZSTD: return "Zstd";
+	case BLOSC: return "Blosc";
+	case CODEC: return "Codec";
+	}
+	return "Unknown";
+}
+
+/** <summary>Parses the names returned by <c>compressionToString()</c></summary>
+ * <remarks>Throws a StorageOptionsException if the name is not recognized.</remarks>
+ */
+StorageOptions::Compression StorageOptions::compressionFromString(const std::string& _compression) {
+	if(_compression == "None") { return NONE; }
+	if(_compression == "Deflate") { return DEFLATE; }
+	if(_compression == "ShuffleDeflate") { return SHUFFLE_DEFLATE; }
+	if(_compression == "LZ4") { return LZ4; }
+	if(_compression == "Zstd") { return ZSTD; }
+	if(_compression == "Blosc") { return BLOSC; }
+	if(_compression == "Codec") { return CODEC; }
+	throw( StorageOptionsException("Unknown compression: " + _compression) );
+}
+
+} // namespace tsdb
@@ -0,0 +1,117 @@
+#pragma once
+
+/* STL Classes */
+#include <string>
+#include <stdexcept>
+
+/* External Libraries */
+#include "hdf5.h"
+
+/* TSDB Includes */
+#include "field.h"
+
+namespace tsdb {
+
+/* -----------------------------------------------------------------
+ * StorageOptionsException. For runtime errors thrown by the
+ * StorageOptions class.
+ * -----------------------------------------------------------------
+ */
+class  StorageOptionsException:
+	public std::runtime_error
+{
+public:
+
+	StorageOptionsException(const std::string& what):
+	  std::runtime_error(std::string("StorageOptionsException: ") + what) {}
+
+};
+
+/* -----------------------------------------------------------------
+ * StorageOptions. How a Table is laid out on disk.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>Describes how a Table is stored in the HDF5 file</summary>
+ * <remarks><p>StorageOptions set the chunk size, the filter pipeline and the chunk cache of a Table.
+ * They are passed to a Table or Timeseries when it is created, and saved as attributes of the
+ * dataset, so a Table that is opened later gets the same chunk cache settings and indexes created
+ * later on get the same layout.</p>
+ * <p>The chunk size can be given in records or in bytes. When it is given in bytes, the number of
+ * records per chunk depends on the size of the record.</p>
+ * <p>The layout is either ROW, where the Table is a single HDF5 table of compound records, or
+ * COLUMNAR, where the Table is a group holding one 1-D dataset per field. A columnar Table can read a
+ * subset of the fields without reading or decompressing the others.</p>
+ * <p>The LZ4, Zstd and Blosc filters are not part of HDF5. They are only usable if the filter plugin
+ * is installed (see HDF5_PLUGIN_PATH); use <c>filterAvailable()</c> to check.</p>
+ * <p>CODEC encodes each column with the TSDB Codec (delta-of-delta timestamps, XOR doubles and zig-zag
+ * integers), followed by deflate at the compression level unless the level is 0. It needs the COLUMNAR
+ * layout, since the encoding depends on the type of the field.</p></remarks>
+ */
+class StorageOptions
+{
+public:
+	enum Compression {
+		NONE,
+		DEFLATE,
+		SHUFFLE_DEFLATE,
+		LZ4,
+		ZSTD,
+		BLOSC,
+		CODEC
+	};
+
+	enum Layout {
+		ROW,
+		COLUMNAR
+	};
+
+	/* Registered ids of the third-party filters */
+	static const H5Z_filter_t LZ4_FILTER_ID = 32004;
+	static const H5Z_filter_t ZSTD_FILTER_ID = 32015;
+	static const H5Z_filter_t BLOSC_FILTER_ID = 32001;
+
+	StorageOptions(void);
+
+	/* Layout */
+	void setLayout(Layout _layout);
+	Layout layout(void) const;
+
+	/* Chunking */
+	void setChunkRecords(hsize_t _chunk_records);
+	void setChunkBytes(size_t _chunk_bytes);
+	hsize_t chunkRecords(size_t record_size) const;
+
+	/* Filters */
+	void setCompression(Compression _compression, int _level = 1);
+	Compression compression(void) const;
+	int compressionLevel(void) const;
+
+	/* Chunk cache */
+	void setChunkCache(size_t _nslots, size_t _nbytes, double _w0);
+
+	/* Property lists for H5Dcreate/H5Dopen. The caller closes them. */
+	hid_t createPropertyList(size_t record_size, Field::FieldType field_type = Field::UNDEFINED) const;
+	hid_t accessPropertyList(void) const;
+
+	/* Persistence as attributes of a dataset */
+	void save(hid_t loc_id, const std::string& name) const;
+	static StorageOptions load(hid_t loc_id, const std::string& name);
+
+	static bool filterAvailable(Compression _compression);
+	static std::string compressionToString(Compression _compression);
+	static Compression compressionFromString(const std::string& _compression);
+
+private:
+	Layout my_layout;
+	hsize_t my_chunk_records;  // used when my_chunk_bytes is 0
+	size_t my_chunk_bytes;
+	Compression my_compression;
+	int my_compression_level;
+	size_t my_cache_nslots;
+	size_t my_cache_nbytes;
+	double my_cache_w0;
+	bool my_cache_set;
+};
+
+} // namespace tsdb
@@ -7,6 +7,7 @@
 
 /* External Libraries */
 #include "hdf5.h"
+#include <boost/shared_ptr.hpp>
 
 /* TSDB Includes */
 #include "field.h"
@@ -55,6 +56,7 @@ public:
 	size_t getSizeOfField(size_t n);
 	Field* getField(size_t n);
 	size_t getFieldIndexByName(std::string field_name);
+	boost::shared_ptr<tsdb::Structure> project(const std::vector<std::string>& field_names);
 
 	/* Methods to access a block of memory using the Structure definition */
 	void* pointerToMember(const void *struct_start, size_t ifield);
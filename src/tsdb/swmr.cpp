@@ -0,0 +1,123 @@
+/* STL includes */
+#include <string>
+
+/* HDF5 Includes */
+#include "hdf5.h"
+
+/* TSDB includes */
+#include "swmr.h"
+#include "hdf5lock.h"
+
+namespace tsdb {
+
+/* ====================================================================
+ * class Swmr - single writer/multiple reader access to files
+ * ====================================================================
+ */
+
+/** <summary>Returns a new file access property list with the latest file format, which SWMR needs</summary>
+ * <remarks>The caller closes it with <c>H5Pclose()</c>.</remarks>
+ */
+hid_t Swmr::fileAccessList(void) {
+#ifdef TSDB_HAVE_SWMR
+	HDF5Lock lock;
+	hid_t fapl = H5Pcreate(H5P_FILE_ACCESS);
+	if(fapl < 0 || H5Pset_libver_bounds(fapl, H5F_LIBVER_LATEST, H5F_LIBVER_LATEST) < 0) {
+		if(fapl >= 0) {
+			H5Pclose(fapl);
+		}
+		throw( SwmrException("Error in H5Pset_libver_bounds.") );
+	}
+	return fapl;
+#else
+	throw( SwmrException("SWMR needs HDF5 1.10 or later.") );
+#endif
+}
+
+/** <summary>Creates a file with the latest file format, and returns its id</summary>
+ * <remarks>Throws a SwmrException if the file exists or can not be created.</remarks>
+ */
+hid_t Swmr::createFile(const std::string& filename) {
+	hid_t fapl = fileAccessList();
+	HDF5Lock lock;
+	hid_t file_id = H5Fcreate(filename.c_str(), H5F_ACC_EXCL, H5P_DEFAULT, fapl);
+	H5Pclose(fapl);
+	if(file_id < 0) {
+		throw( SwmrException("Unable to create '" + filename + "'.") );
+	}
+	return file_id;
+}
+
+/** <summary>Opens a file read-write with the latest file format, ready for startWrite()</summary> */
+hid_t Swmr::openForWrite(const std::string& filename) {
+	hid_t fapl = fileAccessList();
+	HDF5Lock lock;
+	hid_t file_id = H5Fopen(filename.c_str(), H5F_ACC_RDWR, fapl);
+	H5Pclose(fapl);
+	if(file_id < 0) {
+		throw( SwmrException("Unable to open '" + filename + "'.") );
+	}
+	return file_id;
+}
+
+/** <summary>Lets readers in: from now on, the file can only be appended to</summary> */
+void Swmr::startWrite(hid_t file_id) {
+#ifdef TSDB_HAVE_SWMR
+	HDF5Lock lock;
+	if(H5Fstart_swmr_write(file_id) < 0) {
+		throw( SwmrException("Error in H5Fstart_swmr_write. Was the file opened with the latest format?") );
+	}
+#else
+	throw( SwmrException("SWMR needs HDF5 1.10 or later.") );
+#endif
+}
+
+/** <summary>Opens a file read only, to read it while a writer appends to it</summary> */
+hid_t Swmr::openForRead(const std::string& filename) {
+#ifdef TSDB_HAVE_SWMR
+	hid_t fapl = fileAccessList();
+	HDF5Lock lock;
+	hid_t file_id = H5Fopen(filename.c_str(), H5F_ACC_RDONLY | H5F_ACC_SWMR_READ, fapl);
+	H5Pclose(fapl);
+	if(file_id < 0) {
+		throw( SwmrException("Unable to open '" + filename + "' for SWMR reading.") );
+	}
+	return file_id;
+#else
+	throw( SwmrException("SWMR needs HDF5 1.10 or later.") );
+#endif
+}
+
+/** <summary>Returns true if the file of <c>loc_id</c> has been opened with startWrite()</summary> */
+bool Swmr::isWriting(hid_t loc_id) {
+#ifdef TSDB_HAVE_SWMR
+	return (intent(loc_id) & H5F_ACC_SWMR_WRITE) != 0;
+#else
+	return false;
+#endif
+}
+
+/** <summary>Returns true if the file of <c>loc_id</c> has been opened with openForRead()</summary> */
+bool Swmr::isReading(hid_t loc_id) {
+#ifdef TSDB_HAVE_SWMR
+	return (intent(loc_id) & H5F_ACC_SWMR_READ) != 0;
+#else
+	return false;
+#endif
+}
+
+/** <summary>Returns the access flags of the file of <c>loc_id</c>, or 0 if they can't be read</summary> */
+unsigned int Swmr::intent(hid_t loc_id) {
+	HDF5Lock lock;
+	unsigned int flags = 0;
+	hid_t file_id = H5Iget_file_id(loc_id);
+	if(file_id >= 0) {
+		if(H5Fget_intent(file_id, &flags) < 0) {
+			flags = 0;
+		}
+		H5Fclose(file_id);
+	}
+	return flags;
+}
+
+} // namespace tsdb
@@ -0,0 +1,66 @@
+#pragma once
+
+/* STL Classes */
+#include <string>
+#include <stdexcept>
+
+/* External Libraries */
+#include "hdf5.h"
+
+/* Single writer/multiple reader access is new in HDF5 1.10 */
+#if (H5_VERS_MAJOR > 1) || (H5_VERS_MAJOR == 1 && H5_VERS_MINOR >= 10)
+	#define TSDB_HAVE_SWMR
+#endif
+
+namespace tsdb {
+
+/* -----------------------------------------------------------------
+ * SwmrException. For runtime errors thrown by Swmr.
+ * -----------------------------------------------------------------
+ */
+class  SwmrException:
+	public std::runtime_error
+{
+public:
+	SwmrException(const std::string& what):
+	  std::runtime_error(std::string("SwmrException: ") + what) {}
+};
+
+/* -----------------------------------------------------------------
+ * Swmr. Opens files for HDF5 single writer/multiple reader access.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>Opens files so that one process can append to them while others read them</summary>
+ * <remarks><p>With HDF5 SWMR, readers open the file with openForRead() while a writer appends to it,
+ * without locks or copies. The writer:</p>
+ * <list type="number">
+ * <item>opens the file with openForWrite() (or makes it with createFile()),</item>
+ * <item>creates or opens its series, and calls Timeseries::prepareSwmrWrite() on each,</item>
+ * <item>calls startWrite(), and then only appends.</item>
+ * </list>
+ * <p>Once writing has started, no new HDF5 objects can be made in the file, which is why
+ * prepareSwmrWrite() creates the index and zone map of a series up front, and data can't be removed, so
+ * Timeseries::truncate() and mergeRecords() fail. The series flush their data at the end of each batch
+ * they append, and readers see the new records after Timeseries::refresh().</p>
+ * <p>The series must have been created in a file opened with the latest file format, as createFile() and
+ * openForWrite() do, because older formats index the chunks of a dataset in a way readers can't follow.
+ * Readers need not be the same process, or even use TSDB.</p>
+ * <p>Without HDF5 1.10, every method throws a SwmrException.</p></remarks>
+ */
+class Swmr
+{
+public:
+	static hid_t fileAccessList(void);
+	static hid_t createFile(const std::string& filename);
+	static hid_t openForWrite(const std::string& filename);
+	static void startWrite(hid_t file_id);
+	static hid_t openForRead(const std::string& filename);
+	static bool isWriting(hid_t loc_id);
+	static bool isReading(hid_t loc_id);
+
+private:
+	static unsigned int intent(hid_t loc_id);
+};
+
+} // namespace tsdb
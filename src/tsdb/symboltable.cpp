@@ -0,0 +1,119 @@
+/* STL includes */
+#include <string>
+#include <vector>
+#include <sstream>
+
+/* TSDB includes */
+#include "symboltable.h"
+
+namespace tsdb {
+
+/* ====================================================================
+ * class SymbolTable - the dictionary of a SymbolField
+ * ====================================================================
+ */
+
+/** <summary>Creates a dictionary that holds only the empty symbol, code 0</summary>
+ * <param name="_max_length">The most characters a symbol may have</param>
+ */
+SymbolTable::SymbolTable(size_t _max_length): my_max_length(_max_length) {
+	my_symbols.add("");
+}
+
+/** <summary>Returns the code of the symbol of <c>size</c> characters at <c>data</c>, adding it if it is new</summary>
+ * <remarks>Throws a SymbolTableException if a new symbol is longer than maxLength().</remarks>
+ */
+tsdb::symbol_t SymbolTable::code(const char* data, size_t size) {
+	boost::mutex::scoped_lock lock(my_mutex);
+
+	long existing = my_symbols.find(data, size);
+	if(existing >= 0) {
+		return (tsdb::symbol_t) existing;
+	}
+
+	if(size > my_max_length) {
+		std::ostringstream msg;
+		msg << "the symbol '" << std::string(data, size) << "' is longer than " << my_max_length << " characters";
+		throw( SymbolTableException(msg.str()) );
+	}
+	return (tsdb::symbol_t) my_symbols.add(std::string(data, size));
+}
+
+/** <summary>Returns the code of <c>symbol</c>, adding it if it is new</summary> */
+tsdb::symbol_t SymbolTable::code(const std::string& symbol) {
+	return code(symbol.data(), symbol.size());
+}
+
+/** <summary>Looks up a symbol without adding it. Returns false if it is not in the dictionary.</summary> */
+bool SymbolTable::find(const char* data, size_t size, tsdb::symbol_t* code) const {
+	boost::mutex::scoped_lock lock(my_mutex);
+
+	long existing = my_symbols.find(data, size);
+	if(existing < 0) {
+		return false;
+	}
+	*code = (tsdb::symbol_t) existing;
+	return true;
+}
+
+/** <summary>Returns the symbol of <c>code</c></summary>
+ * <remarks>Throws a SymbolTableException if there is no such code, as for records written by another
+ * program whose symbols have not been loaded.</remarks>
+ */
+std::string SymbolTable::symbol(tsdb::symbol_t code) const {
+	boost::mutex::scoped_lock lock(my_mutex);
+
+	if(code < 0 || (size_t) code >= my_symbols.size()) {
+		std::ostringstream msg;
+		msg << "there is no symbol with the code " << code;
+		throw( SymbolTableException(msg.str()) );
+	}
+	return my_symbols.value((size_t) code);
+}
+
+/** <summary>Returns the symbols with codes <c>first</c> and up, in the order of their codes</summary> */
+std::vector<std::string> SymbolTable::symbols(size_t first) const {
+	boost::mutex::scoped_lock lock(my_mutex);
+
+	std::vector<std::string> result;
+	for(size_t i = first; i < my_symbols.size(); i++) {
+		result.push_back(my_symbols.value(i));
+	}
+	return result;
+}
+
+/** <summary>Loads symbols saved in a file, the first of which has the code <c>first</c></summary>
+ * <remarks>Symbols the dictionary has already must have the same codes in the file; a Table checks this
+ * when a Structure it is opened or created with already has symbols. Throws a SymbolTableException if
+ * they do not.</remarks>
+ */
+void SymbolTable::load(size_t first, const std::vector<std::string>& symbols) {
+	boost::mutex::scoped_lock lock(my_mutex);
+
+	for(size_t i = 0; i < symbols.size(); i++) {
+		size_t code = first + i;
+		if(code < my_symbols.size()) {
+			if(my_symbols.value(code) != symbols[i]) {
+				std::ostringstream msg;
+				msg << "the symbol with the code " << code << " is '" << my_symbols.value(code) <<
+					"' in memory, but '" << symbols[i] << "' in the file";
+				throw( SymbolTableException(msg.str()) );
+			}
+		} else if(code > my_symbols.size() || my_symbols.add(symbols[i]) != (long) code) {
+			throw( SymbolTableException("the symbols in the file are not in the order of their codes") );
+		}
+	}
+}
+
+/** <summary>Returns the number of symbols, including the empty one</summary> */
+size_t SymbolTable::size(void) const {
+	boost::mutex::scoped_lock lock(my_mutex);
+	return my_symbols.size();
+}
+
+/** <summary>Returns the most characters a symbol may have</summary> */
+size_t SymbolTable::maxLength(void) const {
+	return my_max_length;
+}
+
+} // namespace tsdb
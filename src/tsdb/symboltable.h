@@ -0,0 +1,70 @@
+#pragma once
+
+/* STL Classes */
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+/* External Libraries */
+#include "boost/thread/mutex.hpp"
+
+/* TSDB Includes */
+#include "tsdb.h"
+#include "field.h"
+#include "tokenset.h"
+
+namespace tsdb {
+
+/* -----------------------------------------------------------------
+ * SymbolTableException. For runtime errors thrown by a
+ * SymbolTable.
+ * -----------------------------------------------------------------
+ */
+class  SymbolTableException:
+	public std::runtime_error
+{
+public:
+	SymbolTableException(const std::string& what):
+	  std::runtime_error(std::string("SymbolTableException: ") + what) {}
+};
+
+/* -----------------------------------------------------------------
+ * SymbolTable. The dictionary of a SymbolField.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>The dictionary of a SymbolField: each symbol it has seen, with a small integer code</summary>
+ * <remarks><p>Codes count from 0 in the order the symbols are added, and a symbol keeps its code. Code 0
+ * is the empty symbol, so zeroed records hold it, as zeroed StringFields hold an empty string. Looking
+ * a symbol up hashes it where it is, with a TokenSet, so parsing a token to its code does not copy it.</p>
+ * <p>A SymbolTable is only in memory. The Table of a SymbolField saves its symbols in a dataset of its
+ * own before the records that use them, and loads them when it is opened.</p>
+ * <p>Every method locks a mutex, so parsers on several threads can add symbols to the same SymbolTable.
+ * </p></remarks>
+ */
+class SymbolTable
+{
+public:
+	SymbolTable(size_t _max_length);
+
+	tsdb::symbol_t code(const char* data, size_t size);
+	tsdb::symbol_t code(const std::string& symbol);
+	bool find(const char* data, size_t size, tsdb::symbol_t* code) const;
+	std::string symbol(tsdb::symbol_t code) const;
+	std::vector<std::string> symbols(size_t first) const;
+	void load(size_t first, const std::vector<std::string>& symbols);
+
+	size_t size(void) const;
+	size_t maxLength(void) const;
+
+private:
+	/* SymbolTables hold a mutex, so they can't be copied */
+	SymbolTable(const SymbolTable&);
+	SymbolTable& operator=(const SymbolTable&);
+
+	size_t my_max_length;
+	tsdb::TokenSet my_symbols;      // the symbols, in the order of their codes
+	mutable boost::mutex my_mutex;
+};
+
+} // namespace tsdb
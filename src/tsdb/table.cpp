@@ -2,6 +2,7 @@
 #include <sstream>
 #include <string>
 #include <vector>
+#include <algorithm>
 #include <boost/make_shared.hpp>
 
 /* HDF5 Includes */
@@ -11,6 +12,11 @@
 /* TSDB includes */
 #include "table.h"
 #include "bufferedrecordset.h"
+#include "symboltable.h"
+#include "codec.h"
+#include "hdf5lock.h"
+#include "swmr.h"
+
 
 
 
@@ -31,22 +37,24 @@ namespace tsdb {
  * <param name="new_title">Title of the table</param>
  * <param name="new_name">Name of the table. This must conform to HDF5 naming rules.</param>
  * <param name="new_record_struct">Structure of the Table</param>
+ * <param name="_options">Chunking, filters and chunk cache of the Table</param>
  */
-Table::Table(hid_t _loc_id, std::string _name, std::string _title, boost::shared_ptr<tsdb::Structure> _structure) {
+Table::Table(hid_t _loc_id, std::string _name, std::string _title, boost::shared_ptr<tsdb::Structure> _structure,
+	const tsdb::StorageOptions& _options) {
+	HDF5Lock lock;
+
 	this->my_loc_id = _loc_id;
 	this->my_name = _name;
 	this->my_title = _title;
 	this->my_structure = _structure;
+	this->my_options = _options;
+	this->my_columnar = (_options.layout() == StorageOptions::COLUMNAR);
 
 	herr_t status;
-	status = H5TBmake_table(my_title.c_str(),my_loc_id,my_name.c_str(),
-		my_structure->getNFields(),0,my_structure->getSizeOf(),
-		const_cast<const char**>(my_structure->getNameOfFieldsAsArray()),
-		my_structure->getOffsetOfFieldsAsArray(),my_structure->getTypeOfFieldsAsArray(),4096,NULL,1,NULL);
-
-	/* Check for errors in the make_table command */
-	if(status < 0) {
-		throw( TableException("Error in H5TBmake_table.") );
+	if(my_columnar) {
+		createColumns();
+	} else {
+		createDataset();
 	}
 
 	/* Add some attributes to the table describing the field types */
@@ -61,186 +69,1019 @@ Table::Table(hid_t _loc_id, std::string _name, std::string _title, boost::shared
 			throw( TableException("Error in H5LTset_attribute_string.") );
 		}
 	}
+	saveSchema();
 	
 	// Append buffer is empty until someone tries to append a record
 	my_nappendbuf = 0;
-	
+
+	openDataset();
+	openSymbols();
+}
+
+/** <summary>Creates an empty table dataset using the storage options</summary>
+ * <remarks><p>H5TBmake_table() does not take a dataset creation property list, so the dataset is
+ * created here in the same way, and with the same attributes (CLASS, VERSION, TITLE and FIELD_i_NAME), 
+ * as H5TBmake_table() would. The result is an ordinary HDF5 table that H5TB and other tools can read.</p>
+ * <p>The storage options are saved as attributes as well.</p></remarks>
+ */
+void Table::createDataset(void) {
+	herr_t status;
+	hsize_t dims = 0;
+	hsize_t maxdims = H5S_UNLIMITED;
+
+	hid_t type_id = compoundType(my_structure);
+	hid_t space_id = H5Screate_simple(1, &dims, &maxdims);
+	hid_t dcpl = -1;
+	try {
+		dcpl = my_options.createPropertyList(my_structure->getSizeOf());
+	} catch(StorageOptionsException& e) {
+		H5Sclose(space_id);
+		H5Tclose(type_id);
+		throw( TableException(e.what()) );
+	}
+
+	hid_t dataset_id = H5Dcreate2(my_loc_id, my_name.c_str(), type_id, space_id, H5P_DEFAULT, dcpl, H5P_DEFAULT);
+
+	H5Pclose(dcpl);
+	H5Sclose(space_id);
+	H5Tclose(type_id);
+
+	if(dataset_id < 0) {
+		throw( TableException("Error in H5Dcreate2.") );
+	}
+	H5Dclose(dataset_id);
+
+	/* The attributes of an HDF5 table */
+	status = H5LTset_attribute_string(my_loc_id, my_name.c_str(), "CLASS", "TABLE");
+	if(status >= 0) {
+		status = H5LTset_attribute_string(my_loc_id, my_name.c_str(), "VERSION", "3.0");
+	}
+	if(status >= 0) {
+		status = H5LTset_attribute_string(my_loc_id, my_name.c_str(), "TITLE", my_title.c_str());
+	}
+
+	stringstream field_name_key;
+	for(size_t i = 0; i < my_structure->getNFields() && status >= 0; i++) {
+		field_name_key.str("");
+		field_name_key << "FIELD_" << i << "_NAME";
+		status = H5LTset_attribute_string(my_loc_id, my_name.c_str(), field_name_key.str().c_str(),
+			my_structure->getNameOfFieldsAsArray()[i]);
+	}
+
+	if(status < 0) {
+		throw( TableException("Error in H5LTset_attribute_string.") );
+	}
+
+	try {
+		my_options.save(my_loc_id, my_name);
+	} catch(StorageOptionsException& e) {
+		throw( TableException(e.what()) );
+	}
+}
+
+/** <summary>Creates an empty columnar table using the storage options</summary>
+ * <remarks><p>A columnar table is a group with one chunked 1-D dataset per field. Each dataset is named 
+ * after its field and has the field's type. The group has the TITLE and FIELD_i_NAME attributes of 
+ * an HDF5 table, and the storage options (including TSDB_LAYOUT, which marks the group as a Table).</p>
+ * <p>The chunk size is applied to each column separately, so a chunk size in bytes gives columns of wide
+ * fields fewer records per chunk.</p></remarks>
+ */
+void Table::createColumns(void) {
+	herr_t status;
+	hsize_t dims = 0;
+	hsize_t maxdims = H5S_UNLIMITED;
+
+	hid_t group_id = H5Gcreate2(my_loc_id, my_name.c_str(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+	if(group_id < 0) {
+		throw( TableException("Error in H5Gcreate2.") );
+	}
+
+	hid_t space_id = H5Screate_simple(1, &dims, &maxdims);
+
+	for(size_t i = 0; i < my_structure->getNFields(); i++) {
+		hid_t dcpl = -1;
+		try {
+			dcpl = my_options.createPropertyList(my_structure->getSizeOfField(i), my_structure->getField(i)->getFieldType());
+		} catch(StorageOptionsException& e) {
+			H5Sclose(space_id);
+			H5Gclose(group_id);
+			throw( TableException(e.what()) );
+		}
+
+		hid_t dataset_id = H5Dcreate2(group_id, my_structure->getNameOfFieldsAsArray()[i],
+			my_structure->getTypeOfFieldsAsArray()[i], space_id, H5P_DEFAULT, dcpl, H5P_DEFAULT);
+		H5Pclose(dcpl);
+
+		if(dataset_id < 0) {
+			H5Sclose(space_id);
+			H5Gclose(group_id);
+			throw( TableException("Error in H5Dcreate2.") );
+		}
+		H5Dclose(dataset_id);
+	}
+
+	H5Sclose(space_id);
+	H5Gclose(group_id);
+
+	status = H5LTset_attribute_string(my_loc_id, my_name.c_str(), "TITLE", my_title.c_str());
+
+	stringstream field_name_key;
+	for(size_t i = 0; i < my_structure->getNFields() && status >= 0; i++) {
+		field_name_key.str("");
+		field_name_key << "FIELD_" << i << "_NAME";
+		status = H5LTset_attribute_string(my_loc_id, my_name.c_str(), field_name_key.str().c_str(),
+			my_structure->getNameOfFieldsAsArray()[i]);
+	}
+
+	if(status < 0) {
+		throw( TableException("Error in H5LTset_attribute_string.") );
+	}
+
+	try {
+		my_options.save(my_loc_id, my_name);
+	} catch(StorageOptionsException& e) {
+		throw( TableException(e.what()) );
+	}
 }
 
 /** <summary>Opens an already existing table</summary>
  * <remarks>Opens a new table from <c>tbl_loc_id</c>. If there are errors
- * opening the table or if the table does not exist, this constructor will throw a TableException.</remarks>
+ * opening the table or if the table does not exist, this constructor will throw a TableException.
+ * The Structure is read from the TSDB_SCHEMA attribute, or from the attributes of each field for tables
+ * written before there was one.</remarks>
  * <param name="tbl_loc_id">A HDF5 <c>hid_t</c> specifying the location of the table (either a group id or file id)</param>
  * <param name="tbl_name">Name of the table to open</param>
  */
 Table::Table(hid_t _loc_id, std::string _name) {
-	herr_t status;
-	hsize_t nfields, nrecords;
-	hsize_t i = 0;
-	
+	HDF5Lock lock;
+
 	if(!Table::exists(_loc_id, _name)) {
 		throw( TableException("Table does not exist.") );
 	}
 
-	/* Get information about the table and it's fields */
-	status = H5TBget_table_info(_loc_id, _name.c_str(), &nfields, &nrecords);
-	if(status < 0) {
-		throw( TableException("Error in H5TBget_table_info.") );
-	}
+	// The columns of the table may be encoded with the Codec, which HDF5 does not know about
+	Codec::registerFilter();
+
+	my_columnar = Table::isColumnar(_loc_id, _name);
 
-	size_t * field_sizes = new size_t[(size_t) nfields];
-	size_t * field_offsets = new size_t[(size_t) nfields];
-	size_t type_size;
+	/* Load the table's fields */
 	vector<Field*> fields;
+	vector<size_t> offsets;
+	size_t type_size = 0;
 
-	status = H5TBget_field_info(_loc_id, _name.c_str(), NULL, field_sizes, field_offsets, &type_size);
-	if(status < 0) {
-		throw( TableException("Error in H5TBget_field_info.") );
+	if(!Table::loadSchema(_loc_id, _name, &fields, &offsets, &type_size)) {
+		Table::loadFieldAttributes(_loc_id, _name, my_columnar, &fields, &offsets, &type_size);
 	}
 
 	/* Get the table title */
-	char* tbl_title;
-	hsize_t dims;
-	H5T_class_t type_class;
-	size_t attr_size;
+	string tbl_title;
+	if(!readStringAttribute(_loc_id, _name, "TITLE", &tbl_title)) {
+		for(size_t i = 0; i < fields.size(); i++) {
+			delete fields[i];
+		}
+		throw( TableException("Error in H5LTget_attribute_string. Table might be missing a TITLE attribute") );
+	}
 
-	status = H5LTget_attribute_info(_loc_id,_name.c_str(),"TITLE",&dims,&type_class,&attr_size);
-	if(status < 0) {
-		throw( TableException("Error in H5LTget_attribute_info. Table might be missing a TITLE attribute") );
+	// Set up the table object
+	my_loc_id = _loc_id;
+	my_name = _name;
+	if(my_columnar) {
+		// The layout of records in memory is up to us when the fields are stored separately
+		my_structure = boost::shared_ptr<tsdb::Structure>(new Structure(fields,true));
+	} else {
+		my_structure = boost::shared_ptr<tsdb::Structure>(new Structure(fields,offsets,type_size));
 	}
+	my_title = tbl_title;
 
-	tbl_title = new char[attr_size];
+	// NOTE: we are not cleaning up the individual fields. We pass ownership of them to my_structure.
 
-	status = H5LTget_attribute_string(_loc_id,_name.c_str(),"TITLE",tbl_title);
-	if(status < 0) {
-		throw( TableException("Error in H5LTget_attribute_string. Table might be missing a TITLE attribute") );
+	// Append buffer is empty until we attempt to append a record
+	my_nappendbuf = 0;
+
+	my_options = StorageOptions::load(my_loc_id, my_name);
+	openDataset();
+	openSymbols();
+}
+
+/** <summary>Saves the whole Structure as the TSDB_SCHEMA attribute</summary>
+ * <remarks><p>The attribute is a string with a line <c>version;record size;number of fields</c>, then a
+ * line <c>type;offset;size;name</c> per field, with the type as Field::getTSDBType() gives it. The name
+ * comes last, so it may hold semicolons.</p>
+ * <p>Opening a table then reads one attribute, instead of the FIELD_i_TYPE and FIELD_i_NAME attributes of
+ * each field and the field info of the compound type. Those are still written, for H5TB, other tools and
+ * older versions of TSDB.</p></remarks>
+ */
+void Table::saveSchema(void) {
+	stringstream schema;
+	schema << SCHEMA_VERSION << ";" << my_structure->getSizeOf() << ";" << my_structure->getNFields() << "\n";
+	for(size_t i = 0; i < my_structure->getNFields(); i++) {
+		schema << my_structure->getField(i)->getTSDBType() << ";" << my_structure->getOffsetOfField(i) << ";"
+			<< my_structure->getSizeOfField(i) << ";" << my_structure->getNameOfFieldsAsArray()[i] << "\n";
 	}
 
-	/* Load the table's fields and make its Structure */
-	stringstream field_type_key;
-	stringstream field_name_key;
-	vector<size_t> offsets;
+	if(H5LTset_attribute_string(my_loc_id, my_name.c_str(), "TSDB_SCHEMA", schema.str().c_str()) < 0) {
+		throw( TableException("Error in H5LTset_attribute_string.") );
+	}
+}
 
-	char* field_type_value;
-	char* field_name_value;
-	bool fieldset = false;
-	for(i=0;i<nfields;i++) {
-		/* Get the field type */
-		field_type_key.str("");
-		field_type_key << "FIELD_" << i << "_TYPE";
+/** <summary>Makes the fields of the table <c>name</c> from its TSDB_SCHEMA attribute</summary>
+ * <remarks>Returns false if the table has no TSDB_SCHEMA attribute, and throws a TableException if the
+ * attribute can not be read or parsed. The caller owns the fields.</remarks>
+ */
+bool Table::loadSchema(hid_t loc_id, const std::string& name, std::vector<Field*>* fields,
+	std::vector<size_t>* offsets, size_t* type_size) {
+
+	if(H5Aexists_by_name(loc_id, name.c_str(), "TSDB_SCHEMA", H5P_DEFAULT) <= 0) {
+		return false;
+	}
+
+	string schema;
+	if(!readStringAttribute(loc_id, name, "TSDB_SCHEMA", &schema)) {
+		throw( TableException("Error in H5LTget_attribute_string while getting the schema.") );
+	}
+
+	istringstream lines(schema);
+	string line;
+	int version = 0;
+	size_t nfields = 0;
+	char sep1 = 0, sep2 = 0;
+
+	getline(lines, line);
+	istringstream header(line);
+	if(!(header >> version >> sep1 >> *type_size >> sep2 >> nfields) || sep1 != ';' || sep2 != ';' ||
+		version != SCHEMA_VERSION) {
+		throw( TableException("The TSDB_SCHEMA attribute is malformed, or from a newer version of TSDB.") );
+	}
+
+	for(size_t i = 0; i < nfields; i++) {
+		size_t offset = 0, field_size = 0;
+		string type;
+		Field* field = NULL;
+
+		getline(lines, line);
+		size_t type_end = line.find(';');
+		if(type_end != string::npos) {
+			type = line.substr(0, type_end);
+			istringstream layout(line.substr(type_end + 1));
+			if(layout >> offset >> sep1 >> field_size >> sep2 && sep1 == ';' && sep2 == ';') {
+				field = fieldFromTSDBType(type, line.substr(type_end + 1 + (size_t) layout.tellg()));
+			}
+		}
+
+		if(field == NULL || field->getSizeOf() != field_size || offset + field_size > *type_size) {
+			delete field;
+			for(size_t j = 0; j < fields->size(); j++) {
+				delete fields->at(j);
+			}
+			fields->clear();
+			throw( TableException("The TSDB_SCHEMA attribute is malformed.") );
+		}
+		fields->push_back(field);
+		offsets->push_back(offset);
+	}
+	return true;
+}
+
+/** <summary>Makes the fields of the table <c>name</c> from its FIELD_i_TYPE and FIELD_i_NAME attributes</summary>
+ * <remarks>This is how tables written before the TSDB_SCHEMA attribute are opened. The offsets and the
+ * record size of a row table come from its compound type. The caller owns the fields.</remarks>
+ */
+void Table::loadFieldAttributes(hid_t loc_id, const std::string& name, bool columnar, std::vector<Field*>* fields,
+	std::vector<size_t>* offsets, size_t* type_size) {
 
-		status = H5LTget_attribute_info(_loc_id,_name.c_str(),field_type_key.str().c_str(),&dims,&type_class,&attr_size);
+	herr_t status;
+	hsize_t nfields, nrecords;
+
+	/* Get information about the table and it's fields */
+	if(columnar) {
+		// A columnar table has no compound type, so count the fields from their attributes
+		stringstream field_key;
+		for(nfields = 0; ; nfields++) {
+			field_key.str("");
+			field_key << "FIELD_" << nfields << "_TYPE";
+			if(H5Aexists_by_name(loc_id, name.c_str(), field_key.str().c_str(), H5P_DEFAULT) <= 0) {
+				break;
+			}
+		}
+	} else {
+		status = H5TBget_table_info(loc_id, name.c_str(), &nfields, &nrecords);
 		if(status < 0) {
-			throw( TableException("Error in H5LTget_attribute_info while getting field types.") );
+			throw( TableException("Error in H5TBget_table_info.") );
 		}
+	}
 
-		field_type_value = new char[attr_size];
+	vector<size_t> field_sizes((size_t) nfields + 1);
+	vector<size_t> field_offsets((size_t) nfields + 1);
 
-		status = H5LTget_attribute_string(_loc_id,_name.c_str(),field_type_key.str().c_str(),field_type_value);
+	if(!columnar) {
+		status = H5TBget_field_info(loc_id, name.c_str(), NULL, &field_sizes[0], &field_offsets[0], type_size);
 		if(status < 0) {
+			throw( TableException("Error in H5TBget_field_info.") );
+		}
+	}
+
+	/* Load the table's fields */
+	stringstream field_type_key;
+	stringstream field_name_key;
+	string field_type_value;
+	string field_name_value;
+
+	for(hsize_t i = 0; i < nfields; i++) {
+		/* Get the field type */
+		field_type_key.str("");
+		field_type_key << "FIELD_" << i << "_TYPE";
+		if(!readStringAttribute(loc_id, name, field_type_key.str(), &field_type_value)) {
 			throw( TableException("Error in H5LTget_attribute_string while getting field types.") );
 		}
 
 		/* Get the field name */
 		field_name_key.str("");
 		field_name_key << "FIELD_" << i << "_NAME";
+		if(!readStringAttribute(loc_id, name, field_name_key.str(), &field_name_value)) {
+			throw( TableException("Error in H5LTget_attribute_string while getting field names.") );
+		}
 
-		status = H5LTget_attribute_info(_loc_id,_name.c_str(),field_name_key.str().c_str(),&dims,&type_class,&attr_size);
-		if(status < 0) {
-			throw( TableException("Error in H5LTget_attribute_info while getting field names.") );
+		Field* field = fieldFromTSDBType(field_type_value, field_name_value);
+		if(field == NULL) {
+			throw( TableException("A field had an unsupported field type.") );
+		}
+		fields->push_back(field);
+
+		if(!columnar) {
+			offsets->push_back(field_offsets[(size_t) i]);
+		}
+	}
+}
+
+/** <summary>Makes a new Field of the type named <c>type</c>, as Field::getTSDBType() names it</summary>
+ * <remarks>Returns NULL if the type is unknown. Throws a TableException if a String field has an invalid
+ * size.</remarks>
+ */
+Field* Table::fieldFromTSDBType(const std::string& type, const std::string& name) {
+	if(type == "Timestamp") {
+		return new TimestampField(name);
+	}
+	if(type == "Record") {
+		return new RecordField(name);
+	}
+	if(type == "Int32") {
+		return new Int32Field(name);
+	}
+	if(type == "Int8") {
+		return new Int8Field(name);
+	}
+	if(type == "Char") {
+		return new CharField(name);
+	}
+	if(type == "Double") {
+		return new DoubleField(name);
+	}
+	if(type == "Date") {
+		return new DateField(name);
+	}
+	if(type.compare(0, 7, "String(") == 0) {
+		// need to determine the size of the string
+		int field_size = atoi(type.c_str() + 7);
+		if(field_size < 1) {
+			throw( TableException("String field size is invalid.") );
+		}
+		return new StringField(name, field_size);
+	}
+	if(type.compare(0, 7, "Symbol(") == 0) {
+		int max_length = atoi(type.c_str() + 7);
+		if(max_length < 1) {
+			throw( TableException("Symbol field size is invalid.") );
+		}
+		return new SymbolField(name, max_length);
+	}
+	return NULL;
+}
+
+/** <summary>Reads the string attribute <c>attr</c> of the object <c>name</c> into <c>value</c></summary>
+ * <remarks>Returns false if it can not be read.</remarks>
+ */
+bool Table::readStringAttribute(hid_t loc_id, const std::string& name, const std::string& attr, std::string* value) {
+	hsize_t dims;
+	H5T_class_t type_class;
+	size_t attr_size;
+
+	if(H5LTget_attribute_info(loc_id, name.c_str(), attr.c_str(), &dims, &type_class, &attr_size) < 0) {
+		return false;
+	}
+
+	vector<char> buf(attr_size + 1, '\0');
+	if(H5LTget_attribute_string(loc_id, name.c_str(), attr.c_str(), &buf[0]) < 0) {
+		return false;
+	}
+	value->assign(&buf[0]);
+	return true;
+}
+
+/** <summary>Opens the handles the Table keeps for its lifetime</summary>
+ * <remarks><p>The H5TB functions look the dataset up by name, and reopen it and its datatype, on every
+ * call. Instead, the Table opens the dataset once and keeps the dataset, its dataspace and a memory
+ * datatype matching the Structure. Reads and writes are then hyperslab selections on the open dataset,
+ * which also keeps the dataset's chunk cache alive between calls. A columnar Table keeps the same
+ * handles for the dataset of each column.</p>
+ * <p>The number of records is read from the dataspace here and tracked in memory afterwards. Call
+ * <c>refresh()</c> if the dataset may have been extended through another handle.</p></remarks>
+ */
+void Table::openDataset(void) {
+	herr_t status;
+	hid_t dapl;
+
+	my_dataset_id = -1;
+	my_space_id = -1;
+	my_mem_type_id = -1;
+	my_ts_type_id = -1;
+	my_group_id = -1;
+	my_map_contiguous = false;
+	my_map_chunk_records = 0;
+
+	try {
+		dapl = my_options.accessPropertyList();
+	} catch(StorageOptionsException& e) {
+		throw( TableException(e.what()) );
+	}
+
+	if(my_columnar) {
+		my_group_id = H5Gopen2(my_loc_id, my_name.c_str(), H5P_DEFAULT);
+		if(my_group_id < 0) {
+			H5Pclose(dapl);
+			throw( TableException("Error in H5Gopen2.") );
 		}
 
-		field_name_value = new char[attr_size];
-		status = H5LTget_attribute_string(_loc_id,_name.c_str(),field_name_key.str().c_str(),field_name_value);
+		for(size_t i = 0; i < my_structure->getNFields(); i++) {
+			hid_t column_id = H5Dopen2(my_group_id, my_structure->getNameOfFieldsAsArray()[i], dapl);
+			if(column_id < 0) {
+				H5Pclose(dapl);
+				throw( TableException("Error in H5Dopen2. A column of the table is missing.") );
+			}
+			my_column_ids.push_back(column_id);
+			my_column_space_ids.push_back(-1);
+			my_column_readers.push_back(boost::make_shared<tsdb::ChunkReader>(column_id,
+				my_structure->getTypeOfFieldsAsArray()[i]));
+		}
+
+		H5Pclose(dapl);
+		refresh();
+		return;
+	}
+
+	my_dataset_id = H5Dopen2(my_loc_id, my_name.c_str(), dapl);
+	H5Pclose(dapl);
+	if(my_dataset_id < 0) {
+		throw( TableException("Error in H5Dopen2.") );
+	}
+
+	/* The memory type of a whole record */
+	my_mem_type_id = compoundType(my_structure);
+	my_chunk_reader = boost::make_shared<tsdb::ChunkReader>(my_dataset_id, my_mem_type_id);
+
+	/* The memory type of just the first field, used by getTimestamps() */
+	my_ts_type_id = H5Tcreate(H5T_COMPOUND, my_structure->getSizeOfFieldsAsArray()[0]);
+	if(my_ts_type_id < 0) {
+		throw( TableException("Error in H5Tcreate.") );
+	}
+
+	status = H5Tinsert(my_ts_type_id, my_structure->getNameOfFieldsAsArray()[0], 0,
+		my_structure->getTypeOfFieldsAsArray()[0]);
+	if(status < 0) {
+		throw( TableException("Error in H5Tinsert.") );
+	}
+
+	refresh();
+}
+
+/** <summary>Makes a compound memory type for records laid out as in <c>_structure</c></summary>
+ * <remarks>The caller closes the type. When <c>_structure</c> only has some of the Table's fields, 
+ * HDF5 reads just those members, matching them by name.</remarks>
+ */
+hid_t Table::compoundType(const boost::shared_ptr<tsdb::Structure>& _structure) {
+	hid_t type_id = H5Tcreate(H5T_COMPOUND, _structure->getSizeOf());
+	if(type_id < 0) {
+		throw( TableException("Error in H5Tcreate.") );
+	}
+
+	for(size_t i = 0; i < _structure->getNFields(); i++) {
+		herr_t status = H5Tinsert(type_id, _structure->getNameOfFieldsAsArray()[i],
+			_structure->getOffsetOfFieldsAsArray()[i], _structure->getTypeOfFieldsAsArray()[i]);
 		if(status < 0) {
-			throw( TableException("Error in H5LTget_attribute_string while getting field names.") );
+			H5Tclose(type_id);
+			throw( TableException("Error in H5Tinsert.") );
 		}
+	}
+
+	return type_id;
+}
 
-		if(strcmp(field_type_value,"Timestamp") == 0) {
-			fields.push_back(new TimestampField((string) field_name_value));
-			fieldset = true;
+/** <summary>Re-reads the number of records of the Table from the file</summary>
+ * <remarks>The Table tracks its number of records in memory. This is only necessary if the
+ * dataset may have been changed other than through this Table object. In a file opened with
+ * Swmr::openForRead(), the datasets are refreshed first, to see what the writer has flushed.</remarks>
+ */
+void Table::refresh(void) {
+	HDF5Lock lock;
+
+#ifdef TSDB_HAVE_SWMR
+	if(Swmr::isReading(my_loc_id)) {
+		if(my_columnar) {
+			for(size_t i = 0; i < my_column_ids.size(); i++) {
+				H5Drefresh(my_column_ids[i]);
+			}
+		} else {
+			H5Drefresh(my_dataset_id);
+		}
+	}
+#endif
+
+	// Chunks that were not written when they were first looked up may be now
+	my_map_chunk_offsets.clear();
+
+	if(my_columnar) {
+		// If the columns differ in length, only the records that are complete in every column count
+		for(size_t i = 0; i < my_column_ids.size(); i++) {
+			hsize_t column_nrecords;
+			refreshSpace(my_column_ids[i], &my_column_space_ids[i], &column_nrecords);
+			if(i == 0 || column_nrecords < my_nrecords) {
+				my_nrecords = column_nrecords;
+			}
 		}
+	} else {
+		refreshSpace(my_dataset_id, &my_space_id, &my_nrecords);
+	}
 
-		if(strcmp(field_type_value,"Record") == 0) {
-			fields.push_back(new RecordField((string) field_name_value));
-			fieldset = true;
+	// The writer saves the symbols before the records that use them
+	for(size_t i = 0; i < my_symbol_tables.size(); i++) {
+		if(my_structure->getField(i)->getFieldType() == Field::SYMBOL) {
+			loadSymbols(i);
 		}
+	}
+}
 
-		if(strcmp(field_type_value,"Int32") == 0) {
-			fields.push_back(new Int32Field((string) field_name_value));
-			fieldset = true;
+/** <summary>Replaces <c>*space_id</c> with the current dataspace of a dataset</summary> */
+void Table::refreshSpace(hid_t dataset_id, hid_t* space_id, hsize_t* nrecords) {
+	if(*space_id >= 0) {
+		H5Sclose(*space_id);
+	}
+
+	*space_id = H5Dget_space(dataset_id);
+	if(*space_id < 0) {
+		throw( TableException("Error in H5Dget_space.") );
+	}
+
+	if(H5Sget_simple_extent_dims(*space_id, nrecords, NULL) < 0) {
+		throw( TableException("Error in H5Sget_simple_extent_dims.") );
+	}
+}
+
+/** <summary>Returns the ChunkReader that reads <c>dataset_id</c> as <c>mem_type_id</c>, or NULL</summary> */
+tsdb::ChunkReader* Table::chunkReader(hid_t dataset_id, hid_t mem_type_id) {
+	tsdb::ChunkReader* reader = NULL;
+
+	if(my_columnar) {
+		for(size_t i = 0; i < my_column_ids.size(); i++) {
+			if(my_column_ids[i] == dataset_id && my_structure->getTypeOfFieldsAsArray()[i] == mem_type_id) {
+				reader = my_column_readers[i].get();
+			}
 		}
+	} else if(dataset_id == my_dataset_id && mem_type_id == my_mem_type_id) {
+		reader = my_chunk_reader.get();
+	}
+
+	return (reader != NULL && reader->supported()) ? reader : NULL;
+}
+
+/** <summary>Reads a range of elements of a 1-D dataset</summary>
+ * <remarks><p>Reads <c>nrecords</c> elements starting at <c>first</c> into <c>buf</c>, converting them
+ * to <c>mem_type_id</c>. This does not check the bounds of the request.</p>
+ * <p>A Table that is mapped (see mapRecords()) copies whole records and timestamps out of the mapping.
+ * Otherwise, a read of at least DIRECT_READ_CHUNKS chunks goes through the ChunkReader of the dataset, if
+ * it has one, so that the chunks are decompressed without holding the HDF5Lock. While the ChunkCache is on,
+ * every read does, timestamps included, so that the chunks come from the cache. Everything else, and any
+ * read the ChunkReader can not do, is an <c>H5Dread()</c> under the lock.</p></remarks>
+ */
+void Table::readSelection(hid_t dataset_id, hid_t space_id, hsize_t first, hsize_t nrecords, hid_t mem_type_id, void* buf) {
+	herr_t status;
+	StatTimer timer(my_counters.read_us);
 
-		if(strcmp(field_type_value,"Int8") == 0) {
-			fields.push_back(new Int8Field((string) field_name_value));
-			fieldset = true;
+	if(my_mapping && dataset_id == my_dataset_id && readMapped(first, nrecords, mem_type_id, buf)) {
+		countRead(my_counters.mapped_reads, nrecords, elementSize(mem_type_id));
+		return;
+	}
+
+	if(DIRECT_READ_CHUNKS > 0) {
+		tsdb::ChunkReader* reader = chunkReader(dataset_id, mem_type_id);
+		if(reader != NULL && (nrecords >= DIRECT_READ_CHUNKS * reader->chunkRecords() || reader->cached())
+			&& reader->read(first, nrecords, buf)) {
+			countRead(my_counters.direct_reads, nrecords, elementSize(mem_type_id));
+			return;
 		}
 
-		if(strcmp(field_type_value,"Char") == 0) {
-			fields.push_back(new CharField((string) field_name_value));
-			fieldset = true;
+		// Timestamps of the row layout are the first field of the chunks of records
+		if(reader == NULL && mem_type_id == my_ts_type_id && my_chunk_reader.get() != NULL &&
+			my_chunk_reader->cached() && my_chunk_reader->read(first, nrecords, buf,
+			my_structure->getOffsetOfField(0), my_structure->getSizeOfField(0))) {
+			countRead(my_counters.direct_reads, nrecords, elementSize(mem_type_id));
+			return;
 		}
+	}
+
+	HDF5Lock lock;
 
-		if(strcmp(field_type_value,"Double") == 0) {
-			fields.push_back(new DoubleField((string) field_name_value));
-			fieldset = true;
+	status = H5Sselect_hyperslab(space_id, H5S_SELECT_SET, &first, NULL, &nrecords, NULL);
+	if(status < 0) {
+		throw( TableException("Error in H5Sselect_hyperslab.") );
+	}
+
+	hid_t mem_space_id = H5Screate_simple(1, &nrecords, NULL);
+	if(mem_space_id < 0) {
+		throw( TableException("Error in H5Screate_simple.") );
+	}
+
+	status = H5Dread(dataset_id, mem_type_id, mem_space_id, space_id, H5P_DEFAULT, buf);
+	H5Sclose(mem_space_id);
+
+	if(status < 0) {
+		throw( TableException("Error in H5Dread.") );
+	}
+	countRead(my_counters.hdf5_reads, nrecords, H5Tget_size(mem_type_id));
+}
+
+/** <summary>Returns the size of an element of <c>mem_type_id</c> if it is one the Table keeps, or 0</summary>
+ * <remarks>This does not call HDF5, so it can be called without the HDF5Lock.</remarks>
+ */
+size_t Table::elementSize(hid_t mem_type_id) {
+	if(mem_type_id == my_mem_type_id) {
+		return my_structure->getSizeOf();
+	} else if(mem_type_id == my_ts_type_id) {
+		return my_structure->getSizeOfField(0);
+	}
+	for(size_t i = 0; my_columnar && i < my_structure->getNFields(); i++) {
+		if(my_structure->getTypeOfFieldsAsArray()[i] == mem_type_id) {
+			return my_structure->getSizeOfField(i);
 		}
+	}
+	return 0;
+}
+
+/** <summary>Counts a read of <c>nrecords</c> elements of <c>element_size</c> bytes</summary> */
+void Table::countRead(tsdb::StatCounter& reads, hsize_t nrecords, size_t element_size) {
+	reads.add();
+	my_counters.records_read.add(nrecords);
+	my_counters.bytes_read.add(nrecords * element_size);
+}
+
+/** <summary>Extends a 1-D dataset and writes elements at its end</summary>
+ * <remarks><c>first</c> is the current number of elements in the dataset. <c>*space_id</c> is replaced
+ * with the extended dataspace.</remarks>
+ */
+void Table::writeSelection(hid_t dataset_id, hid_t* space_id, hsize_t first, hsize_t nrecords, hid_t mem_type_id, const void* buf) {
+	herr_t status;
+	hsize_t new_nrecords = first + nrecords;
+	hsize_t dims;
+	StatTimer timer(my_counters.write_us);
+
+	// The chunks written to are no longer what the ChunkCache has
+	tsdb::ChunkReader* reader = chunkReader(dataset_id, mem_type_id);
+	if(reader != NULL) {
+		reader->invalidate(first);
+	}
+
+	status = H5Dset_extent(dataset_id, &new_nrecords);
+	if(status < 0) {
+		throw( TableException("Error in H5Dset_extent.") );
+	}
+
+	// The dataspace changed size, so get the new one
+	refreshSpace(dataset_id, space_id, &dims);
 
-		if(strcmp(field_type_value,"Date") == 0) {
-			fields.push_back(new DateField((string) field_name_value));
-			fieldset = true;
+	status = H5Sselect_hyperslab(*space_id, H5S_SELECT_SET, &first, NULL, &nrecords, NULL);
+	if(status < 0) {
+		throw( TableException("Error in H5Sselect_hyperslab.") );
+	}
+
+	hid_t mem_space_id = H5Screate_simple(1, &nrecords, NULL);
+	if(mem_space_id < 0) {
+		throw( TableException("Error in H5Screate_simple.") );
+	}
+
+	status = H5Dwrite(dataset_id, mem_type_id, mem_space_id, *space_id, H5P_DEFAULT, buf);
+	H5Sclose(mem_space_id);
+
+	if(status < 0) {
+		throw( TableException("Error in H5Dwrite.") );
+	}
+	my_counters.hdf5_writes.add();
+	my_counters.records_written.add(nrecords);
+	my_counters.bytes_written.add(nrecords * H5Tget_size(mem_type_id));
+}
+
+/** <summary>Reads whole records into <c>buf</c>, laid out as in the Table's Structure</summary>
+ * <remarks>This does not check the bounds of the request.</remarks>
+ */
+void Table::readRecords(hsize_t first, hsize_t nrecords, void* buf) {
+	if(my_columnar) {
+		vector<size_t> field_ids;
+		for(size_t i = 0; i < my_structure->getNFields(); i++) {
+			field_ids.push_back(i);
 		}
+		readColumns(first, nrecords, field_ids, my_structure, buf);
+	} else {
+		readSelection(my_dataset_id, my_space_id, first, nrecords, my_mem_type_id, buf);
+	}
+}
 
-		if(strstr(field_type_value,"String(") == field_type_value) {
-			// need to determine the size of the string
-			char * paren = strstr(field_type_value,")");
-			*paren = '\0';
-			paren = field_type_value + 7;
-			int field_size = 0;
-			field_size = atoi(paren);
+/** <summary>Reads the columns <c>field_ids</c> into records laid out as in <c>_structure</c></summary>
+ * <remarks>Field <c>field_ids[k]</c> of the Table is written to field <c>k</c> of <c>_structure</c>.
+ * Each column is read into a contiguous buffer and then copied into the records. This does not check 
+ * the bounds of the request.</remarks>
+ */
+void Table::readColumns(hsize_t first, hsize_t nrecords, const std::vector<size_t>& field_ids,
+	const boost::shared_ptr<tsdb::Structure>& _structure, void* buf) {
+	size_t record_size = _structure->getSizeOf();
+
+	for(size_t k = 0; k < field_ids.size(); k++) {
+		size_t col = field_ids[k];
+		size_t field_size = my_structure->getSizeOfField(col);
+		hid_t mem_type_id = my_structure->getTypeOfFieldsAsArray()[col];
+
+		if(field_size == record_size) {
+			// The records are just this one field, so read straight into them
+			readSelection(my_column_ids[col], my_column_space_ids[col], first, nrecords, mem_type_id, buf);
+			continue;
+		}
 
-			if(field_size < 1) {
-				throw( TableException("String field size is invalid.") );
-			}
+		vector<char> column((size_t) nrecords * field_size);
+		readSelection(my_column_ids[col], my_column_space_ids[col], first, nrecords, mem_type_id, &column[0]);
 
-			fields.push_back(new StringField((string) field_name_value, field_size));
-			fieldset = true;
+		char* dst = (char*) buf + _structure->getOffsetOfField(k);
+		const char* src = &column[0];
+		for(hsize_t i = 0; i < nrecords; i++) {
+			memcpy(dst, src, field_size);
+			dst += record_size;
+			src += field_size;
 		}
+	}
+}
 
-		if(fieldset == false) {
-			throw( TableException("A field had an unsupported field type.") );
+/** <summary>Reads the records of the Table through a read only memory mapping of the file, if it can</summary>
+ * <remarks><p>Once the Table is mapped, BufferedRecordSet buffers point into the mapping instead of
+ * holding a copy, and every other read of whole records or timestamps is a <c>memcpy()</c> from it rather
+ * than an <c>H5Dread()</c>. The file offset of each chunk is looked up the first time it is read, so
+ * lookups and scans of records that are in the page cache cost no system calls after that. RecordSets are
+ * still copies, since they can be written to.</p>
+ * <p>A Table can be mapped when its dataset is stored as it is in memory: the row layout, without filters
+ * (StorageOptions::NONE), either chunked or contiguous (as after <c>h5repack -l CONTI</c>), and with the
+ * same record type as the Structure. The file must be opened read only, with the default (sec2) driver,
+ * and without a user block. Chunks are only read through the mapping if they are inside it, so records
+ * that another process appends after the Table was mapped are still read through HDF5.</p>
+ * <p>Returns true if the Table is mapped, and false, leaving the Table as it was, if it can't be.</p></remarks>
+ */
+bool Table::mapRecords(void) {
+	HDF5Lock lock;
+
+	if(my_mapping) {
+		return true;
+	}
+	if(my_columnar) {
+		return false;
+	}
+
+	hid_t file_type_id = H5Dget_type(my_dataset_id);
+	bool ok = (file_type_id >= 0 && H5Tequal(file_type_id, my_mem_type_id) > 0);
+	if(file_type_id >= 0) {
+		H5Tclose(file_type_id);
+	}
+
+	/* The file: read only, sec2 and without a user block */
+	hid_t file_id = ok ? H5Iget_file_id(my_dataset_id) : -1;
+	unsigned int intent = 0;
+	ok = ok && file_id >= 0 && H5Fget_intent(file_id, &intent) >= 0 && (intent & H5F_ACC_RDWR) == 0;
+
+	hid_t fapl = ok ? H5Fget_access_plist(file_id) : -1;
+	ok = ok && fapl >= 0 && H5Pget_driver(fapl) == H5FD_SEC2;
+	if(fapl >= 0) {
+		H5Pclose(fapl);
+	}
+
+	hid_t fcpl = ok ? H5Fget_create_plist(file_id) : -1;
+	hsize_t userblock = 0;
+	ok = ok && fcpl >= 0 && H5Pget_userblock(fcpl, &userblock) >= 0 && userblock == 0;
+	if(fcpl >= 0) {
+		H5Pclose(fcpl);
+	}
+
+	string filename;
+	ssize_t name_size = ok ? H5Fget_name(file_id, NULL, 0) : -1;
+	if(name_size > 0) {
+		vector<char> name_buf((size_t) name_size + 1, '\0');
+		if(H5Fget_name(file_id, &name_buf[0], name_buf.size()) > 0) {
+			filename = &name_buf[0];
 		}
+	}
+	if(file_id >= 0) {
+		H5Fclose(file_id);
+	}
+	if(!ok || filename.empty()) {
+		return false;
+	}
 
-		offsets.push_back(field_offsets[i]);
-		delete field_name_value, field_type_value;
+	/* The dataset: unfiltered chunks, or contiguous */
+	hid_t dcpl = H5Dget_create_plist(my_dataset_id);
+	if(dcpl < 0) {
+		return false;
+	}
+	H5D_layout_t layout = H5Pget_layout(dcpl);
+	hsize_t chunk_records = 0;
+	if(layout == H5D_CHUNKED) {
+#ifdef TSDB_HAVE_CHUNK_INFO
+		ok = (H5Pget_chunk(dcpl, 1, &chunk_records) == 1 && chunk_records > 0 && H5Pget_nfilters(dcpl) == 0);
+#else
+		ok = false;
+#endif
+	} else {
+		// A contiguous dataset can't grow, so it is one chunk of all of its records
+		chunk_records = my_nrecords;
+		ok = (layout == H5D_CONTIGUOUS && chunk_records > 0);
+	}
+	H5Pclose(dcpl);
+	if(!ok) {
+		return false;
 	}
 
-	// Set up the table object
-	my_loc_id = _loc_id;
-	my_name = _name;
-	my_structure = boost::shared_ptr<tsdb::Structure>(new Structure(fields,offsets,type_size));
-	my_title = std::string(tbl_title);
-	
+	try {
+		my_mapping = boost::make_shared<tsdb::FileMapping>(filename);
+	} catch(FileMappingException&) {
+		return false;
+	}
+	my_map_contiguous = (layout == H5D_CONTIGUOUS);
+	my_map_chunk_records = chunk_records;
+	my_map_chunk_offsets.clear();
+	return true;
+}
 
-	// Clean up some memory
-	delete  tbl_title, field_sizes, field_offsets;
+/** <summary>Returns true if mapRecords() mapped the Table</summary> */
+bool Table::isMapped(void) const {
+	return (bool) my_mapping;
+}
 
-	// NOTE: we are not cleaning up the individual fields. We pass ownership of them to my_structure.
+/** <summary>Returns the records from <c>*first</c> to <c>*last</c> that are contiguous in the mapping,
+ * without copying them</summary>
+ * <remarks><p>Going forward, the records start at <c>*first</c> and <c>*last</c> is moved back to the
+ * last record that follows on in the file; in reverse, they end at <c>*last</c> and <c>*first</c> is moved
+ * up. Adjacent chunks are usually contiguous, when nothing else was written to the file between them.</p>
+ * <p>The records are read only, and keep the mapping alive. Returns an empty MemoryBlockPtr if the Table
+ * is not mapped or the records are not in the mapping; they must then be read with
+ * recordsAsMemoryBlockPtr(). This does not check the bounds of the request.</p></remarks>
+ */
+tsdb::MemoryBlockPtr Table::mappedRecords(hsize_t* first, hsize_t* last, bool forward) {
+	const char* run = mappedRun(first, last, forward);
+	if(run == NULL) {
+		return tsdb::MemoryBlockPtr();
+	}
 
-	// Append buffer is empty until we attempt to append a record
-	my_nappendbuf = 0;
+	size_t nbytes = (size_t) (*last - *first + 1) * my_structure->getSizeOf();
+	boost::shared_ptr<tsdb::MemoryBlock> block = boost::make_shared<tsdb::MemoryBlock>((char*) run, nbytes,
+		boost::shared_ptr<void>(my_mapping));
+	return tsdb::MemoryBlockPtr(block, 0);
 }
 
+/** <summary>Finds the run of records that mappedRecords() returns, and returns a pointer to its first record</summary> */
+const char* Table::mappedRun(hsize_t* first, hsize_t* last, bool forward) {
+	if(!my_mapping) {
+		return NULL;
+	}
+
+	HDF5Lock lock;
 
+	const hsize_t chunk_records = my_map_chunk_records;
+	const size_t chunk_bytes = (size_t) chunk_records * my_structure->getSizeOf();
+	const size_t record_size = my_structure->getSizeOf();
+
+	if(forward) {
+		hsize_t chunk = *first / chunk_records;
+		const char* start = mappedChunk(chunk);
+		if(start == NULL) {
+			return NULL;
+		}
+		const char* end = start + chunk_bytes;
+		start += (size_t) (*first - chunk * chunk_records) * record_size;
+
+		hsize_t run_last = std::min((chunk + 1) * chunk_records - 1, *last);
+		while(run_last < *last && mappedChunk(chunk + 1) == end) {
+			chunk++;
+			end += chunk_bytes;
+			run_last = std::min((chunk + 1) * chunk_records - 1, *last);
+		}
+		*last = run_last;
+		return start;
+	}
+
+	hsize_t chunk = *last / chunk_records;
+	const char* start = mappedChunk(chunk);
+	if(start == NULL) {
+		return NULL;
+	}
+
+	hsize_t run_first = std::max(chunk * chunk_records, *first);
+	while(run_first > *first && mappedChunk(chunk - 1) == start - chunk_bytes) {
+		chunk--;
+		start -= chunk_bytes;
+		run_first = std::max(chunk * chunk_records, *first);
+	}
+	*first = run_first;
+	return start + (size_t) (run_first - chunk * chunk_records) * record_size;
+}
+
+/** <summary>Returns the start of chunk <c>chunk</c> in the mapping, or NULL if it is not in it</summary>
+ * <remarks>Looks the chunk up in the file the first time. The caller holds the HDF5Lock.</remarks>
+ */
+const char* Table::mappedChunk(hsize_t chunk) {
+	if(chunk >= my_map_chunk_offsets.size()) {
+		my_map_chunk_offsets.resize((size_t) chunk + 1, -1);
+	}
+
+	long long& offset = my_map_chunk_offsets[(size_t) chunk];
+	if(offset == -1) {
+		// -2 marks a chunk that can not be mapped, so it is not looked up again
+		offset = -2;
+		const unsigned long long nbytes = (unsigned long long) my_map_chunk_records * my_structure->getSizeOf();
+		haddr_t addr = HADDR_UNDEF;
+
+		if(my_map_contiguous) {
+			if(chunk == 0) {
+				addr = H5Dget_offset(my_dataset_id);
+			}
+		} else {
+#ifdef TSDB_HAVE_CHUNK_INFO
+			hsize_t coord = chunk * my_map_chunk_records;
+			unsigned int filter_mask = 0;
+			hsize_t size = 0;
+			if(H5Dget_chunk_info_by_coord(my_dataset_id, &coord, &filter_mask, &addr, &size) < 0 || size != nbytes) {
+				addr = HADDR_UNDEF;
+			}
+#endif
+		}
+
+		if(addr != HADDR_UNDEF && addr <= my_mapping->size() && nbytes <= my_mapping->size() - addr) {
+			offset = (long long) addr;
+		}
+	}
+
+	return offset < 0 ? NULL : my_mapping->data() + offset;
+}
+
+/** <summary>Copies records, or just their timestamps, out of the mapping</summary>
+ * <remarks>Returns false if <c>mem_type_id</c> is neither of those, or if some of the records are not
+ * in the mapping.</remarks>
+ */
+bool Table::readMapped(hsize_t first, hsize_t nrecords, hid_t mem_type_id, void* buf) {
+	const bool whole_records = (mem_type_id == my_mem_type_id);
+	if(!whole_records && mem_type_id != my_ts_type_id) {
+		return false;
+	}
+
+	const size_t record_size = my_structure->getSizeOf();
+	const size_t ts_offset = my_structure->getOffsetOfField(0);
+	const size_t ts_size = my_structure->getSizeOfField(0);
+	char* out = (char*) buf;
+
+	hsize_t i = first;
+	while(i < first + nrecords) {
+		hsize_t run_first = i;
+		hsize_t run_last = first + nrecords - 1;
+		const char* run = mappedRun(&run_first, &run_last, true);
+		if(run == NULL) {
+			return false;
+		}
+
+		size_t n = (size_t) (run_last - run_first + 1);
+		if(whole_records) {
+			memcpy(out, run, n * record_size);
+			out += n * record_size;
+		} else {
+			for(size_t k = 0; k < n; k++) {
+				memcpy(out, run + k * record_size + ts_offset, ts_size);
+				out += ts_size;
+			}
+		}
+		i = run_last + 1;
+	}
+	return true;
+}
 /** <summary>Checks if a Table exists at <c>loc_id</c></summary>
  * <remarks>Checks if a Table exists. Returns <c>true</c> if it does, false otherwise.</remarks>
  * <param name="loc_id">A HDF5 <c>hid_t</c> specifying the location of the table (either a group id or file id)</param>
  * <param name="name">Name of the table</param>
  */
 bool Table::exists(hid_t loc_id, std::string name) {
+	HDF5Lock lock;
+
 	herr_t status = 0;
 	hsize_t nfields;
 	hsize_t nrecords;
+	bool found;
 	
 	/* Error printing off */
 	status = H5Eset_auto2(H5E_DEFAULT,NULL,NULL);
@@ -248,7 +1089,10 @@ bool Table::exists(hid_t loc_id, std::string name) {
 		throw( TableException("There was a problem redirecting error printing."));
 	}
 
-	status = H5TBget_table_info(loc_id, name.c_str(),&nfields,&nrecords);
+	// Tables with a schema are found without opening the dataset and its type
+	found = (H5Lexists(loc_id, name.c_str(), H5P_DEFAULT) > 0 &&
+		H5Aexists_by_name(loc_id, name.c_str(), "TSDB_SCHEMA", H5P_DEFAULT) > 0) ||
+		H5TBget_table_info(loc_id, name.c_str(),&nfields,&nrecords) >= 0 || Table::isColumnar(loc_id, name);
 
 	/* Error printing on */
 	status = H5Eset_auto2(H5E_DEFAULT,(H5E_auto2_t) H5Eprint, stderr);
@@ -256,11 +1100,25 @@ bool Table::exists(hid_t loc_id, std::string name) {
 		throw( TableException("There was a problem redirecting error printing."));
 	}
 
-	if(status >= 0) {
-		return true;
-	} else {
+	return found;
+}
+
+/** <summary>Checks if the object <c>name</c> at <c>loc_id</c> is a columnar Table</summary>
+ * <remarks>A columnar Table is a group with a TSDB_LAYOUT attribute.</remarks>
+ */
+bool Table::isColumnar(hid_t loc_id, std::string name) {
+	H5O_info_t info;
+
+	if(H5Lexists(loc_id, name.c_str(), H5P_DEFAULT) <= 0) {
 		return false;
 	}
+
+	if(H5Oget_info_by_name(loc_id, name.c_str(), &info, H5P_DEFAULT) < 0) {
+		return false;
+	}
+
+	return info.type == H5O_TYPE_GROUP && 
+		H5Aexists_by_name(loc_id, name.c_str(), "TSDB_LAYOUT", H5P_DEFAULT) > 0;
 }
 
 /** <summary>Appends records to a table</summary>
@@ -269,22 +1127,42 @@ bool Table::exists(hid_t loc_id, std::string name) {
  * <param name="records">Pointer to a block of memory containing the records</param>
  */
 void Table::appendRecords(size_t nrecords, void* records) {
-	herr_t status = H5TBappend_records(my_loc_id,my_name.c_str(),nrecords,my_structure->getSizeOf(),
-		my_structure->getOffsetOfFieldsAsArray(),my_structure->getSizeOfFieldsAsArray(),records);
-	if(status < 0) {
-		throw( TableException("Error in H5TBappend_records.") );
+	HDF5Lock lock;
+
+	if(nrecords == 0) {
+		return;
+	}
+
+	saveSymbols();
+
+	if(my_columnar) {
+		// Gather each field into a contiguous column and append it to its dataset
+		size_t record_size = my_structure->getSizeOf();
+		for(size_t col = 0; col < my_structure->getNFields(); col++) {
+			size_t field_size = my_structure->getSizeOfField(col);
+			vector<char> column(nrecords * field_size);
+
+			const char* src = (const char*) records + my_structure->getOffsetOfField(col);
+			char* dst = &column[0];
+			for(size_t i = 0; i < nrecords; i++) {
+				memcpy(dst, src, field_size);
+				dst += field_size;
+				src += record_size;
+			}
+
+			writeSelection(my_column_ids[col], &my_column_space_ids[col], my_nrecords, nrecords,
+				my_structure->getTypeOfFieldsAsArray()[col], &column[0]);
+		}
+	} else {
+		writeSelection(my_dataset_id, &my_space_id, my_nrecords, nrecords, my_mem_type_id, records);
 	}
+
+	my_nrecords += nrecords;
 }
 
 /** <summary>Gets the number of records in the table</summary> */
 hsize_t Table::size(void) {
-	hsize_t tbl_nfields,tbl_nrecords;
-	herr_t status;
-	status = H5TBget_table_info(my_loc_id,my_name.c_str(),&tbl_nfields,&tbl_nrecords);
-	if(status < 0) {
-		throw( TableException("Error in H5TBget_table_info.") );
-	}
-	return tbl_nrecords;
+	return my_nrecords;
 }
 
 /** <summary>Gets a set of records from the Table</summary>
@@ -299,7 +1177,6 @@ hsize_t Table::size(void) {
 */
 void Table::getRecords(hsize_t first, hsize_t last, void** records) {
 	hsize_t tbl_nrecords;
-	herr_t status;
 	tbl_nrecords = size();
 
 	if(first >= tbl_nrecords || last >= tbl_nrecords) {
@@ -315,12 +1192,11 @@ void Table::getRecords(hsize_t first, hsize_t last, void** records) {
 		throw(TableException("not enough memory in Table::getRecords"));
 	}
 
-	status = H5TBread_records(my_loc_id, my_name.c_str(), first, last-first+1, my_structure->getSizeOf(),
-		my_structure->getOffsetOfFieldsAsArray(), my_structure->getSizeOfFieldsAsArray(), *records);
-
-	if(status < 0) {
+	try {
+		readRecords(first, last-first+1, *records);
+	} catch(TableException&) {
 		free(*records);
-		throw( TableException("Error in H5TBread_records.") );
+		throw;
 	}
 }
 
@@ -335,8 +1211,21 @@ void Table::getRecords(hsize_t first, hsize_t last, void** records) {
 * <param name="records">Pointer to a pointer to an array of records</param>
 */
 tsdb::MemoryBlockPtr Table::recordsAsMemoryBlockPtr(hsize_t first, hsize_t last) {
+	return recordsAsMemoryBlockPtr(first, last, boost::shared_ptr<tsdb::MemoryBlock>());
+}
+
+/** <summary>Gets a set of records from the Table, reusing a MemoryBlock if it is large enough</summary>
+ * <remarks>The records are read into <c>reuse</c> if it holds at least as many bytes as the records.
+ * Otherwise a new MemoryBlock is allocated, as in recordsAsMemoryBlockPtr(hsize_t, hsize_t). This lets a
+ * caller that reads many blocks of the same size recycle its memory. The caller must make sure nothing
+ * else is using <c>reuse</c>.</remarks>
+ * <param name="first">First record index</param>
+ * <param name="last">Last record index</param>
+ * <param name="reuse">A MemoryBlock to read into, or an empty pointer</param>
+ */
+tsdb::MemoryBlockPtr Table::recordsAsMemoryBlockPtr(hsize_t first, hsize_t last,
+	const boost::shared_ptr<tsdb::MemoryBlock>& reuse) {
 	hsize_t tbl_nrecords;
-	herr_t status;
 	tbl_nrecords = this->size();
 
 	if(first >= tbl_nrecords || last >= tbl_nrecords) {
@@ -347,15 +1236,13 @@ tsdb::MemoryBlockPtr Table::recordsAsMemoryBlockPtr(hsize_t first, hsize_t last)
 		throw( TableException("The last record requested is before the first record requested.") );
 	}
 	
-	boost::shared_ptr<tsdb::MemoryBlock> recmemblk = 
-		boost::make_shared<tsdb::MemoryBlock>(my_structure->getSizeOf() * ( (size_t) (last-first + 1) ));
-	
-	status = H5TBread_records(my_loc_id, my_name.c_str(), first, last-first+1, my_structure->getSizeOf(),
-		my_structure->getOffsetOfFieldsAsArray(), my_structure->getSizeOfFieldsAsArray(), recmemblk->raw());
-
-	if(status < 0) {
-		throw( TableException("Error in H5TBread_records.") );
+	size_t nbytes = my_structure->getSizeOf() * ( (size_t) (last-first + 1) );
+	boost::shared_ptr<tsdb::MemoryBlock> recmemblk = reuse;
+	if(!recmemblk || recmemblk->size() < nbytes) {
+		recmemblk = boost::make_shared<tsdb::MemoryBlock>(nbytes);
 	}
+	
+	readRecords(first, last-first+1, recmemblk->raw());
 
 	return tsdb::MemoryBlockPtr(recmemblk,0);
 }
@@ -370,6 +1257,57 @@ tsdb::RecordSet Table::recordSet(hsize_t first, hsize_t last) {
 	return tsdb::RecordSet(recblkptr,(size_t)(last-first+1), my_structure);
 }
 
+/** <summary>Gets a RecordSet with only some of the fields of the Table</summary>
+ * <remarks><p>The RecordSet has its own Structure, with the fields named in <c>field_names</c> in that
+ * order (see Structure::project()). Only those fields are read. For a columnar Table, the other 
+ * columns are not touched at all.</p>
+ * <p>This function throws an exception if there were any problems getting the RecordSet.</p></remarks>
+ * <param name="first">First record index</param>
+ * <param name="last">Last record index</param>
+ * <param name="field_names">Names of the fields to read</param>
+ */
+tsdb::RecordSet Table::recordSet(hsize_t first, hsize_t last, const std::vector<std::string>& field_names) {
+	if(first >= my_nrecords || last >= my_nrecords) {
+		throw( TableException("Records requested outside the bounds of the table.") );
+	}
+
+	if(last < first) {
+		throw( TableException("The last record requested is before the first record requested.") );
+	}
+
+	boost::shared_ptr<tsdb::Structure> projection = my_structure->project(field_names);
+	size_t nrecords = (size_t) (last-first+1);
+
+	boost::shared_ptr<tsdb::MemoryBlock> recmemblk = 
+		boost::make_shared<tsdb::MemoryBlock>(projection->getSizeOf() * nrecords);
+
+	if(my_columnar) {
+		vector<size_t> field_ids;
+		for(size_t i = 0; i < field_names.size(); i++) {
+			field_ids.push_back(my_structure->getFieldIndexByName(field_names[i]));
+		}
+		readColumns(first, nrecords, field_ids, projection, recmemblk->raw());
+	} else {
+		hid_t type_id;
+		{
+			HDF5Lock lock;
+			type_id = compoundType(projection);
+		}
+		try {
+			readSelection(my_dataset_id, my_space_id, first, nrecords, type_id, recmemblk->raw());
+		} catch(TableException&) {
+			HDF5Lock lock;
+			H5Tclose(type_id);
+			throw;
+		}
+		HDF5Lock lock;
+		H5Tclose(type_id);
+	}
+
+	tsdb::MemoryBlockPtr recblkptr(recmemblk,0);
+	return tsdb::RecordSet(recblkptr, nrecords, projection);
+}
+
 
 
 /** <summary>Gets the last record of the Table</summary>
@@ -379,7 +1317,6 @@ tsdb::RecordSet Table::recordSet(hsize_t first, hsize_t last) {
  */
 void * Table::getLastRecord(void) {
 	void * recordPtr = NULL;
-	herr_t status;
 
 	hsize_t tbl_nrecords = 0;
 	tbl_nrecords = size();
@@ -394,16 +1331,46 @@ void * Table::getLastRecord(void) {
 	}
 
 	// Get the last record of the table
-	status=H5TBread_records(my_loc_id,my_name.c_str(),tbl_nrecords-1,1,my_structure->getSizeOf()
-		,my_structure->getOffsetOfFieldsAsArray(),my_structure->getSizeOfFieldsAsArray(),recordPtr);
-	if(status < 0) {
+	try {
+		readRecords(tbl_nrecords-1, 1, recordPtr);
+	} catch(TableException&) {
 		free(recordPtr);
-		throw( TableException("Error in H5TBread_records.") );
+		throw;
 	}
 
 	return recordPtr;
 }
 
+/** <summary>Reads only the timestamps of a range of records</summary>
+* <remarks><p>Reads the first field of records <c>first</c> through <c>last</c> into the <c>timestamps</c>
+* array, which must have room for <c>last - first + 1</c> values. The first field of the Table must be 
+* a TimestampField, as it is for every Timeseries.</p>
+* <p>This is much cheaper than reading whole records when only the timestamps are needed, for instance
+* when searching the Table for a timestamp.</p></remarks>
+* <param name="first">First record index</param>
+* <param name="last">Last record index</param>
+* <param name="timestamps">Pointer to an array of timestamps</param>
+*/
+void Table::getTimestamps(hsize_t first, hsize_t last, timestamp_t* timestamps) {
+	hsize_t tbl_nrecords;
+	tbl_nrecords = size();
+
+	if(first >= tbl_nrecords || last >= tbl_nrecords) {
+		throw( TableException("Records requested outside the bounds of the table.") );
+	}
+
+	if(last < first) {
+		throw( TableException("The last record requested is before the first record requested.") );
+	}
+
+	if(my_columnar) {
+		readSelection(my_column_ids[0], my_column_space_ids[0], first, last-first+1,
+			my_structure->getTypeOfFieldsAsArray()[0], timestamps);
+	} else {
+		readSelection(my_dataset_id, my_space_id, first, last-first+1, my_ts_type_id, timestamps);
+	}
+}
+
 /** <summary>Returns the title of the table</summary> */
 std::string Table::title(void) {
 	return my_title;
@@ -413,7 +1380,28 @@ std::string Table::title(void) {
  * <remarks>Note that this flushes the append buffer to disk.</remarks>
  */
 Table::~Table(void) {
+	HDF5Lock lock;
+
 	this->flushAppendBuffer();
+
+	for(size_t i = 0; i < my_column_ids.size(); i++) {
+		H5Sclose(my_column_space_ids[i]);
+		H5Dclose(my_column_ids[i]);
+	}
+
+	if(my_columnar) {
+		H5Gclose(my_group_id);
+	} else {
+		H5Sclose(my_space_id);
+		H5Tclose(my_ts_type_id);
+		H5Tclose(my_mem_type_id);
+		H5Dclose(my_dataset_id);
+	}
+}
+
+/** <summary>Returns the storage options the table was created with</summary> */
+const tsdb::StorageOptions& Table::storageOptions(void) {
+	return my_options;
 }
 
 /** <summary>Returns the Structure of the table</summary> */
@@ -465,5 +1453,219 @@ size_t Table::appendBufferSize() {
 	return my_nappendbuf;
 }
 
+/** <summary>Writes the records and the size of the Table out to the file</summary>
+ * <remarks>Flushes the append buffer, and then the datasets, so that SWMR readers see every record
+ * appended so far. See Swmr.</remarks>
+ */
+void Table::flush(void) {
+	flushAppendBuffer();
+
+	HDF5Lock lock;
+	for(size_t i = 0; i < my_symbol_tables.size(); i++) {
+		if(my_symbol_tables[i]) {
+			my_symbol_tables[i]->flush();
+		}
+	}
+
+	herr_t status = 0;
+#ifdef TSDB_HAVE_SWMR
+	if(my_columnar) {
+		for(size_t i = 0; i < my_column_ids.size() && status >= 0; i++) {
+			status = H5Dflush(my_column_ids[i]);
+		}
+	} else {
+		status = H5Dflush(my_dataset_id);
+	}
+#else
+	status = H5Fflush(my_loc_id, H5F_SCOPE_LOCAL);
+#endif
+	if(status < 0) {
+		throw( TableException("Error flushing the table.") );
+	}
+}
+
+/** <summary>Removes the records after the first <c>nrecords</c> records of the Table</summary>
+ * <remarks>The append buffer is flushed first, so the records in it count. Throws a TableException if the
+ * Table has fewer than <c>nrecords</c> records.</remarks>
+ * <param name="nrecords">The number of records to keep</param>
+ */
+void Table::truncate(hsize_t nrecords) {
+	flushAppendBuffer();
+
+	HDF5Lock lock;
+
+	if(nrecords > my_nrecords) {
+		throw( TableException("can not truncate a table to more records than it has") );
+	}
+	if(nrecords == my_nrecords) {
+		return;
+	}
+
+	hsize_t dims;
+	if(my_columnar) {
+		for(size_t i = 0; i < my_column_ids.size(); i++) {
+			my_column_readers[i]->invalidate(nrecords);
+			if(H5Dset_extent(my_column_ids[i], &nrecords) < 0) {
+				throw( TableException("Error in H5Dset_extent.") );
+			}
+			refreshSpace(my_column_ids[i], &my_column_space_ids[i], &dims);
+		}
+	} else {
+		my_chunk_reader->invalidate(nrecords);
+		if(H5Dset_extent(my_dataset_id, &nrecords) < 0) {
+			throw( TableException("Error in H5Dset_extent.") );
+		}
+		refreshSpace(my_dataset_id, &my_space_id, &dims);
+	}
+
+	my_nrecords = nrecords;
+}
+
+/** <summary>Returns what the Table has read and written since it was opened, or since resetStats()</summary>
+ * <remarks>Reads are counted where they reach the dataset, so a read through a Timeseries or a
+ * BufferedRecordSet shows up here whichever way it was done. Reads of a columnar Table count once per
+ * column.</remarks>
+ */
+tsdb::TableStats Table::stats(void) {
+	tsdb::TableStats stats;
+	stats.hdf5_reads = my_counters.hdf5_reads.value();
+	stats.direct_reads = my_counters.direct_reads.value();
+	stats.mapped_reads = my_counters.mapped_reads.value();
+	stats.records_read = my_counters.records_read.value();
+	stats.bytes_read = my_counters.bytes_read.value();
+	stats.read_us = my_counters.read_us.value();
+	stats.hdf5_writes = my_counters.hdf5_writes.value();
+	stats.records_written = my_counters.records_written.value();
+	stats.bytes_written = my_counters.bytes_written.value();
+	stats.write_us = my_counters.write_us.value();
+	stats.buffer_loads = my_counters.buffer_loads.value();
+	stats.prefetched_buffers = my_counters.prefetched_buffers.value();
+	stats.mapped_buffers = my_counters.mapped_buffers.value();
+	return stats;
+}
+
+/** <summary>Sets the counters of the Table back to zero</summary> */
+void Table::resetStats(void) {
+	my_counters.hdf5_reads.reset();
+	my_counters.direct_reads.reset();
+	my_counters.mapped_reads.reset();
+	my_counters.records_read.reset();
+	my_counters.bytes_read.reset();
+	my_counters.read_us.reset();
+	my_counters.hdf5_writes.reset();
+	my_counters.records_written.reset();
+	my_counters.bytes_written.reset();
+	my_counters.write_us.reset();
+	my_counters.buffer_loads.reset();
+	my_counters.prefetched_buffers.reset();
+	my_counters.mapped_buffers.reset();
+}
+
+/** <summary>Returns the live counters of the Table, for the classes that read it to add to</summary> */
+tsdb::TableCounters& Table::counters(void) {
+	return my_counters;
+}
+
+/* The dictionary of a SymbolField is a Table of its own next to this one, with a row per code */
+std::string Table::symbolTableName(size_t field) {
+	return my_name + "_symbols_" + my_structure->getField(field)->getName();
+}
+
+/* Loads the dictionaries of the SymbolFields into their SymbolTables. A Table that has not saved any
+ * symbols yet has no dictionary until it does. */
+void Table::openSymbols(void) {
+	my_symbol_tables.assign(my_structure->getNFields(), boost::shared_ptr<tsdb::Table>());
+	my_symbols_saved.assign(my_structure->getNFields(), 0);
+	for(size_t i = 0; i < my_structure->getNFields(); i++) {
+		if(my_structure->getField(i)->getFieldType() == Field::SYMBOL) {
+			loadSymbols(i);
+		}
+	}
+}
+
+/* Loads the symbols of a dictionary that are not loaded yet */
+void Table::loadSymbols(size_t field) {
+	HDF5Lock lock;
+
+	if(!my_symbol_tables[field]) {
+		if(!Table::exists(my_loc_id, symbolTableName(field))) {
+			return;
+		}
+		my_symbol_tables[field] = boost::make_shared<tsdb::Table>(my_loc_id, symbolTableName(field));
+	}
+
+	tsdb::Table& dictionary = *my_symbol_tables[field];
+	dictionary.refresh();
+	if(dictionary.size() <= my_symbols_saved[field]) {
+		return;
+	}
+
+	size_t max_length = dictionary.structure()->getSizeOf();
+	void* rows = NULL;
+	dictionary.getRecords(my_symbols_saved[field], dictionary.size() - 1, &rows);
+	vector<string> symbols;
+	for(size_t i = 0; i < dictionary.size() - my_symbols_saved[field]; i++) {
+		const char* row = (const char*) rows + i * max_length;
+		symbols.push_back(string(row, std::find(row, row + max_length, '\0')));
+	}
+	free(rows);
+
+	SymbolField* symbol_field = (SymbolField*) my_structure->getField(field);
+	symbol_field->symbols()->load(my_symbols_saved[field], symbols);
+	my_symbols_saved[field] = dictionary.size();
+}
+
+/* Appends the symbols added since the last append to the dictionaries, creating them if need be */
+void Table::saveSymbols(void) {
+	for(size_t i = 0; i < my_symbol_tables.size(); i++) {
+		if(my_structure->getField(i)->getFieldType() != Field::SYMBOL) {
+			continue;
+		}
+		SymbolField* symbol_field = (SymbolField*) my_structure->getField(i);
+		vector<string> symbols = symbol_field->symbols()->symbols(my_symbols_saved[i]);
+		if(symbols.empty()) {
+			continue;
+		}
+
+		size_t max_length = symbol_field->symbols()->maxLength();
+		if(!my_symbol_tables[i]) {
+			vector<Field*> fields;
+			fields.push_back(new StringField("symbol", (int) max_length));
+			my_symbol_tables[i] = boost::make_shared<tsdb::Table>(my_loc_id, symbolTableName(i),
+				"TSDB: Symbols", boost::make_shared<tsdb::Structure>(fields, false));
+		}
+
+		vector<char> rows(symbols.size() * max_length, 0);
+		for(size_t j = 0; j < symbols.size(); j++) {
+			memcpy(&rows[j * max_length], symbols[j].data(), symbols[j].size());
+		}
+		my_symbol_tables[i]->appendRecords(symbols.size(), &rows[0]);
+		my_symbols_saved[i] += symbols.size();
+	}
+}
+
+/* ====================================================================
+ * struct TableStats - what a Table has done
+ * ====================================================================
+ */
+
+/** <summary>Returns the counters as name, value pairs, with <c>prefix</c> in front of each name</summary> */
+tsdb::StatList TableStats::items(const std::string& prefix) const {
+	tsdb::StatList items;
+	items.push_back(std::make_pair(prefix + "hdf5_reads", hdf5_reads));
+	items.push_back(std::make_pair(prefix + "direct_reads", direct_reads));
+	items.push_back(std::make_pair(prefix + "mapped_reads", mapped_reads));
+	items.push_back(std::make_pair(prefix + "records_read", records_read));
+	items.push_back(std::make_pair(prefix + "bytes_read", bytes_read));
+	items.push_back(std::make_pair(prefix + "read_us", read_us));
+	items.push_back(std::make_pair(prefix + "hdf5_writes", hdf5_writes));
+	items.push_back(std::make_pair(prefix + "records_written", records_written));
+	items.push_back(std::make_pair(prefix + "bytes_written", bytes_written));
+	items.push_back(std::make_pair(prefix + "write_us", write_us));
+	items.push_back(std::make_pair(prefix + "buffer_loads", buffer_loads));
+	items.push_back(std::make_pair(prefix + "prefetched_buffers", prefetched_buffers));
+	items.push_back(std::make_pair(prefix + "mapped_buffers", mapped_buffers));
+	return items;
+}
 
 } // namespace tsdb 
\ No newline at end of file
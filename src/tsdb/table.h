@@ -16,6 +16,10 @@
 #include "recordset.h"
 #include "tsdb.h"
 #include "memoryblockptr.h"
+#include "storageoptions.h"
+#include "chunkreader.h"
+#include "filemapping.h"
+#include "stats.h"
 
 namespace tsdb {
 /* Forward declarations */
@@ -33,6 +37,54 @@ public:
 	  std::runtime_error(std::string("TableException: ") + what) {} 
 };
 
+/* -----------------------------------------------------------------
+ * TableStats. What a Table has read and written so far.
+ * -----------------------------------------------------------------
+ */
+struct TableStats
+{
+	TableStats(void): hdf5_reads(0), direct_reads(0), mapped_reads(0), records_read(0), bytes_read(0),
+		read_us(0), hdf5_writes(0), records_written(0), bytes_written(0), write_us(0), buffer_loads(0),
+		prefetched_buffers(0), mapped_buffers(0) {}
+
+	unsigned long long hdf5_reads;          // reads done with H5Dread()
+	unsigned long long direct_reads;        // ... decompressed by a ChunkReader instead
+	unsigned long long mapped_reads;        // ... copied out of the memory mapping instead
+	unsigned long long records_read;        // records, timestamps or column values read by all of them
+	unsigned long long bytes_read;
+	unsigned long long read_us;             // microseconds spent in reads, including waiting for the HDF5 lock
+	unsigned long long hdf5_writes;         // calls to H5Dwrite()
+	unsigned long long records_written;     // records or column values written
+	unsigned long long bytes_written;
+	unsigned long long write_us;            // microseconds spent extending the dataset and writing
+	unsigned long long buffer_loads;        // buffers loaded by the BufferedRecordSets of the Table
+	unsigned long long prefetched_buffers;  // ... that had already been read ahead
+	unsigned long long mapped_buffers;      // ... that point into the memory mapping
+
+	tsdb::StatList items(const std::string& prefix = "") const;
+};
+
+/* -----------------------------------------------------------------
+ * TableCounters. The live counters behind TableStats.
+ * -----------------------------------------------------------------
+ */
+struct TableCounters
+{
+	tsdb::StatCounter hdf5_reads;
+	tsdb::StatCounter direct_reads;
+	tsdb::StatCounter mapped_reads;
+	tsdb::StatCounter records_read;
+	tsdb::StatCounter bytes_read;
+	tsdb::StatCounter read_us;
+	tsdb::StatCounter hdf5_writes;
+	tsdb::StatCounter records_written;
+	tsdb::StatCounter bytes_written;
+	tsdb::StatCounter write_us;
+	tsdb::StatCounter buffer_loads;
+	tsdb::StatCounter prefetched_buffers;
+	tsdb::StatCounter mapped_buffers;
+};
+
 /* -----------------------------------------------------------------
  * Table. Represents a HDF5 High Level Table
  * -----------------------------------------------------------------
@@ -40,34 +92,54 @@ public:
 
 /** <summary>Represents an HDF5 High Level Table</summary>
  * <remarks>This function wraps a number of HDF5_HL functions in a way that supports 
- * TSDB's dynamic typing system.</remarks>
+ * TSDB's dynamic typing system. The table is created with H5TB, but the Table then keeps 
+ * the dataset open and reads and writes it directly.</remarks>
  */
 class  Table
 {
 public:
 	/* Constructors */
 	Table(hid_t _loc_id, std::string _name, 
-		std::string _title, boost::shared_ptr<tsdb::Structure> _structure);
+		std::string _title, boost::shared_ptr<tsdb::Structure> _structure,
+		const tsdb::StorageOptions& _options = tsdb::StorageOptions());
 	Table(hid_t _loc_id, std::string _name);
 
 	/* Methods that get information about the Table */
 	std::string title();
 	hsize_t size(void);
+	void refresh(void);
 	boost::shared_ptr<tsdb::Structure> structure(void);
+	const tsdb::StorageOptions& storageOptions(void);
 
 	/* Methods that modify the table's data */
 	void appendRecords(size_t nrecords, void* records);
 	void appendRecord(tsdb::Record &_record);
 	void flushAppendBuffer();
 	size_t appendBufferSize();
+	void flush(void);
+	void truncate(hsize_t nrecords);
 
 
 	/* Methods that retrieve the table's data */
 	void getRecords(hsize_t first, hsize_t last, void** records); // TODO: change method name
 	tsdb::MemoryBlockPtr recordsAsMemoryBlockPtr(hsize_t first, hsize_t last);
+	tsdb::MemoryBlockPtr recordsAsMemoryBlockPtr(hsize_t first, hsize_t last,
+		const boost::shared_ptr<tsdb::MemoryBlock>& reuse);
 	tsdb::RecordSet recordSet(hsize_t first, hsize_t last);
+	tsdb::RecordSet recordSet(hsize_t first, hsize_t last, const std::vector<std::string>& field_names);
 	tsdb::BufferedRecordSet bufferedRecordSet(hsize_t first, hsize_t last);
 	void * getLastRecord(void); // TODO: change method name
+	void getTimestamps(hsize_t first, hsize_t last, timestamp_t* timestamps);
+
+	/* Methods that read the table's data through a memory mapping */
+	bool mapRecords(void);
+	bool isMapped(void) const;
+	tsdb::MemoryBlockPtr mappedRecords(hsize_t* first, hsize_t* last, bool forward);
+
+	/* Methods that report what the table has done */
+	tsdb::TableStats stats(void);
+	void resetStats(void);
+	tsdb::TableCounters& counters(void);
 
 	/* Static methods */
 	static bool exists(hid_t loc_id, std::string name);
@@ -79,15 +151,80 @@ protected:
 	void setHDF5Properties(void);
 
 private:
+	/* Tables own HDF5 handles, so they can't be copied */
+	Table(const Table&);
+	Table& operator=(const Table&);
+
+	void createDataset(void);
+	void createColumns(void);
+	void openDataset(void);
+	hid_t compoundType(const boost::shared_ptr<tsdb::Structure>& _structure);
+	void refreshSpace(hid_t dataset_id, hid_t* space_id, hsize_t* nrecords);
+	tsdb::ChunkReader* chunkReader(hid_t dataset_id, hid_t mem_type_id);
+	void readSelection(hid_t dataset_id, hid_t space_id, hsize_t first, hsize_t nrecords, hid_t mem_type_id, void* buf);
+	void writeSelection(hid_t dataset_id, hid_t* space_id, hsize_t first, hsize_t nrecords, hid_t mem_type_id, const void* buf);
+	void readRecords(hsize_t first, hsize_t nrecords, void* buf);
+	void readColumns(hsize_t first, hsize_t nrecords, const std::vector<size_t>& field_ids,
+		const boost::shared_ptr<tsdb::Structure>& _structure, void* buf);
+	const char* mappedChunk(hsize_t chunk);
+	const char* mappedRun(hsize_t* first, hsize_t* last, bool forward);
+	bool readMapped(hsize_t first, hsize_t nrecords, hid_t mem_type_id, void* buf);
+	size_t elementSize(hid_t mem_type_id);
+	void countRead(tsdb::StatCounter& reads, hsize_t nrecords, size_t element_size);
+	static bool isColumnar(hid_t loc_id, std::string name);
+	std::string symbolTableName(size_t field);
+	void openSymbols(void);
+	void saveSymbols(void);
+	void loadSymbols(size_t field);
+	void saveSchema(void);
+	static bool loadSchema(hid_t loc_id, const std::string& name, std::vector<Field*>* fields,
+		std::vector<size_t>* offsets, size_t* type_size);
+	static void loadFieldAttributes(hid_t loc_id, const std::string& name, bool columnar, std::vector<Field*>* fields,
+		std::vector<size_t>* offsets, size_t* type_size);
+	static Field* fieldFromTSDBType(const std::string& type, const std::string& name);
+	static bool readStringAttribute(hid_t loc_id, const std::string& name, const std::string& attr, std::string* value);
+
+	/* Version of the TSDB_SCHEMA attribute that saveSchema() writes */
+	static const int SCHEMA_VERSION = 1;
+
 	/* Properties */
 	hid_t my_loc_id;
 	std::string my_name;
 	std::string my_title;
 	boost::shared_ptr<tsdb::Structure> my_structure;
+	tsdb::StorageOptions my_options;
 	bool my_is_saved;
 	tsdb::MemoryBlock my_append_buffer;
 	size_t my_nappendbuf;
 
+	/* Handles kept open for the lifetime of the Table */
+	hid_t my_dataset_id;
+	hid_t my_space_id;
+	hid_t my_mem_type_id;  // a whole record, laid out as in my_structure
+	hid_t my_ts_type_id;   // just the first (timestamp) field
+	hsize_t my_nrecords;
+	boost::shared_ptr<tsdb::ChunkReader> my_chunk_reader;
+
+	/* Handles of a columnar Table, which has one dataset per field */
+	bool my_columnar;
+	hid_t my_group_id;
+	std::vector<hid_t> my_column_ids;
+	std::vector<hid_t> my_column_space_ids;
+	std::vector<boost::shared_ptr<tsdb::ChunkReader> > my_column_readers;
+
+	/* The file mapped into memory by mapRecords(), and where the records are in it */
+	boost::shared_ptr<tsdb::FileMapping> my_mapping;
+	bool my_map_contiguous;
+	hsize_t my_map_chunk_records;                // records per chunk, or of the whole contiguous dataset
+	std::vector<long long> my_map_chunk_offsets; // file offset of each chunk, looked up as it is first read
+
+	/* What the Table has done, see stats() */
+	tsdb::TableCounters my_counters;
+
+	/* The dictionary of each SymbolField, or NULL for other fields, and how many of its symbols are saved */
+	std::vector<boost::shared_ptr<tsdb::Table> > my_symbol_tables;
+	std::vector<size_t> my_symbols_saved;
+
 };
 
 } // namespace tsdb
@@ -0,0 +1,81 @@
+/* STL includes */
+#include <algorithm>
+#include "boost/thread/thread.hpp"
+
+/* TSDB includes */
+#include "tailcursor.h"
+#include "timeseries.h"
+#include "stats.h"
+
+namespace tsdb {
+
+/* ====================================================================
+ * class TailCursor - follows a Timeseries as it grows
+ * ====================================================================
+ */
+
+/** <summary>Creates a cursor over the records of <c>_series</c> from <c>_start</c> on</summary>
+ * <param name="_series">The series to follow</param>
+ * <param name="_start">First timestamp to return</param>
+ * <param name="_poll_ms">How often to look for new records while waiting, in milliseconds</param>
+ */
+TailCursor::TailCursor(tsdb::Timeseries& _series, tsdb::timestamp_t _start, unsigned int _poll_ms):
+	my_series(&_series), my_structure(_series.structure()), my_poll_ms(_poll_ms > 0 ? _poll_ms : 1) {
+	my_series->refresh();
+
+	// With no record at or after _start yet, every record appended from now on is
+	if(my_series->recordId_GE(_start, &my_next_id) == -1) {
+		my_next_id = my_series->getNRecords();
+	}
+	my_first_id = my_next_id;
+}
+
+/** <summary>Moves to the next record, waiting for it if need be</summary>
+ * <remarks>Returns false if no new record has come after <c>timeout_ms</c> milliseconds. A negative
+ * timeout waits for as long as it takes, and 0 only looks once.</remarks>
+ */
+bool TailCursor::next(long timeout_ms) {
+	unsigned long long deadline = StatTimer::now() + (unsigned long long) std::max(timeout_ms, 0L) * 1000ULL;
+	bool refreshed = false;
+
+	for(;;) {
+		if(my_cursor.next()) {
+			return true;
+		}
+
+		hsize_t nrecords = my_series->getNRecords();
+		if(nrecords > my_next_id) {
+			my_cursor = my_series->cursor(my_next_id, nrecords - 1);
+			my_first_id = my_next_id;
+			my_next_id = nrecords;
+			continue;
+		}
+
+		// Look for new records once before waiting at all
+		if(refreshed) {
+			unsigned long long now = StatTimer::now();
+			if(timeout_ms >= 0 && now >= deadline) {
+				return false;
+			}
+			unsigned long long wait_us = (unsigned long long) my_poll_ms * 1000ULL;
+			if(timeout_ms >= 0) {
+				wait_us = std::min(wait_us, deadline - now);
+			}
+			boost::this_thread::sleep(boost::posix_time::microseconds((long) wait_us));
+		}
+		my_series->refresh();
+		refreshed = true;
+	}
+}
+
+/** <summary>Returns the record id of the current record in the Timeseries</summary> */
+hsize_t TailCursor::recordId(void) const {
+	return my_first_id + my_cursor.position();
+}
+
+/** <summary>Returns the Structure of the records</summary> */
+const boost::shared_ptr<tsdb::Structure>& TailCursor::structure(void) const {
+	return my_structure;
+}
+
+} // namespace tsdb
@@ -0,0 +1,54 @@
+#pragma once
+
+/* External Libraries */
+#include "hdf5.h"
+#include <boost/shared_ptr.hpp>
+
+/* TSDB Includes */
+#include "tsdb.h"
+#include "structure.h"
+#include "recordcursor.h"
+
+namespace tsdb {
+
+class Timeseries;
+
+/* -----------------------------------------------------------------
+ * TailCursor. Follows a Timeseries as records are appended to it.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>A forward cursor that waits for new records at the end of a Timeseries</summary>
+ * <remarks><p>The cursor returns the records from <c>start</c> on, like a RecordCursor. When it gets to the
+ * last record, next() calls Timeseries::refresh() every <c>poll_ms</c> milliseconds until the writer has
+ * appended more, or the timeout is up. The new records are read with a RecordCursor over just them, so
+ * following a series reads each record once.</p>
+ * <p>This is how a dashboard follows a series in a file opened with Swmr::openForRead(), while
+ * tsdbimport or a feed handler appends to it. HDF5 does not tell readers when a file changes, so the
+ * cursor polls.</p>
+ * <p>The Timeseries must stay open while the cursor is used, and should not be used by other threads at
+ * the same time.</p></remarks>
+ */
+class TailCursor
+{
+public:
+	TailCursor(tsdb::Timeseries& _series, tsdb::timestamp_t _start, unsigned int _poll_ms = 100);
+
+	bool next(long timeout_ms = -1);
+
+	/** <summary>Returns the current record. Only valid after next() returned true.</summary> */
+	tsdb::RecordView record(void) const { return my_cursor.record(); }
+
+	hsize_t recordId(void) const;
+	const boost::shared_ptr<tsdb::Structure>& structure(void) const;
+
+private:
+	tsdb::Timeseries* my_series;
+	boost::shared_ptr<tsdb::Structure> my_structure;
+	tsdb::RecordCursor my_cursor;	// over records my_first_id to my_next_id - 1
+	hsize_t my_first_id;
+	hsize_t my_next_id;				// the first record that my_cursor does not cover
+	unsigned int my_poll_ms;
+};
+
+} // namespace tsdb
@@ -1,2 +1,423 @@
+#define BOOST_TEST_MODULE timeseries_test
 #include <boost/test/unit_test.hpp>
-#include "timeseries.
\ No newline at end of file
+#include "timeseries.h"
+#include "recordsort.h"
+#include "record.h"
+#include "recordset.h"
+#include "cell.h"
+#include "aggregate.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+using namespace tsdb;
+
+namespace {
+
+/* The records of the series in these tests: a timestamp and a double */
+struct test_record {
+	timestamp_t timestamp;
+	double value;
+};
+
+/* A scratch HDF5 file, removed at the end of each test */
+struct TestFile {
+	TestFile(void): path("timeseries_test.h5") {
+		fid = H5Fcreate(path.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+		BOOST_REQUIRE(fid >= 0);
+	}
+	~TestFile(void) {
+		H5Fclose(fid);
+		remove(path.c_str());
+	}
+
+	/* Creates a series of test_records */
+	Timeseries* create(const std::string& name) {
+		std::vector<Field*> fields;
+		fields.push_back(new DoubleField("value"));
+		Timeseries* ts = new Timeseries(fid, name, "test", fields);
+		BOOST_REQUIRE_EQUAL(ts->structure()->getSizeOf(), sizeof(test_record));
+		return ts;
+	}
+
+	std::string path;
+	hid_t fid;
+};
+
+/* Reads every record of a series */
+std::vector<test_record> readAll(Timeseries& ts) {
+	std::vector<test_record> records((size_t) ts.getNRecords());
+	if(!records.empty()) {
+		void* data = ts.getRecordsById(0, records.size() - 1);
+		memcpy(&records[0], data, records.size() * sizeof(test_record));
+		free(data);
+	}
+	return records;
+}
+
+unsigned long long statValue(Timeseries& ts, const std::string& name) {
+	StatList items = ts.stats().items();
+	for(size_t i = 0; i < items.size(); i++) {
+		if(items[i].first == name) {
+			return items[i].second;
+		}
+	}
+	BOOST_FAIL("no stat called " + name);
+	return 0;
+}
+
+bool timestampLess(const test_record& a, const test_record& b) {
+	return a.timestamp < b.timestamp;
+}
+
+/* Checks lookupAsOf() for sorted queries against a scan of every record. Returns the mismatches. */
+size_t checkAsOf(Timeseries& ts, const std::vector<timestamp_t>& queries) {
+	std::vector<test_record> stored = readAll(ts);
+	std::vector<hsize_t> ids(queries.size());
+	std::vector<test_record> found(queries.size());
+	size_t nfound = ts.lookupAsOf(&queries[0], queries.size(), &ids[0], &found[0]);
+
+	size_t mismatches = 0, nexpected = 0;
+	for(size_t i = 0; i < queries.size(); i++) {
+		// The first record of the run with the latest timestamp at or before the query
+		size_t expected = stored.size();
+		for(size_t j = 0; j < stored.size() && stored[j].timestamp <= queries[i]; j++) {
+			if(j == 0 || stored[j].timestamp != stored[j - 1].timestamp) {
+				expected = j;
+			}
+		}
+
+		if(ids[i] != expected) {
+			mismatches++;
+		} else if(expected < stored.size()) {
+			nexpected++;
+			if(found[i].timestamp != stored[expected].timestamp || found[i].value != stored[expected].value) {
+				mismatches++;
+			}
+		}
+	}
+	if(nfound != nexpected) {
+		mismatches++;
+	}
+	return mismatches;
+}
+
+/* Appends records with appendRecord(), one at a time */
+void appendOneByOne(Timeseries& ts, const std::vector<test_record>& records) {
+	boost::shared_ptr<Structure> structure = ts.structure();
+	Record record(structure);
+	for(size_t i = 0; i < records.size(); i++) {
+		record[0] = records[i].timestamp;
+		record[1] = records[i].value;
+		ts.appendRecord(record);
+	}
+}
+
+/* Returns true if two results of aggregate() have the same rows */
+bool sameRows(const RecordSet& a, const RecordSet& b) {
+	size_t row_size = a.structure()->getSizeOf();
+	return a.size() == b.size() && row_size == b.structure()->getSizeOf() &&
+		(a.size() == 0 || memcmp(a.memoryBlockPtr().raw(), b.memoryBlockPtr().raw(), a.size() * row_size) == 0);
+}
+
+/* Checks recordId_GE() and recordId_LE() for timestamps first to last against a scan. Returns the mismatches. */
+size_t checkLookups(Timeseries& ts, timestamp_t first, timestamp_t last) {
+	std::vector<test_record> stored = readAll(ts);
+	size_t mismatches = 0;
+	for(timestamp_t t = first; t <= last; t++) {
+		// The first record at or after t, and the first record of the run at or before t
+		size_t ge = 0;
+		while(ge < stored.size() && stored[ge].timestamp < t) {
+			ge++;
+		}
+		size_t le = stored.size();
+		for(size_t j = 0; j < stored.size() && stored[j].timestamp <= t; j++) {
+			if(j == 0 || stored[j].timestamp != stored[j - 1].timestamp) {
+				le = j;
+			}
+		}
+
+		hsize_t id = 0;
+		bool found = ts.recordId_GE(t, &id) >= 0;
+		if(found != (ge < stored.size()) || (found && id != ge)) {
+			mismatches++;
+		}
+		found = ts.recordId_LE(t, &id) >= 0;
+		if(found != (le < stored.size()) || (found && id != le)) {
+			mismatches++;
+		}
+	}
+	return mismatches;
+}
+
+} // namespace
+
+/* ---- appendRecords() and RecordSort ---- */
+
+BOOST_AUTO_TEST_CASE( append_sorts_unsorted_batch )
+{
+	TestFile file;
+	std::auto_ptr<Timeseries> ts(file.create("unsorted"));
+
+	// Only the last record is out of order, and it is still after the first one
+	test_record records[] = { {1, 0.0}, {5, 1.0}, {3, 2.0} };
+	ts->appendRecords(3, records, false);
+
+	std::vector<test_record> stored = readAll(*ts);
+	BOOST_REQUIRE_EQUAL(stored.size(), 3u);
+	BOOST_CHECK_EQUAL(stored[0].timestamp, 1);
+	BOOST_CHECK_EQUAL(stored[1].timestamp, 3);
+	BOOST_CHECK_EQUAL(stored[2].timestamp, 5);
+	BOOST_CHECK_EQUAL(statValue(*ts, "sorted_batches"), 1u);
+}
+
+BOOST_AUTO_TEST_CASE( append_keeps_sorted_batch )
+{
+	TestFile file;
+	std::auto_ptr<Timeseries> ts(file.create("sorted"));
+
+	test_record records[] = { {1, 0.0}, {1, 1.0}, {2, 2.0} };
+	ts->appendRecords(3, records, false);
+
+	BOOST_CHECK_EQUAL(statValue(*ts, "sorted_batches"), 0u);
+	BOOST_CHECK_EQUAL(readAll(*ts)[1].value, 1.0);
+}
+
+BOOST_AUTO_TEST_CASE( append_sort_is_stable )
+{
+	TestFile file;
+	std::auto_ptr<Timeseries> ts(file.create("stable"));
+
+	test_record records[] = { {5, 0.0}, {1, 1.0}, {5, 2.0}, {3, 3.0}, {1, 4.0} };
+	ts->appendRecords(5, records, false);
+
+	std::vector<test_record> stored = readAll(*ts);
+	const double expected[] = { 1.0, 4.0, 3.0, 0.0, 2.0 };
+	BOOST_REQUIRE_EQUAL(stored.size(), 5u);
+	for(size_t i = 0; i < stored.size(); i++) {
+		BOOST_CHECK_EQUAL(stored[i].value, expected[i]);
+	}
+}
+
+BOOST_AUTO_TEST_CASE( record_sort_matches_stable_sort )
+{
+	// Enough records for the parallel sort, with many repeated and some negative timestamps
+	size_t nrecords = PARALLEL_SORT_GE + 1000;
+	std::vector<test_record> records(nrecords);
+	unsigned seed = 12345;
+	for(size_t i = 0; i < nrecords; i++) {
+		seed = seed * 1103515245 + 12345;
+		records[i].timestamp = (timestamp_t) ((seed >> 8) % 5000) - 1000;
+		records[i].value = (double) i;
+	}
+
+	std::vector<test_record> expected(records);
+	std::stable_sort(expected.begin(), expected.end(), timestampLess);
+
+	BOOST_CHECK(!RecordSort::isSorted(&records[0], nrecords, sizeof(test_record)));
+	RecordSort::sort(&records[0], nrecords, sizeof(test_record), 4);
+	BOOST_CHECK(RecordSort::isSorted(&records[0], nrecords, sizeof(test_record)));
+
+	size_t mismatches = 0;
+	for(size_t i = 0; i < nrecords; i++) {
+		if(records[i].timestamp != expected[i].timestamp || records[i].value != expected[i].value) {
+			mismatches++;
+		}
+	}
+	BOOST_CHECK_EQUAL(mismatches, 0u);
+}
+
+/* ---- Index settings, verifyIndex() and rebuildIndex() ---- */
+
+BOOST_AUTO_TEST_CASE( verify_index_after_reopen_with_index_step )
+{
+	TestFile file;
+	{
+		std::auto_ptr<Timeseries> ts(file.create("stepped"));
+		ts->setSplitIndexGt(1000);
+		ts->setIndexStep(100);
+
+		// Runs of repeated timestamps, so index points fall inside some of them
+		std::vector<test_record> records(20000);
+		for(size_t i = 0; i < records.size(); i++) {
+			records[i].timestamp = 1000 + (timestamp_t) (i / 3);
+			records[i].value = (double) i;
+		}
+		for(size_t i = 0; i < records.size(); i += 5000) {
+			ts->appendRecords(5000, &records[i], false);
+		}
+		BOOST_REQUIRE(ts->verifyIndex(2).ok());
+	}
+
+	Timeseries reopened(file.fid, "stepped");
+	IndexCheck check = reopened.verifyIndex(2);
+	BOOST_CHECK(check.index_points > 100);
+	BOOST_CHECK_EQUAL(check.bad_index_points, 0u);
+	BOOST_CHECK_EQUAL(check.bad_zone_blocks, 0u);
+	BOOST_CHECK(check.ok());
+
+	reopened.rebuildIndex(2);
+	BOOST_CHECK(reopened.verifyIndex(2).ok());
+}
+
+/* ---- lookupAsOf() ---- */
+
+BOOST_AUTO_TEST_CASE( lookup_as_of_matches_scan )
+{
+	TestFile file;
+	std::auto_ptr<Timeseries> ts(file.create("asof"));
+	ts->setSplitIndexGt(500);
+	ts->setIndexStep(128);
+
+	// Gaps and runs of repeated timestamps
+	std::vector<test_record> records(3000);
+	timestamp_t timestamp = 1000;
+	unsigned seed = 42;
+	for(size_t i = 0; i < records.size(); i++) {
+		seed = seed * 1103515245 + 12345;
+		if((seed >> 8) % 10 >= 4) {
+			timestamp += 1 + (timestamp_t) ((seed >> 12) % 7);
+		}
+		records[i].timestamp = timestamp;
+		records[i].value = (double) i;
+	}
+	ts->appendRecords(records.size(), &records[0], false);
+
+	// Before the first record, on and between records, and after the last one
+	std::vector<timestamp_t> queries;
+	for(timestamp_t t = 900; t <= timestamp + 100; t += 3) {
+		queries.push_back(t);
+	}
+	BOOST_CHECK_EQUAL(checkAsOf(*ts, queries), 0u);
+
+	// Late records, some on timestamps already in the series and one before the first record
+	test_record late[] = { {1500, -1.0}, {990, -2.0}, {records[1000].timestamp, -3.0}, {timestamp, -4.0} };
+	ts->mergeRecords(4, late);
+	BOOST_CHECK_EQUAL(checkAsOf(*ts, queries), 0u);
+
+	// A single query, and queries that are all after the last record
+	std::vector<timestamp_t> one(1, records[2000].timestamp);
+	BOOST_CHECK_EQUAL(checkAsOf(*ts, one), 0u);
+	std::vector<timestamp_t> after(5, timestamp + 1);
+	BOOST_CHECK_EQUAL(checkAsOf(*ts, after), 0u);
+}
+
+/* ---- SegmentIndex ---- */
+
+BOOST_AUTO_TEST_CASE( segment_index_lookups_around_open_segment )
+{
+	TestFile file;
+	std::auto_ptr<Timeseries> ts(file.create("segments"));
+	ts->useSegmentIndex(4);
+
+	// Only the open segment: lookups below, inside and above it
+	std::vector<test_record> records(14);
+	for(size_t i = 0; i < records.size(); i++) {
+		records[i].timestamp = 1000 + 3 * (timestamp_t) i;
+		records[i].value = (double) i;
+	}
+	ts->appendRecords(records.size(), &records[0], false);
+	BOOST_CHECK_EQUAL(checkLookups(*ts, 980, 1060), 0u);
+
+	// Uneven gaps and repeats close segments, so the lookups also go through saved ones
+	records.resize(400);
+	timestamp_t timestamp = 1039;
+	for(size_t i = 0; i < records.size(); i++) {
+		timestamp += (i % 50 < 25) ? 1 : (i % 7 == 0) ? 0 : 9;
+		records[i].timestamp = timestamp;
+		records[i].value = (double) (14 + i);
+	}
+	ts->appendRecords(records.size(), &records[0], false);
+	BOOST_CHECK_EQUAL(checkLookups(*ts, 980, timestamp + 20), 0u);
+	BOOST_CHECK(statValue(*ts, "segment_lookups") > 0);
+}
+
+/* ---- Rollups ---- */
+
+BOOST_AUTO_TEST_CASE( rollup_after_reopen_and_append_record )
+{
+	std::vector<AggregateSpec> specs;
+	specs.push_back(AggregateSpec(AggregateSpec::FIRST, "value"));
+	specs.push_back(AggregateSpec(AggregateSpec::LAST, "value"));
+	specs.push_back(AggregateSpec(AggregateSpec::SUM, "value"));
+	specs.push_back(AggregateSpec(AggregateSpec::COUNT));
+
+	// The same records in a series with a rollup and in one without
+	std::vector<test_record> records(100);
+	for(size_t i = 0; i < records.size(); i++) {
+		records[i].timestamp = (timestamp_t) i;
+		records[i].value = (double) (i * i % 17);
+	}
+	TestFile file;
+	{
+		std::auto_ptr<Timeseries> rolled(file.create("rolled"));
+		std::auto_ptr<Timeseries> raw(file.create("raw"));
+		rolled->appendRecords(50, &records[0], false);
+		raw->appendRecords(50, &records[0], false);
+		rolled->addRollup(10, specs);
+	}
+
+	// The first records appended after the series is opened again go through the append buffer
+	Timeseries rolled(file.fid, "rolled");
+	Timeseries raw(file.fid, "raw");
+	std::vector<test_record> tail(records.begin() + 50, records.end());
+	appendOneByOne(rolled, tail);
+	appendOneByOne(raw, tail);
+	rolled.flushAppendBuffer();
+	raw.flushAppendBuffer();
+
+	RecordSet expected = raw.aggregate(0, 99, 10, specs);
+	RecordSet result = rolled.aggregate(0, 99, 10, specs);
+	BOOST_CHECK_EQUAL(expected.size(), 10u);
+	BOOST_CHECK(sameRows(result, expected));
+	BOOST_CHECK_EQUAL(statValue(rolled, "rollup_aggregates"), 1u);
+
+	// And the rows saved in the file
+	Timeseries reopened(file.fid, "rolled");
+	BOOST_CHECK(sameRows(reopened.aggregate(0, 99, 10, specs), expected));
+}
+
+/* ---- appendRecord() with an AppendWriter ---- */
+
+BOOST_AUTO_TEST_CASE( async_append_after_truncate_and_merge )
+{
+	TestFile file;
+	std::auto_ptr<Timeseries> ts(file.create("async"));
+	ts->setAsyncAppend(256);
+
+	std::vector<test_record> records(100);
+	for(size_t i = 0; i < records.size(); i++) {
+		records[i].timestamp = (timestamp_t) i;
+		records[i].value = (double) i;
+	}
+	appendOneByOne(*ts, records);
+
+	// The order is checked against the end of the series after the truncate, not before it
+	ts->truncate(50);
+	std::vector<test_record> later(1, records[60]);
+	BOOST_CHECK_NO_THROW(appendOneByOne(*ts, later));
+	std::vector<test_record> earlier(1, records[55]);
+	BOOST_CHECK_THROW(appendOneByOne(*ts, earlier), std::runtime_error);
+	ts->flushAppendBuffer();
+
+	std::vector<test_record> stored = readAll(*ts);
+	BOOST_REQUIRE_EQUAL(stored.size(), 51u);
+	BOOST_CHECK_EQUAL(stored[49].timestamp, 49);
+	BOOST_CHECK_EQUAL(stored[50].timestamp, 60);
+
+	// ... and against the end of the series after a merge
+	test_record merged[] = { {10, -1.0}, {70, -2.0} };
+	ts->mergeRecords(2, merged);
+	BOOST_CHECK_THROW(appendOneByOne(*ts, later), std::runtime_error);
+	std::vector<test_record> last(1, records[80]);
+	BOOST_CHECK_NO_THROW(appendOneByOne(*ts, last));
+	ts->flushAppendBuffer();
+
+	stored = readAll(*ts);
+	BOOST_REQUIRE_EQUAL(stored.size(), 54u);
+	BOOST_CHECK_EQUAL(stored[52].timestamp, 70);
+	BOOST_CHECK_EQUAL(stored[53].timestamp, 80);
+}
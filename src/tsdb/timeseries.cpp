@@ -2,8 +2,12 @@
 #include <string>
 #include <vector>
 #include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
 #include "limits.h"
 #include <boost/make_shared.hpp>
+#include <boost/bind.hpp>
 
 /* HDF5 Includes */
 #include "hdf5.h"
@@ -16,7 +20,20 @@
 #include "field.h"
 #include "structure.h"
 #include "bufferedrecordset.h"
+#include "recordcursor.h"
+#include "aggregate.h"
+#include "zonemap.h"
+#include "segmentindex.h"
+#include "recordsort.h"
+#include "appendwriter.h"
+#include "hdf5lock.h"
 #include "cell.h"
+#include "catalog.h"
+#include "predicate.h"
+#include "memoryblock.h"
+#include "parallelscan.h"
+#include "chunkcache.h"
+#include "rollup.h"
 
 
 
@@ -32,6 +49,14 @@ namespace tsdb {
 Timeseries::Timeseries() {
 	my_split_index_gt = SPLIT_INDEX_GT;
 	my_index_step = INDEX_STEP;
+	my_search_window = SEARCH_WINDOW;
+	my_indexed_nrecords = 0;
+	my_indexed_last_ts = 0;
+	my_indexed_last_ts_known = false;
+	my_last_record_known = false;
+	my_swmr_write = false;
+	my_defer_index = false;
+	my_rolled_nrecords = 0;
 }
 /** <summary>Timeseries create constructor, with a vector of fields</summary>
  * <remarks><p>Creates a new timeseries with the fields in <c>new_fields</c>. Note that the 
@@ -45,14 +70,19 @@ Timeseries::Timeseries() {
  * <param name="new_name">A name for the timeseries. This name needs to obey HDF5 naming rules.</param>
  * <param name="new_title">The title of the timeseries</param>
  * <param name="new_fields">A vector of fields to include with the timeseries</param>
+ * <param name="_options">Storage options for the data table. Indexes created later use the same options.</param>
  */
-Timeseries::Timeseries(const hid_t _loc_id, const std::string& _name, const std::string& _title, const std::vector<Field*>& _fields) {
+Timeseries::Timeseries(const hid_t _loc_id, const std::string& _name, const std::string& _title, const std::vector<Field*>& _fields,
+	const tsdb::StorageOptions& _options) {
+	HDF5Lock lock;
 	vector<Field*> fields_with_timestamp;
+
 	my_loc_id = _loc_id;
 	my_name = _name;
 	my_title = _title;
 	my_split_index_gt = SPLIT_INDEX_GT;
 	my_index_step = INDEX_STEP;
+	my_search_window = SEARCH_WINDOW;
 
 	/* Does the timeseries exist? */
 	if(Timeseries::exists(_loc_id, _name)) {
@@ -75,11 +105,17 @@ Timeseries::Timeseries(const hid_t _loc_id, const std::string& _name, const std:
 	my_structure = boost::make_shared<tsdb::Structure>(fields_with_timestamp, true);
 
 	// Create the data table
-	my_data = boost::make_shared<tsdb::Table>(my_group_id, "_TSDB_data", "TSDB: Timeseries Data", my_structure);
+	my_data = boost::make_shared<tsdb::Table>(my_group_id, "_TSDB_data", "TSDB: Timeseries Data", my_structure, _options);
+	Catalog::add(my_loc_id, my_name);
 
 	my_buffer_last_ts = LLONG_MIN;
-
-
+	my_indexed_nrecords = 0;
+	my_indexed_last_ts = 0;
+	my_indexed_last_ts_known = false;
+	my_last_record_known = false;
+	my_swmr_write = false;
+	my_defer_index = false;
+	my_rolled_nrecords = 0;
 }
 /** <summary>Timeseries create constructor, with a pre-defined structure.</summary>
  * <remarks><p>Creates a new timeseries with  structure in <c>new_struct</c>. You must include a 
@@ -89,13 +125,18 @@ Timeseries::Timeseries(const hid_t _loc_id, const std::string& _name, const std:
  * <param name="new_name">A name for the timeseries. This name needs to obey HDF5 naming rules.</param>
  * <param name="new_title">The title of the timeseries</param>
  * <param name="new_struct">A Structure, with a _TSDB_timestamp field as the first field</param>
+ * <param name="_options">Storage options for the data table. Indexes created later use the same options.</param>
  */
-Timeseries::Timeseries(const hid_t _loc_id, const std::string& _name, const std::string& _title, const boost::shared_ptr<tsdb::Structure>& _structure) {
+Timeseries::Timeseries(const hid_t _loc_id, const std::string& _name, const std::string& _title, const boost::shared_ptr<tsdb::Structure>& _structure,
+	const tsdb::StorageOptions& _options) {
+	HDF5Lock lock;
+
 	my_loc_id = _loc_id;
 	my_name = _name;
 	my_title = _title;
 	my_split_index_gt = SPLIT_INDEX_GT;
 	my_index_step = INDEX_STEP;
+	my_search_window = SEARCH_WINDOW;
 
 	/* Does the timeseries exist? */
 	if(Timeseries::exists(_loc_id, _name)) {
@@ -121,9 +162,17 @@ Timeseries::Timeseries(const hid_t _loc_id, const std::string& _name, const std:
 	my_structure = _structure;
 
 	// Create the data table
-	my_data = boost::make_shared<tsdb::Table>(my_group_id, "_TSDB_data", "TSDB: Timeseries Data", my_structure);
+	my_data = boost::make_shared<tsdb::Table>(my_group_id, "_TSDB_data", "TSDB: Timeseries Data", my_structure, _options);
+	Catalog::add(my_loc_id, my_name);
 
 	my_buffer_last_ts = LLONG_MIN;
+	my_indexed_nrecords = 0;
+	my_indexed_last_ts = 0;
+	my_indexed_last_ts_known = false;
+	my_last_record_known = false;
+	my_swmr_write = false;
+	my_defer_index = false;
+	my_rolled_nrecords = 0;
 }
 
 /** <summary>Timeseries open constructor</summary>
@@ -133,6 +182,8 @@ Timeseries::Timeseries(const hid_t _loc_id, const std::string& _name, const std:
  * <param name="grp_name">Name of the timeseries</param>
  */
 Timeseries::Timeseries(const hid_t _loc_id, const std::string& _name) {
+	HDF5Lock lock;
+
 	hid_t grp_id;
 
 	grp_id = H5Gopen(_loc_id,_name.c_str(),H5P_DEFAULT);
@@ -151,12 +202,69 @@ Timeseries::Timeseries(const hid_t _loc_id, const std::string& _name) {
 	my_title = my_data->title();
 	my_split_index_gt = SPLIT_INDEX_GT;
 	my_index_step = INDEX_STEP;
+	my_search_window = SEARCH_WINDOW;
+
+	// Index settings that were changed when the series was written
+	loadIndexSetting("TSDB_INDEX_STEP", &my_index_step);
+	loadIndexSetting("TSDB_SPLIT_INDEX_GT", &my_split_index_gt);
 	
 	if(Timeseries::exists(grp_id,"_TSDB_index")) {
 		my_index_ts = boost::make_shared<tsdb::Timeseries>(grp_id,"_TSDB_index");
+		loadIndexCache();
 	}
 
+	if(ZoneMap::exists(grp_id)) {
+		my_zone_map = boost::make_shared<tsdb::ZoneMap>(grp_id, my_structure);
+	}
+
+	if(SegmentIndex::exists(grp_id)) {
+		my_segment_index = boost::make_shared<tsdb::SegmentIndex>(grp_id);
+	}
+
+	openRollups();
+	my_rolled_nrecords = my_data->size();
+
 	my_buffer_last_ts = LLONG_MIN;
+	my_indexed_nrecords = 0;
+	my_indexed_last_ts = 0;
+	my_indexed_last_ts_known = false;
+	my_last_record_known = false;
+	my_swmr_write = false;
+	my_defer_index = false;
+
+	// The records of an existing index have all been indexed
+	if(my_index_ts.get() != 0) {
+		my_indexed_nrecords = my_data->size();
+	}
+}
+
+/** <summary>Removes the index, the zone map and the segment index of a Timeseries from the file</summary>
+ * <remarks><p>For a series whose index is so broken that it can not be opened: remove it, open the series,
+ * and call rebuildIndex(). The series must not be open. HDF5 does not give back the space they took;
+ * h5repack does.</p>
+ * <p>The ChunkCache is cleared, as new datasets with the same names could be written where the old ones
+ * were. Throws a TimeseriesException if the series can not be opened, or a dataset can not be removed.</p></remarks>
+ * <param name="loc_id">A HDF5 hid_t (group or file id) where the timeseries exists</param>
+ * <param name="name">Name of the timeseries</param>
+ */
+void Timeseries::dropIndex(hid_t loc_id, const std::string& name) {
+	HDF5Lock lock;
+
+	hid_t grp_id = H5Gopen(loc_id, name.c_str(), H5P_DEFAULT);
+	if(grp_id < 0) {
+		throw( TimeseriesException("Could not open timeseries '" + name + "'.") );
+	}
+
+	const char* index_names[] = { "_TSDB_index", "_TSDB_zonemap", "_TSDB_segments" };
+	for(size_t i = 0; i < sizeof(index_names) / sizeof(index_names[0]); i++) {
+		if(H5Lexists(grp_id, index_names[i], H5P_DEFAULT) > 0 && H5Ldelete(grp_id, index_names[i], H5P_DEFAULT) < 0) {
+			H5Gclose(grp_id);
+			throw( TimeseriesException(std::string("Could not remove '") + index_names[i] + "' of timeseries '" + name + "'.") );
+		}
+	}
+	H5Gclose(grp_id);
+
+	ChunkCache::global().clear();
 }
 
 /** <summary>Checks if a Timeseries exists at the specified location</summary>
@@ -164,6 +272,8 @@ Timeseries::Timeseries(const hid_t _loc_id, const std::string& _name) {
  * <param name="name">Name of the timeseries</param>
  */
 bool Timeseries::exists(hid_t loc_id, std::string name) {
+	HDF5Lock lock;
+
 	hid_t grp_id;
 	herr_t status;
 	/* Error printing off */
@@ -192,12 +302,48 @@ bool Timeseries::exists(hid_t loc_id, std::string name) {
 	}
 }
 
+/** <summary>Sets how many records apart index points and zone map blocks are</summary>
+ * <remarks>The step is saved with the series, as the TSDB_INDEX_STEP attribute of its group, so that
+ * verifyIndex() and rebuildIndex() use it again when the series is opened later. Set it before the series
+ * has an index; points already written keep their step.</remarks>
+ */
 void Timeseries::setIndexStep(size_t _index_step) {
+	waitForAppends();
 	my_index_step = _index_step;
+	saveIndexSetting("TSDB_INDEX_STEP", _index_step);
 }
 
+/** <summary>Sets how many records the series has before an index is created</summary>
+ * <remarks>Saved with the series as the TSDB_SPLIT_INDEX_GT attribute of its group, as setIndexStep() does.
+ * </remarks>
+ */
 void Timeseries::setSplitIndexGt(size_t _split_index_gt) {
+	waitForAppends();
 	my_split_index_gt = _split_index_gt;
+	saveIndexSetting("TSDB_SPLIT_INDEX_GT", _split_index_gt);
+}
+
+/* Saves an index setting as an attribute of the group of the series */
+void Timeseries::saveIndexSetting(const char* attr_name, size_t value) {
+	HDF5Lock lock;
+	long long saved = (long long) value;
+	if(H5LTset_attribute_long_long(my_group_id, ".", attr_name, &saved, 1) < 0) {
+		throw( TimeseriesException(std::string("Error saving the ") + attr_name + " attribute.") );
+	}
+}
+
+/* Loads an index setting saved by saveIndexSetting(). Returns false if the series does not have it. */
+bool Timeseries::loadIndexSetting(const char* attr_name, size_t* value) {
+	HDF5Lock lock;
+	if(H5Aexists_by_name(my_group_id, ".", attr_name, H5P_DEFAULT) <= 0) {
+		return false;
+	}
+	long long saved = 0;
+	if(H5LTget_attribute_long_long(my_group_id, ".", attr_name, &saved) < 0) {
+		throw( TimeseriesException(std::string("Error reading the ") + attr_name + " attribute.") );
+	}
+	*value = (size_t) saved;
+	return true;
 }
 
 
@@ -216,7 +362,8 @@ void Timeseries::setSplitIndexGt(size_t _split_index_gt) {
  * are discarded.</param>
  */
 int Timeseries::appendRecords(size_t nrecords, void* records, bool discard_overlap) {
-	
+	waitForAppends();
+
 	// No records to append, just return
 	if(nrecords == 0) {
 		return 0;
@@ -227,11 +374,12 @@ int Timeseries::appendRecords(size_t nrecords, void* records, bool discard_overl
 	long long* tsptr = NULL;
 	long long prevts = 0;
 	long long curts = 0;
-	void* last_record = NULL;
-	herr_t status;
 	size_t record_size = my_structure->getSizeOf();
 	size_t i;
 
+	my_counters.append_batches.add();
+	my_counters.largest_batch.max(nrecords);
+
 	/* Write out some debugging */
 	#ifdef DEBUG
 		tracer << endl << "appending " << nrecords << " records..." << endl;
@@ -239,118 +387,248 @@ int Timeseries::appendRecords(size_t nrecords, void* records, bool discard_overl
 		tracer << "end: " << my_structure->structsToString(
 			my_structure->pointerToMember(records,nrecords-1,0),1,",","") << endl << endl;
 	#endif
-	if(nrecords > 1) {
-		// First determine if the records are sorted
-		// NOTE: Assuming the timestamp is offset zero! This speeds up this
-		// a lot since there are no methods calls to Structure methods.
-	
-		tsptr = (timestamp_t*) records_c;
-		prevts = *tsptr;
-
-		for(size_t i = 1; i<nrecords; i++) {
-			tsptr = (timestamp_t*) (records_c + (record_size*i));
-			if(prevts > *tsptr) {
-				// Sort the records and break
-				tracer << "** records need to be sorted!" << endl;
-				qsort(records, nrecords, record_size, tsdb::record_cmp);
-				break;
-			}
-		}
+	// First determine if the records are sorted
+	// NOTE: Assuming the timestamp is offset zero! This speeds up this
+	// a lot since there are no methods calls to Structure methods.
+	if(!RecordSort::isSorted(records, nrecords, record_size)) {
+		tracer << "** records need to be sorted!" << endl;
+		my_counters.sorted_batches.add();
+		RecordSort::sort(records, nrecords, record_size);
 	}
 
 	// Are the records to be added all after the last record in the table?
 	tsptr = (timestamp_t*) records_c;
 	curts = *tsptr;
 
-	last_record = my_data->getLastRecord();
-
-	if(last_record != NULL) {
-		prevts = *((timestamp_t*) last_record);
+	if(lastTimestamp(&prevts)) {
 
 		if(prevts > curts) {
 			// records aren't all after the last timestamp
 			if(!discard_overlap) {
-				free(last_record);
-				
 				throw( TimeseriesException("Records are overlapping, and discard_overlap=false.") );
 			} else {
 			// discard the overlapping records
 				for(i=0;i<nrecords;i++) {
 					curts = *((timestamp_t*) my_structure->pointerToMember(records,i,0));
 					if(curts >= prevts) {
-						my_data->appendRecords(nrecords-i,
-							my_structure->pointerToMember(records,i,0));
-						indexTail();
-						free(last_record);
+						my_counters.records_discarded.add(i);
+						appendAndIndex(nrecords-i, records_c + record_size*i);
 						tracer << "appended " << nrecords-i << " records, but discarded " << i << " records." << endl;
 						return i; 
 					}
 				}
 
-				status = 0;
-				free(last_record);
 				tracer << "did not append any records, because they all had timestamps < the last timestamp of the series." << endl;
+				my_counters.records_discarded.add(i);
 				return i;
 			}
 		}
 	}
 	
-	my_data->appendRecords(nrecords, records);
-
-	indexTail();
+	appendAndIndex(nrecords, records_c);
 
-	free(last_record);
 	return 0;
 }
 
-/** <summary>Destructor</summary>
- * <remarks>Note that Structure linked to this Timeseries is destroyed when this object is 
- * destroyed. This is the case whether it was passed on construction or generated internally.
- * Additionally, the append buffer is flushed to disk.</remarks>
+/** <summary>Adds records to a Timeseries, wherever their timestamps put them</summary>
+ * <remarks><p>Unlike appendRecords(), records before the last timestamp of the series are kept. The records
+ * are sorted, and the records of the series after the earliest of them are read back, merged with them and
+ * written again, so the cost is in the number of records after the earliest one. The index points and zone
+ * map blocks of that tail are redone by the same code that appends records. If every record is at or
+ * after the last timestamp, the records are just appended.</p>
+ * <p>Records already in the series come first among records with the same timestamp. Returns the number of
+ * records that went before a record already in the series.</p></remarks>
+ * <param name="nrecords">Number of records to add</param>
+ * <param name="records">Pointer to the records. They are sorted in place.</param>
  */
-Timeseries::~Timeseries(void) {
+int Timeseries::mergeRecords(size_t nrecords, void* records) {
+	if(nrecords == 0) {
+		return 0;
+	}
 
-}
+	commitAppendBuffer();
 
-/** <summary>Returns the Stucture of the Timeseries records</summary> */
-boost::shared_ptr<tsdb::Structure> Timeseries::structure(void) {
-	return my_structure;
+	my_counters.merges.add();
+	my_counters.records_merged.add(nrecords);
+
+	size_t record_size = my_structure->getSizeOf();
+	char* records_c = (char*) records;
+	RecordSort::sort(records, nrecords, record_size);
+
+	timestamp_t first_ts = *((timestamp_t*) records_c);
+	timestamp_t last_ts;
+	hsize_t first_later;   // first record of the series after the earliest new record
+	if(!lastTimestamp(&last_ts) || last_ts <= first_ts || recordId_GE(first_ts + 1, &first_later) < 0) {
+		appendAndIndex(nrecords, records_c);
+		resetBufferLastTimestamp();
+		return 0;
+	}
+
+	hsize_t tbl_nrecords = my_data->size();
+	size_t ntail = (size_t) (tbl_nrecords - first_later);
+	void* tail = NULL;
+	my_data->getRecords(first_later, tbl_nrecords - 1, &tail);
+	const char* tail_c = (const char*) tail;
+
+	vector<char> merged((ntail + nrecords) * record_size);
+	char* dst = &merged[0];
+	size_t i = 0, j = 0;
+	int nlate = 0;
+	while(i < ntail || j < nrecords) {
+		if(j == nrecords || (i < ntail &&
+			*((timestamp_t*) (tail_c + i * record_size)) <= *((timestamp_t*) (records_c + j * record_size)))) {
+			memcpy(dst, tail_c + i * record_size, record_size);
+			i++;
+		} else {
+			memcpy(dst, records_c + j * record_size, record_size);
+			j++;
+			if(i < ntail) {
+				nlate++;
+			}
+		}
+		dst += record_size;
+	}
+	free(tail);
+
+	tracer << "merging " << nrecords << " records into series: " << my_name << ", rewriting " << ntail << " records" << endl;
+	truncate(first_later);
+	appendAndIndex(ntail + nrecords, &merged[0]);
+	resetBufferLastTimestamp();
+
+	return nlate;
 }
-/**
- * <summary>
- * Creates and index for the timeseries instance, if the number of rows in the data
- * table is greater than or equal to <c>this->split_index_gt</c>.
- * </summary> <remarks>This method returns
- * <c>FALSE</c> if the index already exists (in which case the function does nothing),
- * and <c>TRUE</c> if the index was created by this function or if the data table is
- * too small for an index.
- * </remarks>
+
+/** <summary>Removes the records after the first <c>nrecords</c> records of the Timeseries</summary>
+ * <remarks>The index points at or after record <c>nrecords</c> are removed, and so are the zone map blocks
+ * that end after it. Appending records redoes them. The rows of the rollups after the bucket of the last
+ * record kept are removed, and that bucket is aggregated again from the records left in it. Throws a
+ * TimeseriesException if the series has fewer than <c>nrecords</c> records.</remarks>
+ * <param name="nrecords">The number of records to keep</param>
  */
-bool Timeseries::createIndexIfNecessary(void) {
+void Timeseries::truncate(hsize_t nrecords) {
+	commitAppendBuffer();
 
-	/* Conveience structure for index records */
-	#pragma pack(push, index_record, 4)
-	typedef struct {
-	timestamp_t timestamp;
-	hsize_t record_id; } index_record_t;
-	#pragma pack(pop, index_record )
+	if(nrecords > my_data->size()) {
+		throw( TimeseriesException("Can not truncate a timeseries to more records than it has.") );
+	}
+	if(nrecords == my_data->size()) {
+		return;
+	}
+
+	my_data->truncate(nrecords);
+	my_last_record_known = false;
+	resetBufferLastTimestamp();
+
+	if(my_segment_index.get() != 0) {
+		my_segment_index->truncate(nrecords);
+	}
+
+	if(my_indexed_nrecords > nrecords) {
+		my_indexed_nrecords = nrecords;
+		my_indexed_last_ts_known = false;
+	}
 
-	/* If the index already exists, then it is not necessary to create it.
-	 * Exit with FALSE. */
 	if(my_index_ts.get() != 0) {
+		size_t keep = my_index_cache.size();
+		while(keep > 0 && my_index_cache[keep - 1].record_id >= nrecords) {
+			keep--;
+		}
+		if(keep < my_index_cache.size()) {
+			my_index_ts->truncate(keep);
+			my_index_cache.resize(keep);
+		}
+
+		// Block k ends at index point k, so the blocks up to the kept points are still right
+		if(my_zone_map.get() != 0 && (keep < my_zone_map->size() || my_zone_map->nextRecordId() > nrecords)) {
+			my_zone_map->truncate(std::min(my_zone_map->size(), keep));
+		}
+	}
+
+	for(size_t i = 0; i < my_rollups.size(); i++) {
+		my_rollups[i]->invalidate();
+	}
+	my_rolled_nrecords = nrecords;
+	resumeRollups();
+}
+
+/** <summary>Appends sorted records to the data table, and indexes them while they are in memory</summary> */
+void Timeseries::appendAndIndex(size_t nrecords, const char* records) {
+	StatTimer timer(my_counters.append_us);
+	my_counters.records_appended.add(nrecords);
+
+	hsize_t first_id = my_data->size();
+	rollupTail();
+	my_data->appendRecords(nrecords, (void*) records);
+
+	size_t record_size = my_structure->getSizeOf();
+	my_last_record.assign(records + (nrecords - 1) * record_size, records + nrecords * record_size);
+	my_last_record_known = true;
+
+	if(!my_defer_index) {
+		indexRecords(first_id, nrecords, records);
+	}
+
+	for(size_t i = 0; i < my_rollups.size(); i++) {
+		my_rollups[i]->addRecords(records, nrecords);
+	}
+	my_rolled_nrecords = first_id + nrecords;
+
+	if(my_swmr_write) {
+		flushDatasets();
+	}
+}
+
+/** <summary>Gets the timestamp of the last record in the data table. Returns false if it is empty.</summary> */
+bool Timeseries::lastTimestamp(tsdb::timestamp_t* timestamp) {
+	if(!loadLastRecord()) {
 		return false;
 	}
+	// The timestamp is at offset zero
+	*timestamp = *((timestamp_t*) &my_last_record[0]);
+	return true;
+}
 
-	/* Is the table big enough for an index */
-	hsize_t tbl_nrecords = my_data->size();
-	
-	/* If no, don't create one yet and return TRUE */
-	if(tbl_nrecords <= my_split_index_gt) {
+/** <summary>Makes sure my_last_record holds the last record of the data table. Returns false if it is empty.</summary>
+ * <remarks>The record is read from the table once, and then kept up to date by appendAndIndex(). Anything
+ * else that changes the end of the table, such as truncate(), refresh() or the append buffer of the Table
+ * being written, sets my_last_record_known to false, and the record is read again the next time.</remarks>
+ */
+bool Timeseries::loadLastRecord(void) {
+	if(my_last_record_known) {
 		return true;
 	}
 
-	/* An index is necessary, so create it! Start with creating the table. */
-	tracer << "Creating a new index for series: " << my_name << ", because it has " << tbl_nrecords << " records." << endl;
+	void* last_record = my_data->getLastRecord();
+	if(last_record == NULL) {
+		return false;
+	}
+	const char* last_record_c = (const char*) last_record;
+	my_last_record.assign(last_record_c, last_record_c + my_structure->getSizeOf());
+	my_last_record_known = true;
+	free(last_record);
+	return true;
+}
+
+/** <summary>Destructor</summary>
+ * <remarks>Note that Structure linked to this Timeseries is destroyed when this object is 
+ * destroyed. This is the case whether it was passed on construction or generated internally.
+ * Additionally, the append buffer is flushed to disk.</remarks>
+ */
+Timeseries::~Timeseries(void) {
+	// Stop the writer thread, which writes what is left first
+	my_appender.reset();
+}
+
+/** <summary>Returns the Stucture of the Timeseries records</summary> */
+boost::shared_ptr<tsdb::Structure> Timeseries::structure(void) {
+	return my_structure;
+}
+/** <summary>Creates an empty index for the Timeseries, and a zone map if it has numeric fields</summary>
+ * <remarks>The index points are added by indexRecords(), which is called with the records of the data
+ * table in order, starting from the first.</remarks>
+ */
+void Timeseries::createIndex(void) {
+	tracer << "Creating a new index for series: " << my_name << ", because it has " << my_data->size() << " records." << endl;
 
 	vector<Field*> index_fields;
 	vector<size_t> offsets;
@@ -363,191 +641,958 @@ bool Timeseries::createIndexIfNecessary(void) {
 	boost::shared_ptr<tsdb::Structure> indexStructure = 
 		boost::make_shared<tsdb::Structure>(index_fields,offsets,sizeof(index_record_t));
 
+	my_index_ts = boost::make_shared<tsdb::Timeseries>(my_group_id,std::string("_TSDB_index"), std::string("TSDB: Index"),indexStructure,
+		my_data->storageOptions());
+	my_index_cache.clear();
+	my_indexed_nrecords = 0;
+	my_indexed_last_ts_known = false;
 
-	my_index_ts = boost::make_shared<tsdb::Timeseries>(my_group_id,std::string("_TSDB_index"), std::string("TSDB: Index"),indexStructure);
-	
+	if(ZoneMap::hasZoneFields(*my_structure)) {
+		my_zone_map = boost::make_shared<tsdb::ZoneMap>(my_group_id, my_structure, my_data->storageOptions());
+	}
+}
 
-	/* Index the already-existing data */
-	hsize_t i = 0; // an iterator
-	void * tbl_records = NULL;   // pointer to records from the data table
-	index_record_t * indx_records = NULL;  // pointer to records from the index table
-	timestamp_t *ts1p, *ts2p;    // two timestamp pointers used later on
-	//index_record_t indx_record;  // an index record for convience
-
-	/* Start at the index_step records into the data table and move forward,
-	 * index_step records at a time. Need to ensure that index points are 
-	 * on the FIRST record of a given unique timestamp. This makes searching
-	 * using the index much easier in the future. */
-	tracer << "   starting at record #" << my_index_step-1 << endl;
-
-	for(i=my_index_step-1;i<tbl_nrecords;i++) {
-
-		/* Check if record is the first of a timestamp (i.e. that the
-		 * previous record does not have the same timestamp. */
-		my_data->getRecords(i-1,i,&tbl_records); // get this record and previous record
-		ts1p = (timestamp_t*) my_structure->pointerToMember(tbl_records,0,0); // pointer to prev ts
-		ts2p = (timestamp_t*) my_structure->pointerToMember(tbl_records,1,0); // pointer to this ts
-
-		if(*ts1p != *ts2p) { // are the timestamps different?
-			/* record i is a valid index point, so add it */
-			indx_records = (index_record_t*) malloc(sizeof(index_record_t));
-			indx_records->timestamp = *ts2p;
-			indx_records->record_id = i;
-			//indx_record.timestamp = *ts2p;
-			//indx_record.record_id = i;
-			//this->index_ts->getStructure()->setMember(indx_records,0,0,&indx_record.timestamp);
-			//this->index_ts->getStructure()->setMember(indx_records,0,1,&indx_record.record_id);
-			my_index_ts->appendRecords(1,indx_records, true);
-			free(indx_records);
-			tracer << "      index point added at record #" << i << endl;
+/** 
+ * <summary>
+ * Indexes records that were just appended to the data table.
+ * </summary>
+ * <remarks>
+ * <p>The index points are chosen from the timestamps of <c>records</c>, which are records <c>first_id</c>
+ * onward of the data table, so the data table is not read again. An index point is the first record of a
+ * new timestamp at least index_step records after the last index point. This keeps index points on the
+ * first record of a timestamp, which makes searching with the index much easier. The new points are
+ * appended to the index with one write, and the records are added to the zone map, and their timestamps
+ * to the segment index if there is one.</p>
+ * <p>When the records are not right after the records indexed so far, as when the index is created for a
+ * table that already has records, the records in between are read from the data table first. The index
+ * is created once the table has more than split_index_gt records.</p>
+ * </remarks>
+ * <param name="first_id">Record id of the first of <c>records</c></param>
+ * <param name="nrecords">Number of records</param>
+ * <param name="records">The records, laid out as in the Structure of the Timeseries</param>
+ */
+void Timeseries::indexRecords(hsize_t first_id, size_t nrecords, const char* records) {
+	updateSegmentIndex(first_id, nrecords, records);
 
-			i = i + my_index_step-1;
-			tracer << "       - advance to record #" << i << endl;
-			
+	if(my_index_ts.get() == 0) {
+		if(my_data->size() <= my_split_index_gt) {
+			return;
 		}
+		createIndex();
+	}
 
+	if(my_indexed_nrecords < first_id) {
+		indexTableRange(my_indexed_nrecords, first_id - 1);
 	}
 
-	// return true since we made an index.
-	return true;
+	/* Actually add the new index points to the index */
+	size_t npoints = my_index_cache.size();
+	addIndexPoints(first_id, nrecords, records);
+	if(my_index_cache.size() > npoints) {
+		my_index_ts->appendRecords(my_index_cache.size() - npoints, &my_index_cache[npoints], true);
+		tracer << "   added " << my_index_cache.size() - npoints << " index points to series: " << my_name << endl;
+	}
+
+	updateZoneMap(first_id, nrecords, records);
 }
+
+/** <summary>Chooses the index points among records, and adds them to the in-memory copy of the index</summary>
+ * <remarks>See indexRecords(). The points are not written to the index table. Records before
+ * <c>first_id</c> must have been indexed already.</remarks>
+ * <param name="first_id">Record id of the first of <c>records</c></param>
+ * <param name="nrecords">Number of records</param>
+ * <param name="records">The records, laid out as in the Structure of the Timeseries</param>
+ */
+void Timeseries::addIndexPoints(hsize_t first_id, size_t nrecords, const char* records) {
+	size_t record_size = my_structure->getSizeOf();
+
+	/* The timestamp of the record before the first one to index, to tell if a record starts a new timestamp */
+	timestamp_t prevts = 0;
+	if(my_indexed_nrecords > 0 && my_indexed_nrecords == first_id && my_indexed_last_ts_known) {
+		prevts = my_indexed_last_ts;
+	} else if(my_indexed_nrecords > 0) {
+		my_data->getTimestamps(my_indexed_nrecords - 1, my_indexed_nrecords - 1, &prevts);
+	}
+
+	hsize_t next_point = (my_index_cache.size() > 0) ? my_index_cache.back().record_id + my_index_step : my_index_step;
+	index_record_t indx_record;
+
+	for(size_t i = 0; i < nrecords; i++) {
+		hsize_t id = first_id + i;
+		if(id < my_indexed_nrecords) {
+			continue; // already indexed
+		}
+
+		timestamp_t thists = *((timestamp_t*) (records + i * record_size));
+		if(id >= next_point && id > 0 && thists != prevts) {
+			indx_record.timestamp = thists;
+			indx_record.record_id = id;
+			my_index_cache.push_back(indx_record);
+			next_point = id + my_index_step;
+		}
+		prevts = thists;
+	}
+
+	if(first_id + nrecords > my_indexed_nrecords) {
+		my_indexed_nrecords = first_id + nrecords;
+		my_indexed_last_ts = prevts;
+		my_indexed_last_ts_known = true;
+	}
+}
+
+/** <summary>Indexes records <c>first</c> to <c>last</c> of the data table, reading them a block at a time</summary> */
+void Timeseries::indexTableRange(hsize_t first, hsize_t last) {
+	hsize_t block_nrecords = (my_index_step > 0) ? my_index_step : INDEX_STEP;
+
+	for(hsize_t blk_start = first; blk_start <= last; blk_start += block_nrecords) {
+		hsize_t blk_last = (last - blk_start < block_nrecords) ? last : blk_start + block_nrecords - 1;
+		void* tbl_records = NULL;
+
+		my_data->getRecords(blk_start, blk_last, &tbl_records);
+		indexRecords(blk_start, (size_t) (blk_last - blk_start + 1), (const char*) tbl_records);
+		free(tbl_records);
+	}
+}
+
 /** 
  * <summary>
  * Indexes the "tail" of the data table.
  * </summary>
  * <remarks>
- * If records were appended to the table, this function should be run.
- * This function gets the last index point on the table, and scans the rows in the data table after that
- * point, looking for places to insert additional index points.
+ * If records were appended to the table by some other means than appendRecords(), for instance through
+ * the append buffer, this function should be run. It reads the records after the last indexed record from
+ * the data table, and indexes them with indexRecords().
  * </remarks>
  */
 void Timeseries::indexTail(void) {
-	
-	/* Check if an index is even necessary. Create index returns true is the table is too small
-	 * for an index or if there was no index and one was created. If <c>createIndexIfNecessary()</c>
-	 * creates an index, then obviously this function does not have to do it. */
-	if(createIndexIfNecessary()) {
+	hsize_t tbl_nrecords = my_data->size();
+
+	// The last record may have changed
+	my_last_record_known = false;
+
+	if(my_defer_index) {
+		return;
+	}
+
+	// The segment index only reads the timestamps it does not have yet
+	updateSegmentIndex(tbl_nrecords, 0, NULL);
+
+	if(my_index_ts.get() == 0 && tbl_nrecords <= my_split_index_gt) {
+		return;
+	}
+
+	if(my_indexed_nrecords < tbl_nrecords) {
+		tracer << "indexing the tail of series: " << my_name << endl;
+		indexTableRange(my_indexed_nrecords, tbl_nrecords - 1);
+	}
+}
+
+/** <summary>Adds records to the zone map, closing a block at each index point</summary>
+ * <remarks>Block <c>k</c> ends right before index point <c>k</c>, so the zone map has as many blocks as
+ * there are index points. Records before <c>first_id</c> that the zone map does not have yet, as after
+ * the Timeseries was reopened, are read from the data table first.</remarks>
+ * <param name="first_id">Record id of the first of <c>records</c></param>
+ * <param name="nrecords">Number of records</param>
+ * <param name="records">The records, laid out as in the Structure of the Timeseries</param>
+ */
+void Timeseries::updateZoneMap(hsize_t first_id, size_t nrecords, const char* records) {
+	if(my_zone_map.get() == 0) {
 		return;
 	}
 
+	size_t record_size = my_structure->getSizeOf();
+	hsize_t next = my_zone_map->nextRecordId();
+	hsize_t stop = first_id + nrecords;
+
+	if(next < first_id) {
+		void* tbl_records = NULL;
+		my_data->getRecords(next, first_id - 1, &tbl_records);
+		updateZoneMap(next, (size_t) (first_id - next), (const char*) tbl_records);
+		free(tbl_records);
+		next = first_id;
+	}
+
+	for(;;) {
+		size_t k = my_zone_map->size();
+		if(k < my_index_cache.size() && my_index_cache[k].record_id <= next) {
+			my_zone_map->closeBlock();
+			continue;
+		}
+		if(next >= stop) {
+			break;
+		}
+
+		hsize_t end = stop;
+		if(k < my_index_cache.size() && my_index_cache[k].record_id < stop) {
+			end = my_index_cache[k].record_id;
+		}
+		my_zone_map->addRecords(records + (next - first_id) * record_size, (size_t) (end - next));
+		next = end;
+	}
+}
+
+/** <summary>Adds the timestamps of records to the segment index, if there is one</summary>
+ * <remarks>The timestamps of the records before <c>first_id</c> that the segment index does not have yet,
+ * as after the Timeseries was reopened, are read from the data table first, without the other fields.
+ * Records it already has are skipped.</remarks>
+ * <param name="first_id">Record id of the first of <c>records</c></param>
+ * <param name="nrecords">Number of records</param>
+ * <param name="records">The records, laid out as in the Structure of the Timeseries</param>
+ */
+void Timeseries::updateSegmentIndex(hsize_t first_id, size_t nrecords, const char* records) {
+	if(my_segment_index.get() == 0) {
+		return;
+	}
+
+	hsize_t next = my_segment_index->nextRecordId();
+	hsize_t block_nrecords = (my_index_step > 0) ? my_index_step : INDEX_STEP;
+	vector<timestamp_t> timestamps;
+	while(next < first_id) {
+		size_t n = (size_t) std::min(block_nrecords, first_id - next);
+		timestamps.resize(n);
+		my_data->getTimestamps(next, next + n - 1, &timestamps[0]);
+		my_segment_index->addTimestamps((const char*) &timestamps[0], n, sizeof(timestamp_t));
+		next += n;
+	}
+
+	if(next < first_id + nrecords) {
+		size_t skip = (size_t) (next - first_id);
+		size_t record_size = my_structure->getSizeOf();
+		my_segment_index->addTimestamps(records + skip * record_size, nrecords - skip, record_size);
+	}
+}
+
+/** <summary>Reads the data table through a read only memory mapping of the file, if it can be</summary>
+ * <remarks>See Table::mapRecords() for when it can. The series must be opened from a file opened read only,
+ * and created with StorageOptions::NONE compression. Returns true if the data table is mapped.</remarks>
+ */
+bool Timeseries::mapRecords(void) {
+	waitForAppends();
+	return my_data->mapRecords();
+}
+
+/** <summary>Gets the Timeseries ready to be appended to while the file is open for SWMR writing</summary>
+ * <remarks><p>Nothing new can be created in the file once Swmr::startWrite() has been called, so this
+ * creates the index and the zone map now, if they don't exist yet, even for a small series, and does the
+ * same for the series of its rollups. From now on, every batch of appended records is flushed, so that
+ * readers see it after their next refresh().</p>
+ * <p>Call it for every series that will be appended to, before Swmr::startWrite().</p></remarks>
+ */
+void Timeseries::prepareSwmrWrite(void) {
+	commitAppendBuffer();
+
+	if(my_index_ts.get() == 0) {
+		createIndex();
+		indexTail();
+	}
+	rollupTail();
+	for(size_t i = 0; i < my_rollups.size(); i++) {
+		my_rollups[i]->series()->prepareSwmrWrite();
+	}
+	my_swmr_write = true;
+	flushDatasets();
+}
+
+/** <summary>Writes the data table, the index, the zone map and the rollups out to the file, for SWMR readers</summary>
+ * <remarks>The data table goes first, then the index, the zone map and the rollups, so that a reader never
+ * sees an index point, a block or a row for records it can not see yet.</remarks>
+ */
+void Timeseries::flushDatasets(void) {
+	HDF5Lock lock;
+
+	my_data->flush();
+	if(my_index_ts.get() != 0) {
+		my_index_ts->flushDatasets();
+	}
+	if(my_zone_map.get() != 0) {
+		my_zone_map->flush();
+	}
+	if(my_segment_index.get() != 0) {
+		my_segment_index->flush();
+	}
+	for(size_t i = 0; i < my_rollups.size(); i++) {
+		my_rollups[i]->series()->flushDatasets();
+	}
+}
+
+/** <summary>Picks up the records another writer has appended since the Timeseries was opened</summary>
+ * <remarks><p>Re-reads the number of records, the new index points and the new zone map blocks, without
+ * reopening anything. In a file opened with Swmr::openForRead(), this sees each batch the writer has
+ * flushed.</p>
+ * <p>The zone map and the indexes are refreshed before the data table, the reverse of the order
+ * the writer flushes them in, so that every index point refers to a record that is there.</p></remarks>
+ */
+void Timeseries::refresh(void) {
+	waitForAppends();
+	HDF5Lock lock;
+
+	if(my_zone_map.get() != 0) {
+		my_zone_map->refresh();
+	} else if(ZoneMap::exists(my_group_id)) {
+		my_zone_map = boost::make_shared<tsdb::ZoneMap>(my_group_id, my_structure);
+	}
 
-	tracer << "indexing the tail of series: " << my_name << endl;
+	if(my_segment_index.get() != 0) {
+		my_segment_index->refresh();
+	} else if(SegmentIndex::exists(my_group_id)) {
+		my_segment_index = boost::make_shared<tsdb::SegmentIndex>(my_group_id);
+	}
 
-	hsize_t blk_start;                     // the start of a block of records from the data table
-	vector<index_record_t> indx_records_v; // a vector of index records to add to the index
-	index_record_t indx_record;            // an index record to use for convience.
-	void * tbl_records = NULL;             // pointer to records from the data table
-	timestamp_t prevts = 0;                // two timestamp values to use below
-	timestamp_t thists = 0;
-	size_t blk_nrecords = 0;               // the number of records the block
-	size_t i;							   // a loop counter
-	index_record_t * indx_records = NULL;  // pointer to records to add to the index table
+	if(my_index_ts.get() != 0) {
+		my_index_ts->refresh();
+	} else if(Timeseries::exists(my_group_id, "_TSDB_index")) {
+		my_index_ts = boost::make_shared<tsdb::Timeseries>(my_group_id, "_TSDB_index");
+	}
 
-	/* Get the last record of the index */
-	index_record_t* indx_last_r = (index_record_t*) my_index_ts->dataTable()->getLastRecord();
-	//index_record_t indx_last_r;
-	//indx_last_r.timestamp = *((timestamp_t*) this->record_struct->pointerToMember(indx_last_r_ptr,0));
-	//indx_last_r.record_id = *((hsize_t*) this->record_struct->pointerToMember(indx_last_r_ptr,1));
+	// Only the index points after the ones in memory are read
+	if(my_index_ts.get() != 0) {
+		hsize_t indx_nrecords = my_index_ts->getNRecords();
+		if(indx_nrecords > my_index_cache.size()) {
+			index_record_t* indx_records =
+				(index_record_t*) my_index_ts->getRecordsById(my_index_cache.size(), indx_nrecords - 1);
+			my_index_cache.insert(my_index_cache.end(), indx_records,
+				indx_records + (indx_nrecords - my_index_cache.size()));
+			free(indx_records);
+		}
+	}
+
+	my_data->refresh();
+	my_last_record_known = false;
+
+	// Rollups go after the data table, so that their rows are not behind the records aggregate() reads
+	for(size_t i = 0; i < my_rollups.size(); i++) {
+		my_rollups[i]->series()->refresh();
+	}
+	openRollups();
+	my_rolled_nrecords = my_data->size();
+
+	// As when the Timeseries is opened, the records of an existing index have all been indexed
+	if(my_index_ts.get() != 0) {
+		my_indexed_nrecords = my_data->size();
+		my_indexed_last_ts_known = false;
+	}
+}
+
+/** <summary>Returns what the Timeseries has done since it was opened, or since resetStats()</summary>
+ * <remarks>Lookups that the index answers or narrows read fewer timestamps: compare <c>index_hits</c> and
+ * <c>index_narrowed</c> with <c>lookups</c>, and <c>bisection_steps</c> and <c>records_scanned</c> per
+ * lookup, when tuning INDEX_STEP and SEARCH_WINDOW. The lookups of the index itself are not included.</remarks>
+ */
+tsdb::TimeseriesStats Timeseries::stats(void) {
+	tsdb::TimeseriesStats stats;
+	stats.lookups = my_counters.lookups.value();
+	stats.index_hits = my_counters.index_hits.value();
+	stats.index_narrowed = my_counters.index_narrowed.value();
+	stats.bisection_steps = my_counters.bisection_steps.value();
+	stats.window_scans = my_counters.window_scans.value();
+	stats.records_scanned = my_counters.records_scanned.value();
+	stats.lookup_us = my_counters.lookup_us.value();
+	stats.append_batches = my_counters.append_batches.value();
+	stats.largest_batch = my_counters.largest_batch.value();
+	stats.sorted_batches = my_counters.sorted_batches.value();
+	stats.records_discarded = my_counters.records_discarded.value();
+	stats.single_appends = my_counters.single_appends.value();
+	stats.merges = my_counters.merges.value();
+	stats.records_merged = my_counters.records_merged.value();
+	stats.records_appended = my_counters.records_appended.value();
+	stats.append_us = my_counters.append_us.value();
+	stats.scans = my_counters.scans.value();
+	stats.scan_blocks_skipped = my_counters.scan_blocks_skipped.value();
+	stats.scan_records_read = my_counters.scan_records_read.value();
+	stats.scan_records_matched = my_counters.scan_records_matched.value();
+	stats.segment_lookups = my_counters.segment_lookups.value();
+	stats.asof_lookups = my_counters.asof_lookups.value();
+	stats.asof_windows = my_counters.asof_windows.value();
+	stats.last_record_hits = my_counters.last_record_hits.value();
+	stats.rollup_aggregates = my_counters.rollup_aggregates.value();
+	stats.rollup_rows_read = my_counters.rollup_rows_read.value();
+	stats.data = my_data->stats();
+	return stats;
+}
+
+/** <summary>Sets the counters of the Timeseries and its data table back to zero</summary> */
+void Timeseries::resetStats(void) {
+	my_counters.lookups.reset();
+	my_counters.index_hits.reset();
+	my_counters.index_narrowed.reset();
+	my_counters.bisection_steps.reset();
+	my_counters.window_scans.reset();
+	my_counters.records_scanned.reset();
+	my_counters.lookup_us.reset();
+	my_counters.append_batches.reset();
+	my_counters.largest_batch.reset();
+	my_counters.sorted_batches.reset();
+	my_counters.records_discarded.reset();
+	my_counters.single_appends.reset();
+	my_counters.merges.reset();
+	my_counters.records_merged.reset();
+	my_counters.records_appended.reset();
+	my_counters.append_us.reset();
+	my_counters.scans.reset();
+	my_counters.scan_blocks_skipped.reset();
+	my_counters.scan_records_read.reset();
+	my_counters.scan_records_matched.reset();
+	my_counters.segment_lookups.reset();
+	my_counters.asof_lookups.reset();
+	my_counters.asof_windows.reset();
+	my_counters.last_record_hits.reset();
+	my_counters.rollup_aggregates.reset();
+	my_counters.rollup_rows_read.reset();
+	my_data->resetStats();
+}
+
+/** <summary>Creates the zone map of a Timeseries that has an index, but no zone map</summary>
+ * <remarks>Timeseries written before zone maps existed only have an index. This reads the whole data table
+ * once. It does nothing if there already is a zone map, if there is no index yet, or if the records have
+ * no numeric fields.</remarks>
+ */
+void Timeseries::buildZoneMap(void) {
+	waitForAppends();
+	if(my_zone_map.get() != 0 || my_index_ts.get() == 0 || !ZoneMap::hasZoneFields(*my_structure)) {
+		return;
+	}
+
+	my_zone_map = boost::make_shared<tsdb::ZoneMap>(my_group_id, my_structure, my_data->storageOptions());
 
-	/* Start the block to be indexed <c>index_step</c> records ahead of the
-	 * last record to be indexed */
-	blk_start = indx_last_r->record_id + my_index_step;
 	hsize_t tbl_nrecords = my_data->size();
-	
-	/* Index one block at a time, until the the end of the table is reached */
-	while(blk_start<tbl_nrecords) {
-		
-		// read the first record of the block and the prev record to see
-		// if the first record starts a new timestamp.
-		my_data->getRecords(blk_start - 1, blk_start, &tbl_records);
-		prevts = *((timestamp_t*) my_structure->pointerToMember(tbl_records,0,0));
-		thists = *((timestamp_t*) my_structure->pointerToMember(tbl_records,1,0));
+	hsize_t block_nrecords = (my_index_step > 0) ? my_index_step : INDEX_STEP;
+	for(hsize_t blk_start = 0; blk_start < tbl_nrecords; blk_start += block_nrecords) {
+		hsize_t blk_last = (tbl_nrecords - 1 - blk_start < block_nrecords) ? tbl_nrecords - 1 : blk_start + block_nrecords - 1;
+		void* tbl_records = NULL;
+
+		my_data->getRecords(blk_start, blk_last, &tbl_records);
+		updateZoneMap(blk_start, (size_t) (blk_last - blk_start + 1), (const char*) tbl_records);
 		free(tbl_records);
-		tracer << "   start processing block at record #" << blk_start << endl;
+	}
+}
 
-		// the block starts with a new timestamp?
-		if(prevts < thists) {
+/** <summary>Adds a SegmentIndex to the Timeseries, so that lookups search only around its predictions</summary>
+ * <remarks>The timestamps of the data table are read once, to fit the segments to the records there
+ * already; after that, the segments are kept up to date as records are appended. It does nothing if
+ * the series has a segment index already. In a file that will be written with SWMR, call it before
+ * Swmr::startWrite(), as nothing can be created after.</remarks>
+ * <param name="max_error">How far, in records, a prediction may be from the record it predicts</param>
+ */
+void Timeseries::useSegmentIndex(size_t max_error) {
+	commitAppendBuffer();
+	if(my_segment_index.get() != 0) {
+		return;
+	}
 
-			// if yes, record this as an index point.
-			indx_record.timestamp = thists;
-			indx_record.record_id = blk_start;
-			indx_records_v.push_back(indx_record);
-			tracer << "      index point added at record #" << blk_start << endl;
-
-			// advance the block by one index_step
-			blk_start = blk_start + my_index_step;
-			tracer << "       - advance to record #" << blk_start << endl;
-		
-		} else { 
-			
-			tracer << "      record #" << blk_start << " repeats timestamp. searching for new timstamp" << endl;
-
-			// if no, get up to index_step-1 records from the table. If not index_step-1 avail, get as many as possible
-			if(tbl_nrecords - blk_start < ( (hsize_t) my_index_step ) - 1) {
-				// there are less then index_step-1 records avail., so get up to the end of the table.
-				my_data->getRecords(blk_start, tbl_nrecords-1, &tbl_records);
-				blk_nrecords =  ( (size_t) (tbl_nrecords - blk_start) );
-			} else {
-				// there are at least index_step records left, so get index_step records
-				my_data->getRecords(blk_start, blk_start + my_index_step-1 - 1, &tbl_records);
-				blk_nrecords = my_index_step-1;
+	my_segment_index = boost::make_shared<tsdb::SegmentIndex>(my_group_id, max_error, my_data->storageOptions());
+	updateSegmentIndex(my_data->size(), 0, NULL);
+}
+
+/** <summary>Stops appends from updating the indexes, or starts them again</summary>
+ * <remarks><p>While indexing is deferred, appended records are only written to the data table: the index,
+ * the zone map and the segment index are left as they are, and lookups past them search the data table
+ * from their last point. Turning it off indexes the records appended meanwhile, reading them back as
+ * indexTail() does. After a large bulk load, rebuildIndex() does it faster, on several threads.</p>
+ * <p>Deferring is not saved in the file: another process that opens the series indexes the records
+ * that were not indexed when it next appends.</p></remarks>
+ */
+void Timeseries::setDeferIndex(bool defer) {
+	commitAppendBuffer();
+
+	bool was_deferred = my_defer_index;
+	my_defer_index = defer;
+	if(was_deferred && !defer) {
+		indexTail();
+	}
+}
+
+/** <summary>Adds a Rollup of the Timeseries, with buckets of <c>bucket_size</c> milliseconds</summary>
+ * <remarks><p>The rollup is built from the records the series has, read by a ParallelScan with
+ * <c>nthreads</c> workers (0 for one per processor), and from then on every append brings it up to date,
+ * in any process that opens the series. aggregate() reads it when it can. Only FIRST, LAST, MIN, MAX, SUM
+ * and COUNT can be rolled up, as in</p>
+ * \code
+ * std::vector<AggregateSpec> bars;
+ * bars.push_back(AggregateSpec(AggregateSpec::FIRST, "price", "", "open"));
+ * bars.push_back(AggregateSpec(AggregateSpec::MAX, "price", "", "high"));
+ * bars.push_back(AggregateSpec(AggregateSpec::MIN, "price", "", "low"));
+ * bars.push_back(AggregateSpec(AggregateSpec::LAST, "price", "", "close"));
+ * bars.push_back(AggregateSpec(AggregateSpec::SUM, "amount", "", "volume"));
+ * ts.addRollup(60000, bars);
+ * \endcode
+ * <p>In a file that will be written with SWMR, call it before Swmr::startWrite(), as nothing can be
+ * created after. Throws a TimeseriesException if the series has a rollup with that bucket size already,
+ * and a RollupException or an AggregateException if the specs can not be rolled up.</p></remarks>
+ * <param name="bucket_size">Length of a bucket, in milliseconds</param>
+ * <param name="specs">The aggregated columns</param>
+ * <param name="nthreads">Number of threads reading the data table, 0 for one per processor</param>
+ */
+void Timeseries::addRollup(tsdb::timestamp_t bucket_size, const std::vector<tsdb::AggregateSpec>& specs, size_t nthreads) {
+	commitAppendBuffer();
+
+	for(size_t i = 0; i < my_rollups.size(); i++) {
+		if(my_rollups[i]->bucketSize() == bucket_size) {
+			throw( TimeseriesException("The timeseries already has a rollup with that bucket size.") );
+		}
+	}
+	if(bucket_size <= 0) {
+		throw( TimeseriesException("The bucket size of a rollup must be positive.") );
+	}
+
+	boost::shared_ptr<tsdb::Rollup> rollup =
+		boost::make_shared<tsdb::Rollup>(my_group_id, my_structure, bucket_size, specs, my_data->storageOptions());
+
+	hsize_t tbl_nrecords = my_data->size();
+	if(tbl_nrecords > 0) {
+		ParallelScan scan(my_group_id, "_TSDB_data", 0, tbl_nrecords, (my_index_step > 0) ? my_index_step : INDEX_STEP);
+		scan.setThreads(nthreads);
+		scan.run(boost::bind(&Rollup::addRecords, rollup.get(), _3, _2));
+	}
+	my_rollups.push_back(rollup);
+}
+
+/** <summary>Adds a Rollup of the Timeseries, with buckets of <c>bucket_size</c></summary>
+ * <param name="bucket_size">Length of a bucket</param>
+ * <param name="specs">The aggregated columns</param>
+ */
+void Timeseries::addRollup(boost::posix_time::time_duration bucket_size, const std::vector<tsdb::AggregateSpec>& specs) {
+	addRollup((tsdb::timestamp_t) bucket_size.total_milliseconds(), specs);
+}
+
+/** <summary>Removes the Rollup with buckets of <c>bucket_size</c> milliseconds from the file</summary>
+ * <remarks>As with dropIndex(), HDF5 does not give back the space it took. Throws a TimeseriesException if
+ * there is no such rollup.</remarks>
+ */
+void Timeseries::dropRollup(tsdb::timestamp_t bucket_size) {
+	commitAppendBuffer();
+	HDF5Lock lock;
+
+	for(size_t i = 0; i < my_rollups.size(); i++) {
+		if(my_rollups[i]->bucketSize() == bucket_size) {
+			my_rollups.erase(my_rollups.begin() + i);
+			break;
+		}
+	}
+
+	std::string name = Rollup::name(bucket_size);
+	if(H5Lexists(my_group_id, name.c_str(), H5P_DEFAULT) <= 0) {
+		throw( TimeseriesException("The timeseries has no rollup with that bucket size.") );
+	}
+	if(H5Ldelete(my_group_id, name.c_str(), H5P_DEFAULT) < 0) {
+		throw( TimeseriesException("Could not remove '" + name + "' of timeseries '" + my_name + "'.") );
+	}
+	ChunkCache::global().clear();
+}
+
+/** <summary>Returns the bucket sizes of the rollups of the Timeseries, in milliseconds</summary> */
+std::vector<tsdb::timestamp_t> Timeseries::rollups(void) {
+	std::vector<tsdb::timestamp_t> sizes;
+	for(size_t i = 0; i < my_rollups.size(); i++) {
+		sizes.push_back(my_rollups[i]->bucketSize());
+	}
+	return sizes;
+}
+
+/* Opens the rollups in the group that are not open yet */
+void Timeseries::openRollups(void) {
+	std::vector<std::string> names = Rollup::names(my_group_id);
+	for(size_t i = 0; i < names.size(); i++) {
+		bool open = false;
+		for(size_t j = 0; j < my_rollups.size(); j++) {
+			open = open || Rollup::name(my_rollups[j]->bucketSize()) == names[i];
+		}
+		if(!open) {
+			my_rollups.push_back(boost::make_shared<tsdb::Rollup>(my_group_id, names[i], my_structure));
+		}
+	}
+}
+
+/** <summary>Adds the records of the data table after the ones the rollups have been given to them</summary>
+ * <remarks>As indexTail() does for the index, for records written through the append buffer of the data
+ * table. The rollups that do not know their open bucket are resumed first, so that they get every record
+ * of the tail.</remarks>
+ */
+void Timeseries::rollupTail(void) {
+	hsize_t tbl_nrecords = my_data->size();
+	hsize_t block_nrecords = (my_index_step > 0) ? my_index_step : INDEX_STEP;
+
+	resumeRollups();
+
+	while(!my_rollups.empty() && my_rolled_nrecords < tbl_nrecords) {
+		hsize_t last = (tbl_nrecords - my_rolled_nrecords > block_nrecords) ?
+			my_rolled_nrecords + block_nrecords - 1 : tbl_nrecords - 1;
+		void* records = NULL;
+		my_data->getRecords(my_rolled_nrecords, last, &records);
+		try {
+			for(size_t i = 0; i < my_rollups.size(); i++) {
+				my_rollups[i]->addRecords((const char*) records, (size_t) (last - my_rolled_nrecords + 1));
+			}
+		} catch(...) {
+			free(records);
+			throw;
+		}
+		free(records);
+		my_rolled_nrecords = last + 1;
+	}
+	my_rolled_nrecords = tbl_nrecords;
+}
+
+/** <summary>Gets the rollups that do not know their open bucket ready for records to be added</summary>
+ * <remarks>Each of them is resumed with the records in the bucket of the last record it has been given,
+ * the record before my_rolled_nrecords, so this reads at most one bucket of the coarsest rollup, once after
+ * the series is opened or truncated. Records after that one are added by rollupTail().</remarks>
+ */
+void Timeseries::resumeRollups(void) {
+	hsize_t rolled_nrecords = my_rolled_nrecords;
+
+	for(size_t i = 0; i < my_rollups.size(); i++) {
+		if(my_rollups[i]->resumed()) {
+			continue;
+		}
+		if(rolled_nrecords == 0) {
+			my_rollups[i]->resume(0, NULL, 0);
+			continue;
+		}
+
+		tsdb::timestamp_t last_ts;
+		my_data->getTimestamps(rolled_nrecords - 1, rolled_nrecords - 1, &last_ts);
+		tsdb::timestamp_t bucket = my_rollups[i]->bucketOf(last_ts);
+		hsize_t first;
+		if(recordId_GE(bucket, &first) < 0) {
+			first = rolled_nrecords - 1;
+		}
+
+		void* records = NULL;
+		my_data->getRecords(first, rolled_nrecords - 1, &records);
+		try {
+			my_rollups[i]->resume(bucket, (const char*) records, (size_t) (rolled_nrecords - first));
+		} catch(...) {
+			free(records);
+			throw;
+		}
+		free(records);
+	}
+}
+
+/** <summary>Builds the index, the zone map and the segment index of the Timeseries again, from scratch</summary>
+ * <remarks><p>Their points, blocks and segments are removed, and the data table is read once, a block of
+ * index_step records at a time, by a ParallelScan with <c>nthreads</c> workers (0 for one per processor).
+ * The blocks are indexed in order as they arrive, and the index points are written with one append at the
+ * end. The index is created if the series has more than split_index_gt records and no index, and so is
+ * the zone map if it has an index and numeric fields but no zone map. A segment index is rebuilt if there
+ * was one.</p>
+ * <p>Use it after a bulk load with setDeferIndex(), or to repair an index that verifyIndex() found
+ * wrong. The datasets of the index are reused; a series whose index can not even be opened can have
+ * it removed first with dropIndex().</p></remarks>
+ * <param name="nthreads">Number of threads reading the data table, 0 for one per processor</param>
+ */
+void Timeseries::rebuildIndex(size_t nthreads) {
+	// The records still buffered are indexed with the rest below
+	bool deferred = my_defer_index;
+	my_defer_index = true;
+	commitAppendBuffer();
+	my_defer_index = deferred;
+	clearIndexes();
+
+	hsize_t tbl_nrecords = my_data->size();
+	if(my_index_ts.get() == 0 && tbl_nrecords > my_split_index_gt) {
+		createIndex();
+	}
+	if(my_index_ts.get() != 0 && my_zone_map.get() == 0 && ZoneMap::hasZoneFields(*my_structure)) {
+		my_zone_map = boost::make_shared<tsdb::ZoneMap>(my_group_id, my_structure, my_data->storageOptions());
+	}
+
+	tracer << "Rebuilding the index of series: " << my_name << " from " << tbl_nrecords << " records." << endl;
+	if(tbl_nrecords > 0) {
+		ParallelScan scan(my_group_id, "_TSDB_data", 0, tbl_nrecords, (my_index_step > 0) ? my_index_step : INDEX_STEP);
+		scan.setThreads(nthreads);
+		scan.run(boost::bind(&Timeseries::rebuildBlock, this, _1, _2, _3));
+	}
+
+	if(my_index_cache.size() > 0) {
+		my_index_ts->appendRecords(my_index_cache.size(), &my_index_cache[0], true);
+	}
+
+	if(my_swmr_write) {
+		flushDatasets();
+	}
+}
+
+/** <summary>Indexes the next block of records read by rebuildIndex()</summary>
+ * <remarks>As indexRecords(), but the index points are only added to the in-memory copy of the index.</remarks>
+ */
+void Timeseries::rebuildBlock(hsize_t first_id, size_t nrecords, const char* records) {
+	updateSegmentIndex(first_id, nrecords, records);
+	if(my_index_ts.get() != 0) {
+		addIndexPoints(first_id, nrecords, records);
+		updateZoneMap(first_id, nrecords, records);
+	}
+}
+
+/** <summary>Removes every index point, zone map block and segment, keeping the datasets</summary>
+ * <remarks>They are truncated, rather than removed, so that their chunks also leave the ChunkCache.</remarks>
+ */
+void Timeseries::clearIndexes(void) {
+	if(my_index_ts.get() != 0) {
+		my_index_ts->truncate(0);
+	}
+	my_index_cache.clear();
+	if(my_zone_map.get() != 0) {
+		my_zone_map->truncate(0);
+	}
+	if(my_segment_index.get() != 0) {
+		my_segment_index->truncate(0);
+	}
+	my_indexed_nrecords = 0;
+	my_indexed_last_ts_known = false;
+}
+
+namespace {
+
+/* Works out the index points, zone map blocks and segment keys of a Timeseries from its records, as
+   indexRecords() would, and counts the ones that differ from what the Timeseries has. The records are
+   added in order, a block at a time. */
+class IndexVerifier
+{
+public:
+	IndexVerifier(tsdb::Structure& structure, size_t index_step, bool expect_index, bool expect_zones,
+		const vector<index_record_t>& points, const tsdb::ZoneMap* zone_map, const tsdb::SegmentIndex* segments):
+		my_structure(structure), my_index_step(index_step), my_expect_index(expect_index),
+		my_expect_zones(expect_zones), my_points(points), my_zone_map(zone_map), my_segments(segments),
+		my_next_point(index_step), my_prevts(0), my_open_first_id(0), my_open_nrecords(0), my_open_first_ts(0),
+		my_open_last_ts(0) {
+		my_open_stats.resize(structure.getNFields());
+	}
+
+	void add(hsize_t first_id, size_t nrecords, const char* records) {
+		size_t record_size = my_structure.getSizeOf();
+		size_t run_start = 0;
+
+		for(size_t i = 0; i < nrecords; i++) {
+			hsize_t id = first_id + i;
+			timestamp_t thists = *((timestamp_t*) (records + i * record_size));
+
+			if(my_expect_index && id >= my_next_point && id > 0 && thists != my_prevts) {
+				addRun(records, run_start, i - run_start);
+				run_start = i;
+				closeBlock();
+				checkPoint(thists, id);
+				my_next_point = id + my_index_step;
 			}
-			tracer << "       - the search block has " << blk_nrecords << " records" << endl;
-
-			// scan these records sequentially, finding the first one with a different timestamp.
-			i = 0;
-			while(prevts == thists && i < blk_nrecords) {
-				// increment thists to the timestamp of record i
-				thists = *((timestamp_t*) my_structure->pointerToMember(tbl_records,i,0));
-				i++;
+
+			// The first record of each timestamp is where a lookup of it should land
+			if(my_segments != 0 && (id == 0 || thists != my_prevts)) {
+				hsize_t seg_first, seg_last;
+				if(my_segments->bounds(thists, &seg_first, &seg_last)) {
+					my_check.segment_keys++;
+					if(id < seg_first || id > seg_last) {
+						my_check.bad_segment_keys++;
+					}
+				}
 			}
+			my_prevts = thists;
+		}
+		addRun(records, run_start, nrecords - run_start);
+		my_check.nrecords += nrecords;
+	}
 
-			// done with those records, so free memory
-			free(tbl_records);
-
-			// did the loop exit because of a vaild index point?
-			if(prevts < thists) {
-				i--; // decrement i so that it refers to the array index number of the record to index
-
-				// record an index point at that record
-				indx_record.timestamp = thists;
-				indx_record.record_id = blk_start+i;
-				indx_records_v.push_back(indx_record);
-				tracer << "      index point added at record #" << blk_start+i << endl;
-				
-				// the next block starts index_step records after that point
-				blk_start = indx_record.record_id + my_index_step;
-				tracer << "       - advance to record #" << blk_start << endl;
-			} else {
-				// no vaild index point was found, so move the start of the block up by
-				// index_step
-				tracer << "   end of block. no valid index points, advancing to record #" << blk_start + my_index_step << endl;
-				blk_start = blk_start + my_index_step;
-				
+	tsdb::IndexCheck finish(void) {
+		if(my_points.size() > my_check.index_points) {
+			my_check.bad_index_points += my_points.size() - my_check.index_points;
+		}
+		if(my_zone_map != 0 && my_zone_map->size() > my_check.zone_blocks) {
+			my_check.bad_zone_blocks += my_zone_map->size() - my_check.zone_blocks;
+		}
+		return my_check;
+	}
+
+private:
+	void checkPoint(timestamp_t timestamp, hsize_t record_id) {
+		size_t k = (size_t) my_check.index_points++;
+		if(k >= my_points.size() || my_points[k].timestamp != timestamp || my_points[k].record_id != record_id) {
+			my_check.bad_index_points++;
+		}
+	}
+
+	/* Adds records first to first + nrecords - 1 of a block to the open zone map block */
+	void addRun(const char* records, size_t first, size_t nrecords) {
+		if(!my_expect_zones || nrecords == 0) {
+			return;
+		}
+
+		size_t record_size = my_structure.getSizeOf();
+		const char* run = records + first * record_size;
+		if(my_open_nrecords == 0) {
+			my_open_first_ts = *((timestamp_t*) run);
+		}
+		my_open_last_ts = *((timestamp_t*) (run + (nrecords - 1) * record_size));
+		my_open_nrecords += nrecords;
+
+		if(my_zone_map == 0) {
+			return;
+		}
+		for(size_t f = 1; f < my_open_stats.size(); f++) {
+			if(my_zone_map->hasField(f)) {
+				my_open_stats[f].merge(ZoneStats::fromColumn(tsdb::StridedColumn(run, nrecords, my_structure, f)));
 			}
 		}
+	}
+
+	/* Compares the open block, which ends at an index point, with the zone map, and starts the next */
+	void closeBlock(void) {
+		if(!my_expect_zones) {
+			return;
+		}
+
+		size_t k = (size_t) my_check.zone_blocks++;
+		bool good = my_zone_map != 0 && k < my_zone_map->size() && my_zone_map->firstRecordId(k) == my_open_first_id &&
+			my_zone_map->nrecords(k) == my_open_nrecords && my_zone_map->firstTimestamp(k) == my_open_first_ts &&
+			my_zone_map->lastTimestamp(k) == my_open_last_ts;
+		for(size_t f = 1; good && f < my_open_stats.size(); f++) {
+			if(my_zone_map->hasField(f)) {
+				good = sameStats(my_zone_map->stats(k, f), my_open_stats[f]);
+			}
+		}
+		if(!good) {
+			my_check.bad_zone_blocks++;
+		}
+
+		my_open_first_id += my_open_nrecords;
+		my_open_nrecords = 0;
+		my_open_stats.assign(my_open_stats.size(), tsdb::ZoneStats());
+	}
+
+	/* Sums may have been added up in another order, so they only need to be close */
+	static bool sameStats(const tsdb::ZoneStats& a, const tsdb::ZoneStats& b) {
+		return a.count == b.count && a.nans == b.nans && sameValue(a.min, b.min) && sameValue(a.max, b.max) &&
+			fabs(a.sum - b.sum) <= 1e-9 * std::max(1.0, fabs(a.sum) + fabs(b.sum));
+	}
+
+	static bool sameValue(tsdb::ieee64_t a, tsdb::ieee64_t b) {
+		return a == b || (a != a && b != b);
+	}
+
+	tsdb::Structure& my_structure;
+	size_t my_index_step;
+	bool my_expect_index;
+	bool my_expect_zones;
+	const vector<index_record_t>& my_points;
+	const tsdb::ZoneMap* my_zone_map;
+	const tsdb::SegmentIndex* my_segments;
+	tsdb::IndexCheck my_check;
+
+	hsize_t my_next_point;
+	timestamp_t my_prevts;
+	hsize_t my_open_first_id;
+	hsize_t my_open_nrecords;
+	timestamp_t my_open_first_ts;
+	timestamp_t my_open_last_ts;
+	vector<tsdb::ZoneStats> my_open_stats;  // by field of the data, for the fields the zone map has
+};
+
+} // namespace
+
+/** <summary>Checks the index, the zone map and the segment index of the Timeseries against its records</summary>
+ * <remarks><p>The data table is read once, on <c>nthreads</c> threads as in rebuildIndex(), and the index
+ * points and zone map blocks are worked out again, with the current index_step. Each one that is missing,
+ * different, or should not be there is counted as bad, and so is each timestamp whose first record is not
+ * where the segment index predicts. An index is expected if the series has one, or has more than
+ * split_index_gt records, and a zone map along with it if the series has numeric fields.</p>
+ * <p>What is checked is what the Timeseries loaded when it was opened, so open the series again to check
+ * the file. An index that was deferred with setDeferIndex() is reported as bad, as it is behind.</p></remarks>
+ * <param name="nthreads">Number of threads reading the data table, 0 for one per processor</param>
+ */
+tsdb::IndexCheck Timeseries::verifyIndex(size_t nthreads) {
+	waitForAppends();
+
+	hsize_t tbl_nrecords = my_data->size();
+	bool expect_index = my_index_ts.get() != 0 || tbl_nrecords > my_split_index_gt;
+	bool expect_zones = expect_index && ZoneMap::hasZoneFields(*my_structure);
+	IndexVerifier verifier(*my_structure, my_index_step, expect_index, expect_zones, my_index_cache,
+		my_zone_map.get(), my_segment_index.get());
+
+	if(tbl_nrecords > 0) {
+		ParallelScan scan(my_group_id, "_TSDB_data", 0, tbl_nrecords, (my_index_step > 0) ? my_index_step : INDEX_STEP);
+		scan.setThreads(nthreads);
+		scan.run(boost::bind(&IndexVerifier::add, &verifier, _1, _2, _3));
+	}
+	return verifier.finish();
+}
+
+/** <summary>Loads the index points of the Timeseries into memory</summary>
+ * <remarks>The whole index table is read once, when the Timeseries is opened. Afterwards, the
+ * in-memory copy is kept in sync by <c>indexRecords()</c>, which is the only place index points
+ * are added.</remarks>
+ */
+void Timeseries::loadIndexCache(void) {
+	my_index_cache.clear();
+
+	if(my_index_ts.get() == 0) {
+		return;
+	}
 
+	hsize_t indx_nrecords = my_index_ts->getNRecords();
+	if(indx_nrecords == 0) {
+		return;
 	}
 
-	/* Actually add the index points to the index */
-	if(indx_records_v.size() > 0) {
-		// allocate some memory to store these records
-		indx_records = (index_record_t*) malloc(sizeof(index_record_t) * indx_records_v.size());
-		// TODO: Can this be replaced with a memcpy, or can we use the internal vector memory directly?
-		for(i=0;i<indx_records_v.size();i++) {
-			indx_records[i].timestamp = indx_records_v.at(i).timestamp;
-			indx_records[i].record_id = indx_records_v.at(i).record_id;
-			//this->index_ts->getStructure()->setMember(indx_records,i,0,&indx_record.timestamp);
-			//this->index_ts->getStructure()->setMember(indx_records,i,1,&indx_record.record_id);
+	index_record_t* indx_records = (index_record_t*) my_index_ts->getRecordsById(0, indx_nrecords - 1);
+	my_index_cache.assign(indx_records, indx_records + indx_nrecords);
+	free(indx_records);
+}
+
+/* Comparison function used to binary search the in-memory index by timestamp */
+static bool ts_index_record_less(timestamp_t timestamp, const index_record_t& r) {
+	return timestamp < r.timestamp;
+}
+
+/** <summary>Narrows the range of the data table that may contain <c>timestamp</c></summary>
+ * <remarks>Uses the in-memory copy of the index to find the index points on either side of
+ * <c>timestamp</c>. When <c>timestamp</c> is an index point itself, the method returns <c>true</c>
+ * and <c>tbl_first_id</c> is the record id of the first record with that timestamp. Otherwise, the
+ * method returns <c>false</c> and the record being searched for is in [tbl_first_id, tbl_last_id].</remarks>
+ * <param name="timestamp">Timestamp to search for</param>
+ * <param name="tbl_first_id">The first record of the range to search</param>
+ * <param name="tbl_last_id">The last record of the range to search</param>
+ */
+bool Timeseries::indexRange(timestamp_t timestamp, hsize_t* tbl_first_id, hsize_t* tbl_last_id) {
+	*tbl_first_id = 0;
+	*tbl_last_id = my_data->size() - 1;
+
+	if(my_index_cache.size() == 0) {
+		return false;
+	}
+
+	// First index point with a timestamp strictly greater than the one we are looking for.
+	vector<index_record_t>::const_iterator indx_GT = 
+		upper_bound(my_index_cache.begin(), my_index_cache.end(), timestamp, ts_index_record_less);
+
+	if(indx_GT != my_index_cache.begin()) {
+		vector<index_record_t>::const_iterator indx_LE = indx_GT - 1;
+		// Index points are always on the first record of a timestamp, so an exact match is the answer
+		*tbl_first_id = indx_LE->record_id;
+		if(indx_LE->timestamp == timestamp) {
+			my_counters.index_hits.add();
+			return true;
 		}
+	}
 
-		// actually add the records
-		
-		my_index_ts->appendRecords(indx_records_v.size(),indx_records,true);
-		
-		free(indx_records);
+	if(indx_GT != my_index_cache.end()) {
+		*tbl_last_id = indx_GT->record_id;
 	}
 
+	my_counters.index_narrowed.add();
+	return false;
+}
+
+/** <summary>Finds the first record with a timestamp GE <c>timestamp</c> around where the segment index
+ * predicts it</summary>
+ * <remarks>Returns false if there is no segment index, or if it does not cover <c>timestamp</c> yet. Otherwise
+ * <c>record_id</c> is set to the record, or to the number of records if there is none.</remarks>
+ */
+bool Timeseries::segmentLowerBound(timestamp_t timestamp, hsize_t* record_id) {
+	hsize_t first, last;
+	if(my_segment_index.get() == 0 || !my_segment_index->bounds(timestamp, &first, &last)) {
+		return false;
+	}
+
+	*record_id = (last > first) ? lowerBoundById(timestamp, first, last - 1) : first;
+	return true;
 }
 
 
@@ -562,89 +1607,52 @@ void Timeseries::indexTail(void) {
  * <param name="record_id">Pointer to a record_id. The resulting record is stored here</param>
  */
 herr_t Timeseries::recordId_LE(timestamp_t timestamp, hsize_t* record_id){
-	
-	
-	/* Conveience structure for index records */
-	#pragma pack(push, index_record, 4)
-	typedef struct {
-	timestamp_t timestamp;
-	hsize_t record_id; } index_record_t;
-	#pragma pack(pop, index_record )
-
-	hsize_t indx_id_LE, indx_id_GE, tbl_first_id, tbl_last_id;
-	index_record_t *indx_LE, *indx_GE; // NULL if these don't exist
-	void* tbl_records;
-
-
+	waitForAppends();
+	StatTimer timer(my_counters.lookup_us);
+	my_counters.lookups.add();
+	
+	hsize_t tbl_first_id, tbl_last_id, gt_id;
+	timestamp_t matchts;
 
-	if(my_index_ts.get() != 0 ) {
-		if(my_index_ts->recordId_LE(timestamp,&indx_id_LE) == -1) {
-			indx_LE = NULL;
-			tbl_first_id = 0; // Search from the top of the table then.
-		} else {
-			indx_LE = (index_record_t*) my_index_ts->getRecordsById(indx_id_LE, indx_id_LE);
-			// First of all, if the exact timestamp is in the index, great!
-			if(indx_LE->timestamp == timestamp) {
-				*record_id = indx_LE->record_id;
-				free(indx_LE);
-				return 0;
-			}
-			tbl_first_id = indx_LE->record_id;
-		}
+	if(my_data->size() == 0) {
+		return -1;
+	}
 
-		// NOTE: there is no point in checking if the indx_GE is the timestamp we are
-		// searching for. It isn't otherwise it would have been returned in indx_LE
-		// and we would have returned already.
-		if(my_index_ts->recordId_GE(timestamp,&indx_id_GE) == -1) {
-			indx_GE = NULL;
-			tbl_last_id = my_data->size() -1; // Search to the end then.
-		} else {
-			indx_GE = (index_record_t*) my_index_ts->getRecordsById(indx_id_GE, indx_id_GE);
-			tbl_last_id = indx_GE->record_id;
+	// The segment index finds the first record after the match, and then the first record of the match
+	if(timestamp != LLONG_MAX && segmentLowerBound(timestamp + 1, &gt_id)) {
+		if(gt_id == 0) {
+			return -1;
 		}
-		free(indx_LE);
-		free(indx_GE);	
-		
-	} else {
-		// get the whole table into memory and search it.
-		tbl_first_id = 0;
-		tbl_last_id = my_data->size() - 1;
-	}
-
-	// Now, we know the timestamp we are looking for is likely in the range [tbl_first_id, tbl_last_id]
-	// get range of records from table based on those record_ids
-	tbl_records = getRecordsById(tbl_first_id,tbl_last_id);
-
-	// Search backward, find the first record that is LE timestamp
-	signed long long i;
-	timestamp_t thists = 0;
-	timestamp_t matchts = 0;
-	for(i=tbl_last_id - tbl_first_id;i>=0;i--) {
-		thists = *((timestamp_t *) my_structure->pointerToMember(tbl_records,(size_t) i,0));
-		if(thists <= timestamp) {
-			// Search backwards until we find the first record of a new timestamp.
-			matchts = thists;
-			for(i=i;i>=0;i--) {
-				thists = *((timestamp_t *) my_structure->pointerToMember(tbl_records,(size_t) i,0));
-				if(matchts > thists) {
-					// found it.
-					*record_id = tbl_first_id + i + 1;
-					free(tbl_records);
-					return 0;
-				}
-			}
-			
-			// reached the top of the table, so return record_id = 0
-			*record_id = 0;
-			free(tbl_records);
+		my_data->getTimestamps(gt_id - 1, gt_id - 1, &matchts);
+		if(segmentLowerBound(matchts, record_id)) {
+			my_counters.segment_lookups.add();
 			return 0;
 		}
 	}
 
-	free(tbl_records);
+	if(indexRange(timestamp, &tbl_first_id, &tbl_last_id)) {
+		*record_id = tbl_first_id;
+		return 0;
+	}
+
+	// Now, we know the timestamp we are looking for is likely in the range [tbl_first_id, tbl_last_id].
+	// Find the first record that is strictly greater than timestamp; the record before it is the
+	// last record LE timestamp.
+	if(timestamp == LLONG_MAX) {
+		gt_id = tbl_last_id + 1;
+	} else {
+		gt_id = lowerBoundById(timestamp + 1, tbl_first_id, tbl_last_id);
+	}
+
+	if(gt_id == tbl_first_id) {
+		// OK, didn't find it.
+		return -1;
+	}
 
-	// OK, didn't find it.
-	return -1;
+	// Search for the first record of the run of timestamps that the match belongs to.
+	my_data->getTimestamps(gt_id - 1, gt_id - 1, &matchts);
+	*record_id = lowerBoundById(matchts, tbl_first_id, gt_id - 1);
+	return 0;
 }
 
 
@@ -658,87 +1666,87 @@ herr_t Timeseries::recordId_LE(timestamp_t timestamp, hsize_t* record_id){
  * <param name="record_id">Pointer to a record_id. The resulting record is stored here</param>
  */
 herr_t Timeseries::recordId_GE(timestamp_t timestamp, hsize_t* record_id){
+	waitForAppends();
+	StatTimer timer(my_counters.lookup_us);
+	my_counters.lookups.add();
 
-	/* Conveience structure for index records */
-	#pragma pack(push, index_record, 4)
-	typedef struct {
-	timestamp_t timestamp;
-	hsize_t record_id; } index_record_t;
-	#pragma pack(pop, index_record )
-
+	hsize_t tbl_first_id, tbl_last_id, ge_id;
 
-	hsize_t indx_id_LE, indx_id_GE, tbl_first_id, tbl_last_id;
-	index_record_t *indx_LE, *indx_GE; // NULL if these don't exist
-	void* tbl_records;
+	if(my_data->size() == 0) {
+		return -1;
+	}
 
-	if(my_index_ts.get() != 0 ) {
-		if(my_index_ts->recordId_LE(timestamp,&indx_id_LE) == -1) {
-			indx_LE = NULL;
-			tbl_first_id = 0; // Search from the top of the table then.
-		} else {
-			indx_LE = (index_record_t*)my_index_ts->getRecordsById(indx_id_LE, indx_id_LE);
-			// First of all, if the exact timestamp is in the index, great!
-			if(indx_LE->timestamp == timestamp) {
-				*record_id = indx_LE->record_id;
-				free(indx_LE);
-				return 0;
-			}
-			tbl_first_id = indx_LE->record_id;
+	if(segmentLowerBound(timestamp, &ge_id)) {
+		my_counters.segment_lookups.add();
+		if(ge_id >= my_data->size()) {
+			return -1;
 		}
+		*record_id = ge_id;
+		return 0;
+	}
 
-		// NOTE: there is no point in checking if the indx_GE equals the timestamp we are
-		// searching for. It isn't otherwise it would have been returned in indx_LE
-		// and we would have returned already.
-		if(my_index_ts->recordId_GE(timestamp,&indx_id_GE) == -1) {
-			indx_GE = NULL;
-			tbl_last_id = my_data->size() -1; // Search to the end then.
-		} else {
-			indx_GE = (index_record_t*) my_index_ts->getRecordsById(indx_id_GE, indx_id_GE);
-			tbl_last_id = indx_GE->record_id;
-		}
-		free(indx_LE);
-		free(indx_GE);	
-		
-	} else {
-		// get the whole table into memory and search it.
-		tbl_first_id = 0;
-		tbl_last_id = my_data->size() - 1;
+	if(indexRange(timestamp, &tbl_first_id, &tbl_last_id)) {
+		*record_id = tbl_first_id;
+		return 0;
 	}
 
-	// Now, we know the timestamp we are looking for is likely in the range [tbl_first_id, tbl_last_id]
-	// get range of records from table based on those record_ids
-	tbl_records = this->getRecordsById(tbl_first_id,tbl_last_id);
+	// Now, we know the timestamp we are looking for is likely in the range [tbl_first_id, tbl_last_id].
+	// The first record that is GE timestamp will automatically be the first of that timestamp group.
+	ge_id = lowerBoundById(timestamp, tbl_first_id, tbl_last_id);
+	if(ge_id > tbl_last_id) {
+		return -1;
+	}
 
-	// Search forwards, find the first record that is GE timestamp.
-	// This record will automatically be the first of that timestamp
-	// group.
-	size_t i;
-	timestamp_t thists = 0;
-	for(i=0;i<(tbl_last_id - tbl_first_id)+1;i++) {
-		thists = *((timestamp_t*) my_structure->pointerToMember(tbl_records,i,0));
-		if(thists >= timestamp) {
-			*record_id = tbl_first_id + i;
-			free(tbl_records);
-			return 0;
+	*record_id = ge_id;
+	return 0;
+}
+
+/** <summary>Finds the first record in [first, last] with a timestamp GE <c>timestamp</c></summary>
+ * <remarks><p>Bisects over the record ids, reading a single timestamp from the data table per step,
+ * until the range is no more than <c>my_search_window</c> records wide. The timestamps of that window
+ * are then read with one call and scanned in memory. Only the timestamp field is read from the table.</p>
+ * <p>Returns <c>last + 1</c> if every record in the range is less than <c>timestamp</c>.</p></remarks>
+ * <param name="timestamp">Timestamp to search for</param>
+ * <param name="first">The first record of the range to search</param>
+ * <param name="last">The last record of the range to search</param>
+ */
+hsize_t Timeseries::lowerBoundById(timestamp_t timestamp, hsize_t first, hsize_t last) {
+	hsize_t lo = first;    // the answer is always in [lo, hi]
+	hsize_t hi = last + 1;
+	hsize_t mid;
+	timestamp_t midts;
+	unsigned long long steps = 0;
+
+	while(hi - lo > my_search_window) {
+		mid = lo + (hi - lo) / 2;
+		my_data->getTimestamps(mid, mid, &midts);
+		if(midts < timestamp) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
 		}
-			/*
-			// Search forwards until we find the first record of a new timestamp.
-			matchts = thists;
-			for(i=i;i<(tbl_last_id - tbl_first_id)+1;i++) {
-				thists = *((timestamp_t*) this->getStructure()->pointerToMember(tbl_records,i,0));
-				if(matchts < thists) {
-					// found it.
-					*record_id = tbl_first_id + i - 1;
-					free(tbl_records);
-					return 0;
-				}
+		steps++;
+	}
+	my_counters.bisection_steps.add(steps);
+
+	if(hi > lo) {
+		vector<timestamp_t> window((size_t) (hi - lo));
+		my_data->getTimestamps(lo, hi - 1, &window[0]);
+		my_counters.window_scans.add();
+		my_counters.records_scanned.add(window.size());
+		for(size_t i = 0; i < window.size(); i++) {
+			if(window[i] >= timestamp) {
+				return lo + i;
 			}
-			
-		}*/
+		}
 	}
 
-	free(tbl_records);
-	return -1;
+	return hi;
+}
+
+void Timeseries::setSearchWindow(size_t _search_window) {
+	waitForAppends();
+	my_search_window = _search_window;
 }
 /** <summary>Returns the record closest to the given <c>timestamp</c> on the greater-than side</summary>
  * <remarks>This function returns the record that is closest to the given <c>timestamp</c> that is
@@ -772,6 +1780,7 @@ herr_t Timeseries::recordId_LE(boost::posix_time::ptime timestamp, hsize_t *reco
  * <param name="last">Last record_id</param>
  */
 void* Timeseries::getRecordsById(hsize_t first, hsize_t last) {
+	waitForAppends();
 	void* records;
 	my_data->getRecords(first,last,&records);
 	return records;
@@ -801,6 +1810,7 @@ void Timeseries::getRecordsByTimestamp(boost::posix_time::ptime start, boost::po
  * <param name="records">Pointer to a pointer, where the address of the records is saved</param>
  */
 void Timeseries::getRecordsByTimestamp(tsdb::timestamp_t start, tsdb::timestamp_t end, hsize_t* nrecords, void** records) {
+	waitForAppends();
 	hsize_t start_id = 0;
 	hsize_t end_id = 0;
 	herr_t status;
@@ -844,6 +1854,7 @@ void Timeseries::getRecordsByTimestamp(tsdb::timestamp_t start, tsdb::timestamp_
  * <param name="last">Last record_id</param>
  */
 tsdb::RecordSet Timeseries::recordSet(hsize_t first, hsize_t last) {
+	waitForAppends();
 	return my_data->recordSet(first,last);
 }
 
@@ -860,39 +1871,81 @@ tsdb::RecordSet Timeseries::recordSet(boost::posix_time::ptime start, boost::pos
  * <param name="end">Ending timestamp</param>
  */
 tsdb::RecordSet Timeseries::recordSet(tsdb::timestamp_t start, tsdb::timestamp_t end) {
+	waitForAppends();
 	hsize_t start_id = 0;
 	hsize_t end_id = 0;
-	herr_t status;
 
+	if(!recordIdRange(start, end, &start_id, &end_id)) { // no records found
+		return tsdb::RecordSet(); // TODO: link in the structure. There should be a constructor for RecordSet that
+		// makes an empty one that is still linked to the structure.
+	}
+
+	return this->recordSet(start_id,end_id);
+}
+
+/** <summary>Gets a RecordSet with some of the fields of records <c>first</c> to <c>last</c></summary>
+ * <remarks>Only the fields named in <c>field_names</c> are read. See Table::recordSet().</remarks>
+ * <param name="first">First record id</param>
+ * <param name="last">Last record id</param>
+ * <param name="field_names">Names of the fields to read</param>
+ */
+tsdb::RecordSet Timeseries::recordSet(hsize_t first, hsize_t last, const std::vector<std::string>& field_names) {
+	waitForAppends();
+	return my_data->recordSet(first, last, field_names);
+}
+
+/** <summary>Gets a RecordSet with some of the fields of the records from start to end, inclusive</summary>
+ * <remarks>Only the fields named in <c>field_names</c> are read, and the RecordSet has a Structure with
+ * just those fields, in that order. Include "_TSDB_timestamp" in <c>field_names</c> to get the timestamps.
+ * When there are no records in the range, the RecordSet is empty but still has that Structure.</remarks>
+ * <param name="start">Starting timestamp</param>
+ * <param name="end">Ending timestamp</param>
+ * <param name="field_names">Names of the fields to read</param>
+ */
+tsdb::RecordSet Timeseries::recordSet(tsdb::timestamp_t start, tsdb::timestamp_t end, const std::vector<std::string>& field_names) {
+	waitForAppends();
+	hsize_t start_id = 0;
+	hsize_t end_id = 0;
+
+	if(!recordIdRange(start, end, &start_id, &end_id)) {
+		boost::shared_ptr<tsdb::Structure> projection = my_structure->project(field_names);
+		return tsdb::RecordSet(0, projection);
+	}
+
+	return my_data->recordSet(start_id, end_id, field_names);
+}
+
+/** <summary>Finds the record ids of the first and last records between two timestamps, inclusive</summary>
+ * <remarks>Returns <c>false</c> if there are no records between the timestamps. Throws a TimeseriesException
+ * if <c>start</c> is greater than <c>end</c>, or if the range is entirely before or after the records of 
+ * the Timeseries.</remarks>
+ */
+bool Timeseries::recordIdRange(tsdb::timestamp_t start, tsdb::timestamp_t end, hsize_t* start_id, hsize_t* end_id) {
+	herr_t status;
 
 	if(start > end) {
 		throw(TimeseriesException("Start timestamp cannot be greater than end timestamp."));
 	}
 
 	
-	status = this->recordId_GE(start, &start_id);
+	status = this->recordId_GE(start, start_id);
 	if(status == -1) {
 		throw(TimeseriesException("The start timestamp is greater then the last record in the timeseries."));
 	}
 
-	status = this->recordId_LE(end, &end_id);
+	status = this->recordId_LE(end, end_id);
 	if(status == -1) {
 		throw(TimeseriesException("The end timestamp was less than the first record in the timeseries."));
 	}
 
-	status = this->recordId_GE(end+1, &end_id);
+	status = this->recordId_GE(end+1, end_id);
 	if(status == -1) {
-		end_id = this->getNRecords() - 1;
+		*end_id = this->getNRecords() - 1;
 	} else {
-		end_id = end_id -1;
-	}
-
-	if(end_id < start_id) { // no records found
-		return tsdb::RecordSet(); // TODO: link in the structure. There should be a constructor for RecordSet that
-		// makes an empty one that is still linked to the structure.
+		*end_id = *end_id -1;
 	}
 
-	return this->recordSet(start_id,end_id);
+	return *end_id >= *start_id;
 }
 
 
@@ -911,6 +1964,7 @@ hsize_t Timeseries::getNRecordsByTimestamp(boost::posix_time::ptime start, boost
  * <param name="end">Ending timestamp</param>
  */
 hsize_t Timeseries::getNRecordsByTimestamp(tsdb::timestamp_t start, tsdb::timestamp_t end) {
+	waitForAppends();
 	hsize_t start_id = 0;
 	hsize_t end_id = 0;
 	herr_t status;
@@ -949,19 +2003,189 @@ hsize_t Timeseries::getNRecordsByTimestamp(tsdb::timestamp_t start, tsdb::timest
 
 /** <summary>Gets the last record of the timeseries</summary>
  * <remarks>Returns a pointer to the last record of the timeseries. You need to <c>free()</c> this
- * memory.</remarks>
+ * memory. Returns NULL if the timeseries is empty.</remarks>
  */
 void* Timeseries::getLastRecord() {
-	return my_data->getLastRecord();
+	waitForAppends();
+	if(my_last_record_known) {
+		my_counters.last_record_hits.add();
+	}
+	if(!loadLastRecord()) {
+		return NULL;
+	}
+
+	void* record = malloc(my_last_record.size());
+	if(record == NULL) {
+		throw( TimeseriesException("not enough memory") );
+	}
+	memcpy(record, &my_last_record[0], my_last_record.size());
+	return record;
+}
+
+/** <summary>Copies the last record of the timeseries to <c>record</c></summary>
+ * <remarks>Returns false, and copies nothing, if the timeseries is empty. The last record is kept in
+ * memory, so after it has been read once, this neither reads the file nor allocates memory.</remarks>
+ * <param name="record">Pointer to memory for a record</param>
+ */
+bool Timeseries::getLastRecord(void* record) {
+	waitForAppends();
+	if(my_last_record_known) {
+		my_counters.last_record_hits.add();
+	}
+	if(!loadLastRecord()) {
+		return false;
+	}
+	memcpy(record, &my_last_record[0], my_last_record.size());
+	return true;
+}
+
+/** <summary>Looks up the last record at or before each of a sorted array of timestamps</summary>
+ * <remarks><p>Each timestamp gets the record recordId_LE() would return for it: the first record of the
+ * run of records with the latest timestamp at or before it. Timestamps before the first record of the
+ * series have none. Their record id is set to the number of records, and their record is zeroed. Since
+ * the timestamps are sorted, those are the first ones; the number of timestamps that do have a record is
+ * returned.</p>
+ * <p>The timestamps are answered in one pass, in order. For a timestamp that needs a lookup, a window of
+ * the search window size of timestamps is read around the record found, and the timestamps after it that
+ * fall in the window are answered from it, without reading. Timestamps at or after the last record are
+ * answered from the last record, which is kept in memory. If <c>records</c> is not NULL, the records are
+ * then read, with one read for records found that are less than a window apart.</p>
+ * <p>Throws a TimeseriesException if the timestamps are not sorted.</p></remarks>
+ * <param name="timestamps">The timestamps, in ascending order</param>
+ * <param name="ntimestamps">The number of timestamps</param>
+ * <param name="record_ids">Where to write the record id of each timestamp</param>
+ * <param name="records">Where to write the record of each timestamp, or NULL for only the record ids</param>
+ */
+size_t Timeseries::lookupAsOf(const tsdb::timestamp_t* timestamps, size_t ntimestamps, hsize_t* record_ids,
+	void* records) {
+	waitForAppends();
+
+	for(size_t i = 1; i < ntimestamps; i++) {
+		if(timestamps[i] < timestamps[i - 1]) {
+			throw( TimeseriesException("lookupAsOf() needs the timestamps in ascending order.") );
+		}
+	}
+	my_counters.asof_lookups.add(ntimestamps);
+
+	hsize_t tbl_nrecords = my_data->size();
+	timestamp_t last_ts = 0;
+	bool have_records = lastTimestamp(&last_ts);
+	hsize_t last_run_id = tbl_nrecords;   // the first record with the last timestamp, once it is needed
+
+	// A window of timestamps, of records [window_first, window_first + window.size()). It has to
+	// hold a few records before the one found, for the start of its run, and the one after it.
+	size_t window_size = std::max(my_search_window, (size_t) 16);
+	size_t window_back = window_size / 8;
+	vector<timestamp_t> window;
+	hsize_t window_first = 0;
+	size_t nfound = 0;
+
+	for(size_t i = 0; i < ntimestamps; i++) {
+		timestamp_t timestamp = timestamps[i];
+		record_ids[i] = tbl_nrecords;
+		if(!have_records) {
+			continue;
+		}
+
+		if(timestamp >= last_ts) {
+			if(last_run_id == tbl_nrecords) {
+				recordId_GE(last_ts, &last_run_id);
+			}
+			record_ids[i] = last_run_id;
+			nfound++;
+			continue;
+		}
+
+		// The window answers timestamps from its first timestamp up to, but not including, its last one
+		if(window.empty() || timestamp < window.front() || timestamp >= window.back()) {
+			// There is a record after timestamp, since it is before the last one
+			hsize_t gt_id;
+			recordId_GE(timestamp + 1, &gt_id);
+			if(gt_id == 0) {
+				continue;
+			}
+			window_first = (gt_id - 1 > window_back) ? gt_id - 1 - window_back : 0;
+			hsize_t window_last = std::min(window_first + window_size - 1, tbl_nrecords - 1);
+			window.resize((size_t) (window_last - window_first + 1));
+			my_data->getTimestamps(window_first, window_last, &window[0]);
+			my_counters.asof_windows.add();
+		}
+
+		size_t gt = upper_bound(window.begin(), window.end(), timestamp) - window.begin();
+		if(gt == 0) {
+			continue;
+		}
+		size_t run = lower_bound(window.begin(), window.begin() + gt, window[gt - 1]) - window.begin();
+		if(run == 0 && window_first > 0) {
+			// The run may start before the window
+			recordId_GE(window[0], &record_ids[i]);
+		} else {
+			record_ids[i] = window_first + run;
+		}
+		nfound++;
+	}
+
+	if(records == NULL) {
+		return nfound;
+	}
+
+	size_t record_size = my_structure->getSizeOf();
+	char* records_c = (char*) records;
+	size_t i = ntimestamps - nfound;
+	memset(records_c, 0, i * record_size);
+
+	// The record ids are in ascending order, so the ones close together are read together
+	while(i < ntimestamps) {
+		hsize_t first = record_ids[i];
+		size_t j = i + 1;
+		while(j < ntimestamps && record_ids[j] - first < window_size) {
+			j++;
+		}
+		hsize_t last = record_ids[j - 1];
+
+		if(first == tbl_nrecords - 1) {
+			for(; i < j; i++) {
+				memcpy(records_c + i * record_size, &my_last_record[0], record_size);
+			}
+			my_counters.last_record_hits.add();
+			continue;
+		}
+
+		void* span = NULL;
+		my_data->getRecords(first, last, &span);
+		const char* span_c = (const char*) span;
+		for(; i < j; i++) {
+			memcpy(records_c + i * record_size, span_c + (record_ids[i] - first) * record_size, record_size);
+		}
+		free(span);
+	}
+
+	return nfound;
 }
 
 /** <summary>Returns the number of records</summary> */
 hsize_t Timeseries::getNRecords() {
+	waitForAppends();
 	return my_data->size();
 }
 
 void Timeseries::appendRecord(tsdb::Record &record) {
-		
+	my_counters.single_appends.add();
+
+	if(my_appender.get() != 0) {
+		// The timestamp is at offset zero
+		tsdb::timestamp_t record_ts = *((timestamp_t*) record.memoryBlockPtr().raw());
+		if(record.structure() != my_structure) {
+			throw std::runtime_error("attempted to append record with different structure");
+		}
+		if(record_ts < my_buffer_last_ts) {
+			throw std::runtime_error("attempted to append a misordered timestamp");
+		}
+		my_buffer_last_ts = record_ts;
+		my_appender->append(record.memoryBlockPtr().raw());
+		return;
+	}
+
 	tsdb::timestamp_t record_ts  = record[0].toTimestamp();
 
 	if(record_ts >= my_buffer_last_ts) {
@@ -972,6 +2196,10 @@ void Timeseries::appendRecord(tsdb::Record &record) {
 
 			// Buffer must have been flushed, so reindex the tail
 			indexTail();
+			rollupTail();
+			if(my_swmr_write) {
+				flushDatasets();
+			}
 		}
 	} else {
 		throw std::runtime_error("attempted to append a misordered timestamp");
@@ -984,14 +2212,88 @@ void Timeseries::appendRecordSet(const tsdb::RecordSet &recset, bool discard_ove
 }
 
 const boost::shared_ptr<tsdb::Table>& Timeseries::dataTable() {
+	waitForAppends();
 	return my_data;
 }
 
-/** <summary>Flushes the append buffer to disk</summary> */
+/** <summary>Returns the zone map, which is empty if the Timeseries has none</summary> */
+const boost::shared_ptr<tsdb::ZoneMap>& Timeseries::zoneMap() {
+	waitForAppends();
+	return my_zone_map;
+}
+
+/** <summary>Writes the records in the append buffer, and flushes the file to disk</summary>
+ * <remarks>When it returns, every record appended with appendRecord() is in the data table and the index,
+ * and HDF5 has written its buffers to the file. With setAsyncAppend(), this waits for the writer
+ * thread. Throws a TimeseriesException if the writer failed, or if the file can not be flushed.</remarks>
+ */
 void Timeseries::flushAppendBuffer() {
+	commitAppendBuffer();
+
+	HDF5Lock lock;
+	if(H5Fflush(my_group_id, H5F_SCOPE_LOCAL) < 0) {
+		throw( TimeseriesException("Error in H5Fflush.") );
+	}
+}
+
+/** <summary>Writes the records in the append buffer to the data table and the index</summary> */
+void Timeseries::commitAppendBuffer(void) {
+	if(my_appender.get() != 0) {
+		my_appender->commit();
+		resetBufferLastTimestamp();
+		return;
+	}
+
 	my_data->flushAppendBuffer();
 	my_buffer_last_ts = LLONG_MIN;
 	indexTail();
+	rollupTail();
+	if(my_swmr_write) {
+		flushDatasets();
+	}
+}
+
+/** <summary>Waits until the AppendWriter, if there is one, has written the buffers handed to it</summary>
+ * <remarks>Every public method that uses the data table or the index calls this first, so that the writer
+ * thread is done with them. The records in the buffer that is being filled are not written.</remarks>
+ */
+void Timeseries::waitForAppends(void) {
+	if(my_appender.get() != 0) {
+		my_appender->wait();
+	}
+}
+
+/** <summary>Writes the records of appendRecord() on a writer thread, in buffers of <c>buffer_bytes</c></summary>
+ * <remarks><p>appendRecord() then only copies the record into a buffer. A full buffer goes to an
+ * AppendWriter, which appends and indexes it on its own thread, and joins buffers that are waiting into
+ * one write. The other methods of the Timeseries wait for the buffers that have gone to the writer, and
+ * flushAppendBuffer() waits for it to write everything. Records appended with appendRecord() must be in
+ * order, and at or after the last timestamp of the series.</p>
+ * <p>0 writes what is left, stops the writer, and goes back to writing full buffers on the thread that
+ * calls appendRecord().</p></remarks>
+ * <param name="buffer_bytes">Size of the buffers in bytes. A buffer holds at least one record.</param>
+ */
+void Timeseries::setAsyncAppend(size_t buffer_bytes) {
+	commitAppendBuffer();
+	my_appender.reset();
+
+	if(buffer_bytes > 0) {
+		my_appender = boost::make_shared<tsdb::AppendWriter>(this, buffer_bytes);
+		resetBufferLastTimestamp();
+	}
+}
+
+/** <summary>With an AppendWriter, sets the timestamp appendRecord() checks the order against to the last
+ * timestamp of the data table</summary>
+ * <remarks>With an AppendWriter, my_buffer_last_ts is the last timestamp the series will have once the
+ * buffers are written. It has to be set again whenever the end of the data table changes other than by
+ * appendRecord(), as when the buffers have all been written, or the series is truncated or merged into.
+ * </remarks>
+ */
+void Timeseries::resetBufferLastTimestamp(void) {
+	if(my_appender.get() != 0 && !lastTimestamp(&my_buffer_last_ts)) {
+		my_buffer_last_ts = LLONG_MIN;
+	}
 }
 
 /** <summary>Returns a BufferedRecordSet (inclusive)</summary>
@@ -999,6 +2301,7 @@ void Timeseries::flushAppendBuffer() {
  * <param name="last">Last record ID to include</param>
  */
 tsdb::BufferedRecordSet Timeseries::bufferedRecordSet(hsize_t first, hsize_t last) {
+	waitForAppends();
 	return my_data->bufferedRecordSet(first,last);
 }
 
@@ -1007,6 +2310,7 @@ tsdb::BufferedRecordSet Timeseries::bufferedRecordSet(hsize_t first, hsize_t las
  * <param name="last">Last timestamp to include</param>
  */
 tsdb::BufferedRecordSet Timeseries::bufferedRecordSet(tsdb::timestamp_t start, tsdb::timestamp_t end) {
+	waitForAppends();
 	hsize_t start_id = 0;
 	hsize_t end_id = 0;
 	herr_t status;
@@ -1050,6 +2354,347 @@ tsdb::BufferedRecordSet Timeseries::bufferedRecordSet(boost::posix_time::ptime s
 	return this->bufferedRecordSet(tsdb::ptime_to_timestamp(start), tsdb::ptime_to_timestamp(end));
 }
 
+/** <summary>Returns a RecordCursor over a range of records (inclusive)</summary>
+ * <param name="first">First record ID to include</param>
+ * <param name="last">Last record ID to include</param>
+ * <param name="forward">True to go forward from <c>first</c>, false to go backward from <c>last</c></param>
+ */
+tsdb::RecordCursor Timeseries::cursor(hsize_t first, hsize_t last, bool forward) {
+	waitForAppends();
+	return tsdb::RecordCursor(this->bufferedRecordSet(first, last), forward);
+}
+
+/** <summary>Returns a RecordCursor over the records between two timestamps (inclusive)</summary>
+ * <param name="start">First timestamp to include</param>
+ * <param name="end">Last timestamp to include</param>
+ * <param name="forward">True to go forward from <c>start</c>, false to go backward from <c>end</c></param>
+ */
+tsdb::RecordCursor Timeseries::cursor(tsdb::timestamp_t start, tsdb::timestamp_t end, bool forward) {
+	waitForAppends();
+	return tsdb::RecordCursor(this->bufferedRecordSet(start, end), forward);
+}
+
+/** <summary>Returns a RecordCursor over the records between two timestamps (inclusive)</summary>
+ * <param name="start">First timestamp to include</param>
+ * <param name="end">Last timestamp to include</param>
+ * <param name="forward">True to go forward from <c>start</c>, false to go backward from <c>end</c></param>
+ */
+tsdb::RecordCursor Timeseries::cursor(boost::posix_time::ptime start, boost::posix_time::ptime end, bool forward) {
+	return this->cursor(tsdb::ptime_to_timestamp(start), tsdb::ptime_to_timestamp(end), forward);
+}
+
+/** <summary>Reduces the records between two timestamps (inclusive) to one row per time bucket</summary>
+ * <remarks><p>The records are streamed through a RecordCursor into an Aggregator, so only one buffer of
+ * records is in memory at a time, however long the range is. The result has the start of each bucket
+ * as its timestamp, followed by one column per spec; see Aggregator for the details.</p>
+ * <p>If a Rollup covers the aggregation, because <c>bucket_size</c> is a multiple of its bucket size and
+ * it has every spec, the coarsest one that does is read instead, and only the records at the ends of the
+ * range that do not fill a bucket of it are; see Rollup::covers(). The result is the same.</p>
+ * <p>Throws an AggregateException if the specs do not fit the fields of the Timeseries.</p></remarks>
+ * <param name="start">First timestamp to include</param>
+ * <param name="end">Last timestamp to include</param>
+ * <param name="bucket_size">Length of a bucket, in milliseconds</param>
+ * <param name="specs">The aggregated columns</param>
+ */
+tsdb::RecordSet Timeseries::aggregate(tsdb::timestamp_t start, tsdb::timestamp_t end, tsdb::timestamp_t bucket_size,
+	const std::vector<tsdb::AggregateSpec>& specs) {
+	waitForAppends();
+	tsdb::Aggregator aggregator(my_structure, specs, bucket_size);
+
+	if(!aggregateRollup(aggregator, start, end, bucket_size, specs)) {
+		aggregateRecords(aggregator, start, end);
+	}
+	return aggregator.result();
+}
+
+/** <summary>Adds the records between two timestamps (inclusive) to an Aggregator</summary> */
+void Timeseries::aggregateRecords(tsdb::Aggregator& aggregator, tsdb::timestamp_t start, tsdb::timestamp_t end) {
+	size_t record_size = my_structure->getSizeOf();
+
+	// Hand the aggregator whole buffers, so that it can work on columns
+	tsdb::BufferedRecordSet records = this->bufferedRecordSet(start, end);
+	for(hsize_t i = 0; i < records.size(); ) {
+		hsize_t buf_first;
+		size_t nbufrecords;
+		const char* buffer = records.buffer(i, &buf_first, &nbufrecords);
+		size_t skip = (size_t) (i - buf_first);
+		aggregator.addRecords(buffer + skip * record_size, nbufrecords - skip);
+		i = buf_first + nbufrecords;
+	}
+}
+
+/** <summary>Adds the records between two timestamps (inclusive) to an Aggregator, from a Rollup where it can</summary>
+ * <remarks>The rows of the whole buckets of the rollup in the range are added, and the records before the
+ * first of them and after the last are read from the data table. Returns false, having added nothing, if
+ * no rollup covers the aggregation, or if the range does not have a whole bucket of the one that does.</remarks>
+ */
+bool Timeseries::aggregateRollup(tsdb::Aggregator& aggregator, tsdb::timestamp_t start, tsdb::timestamp_t end,
+	tsdb::timestamp_t bucket_size, const std::vector<tsdb::AggregateSpec>& specs) {
+	boost::shared_ptr<tsdb::Rollup> rollup;
+	std::vector<size_t> columns, rollup_columns;
+	for(size_t i = 0; i < my_rollups.size(); i++) {
+		if(my_rollups[i]->covers(bucket_size, specs, &columns) &&
+			(rollup.get() == 0 || my_rollups[i]->bucketSize() > rollup->bucketSize())) {
+			rollup = my_rollups[i];
+			rollup_columns = columns;
+		}
+	}
+
+	// Keeping to the timestamps the series has also keeps the bucket arithmetic in range
+	tsdb::timestamp_t first_ts, last_ts;
+	if(rollup.get() == 0 || !lastTimestamp(&last_ts)) {
+		return false;
+	}
+	my_data->getTimestamps(0, 0, &first_ts);
+	start = std::max(start, first_ts);
+	end = std::min(end, last_ts);
+	if(start > end) {
+		return false;
+	}
+
+	tsdb::timestamp_t rollup_size = rollup->bucketSize();
+	tsdb::timestamp_t first_bucket = rollup->bucketOf(start);
+	if(first_bucket < start) {
+		first_bucket += rollup_size;
+	}
+	tsdb::timestamp_t last_bucket = rollup->bucketOf(end);
+	if(end - last_bucket != rollup_size - 1) {
+		last_bucket -= rollup_size;
+	}
+	if(first_bucket > last_bucket) {
+		return false;
+	}
+
+	my_counters.rollup_aggregates.add();
+	if(start < first_bucket) {
+		aggregateRecords(aggregator, start, first_bucket - 1);
+	}
+
+	boost::shared_ptr<tsdb::Structure> row_structure = rollup->series()->structure();
+	size_t row_size = row_structure->getSizeOf();
+	tsdb::BufferedRecordSet rows = rollup->series()->bufferedRecordSet(first_bucket, last_bucket);
+	for(hsize_t i = 0; i < rows.size(); ) {
+		hsize_t buf_first;
+		size_t nbufrows;
+		const char* buffer = rows.buffer(i, &buf_first, &nbufrows);
+		size_t skip = (size_t) (i - buf_first);
+		aggregator.addRows(buffer + skip * row_size, nbufrows - skip, row_structure, rollup_columns);
+		i = buf_first + nbufrows;
+	}
+	my_counters.rollup_rows_read.add(rows.size());
+
+	if(last_bucket + rollup_size <= end) {
+		aggregateRecords(aggregator, last_bucket + rollup_size, end);
+	}
+	return true;
+}
+
+/** <summary>Reduces the records between two timestamps (inclusive) to one row per time bucket</summary>
+ * <param name="start">First timestamp to include</param>
+ * <param name="end">Last timestamp to include</param>
+ * <param name="bucket_size">Length of a bucket</param>
+ * <param name="specs">The aggregated columns</param>
+ */
+tsdb::RecordSet Timeseries::aggregate(boost::posix_time::ptime start, boost::posix_time::ptime end,
+	boost::posix_time::time_duration bucket_size, const std::vector<tsdb::AggregateSpec>& specs) {
+	return this->aggregate(tsdb::ptime_to_timestamp(start), tsdb::ptime_to_timestamp(end),
+		(tsdb::timestamp_t) bucket_size.total_milliseconds(), specs);
+}
+
+/** <summary>Computes the statistics of a field over the records between two timestamps (inclusive)</summary>
+ * <remarks><p>The blocks of the zone map that are inside the range are not read: their statistics are
+ * merged from the zone map, and only the records before the first and after the last of them are
+ * scanned. Without a zone map, all of the records are scanned.</p>
+ * <p>Throws a StructureException if there is no such field, and a type_conversion_error if it is not a
+ * number.</p></remarks>
+ * <param name="start">First timestamp to include</param>
+ * <param name="end">Last timestamp to include</param>
+ * <param name="field_name">Name of a numeric field</param>
+ */
+tsdb::ZoneStats Timeseries::fieldStatistics(tsdb::timestamp_t start, tsdb::timestamp_t end, const std::string& field_name) {
+	waitForAppends();
+	size_t ifield = my_structure->getFieldIndexByName(field_name);
+	tsdb::ZoneStats stats;
+
+	tsdb::BufferedRecordSet range = this->bufferedRecordSet(start, end);
+	if(range.size() == 0) {
+		return stats;
+	}
+	hsize_t first = range.firstRecordId();
+	hsize_t last = first + range.size() - 1;
+	hsize_t i = first;
+
+	if(my_zone_map.get() != 0 && my_zone_map->hasField(ifield)) {
+		for(size_t b = my_zone_map->blockAtOrAfter(first); b < my_zone_map->size(); b++) {
+			hsize_t block_first = my_zone_map->firstRecordId(b);
+			hsize_t block_last = block_first + my_zone_map->nrecords(b) - 1;
+			if(block_last > last) {
+				break;
+			}
+			if(block_first > i) {
+				scanStatistics(i, block_first - 1, ifield, &stats);
+			}
+			stats.merge(my_zone_map->stats(b, ifield));
+			i = block_last + 1;
+		}
+	}
+
+	if(i <= last) {
+		scanStatistics(i, last, ifield, &stats);
+	}
+	return stats;
+}
+
+/** <summary>Computes the statistics of a field over the records between two timestamps (inclusive)</summary>
+ * <param name="start">First timestamp to include</param>
+ * <param name="end">Last timestamp to include</param>
+ * <param name="field_name">Name of a numeric field</param>
+ */
+tsdb::ZoneStats Timeseries::fieldStatistics(boost::posix_time::ptime start, boost::posix_time::ptime end,
+	const std::string& field_name) {
+	return this->fieldStatistics(tsdb::ptime_to_timestamp(start), tsdb::ptime_to_timestamp(end), field_name);
+}
+
+/** <summary>Returns the records between two timestamps (inclusive) that match a Predicate</summary>
+ * <remarks><p>The records are read a buffer at a time, and a CompiledPredicate selects the ones that
+ * match, a column at a time, so only those are copied into the result. The blocks of the zone map that
+ * the Predicate can't match, going by their statistics, are not read at all, so a selective condition on a
+ * field that changes slowly over time reads little more than the records it returns.</p>
+ * <p>Only the fields named in <c>field_names</c> are returned, in that order, as with recordSet(); when it
+ * is empty, all of them are. The Predicate may use fields that are not returned.</p>
+ * <p>Throws a PredicateException if the Predicate does not fit the fields of the Timeseries, and a
+ * StructureException if a field in <c>field_names</c> is not one of them.</p></remarks>
+ * <param name="start">First timestamp to include</param>
+ * <param name="end">Last timestamp to include</param>
+ * <param name="predicate">The condition that the records must meet</param>
+ * <param name="field_names">Names of the fields to return, or empty for all of them</param>
+ */
+tsdb::RecordSet Timeseries::scan(tsdb::timestamp_t start, tsdb::timestamp_t end, const tsdb::Predicate& predicate,
+	const std::vector<std::string>& field_names) {
+	waitForAppends();
+	my_counters.scans.add();
+	tsdb::CompiledPredicate compiled(predicate, my_structure);
+	boost::shared_ptr<tsdb::Structure> projection = field_names.empty() ? my_structure : my_structure->project(field_names);
+
+	// Where each field of the result is in a record of the Timeseries
+	size_t record_size = my_structure->getSizeOf();
+	size_t row_size = projection->getSizeOf();
+	std::vector<size_t> src_offsets;
+	std::vector<size_t> dst_offsets;
+	std::vector<size_t> sizes;
+	for(size_t j = 0; j < projection->getNFields(); j++) {
+		size_t i = my_structure->getFieldIndexByName(projection->getField(j)->getName());
+		src_offsets.push_back(my_structure->getOffsetOfField(i));
+		dst_offsets.push_back(projection->getOffsetOfField(j));
+		sizes.push_back(my_structure->getSizeOfField(i));
+	}
+
+	tsdb::BufferedRecordSet range = this->bufferedRecordSet(start, end);
+	if(range.size() == 0) {
+		return tsdb::RecordSet(0, projection);
+	}
+	hsize_t first = range.firstRecordId();
+	hsize_t last = first + range.size() - 1;
+
+	// The runs of records to read: the range, less the zone map blocks that can't match
+	std::vector<std::pair<hsize_t, hsize_t> > runs;
+	hsize_t i = first;
+	if(my_zone_map.get() != 0 && !compiled.matchesAll()) {
+		size_t b = my_zone_map->blockAtOrAfter(first);
+		b = (b > 0) ? b - 1 : 0;  // the block before may hold the first record
+		for( ; b < my_zone_map->size() && i <= last; b++) {
+			hsize_t block_first = my_zone_map->firstRecordId(b);
+			hsize_t block_last = block_first + my_zone_map->nrecords(b) - 1;
+			if(my_zone_map->nrecords(b) == 0 || block_last < i) {
+				continue;
+			}
+			if(block_first > last) {
+				break;
+			}
+			if(compiled.mayMatch(*my_zone_map, b)) {
+				continue;
+			}
+			if(block_first > i) {
+				runs.push_back(std::make_pair(i, block_first - 1));
+			}
+			my_counters.scan_blocks_skipped.add();
+			i = block_last + 1;
+		}
+	}
+	if(i <= last) {
+		runs.push_back(std::make_pair(i, last));
+	}
+
+	std::vector<char> rows;
+	size_t nrows = 0;
+	std::vector<size_t> selection;
+	for(size_t r = 0; r < runs.size(); r++) {
+		tsdb::BufferedRecordSet records = my_data->bufferedRecordSet(runs[r].first, runs[r].second);
+		for(hsize_t k = 0; k < records.size(); ) {
+			hsize_t buf_first;
+			size_t nbufrecords;
+			const char* buffer = records.buffer(k, &buf_first, &nbufrecords);
+			size_t skip = (size_t) (k - buf_first);
+			const char* block = buffer + skip * record_size;
+			size_t nblock = nbufrecords - skip;
+
+			selection.clear();
+			size_t nselected = compiled.select(block, nblock, selection);
+			my_counters.scan_records_read.add(nblock);
+			my_counters.scan_records_matched.add(nselected);
+
+			rows.resize((nrows + nselected) * row_size);
+			for(size_t s = 0; s < nselected; s++) {
+				const char* src = block + selection[s] * record_size;
+				char* dst = &rows[(nrows + s) * row_size];
+				if(field_names.empty()) {
+					memcpy(dst, src, record_size);
+					continue;
+				}
+				for(size_t f = 0; f < sizes.size(); f++) {
+					memcpy(dst + dst_offsets[f], src + src_offsets[f], sizes[f]);
+				}
+			}
+			nrows += nselected;
+			k = buf_first + nbufrecords;
+		}
+	}
+
+	if(nrows == 0) {
+		return tsdb::RecordSet(0, projection);
+	}
+	boost::shared_ptr<tsdb::MemoryBlock> memblk = boost::make_shared<tsdb::MemoryBlock>(rows.size());
+	tsdb::MemoryBlockPtr memblkptr(memblk, 0);
+	memblkptr.memCpy(&rows[0], rows.size());
+	return tsdb::RecordSet(memblkptr, nrows, projection);
+}
+
+/** <summary>Returns the records between two timestamps (inclusive) that match a Predicate</summary>
+ * <param name="start">First timestamp to include</param>
+ * <param name="end">Last timestamp to include</param>
+ * <param name="predicate">The condition that the records must meet</param>
+ * <param name="field_names">Names of the fields to return, or empty for all of them</param>
+ */
+tsdb::RecordSet Timeseries::scan(boost::posix_time::ptime start, boost::posix_time::ptime end,
+	const tsdb::Predicate& predicate, const std::vector<std::string>& field_names) {
+	return this->scan(tsdb::ptime_to_timestamp(start), tsdb::ptime_to_timestamp(end), predicate, field_names);
+}
+
+/** <summary>Merges the statistics of field <c>ifield</c> of records <c>first</c> to <c>last</c> into <c>stats</c></summary> */
+void Timeseries::scanStatistics(hsize_t first, hsize_t last, size_t ifield, tsdb::ZoneStats* stats) {
+	tsdb::BufferedRecordSet records = my_data->bufferedRecordSet(first, last);
+
+	for(hsize_t i = 0; i < records.size(); ) {
+		hsize_t buf_first;
+		size_t nbufrecords;
+		const char* buffer = records.buffer(i, &buf_first, &nbufrecords);
+		size_t skip = (size_t) (i - buf_first);
+		stats->merge(tsdb::ZoneStats::fromColumn(tsdb::StridedColumn(buffer + skip * my_structure->getSizeOf(),
+			nbufrecords - skip, *my_structure, ifield)));
+		i = buf_first + nbufrecords;
+	}
+}
+
 /*Timeseries::Timeseries() {
 	this->data = NULL;
 	this->record_struct = NULL;
@@ -1098,4 +2743,70 @@ int record_cmp(const void *a, const void *b) {
 	if(tsA < tsB) { return -1; } else if(tsA == tsB) { return 0; } else { return 1; };
 }
 
+/* ====================================================================
+ * struct TimeseriesStats - what a Timeseries has done
+ * ====================================================================
+ */
+
+/** <summary>Returns the counters as name, value pairs</summary>
+ * <remarks>The counters of the data table follow those of the Timeseries, with names that start with
+ * <c>data_</c>.</remarks>
+ */
+tsdb::StatList TimeseriesStats::items(void) const {
+	tsdb::StatList items;
+	items.push_back(std::make_pair(std::string("lookups"), lookups));
+	items.push_back(std::make_pair(std::string("index_hits"), index_hits));
+	items.push_back(std::make_pair(std::string("index_narrowed"), index_narrowed));
+	items.push_back(std::make_pair(std::string("bisection_steps"), bisection_steps));
+	items.push_back(std::make_pair(std::string("window_scans"), window_scans));
+	items.push_back(std::make_pair(std::string("records_scanned"), records_scanned));
+	items.push_back(std::make_pair(std::string("lookup_us"), lookup_us));
+	items.push_back(std::make_pair(std::string("append_batches"), append_batches));
+	items.push_back(std::make_pair(std::string("largest_batch"), largest_batch));
+	items.push_back(std::make_pair(std::string("sorted_batches"), sorted_batches));
+	items.push_back(std::make_pair(std::string("records_discarded"), records_discarded));
+	items.push_back(std::make_pair(std::string("single_appends"), single_appends));
+	items.push_back(std::make_pair(std::string("merges"), merges));
+	items.push_back(std::make_pair(std::string("records_merged"), records_merged));
+	items.push_back(std::make_pair(std::string("records_appended"), records_appended));
+	items.push_back(std::make_pair(std::string("append_us"), append_us));
+	items.push_back(std::make_pair(std::string("scans"), scans));
+	items.push_back(std::make_pair(std::string("scan_blocks_skipped"), scan_blocks_skipped));
+	items.push_back(std::make_pair(std::string("scan_records_read"), scan_records_read));
+	items.push_back(std::make_pair(std::string("scan_records_matched"), scan_records_matched));
+	items.push_back(std::make_pair(std::string("segment_lookups"), segment_lookups));
+	items.push_back(std::make_pair(std::string("asof_lookups"), asof_lookups));
+	items.push_back(std::make_pair(std::string("asof_windows"), asof_windows));
+	items.push_back(std::make_pair(std::string("last_record_hits"), last_record_hits));
+	items.push_back(std::make_pair(std::string("rollup_aggregates"), rollup_aggregates));
+	items.push_back(std::make_pair(std::string("rollup_rows_read"), rollup_rows_read));
+
+	tsdb::StatList data_items = data.items("data_");
+	items.insert(items.end(), data_items.begin(), data_items.end());
+	return items;
+}
+
+/* ====================================================================
+ * struct IndexCheck - what Timeseries::verifyIndex() found
+ * ====================================================================
+ */
+
+/** <summary>Returns true if nothing was bad</summary> */
+bool IndexCheck::ok(void) const {
+	return bad_index_points == 0 && bad_zone_blocks == 0 && bad_segment_keys == 0;
+}
+
+/** <summary>Returns the counts as name, value pairs</summary> */
+tsdb::StatList IndexCheck::items(void) const {
+	tsdb::StatList items;
+	items.push_back(std::make_pair(std::string("nrecords"), nrecords));
+	items.push_back(std::make_pair(std::string("index_points"), index_points));
+	items.push_back(std::make_pair(std::string("bad_index_points"), bad_index_points));
+	items.push_back(std::make_pair(std::string("zone_blocks"), zone_blocks));
+	items.push_back(std::make_pair(std::string("bad_zone_blocks"), bad_zone_blocks));
+	items.push_back(std::make_pair(std::string("segment_keys"), segment_keys));
+	items.push_back(std::make_pair(std::string("bad_segment_keys"), bad_segment_keys));
+	return items;
+}
+
 } // namespace tsdb
\ No newline at end of file
@@ -13,6 +13,7 @@
 /* TSDB Includes */
 #include "tsdb.h"
 #include "table.h"
+#include "storageoptions.h"
 #include "structure.h"
 #include "recordset.h"
 
@@ -26,6 +27,15 @@ namespace tsdb {
  * -----------------------------------------------------------------
  */
 class BufferedRecordSet;
+class RecordCursor;
+struct AggregateSpec;
+class Aggregator;
+class Predicate;
+struct ZoneStats;
+class ZoneMap;
+class SegmentIndex;
+class AppendWriter;
+class Rollup;
 
 /* -----------------------------------------------------------------
  * TimeseriesException. For runtime errors thrown by the Timeseries 
@@ -42,6 +52,70 @@ public:
 
 };
 
+/* -----------------------------------------------------------------
+ * TimeseriesStats. What a Timeseries has done so far.
+ * -----------------------------------------------------------------
+ */
+struct TimeseriesStats
+{
+	TimeseriesStats(void): lookups(0), index_hits(0), index_narrowed(0), bisection_steps(0), window_scans(0),
+		records_scanned(0), lookup_us(0), append_batches(0), largest_batch(0), sorted_batches(0),
+		records_discarded(0), single_appends(0), merges(0), records_merged(0), records_appended(0), append_us(0),
+		scans(0), scan_blocks_skipped(0), scan_records_read(0), scan_records_matched(0), segment_lookups(0),
+		asof_lookups(0), asof_windows(0), last_record_hits(0), rollup_aggregates(0), rollup_rows_read(0) {}
+
+	unsigned long long lookups;            // calls to recordId_LE() and recordId_GE()
+	unsigned long long index_hits;         // ... answered by an index point
+	unsigned long long index_narrowed;     // ... whose range the index narrowed, but did not answer
+	unsigned long long bisection_steps;    // single timestamps read while bisecting the data table
+	unsigned long long window_scans;       // search windows read once bisecting was done
+	unsigned long long records_scanned;    // timestamps read in those windows
+	unsigned long long lookup_us;          // microseconds spent in lookups
+	unsigned long long append_batches;     // calls to appendRecords() with records
+	unsigned long long largest_batch;      // ... and the most records in one of them
+	unsigned long long sorted_batches;     // ... that were out of order, and had to be sorted
+	unsigned long long records_discarded;  // records appendRecords() dropped for being before the end
+	unsigned long long single_appends;     // calls to appendRecord()
+	unsigned long long merges;             // calls to mergeRecords() with records
+	unsigned long long records_merged;     // ... and the records passed to them
+	unsigned long long records_appended;   // records written to the end of the data table, by any method
+	unsigned long long append_us;          // microseconds spent writing and indexing them
+	unsigned long long scans;              // calls to scan()
+	unsigned long long scan_blocks_skipped; // ... zone map blocks they did not read
+	unsigned long long scan_records_read;  // ... records they read and tested
+	unsigned long long scan_records_matched; // ... and the records that matched
+	unsigned long long segment_lookups;    // lookups that searched where the segment index predicted
+	unsigned long long asof_lookups;       // timestamps looked up by lookupAsOf()
+	unsigned long long asof_windows;       // ... windows of timestamps it read to answer them
+	unsigned long long last_record_hits;   // last records copied from memory, without a read
+	unsigned long long rollup_aggregates;  // calls to aggregate() answered from a rollup
+	unsigned long long rollup_rows_read;   // ... and the rollup rows they read
+	tsdb::TableStats data;                 // reads and writes of the data table
+
+	tsdb::StatList items(void) const;
+};
+
+/* -----------------------------------------------------------------
+ * IndexCheck. What Timeseries::verifyIndex() found.
+ * -----------------------------------------------------------------
+ */
+struct IndexCheck
+{
+	IndexCheck(void): nrecords(0), index_points(0), bad_index_points(0), zone_blocks(0), bad_zone_blocks(0),
+		segment_keys(0), bad_segment_keys(0) {}
+
+	unsigned long long nrecords;           // records of the data table that were read
+	unsigned long long index_points;       // index points there should be
+	unsigned long long bad_index_points;   // ... that are missing or wrong, and points that should not be there
+	unsigned long long zone_blocks;        // zone map blocks there should be
+	unsigned long long bad_zone_blocks;    // ... that are missing or wrong, and blocks that should not be there
+	unsigned long long segment_keys;       // timestamps the segment index covers
+	unsigned long long bad_segment_keys;   // ... whose first record is not where it predicts
+
+	bool ok(void) const;
+	tsdb::StatList items(void) const;
+};
+
 /* -----------------------------------------------------------------
  * Timeseries. Represents a timeseries object in the database
  * -----------------------------------------------------------------
@@ -63,17 +137,56 @@ public:
  * is created, another timeseries is created in the original Group. This timeseries is called "_TSDB_index"
  * and is a full-fledged Timeseries object itself. After the index is created, operations on the 
  * base timeseries will use the index to speed up locating timestamps. Because the index is a Timeseries
- * itself, after it gets too large, it will spawn a secondary index. Queries on the original base Timeseries 
- * will recursively descend the index tree.</p></remarks>
+ * itself, after it gets too large, it will spawn a secondary index.</p>
+ * <p>Index points are chosen from the records being appended while they are still in memory, and written
+ * to the index in one go, so keeping the index up to date does not read the data table.
+ * When a Timeseries is opened, the index points are loaded into memory once and kept up to date as records
+ * are appended. Lookups binary search this in-memory copy, so locating a timestamp costs at most one read
+ * from the data table.</p>
+ * <p>Along with the index, a Timeseries with numeric fields keeps a ZoneMap "_TSDB_zonemap": the minimum,
+ * maximum, sum and counts of each numeric field in every block between two index points. fieldStatistics()
+ * answers the blocks a range covers from the zone map, and only reads the records at its ends.</p>
+ * <p>useSegmentIndex() adds a SegmentIndex "_TSDB_segments", a few line segments that predict the record id
+ * of a timestamp to within SEGMENT_MAX_ERROR records. It is kept up to date with the index, and lookups
+ * that it covers search only the records around the prediction, with one read. The index points are still
+ * kept, since the zone map blocks are between them, and answer the lookups the segments do not cover.</p>
+ * <p>Records that arrive late can be merged into the series with mergeRecords(), which rewrites the records
+ * after the earliest of them, along with the index points and zone map blocks there. A ReorderBuffer
+ * holds records back for a while first, so that only the ones later than its horizon need this.</p>
+ * <p>Creating a Timeseries adds its name to the Catalog of its location, so the series of a file can be
+ * listed with one read.</p>
+ * <p>appendRecord() buffers records, and writes them when the buffer is full. With setAsyncAppend(), an
+ * AppendWriter writes the full buffers on a thread of its own instead, so appending a record is a copy.
+ * flushAppendBuffer() writes everything appended and flushes the file.</p>
+ * <p>scan() returns only the records of a range that match a Predicate, with only some of their fields.
+ * It tests the records a buffer at a time, and does not read the zone map blocks that can't match.</p>
+ * <p>stats() reports what the Timeseries has done since it was opened: how lookups went through the index,
+ * bisection and search window, how big the appended batches were, and the reads and writes of the data
+ * table. The counters are always on, and cost an atomic add each.</p>
+ * <p>One process can append to a series while others read it, with HDF5 SWMR: the writer calls
+ * prepareSwmrWrite() before Swmr::startWrite(), and readers call refresh() to see the new records. See
+ * Swmr, and TailCursor to follow a series as it grows.</p>
+ * <p>For bulk loads, setDeferIndex() stops appends from keeping the index, the zone map and the segment
+ * index up to date, and rebuildIndex() then builds them from scratch, reading the data table on several
+ * threads and writing the index points in one go. verifyIndex() compares them with what they should be,
+ * which finds an index left behind by a writer that crashed; rebuildIndex() repairs it.</p>
+ * <p>The Timeseries keeps its last record in memory once it has read it, and appends keep it current, so
+ * getLastRecord() does not read the file. lookupAsOf() answers many recordId_LE() lookups at once, for a
+ * sorted array of timestamps, reading a window of timestamps for each record found and answering the
+ * timestamps after it that fall in the window from memory.</p>
+ * <p>addRollup() keeps a Rollup of the series: the rows aggregate() would return for it with one bucket size,
+ * saved as a Timeseries "_TSDB_rollup_<bucket size>" in the group and brought up to date by every append.
+ * aggregate() answers from the coarsest rollup that can, and only reads the records at the ends of the
+ * range that do not fill a bucket of it.</p></remarks>
  */
 class  Timeseries 
 {
 public:
 	/* Constructors */
 	Timeseries(const hid_t _loc_id, const std::string& _name, const std::string& _title, 
-		const std::vector<Field*>& _fields);
+		const std::vector<Field*>& _fields, const tsdb::StorageOptions& _options = tsdb::StorageOptions());
 	Timeseries(const hid_t _loc_id, const std::string& _name, const std::string& _title,
-		const boost::shared_ptr<tsdb::Structure>& _structure);
+		const boost::shared_ptr<tsdb::Structure>& _structure, const tsdb::StorageOptions& _options = tsdb::StorageOptions());
 	Timeseries(const hid_t _loc_id, const std::string& _name);
 	Timeseries();
 
@@ -82,6 +195,8 @@ public:
 	void appendRecordSet(const tsdb::RecordSet &recset, bool discard_overlap);
 	void appendRecord(tsdb::Record &record);
 	void flushAppendBuffer();
+	int mergeRecords(size_t nrecords, void* records);
+	void truncate(hsize_t nrecords);
 
 	/* Methods to lookup records in the Timeseries */
 	herr_t recordId_LE(timestamp_t timestamp, hsize_t* record_id);
@@ -89,15 +204,33 @@ public:
 	herr_t recordId_LE(boost::posix_time::ptime timestamp, hsize_t* record_id);
 	herr_t recordId_GE(boost::posix_time::ptime timestamp, hsize_t* record_id);
 	void* getLastRecord(void);
+	bool getLastRecord(void* record);
+	size_t lookupAsOf(const tsdb::timestamp_t* timestamps, size_t ntimestamps, hsize_t* record_ids,
+		void* records = NULL);
 	void* getRecordsById(hsize_t first, hsize_t last);
 	tsdb::RecordSet recordSet(hsize_t first, hsize_t last);
 	tsdb::RecordSet recordSet(tsdb::timestamp_t start, tsdb::timestamp_t end);
+	tsdb::RecordSet recordSet(hsize_t first, hsize_t last, const std::vector<std::string>& field_names);
+	tsdb::RecordSet recordSet(tsdb::timestamp_t start, tsdb::timestamp_t end, const std::vector<std::string>& field_names);
 	tsdb::RecordSet recordSet(boost::posix_time::ptime start, boost::posix_time::ptime end);
 	void getRecordsByTimestamp(boost::posix_time::ptime start, boost::posix_time::ptime end,  hsize_t* nrecords, void** records);
 	void getRecordsByTimestamp(tsdb::timestamp_t start, tsdb::timestamp_t end,  hsize_t* nrecords, void** records);
 	tsdb::BufferedRecordSet bufferedRecordSet(hsize_t first, hsize_t last);
 	tsdb::BufferedRecordSet bufferedRecordSet(tsdb::timestamp_t start, tsdb::timestamp_t end);
 	tsdb::BufferedRecordSet bufferedRecordSet(boost::posix_time::ptime start, boost::posix_time::ptime end);
+	tsdb::RecordCursor cursor(hsize_t first, hsize_t last, bool forward = true);
+	tsdb::RecordCursor cursor(tsdb::timestamp_t start, tsdb::timestamp_t end, bool forward = true);
+	tsdb::RecordCursor cursor(boost::posix_time::ptime start, boost::posix_time::ptime end, bool forward = true);
+	tsdb::RecordSet aggregate(tsdb::timestamp_t start, tsdb::timestamp_t end, tsdb::timestamp_t bucket_size,
+		const std::vector<tsdb::AggregateSpec>& specs);
+	tsdb::RecordSet aggregate(boost::posix_time::ptime start, boost::posix_time::ptime end,
+		boost::posix_time::time_duration bucket_size, const std::vector<tsdb::AggregateSpec>& specs);
+	tsdb::ZoneStats fieldStatistics(tsdb::timestamp_t start, tsdb::timestamp_t end, const std::string& field_name);
+	tsdb::ZoneStats fieldStatistics(boost::posix_time::ptime start, boost::posix_time::ptime end, const std::string& field_name);
+	tsdb::RecordSet scan(tsdb::timestamp_t start, tsdb::timestamp_t end, const tsdb::Predicate& predicate,
+		const std::vector<std::string>& field_names = std::vector<std::string>());
+	tsdb::RecordSet scan(boost::posix_time::ptime start, boost::posix_time::ptime end, const tsdb::Predicate& predicate,
+		const std::vector<std::string>& field_names = std::vector<std::string>());
 	
 	/* Methods to get information about the Timeseries */
 	hsize_t getNRecords(void);
@@ -105,12 +238,39 @@ public:
 	hsize_t getNRecordsByTimestamp(boost::posix_time::ptime start, boost::posix_time::ptime end);
 	hsize_t getNRecordsByTimestamp(tsdb::timestamp_t start, tsdb::timestamp_t end);
 	const boost::shared_ptr<tsdb::Table>& dataTable();
+	const boost::shared_ptr<tsdb::ZoneMap>& zoneMap();
 
 	/* Methods to change the behaivor of the Timeseries */
 	void setIndexStep(size_t _index_step);
 	void setSplitIndexGt(size_t _split_index_gt);
+	void setSearchWindow(size_t _search_window);
+	void setAsyncAppend(size_t buffer_bytes);
+	void buildZoneMap(void);
+	void useSegmentIndex(size_t max_error = SEGMENT_MAX_ERROR);
+	bool mapRecords(void);
+	void setDeferIndex(bool defer);
+
+	/* Methods to keep downsampled copies of the Timeseries, see Rollup */
+	void addRollup(tsdb::timestamp_t bucket_size, const std::vector<tsdb::AggregateSpec>& specs, size_t nthreads = 0);
+	void addRollup(boost::posix_time::time_duration bucket_size, const std::vector<tsdb::AggregateSpec>& specs);
+	void dropRollup(tsdb::timestamp_t bucket_size);
+	std::vector<tsdb::timestamp_t> rollups(void);
+
+	/* Methods to rebuild and check the indexes, see tsdbreindex */
+	void rebuildIndex(size_t nthreads = 0);
+	tsdb::IndexCheck verifyIndex(size_t nthreads = 0);
+
+	/* Methods for single writer/multiple reader access, see Swmr */
+	void prepareSwmrWrite(void);
+	void refresh(void);
+
+	/* Methods that report what the Timeseries has done */
+	tsdb::TimeseriesStats stats(void);
+	void resetStats(void);
+
 	/* Static Methods */
 	static bool exists(hid_t loc_id, std::string name);
+	static void dropIndex(hid_t loc_id, const std::string& name);
 
 	/* Destructor */
 	~Timeseries(void);
@@ -119,8 +279,37 @@ public:
 private:
 	
 	/* Private methods to deal with the Timeseries' index */
-	bool createIndexIfNecessary(void);
+	friend class AppendWriter;
+	void waitForAppends(void);
+	void commitAppendBuffer(void);
+	void resetBufferLastTimestamp(void);
+	void flushDatasets(void);
+	void appendAndIndex(size_t nrecords, const char* records);
+	bool lastTimestamp(tsdb::timestamp_t* timestamp);
+	bool loadLastRecord(void);
+	void createIndex(void);
+	void indexRecords(hsize_t first_id, size_t nrecords, const char* records);
+	void addIndexPoints(hsize_t first_id, size_t nrecords, const char* records);
+	void rebuildBlock(hsize_t first_id, size_t nrecords, const char* records);
+	void clearIndexes(void);
+	void indexTableRange(hsize_t first, hsize_t last);
 	void indexTail(void);
+	void loadIndexCache(void);
+	void saveIndexSetting(const char* attr_name, size_t value);
+	bool loadIndexSetting(const char* attr_name, size_t* value);
+	void updateZoneMap(hsize_t first_id, size_t nrecords, const char* records);
+	void updateSegmentIndex(hsize_t first_id, size_t nrecords, const char* records);
+	bool segmentLowerBound(tsdb::timestamp_t timestamp, hsize_t* record_id);
+	void scanStatistics(hsize_t first, hsize_t last, size_t ifield, tsdb::ZoneStats* stats);
+	void openRollups(void);
+	void rollupTail(void);
+	void resumeRollups(void);
+	void aggregateRecords(tsdb::Aggregator& aggregator, tsdb::timestamp_t start, tsdb::timestamp_t end);
+	bool aggregateRollup(tsdb::Aggregator& aggregator, tsdb::timestamp_t start, tsdb::timestamp_t end,
+		tsdb::timestamp_t bucket_size, const std::vector<tsdb::AggregateSpec>& specs);
+	bool indexRange(timestamp_t timestamp, hsize_t* tbl_first_id, hsize_t* tbl_last_id);
+	hsize_t lowerBoundById(timestamp_t timestamp, hsize_t first, hsize_t last);
+	bool recordIdRange(tsdb::timestamp_t start, tsdb::timestamp_t end, hsize_t* start_id, hsize_t* end_id);
 
 	/* Properties */
 	boost::shared_ptr<tsdb::Table> my_data;
@@ -130,9 +319,54 @@ private:
 	std::string my_name;
 	std::string my_title;
 	size_t my_split_index_gt;	// Create an index when more than this nrecords 
-	size_t my_index_step;		// Add index points at approx. this step size
+	size_t my_index_step;		// Add index points at approx. this step size 
+	size_t my_search_window;	// Scan ranges of at most this many records when searching by timestamp
 	boost::shared_ptr<tsdb::Timeseries> my_index_ts;
+	std::vector<index_record_t> my_index_cache; // every point of my_index_ts, sorted by timestamp
+	boost::shared_ptr<tsdb::ZoneMap> my_zone_map; // statistics of the blocks between index points
+	boost::shared_ptr<tsdb::SegmentIndex> my_segment_index; // predicts record ids, if useSegmentIndex()
+	std::vector<boost::shared_ptr<tsdb::Rollup> > my_rollups; // see addRollup()
+	hsize_t my_rolled_nrecords;            // records of the data table the rollups have been given
+	hsize_t my_indexed_nrecords;           // records of the data table that indexRecords() has seen
+	tsdb::timestamp_t my_indexed_last_ts;  // ... and the timestamp of the last of them
+	bool my_indexed_last_ts_known;
+	std::vector<char> my_last_record;      // the last record of the data table, if my_last_record_known
+	bool my_last_record_known;
 	tsdb::timestamp_t my_buffer_last_ts;
+	boost::shared_ptr<tsdb::AppendWriter> my_appender; // writes appendRecord() records on a thread, if set
+	bool my_swmr_write;                    // flushDatasets() after every batch, see prepareSwmrWrite()
+	bool my_defer_index;                   // appends do not index, see setDeferIndex()
+
+	/* What the Timeseries has done, see stats() */
+	struct Counters {
+		tsdb::StatCounter lookups;
+		tsdb::StatCounter index_hits;
+		tsdb::StatCounter index_narrowed;
+		tsdb::StatCounter bisection_steps;
+		tsdb::StatCounter window_scans;
+		tsdb::StatCounter records_scanned;
+		tsdb::StatCounter lookup_us;
+		tsdb::StatCounter append_batches;
+		tsdb::StatCounter largest_batch;
+		tsdb::StatCounter sorted_batches;
+		tsdb::StatCounter records_discarded;
+		tsdb::StatCounter single_appends;
+		tsdb::StatCounter merges;
+		tsdb::StatCounter records_merged;
+		tsdb::StatCounter records_appended;
+		tsdb::StatCounter append_us;
+		tsdb::StatCounter scans;
+		tsdb::StatCounter scan_blocks_skipped;
+		tsdb::StatCounter scan_records_read;
+		tsdb::StatCounter scan_records_matched;
+		tsdb::StatCounter segment_lookups;
+		tsdb::StatCounter asof_lookups;
+		tsdb::StatCounter asof_windows;
+		tsdb::StatCounter last_record_hits;
+		tsdb::StatCounter rollup_aggregates;
+		tsdb::StatCounter rollup_rows_read;
+	};
+	Counters my_counters;
 
 };
 
@@ -1,5 +1,6 @@
 #include "tokenfilter.h"
 #include <stdexcept>
+#include <string.h>
 
 namespace tsdb {
 
@@ -42,80 +43,111 @@ TokenFilter::TokenFilter(std::vector<size_t> new_apply_to_tokens, tsdb::TokenFil
 	this->apply_to_tokens = new_apply_to_tokens;
 	this->compare_operator = new_compare_operator;
 	this->compare_to = new_compare_to;
+	if(new_compare_operator == IN || new_compare_operator == NOT_IN) {
+		this->compare_set.add(new_compare_to);
+	}
+}
+
+/** <summary>Constructs a new TokenFilter that looks the joined tokens up in a set of strings</summary>
+ * <remarks>With IN, the filter is true (and a RecordParser excludes the line) when the joined tokens are
+ * one of the strings; with NOT_IN, when they are none of them. EQUAL_TO and NOT_EQUAL_TO behave like IN
+ * and NOT_IN.
+ * </remarks>
+ * <param name="new_apply_to_tokens">A vector of token index numbers to join into a string</param>
+ * <param name="new_compare_operator">A Comparison enum to be used</param>
+ * <param name="new_compare_set">The strings to look the joined tokens up in</param>
+ */
+TokenFilter::TokenFilter(std::vector<size_t> new_apply_to_tokens, tsdb::TokenFilter::Comparison new_compare_operator,
+	const std::vector<std::string>& new_compare_set): compare_set(new_compare_set) {
+	if(new_apply_to_tokens.size() == 0) {
+		throw(TokenFilterException("no tokens specified to use"));
+	}
+
+	this->apply_to_tokens = new_apply_to_tokens;
+	switch(new_compare_operator) {
+		case EQUAL_TO:
+			this->compare_operator = IN;
+			break;
+		case NOT_EQUAL_TO:
+			this->compare_operator = NOT_IN;
+			break;
+		default:
+			this->compare_operator = new_compare_operator;
+			break;
+	}
 }
 
 /** <summary>Evaluates the filter on a vector of tokens</summary>
  * <remarks>Returns <c>true</c> if the joined token string compared to this->compare_to is
- * true, and false otherwise (using the predefined comparison operator).
+ * true, and false otherwise (using the predefined comparison operator). The tokens are compared
+ * through TokenViews, so they are not joined into a new string.
  * </remarks>
  * <param name="tokens">A vector of token strings</param>
  */
 bool TokenFilter::evaluateFilterOnTokens(const std::vector<std::string> &tokens) {
-	using namespace std;
+	std::vector<TokenView> views(tokens.begin(), tokens.end());
+	return evaluateFilterOnTokens(views);
+}
 
-	bool retval = true;
+/** <summary>Evaluates the filter on a vector of TokenViews</summary>
+ * <remarks>The tokens are compared to this->compare_to piece by piece, without joining them into a
+ * string, or looked up in this->compare_set for IN and NOT_IN.
+ * </remarks>
+ * <param name="tokens">A vector of TokenViews</param>
+ */
+bool TokenFilter::evaluateFilterOnTokens(const std::vector<tsdb::TokenView> &tokens) {
+	bool equal = true;
 
+	if(this->compare_operator == IN || this->compare_operator == NOT_IN) {
+		for(size_t i = 0; i<this->apply_to_tokens.size(); i++) {
+			if(tokens.size() <= this->apply_to_tokens[i]) {
+				throw(TokenFilterException("not enough tokens in token array to process filter"));
+			}
+		}
+		bool found = this->compare_set.find(tokens, this->apply_to_tokens) >= 0;
+		return (this->compare_operator == IN) ? found : !found;
+	}
 
-	/* Combine string to evaluate, if applied to more than one token */
 	if (this->apply_to_tokens.size() > 1) {
-		string eval_str = "";
 		size_t ntokens = tokens.size();
-		for(size_t i = 0; i<this->apply_to_tokens.size(); ) {
-			if(ntokens <= this->apply_to_tokens.at(i)) {
+		size_t pos = 0; // how much of compare_to has matched
+		for(size_t i = 0; i<this->apply_to_tokens.size(); i++) {
+			if(ntokens <= this->apply_to_tokens[i]) {
 				throw(TokenFilterException("not enough tokens in token array to process filter"));
 			}
-
-			eval_str = eval_str + tokens.at(this->apply_to_tokens.at(i));
-			i++;
-			if(i<this->apply_to_tokens.size()) {
-				eval_str = eval_str + " ";
+			if(!equal) {
+				continue;
 			}
-		}
-
-		
-		/* Use the comparison operator to evaluate the string */
-
-		switch(this->compare_operator) {
-			case EQUAL_TO:
-				if(eval_str == this->compare_to) {
-					retval = true;
-				} else {
-					retval = false;
-				}
-				break;
 
-			case NOT_EQUAL_TO:
-				if(eval_str != this->compare_to) {
-					retval = true;
-				} else {
-					retval = false;
+			const TokenView& token = tokens[this->apply_to_tokens[i]];
+			if(i > 0) {
+				if(pos >= this->compare_to.size() || this->compare_to[pos] != ' ') {
+					equal = false;
+					continue;
 				}
-				break;
+				pos++;
+			}
+			if(this->compare_to.size() - pos < token.size || 
+				memcmp(this->compare_to.data() + pos, token.data, token.size) != 0) {
+				equal = false;
+				continue;
+			}
+			pos += token.size;
 		}
+		equal = equal && (pos == this->compare_to.size());
 	} else {
-		/* Use the comparison operator to evaluate the string */
-
-		switch(this->compare_operator) {
-			case EQUAL_TO:
-				if(tokens.at(this->apply_to_tokens.at(0)).compare(this->compare_to) == 0) {
-					retval = true;
-				} else {
-					retval = false;
-				}
-				break;
-
-			case NOT_EQUAL_TO:
-				if(tokens.at(this->apply_to_tokens.at(0)).compare(this->compare_to) != 0) {
-					retval = true;
-				} else {
-					retval = false;
-				}
-				break;
-		}
+		const TokenView& token = tokens.at(this->apply_to_tokens.at(0));
+		equal = (token.size == this->compare_to.size() && 
+			memcmp(this->compare_to.data(), token.data, token.size) == 0);
 	}
 
-	return retval;
+	if(this->compare_operator == EQUAL_TO) {
+		return equal;
+	}
+	return !equal;
+}
 
+TokenFilter::~TokenFilter(void) {
 }
 
 } // namespace tsdb
\ No newline at end of file
@@ -4,6 +4,8 @@
 #include <string>
 
 #include "tsdb.h"
+#include "tokenizer.h"
+#include "tokenset.h"
 
 namespace tsdb {
 
@@ -11,6 +13,9 @@ namespace tsdb {
  * <remarks><p>A TokenFilter represents a simple boolean expression where a set of 
  * tokens are joined into a string separated by spaces are compared to a constant 
  * string. The user can select the comparison operator (EQUAL_TO or NOT_EQUAL_TO).</p>
+ * <p>With IN or NOT_IN, the joined tokens are looked up in a set of strings instead. The set is a TokenSet,
+ * hashed when the filter is made, so keeping 50 symbols out of a feed of hundreds costs one hash and
+ * about one compare per line, not 50 compares.</p>
  * <p>When using the TokenFilter with a RecordParser, the RecordParser evaluates the TokenFilters
  * before any FieldParsers are called. This lets you filter out unsuitable records prior to
  * any expensive parsing operations (such as timestamp parsing). This can signifigantly improve
@@ -24,15 +29,20 @@ class  TokenFilter
 public:
 	enum Comparison {
 		EQUAL_TO,
-		NOT_EQUAL_TO
+		NOT_EQUAL_TO,
+		IN,
+		NOT_IN
 	};
 	
 	/* Constructors */
 	TokenFilter(std::vector<size_t> new_apply_to_tokens, Comparison new_compare_operator,
 		std::string new_compare_to);
+	TokenFilter(std::vector<size_t> new_apply_to_tokens, Comparison new_compare_operator,
+		const std::vector<std::string>& new_compare_set);
 
 	/* Other Methods */
 	bool evaluateFilterOnTokens(const std::vector<std::string> &tokens);
+	bool evaluateFilterOnTokens(const std::vector<tsdb::TokenView> &tokens);
 
 	/* Destructor */
 	~TokenFilter(void);
@@ -41,6 +51,7 @@ private:
 	std::vector<size_t> apply_to_tokens;
 	Comparison compare_operator;
 	std::string compare_to;
+	tsdb::TokenSet compare_set;  // for IN and NOT_IN
 
 };
 
@@ -0,0 +1,259 @@
+/* STL includes */
+#include <string>
+#include <vector>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TSDB_TOKENIZER_SSE2
+#endif
+
+/* TSDB includes */
+#include "tokenizer.h"
+
+namespace tsdb {
+
+/* ====================================================================
+ * class Tokenizer - splits lines into TokenViews
+ * ====================================================================
+ */
+
+/** <summary>Creates a simple Tokenizer that splits at commas</summary> */
+Tokenizer::Tokenizer(void) {
+	setSimple(',');
+}
+
+/** <summary>Splits lines at every <c>_delim</c></summary> */
+void Tokenizer::setSimple(char _delim) {
+	my_simple = true;
+	my_special = std::string(1, _delim);
+	memset(my_char_class, NORMAL, sizeof(my_char_class));
+	my_char_class[(unsigned char) _delim] = DELIMITER;
+}
+
+/** <summary>Splits lines at any character in <c>_delim</c>, with escapes and quotes</summary>
+ * <remarks>Any of the strings may be empty. A character in more than one of the strings is an
+ * escape before it is a delimiter, and a delimiter before it is a quote.</remarks>
+ */
+void Tokenizer::setExtended(const std::string& _delim, const std::string& _esc, const std::string& _quote) {
+	size_t i;
+
+	my_simple = false;
+	memset(my_char_class, NORMAL, sizeof(my_char_class));
+	for(i = 0; i < _quote.size(); i++) {
+		my_char_class[(unsigned char) _quote[i]] = QUOTE;
+	}
+	for(i = 0; i < _delim.size(); i++) {
+		my_char_class[(unsigned char) _delim[i]] = DELIMITER;
+	}
+	for(i = 0; i < _esc.size(); i++) {
+		my_char_class[(unsigned char) _esc[i]] = ESCAPE;
+	}
+
+	my_special.clear();
+	for(i = 0; i < 256; i++) {
+		if(my_char_class[i] != NORMAL) {
+			my_special.push_back((char) i);
+		}
+	}
+}
+
+/** <summary>Returns the first special character in [p, end), or end</summary> */
+const char* Tokenizer::findSpecial(const char* p, const char* end) const {
+#ifdef TSDB_TOKENIZER_SSE2
+	size_t nspecial = my_special.size();
+	if(nspecial > 0 && nspecial <= 8) {
+		__m128i chars[8];
+		for(size_t i = 0; i < nspecial; i++) {
+			chars[i] = _mm_set1_epi8(my_special[i]);
+		}
+
+		while(end - p >= 16) {
+			__m128i block = _mm_loadu_si128((const __m128i*) p);
+			__m128i match = _mm_cmpeq_epi8(block, chars[0]);
+			for(size_t i = 1; i < nspecial; i++) {
+				match = _mm_or_si128(match, _mm_cmpeq_epi8(block, chars[i]));
+			}
+			int mask = _mm_movemask_epi8(match);
+			if(mask != 0) {
+				int offset = 0;
+				while(!(mask & 1)) {
+					mask >>= 1;
+					offset++;
+				}
+				return p + offset;
+			}
+			p += 16;
+		}
+	}
+#endif
+
+	while(p < end && my_char_class[(unsigned char) *p] == NORMAL) {
+		p++;
+	}
+	return p;
+}
+
+/** <summary>Splits a line into tokens</summary>
+ * <remarks><p><c>tokens</c> is cleared first. Its capacity is reused, so splitting lines with the
+ * same number of tokens does not allocate memory.</p>
+ * <p>In extended mode, throws a TokenizerException if an escape character is at the end of the line
+ * or is followed by a character it can not escape.</p></remarks>
+ * <param name="line">The line. It does not have to be NUL-terminated.</param>
+ * <param name="length">Length of the line</param>
+ * <param name="tokens">The tokens, which point into <c>line</c> or into the Tokenizer</param>
+ */
+void Tokenizer::split(const char* line, size_t length, std::vector<TokenView>& tokens) {
+	tokens.clear();
+	if(!my_simple) {
+		splitExtended(line, length, tokens);
+		return;
+	}
+
+	const char* p = line;
+	const char* end = line + length;
+	while(p < end) {
+		const char* next = findSpecial(p, end);
+		tokens.push_back(TokenView(p, next - p));
+		p = next + 1;  // a delimiter at the very end does not start a token
+	}
+}
+
+void Tokenizer::splitExtended(const char* line, size_t length, std::vector<TokenView>& tokens) {
+	const char* p = line;
+	const char* end = line + length;
+
+	if(p == end) {
+		return;
+	}
+
+	// Unescaped tokens are never longer than the line, so the scratch space does not move
+	if(my_scratch.size() < length) {
+		my_scratch.resize(length);
+	}
+	char* out = my_scratch.empty() ? NULL : &my_scratch[0];
+
+	for(;;) {
+		const char* start = p;
+		p = findSpecial(p, end);
+
+		if(p == end || my_char_class[(unsigned char) *p] == DELIMITER) {
+			// The common case: no quotes or escapes, so the token points into the line
+			tokens.push_back(TokenView(start, p - start));
+			if(p == end) {
+				return;
+			}
+			p++;
+			if(p == end) {
+				tokens.push_back(TokenView(p, 0));  // a delimiter at the end gives an empty token
+				return;
+			}
+			continue;
+		}
+
+		// The token has quotes or escapes, so it is copied to the scratch space
+		char* token_start = out;
+		bool in_quote = false;
+		memcpy(out, start, p - start);
+		out += p - start;
+
+		bool at_delimiter = false;
+		while(p < end) {
+			unsigned char c = (unsigned char) *p;
+			switch(my_char_class[c]) {
+			case ESCAPE:
+				if(++p == end) {
+					throw(TokenizerException("cannot end with escape"));
+				}
+				if(*p == 'n') {
+					*out++ = '\n';
+				} else if(my_char_class[(unsigned char) *p] != NORMAL) {
+					*out++ = *p;
+				} else {
+					throw(TokenizerException("unknown escape sequence"));
+				}
+				p++;
+				break;
+			case DELIMITER:
+				if(!in_quote) {
+					at_delimiter = true;
+				} else {
+					*out++ = *p++;
+				}
+				break;
+			case QUOTE:
+				in_quote = !in_quote;
+				p++;
+				break;
+			default: {
+				const char* next = findSpecial(p, end);
+				memcpy(out, p, next - p);
+				out += next - p;
+				p = next;
+				break; }
+			}
+
+			if(at_delimiter) {
+				break;
+			}
+		}
+
+		tokens.push_back(TokenView(token_start, out - token_start));
+		if(p == end) {
+			return;
+		}
+		p++;  // skip the delimiter
+		if(p == end) {
+			tokens.push_back(TokenView(p, 0));
+			return;
+		}
+	}
+}
+
+/* ====================================================================
+ * class TokenTable - the tokens of many lines
+ * ====================================================================
+ */
+
+/** <summary>Removes every row, keeping the memory for the next buffer of lines</summary> */
+void TokenTable::clear(void) {
+	my_tokens.clear();
+	my_row_starts.clear();
+	my_copies.clear();
+	my_copied.clear();
+}
+
+/** <summary>Adds the tokens of a line as the next row</summary>
+ * <param name="tokens">The tokens, as Tokenizer::split() returned them</param>
+ * <param name="line">The line they came from</param>
+ * <param name="length">Length of the line</param>
+ */
+void TokenTable::addRow(const std::vector<TokenView>& tokens, const char* line, size_t length) {
+	if(my_row_starts.empty()) {
+		my_row_starts.push_back(0);
+	}
+
+	for(size_t i = 0; i < tokens.size(); i++) {
+		const TokenView& token = tokens[i];
+		if(token.size == 0 || (token.data >= line && token.data + token.size <= line + length)) {
+			my_tokens.push_back(token);
+			continue;
+		}
+
+		// Copied, since the Tokenizer reuses its scratch space. The earlier copies move when it grows.
+		const char* old_copies = my_copies.empty() ? NULL : &my_copies[0];
+		size_t offset = my_copies.size();
+		my_copies.insert(my_copies.end(), token.data, token.data + token.size);
+		my_copied.push_back(std::make_pair(my_tokens.size(), offset));
+		my_tokens.push_back(TokenView(&my_copies[offset], token.size));
+
+		if(old_copies != NULL && old_copies != &my_copies[0]) {
+			for(size_t k = 0; k < my_copied.size(); k++) {
+				my_tokens[my_copied[k].first].data = &my_copies[0] + my_copied[k].second;
+			}
+		}
+	}
+	my_row_starts.push_back(my_tokens.size());
+}
+
+} // namespace tsdb
@@ -0,0 +1,122 @@
+#pragma once
+
+/* STL Classes */
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "tsdb.h"
+
+namespace tsdb {
+
+/* -----------------------------------------------------------------
+ * TokenizerException. For runtime errors thrown by the Tokenizer.
+ * -----------------------------------------------------------------
+ */
+class  TokenizerException:
+	public std::runtime_error
+{
+public:
+	TokenizerException(const std::string& what):
+	  std::runtime_error(std::string("TokenizerException: ") + what) {}
+};
+
+/* -----------------------------------------------------------------
+ * TokenView. A token that points into the line it came from.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>A (pointer, length) view of a token</summary>
+ * <remarks>A TokenView does not own its characters, and is not NUL-terminated. It points into
+ * the line that was tokenized (or into the Tokenizer's scratch space, for tokens with escapes or
+ * quotes), so it is only valid until the next line is tokenized.</remarks>
+ */
+struct TokenView
+{
+	TokenView(void): data(NULL), size(0) {}
+	TokenView(const char* _data, size_t _size): data(_data), size(_size) {}
+	TokenView(const std::string& _str): data(_str.data()), size(_str.size()) {}
+
+	std::string str(void) const { return std::string(data, size); }
+	bool empty(void) const { return size == 0; }
+
+	const char* data;
+	size_t size;
+};
+
+/* -----------------------------------------------------------------
+ * Tokenizer. Splits a line into TokenViews.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>Splits lines into tokens without copying them</summary>
+ * <remarks><p>In simple mode, a line is split at every occurrence of one delimiter character, as
+ * <c>std::getline()</c> does; a delimiter at the end of the line does not start another token.</p>
+ * <p>In extended mode, any character in the delimiter, escape or quote strings is special, as in
+ * <c>boost::escaped_list_separator</c>: delimiters inside quotes are part of the token, quotes are
+ * removed, and an escape character followed by <c>n</c> stands for a newline, and followed by any
+ * other special character for that character. Only tokens that contain quotes or escapes are
+ * copied (to scratch space owned by the Tokenizer); the others point straight into the line.</p>
+ * <p>The search for the next special character looks at 16 characters at a time with SSE2, where
+ * it is available, when there are at most eight special characters.</p></remarks>
+ */
+class Tokenizer
+{
+public:
+	Tokenizer(void);
+
+	void setSimple(char _delim);
+	void setExtended(const std::string& _delim, const std::string& _esc, const std::string& _quote);
+
+	void split(const char* line, size_t length, std::vector<TokenView>& tokens);
+
+private:
+	const char* findSpecial(const char* p, const char* end) const;
+	void splitExtended(const char* line, size_t length, std::vector<TokenView>& tokens);
+
+	enum CharClass {
+		NORMAL = 0,
+		DELIMITER,
+		ESCAPE,
+		QUOTE
+	};
+
+	bool my_simple;
+	unsigned char my_char_class[256];
+	std::string my_special;     // all of the special characters
+	std::vector<char> my_scratch;  // unescaped tokens in extended mode
+};
+
+/* -----------------------------------------------------------------
+ * TokenTable. The tokens of many lines.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>Keeps the tokens of a buffer of lines, so they can be parsed a column at a time</summary>
+ * <remarks><p>Row <c>r</c> is the tokens of the <c>r</c>th line added, one after the other in a flat
+ * array, with an offset table of where each row starts. Tokens that point into their line are kept as
+ * they are, so the lines must outlive the table. Tokens that the Tokenizer unescaped into its scratch
+ * space, which the next line reuses, are copied into the table.</p>
+ * <p>RecordParser::parseLines() fills one, and hands it to each FieldParser in turn.</p></remarks>
+ */
+class TokenTable
+{
+public:
+	void clear(void);
+	void addRow(const std::vector<TokenView>& tokens, const char* line, size_t length);
+
+	/** <summary>Returns the number of rows</summary> */
+	size_t size(void) const { return my_row_starts.empty() ? 0 : my_row_starts.size() - 1; }
+	/** <summary>Returns the number of tokens of row <c>row</c></summary> */
+	size_t ntokens(size_t row) const { return my_row_starts[row + 1] - my_row_starts[row]; }
+	/** <summary>Returns the first token of row <c>row</c>; the others follow it</summary> */
+	const TokenView* row(size_t row) const { return my_tokens.empty() ? NULL : &my_tokens[0] + my_row_starts[row]; }
+
+private:
+	std::vector<TokenView> my_tokens;
+	std::vector<size_t> my_row_starts;   // index in my_tokens of the first token of each row, and the end
+	std::vector<char> my_copies;         // tokens that did not point into their line
+	std::vector<std::pair<size_t, size_t> > my_copied;  // index in my_tokens and offset in my_copies of each
+};
+
+} // namespace tsdb
@@ -0,0 +1,152 @@
+/* STL includes */
+#include <string>
+#include <vector>
+#include <string.h>
+
+/* TSDB includes */
+#include "tokenset.h"
+
+namespace tsdb {
+
+/* FNV-1a, which can be fed a string a piece at a time */
+#define FNV_OFFSET 2166136261U
+#define FNV_PRIME 16777619U
+
+static inline unsigned int hashBytes(unsigned int hash, const char* data, size_t size) {
+	for(size_t i = 0; i < size; i++) {
+		hash = (hash ^ (unsigned char) data[i]) * FNV_PRIME;
+	}
+	return hash;
+}
+
+/* ====================================================================
+ * class TokenSet - a set of strings to look tokens up in
+ * ====================================================================
+ */
+
+/** <summary>Creates an empty set</summary> */
+TokenSet::TokenSet(void) {
+	rehash(16);
+}
+
+/** <summary>Creates a set of <c>values</c>. Values that are in the list twice are in the set once.</summary> */
+TokenSet::TokenSet(const std::vector<std::string>& values) {
+	rehash(16);
+	for(size_t i = 0; i < values.size(); i++) {
+		add(values[i]);
+	}
+}
+
+/** <summary>Adds <c>value</c> to the set, and returns its index</summary>
+ * <remarks>If the value is in the set already, the index it has is returned. Indexes count from 0 in the
+ * order values are added.</remarks>
+ */
+long TokenSet::add(const std::string& value) {
+	long existing = find(value.data(), value.size());
+	if(existing >= 0) {
+		return existing;
+	}
+
+	my_values.push_back(value);
+	my_hashes.push_back(hashBytes(FNV_OFFSET, value.data(), value.size()));
+	if(my_values.size() * 2 > my_slots.size()) {
+		rehash(my_slots.size() * 2);
+	} else {
+		size_t mask = my_slots.size() - 1;
+		size_t slot = my_hashes.back() & mask;
+		while(my_slots[slot] >= 0) {
+			slot = (slot + 1) & mask;
+		}
+		my_slots[slot] = (long) my_values.size() - 1;
+	}
+	return (long) my_values.size() - 1;
+}
+
+/** <summary>Returns the index of the value equal to <c>size</c> bytes at <c>data</c>, or -1 if there is
+ * none</summary>
+ */
+long TokenSet::find(const char* data, size_t size) const {
+	unsigned int hash = hashBytes(FNV_OFFSET, data, size);
+	size_t mask = my_slots.size() - 1;
+	for(size_t slot = hash & mask; my_slots[slot] >= 0; slot = (slot + 1) & mask) {
+		const std::string& value = my_values[my_slots[slot]];
+		if(my_hashes[my_slots[slot]] == hash && value.size() == size && memcmp(value.data(), data, size) == 0) {
+			return my_slots[slot];
+		}
+	}
+	return -1;
+}
+
+/** <summary>Returns the index of the value equal to the tokens numbered in <c>apply_to_tokens</c>, joined
+ * with spaces, or -1 if there is none</summary>
+ * <remarks>The caller checks that there are enough tokens.</remarks>
+ */
+long TokenSet::find(const std::vector<tsdb::TokenView>& tokens, const std::vector<size_t>& apply_to_tokens) const {
+	if(apply_to_tokens.size() == 1) {
+		const TokenView& token = tokens[apply_to_tokens[0]];
+		return find(token.data, token.size);
+	}
+
+	unsigned int hash = FNV_OFFSET;
+	for(size_t i = 0; i < apply_to_tokens.size(); i++) {
+		if(i > 0) {
+			hash = hashBytes(hash, " ", 1);
+		}
+		const TokenView& token = tokens[apply_to_tokens[i]];
+		hash = hashBytes(hash, token.data, token.size);
+	}
+
+	size_t mask = my_slots.size() - 1;
+	for(size_t slot = hash & mask; my_slots[slot] >= 0; slot = (slot + 1) & mask) {
+		if(my_hashes[my_slots[slot]] == hash && matches(my_slots[slot], tokens, apply_to_tokens)) {
+			return my_slots[slot];
+		}
+	}
+	return -1;
+}
+
+/** <summary>Returns true if value <c>i</c> is equal to the tokens joined with spaces</summary> */
+bool TokenSet::matches(size_t i, const std::vector<tsdb::TokenView>& tokens,
+	const std::vector<size_t>& apply_to_tokens) const {
+	const std::string& value = my_values[i];
+	size_t pos = 0;  // how much of the value has matched
+	for(size_t t = 0; t < apply_to_tokens.size(); t++) {
+		if(t > 0) {
+			if(pos >= value.size() || value[pos] != ' ') {
+				return false;
+			}
+			pos++;
+		}
+		const TokenView& token = tokens[apply_to_tokens[t]];
+		if(value.size() - pos < token.size || memcmp(value.data() + pos, token.data, token.size) != 0) {
+			return false;
+		}
+		pos += token.size;
+	}
+	return pos == value.size();
+}
+
+/** <summary>Returns the number of values in the set</summary> */
+size_t TokenSet::size(void) const {
+	return my_values.size();
+}
+
+/** <summary>Returns the value with index <c>i</c></summary> */
+const std::string& TokenSet::value(size_t i) const {
+	return my_values.at(i);
+}
+
+/** <summary>Rebuilds the hash table with <c>nslots</c> slots, a power of two</summary> */
+void TokenSet::rehash(size_t nslots) {
+	my_slots.assign(nslots, -1);
+	size_t mask = nslots - 1;
+	for(size_t i = 0; i < my_values.size(); i++) {
+		size_t slot = my_hashes[i] & mask;
+		while(my_slots[slot] >= 0) {
+			slot = (slot + 1) & mask;
+		}
+		my_slots[slot] = (long) i;
+	}
+}
+
+} // namespace tsdb
@@ -0,0 +1,50 @@
+#pragma once
+
+/* STL Classes */
+#include <string>
+#include <vector>
+
+#include "tsdb.h"
+#include "tokenizer.h"
+
+namespace tsdb {
+
+/* -----------------------------------------------------------------
+ * TokenSet. A fixed set of strings that tokens are looked up in.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>A set of strings, with a hash table to look tokens up in without copying them</summary>
+ * <remarks><p>The values are hashed once, when they are added, into an open addressing table that is
+ * kept at most half full. find() hashes the token where it is, in the line it came from, and
+ * compares it only to the values with the same hash, so looking a token up in a set of hundreds of
+ * symbols costs about as much as one string compare.</p>
+ * <p>Several tokens are looked up as if they were joined with spaces, as TokenFilter does, but without
+ * joining them.</p>
+ * <p>find() does not change the set, so several threads can look up in the same set once it is
+ * filled in.</p></remarks>
+ */
+class TokenSet
+{
+public:
+	TokenSet(void);
+	TokenSet(const std::vector<std::string>& values);
+
+	long add(const std::string& value);
+	long find(const char* data, size_t size) const;
+	long find(const std::vector<tsdb::TokenView>& tokens, const std::vector<size_t>& apply_to_tokens) const;
+
+	size_t size(void) const;
+	const std::string& value(size_t i) const;
+
+private:
+	void rehash(size_t nslots);
+	bool matches(size_t i, const std::vector<tsdb::TokenView>& tokens,
+		const std::vector<size_t>& apply_to_tokens) const;
+
+	std::vector<std::string> my_values;
+	std::vector<unsigned int> my_hashes;  // hash of each value
+	std::vector<long> my_slots;           // index of a value, or -1; a power of two long
+};
+
+} // namespace tsdb
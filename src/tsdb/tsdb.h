@@ -19,6 +19,75 @@
 	#define INDEX_STEP 65536
 #endif
 
+/* Timestamp lookups bisect the data table until the range left is
+   this many records, then read and scan the range in one go. This
+   matches the chunk size of the data table, since HDF5 decompresses
+   whole chunks anyway. */
+#ifndef SEARCH_WINDOW
+	#define SEARCH_WINDOW 4096
+#endif
+
+/* A BufferedRecordSet reads buffers of this many bytes at first, and
+   doubles the size up to BUFFER_MAX_BYTES while it is being scanned */
+#ifndef BUFFER_BYTES
+	#define BUFFER_BYTES (1 << 20)
+#endif
+
+#ifndef BUFFER_MAX_BYTES
+	#define BUFFER_MAX_BYTES (16 << 20)
+#endif
+
+/* A SegmentIndex predicts the record id of a timestamp to within
+   this many records, and starts a new segment after this many
+   records, which is how many records are added again after the
+   series is reopened */
+#ifndef SEGMENT_MAX_ERROR
+	#define SEGMENT_MAX_ERROR 64
+#endif
+
+#ifndef SEGMENT_MAX_RECORDS
+	#define SEGMENT_MAX_RECORDS (1 << 20)
+#endif
+
+/* Reads of at least this many chunks decompress the chunks outside of
+   the HDF5 lock (see ChunkReader). Smaller reads go through HDF5 and
+   its chunk cache. 0 turns the ChunkReader off. */
+#ifndef DIRECT_READ_CHUNKS
+	#define DIRECT_READ_CHUNKS 2
+#endif
+
+/* The ChunkCache that all Tables share keeps at most this many bytes
+   of decompressed chunks, unless it is given another capacity. While
+   it is on, reads of any size go through the ChunkReader. 0 turns it
+   off. */
+#ifndef CHUNK_CACHE_BYTES
+	#define CHUNK_CACHE_BYTES (64 << 20)
+#endif
+
+/* Batches of at least this many records are sorted on several
+   threads (see RecordSort) */
+#ifndef PARALLEL_SORT_GE
+	#define PARALLEL_SORT_GE 262144
+#endif
+
+/* A MemoryPool keeps at most this many bytes of released blocks for
+   reuse, unless it is given another capacity */
+#ifndef POOL_CAPACITY_BYTES
+	#define POOL_CAPACITY_BYTES (256 << 20)
+#endif
+
+/* A RecordFormatter writes its text output in blocks of this many
+   bytes */
+#ifndef FORMAT_BUFFER_BYTES
+	#define FORMAT_BUFFER_BYTES (4 << 20)
+#endif
+
+/* A SeriesCache keeps at most this many Timeseries open, unless it
+   is given another capacity */
+#ifndef SERIES_CACHE_ENTRIES
+	#define SERIES_CACHE_ENTRIES 256
+#endif
+
 
 
 /* -----------------------------------------------------------------
@@ -0,0 +1,330 @@
+#pragma once
+
+/* STL Classes */
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <string.h>
+
+/* External Libraries */
+#include "hdf5.h"
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/tuple/tuple.hpp>
+
+/* TSDB Includes */
+#include "tsdb.h"
+#include "field.h"
+#include "structure.h"
+#include "storageoptions.h"
+#include "timeseries.h"
+#include "bufferedrecordset.h"
+
+namespace tsdb {
+
+/* -----------------------------------------------------------------
+ * TypedSeriesException. For runtime errors thrown by a TypedSeries.
+ * -----------------------------------------------------------------
+ */
+class  TypedSeriesException:
+	public std::runtime_error
+{
+public:
+	TypedSeriesException(const std::string& what):
+	  std::runtime_error(std::string("TypedSeriesException: ") + what) {}
+};
+
+namespace typed {
+
+/* -----------------------------------------------------------------
+ * Field tags. Each one stands for a Field type, and gives the C type
+ * of its values.
+ * -----------------------------------------------------------------
+ */
+struct Timestamp {
+	typedef tsdb::timestamp_t value_type;
+	static tsdb::Field::FieldType fieldType(void) { return tsdb::Field::TIMESTAMP; }
+	static tsdb::Field* makeField(const std::string& name) { return new tsdb::TimestampField(name); }
+};
+
+struct Date {
+	typedef tsdb::date_t value_type;
+	static tsdb::Field::FieldType fieldType(void) { return tsdb::Field::DATE; }
+	static tsdb::Field* makeField(const std::string& name) { return new tsdb::DateField(name); }
+};
+
+struct Record {
+	typedef tsdb::record_t value_type;
+	static tsdb::Field::FieldType fieldType(void) { return tsdb::Field::RECORD; }
+	static tsdb::Field* makeField(const std::string& name) { return new tsdb::RecordField(name); }
+};
+
+struct Int32 {
+	typedef tsdb::int32_t value_type;
+	static tsdb::Field::FieldType fieldType(void) { return tsdb::Field::INT32; }
+	static tsdb::Field* makeField(const std::string& name) { return new tsdb::Int32Field(name); }
+};
+
+struct Int8 {
+	typedef tsdb::int8_t value_type;
+	static tsdb::Field::FieldType fieldType(void) { return tsdb::Field::INT8; }
+	static tsdb::Field* makeField(const std::string& name) { return new tsdb::Int8Field(name); }
+};
+
+struct Double {
+	typedef tsdb::ieee64_t value_type;
+	static tsdb::Field::FieldType fieldType(void) { return tsdb::Field::DOUBLE; }
+	static tsdb::Field* makeField(const std::string& name) { return new tsdb::DoubleField(name); }
+};
+
+struct Char {
+	typedef tsdb::char_t value_type;
+	static tsdb::Field::FieldType fieldType(void) { return tsdb::Field::CHAR; }
+	static tsdb::Field* makeField(const std::string& name) { return new tsdb::CharField(name); }
+};
+
+/* The value type of a tag, with null_type for the unused tags of a TypedSeries */
+template <class Tag> struct ValueOf {
+	typedef typename Tag::value_type type;
+};
+
+template <> struct ValueOf<boost::tuples::null_type> {
+	typedef boost::tuples::null_type type;
+};
+
+/* Walks a boost::tuples::cons list of tags at compile time */
+template <class TagCons> struct TagList {
+	typedef typename TagCons::head_type head_type;
+	typedef typename TagCons::tail_type tail_type;
+
+	static void fieldTypes(std::vector<tsdb::Field::FieldType>& types, std::vector<size_t>& sizes) {
+		types.push_back(head_type::fieldType());
+		sizes.push_back(sizeof(typename head_type::value_type));
+		TagList<tail_type>::fieldTypes(types, sizes);
+	}
+
+	static void makeFields(const std::string* names, std::vector<tsdb::Field*>& fields) {
+		fields.push_back(head_type::makeField(*names));
+		TagList<tail_type>::makeFields(names + 1, fields);
+	}
+};
+
+template <> struct TagList<boost::tuples::null_type> {
+	static void fieldTypes(std::vector<tsdb::Field::FieldType>&, std::vector<size_t>&) {}
+	static void makeFields(const std::string*, std::vector<tsdb::Field*>&) {}
+};
+
+/* Copies the fields of a record to and from a row, one memcpy of a known size per field */
+template <class RowCons> struct RowCodec {
+	typedef typename RowCons::head_type head_type;
+	typedef typename RowCons::tail_type tail_type;
+
+	static void unpack(const char* record, const size_t* offsets, RowCons& row) {
+		memcpy(&row.head, record + offsets[0], sizeof(head_type));
+		RowCodec<tail_type>::unpack(record, offsets + 1, row.get_tail());
+	}
+
+	static void pack(const RowCons& row, const size_t* offsets, char* record) {
+		memcpy(record + offsets[0], &row.head, sizeof(head_type));
+		RowCodec<tail_type>::pack(row.get_tail(), offsets + 1, record);
+	}
+};
+
+template <> struct RowCodec<boost::tuples::null_type> {
+	static void unpack(const char*, const size_t*, boost::tuples::null_type) {}
+	static void pack(boost::tuples::null_type, const size_t*, char*) {}
+};
+
+} // namespace typed
+
+/* -----------------------------------------------------------------
+ * TypedSeries. A Timeseries whose fields are known at compile time.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>Reads and writes a Timeseries as rows of C++ types, for fields that are known at compile time</summary>
+ * <remarks><p>The template arguments are the tags of the fields in order, starting with
+ * typed::Timestamp for _TSDB_timestamp, for example
+ * <c>TypedSeries&lt;typed::Timestamp, typed::Double, typed::Int32, typed::Int8&gt;</c> (up to ten fields).
+ * Opening the Timeseries checks that its Structure has exactly these fields, and throws a
+ * TypedSeriesException if it does not.</p>
+ * <p>A row is a <c>boost::tuple</c> of the value types of the fields, so its members are naturally aligned,
+ * unlike the packed records of the Structure, and <c>boost::get&lt;K&gt;(row)</c> is a plain member
+ * access. read() and readColumn() convert whole buffers of records: each field is copied with a memcpy
+ * of a size known at compile time, with no Cell and no switch on the field type.</p></remarks>
+ */
+template <class T0, class T1 = boost::tuples::null_type, class T2 = boost::tuples::null_type,
+	class T3 = boost::tuples::null_type, class T4 = boost::tuples::null_type, class T5 = boost::tuples::null_type,
+	class T6 = boost::tuples::null_type, class T7 = boost::tuples::null_type, class T8 = boost::tuples::null_type,
+	class T9 = boost::tuples::null_type>
+class TypedSeries
+{
+public:
+	typedef boost::tuple<T0, T1, T2, T3, T4, T5, T6, T7, T8, T9> tag_list;
+	typedef boost::tuple<typename typed::ValueOf<T0>::type, typename typed::ValueOf<T1>::type,
+		typename typed::ValueOf<T2>::type, typename typed::ValueOf<T3>::type, typename typed::ValueOf<T4>::type,
+		typename typed::ValueOf<T5>::type, typename typed::ValueOf<T6>::type, typename typed::ValueOf<T7>::type,
+		typename typed::ValueOf<T8>::type, typename typed::ValueOf<T9>::type> row_type;
+
+	/** <summary>The value type of field <c>K</c></summary> */
+	template <int K> struct value {
+		typedef typename boost::tuples::element<K, row_type>::type type;
+	};
+
+	/** <summary>Uses an open Timeseries. Throws a TypedSeriesException if its fields do not match.</summary> */
+	TypedSeries(const boost::shared_ptr<tsdb::Timeseries>& _timeseries): my_timeseries(_timeseries) {
+		bind();
+	}
+
+	/** <summary>Opens the Timeseries <c>_name</c>. Throws a TypedSeriesException if its fields do not match.</summary> */
+	TypedSeries(hid_t _loc_id, const std::string& _name) {
+		my_timeseries = boost::make_shared<tsdb::Timeseries>(_loc_id, _name);
+		bind();
+	}
+
+	/** <summary>Creates a Timeseries with the fields of the TypedSeries</summary>
+	 * <param name="_field_names">Names of the fields after _TSDB_timestamp, one per tag after the first</param>
+	 */
+	static TypedSeries create(hid_t _loc_id, const std::string& _name, const std::string& _title,
+		const std::vector<std::string>& _field_names, const tsdb::StorageOptions& _options = tsdb::StorageOptions()) {
+
+		std::vector<tsdb::Field::FieldType> types;
+		std::vector<size_t> sizes;
+		typed::TagList<typename tag_list::inherited>::fieldTypes(types, sizes);
+		if(types.empty() || types[0] != tsdb::Field::TIMESTAMP) {
+			throw( TypedSeriesException("the first field must be typed::Timestamp") );
+		}
+		if(_field_names.size() + 1 != types.size()) {
+			throw( TypedSeriesException("there must be a name for each field after the timestamp") );
+		}
+
+		// The Timeseries adds _TSDB_timestamp itself
+		std::vector<std::string> names(1, "_TSDB_timestamp");
+		names.insert(names.end(), _field_names.begin(), _field_names.end());
+		std::vector<tsdb::Field*> fields;
+		typed::TagList<typename tag_list::inherited>::makeFields(&names[0], fields);
+		delete fields[0];
+		fields.erase(fields.begin());
+
+		return TypedSeries(boost::make_shared<tsdb::Timeseries>(_loc_id, _name, _title, fields, _options));
+	}
+
+	/** <summary>Returns the Timeseries</summary> */
+	const boost::shared_ptr<tsdb::Timeseries>& timeseries(void) const {
+		return my_timeseries;
+	}
+
+	/** <summary>Returns the number of records</summary> */
+	hsize_t size(void) {
+		return my_timeseries->getNRecords();
+	}
+
+	/** <summary>Reads records <c>first</c> to <c>last</c> into <c>rows</c>, which is replaced</summary> */
+	void read(hsize_t first, hsize_t last, std::vector<row_type>& rows) {
+		rows.clear();
+		if(last < first || last >= my_timeseries->getNRecords()) {
+			return;
+		}
+		readBuffers(my_timeseries->bufferedRecordSet(first, last), rows);
+	}
+
+	/** <summary>Reads the records from <c>start</c> to <c>end</c> (inclusive) into <c>rows</c>, which is replaced</summary> */
+	void read(tsdb::timestamp_t start, tsdb::timestamp_t end, std::vector<row_type>& rows) {
+		rows.clear();
+		readBuffers(my_timeseries->bufferedRecordSet(start, end), rows);
+	}
+
+	/** <summary>Reads field <c>K</c> of the records from <c>start</c> to <c>end</c> (inclusive) into <c>values</c></summary> */
+	template <int K> void readColumn(tsdb::timestamp_t start, tsdb::timestamp_t end,
+		std::vector<typename value<K>::type>& values) {
+
+		typedef typename value<K>::type value_type;
+		values.clear();
+
+		tsdb::BufferedRecordSet records = my_timeseries->bufferedRecordSet(start, end);
+		values.resize((size_t) records.size());
+		size_t offset = my_offsets[K];
+		for(hsize_t i = 0; i < records.size(); ) {
+			hsize_t buf_first;
+			size_t nbufrecords;
+			const char* buffer = records.buffer(i, &buf_first, &nbufrecords);
+			size_t skip = (size_t) (i - buf_first);
+			const char* src = buffer + skip * my_record_size + offset;
+			value_type* dst = &values[(size_t) i];
+			for(size_t j = skip; j < nbufrecords; j++) {
+				memcpy(dst++, src, sizeof(value_type));
+				src += my_record_size;
+			}
+			i = buf_first + nbufrecords;
+		}
+	}
+
+	/** <summary>Appends rows, which must be in order and at or after the last record</summary>
+	 * <remarks>Throws a TimeseriesException if they are not.</remarks>
+	 */
+	void append(const std::vector<row_type>& rows) {
+		if(rows.empty()) {
+			return;
+		}
+		std::vector<char> records(rows.size() * my_record_size);
+		pack(&rows[0], rows.size(), &records[0]);
+		my_timeseries->appendRecords(rows.size(), &records[0], false);
+	}
+
+	/** <summary>Converts records, laid out as in the Structure of the Timeseries, to rows</summary> */
+	void unpack(const char* records, size_t nrecords, row_type* rows) const {
+		for(size_t i = 0; i < nrecords; i++) {
+			typed::RowCodec<typename row_type::inherited>::unpack(records + i * my_record_size, &my_offsets[0], rows[i]);
+		}
+	}
+
+	/** <summary>Converts rows to records, laid out as in the Structure of the Timeseries</summary> */
+	void pack(const row_type* rows, size_t nrecords, char* records) const {
+		for(size_t i = 0; i < nrecords; i++) {
+			typed::RowCodec<typename row_type::inherited>::pack(rows[i], &my_offsets[0], records + i * my_record_size);
+		}
+	}
+
+private:
+	/** <summary>Checks that the Structure of the Timeseries has the fields of the tags, and keeps their offsets</summary> */
+	void bind(void) {
+		std::vector<tsdb::Field::FieldType> types;
+		std::vector<size_t> sizes;
+		typed::TagList<typename tag_list::inherited>::fieldTypes(types, sizes);
+
+		my_structure = my_timeseries->structure();
+		if(my_structure->getNFields() != types.size()) {
+			throw( TypedSeriesException("the timeseries does not have the number of fields of the TypedSeries") );
+		}
+
+		my_offsets.clear();
+		for(size_t i = 0; i < types.size(); i++) {
+			tsdb::Field* field = my_structure->getField(i);
+			if(field->getFieldType() != types[i] || field->getSizeOf() != sizes[i]) {
+				throw( TypedSeriesException("field '" + field->getName() + "' of the timeseries does not have the type of the TypedSeries") );
+			}
+			my_offsets.push_back(my_structure->getOffsetOfField(i));
+		}
+		my_record_size = my_structure->getSizeOf();
+	}
+
+	/** <summary>Appends the records of <c>records</c>, a buffer at a time, to <c>rows</c></summary> */
+	void readBuffers(tsdb::BufferedRecordSet records, std::vector<row_type>& rows) {
+		rows.resize((size_t) records.size());
+		for(hsize_t i = 0; i < records.size(); ) {
+			hsize_t buf_first;
+			size_t nbufrecords;
+			const char* buffer = records.buffer(i, &buf_first, &nbufrecords);
+			size_t skip = (size_t) (i - buf_first);
+			unpack(buffer + skip * my_record_size, nbufrecords - skip, &rows[(size_t) i]);
+			i = buf_first + nbufrecords;
+		}
+	}
+
+	boost::shared_ptr<tsdb::Timeseries> my_timeseries;
+	boost::shared_ptr<tsdb::Structure> my_structure;
+	std::vector<size_t> my_offsets;   // offset of each field in a record
+	size_t my_record_size;
+};
+
+} // namespace tsdb
@@ -0,0 +1,356 @@
+/* STL includes */
+#include <string>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+#include <boost/make_shared.hpp>
+
+/* TSDB includes */
+#include "zonemap.h"
+
+namespace tsdb {
+
+/* ====================================================================
+ * struct ZoneStats - summary statistics of one field
+ * ====================================================================
+ */
+
+ZoneStats::ZoneStats(void): min(std::numeric_limits<tsdb::ieee64_t>::quiet_NaN()),
+	max(std::numeric_limits<tsdb::ieee64_t>::quiet_NaN()), sum(0), count(0), nans(0) {}
+
+/** <summary>Adds the statistics of other records to these</summary> */
+void ZoneStats::merge(const ZoneStats& other) {
+	if(other.count > 0) {
+		min = (count == 0 || other.min < min) ? other.min : min;
+		max = (count == 0 || other.max > max) ? other.max : max;
+	}
+	sum += other.sum;
+	count += other.count;
+	nans += other.nans;
+}
+
+/** <summary>Returns the mean of the values that are not missing, or NaN if there are none</summary> */
+tsdb::ieee64_t ZoneStats::mean(void) const {
+	return (count > 0) ? sum / count : std::numeric_limits<tsdb::ieee64_t>::quiet_NaN();
+}
+
+/** <summary>Computes the statistics of a column with the ColumnKernels</summary> */
+ZoneStats ZoneStats::fromColumn(const tsdb::StridedColumn& column) {
+	ZoneStats stats;
+	size_t count = 0;
+
+	stats.sum = ColumnKernels::sum(column, &count);
+	ColumnKernels::minMax(column, &stats.min, &stats.max);
+	stats.count = count;
+	stats.nans = column.size - count;
+	return stats;
+}
+
+/* ====================================================================
+ * class ZoneMap - per-block statistics of a Timeseries
+ * ====================================================================
+ */
+
+namespace {
+
+/* The columns of a zone map row before the statistics, and the columns per field */
+const size_t FIXED_COLUMNS = 4;
+const size_t COLUMNS_PER_FIELD = 5;
+
+bool isZoneType(tsdb::Field::FieldType type) {
+	switch(type) {
+		case tsdb::Field::DOUBLE:
+		case tsdb::Field::INT32:
+		case tsdb::Field::INT8:
+		case tsdb::Field::TIMESTAMP:
+		case tsdb::Field::DATE:
+			return true;
+		default:
+			return false;
+	}
+}
+
+} // namespace
+
+/** <summary>Creates an empty zone map for a Timeseries</summary>
+ * <param name="_loc_id">The HDF5 group of the Timeseries</param>
+ * <param name="_data_structure">Structure of the records of the Timeseries</param>
+ * <param name="_options">Storage options for the zone map table</param>
+ */
+ZoneMap::ZoneMap(hid_t _loc_id, const boost::shared_ptr<tsdb::Structure>& _data_structure,
+	const tsdb::StorageOptions& _options): my_data_structure(_data_structure) {
+
+	makeRowStructure();
+	my_table = boost::make_shared<tsdb::Table>(_loc_id, "_TSDB_zonemap", "TSDB: Zone Map", my_row_structure, _options);
+	my_open_first_id = 0;
+	my_open_nrecords = 0;
+	my_open_stats.resize(my_zone_fields.size());
+}
+
+/** <summary>Opens the zone map of a Timeseries, and loads it into memory</summary>
+ * <remarks>Throws a ZoneMapException if the zone map does not match the fields of the Timeseries.</remarks>
+ * <param name="_loc_id">The HDF5 group of the Timeseries</param>
+ * <param name="_data_structure">Structure of the records of the Timeseries</param>
+ */
+ZoneMap::ZoneMap(hid_t _loc_id, const boost::shared_ptr<tsdb::Structure>& _data_structure):
+	my_data_structure(_data_structure) {
+
+	makeRowStructure();
+	my_table = boost::make_shared<tsdb::Table>(_loc_id, "_TSDB_zonemap");
+
+	// Read the rows with the layout of the file, after checking that it has the expected columns
+	boost::shared_ptr<tsdb::Structure> saved = my_table->structure();
+	if(saved->getNFields() != my_row_structure->getNFields()) {
+		throw( ZoneMapException("the zone map does not match the fields of the timeseries") );
+	}
+	for(size_t i = 0; i < saved->getNFields(); i++) {
+		if(saved->getField(i)->getName() != my_row_structure->getField(i)->getName()) {
+			throw( ZoneMapException("the zone map does not match the fields of the timeseries") );
+		}
+	}
+	my_row_structure = saved;
+
+	loadBlocks();
+	my_open_first_id = my_first_ids.empty() ? 0 : my_first_ids.back() + my_nrecords.back();
+	my_open_nrecords = 0;
+	my_open_stats.resize(my_zone_fields.size());
+}
+
+/** <summary>Adds records to the open block</summary>
+ * <remarks>The records must be the ones right after the records added so far, starting at record
+ * nextRecordId() of the Timeseries.</remarks>
+ * <param name="records">The records, laid out as in the Structure of the Timeseries</param>
+ * <param name="nrecords">Number of records</param>
+ */
+void ZoneMap::addRecords(const char* records, size_t nrecords) {
+	if(nrecords == 0) {
+		return;
+	}
+
+	if(my_open_nrecords == 0) {
+		memcpy(&my_open_first_ts, records, sizeof(my_open_first_ts));
+	}
+	memcpy(&my_open_last_ts, records + (nrecords - 1) * my_data_structure->getSizeOf(), sizeof(my_open_last_ts));
+
+	for(size_t i = 0; i < my_zone_fields.size(); i++) {
+		my_open_stats[i].merge(ZoneStats::fromColumn(tsdb::StridedColumn(records, nrecords, *my_data_structure, my_zone_fields[i])));
+	}
+	my_open_nrecords += nrecords;
+}
+
+/** <summary>Saves the open block as the next block, and starts a new one after it</summary>
+ * <remarks>Throws a ZoneMapException if the open block has no records.</remarks>
+ */
+void ZoneMap::closeBlock(void) {
+	if(my_open_nrecords == 0) {
+		throw( ZoneMapException("a block can not be empty") );
+	}
+
+	std::vector<char> row(my_row_structure->getSizeOf(), 0);
+	my_row_structure->setMember(&row[0], 0, &my_open_first_ts);
+	my_row_structure->setMember(&row[0], 1, &my_open_last_ts);
+	my_row_structure->setMember(&row[0], 2, &my_open_first_id);
+	my_row_structure->setMember(&row[0], 3, &my_open_nrecords);
+
+	for(size_t i = 0; i < my_zone_fields.size(); i++) {
+		size_t column = FIXED_COLUMNS + i * COLUMNS_PER_FIELD;
+		my_row_structure->setMember(&row[0], column, &my_open_stats[i].min);
+		my_row_structure->setMember(&row[0], column + 1, &my_open_stats[i].max);
+		my_row_structure->setMember(&row[0], column + 2, &my_open_stats[i].sum);
+		my_row_structure->setMember(&row[0], column + 3, &my_open_stats[i].count);
+		my_row_structure->setMember(&row[0], column + 4, &my_open_stats[i].nans);
+	}
+
+	my_table->appendRecords(1, &row[0]);
+
+	my_first_ids.push_back(my_open_first_id);
+	my_nrecords.push_back(my_open_nrecords);
+	my_first_ts.push_back(my_open_first_ts);
+	my_last_ts.push_back(my_open_last_ts);
+	my_stats.insert(my_stats.end(), my_open_stats.begin(), my_open_stats.end());
+
+	my_open_first_id += my_open_nrecords;
+	my_open_nrecords = 0;
+	my_open_stats.assign(my_zone_fields.size(), tsdb::ZoneStats());
+}
+
+/** <summary>Returns the record id of the next record that addRecords() expects</summary> */
+hsize_t ZoneMap::nextRecordId(void) const {
+	return my_open_first_id + my_open_nrecords;
+}
+
+/** <summary>Keeps only the first <c>nblocks</c> blocks, and discards the open block</summary>
+ * <remarks>This is used when the records after the kept blocks are rewritten. The next addRecords() starts
+ * right after the last kept block.</remarks>
+ * <param name="nblocks">The number of blocks to keep. If it is not less than size(), only the open block
+ * is discarded.</param>
+ */
+void ZoneMap::truncate(size_t nblocks) {
+	if(nblocks < my_first_ids.size()) {
+		my_table->truncate(nblocks);
+		my_first_ids.resize(nblocks);
+		my_nrecords.resize(nblocks);
+		my_first_ts.resize(nblocks);
+		my_last_ts.resize(nblocks);
+		my_stats.resize(nblocks * my_zone_fields.size());
+	}
+
+	my_open_first_id = my_first_ids.empty() ? 0 : my_first_ids.back() + my_nrecords.back();
+	my_open_nrecords = 0;
+	my_open_stats.assign(my_zone_fields.size(), tsdb::ZoneStats());
+}
+
+/** <summary>Writes the saved blocks out to the file, for SWMR readers</summary> */
+void ZoneMap::flush(void) {
+	my_table->flush();
+}
+
+/** <summary>Loads the blocks saved since the ZoneMap was opened, or last refreshed</summary>
+ * <remarks>For a reader of a series that another writer appends to. The open block is discarded.</remarks>
+ */
+void ZoneMap::refresh(void) {
+	my_table->refresh();
+	loadBlocks();
+	truncate(my_first_ids.size());
+}
+
+/** <summary>Returns the number of blocks</summary> */
+size_t ZoneMap::size(void) const {
+	return my_first_ids.size();
+}
+
+/** <summary>Returns the record id of the first record of a block</summary> */
+hsize_t ZoneMap::firstRecordId(size_t block) const {
+	return my_first_ids.at(block);
+}
+
+/** <summary>Returns the number of records in a block</summary> */
+hsize_t ZoneMap::nrecords(size_t block) const {
+	return my_nrecords.at(block);
+}
+
+/** <summary>Returns the timestamp of the first record of a block</summary> */
+tsdb::timestamp_t ZoneMap::firstTimestamp(size_t block) const {
+	return my_first_ts.at(block);
+}
+
+/** <summary>Returns the timestamp of the last record of a block</summary> */
+tsdb::timestamp_t ZoneMap::lastTimestamp(size_t block) const {
+	return my_last_ts.at(block);
+}
+
+/** <summary>Returns the first block that starts at or after <c>record_id</c>, or size() if there is none</summary> */
+size_t ZoneMap::blockAtOrAfter(hsize_t record_id) const {
+	return std::lower_bound(my_first_ids.begin(), my_first_ids.end(), record_id) - my_first_ids.begin();
+}
+
+/** <summary>Returns true if the zone map has statistics of field <c>ifield</c> of the Timeseries</summary> */
+bool ZoneMap::hasField(size_t ifield) const {
+	return ifield < my_zone_of_field.size() && my_zone_of_field[ifield] >= 0;
+}
+
+/** <summary>Returns the statistics of field <c>ifield</c> of the Timeseries in a block</summary>
+ * <remarks>Throws a ZoneMapException if the zone map does not keep statistics of the field.</remarks>
+ */
+const tsdb::ZoneStats& ZoneMap::stats(size_t block, size_t ifield) const {
+	if(!hasField(ifield)) {
+		throw( ZoneMapException("no statistics for field '" + my_data_structure->getField(ifield)->getName() + "'") );
+	}
+	return my_stats.at(block * my_zone_fields.size() + my_zone_of_field[ifield]);
+}
+
+/** <summary>Returns false if no value of field <c>ifield</c> in the block can be from <c>lo</c> to <c>hi</c></summary>
+ * <remarks>A scan with a predicate such as <c>price &gt; x</c> can skip the blocks for which this is false.
+ * It is always true for a field without statistics.</remarks>
+ */
+bool ZoneMap::mayContain(size_t block, size_t ifield, tsdb::ieee64_t lo, tsdb::ieee64_t hi) const {
+	if(!hasField(ifield)) {
+		return true;
+	}
+	const tsdb::ZoneStats& zone = stats(block, ifield);
+	return zone.count > 0 && zone.max >= lo && zone.min <= hi;
+}
+
+/** <summary>Checks if there is a zone map in the group of a Timeseries</summary> */
+bool ZoneMap::exists(hid_t loc_id) {
+	return tsdb::Table::exists(loc_id, "_TSDB_zonemap");
+}
+
+/** <summary>Returns true if the records have a field that a zone map keeps statistics of</summary> */
+bool ZoneMap::hasZoneFields(tsdb::Structure& _data_structure) {
+	for(size_t i = 1; i < _data_structure.getNFields(); i++) {
+		if(isZoneType(_data_structure.getField(i)->getFieldType())) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void ZoneMap::makeRowStructure(void) {
+	std::vector<Field*> fields;
+	fields.push_back(new TimestampField("_TSDB_timestamp"));
+	fields.push_back(new TimestampField("last_timestamp"));
+	fields.push_back(new RecordField("record_id"));
+	fields.push_back(new RecordField("nrecords"));
+
+	my_zone_of_field.assign(my_data_structure->getNFields(), -1);
+	for(size_t i = 1; i < my_data_structure->getNFields(); i++) {
+		if(!isZoneType(my_data_structure->getField(i)->getFieldType())) {
+			continue;
+		}
+		std::string name = my_data_structure->getField(i)->getName();
+		my_zone_of_field[i] = (int) my_zone_fields.size();
+		my_zone_fields.push_back(i);
+		fields.push_back(new DoubleField("min_" + name));
+		fields.push_back(new DoubleField("max_" + name));
+		fields.push_back(new DoubleField("sum_" + name));
+		fields.push_back(new RecordField("count_" + name));
+		fields.push_back(new RecordField("nan_" + name));
+	}
+
+	my_row_structure = boost::make_shared<tsdb::Structure>(fields, true);
+}
+
+/* Loads the blocks of the table after the ones already loaded */
+void ZoneMap::loadBlocks(void) {
+	hsize_t first = my_first_ids.size();
+	hsize_t nblocks = my_table->size();
+	if(nblocks <= first) {
+		return;
+	}
+
+	void* rows = NULL;
+	my_table->getRecords(first, nblocks - 1, &rows);
+
+	for(hsize_t b = 0; b < nblocks - first; b++) {
+		const char* row = (const char*) rows + b * my_row_structure->getSizeOf();
+		tsdb::timestamp_t ts;
+		hsize_t id;
+
+		memcpy(&ts, row + my_row_structure->getOffsetOfField(0), sizeof(ts));
+		my_first_ts.push_back(ts);
+		memcpy(&ts, row + my_row_structure->getOffsetOfField(1), sizeof(ts));
+		my_last_ts.push_back(ts);
+		memcpy(&id, row + my_row_structure->getOffsetOfField(2), sizeof(id));
+		my_first_ids.push_back(id);
+		memcpy(&id, row + my_row_structure->getOffsetOfField(3), sizeof(id));
+		my_nrecords.push_back(id);
+
+		for(size_t i = 0; i < my_zone_fields.size(); i++) {
+			size_t column = FIXED_COLUMNS + i * COLUMNS_PER_FIELD;
+			tsdb::ZoneStats stats;
+			memcpy(&stats.min, row + my_row_structure->getOffsetOfField(column), sizeof(stats.min));
+			memcpy(&stats.max, row + my_row_structure->getOffsetOfField(column + 1), sizeof(stats.max));
+			memcpy(&stats.sum, row + my_row_structure->getOffsetOfField(column + 2), sizeof(stats.sum));
+			memcpy(&stats.count, row + my_row_structure->getOffsetOfField(column + 3), sizeof(stats.count));
+			memcpy(&stats.nans, row + my_row_structure->getOffsetOfField(column + 4), sizeof(stats.nans));
+			my_stats.push_back(stats);
+		}
+	}
+
+	free(rows);
+}
+
+} // namespace tsdb
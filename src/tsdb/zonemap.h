@@ -0,0 +1,131 @@
+#pragma once
+
+/* STL Classes */
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+/* External Libraries */
+#include "hdf5.h"
+#include <boost/shared_ptr.hpp>
+
+/* TSDB Includes */
+#include "tsdb.h"
+#include "field.h"
+#include "structure.h"
+#include "table.h"
+#include "storageoptions.h"
+#include "columnkernels.h"
+
+namespace tsdb {
+
+/* -----------------------------------------------------------------
+ * ZoneMapException. For runtime errors thrown by the ZoneMap class.
+ * -----------------------------------------------------------------
+ */
+class  ZoneMapException:
+	public std::runtime_error
+{
+public:
+	ZoneMapException(const std::string& what):
+	  std::runtime_error(std::string("ZoneMapException: ") + what) {}
+};
+
+/* -----------------------------------------------------------------
+ * ZoneStats. Summary statistics of one field over some records.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>The minimum, maximum, sum and counts of one numeric field over a range of records</summary>
+ * <remarks>A NaN in a DOUBLE field is a missing value, as in the ColumnKernels: it is counted in
+ * <c>nans</c>, and not in <c>count</c>, <c>sum</c> or the extremes. <c>min</c> and <c>max</c> are NaN
+ * when <c>count</c> is 0.</remarks>
+ */
+struct ZoneStats
+{
+	ZoneStats(void);
+
+	void merge(const ZoneStats& other);
+	tsdb::ieee64_t mean(void) const;
+
+	static ZoneStats fromColumn(const tsdb::StridedColumn& column);
+
+	tsdb::ieee64_t min;
+	tsdb::ieee64_t max;
+	tsdb::ieee64_t sum;
+	hsize_t count;   // values that are not missing
+	hsize_t nans;    // values that are missing
+};
+
+/* -----------------------------------------------------------------
+ * ZoneMap. Per-block statistics of a Timeseries.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>Keeps ZoneStats of every numeric field for each block between two index points</summary>
+ * <remarks><p>A Timeseries with an index splits its data table into blocks at the index points: block 0
+ * is the records before the first index point, and block <c>k</c> goes from index point <c>k - 1</c>
+ * up to index point <c>k</c>. Because index points are on the first record of a timestamp, a
+ * timestamp is never split across blocks. The records after the last index point are not a block
+ * yet: addRecords() only adds them to the open block, which closeBlock() saves once the next index point
+ * is known. The open block is not saved, so after a Timeseries is reopened its records are added again.</p>
+ * <p>The ZoneMap is saved as a Table called "_TSDB_zonemap" in the group of the Timeseries, with one
+ * row per block, and is loaded into memory when it is opened. Each row has the first and last timestamp,
+ * the first record id and the number of records of the block, followed by <c>min_</c>, <c>max_</c>,
+ * <c>sum_</c>, <c>count_</c> and <c>nan_</c> columns for every numeric field after _TSDB_timestamp.</p>
+ * <p>Queries use it to answer the blocks that a range covers completely without reading them, and
+ * scans can use mayContain() to skip blocks that can not match a predicate.</p></remarks>
+ */
+class ZoneMap
+{
+public:
+	ZoneMap(hid_t _loc_id, const boost::shared_ptr<tsdb::Structure>& _data_structure,
+		const tsdb::StorageOptions& _options);
+	ZoneMap(hid_t _loc_id, const boost::shared_ptr<tsdb::Structure>& _data_structure);
+
+	void addRecords(const char* records, size_t nrecords);
+	void closeBlock(void);
+	hsize_t nextRecordId(void) const;
+	void truncate(size_t nblocks);
+	void flush(void);
+	void refresh(void);
+
+	size_t size(void) const;
+	hsize_t firstRecordId(size_t block) const;
+	hsize_t nrecords(size_t block) const;
+	tsdb::timestamp_t firstTimestamp(size_t block) const;
+	tsdb::timestamp_t lastTimestamp(size_t block) const;
+	size_t blockAtOrAfter(hsize_t record_id) const;
+
+	bool hasField(size_t ifield) const;
+	const tsdb::ZoneStats& stats(size_t block, size_t ifield) const;
+	bool mayContain(size_t block, size_t ifield, tsdb::ieee64_t lo, tsdb::ieee64_t hi) const;
+
+	static bool exists(hid_t loc_id);
+	static bool hasZoneFields(tsdb::Structure& _data_structure);
+
+private:
+	void makeRowStructure(void);
+	void loadBlocks(void);
+
+	boost::shared_ptr<tsdb::Structure> my_data_structure;
+	boost::shared_ptr<tsdb::Structure> my_row_structure;
+	boost::shared_ptr<tsdb::Table> my_table;
+	std::vector<size_t> my_zone_fields;     // index in the data of each field with statistics
+	std::vector<int> my_zone_of_field;      // index in my_zone_fields of each data field, or -1
+
+	std::vector<hsize_t> my_first_ids;
+	std::vector<hsize_t> my_nrecords;
+	std::vector<tsdb::timestamp_t> my_first_ts;
+	std::vector<tsdb::timestamp_t> my_last_ts;
+	std::vector<tsdb::ZoneStats> my_stats;  // my_zone_fields.size() per block
+
+	/* The open block, which the next addRecords() continues */
+	hsize_t my_open_first_id;
+	hsize_t my_open_nrecords;
+	tsdb::timestamp_t my_open_first_ts;
+	tsdb::timestamp_t my_open_last_ts;
+	std::vector<tsdb::ZoneStats> my_open_stats;
+};
+
+} // namespace tsdb
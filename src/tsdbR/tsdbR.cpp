@@ -35,6 +35,8 @@ by the HDF5 library. </remarks>
 */
 SEXP TSDBclose() {
 try {
+	tsdb::SeriesCache::global().clear();
+	tsdb::ChunkCache::global().clear();
 	H5close();
 	return Rcpp::wrap(1);
 }
@@ -94,7 +96,8 @@ flushing all data to storage and terminating access to the file through file_id.
 If this is the last file identifier open for the file and no other access
 identifier is open (e.g., a dataset identifier, group identifier, or
 shared datatype identifier), the file will be fully closed and access
-will end. </remarks>
+will end. The timeseries of the file that earlier calls opened, and that are
+cached for the next calls, are closed first. </remarks>
 <param name="groupID">Integer argument for the HDF5 file identifier (group ID).</param>
 <returns> Returns a non-negative value if successful; otherwise
 returns a negative value. </returns>
@@ -107,6 +110,9 @@ try{
 
 	hid_t groupID = (hid_t) Rcpp::as<int>(_groupID);
 
+	//the cached timeseries of the file hold it open
+	tsdb::SeriesCache::global().invalidateLocation(groupID);
+
 	return Rcpp::wrap(H5Fclose(groupID));
 }
 catch( std::exception &ex ) {
@@ -118,7 +124,9 @@ return R_NilValue;
 }
 
 /**
-<summary> Lists all timeseries stored in a HDF5 file. Wraps H5Gget_info. </summary>
+<summary> Lists all timeseries stored in a HDF5 file. </summary>
+<remarks> The names are read from the catalog of the file in one go (see tsdb::Catalog). Files
+without a catalog have their links listed instead. </remarks>
 <param name="groupID">Integer argument for the HDF5 file identifier (group ID).</param>
 <returns> Returns a list of available timeseries in the HDF5 file. </returns>
 */
@@ -133,30 +141,15 @@ try {
 
 	hid_t groupID = (hid_t) Rcpp::as<int>(_groupID);
 
-	herr_t status, size;
-	H5G_info_t group_info;
-	status = H5Gget_info(groupID, &group_info);
-
-	if (status < 0)
-		throw std::runtime_error("Could not retrieve information. Likely an invalid "
-				"file indentifier (group ID).");
+	vector<string> names = tsdb::Catalog::seriesNames(groupID);
 
-	if (group_info.nlinks == 0)
+	if (names.empty())
 		throw std::runtime_error("No timeseries found.");
 
-	char * name = NULL;
-	Rcpp::StringVector tableNames(group_info.nlinks);
+	Rcpp::StringVector tableNames(names.size());
+	for(size_t i = 0; i < names.size(); i++)
+		tableNames[i] = names[i];
 
-	for(hsize_t i = 0; i < group_info.nlinks; i++)
-	{
-		size = H5Lget_name_by_idx(groupID, ".", H5_INDEX_NAME, H5_ITER_INC, i, NULL, 0, H5P_DEFAULT);
-		// allocate some space
-		name = (char *) malloc(size+1);
-		memset(name,0,size+1);
-		status = H5Lget_name_by_idx(groupID, ".", H5_INDEX_NAME, H5_ITER_INC, i, name, size+1, H5P_DEFAULT);
-		tableNames[i] = name;
-		free(name);
-	}
 	return tableNames;
 }
 catch( std::exception &ex ) {
@@ -196,14 +189,14 @@ try {
 	if (groupID < 0)
 		throw std::runtime_error("Invalid group ID.");
 
-	//creating timeseries object
-	tsdb::Timeseries ts(groupID, seriesName);
+	//opening the timeseries, or reusing it if an earlier call opened it
+	boost::shared_ptr<tsdb::Timeseries> ts = tsdb::SeriesCache::global().open(groupID, seriesName);
 
 	/***************************************
 	RECORD COUNT
 	***************************************/
 	Rcpp::NumericVector recordCount(1);
-	recordCount[0] = ts.getNRecords();
+	recordCount[0] = ts->getNRecords();
 
 	/***************************************
 	BEGINNING AND ENDING TIMESTAMPS
@@ -211,18 +204,18 @@ try {
 	Rcpp::StringVector firstTimestamp(1), lastTimestamp(1);
 	if (recordCount[0] > 0)
 	{
-		tsdb::RecordSet record = ts.recordSet((hsize_t) 0, (hsize_t) 0);
+		tsdb::RecordSet record = ts->recordSet((hsize_t) 0, (hsize_t) 0);
 		firstTimestamp = record[0][0].toString();
 
-		record = ts.recordSet(ts.getNRecords()-1,ts.getNRecords()-1);
+		record = ts->recordSet(ts->getNRecords()-1,ts->getNRecords()-1);
 		lastTimestamp = record[0][0].toString();
 	}
 
 	/***************************************
 	COLUMN NAMES AND TYPES
 	***************************************/
-	size_t numFields = ts.structure()->getNFields();
-	char** _fieldNames = ts.structure()->getNameOfFieldsAsArray();
+	size_t numFields = ts->structure()->getNFields();
+	char** _fieldNames = ts->structure()->getNameOfFieldsAsArray();
 
 	Rcpp::StringVector fieldNames(numFields);
 	Rcpp::StringVector fieldTypes(numFields);
@@ -230,7 +223,7 @@ try {
 	for (size_t i=0; i<numFields; i++)
 	{
 		fieldNames[i] = _fieldNames[i];
-		fieldTypes[i] = ts.structure()->getField(i)->getTSDBType();
+		fieldTypes[i] = ts->structure()->getField(i)->getTSDBType();
 	}
 
 	//dataframe of field properties
@@ -252,6 +245,249 @@ catch( std::exception &ex ) {
 return R_NilValue;
 }
 
+/**
+<summary> Returns the counters of a timeseries: lookups, appends, and the reads and writes of its
+data table.</summary>
+<remarks> The counters are those of the Timeseries that the bindings keep open (see tsdb::SeriesCache), so
+they add up over the calls made since the series was first used, until reset. See tsdb::TimeseriesStats
+for what each one counts. Times are in microseconds.</remarks>
+<param name="groupID">Integer argument for the HDF5 file identifier (group ID).</param>
+<param name="seriesName">String argument for the timeseries name.</param>
+<param name="reset">Logical argument. If TRUE, the counters are set back to zero after they are read.</param>
+<returns> Returns a named numeric vector, with one element per counter.</returns>
+*/
+SEXP TSDBget_stats(SEXP _groupID, SEXP _seriesName, SEXP _reset)
+{
+try {
+	using namespace std;
+
+	//checking arguments
+	if (TYPEOF(_groupID) != INTSXP)
+		throw std::runtime_error("First argument should an integer argument.");
+
+	if (TYPEOF(_seriesName) != STRSXP)
+		throw std::runtime_error("Second argument should a string.");
+
+	if (TYPEOF(_reset) != LGLSXP)
+		throw std::runtime_error("Third argument should be a logical.");
+
+	hid_t groupID = (hid_t) Rcpp::as<int>(_groupID);
+	string seriesName = Rcpp::as<std::string>(_seriesName);
+	bool reset = Rcpp::as<bool>(_reset);
+
+	if (groupID < 0)
+		throw std::runtime_error("Invalid group ID.");
+
+	boost::shared_ptr<tsdb::Timeseries> ts = tsdb::SeriesCache::global().open(groupID, seriesName);
+
+	tsdb::StatList items = ts->stats().items();
+	if (reset)
+		ts->resetStats();
+
+	Rcpp::NumericVector values(items.size());
+	Rcpp::StringVector names(items.size());
+	for (size_t i=0; i<items.size(); i++)
+	{
+		values[i] = (double) items[i].second;
+		names[i] = items[i].first;
+	}
+	values.attr("names") = names;
+
+	return values;
+}
+catch( std::exception &ex ) {
+	forward_exception_to_r(ex);
+} catch(...) {
+	::Rf_error( "c++ exception (unknown reason)" );
+}
+return R_NilValue;
+}
+
+/**
+<summary> Sets how many bytes of decompressed chunks the process keeps for reuse across queries.</summary>
+<remarks> The cache is shared by every timeseries that is open (see tsdb::ChunkCache), so repeated queries
+over the same window do not decompress the same chunks again. The least recently used chunks are dropped
+to stay within the capacity. 0 turns the cache off.</remarks>
+<param name="capacityBytes">Numeric argument for the capacity in bytes.</param>
+<returns> Returns 0.</returns>
+*/
+SEXP TSDBset_chunk_cache(SEXP _capacityBytes)
+{
+try {
+	//checking arguments
+	if (TYPEOF(_capacityBytes) != REALSXP && TYPEOF(_capacityBytes) != INTSXP)
+		throw std::runtime_error("First argument should be a number.");
+
+	double capacityBytes = Rcpp::as<double>(_capacityBytes);
+	if (capacityBytes < 0)
+		throw std::runtime_error("Invalid capacity.");
+
+	tsdb::ChunkCache::global().setCapacity((size_t) capacityBytes);
+	return Rcpp::wrap(0);
+}
+catch( std::exception &ex ) {
+	forward_exception_to_r(ex);
+} catch(...) {
+	::Rf_error( "c++ exception (unknown reason)" );
+}
+return R_NilValue;
+}
+
+/**
+<summary> Returns the counters of the chunk cache: hits, misses, stale chunks, insertions, evictions and
+invalidations, and the bytes and chunks it holds.</summary>
+<remarks> See tsdb::ChunkCacheStats for what each one counts.</remarks>
+<param name="reset">Logical argument. If TRUE, the counters are set back to zero after they are read.</param>
+<returns> Returns a named numeric vector, with one element per counter.</returns>
+*/
+SEXP TSDBget_chunk_cache_stats(SEXP _reset)
+{
+try {
+	//checking arguments
+	if (TYPEOF(_reset) != LGLSXP)
+		throw std::runtime_error("First argument should be a logical.");
+
+	bool reset = Rcpp::as<bool>(_reset);
+
+	tsdb::StatList items = tsdb::ChunkCache::global().stats().items();
+	if (reset)
+		tsdb::ChunkCache::global().resetStats();
+
+	Rcpp::NumericVector values(items.size());
+	Rcpp::StringVector names(items.size());
+	for (size_t i=0; i<items.size(); i++)
+	{
+		values[i] = (double) items[i].second;
+		names[i] = items[i].first;
+	}
+	values.attr("names") = names;
+
+	return values;
+}
+catch( std::exception &ex ) {
+	forward_exception_to_r(ex);
+} catch(...) {
+	::Rf_error( "c++ exception (unknown reason)" );
+}
+return R_NilValue;
+}
+
+/**
+<summary> Converts a record set into a list of columns, one for each field, named after the
+fields. Timestamps become doubles (milliseconds since the epoch), dates, 8 bit and 32 bit
+integers become integers, strings become character vectors, and symbols become factors, with
+a level for each symbol in the dictionary.</summary>
+<param name="recordSet">The records to convert.</param>
+<param name="fields">The indices of the fields to convert, in the order of the columns.</param>
+<returns> Returns a list of columns, which can be made into a data frame.</returns>
+*/
+static Rcpp::List recordSetColumns(tsdb::RecordSet& recordSet, const std::vector<size_t>& fields)
+{
+	using namespace std;
+
+	size_t numRecords = recordSet.size();
+	size_t numFields = fields.size();
+	char** fieldNames = recordSet.structure()->getNameOfFieldsAsArray();
+
+	Rcpp::List records; //record container
+
+	//looping through the columns
+	for (size_t i = 0; i<numFields; i++)
+	{
+		size_t index = fields[i];
+
+		//type of the column
+		string fieldType = recordSet.structure()->getField(index)->getTSDBType();
+
+		//numeric columns are copied straight out of the records into the R vector
+		if (fieldType == "Timestamp" || fieldType == "Double")
+		{
+			Rcpp::NumericVector columnData(numRecords);
+			recordSet.extractDoubles(index, columnData.begin());
+
+			records.push_back(columnData,fieldNames[index]);
+		}
+		if (fieldType == "Date" || fieldType == "Int8" || fieldType == "Int32")
+		{
+			Rcpp::IntegerVector columnData(numRecords);
+			recordSet.extractInts(index, columnData.begin());
+
+			records.push_back(columnData,fieldNames[index]);
+		}
+		if (fieldType.find("String") != std::string::npos)
+		{
+			Rcpp::StringVector columnData(numRecords);
+
+			for (size_t row=0; row<numRecords; row++)
+				columnData[row] = recordSet[row][index].toString();
+
+			records.push_back(columnData,fieldNames[index]);
+		}
+		if (fieldType.find("Symbol") != std::string::npos)
+		{
+			//the codes count from 0, and the levels of a factor from 1
+			Rcpp::IntegerVector columnData(numRecords);
+			recordSet.extractInts(index, columnData.begin());
+			for (size_t row=0; row<numRecords; row++)
+				columnData[row] += 1;
+
+			tsdb::SymbolField* field = (tsdb::SymbolField*) recordSet.structure()->getField(index);
+			std::vector<std::string> symbols = field->symbols()->symbols(0);
+			Rcpp::StringVector levels(symbols.size());
+			for (size_t j=0; j<symbols.size(); j++)
+				levels[j] = symbols[j];
+
+			columnData.attr("levels") = levels;
+			columnData.attr("class") = "factor";
+			records.push_back(columnData,fieldNames[index]);
+		}
+	}
+
+	return records;
+}
+
+/**
+<summary> Converts all of the fields of a record set into a list of columns.</summary>
+*/
+static Rcpp::List recordSetColumns(tsdb::RecordSet& recordSet)
+{
+	std::vector<size_t> fields(recordSet.structure()->getNFields());
+	for (size_t i = 0; i<fields.size(); i++)
+		fields[i] = i;
+
+	return recordSetColumns(recordSet, fields);
+}
+
+/**
+<summary> The state of a cursor opened by TSDBopen_cursor.</summary>
+<remarks> The records are read through a tsdb::BufferedRecordSet, so only the buffer it
+has loaded and the chunk being returned are in memory at any time. The BufferedRecordSet
+reads from the table of the Timeseries, which the cursor keeps open.</remarks>
+*/
+struct TSDBcursor
+{
+	boost::shared_ptr<tsdb::Timeseries> series;
+	tsdb::BufferedRecordSet records;
+	std::vector<size_t> fields;	//indices of the wanted fields
+	hsize_t next;				//index in records of the first record of the next chunk
+	size_t chunkRows;
+};
+
+/**
+<summary> Returns the cursor of an external pointer made by TSDBopen_cursor.</summary>
+*/
+static TSDBcursor* cursorOf(SEXP _cursor)
+{
+	if (TYPEOF(_cursor) != EXTPTRSXP)
+		throw std::runtime_error("Expecting a cursor from TSDBopen_cursor.");
+
+	TSDBcursor* cursor = (TSDBcursor*) R_ExternalPtrAddr(_cursor);
+	if (cursor == NULL)
+		throw std::runtime_error("The cursor has been closed.");
+
+	return cursor;
+}
+
 /**
 <summary> Pulls records from the timeseries.</summary>
 <param name="groupID">Integer argument for the HDF5 file identifier (group ID).</param>
@@ -265,10 +501,14 @@ than 2^53 seconds from the epoch, which will happen in a few hundreds of thousan
 of years, there should be no loss of precision.</param>
 <param name="lastTimestamp"> Double arugment for the last timestamp of the wanted record.</param>
 <param name="fieldsWanted"> Character vectora rgument for the wanted fields.</param>
+<param name="filter"> Optional string argument with a condition on the fields, such as
+"side == 1 & amount > 100" (see tsdb::Predicate::parse). Only the records that meet it are
+returned; they are selected in the library, so the others are never copied into R, and
+blocks of the series that can't meet it are not read. NULL or "" returns every record.</param>
 <returns> Returns a data frame of wanted fields for the wanted records.</returns>
 */
 SEXP TSDBget_records(SEXP _groupID, SEXP _seriesName,
-		SEXP _startTimestamp, SEXP _endTimestamp, SEXP _fieldsWanted)
+		SEXP _startTimestamp, SEXP _endTimestamp, SEXP _fieldsWanted, SEXP _filter)
 {
 try {
 	using namespace std;
@@ -287,117 +527,369 @@ try {
 	if (TYPEOF(_fieldsWanted) != STRSXP && TYPEOF(_fieldsWanted) != NILSXP)
 		throw std::runtime_error("Timestamp arguments must have type double.");
 
+	//filter might be an empty argument
+	if (TYPEOF(_filter) != STRSXP && TYPEOF(_filter) != NILSXP)
+		throw std::runtime_error("Filter should be a string.");
+
 	//getting arguments
 	hid_t groupID = (hid_t) Rcpp::as<int>(_groupID);
 	string seriesName = Rcpp::as<std::string>(_seriesName);
 	tsdb::timestamp_t startTimestamp = (tsdb::timestamp_t) Rcpp::as<double>(_startTimestamp);
 	tsdb::timestamp_t endTimestamp = (tsdb::timestamp_t) Rcpp::as<double>(_endTimestamp);
+	tsdb::Predicate filter;
+	if (TYPEOF(_filter) != NILSXP)
+		filter = tsdb::Predicate::parse(Rcpp::as<std::string>(_filter));
 	Rcpp::StringVector fieldsWanted;
 	size_t numFieldsWanted;
-	vector<size_t> indicesWanted;
+	vector<string> namesWanted;
 
 	if (groupID < 0)
 		throw std::runtime_error("Invalid group ID.");
 
-	//creating timeseries object
-	tsdb::Timeseries ts(groupID, seriesName);
+	//opening the timeseries, or reusing it if an earlier call opened it
+	boost::shared_ptr<tsdb::Timeseries> ts = tsdb::SeriesCache::global().open(groupID, seriesName);
 
 	if (TYPEOF(_fieldsWanted) != NILSXP)
 	{
-		//figuring out the indices of wanted columns
+		//only the wanted columns are read from the file
 		fieldsWanted = Rcpp::StringVector(_fieldsWanted);
 		numFieldsWanted = fieldsWanted.length();
 		for (size_t i=0; i<numFieldsWanted; i++)
-		{
-			size_t index = ts.structure()->
-					getFieldIndexByName((char*)fieldsWanted[i]);
-			indicesWanted.push_back(index);
-		}
+			namesWanted.push_back((char*)fieldsWanted[i]);
 	}
 	else
 	{
 		//grabbing all columns
-		numFieldsWanted = ts.structure()->getNFields();
-		char** fieldNames = ts.structure()->getNameOfFieldsAsArray();
+		numFieldsWanted = ts->structure()->getNFields();
+		char** fieldNames = ts->structure()->getNameOfFieldsAsArray();
 		fieldsWanted = Rcpp::StringVector(numFieldsWanted);
 		for (size_t i=0; i<numFieldsWanted; i++)
 		{
-			indicesWanted.push_back(i);
+			namesWanted.push_back(fieldNames[i]);
 			fieldsWanted[i] = fieldNames[i];
 		}
 	}
 
-	//loading the records into memory
-	tsdb::RecordSet recordSet = ts.recordSet(startTimestamp, endTimestamp);
-	size_t numRecords = recordSet.size();
+	//loading the records into memory. The record set has just the wanted
+	//fields, in the order they were asked for.
+	if (!filter.matchesAll())
+	{
+		//only the records that meet the filter are copied
+		tsdb::RecordSet recordSet = ts->scan(startTimestamp, endTimestamp, filter, namesWanted);
+		return Rcpp::DataFrame::create(recordSetColumns(recordSet));
+	}
+	tsdb::RecordSet recordSet = ts->recordSet(startTimestamp, endTimestamp, namesWanted);
+	return Rcpp::DataFrame::create(recordSetColumns(recordSet));
+}
+catch( std::exception &ex ) {
+	forward_exception_to_r(ex);
+} catch(...) {
+	::Rf_error( "c++ exception (unknown reason)" );
+}
+return R_NilValue;
+}
 
-	Rcpp::List records; //record container
+/**
+<summary> Opens a cursor over the records of a time range, to read them a chunk at a time.</summary>
+<remarks> Unlike TSDBget_records, which loads the whole range before making one data frame,
+the cursor only reads the records of a chunk when TSDBnext_chunk asks for it, so a range of
+any length can be processed in bounded memory. The file must stay open while the cursor is
+used. The cursor is freed by TSDBclose_cursor, or else when R garbage collects it.</remarks>
+<param name="groupID">Integer argument for the HDF5 file identifier (group ID).</param>
+<param name="seriesName">String argument for the timeseries name.</param>
+<param name="startTimestamp"> Double argument for the first wanted record, as in TSDBget_records.</param>
+<param name="lastTimestamp"> Double arugment for the last timestamp of the wanted record.</param>
+<param name="fieldsWanted"> Character vector argument for the wanted fields. If it is NULL,
+all of the fields are read.</param>
+<param name="chunkRows"> Integer argument for the largest number of records in a chunk.</param>
+<returns> Returns the cursor, as an external pointer.</returns>
+*/
+SEXP TSDBopen_cursor(SEXP _groupID, SEXP _seriesName,
+		SEXP _startTimestamp, SEXP _endTimestamp, SEXP _fieldsWanted, SEXP _chunkRows)
+{
+try {
+	using namespace std;
+
+	//checking arguments
+	if (TYPEOF(_groupID) != INTSXP)
+		throw std::runtime_error("Group ID should an integer argument.");
+
+	if (TYPEOF(_seriesName) != STRSXP)
+		throw std::runtime_error("Timeseries name should a string.");
+
+	if (TYPEOF(_startTimestamp) != REALSXP || TYPEOF(_endTimestamp) != REALSXP)
+		throw std::runtime_error("Timestamp arguments must have type double.");
+
+	if (TYPEOF(_fieldsWanted) != STRSXP && TYPEOF(_fieldsWanted) != NILSXP)
+		throw std::runtime_error("Wanted fields must be a character vector or NULL.");
+
+	if (TYPEOF(_chunkRows) != INTSXP && TYPEOF(_chunkRows) != REALSXP)
+		throw std::runtime_error("Chunk rows should be a number.");
+
+	//getting arguments
+	hid_t groupID = (hid_t) Rcpp::as<int>(_groupID);
+	string seriesName = Rcpp::as<std::string>(_seriesName);
+	tsdb::timestamp_t startTimestamp = (tsdb::timestamp_t) Rcpp::as<double>(_startTimestamp);
+	tsdb::timestamp_t endTimestamp = (tsdb::timestamp_t) Rcpp::as<double>(_endTimestamp);
+	int chunkRows = Rcpp::as<int>(_chunkRows);
 
-	//looping through wanted columns
-	for (size_t i = 0; i<numFieldsWanted; i++)
+	if (groupID < 0)
+		throw std::runtime_error("Invalid group ID.");
+
+	if (chunkRows < 1)
+		throw std::runtime_error("Chunk rows should be at least 1.");
+
+	TSDBcursor* cursor = new TSDBcursor();
+	Rcpp::XPtr<TSDBcursor> cursorPtr(cursor, true); //frees the cursor if anything below throws
+
+	cursor->series = tsdb::SeriesCache::global().open(groupID, seriesName);
+	cursor->records = cursor->series->bufferedRecordSet(startTimestamp, endTimestamp);
+	cursor->next = 0;
+	cursor->chunkRows = (size_t) chunkRows;
+
+	boost::shared_ptr<tsdb::Structure> structure = cursor->series->structure();
+	if (TYPEOF(_fieldsWanted) != NILSXP)
 	{
-		size_t index = indicesWanted[i];
+		Rcpp::StringVector fieldsWanted(_fieldsWanted);
+		for (int i=0; i<fieldsWanted.length(); i++)
+			cursor->fields.push_back(structure->getFieldIndexByName((char*)fieldsWanted[i]));
+	}
+	else
+	{
+		for (size_t i=0; i<structure->getNFields(); i++)
+			cursor->fields.push_back(i);
+	}
 
-		//type of the column
-		string fieldType = ts.structure()->getField(index)->getTSDBType();
+	//a buffer holds at least a whole chunk
+	size_t chunkBytes = cursor->chunkRows * structure->getSizeOf();
+	cursor->records.setBufferSize(std::max<size_t>(BUFFER_BYTES, chunkBytes),
+		std::max<size_t>(BUFFER_MAX_BYTES, chunkBytes));
 
-		if (fieldType == "Timestamp")
-		{
-			Rcpp::NumericVector columnData(numRecords);
+	return cursorPtr;
+}
+catch( std::exception &ex ) {
+	forward_exception_to_r(ex);
+} catch(...) {
+	::Rf_error( "c++ exception (unknown reason)" );
+}
+return R_NilValue;
+}
 
-			for (size_t row=0; row<numRecords; row++)
-				columnData[row] = recordSet[row][index].toTimestamp();
+/**
+<summary> Reads the next chunk of records of a cursor.</summary>
+<param name="cursor">The cursor, from TSDBopen_cursor.</param>
+<returns> Returns a data frame of the wanted fields of up to chunkRows records, or NULL when
+all of the records of the range have been returned.</returns>
+*/
+SEXP TSDBnext_chunk(SEXP _cursor)
+{
+try {
+	TSDBcursor* cursor = cursorOf(_cursor);
 
-			records.push_back(columnData,(char*)fieldsWanted[i]);
-		}
-		if (fieldType == "Date")
-		{
-			Rcpp::IntegerVector columnData(numRecords);
+	hsize_t numRecords = cursor->records.size();
+	if (cursor->next >= numRecords)
+		return R_NilValue;
 
-			for (size_t row=0; row<numRecords; row++)
-				columnData[row] = recordSet[row][index].toDate();
+	size_t chunkRecords = (size_t) std::min<hsize_t>(cursor->chunkRows, numRecords - cursor->next);
+	boost::shared_ptr<tsdb::Structure> structure = cursor->records.structure();
+	size_t recordSize = structure->getSizeOf();
 
-			records.push_back(columnData,(char*)fieldsWanted[i]);
-		}
-		if (fieldType == "Int8")
-		{
-			Rcpp::IntegerVector columnData(numRecords);
+	//copying the records of the chunk out of the buffers of the BufferedRecordSet
+	tsdb::RecordSet chunk(chunkRecords, structure);
+	char* dest = chunk.memoryBlockPtr().raw();
+	size_t done = 0;
+	while (done < chunkRecords)
+	{
+		hsize_t bufFirst;
+		size_t bufRecords;
+		const char* buf = cursor->records.buffer(cursor->next + done, &bufFirst, &bufRecords);
+
+		size_t offset = (size_t) (cursor->next + done - bufFirst);
+		size_t count = std::min(chunkRecords - done, bufRecords - offset);
+		memcpy(dest + done * recordSize, buf + offset * recordSize, count * recordSize);
+		done += count;
+	}
+	cursor->next += chunkRecords;
 
-			for (size_t row=0; row<numRecords; row++)
-				columnData[row] = recordSet[row][index].toInt8();
+	return Rcpp::DataFrame::create(recordSetColumns(chunk, cursor->fields));
+}
+catch( std::exception &ex ) {
+	forward_exception_to_r(ex);
+} catch(...) {
+	::Rf_error( "c++ exception (unknown reason)" );
+}
+return R_NilValue;
+}
 
-			records.push_back(columnData,(char*)fieldsWanted[i]);
-		}
-		if (fieldType == "Int32")
-		{
-			Rcpp::IntegerVector columnData(numRecords);
+/**
+<summary> Closes a cursor, and frees its buffers.</summary>
+<remarks> Closing a cursor that is already closed does nothing.</remarks>
+<param name="cursor">The cursor, from TSDBopen_cursor.</param>
+<returns> Returns 1.</returns>
+*/
+SEXP TSDBclose_cursor(SEXP _cursor)
+{
+try {
+	if (TYPEOF(_cursor) != EXTPTRSXP)
+		throw std::runtime_error("Expecting a cursor from TSDBopen_cursor.");
 
-			for (size_t row=0; row<numRecords; row++)
-				columnData[row] = recordSet[row][index].toInt32();
+	TSDBcursor* cursor = (TSDBcursor*) R_ExternalPtrAddr(_cursor);
+	if (cursor != NULL)
+	{
+		delete cursor;
+		R_ClearExternalPtr(_cursor);
+	}
 
-			records.push_back(columnData,(char*)fieldsWanted[i]);
-		}
-		if (fieldType == "Double")
-		{
-			Rcpp::NumericVector columnData(numRecords);
+	return Rcpp::wrap(1);
+}
+catch( std::exception &ex ) {
+	forward_exception_to_r(ex);
+} catch(...) {
+	::Rf_error( "c++ exception (unknown reason)" );
+}
+return R_NilValue;
+}
 
-			for (size_t row=0; row<numRecords; row++)
-				columnData[row] = recordSet[row][index].toDouble();
+/**
+<summary> Pulls the records of a time range from several timeseries at once.</summary>
+<remarks> The timeseries are read in parallel by a pool of worker threads (see
+tsdb::MultiSeriesQuery). HDF5 itself is serialized, but the decompression of the
+records and the copying of the columns are done by the workers at the same time.</remarks>
+<param name="groupID">Integer argument for the HDF5 file identifier (group ID).</param>
+<param name="seriesNames">Character vector argument for the timeseries names.</param>
+<param name="startTimestamp"> Double argument for the first wanted record, as in TSDBget_records.</param>
+<param name="lastTimestamp"> Double arugment for the last timestamp of the wanted record.</param>
+<param name="fieldsWanted"> Character vector argument for the wanted fields, which every timeseries
+must have. If it is NULL, all of the fields are read.</param>
+<param name="threads"> Integer argument for the number of worker threads. If it is NULL or 0,
+there is one worker per processor.</param>
+<returns> Returns a list of data frames, named after the timeseries.</returns>
+*/
+SEXP TSDBget_records_multi(SEXP _groupID, SEXP _seriesNames,
+		SEXP _startTimestamp, SEXP _endTimestamp, SEXP _fieldsWanted, SEXP _threads)
+{
+try {
+	using namespace std;
 
-			records.push_back(columnData,(char*)fieldsWanted[i]);
-		}
-		if (fieldType.find("String") != std::string::npos)
-		{
-			Rcpp::StringVector columnData(numRecords);
+	//checking arguments
+	if (TYPEOF(_groupID) != INTSXP)
+		throw std::runtime_error("Group ID should an integer argument.");
 
-			for (size_t row=0; row<numRecords; row++)
-				columnData[row] = recordSet[row][index].toString();
+	if (TYPEOF(_seriesNames) != STRSXP)
+		throw std::runtime_error("Timeseries names should be a character vector.");
 
-			records.push_back(columnData,(char*)fieldsWanted[i]);
-		}
+	if (TYPEOF(_startTimestamp) != REALSXP || TYPEOF(_endTimestamp) != REALSXP)
+		throw std::runtime_error("Timestamp arguments must have type double.");
+
+	if (TYPEOF(_fieldsWanted) != STRSXP && TYPEOF(_fieldsWanted) != NILSXP)
+		throw std::runtime_error("Wanted fields should be a character vector.");
+
+	if (TYPEOF(_threads) != INTSXP && TYPEOF(_threads) != NILSXP)
+		throw std::runtime_error("Number of threads should be an integer argument.");
+
+	//getting arguments
+	hid_t groupID = (hid_t) Rcpp::as<int>(_groupID);
+	tsdb::timestamp_t startTimestamp = (tsdb::timestamp_t) Rcpp::as<double>(_startTimestamp);
+	tsdb::timestamp_t endTimestamp = (tsdb::timestamp_t) Rcpp::as<double>(_endTimestamp);
+	Rcpp::StringVector seriesNames(_seriesNames);
+	vector<string> names;
+	vector<string> namesWanted;
+	int threads = 0;
+
+	if (groupID < 0)
+		throw std::runtime_error("Invalid group ID.");
+
+	for (int i=0; i<seriesNames.length(); i++)
+		names.push_back((char*)seriesNames[i]);
+
+	if (TYPEOF(_fieldsWanted) != NILSXP)
+	{
+		Rcpp::StringVector fieldsWanted(_fieldsWanted);
+		for (int i=0; i<fieldsWanted.length(); i++)
+			namesWanted.push_back((char*)fieldsWanted[i]);
 	}
 
-	return Rcpp::DataFrame::create(records);
+	if (TYPEOF(_threads) != NILSXP)
+		threads = Rcpp::as<int>(_threads);
+
+	if (threads < 0)
+		throw std::runtime_error("Number of threads can not be negative.");
+
+	//reading all of the timeseries
+	tsdb::MultiSeriesQuery query(groupID, names);
+	query.setFields(namesWanted);
+	query.setThreads((size_t) threads);
+	vector<tsdb::RecordSet> recordSets = query.run(startTimestamp, endTimestamp);
+
+	Rcpp::List frames; //one data frame per timeseries
+	for (size_t i=0; i<recordSets.size(); i++)
+		frames.push_back(Rcpp::DataFrame::create(recordSetColumns(recordSets[i])), names[i]);
+
+	return frames;
+}
+catch( std::exception &ex ) {
+	forward_exception_to_r(ex);
+} catch(...) {
+	::Rf_error( "c++ exception (unknown reason)" );
+}
+return R_NilValue;
+}
+
+/**
+<summary> Reduces the records of a time range to one row per time bucket.</summary>
+<remarks> The records are aggregated in the library, one buffer at a time, so only the
+rows of the result are copied into R (see tsdb::Timeseries::aggregate).</remarks>
+<param name="groupID">Integer argument for the HDF5 file identifier (group ID).</param>
+<param name="seriesName">String argument for the timeseries name.</param>
+<param name="startTimestamp"> Double argument for the first wanted record, as in TSDBget_records.</param>
+<param name="lastTimestamp"> Double arugment for the last timestamp of the wanted record.</param>
+<param name="bucketSize"> Double argument for the length of a bucket, in milliseconds.</param>
+<param name="specs"> Character vector argument for the aggregated columns, such as "max(price)",
+"vwap(price,amount)" or "count". The functions are first, last, min, max, sum, count, mean and
+wmean (or vwap).</param>
+<returns> Returns a data frame with the start of each bucket, followed by one column per spec.</returns>
+*/
+SEXP TSDBaggregate(SEXP _groupID, SEXP _seriesName,
+		SEXP _startTimestamp, SEXP _endTimestamp, SEXP _bucketSize, SEXP _specs)
+{
+try {
+	using namespace std;
+
+	//checking arguments
+	if (TYPEOF(_groupID) != INTSXP)
+		throw std::runtime_error("Group ID should an integer argument.");
+
+	if (TYPEOF(_seriesName) != STRSXP)
+		throw std::runtime_error("Timeseries name should a string.");
+
+	if (TYPEOF(_startTimestamp) != REALSXP || TYPEOF(_endTimestamp) != REALSXP)
+		throw std::runtime_error("Timestamp arguments must have type double.");
+
+	if (TYPEOF(_bucketSize) != REALSXP)
+		throw std::runtime_error("Bucket size must have type double.");
+
+	if (TYPEOF(_specs) != STRSXP)
+		throw std::runtime_error("Aggregates should be a character vector.");
+
+	//getting arguments
+	hid_t groupID = (hid_t) Rcpp::as<int>(_groupID);
+	string seriesName = Rcpp::as<std::string>(_seriesName);
+	tsdb::timestamp_t startTimestamp = (tsdb::timestamp_t) Rcpp::as<double>(_startTimestamp);
+	tsdb::timestamp_t endTimestamp = (tsdb::timestamp_t) Rcpp::as<double>(_endTimestamp);
+	tsdb::timestamp_t bucketSize = (tsdb::timestamp_t) Rcpp::as<double>(_bucketSize);
+	Rcpp::StringVector specStrings(_specs);
+	vector<tsdb::AggregateSpec> specs;
+
+	if (groupID < 0)
+		throw std::runtime_error("Invalid group ID.");
+
+	for (int i=0; i<specStrings.length(); i++)
+		specs.push_back(tsdb::AggregateSpec::fromString((char*)specStrings[i]));
+
+	boost::shared_ptr<tsdb::Timeseries> ts = tsdb::SeriesCache::global().open(groupID, seriesName);
+	tsdb::RecordSet recordSet = ts->aggregate(startTimestamp, endTimestamp, bucketSize, specs);
+
+	return Rcpp::DataFrame::create(recordSetColumns(recordSet));
 }
 catch( std::exception &ex ) {
 	forward_exception_to_r(ex);
@@ -521,6 +1013,14 @@ try {
 			fields.push_back(new tsdb::DoubleField(name));
 		else if (type == "date")
 			fields.push_back(new tsdb::DateField(name));
+		else if (type.find("symbol") != std::string::npos)
+		{
+			int maxLength = atoi(type.c_str() + type.find("(") + 1);
+			if (type.find("(") == std::string::npos || maxLength < 1)
+				throw std::runtime_error("Field type for a symbol must have the form 'symbol(n)', for some integer n.");
+
+			fields.push_back(new tsdb::SymbolField(name,maxLength));
+		}
 		else if (type.find("string") != std::string::npos)
 		{
 			char* stringLengthPr = strtok((char*) type.c_str(),"(");
@@ -538,6 +1038,7 @@ try {
 
 	boost::shared_ptr<tsdb::Structure> st =
 			boost::make_shared<tsdb::Structure>(fields,false);
+	tsdb::SeriesCache::global().invalidate(groupID, seriesName);
 	tsdb::Timeseries ts =
 			tsdb::Timeseries(groupID,seriesName,seriesDescription,st);
 
@@ -596,8 +1097,8 @@ try {
 	//properties of the table
 	string seriesName = Rcpp::as<string>(_seriesName);
 	int groupID = Rcpp::as<int>(_groupID);
-	tsdb::Timeseries ts(groupID, seriesName);
-	size_t tableFieldCount = ts.structure()->getNFields();
+	boost::shared_ptr<tsdb::Timeseries> ts = tsdb::SeriesCache::global().open(groupID, seriesName);
+	size_t tableFieldCount = ts->structure()->getNFields();
 
 	//properties of the appending data frame
 	Rcpp::List appendData(_appendData);
@@ -615,10 +1116,10 @@ try {
 	for (size_t i=0; i<appendingFieldCount; i++)
 	{
 		//if the index isn't found, an exception will occur
-		size_t index = ts.structure()->getFieldIndexByName((string) appendDataNames[i]);
+		size_t index = ts->structure()->getFieldIndexByName((string) appendDataNames[i]);
 
 		//checking the types match
-		string TSDBtype = ts.structure()->getField(index)->getTSDBType();
+		string TSDBtype = ts->structure()->getField(index)->getTSDBType();
 		if (TSDBtype == "Timestamp" || TSDBtype == "Double")
 		{
 			if (TYPEOF(appendData[(string) appendDataNames[i]]) != REALSXP)
@@ -643,9 +1144,18 @@ try {
 				    TSDBappendErrorMessage((string) appendDataNames[i],TSDBtype));
 			}
 		}
+		else if (TSDBtype.find("Symbol") != std::string::npos)
+		{
+			SEXP column = appendData[(string) appendDataNames[i]];
+		    if (TYPEOF(column) != STRSXP && !Rf_isFactor(column))
+			{
+				throw std::runtime_error(
+				    TSDBappendErrorMessage((string) appendDataNames[i],TSDBtype));
+			}
+		}
 
 		//checking existence of table fields in the data frame
-		string fieldName = ts.structure()->getField(i)->getName();
+		string fieldName = ts->structure()->getField(i)->getName();
 		int check = (int) std::count(appendDataNames.begin(),appendDataNames.end(),fieldName.c_str());
 		if (check != 1)
 		{
@@ -673,7 +1183,7 @@ try {
 	explains why 'tsdb::RecordSet records((size_t) numRecordsToAppend, ts.structure());'
 	would not work.
 	*/
-	boost::shared_ptr<tsdb::Structure> tsStructure = ts.structure();
+	boost::shared_ptr<tsdb::Structure> tsStructure = ts->structure();
 	tsdb::RecordSet records((size_t) numRecordsToAppend, tsStructure);
 
 	for (size_t dfIndex=0; dfIndex<appendingFieldCount; dfIndex++)
@@ -681,8 +1191,8 @@ try {
 		string dfName = (string) appendDataNames[dfIndex];
 
 		//index in the TSDB table
-		size_t tableIndex = ts.structure()->getFieldIndexByName(dfName);
-		string TSDBtype = ts.structure()->getField(tableIndex)->getTSDBType();
+		size_t tableIndex = ts->structure()->getFieldIndexByName(dfName);
+		string TSDBtype = ts->structure()->getField(tableIndex)->getTSDBType();
 
 		if (TSDBtype == "Timestamp")
 		{
@@ -726,11 +1236,43 @@ try {
 			for (int row=0; row<numRecordsToAppend; row++)
 				records[row][tableIndex] = (string) dfColumn[row];
 		}
+		else if (TSDBtype.find("Symbol") != std::string::npos)
+		{
+			SEXP dfColumn = VECTOR_ELT(_appendData,dfIndex);
+			tsdb::SymbolField* field = (tsdb::SymbolField*) tsStructure->getField(tableIndex);
+
+			if (Rf_isFactor(dfColumn))
+			{
+				//each level is looked up once, and NA is the empty symbol
+				Rcpp::StringVector levels(Rf_getAttrib(dfColumn, R_LevelsSymbol));
+				std::vector<tsdb::int32_t> codes(levels.length());
+				for (int j=0; j<levels.length(); j++)
+					codes[j] = field->symbols()->code((string) levels[j]);
+
+				for (int row=0; row<numRecordsToAppend; row++)
+				{
+					int level = INTEGER(dfColumn)[row];
+					records[row][tableIndex] = (level == NA_INTEGER) ? (tsdb::int32_t) 0 : codes[level - 1];
+				}
+			}
+			else
+			{
+				Rcpp::StringVector column(dfColumn);
+				for (int row=0; row<numRecordsToAppend; row++)
+					records[row][tableIndex] = (string) column[row];
+			}
+		}
 	}
 
-	//appending the data
+	//appending the data. The cached timeseries keeps track of what it appends, but
+	//after a failed append it is reopened from the file.
 	bool discardOverlap = Rcpp::as<bool>(_discardOverlap);
-	ts.appendRecordSet(records,discardOverlap);
+	try {
+		ts->appendRecordSet(records,discardOverlap);
+	} catch(...) {
+		tsdb::SeriesCache::global().invalidate(groupID, seriesName);
+		throw;
+	}
 
 	return Rcpp::wrap(1);
 }
@@ -11,6 +11,15 @@
 #include "record.h"
 #include "field.h"
 #include "table.h"
+#include "multiseriesquery.h"
+#include "aggregate.h"
+#include "columnkernels.h"
+#include "bufferedrecordset.h"
+#include "seriescache.h"
+#include "catalog.h"
+#include "predicate.h"
+#include "chunkcache.h"
+#include "symboltable.h"
 
 #include <boost/algorithm/string.hpp>
 #include <boost/make_shared.hpp>
@@ -21,8 +30,19 @@ RcppExport SEXP TSDBopen_file(SEXP _filename, SEXP _permission);
 RcppExport SEXP TSDBclose_file(SEXP _fid);
 RcppExport SEXP TSDBtimeseries(SEXP _fid);
 RcppExport SEXP TSDBget_properties(SEXP _goupID, SEXP _seriesName);
+RcppExport SEXP TSDBget_stats(SEXP _groupID, SEXP _seriesName, SEXP _reset);
+RcppExport SEXP TSDBset_chunk_cache(SEXP _capacityBytes);
+RcppExport SEXP TSDBget_chunk_cache_stats(SEXP _reset);
 RcppExport SEXP TSDBget_records(SEXP _groupID, SEXP _timeseriesName,
-		   SEXP _startTimestamp, SEXP _endTimestamp, SEXP _columnsWanted);
+		   SEXP _startTimestamp, SEXP _endTimestamp, SEXP _columnsWanted, SEXP _filter);
+RcppExport SEXP TSDBopen_cursor(SEXP _groupID, SEXP _seriesName,
+		   SEXP _startTimestamp, SEXP _endTimestamp, SEXP _columnsWanted, SEXP _chunkRows);
+RcppExport SEXP TSDBnext_chunk(SEXP _cursor);
+RcppExport SEXP TSDBclose_cursor(SEXP _cursor);
+RcppExport SEXP TSDBget_records_multi(SEXP _groupID, SEXP _seriesNames,
+		   SEXP _startTimestamp, SEXP _endTimestamp, SEXP _columnsWanted, SEXP _threads);
+RcppExport SEXP TSDBaggregate(SEXP _groupID, SEXP _seriesName,
+		   SEXP _startTimestamp, SEXP _endTimestamp, SEXP _bucketSize, SEXP _specs);
 RcppExport SEXP TSDBcreate_file(SEXP _fileName, SEXP _permission);
 RcppExport SEXP TSDBcreate_timeseries(SEXP _groupID, SEXP _seriesName,
 		   SEXP _seriesDescription, SEXP _columns);
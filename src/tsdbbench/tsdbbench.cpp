@@ -0,0 +1,541 @@
+/** \file
+ * <summary>Measures the throughput and latency of the main read, write and import paths on synthetic
+ * series, and prints the results as CSV.</summary>
+ * <remarks><p>tsdbbench writes a scratch TSDB file (and a CSV file next to it for the import benchmark), runs
+ * each benchmark, and removes both files when it is done. Every result is one line of standard output:</p>
+ *
+ * \code
+ * benchmark,series_records,operations,seconds,ops_per_second,us_per_op
+ * appendRecords_sorted,1048576,1048576,0.412,2545087.4,0.393
+ * recordId_LE,65536,1000,0.021,47619.0,21.000
+ * ...
+ * \endcode
+ *
+ * <p><c>series_records</c> is the size of the series the benchmark ran against (0 for the parser
+ * benchmarks, which do not touch a series), and <c>operations</c> is what was counted: records appended,
+ * scanned or imported, lookups, or lines parsed. The benchmarks are:</p>
+ * <list type="table">
+ * <item><term>appendRecords_sorted, appendRecords_unsorted</term><description>Timeseries::appendRecords()
+ * with batches of records in order, and with each batch shuffled, so that it is sorted first</description></item>
+ * <item><term>appendRecord</term><description>Timeseries::appendRecord() one record at a time, including
+ * the flushAppendBuffer() at the end</description></item>
+ * <item><term>recordId_LE, recordId_GE</term><description>random timestamp lookups, each time the sorted
+ * series doubles in size from a quarter of SPLIT_INDEX_GT, so lookups with and without the split index
+ * are both measured</description></item>
+ * <item><term>lookupAsOf</term><description>as many random timestamps, sorted, looked up at once with their
+ * records, at the same points</description></item>
+ * <item><term>scan_forward, scan_reverse</term><description>every record of the sorted series read one
+ * BufferedRecordSet buffer at a time</description></item>
+ * <item><term>parse_&lt;type&gt;</term><description>RecordParser::parseLine() on lines of one field of each
+ * type a FieldParser exists for</description></item>
+ * <item><term>parse_batch_&lt;type&gt;</term><description>RecordParser::parseLines() on the same lines,
+ * 1000 at a time</description></item>
+ * <item><term>import</term><description>the tsdbimport pipeline from a CSV file to a series, end to
+ * end</description></item>
+ * </list>
+ * <p>Settings and progress go to standard error, so the output can be piped straight into a comparison
+ * script. The defaults write about a million records; <c>--records</c> changes that.</p>
+ *
+ * \code
+ * > tsdbbench --records 4000000 --threads 4 /tmp/bench.tsdb > results.csv
+ * \endcode
+ * </remarks>
+ */
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <fcntl.h>
+
+#include "boost/date_time/posix_time/posix_time.hpp"
+
+#include "tsdb.h"
+#include "hdf5.h"
+
+#include "field.h"
+#include "fieldparser.h"
+#include "structure.h"
+#include "recordparser.h"
+#include "record.h"
+#include "cell.h"
+#include "timeseries.h"
+#include "bufferedrecordset.h"
+
+#include "importpipeline.h"
+
+#ifdef WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#define BYTES_PER_MB 1048576
+
+/* Timestamps of the synthetic records start here and are this many milliseconds apart */
+#define BENCH_EPOCH 1262304000000LL  // 2010-01-01
+#define BENCH_STEP 10
+
+/* -----------------------------------------------------------------
+ * Stopwatch. Adds up the wall clock time between start() and stop().
+ * -----------------------------------------------------------------
+ */
+class Stopwatch
+{
+public:
+	Stopwatch(void): my_seconds(0.0) {}
+	void start(void) { my_start = boost::posix_time::microsec_clock::universal_time(); }
+	void stop(void) {
+		my_seconds += (boost::posix_time::microsec_clock::universal_time() - my_start).total_microseconds() / 1e6;
+	}
+	double seconds(void) const { return my_seconds; }
+
+private:
+	boost::posix_time::ptime my_start;
+	double my_seconds;
+};
+
+/* Generates random numbers the same way on every platform, so runs can be compared */
+class Lcg
+{
+public:
+	Lcg(unsigned long long _seed): my_state(_seed) {}
+	unsigned long long next(void) {
+		my_state = my_state * 6364136223846793005ULL + 1442695040888963407ULL;
+		return my_state >> 33;
+	}
+
+private:
+	unsigned long long my_state;
+};
+
+void usage(void) {
+	using namespace std;
+	cerr << "Usage: tsdbbench [--records <n>] [--batch <n>] [--lookups <n>] [--threads <n>] [<scratch file>]" << endl;
+	cerr << "The scratch file defaults to tsdbbench.tsdb in the current directory, and is overwritten." << endl;
+}
+
+/* Prints one result line */
+void report(const std::string& benchmark, unsigned long long series_records, unsigned long long operations,
+	double seconds) {
+	printf("%s,%llu,%llu,%.6f,%.1f,%.4f\n", benchmark.c_str(), series_records, operations, seconds,
+		seconds > 0 ? operations / seconds : 0.0, operations > 0 ? seconds * 1e6 / operations : 0.0);
+	fflush(stdout);
+}
+
+/* Makes the fields of the benchmark series, after the timestamp: the fields of the tsdbimport example */
+std::vector<tsdb::Field*> series_fields(void) {
+	std::vector<tsdb::Field*> fields;
+	fields.push_back(new tsdb::DoubleField("price"));
+	fields.push_back(new tsdb::Int32Field("amount"));
+	fields.push_back(new tsdb::Int8Field("side"));
+	return fields;
+}
+
+/* Writes the records first .. first+n-1 of the synthetic series to records */
+void fill_records(tsdb::Structure* structure, char* records, unsigned long long first, size_t n) {
+	size_t record_size = structure->getSizeOf();
+	for(size_t i = 0; i < n; i++) {
+		unsigned long long k = first + i;
+		tsdb::timestamp_t timestamp = BENCH_EPOCH + (tsdb::timestamp_t) k * BENCH_STEP;
+		tsdb::ieee64_t price = 80.0 + (double) (k % 1000) / 100.0;
+		tsdb::int32_t amount = (tsdb::int32_t) (k % 100 + 1);
+		tsdb::int8_t side = (tsdb::int8_t) (k % 2);
+		char* record = records + record_size * i;
+		structure->setMember(record, 0, &timestamp);
+		structure->setMember(record, 1, &price);
+		structure->setMember(record, 2, &amount);
+		structure->setMember(record, 3, &side);
+	}
+}
+
+/* Shuffles n records in place */
+void shuffle_records(char* records, size_t n, size_t record_size, Lcg& random) {
+	std::vector<char> tmp(record_size);
+	for(size_t i = n; i > 1; i--) {
+		size_t j = (size_t) (random.next() % i);
+		memcpy(&tmp[0], records + record_size * (i - 1), record_size);
+		memcpy(records + record_size * (i - 1), records + record_size * j, record_size);
+		memcpy(records + record_size * j, &tmp[0], record_size);
+	}
+}
+
+/* Formats a timestamp as the import benchmark's CSV files have it */
+std::string format_timestamp(tsdb::timestamp_t timestamp) {
+	using namespace boost::posix_time;
+	ptime t = ptime(boost::gregorian::date(1970,1,1)) + milliseconds(timestamp);
+	time_duration day = t.time_of_day();
+	char text[64];
+	snprintf(text, sizeof(text), "%04d-%02d-%02d %02d:%02d:%02d.%03d", (int) t.date().year(), (int) t.date().month(),
+		(int) t.date().day(), (int) day.hours(), (int) day.minutes(), (int) day.seconds(),
+		(int) (day.fractional_seconds() / (time_duration::ticks_per_second() / 1000)));
+	return std::string(text);
+}
+
+/* Times nlookups lookups of random timestamps in ts, with recordId_LE and then recordId_GE, and then
+   the same number of sorted timestamps with lookupAsOf, records included */
+void bench_lookups(tsdb::Timeseries& ts, unsigned long long nrecords, size_t nlookups) {
+	tsdb::timestamp_t span = (tsdb::timestamp_t) nrecords * BENCH_STEP;
+	hsize_t record_id;
+
+	for(int ge = 0; ge < 2; ge++) {
+		Lcg random(nrecords + ge);
+		Stopwatch watch;
+		watch.start();
+		for(size_t i = 0; i < nlookups; i++) {
+			tsdb::timestamp_t timestamp = BENCH_EPOCH + (tsdb::timestamp_t) (random.next() % span);
+			if(ge) {
+				ts.recordId_GE(timestamp, &record_id);
+			} else {
+				ts.recordId_LE(timestamp, &record_id);
+			}
+		}
+		watch.stop();
+		report(ge ? "recordId_GE" : "recordId_LE", nrecords, nlookups, watch.seconds());
+	}
+
+	Lcg random(nrecords);
+	std::vector<tsdb::timestamp_t> timestamps(nlookups);
+	for(size_t i = 0; i < nlookups; i++) {
+		timestamps[i] = BENCH_EPOCH + (tsdb::timestamp_t) (random.next() % span);
+	}
+	std::sort(timestamps.begin(), timestamps.end());
+	std::vector<hsize_t> record_ids(nlookups);
+	std::vector<char> records(ts.structure()->getSizeOf() * nlookups);
+
+	Stopwatch watch;
+	watch.start();
+	ts.lookupAsOf(&timestamps[0], nlookups, &record_ids[0], &records[0]);
+	watch.stop();
+	report("lookupAsOf", nrecords, nlookups, watch.seconds());
+}
+
+/* Appends nrecords to a new series in batches, sorted or shuffled. The lookups are timed each time the
+   sorted series doubles. */
+void bench_append(hid_t fh, const std::string& name, unsigned long long nrecords, size_t batch, bool sorted,
+	size_t nlookups) {
+	tsdb::Timeseries ts(fh, name, "tsdbbench", series_fields());
+	boost::shared_ptr<tsdb::Structure> structure = ts.structure();
+	std::vector<char> records(structure->getSizeOf() * batch);
+	Lcg random(1);
+	unsigned long long next_lookups = SPLIT_INDEX_GT / 4;
+
+	Stopwatch watch;
+	for(unsigned long long done = 0; done < nrecords; ) {
+		size_t n = (size_t) std::min((unsigned long long) batch, nrecords - done);
+		fill_records(structure.get(), &records[0], done, n);
+		if(!sorted) {
+			shuffle_records(&records[0], n, structure->getSizeOf(), random);
+		}
+
+		watch.start();
+		ts.appendRecords(n, &records[0], false);
+		watch.stop();
+		done += n;
+
+		if(sorted && nlookups > 0 && done >= next_lookups) {
+			bench_lookups(ts, done, nlookups);
+			while(next_lookups <= done) {
+				next_lookups *= 2;
+			}
+		}
+	}
+	report(sorted ? "appendRecords_sorted" : "appendRecords_unsorted", nrecords, nrecords, watch.seconds());
+}
+
+/* Appends nrecords to a new series one at a time */
+void bench_append_record(hid_t fh, unsigned long long nrecords) {
+	tsdb::Timeseries ts(fh, "append_record", "tsdbbench", series_fields());
+	tsdb::Record record(ts.structure());
+
+	Stopwatch watch;
+	watch.start();
+	for(unsigned long long k = 0; k < nrecords; k++) {
+		record[0] = (tsdb::int64_t) (BENCH_EPOCH + (tsdb::timestamp_t) k * BENCH_STEP);
+		record[1] = (tsdb::ieee64_t) (80.0 + (double) (k % 1000) / 100.0);
+		record[2] = (tsdb::int32_t) (k % 100 + 1);
+		record[3] = (tsdb::int8_t) (k % 2);
+		ts.appendRecord(record);
+	}
+	ts.flushAppendBuffer();
+	watch.stop();
+	report("appendRecord", nrecords, nrecords, watch.seconds());
+}
+
+/* Reads the whole of a series forward and then in reverse, a buffer at a time */
+void bench_scans(hid_t fh, const std::string& name) {
+	tsdb::Timeseries ts(fh, name);
+	hsize_t nrecords = ts.getNRecords();
+	if(nrecords == 0) {
+		return;
+	}
+	size_t record_size = ts.structure()->getSizeOf();
+	size_t price_offset = ts.structure()->getOffsetOfField(1);
+
+	for(int reverse = 0; reverse < 2; reverse++) {
+		Stopwatch watch;
+		watch.start();
+		tsdb::BufferedRecordSet set = ts.bufferedRecordSet((hsize_t) 0, nrecords - 1);
+		set.set_my_buffer_direction(!reverse);
+		double sum = 0.0;
+		hsize_t scanned = 0;
+		hsize_t i = reverse ? set.size() - 1 : 0;
+		while(scanned < set.size()) {
+			hsize_t buf_first;
+			size_t nbufrecords;
+			const char* buf = set.buffer(i, &buf_first, &nbufrecords);
+			for(size_t j = 0; j < nbufrecords; j++) {
+				tsdb::ieee64_t price;
+				memcpy(&price, buf + record_size * j + price_offset, sizeof(price));
+				sum += price;
+			}
+			scanned += nbufrecords;
+			if(reverse) {
+				i = buf_first - 1;
+			} else {
+				i = buf_first + nbufrecords;
+			}
+		}
+		watch.stop();
+		if(sum < 0) {
+			std::cerr << sum;  // keeps the sum, and so the reads, from being optimized away
+		}
+		report(reverse ? "scan_reverse" : "scan_forward", nrecords, scanned, watch.seconds());
+	}
+}
+
+/* Parses nlines lines of one field with a RecordParser, one at a time, then in batches */
+void bench_parse(const std::string& type, tsdb::Field* field, tsdb::FieldParser* field_parser,
+	unsigned long long nlines) {
+	std::vector<tsdb::Field*> fields;
+	fields.push_back(field);
+	tsdb::Structure structure(fields, true);
+
+	tsdb::RecordParser parser;
+	parser.setRecordStructure(&structure);
+	parser.setSimpleParse(true);
+	parser.setDelimiter(",");
+	parser.addFieldParser(field_parser);
+
+	/* Make the lines first, so only parsing is timed */
+	std::vector<std::string> values;
+	for(size_t k = 0; k < 1000; k++) {
+		if(type == "timestamp") {
+			values.push_back(format_timestamp(BENCH_EPOCH + (tsdb::timestamp_t) k * 1234567));
+		} else if(type == "double") {
+			char text[32];
+			sprintf(text, "%.4f", 80.0 + (double) k / 1000.0);
+			values.push_back(text);
+		} else if(type == "int32") {
+			char text[32];
+			sprintf(text, "%d", (int) (k * 7919));
+			values.push_back(text);
+		} else if(type == "int8") {
+			char text[32];
+			sprintf(text, "%d", (int) (k % 100));
+			values.push_back(text);
+		} else if(type == "char") {
+			values.push_back(std::string(1, (char) ('A' + k % 26)));
+		} else {
+			values.push_back(k % 2 ? "USD/JPY" : "EUR/USD");
+		}
+	}
+
+	std::vector<char> record(structure.getSizeOf());
+	Stopwatch watch;
+	watch.start();
+	for(unsigned long long k = 0; k < nlines; k++) {
+		const std::string& line = values[k % values.size()];
+		parser.parseLine(line.c_str(), line.size(), &record[0]);
+	}
+	watch.stop();
+	report("parse_" + type, 0, nlines, watch.seconds());
+
+	std::vector<tsdb::TokenView> lines;
+	for(size_t k = 0; k < values.size(); k++) {
+		lines.push_back(tsdb::TokenView(values[k]));
+	}
+	std::vector<char> records(structure.getSizeOf() * lines.size());
+	Stopwatch batch_watch;
+	batch_watch.start();
+	for(unsigned long long k = 0; k < nlines; k += lines.size()) {
+		parser.parseLines(lines, &records[0]);
+	}
+	batch_watch.stop();
+	unsigned long long nbatched = (nlines + lines.size() - 1) / lines.size() * lines.size();
+	report("parse_batch_" + type, 0, nbatched, batch_watch.seconds());
+}
+
+/* A RecordParser for the CSV files of the import benchmark, with its FieldParsers */
+struct ImportParser
+{
+	ImportParser(tsdb::Structure* structure):
+		timestamp_parser(std::vector<size_t>(1, 0), "%Y-%m-%d %H:%M:%S%F", "_TSDB_timestamp"),
+		price_parser(1, "price"), amount_parser(2, "amount"), side_parser(3, "side") {
+		parser.setRecordStructure(structure);
+		parser.setSimpleParse(true);
+		parser.setDelimiter(",");
+		parser.addFieldParser(&timestamp_parser);
+		parser.addFieldParser(&price_parser);
+		parser.addFieldParser(&amount_parser);
+		parser.addFieldParser(&side_parser);
+	}
+
+	tsdb::TimestampFieldParser timestamp_parser;
+	tsdb::DoubleFieldParser price_parser;
+	tsdb::Int32FieldParser amount_parser;
+	tsdb::Int8FieldParser side_parser;
+	tsdb::RecordParser parser;
+};
+
+/* Writes nrecords lines of CSV to csv_file, and times importing them with the tsdbimport pipeline */
+void bench_import(hid_t fh, const std::string& csv_file, unsigned long long nrecords, int nthreads) {
+	FILE* csv = fopen(csv_file.c_str(), "wb");
+	if(csv == NULL) {
+		throw std::runtime_error("Unable to write '" + csv_file + "'.");
+	}
+	for(unsigned long long k = 0; k < nrecords; k++) {
+		std::string timestamp = format_timestamp(BENCH_EPOCH + (tsdb::timestamp_t) k * BENCH_STEP);
+		fprintf(csv, "%s,%.2f,%d,%d\n", timestamp.c_str(), 80.0 + (double) (k % 1000) / 100.0,
+			(int) (k % 100 + 1), (int) (k % 2));
+	}
+	if(fclose(csv) != 0) {
+		throw std::runtime_error("Unable to write '" + csv_file + "'.");
+	}
+
+	tsdb::Timeseries ts(fh, "import", "tsdbbench", series_fields());
+
+	/* The parsers of the tsdbimport example, one per thread */
+	std::vector<ImportParser*> parsers;
+	std::vector<tsdb::RecordParser*> record_parsers;
+	for(int t = 0; t < nthreads; t++) {
+		parsers.push_back(new ImportParser(ts.structure().get()));
+		record_parsers.push_back(&parsers.back()->parser);
+	}
+
+	#ifdef WIN32
+		int ifh = _open(csv_file.c_str(), _O_RDONLY | _O_BINARY);
+	#else
+		int ifh = open(csv_file.c_str(), O_RDONLY);
+	#endif
+	if(ifh == -1) {
+		throw std::runtime_error("Unable to open '" + csv_file + "'.");
+	}
+	#ifdef WIN32
+		long long size = _lseeki64(ifh, 0, SEEK_END);
+		_lseeki64(ifh, 0, SEEK_SET);
+	#else
+		long long size = lseek(ifh, 0, SEEK_END);
+		lseek(ifh, 0, SEEK_SET);
+	#endif
+
+	Stopwatch watch;
+	watch.start();
+	ImportPipeline pipeline(ifh, size, &ts, record_parsers, 5*BYTES_PER_MB);
+	long long nimported = pipeline.run();
+	ts.flushAppendBuffer();
+	watch.stop();
+
+	#ifdef WIN32
+		_close(ifh);
+	#else
+		close(ifh);
+	#endif
+	for(size_t i = 0; i < parsers.size(); i++) {
+		delete parsers[i];
+	}
+
+	report("import", nrecords, (unsigned long long) nimported, watch.seconds());
+}
+
+int main(int argc, char* argv[])
+{
+	using namespace std;
+	using namespace tsdb;
+
+	unsigned long long nrecords = 4ULL * SPLIT_INDEX_GT;  // so the lookups run on both sides of the split index
+	size_t batch = 10000;
+	size_t nlookups = 1000;
+	int nthreads = 1;
+	string filename = "tsdbbench.tsdb";
+
+	int arg = 1;
+	while(arg < argc && string(argv[arg]).substr(0,2) == "--") {
+		if(arg + 1 >= argc) {
+			break;
+		} else if(string(argv[arg]) == "--records") {
+			nrecords = strtoull(argv[arg+1], NULL, 10);
+		} else if(string(argv[arg]) == "--batch") {
+			batch = (size_t) atol(argv[arg+1]);
+		} else if(string(argv[arg]) == "--lookups") {
+			nlookups = (size_t) atol(argv[arg+1]);
+		} else if(string(argv[arg]) == "--threads") {
+			nthreads = atoi(argv[arg+1]);
+		} else {
+			break;
+		}
+		arg += 2;
+	}
+	if(arg < argc) {
+		filename = argv[arg++];
+	}
+	if(arg != argc || nrecords == 0 || batch == 0 || nthreads < 1) {
+		cerr << "Error: Invalid arguments." << endl;
+		usage();
+		return -1;
+	}
+	string csv_file = filename + ".csv";
+
+	cerr << "tsdbbench: " << nrecords << " records, batches of " << batch << ", " << nlookups << " lookups, " <<
+		nthreads << " parser thread(s)" << endl;
+	cerr << "SPLIT_INDEX_GT=" << SPLIT_INDEX_GT << " INDEX_STEP=" << INDEX_STEP << " SEARCH_WINDOW=" <<
+		SEARCH_WINDOW << " BUFFER_BYTES=" << BUFFER_BYTES << endl;
+
+	hid_t fh = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+	if(fh < 0) {
+		cerr << "Error: Unable to create scratch file: '" << filename << "'." << endl;
+		return -1;
+	}
+
+	int ret = 0;
+	try {
+		printf("benchmark,series_records,operations,seconds,ops_per_second,us_per_op\n");
+
+		bench_append(fh, "sorted", nrecords, batch, true, nlookups);
+		bench_append(fh, "unsorted", nrecords, batch, false, 0);
+		bench_append_record(fh, nrecords);
+		bench_scans(fh, "sorted");
+
+		/* The Structure of each parser benchmark deletes its field */
+		TimestampFieldParser timestamp_parser(vector<size_t>(1, 0), "%Y-%m-%d %H:%M:%S%F", "value");
+		DoubleFieldParser double_parser(0, "value");
+		Int32FieldParser int32_parser(0, "value");
+		Int8FieldParser int8_parser(0, "value");
+		CharFieldParser char_parser(0, "value");
+		StringFieldParser string_parser(vector<size_t>(1, 0), "value");
+		bench_parse("timestamp", new TimestampField("value"), &timestamp_parser, nrecords);
+		bench_parse("double", new DoubleField("value"), &double_parser, nrecords);
+		bench_parse("int32", new Int32Field("value"), &int32_parser, nrecords);
+		bench_parse("int8", new Int8Field("value"), &int8_parser, nrecords);
+		bench_parse("char", new CharField("value"), &char_parser, nrecords);
+		bench_parse("string", new StringField("value", 8), &string_parser, nrecords);
+
+		bench_import(fh, csv_file, nrecords, nthreads);
+	} catch(std::exception &e) {
+		cerr << "Exception:" << endl;
+		cerr << e.what() << endl;
+		ret = -1;
+	}
+
+	if(H5Fclose(fh) < 0) {
+		cerr << "Warning: error closing scratch file." << endl;
+	}
+	remove(filename.c_str());
+	remove(csv_file.c_str());
+	return ret;
+}
@@ -1,6 +1,6 @@
 /** \file 
  * <summary>Creates a new TSDB file and series, or, if the file exists, a new series in the file.</summary>
- * <remarks><code>Usage: tsdbcreate <filename> <series> (<field type> <field name>)</code>
+ * <remarks><code>Usage: tsdbcreate [--uncompressed] [--swmr] <filename> <series> (<field type> <field name>)</code>
  * <p>List field type and field names in pairs. Valid field types are:</p>
  * <ul>
  * <li>int8&ndash;8-bit signed integer</li>
@@ -9,11 +9,19 @@
  * <li>char&ndash;8-bit signed integer representing a ANSI character</li>
  * <li>timestamp&ndash;64-bit signed integer representing milliseconds before or after Jan 1, 1970 00:00:00</li>
  * <li>record&ndash;64-bit signed integer representing a record id (used internally)</li>
+ * <li>string(n)&ndash;a string of up to n characters</li>
+ * <li>symbol(n)&ndash;a string of up to n characters from a small set, such as a venue, stored as a code in a
+ * dictionary kept with the series (see SymbolField)</li>
  * </ul>
  * <p>An example:</p>
  * <code>&gt; tsdbcreate usdjpy.tsdb series1 double price int32 amount int8 side</code>
  * <p><strong>NOTE:</strong> A timestamp field called &ldquo;_TSDB_timestamp&rdquo; is automatically added
  * to the start of the field list. This field is used to order the records in the timeseries.</p>
+ * <p>With <c>--uncompressed</c> first, the series is stored without compression. It takes more space, but
+ * programs that open the file read only can then read it through a memory mapping, without copying it
+ * (see Timeseries::mapRecords()).</p>
+ * <p>With <c>--swmr</c>, the file is created (or opened) with the latest HDF5 file format, so that the
+ * series can be appended to while other programs read it (see Swmr, and <c>tsdbimport --swmr</c>).</p>
  * </remarks>
  * 
  */
@@ -31,6 +39,8 @@
 #include "field.h"
 #include "structure.h"
 #include "timeseries.h"
+#include "storageoptions.h"
+#include "swmr.h"
 
 
 int main(int argc, char* argv[])
@@ -38,14 +48,26 @@ int main(int argc, char* argv[])
 	using namespace std;
 	using namespace tsdb;
 
+	StorageOptions options;
+	bool swmr = false;
+	while(argc > 1 && (string(argv[1]) == "--uncompressed" || string(argv[1]) == "--swmr")) {
+		if(string(argv[1]) == "--uncompressed") {
+			options.setCompression(StorageOptions::NONE);
+		} else {
+			swmr = true;
+		}
+		argv++;
+		argc--;
+	}
+
 	if(argc < 5) {
 		cerr << "One or more fields required." << endl;
-		cerr << "Usage: tsdbcreate <filename> <series> (<field type> <field name>)..." << endl;
+		cerr << "Usage: tsdbcreate [--uncompressed] [--swmr] <filename> <series> (<field type> <field name>)..." << endl;
 		return -1;
 	}
 	if((argc-3) % 2 != 0) {
 		cerr << "Each field must have a type and name." << endl;
-		cerr << "Usage: tsdbcreate <filename> <series> [<field type> <field name>]..." << endl;
+		cerr << "Usage: tsdbcreate [--uncompressed] [--swmr] <filename> <series> [<field type> <field name>]..." << endl;
 		return -1;
 	}
 
@@ -84,6 +106,14 @@ int main(int argc, char* argv[])
 			fields.push_back(new CharField(field_name));
 		} else if(field_type == "RECORD") {
 			fields.push_back(new RecordField(field_name));
+		} else if(field_type.compare(0, 7, "SYMBOL(") == 0) {
+			int max_length = atoi(field_type.c_str() + 7);
+			if(max_length < 1) {
+				cerr << "Size of " << max_length << " is too small." << endl;
+				return -1;
+			}
+
+			fields.push_back(new SymbolField(field_name,max_length));
 		} else if(field_type.find_first_of("STRING(") == 0) {
 			// The user wants a string type. Determine the size
 			std::string size_str = field_type.substr(7,field_type.length()-8);
@@ -106,27 +136,39 @@ int main(int argc, char* argv[])
 	int intstat;
 	intstat = stat(filename.c_str(),&finfo);
 	hid_t ofh;
+	hid_t fapl = H5P_DEFAULT;
+	if(swmr) {
+		try {
+			fapl = Swmr::fileAccessList();
+		} catch(runtime_error& e) {
+			cerr << e.what() << endl;
+			return -1;
+		}
+	}
 	if(intstat != 0) {
 		// Try to create the file
-		ofh = H5Fcreate(filename.c_str(),H5F_ACC_EXCL,H5P_DEFAULT,H5P_DEFAULT);
+		ofh = H5Fcreate(filename.c_str(),H5F_ACC_EXCL,H5P_DEFAULT,fapl);
 		if(ofh < 0) {
 			cerr << "Error creating TSDB file: '" << filename << "'." << endl;
 			return -1;
 		}
 	} else {
 		// Try to open the file
-		ofh = H5Fopen(filename.c_str(), H5F_ACC_RDWR, H5P_DEFAULT);
+		ofh = H5Fopen(filename.c_str(), H5F_ACC_RDWR, fapl);
 		if(ofh < 0) {
 			cerr << "Error opening TSDB file: '" << filename << "'." << endl;
 			return -1;
 		}
 	}
+	if(swmr) {
+		H5Pclose(fapl);
+	}
 
 	/* Create timeseries */
 	herr_t status;
 	try {
 		boost::shared_ptr<Structure> st = boost::make_shared<Structure>(fields,false); /* Note: no memory alignment for better space utilization */
-		Timeseries ts = Timeseries(ofh,series,"",st);
+		Timeseries ts(ofh,series,"",st,options);
 	} catch( TableException &ex ) {
 		cerr << ex.what();
 		status = H5Fclose(ofh);
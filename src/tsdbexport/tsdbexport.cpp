@@ -0,0 +1,115 @@
+/** \file
+ * <summary>Writes a time range of a series to an Arrow IPC file, or appends the records of one to a
+ * series.</summary>
+ * <remarks><p>Arrow IPC files, also known as Feather version 2 files, are read directly by pandas
+ * (<c>pandas.read_feather</c>), pyarrow, Spark and DuckDB, so this hands data to them without the text
+ * round trip of tsdbview and a CSV reader. See ArrowWriter for how fields map to Arrow types.</p>
+ *
+ * \code
+ * > tsdbexport usdjpy.tsdb series1 20100101T000000 20100201T000000 usdjpy.arrow
+ * \endcode
+ *
+ * <p>With <c>--import</c>, the records of an Arrow IPC file or stream are appended to an existing series
+ * instead. Each field is read from the column with the same name, and the timestamp from the first timestamp
+ * column if none is named after it; see ArrowReader. Records before the end of the series are discarded, as
+ * tsdbimport does.</p>
+ *
+ * \code
+ * > tsdbexport --import usdjpy.arrow usdjpy.tsdb series2
+ * \endcode
+ *
+ * <p>Either file name may be <c>-</c> for standard output or input.</p></remarks>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "boost/date_time/posix_time/posix_time.hpp"
+#include "tsdb.h"
+#include "timeseries.h"
+#include "arrowipc.h"
+#include "hdf5.h"
+
+
+void usage(void) {
+	using namespace std;
+	cerr << "Usage: tsdbexport <filename> <series> <start_date> <end_date> <arrow file>" << endl <<
+		"       tsdbexport --import <arrow file> <filename> <series>" << endl;
+	cerr << "Date format is YYYYMMDDThhmmssffff. Fractional seconds optional." << endl <<
+		"For example, 20080201T010000" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+	using namespace std;
+	using namespace boost::posix_time;
+	using namespace tsdb;
+
+	bool import = argc > 1 && string(argv[1]) == "--import";
+	if((import && argc != 5) || (!import && argc != 6)) {
+		cerr << "Error: Not enough or invalid arguments." << endl;
+		usage();
+		return -1;
+	}
+
+	string arrow_file = import ? argv[2] : argv[5];
+	string filename = import ? argv[3] : argv[1];
+	string series = import ? argv[4] : argv[2];
+
+	hid_t ofh = H5Fopen(filename.c_str(), import ? H5F_ACC_RDWR : H5F_ACC_RDONLY, H5P_DEFAULT);
+	if(ofh < 0) {
+		cerr << "Error: Unable to open TSDB file: '" << filename << "'." << endl;
+		return -1;
+	}
+
+	FILE* arrow = NULL;
+	if(arrow_file == "-") {
+		arrow = import ? stdin : stdout;
+	} else {
+		arrow = fopen(arrow_file.c_str(), import ? "rb" : "wb");
+	}
+	if(arrow == NULL) {
+		cerr << "Error: Unable to open Arrow file: '" << arrow_file << "'." << endl;
+		H5Fclose(ofh);
+		return -1;
+	}
+
+	int ret = 0;
+	try {
+		Timeseries ts(ofh, series);
+
+		if(import) {
+			hsize_t nrecords = ArrowReader::appendFile(ts, arrow, true);
+			cerr << "Appended " << nrecords << " records." << endl;
+		} else {
+			// The file is read only, so an uncompressed series is read through a mapping
+			ts.mapRecords();
+
+			ptime start(from_iso_string(argv[3]));
+			ptime end(from_iso_string(argv[4]));
+
+			if(start > end) {
+				throw(TimeseriesException("Start timestamp cannot be greater than end timestamp."));
+			}
+
+			hsize_t nrecords = ArrowWriter::writeRange(ts, ptime_to_timestamp(start), ptime_to_timestamp(end), arrow);
+			if(fflush(arrow) != 0) {
+				throw ArrowException("Unable to write to the output file.");
+			}
+			cerr << "Wrote " << nrecords << " records." << endl;
+		}
+	} catch(std::exception &e) {
+		cerr << "Exception:" << endl;
+		cerr << e.what() << endl;
+		ret = -1;
+	}
+
+	if(arrow != stdin && arrow != stdout && fclose(arrow) != 0) {
+		cerr << "Error: Unable to close Arrow file: '" << arrow_file << "'." << endl;
+		ret = -1;
+	}
+	if(H5Fclose(ofh) < 0) {
+		cerr << "Warning: error closing TSDB file. There may be data corruption." << endl;
+		ret = -1;
+	}
+	return ret;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+/* STL Classes */
+#include <deque>
+
+/* Boost */
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/condition_variable.hpp"
+
+/* -----------------------------------------------------------------
+ * BoundedQueue. A blocking queue with a maximum size.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>A thread safe FIFO queue that holds at most <c>capacity</c> items</summary>
+ * <remarks><p><c>push()</c> blocks while the queue is full and <c>pop()</c> blocks while it is empty,
+ * so a fast producer waits for a slow consumer instead of filling up memory.</p>
+ * <p><c>close()</c> is called by the producer when it is done: consumers drain the remaining items,
+ * then <c>pop()</c> returns false. <c>abort()</c> also drops the remaining items, and is used to stop
+ * all threads after an error.</p></remarks>
+ */
+template <class T>
+class BoundedQueue
+{
+public:
+	BoundedQueue(size_t _capacity): my_capacity(_capacity > 0 ? _capacity : 1), my_closed(false) {}
+
+	/** <summary>Adds an item, waiting while the queue is full</summary>
+	 * <remarks>Returns false if the queue has been closed, in which case the item is not added.</remarks>
+	 */
+	bool push(const T& item) {
+		boost::unique_lock<boost::mutex> lock(my_mutex);
+		while(my_items.size() >= my_capacity && !my_closed) {
+			my_not_full.wait(lock);
+		}
+		if(my_closed) {
+			return false;
+		}
+		my_items.push_back(item);
+		my_not_empty.notify_one();
+		return true;
+	}
+
+	/** <summary>Removes the oldest item, waiting while the queue is empty</summary>
+	 * <remarks>Returns false if the queue is closed and empty (or aborted).</remarks>
+	 */
+	bool pop(T* item) {
+		boost::unique_lock<boost::mutex> lock(my_mutex);
+		while(my_items.empty() && !my_closed) {
+			my_not_empty.wait(lock);
+		}
+		if(my_items.empty()) {
+			return false;
+		}
+		*item = my_items.front();
+		my_items.pop_front();
+		my_not_full.notify_one();
+		return true;
+	}
+
+	/** <summary>No more items will be pushed</summary> */
+	void close(void) {
+		boost::lock_guard<boost::mutex> lock(my_mutex);
+		my_closed = true;
+		my_not_full.notify_all();
+		my_not_empty.notify_all();
+	}
+
+	/** <summary>Closes the queue and drops the items in it</summary> */
+	void abort(void) {
+		boost::lock_guard<boost::mutex> lock(my_mutex);
+		my_closed = true;
+		my_items.clear();
+		my_not_full.notify_all();
+		my_not_empty.notify_all();
+	}
+
+private:
+	BoundedQueue(const BoundedQueue&);
+	BoundedQueue& operator=(const BoundedQueue&);
+
+	boost::mutex my_mutex;
+	boost::condition_variable my_not_full;
+	boost::condition_variable my_not_empty;
+	std::deque<T> my_items;
+	size_t my_capacity;
+	bool my_closed;
+};
@@ -0,0 +1,458 @@
+/* STL Classes */
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdlib.h>
+#include <string.h>
+
+/* Boost */
+#include "boost/bind.hpp"
+#include "boost/thread/thread.hpp"
+#include "boost/date_time/posix_time/posix_time.hpp"
+
+#include "importpipeline.h"
+#include "inputstream.h"
+#include "symboltable.h"
+
+/* ====================================================================
+ * struct ImportChunk - a piece of the input file
+ * ====================================================================
+ */
+
+ImportChunk::ImportChunk(void) {
+	first_line = 0;
+	bytes_read = 0;
+	records = NULL;
+	nrecords = 0;
+	parsed = false;
+}
+
+ImportChunk::~ImportChunk(void) {
+	free(records);
+}
+
+/* ====================================================================
+ * class ImportPipeline - multi threaded import of a delimited file
+ * ====================================================================
+ */
+
+/** <summary>Sets up an import</summary>
+ * <param name="_ifh">File handle of the input file, positioned at the start of the file</param>
+ * <param name="_file_size">Size of the input file, for the progress meter</param>
+ * <param name="_out_ts">Timeseries to append the records to</param>
+ * <param name="_parsers">One RecordParser per parser thread. They must all be bound to the structure
+ * of <c>_out_ts</c>. The caller keeps ownership.</param>
+ * <param name="_chunk_size">Size in bytes of the chunks the file is read in</param>
+ * <param name="_progress">Called after each chunk is written, or NULL</param>
+ */
+ImportPipeline::ImportPipeline(int _ifh, long long _file_size, tsdb::Timeseries* _out_ts,
+	const std::vector<tsdb::RecordParser*>& _parsers, size_t _chunk_size, ProgressFunc _progress):
+	my_parse_queue(2 * _parsers.size()), my_write_queue(2 * _parsers.size()) {
+	init(_ifh, _file_size, std::vector<tsdb::Timeseries*>(1, _out_ts), _parsers, _chunk_size, _progress);
+}
+
+/** <summary>Sets up an import that splits the file into several series</summary>
+ * <remarks>The same as the constructor for one series, but the RecordRouter of the parsers picks which
+ * of <c>_out_series</c> each record goes to. Throws a <c>std::runtime_error</c> if the parsers have no
+ * router, or it has destinations that are not in <c>_out_series</c>.</remarks>
+ */
+ImportPipeline::ImportPipeline(int _ifh, long long _file_size, const std::vector<tsdb::Timeseries*>& _out_series,
+	const std::vector<tsdb::RecordParser*>& _parsers, size_t _chunk_size, ProgressFunc _progress):
+	my_parse_queue(2 * _parsers.size()), my_write_queue(2 * _parsers.size()) {
+	init(_ifh, _file_size, _out_series, _parsers, _chunk_size, _progress);
+}
+
+/** <summary>Checks the arguments of the constructors, and keeps them</summary> */
+void ImportPipeline::init(int _ifh, long long _file_size, const std::vector<tsdb::Timeseries*>& _out_series,
+	const std::vector<tsdb::RecordParser*>& _parsers, size_t _chunk_size, ProgressFunc _progress) {
+
+	if(_parsers.empty()) {
+		throw(std::runtime_error("the import pipeline needs at least one parser"));
+	}
+	if(_out_series.empty()) {
+		throw(std::runtime_error("the import pipeline needs at least one series"));
+	}
+
+	my_ifh = _ifh;
+	my_file_size = _file_size;
+	my_out_series = _out_series;
+	my_parsers = _parsers;
+	my_chunk_size = _chunk_size > 0 ? _chunk_size : 1;
+	my_record_size = _out_series[0]->structure()->getSizeOf();
+	my_progress = _progress;
+	my_horizon = -1;
+
+	boost::shared_ptr<tsdb::Structure> structure = _out_series[0]->structure();
+	for(size_t s = 1; s < _out_series.size(); s++) {
+		if(_out_series[s]->structure()->getSizeOf() != my_record_size) {
+			throw(std::runtime_error("the series of an import must all have the same structure"));
+		}
+		for(size_t f = 0; f < structure->getNFields(); f++) {
+			if(structure->getField(f)->getFieldType() == tsdb::Field::SYMBOL &&
+				_out_series[s]->structure()->getField(f)->getFieldType() != tsdb::Field::SYMBOL) {
+				throw(std::runtime_error("the series of an import must all have the same structure"));
+			}
+		}
+	}
+	my_symbol_codes.assign(_out_series.size(), std::vector<std::vector<tsdb::symbol_t> >(structure->getNFields()));
+	for(size_t p = 0; p < _parsers.size(); p++) {
+		const boost::shared_ptr<tsdb::RecordRouter>& router = _parsers[p]->router();
+		if(router.get() == NULL ? _out_series.size() > 1 : router->nDestinations() > _out_series.size()) {
+			throw(std::runtime_error("the routes of the parsers do not match the series of the import"));
+		}
+	}
+}
+
+/** <summary>Keeps records that are out of order, holding records back for <c>_horizon</c> milliseconds</summary>
+ * <remarks>See ReorderBuffer. Records later than the horizon are still kept, but make the writer rewrite the
+ * end of the Timeseries.</remarks>
+ */
+void ImportPipeline::setHorizon(tsdb::timestamp_t _horizon) {
+	my_horizon = _horizon;
+}
+
+/** <summary>Runs the import. Returns the number of records written.</summary>
+ * <remarks>Lines that can not be parsed are reported on cerr and skipped, as are records that are out
+ * of order when there is no horizon. Any other error stops all threads, and is rethrown as a
+ * <c>std::runtime_error</c>.</remarks>
+ */
+long long ImportPipeline::run(void) {
+	using namespace boost::posix_time;
+
+	long long outnumber = 0;
+	ptime starttime = microsec_clock::universal_time();
+
+	boost::thread_group threads;
+	threads.create_thread(boost::bind(&ImportPipeline::readChunks, this));
+	for(size_t i = 0; i < my_parsers.size(); i++) {
+		threads.create_thread(boost::bind(&ImportPipeline::parseChunks, this, my_parsers[i]));
+	}
+
+	std::vector<boost::shared_ptr<tsdb::ReorderBuffer> > reorders(my_out_series.size());
+	if(my_horizon >= 0) {
+		for(size_t s = 0; s < my_out_series.size(); s++) {
+			reorders[s].reset(new tsdb::ReorderBuffer(my_out_series[s], my_horizon));
+		}
+	}
+
+	// Records routed to each series, waiting to be appended
+	std::vector<std::vector<char> > buffers(my_out_series.size());
+	long long nbuffered = 0;
+
+	try {
+		ImportChunkPtr chunk;
+		while(my_write_queue.pop(&chunk)) {
+			// Wait for the chunk to be parsed. Chunks come out of the queue in file order.
+			{
+				boost::unique_lock<boost::mutex> lock(chunk->mutex);
+				while(!chunk->parsed) {
+					chunk->parsed_cond.wait(lock);
+				}
+			}
+
+			if(!chunk->error.empty()) {
+				throw(std::runtime_error(chunk->error));
+			}
+
+			if(chunk->routes.empty()) {
+				outnumber += appendToSeries(0, chunk->nrecords, chunk->records, reorders);
+			} else {
+				for(int i = 0; i < chunk->nrecords; i++) {
+					std::vector<char>& buffer = buffers[chunk->routes[i]];
+					const char* record = ((const char*) chunk->records) + i * my_record_size;
+					buffer.insert(buffer.end(), record, record + my_record_size);
+					nbuffered++;
+					if(buffer.size() >= BUFFER_BYTES) {
+						nbuffered -= buffer.size() / my_record_size;
+						outnumber += appendToSeries(chunk->routes[i], buffer.size() / my_record_size, &buffer[0],
+							reorders);
+						buffer.clear();
+					}
+				}
+			}
+
+			free(chunk->records);
+			chunk->records = NULL;
+
+			if(my_progress != NULL) {
+				double seconds = (microsec_clock::universal_time() - starttime).total_milliseconds() / 1000.0;
+				if(seconds <= 0) {
+					seconds = 0.001;
+				}
+				my_progress((double) chunk->bytes_read, (double) my_file_size,
+					((double) chunk->bytes_read / 1048576) / seconds, ((double) (outnumber + nbuffered)) / seconds);
+			}
+			chunk.reset();
+		}
+
+		for(size_t s = 0; s < my_out_series.size(); s++) {
+			if(!buffers[s].empty()) {
+				outnumber += appendToSeries(s, buffers[s].size() / my_record_size, &buffers[s][0], reorders);
+				std::vector<char>().swap(buffers[s]);
+			}
+		}
+
+		hsize_t late = 0;
+		for(size_t s = 0; s < reorders.size(); s++) {
+			if(reorders[s].get() != 0) {
+				reorders[s]->flush();
+				late += reorders[s]->lateRecords();
+			}
+		}
+		if(late > 0) {
+			boost::lock_guard<boost::mutex> lock(my_output_mutex);
+			std::cerr << late << " record(s) arrived after the horizon, and were merged "
+				"into the series." << std::endl;
+		}
+	} catch(...) {
+		stop();
+		threads.join_all();
+		throw;
+	}
+
+	threads.join_all();
+
+	if(!my_read_error.empty()) {
+		throw(std::runtime_error(my_read_error));
+	}
+
+	return outnumber;
+}
+
+/** <summary>Appends records to series <c>series</c>, or to its ReorderBuffer. Returns the number of records
+ * kept.</summary>
+ */
+long long ImportPipeline::appendToSeries(size_t series, size_t nrecords, void* records,
+	std::vector<boost::shared_ptr<tsdb::ReorderBuffer> >& reorders) {
+	if(series > 0) {
+		recodeSymbols(series, nrecords, (char*) records);
+	}
+
+	if(reorders[series].get() != 0) {
+		reorders[series]->addRecords(nrecords, records);
+		return (long long) nrecords;
+	}
+
+	int ndiscrec = my_out_series[series]->appendRecords(nrecords, records, true);
+	if(ndiscrec > 0) {
+		/* Some records were discarded because they overlapped. Warn the user */
+		boost::lock_guard<boost::mutex> lock(my_output_mutex);
+		std::cerr << ndiscrec << " record(s) discarded because they were misordered." << std::endl;
+	}
+	return (long long) nrecords - ndiscrec;
+}
+
+/** <summary>Gives the Symbol fields of records routed to series <c>series</c> the codes of its own
+ * dictionaries</summary>
+ * <remarks>The parsers are bound to the Structure of the first series, so they add the symbols to its
+ * dictionaries. The codes of the other series are looked up once per symbol.</remarks>
+ */
+void ImportPipeline::recodeSymbols(size_t series, size_t nrecords, char* records) {
+	tsdb::Structure& from = *my_out_series[0]->structure();
+	tsdb::Structure& to = *my_out_series[series]->structure();
+
+	for(size_t f = 0; f < from.getNFields(); f++) {
+		if(from.getField(f)->getFieldType() != tsdb::Field::SYMBOL) {
+			continue;
+		}
+		tsdb::SymbolTable& from_symbols = *((tsdb::SymbolField*) from.getField(f))->symbols();
+		tsdb::SymbolTable& to_symbols = *((tsdb::SymbolField*) to.getField(f))->symbols();
+		if(&from_symbols == &to_symbols) {
+			continue;
+		}
+
+		std::vector<tsdb::symbol_t>& codes = my_symbol_codes[series][f];
+		char* value = records + from.getOffsetOfField(f);
+		for(size_t i = 0; i < nrecords; i++, value += my_record_size) {
+			tsdb::symbol_t code;
+			memcpy(&code, value, sizeof(code));
+			if((size_t) code >= codes.size()) {
+				std::vector<std::string> symbols = from_symbols.symbols(codes.size());
+				for(size_t j = 0; j < symbols.size(); j++) {
+					codes.push_back(to_symbols.code(symbols[j]));
+				}
+			}
+			memcpy(value, &codes[code], sizeof(code));
+		}
+	}
+}
+
+/** <summary>Stops the reader and the parsers after an error</summary> */
+void ImportPipeline::stop(void) {
+	my_write_queue.abort();
+	my_parse_queue.abort();
+}
+
+/** <summary>Reader thread. Reads the file into chunks of complete lines.</summary>
+ * <remarks>Each chunk is queued twice: for the parsers, and for the writer, which takes the chunks
+ * in file order. A line longer than the chunk size makes the chunk larger. Compressed files are
+ * decompressed here, through an InputStream, so the chunks always hold text.</remarks>
+ */
+void ImportPipeline::readChunks(void) {
+	std::vector<char> carry;  // the start of a line that did not fit in the previous chunk
+	long long lines = 0;
+	long long completed = 0;
+	bool eof = false;
+
+	try {
+		std::auto_ptr<InputStream> input(InputStream::open(my_ifh, my_parsers.size()));
+
+		while(!eof) {
+			ImportChunkPtr chunk(new ImportChunk());
+			std::vector<char>& text = chunk->text;
+			text.swap(carry);
+
+			size_t used = text.size();
+			size_t end = 0;  // end of the last complete line
+			text.resize(used + my_chunk_size);
+
+			while(end == 0) {
+				if(used == text.size()) {
+					text.resize(text.size() + my_chunk_size);
+				}
+
+				size_t bytes_read = input->read(&text[used], text.size() - used);
+
+				if(bytes_read == 0) {
+					// end of file reached!
+					eof = true;
+					end = used;
+					break;
+				}
+
+				used += bytes_read;
+				completed += bytes_read;
+
+				if(used == text.size()) {
+					// The chunk is full; cut it after the last newline
+					for(size_t i = used; i > 0; i--) {
+						if(text[i - 1] == '\n') {
+							end = i;
+							break;
+						}
+					}
+				}
+			}
+
+			carry.assign(text.begin() + end, text.begin() + used);
+			text.resize(end);
+			if(text.empty()) {
+				break;
+			}
+
+			chunk->first_line = lines;
+			if(input->format() == "plain") {
+				chunk->bytes_read = completed - (long long) carry.size();
+			} else {
+				// Progress is in bytes of the file, and the carry can't be mapped back to compressed bytes
+				chunk->bytes_read = input->consumed();
+			}
+			lines += std::count(text.begin(), text.end(), '\n');
+
+			if(!my_write_queue.push(chunk) || !my_parse_queue.push(chunk)) {
+				break;  // the writer stopped
+			}
+		}
+	} catch(std::exception& e) {
+		my_read_error = std::string("Error reading input file: ") + e.what();
+	}
+
+	my_write_queue.close();
+	my_parse_queue.close();
+}
+
+/** <summary>Parser thread. Parses chunks until there are none left.</summary> */
+void ImportPipeline::parseChunks(tsdb::RecordParser* parser) {
+	ImportChunkPtr chunk;
+	while(my_parse_queue.pop(&chunk)) {
+		try {
+			parseChunk(parser, chunk.get());
+		} catch(std::exception& e) {
+			chunk->error = e.what();
+		}
+
+		{
+			boost::lock_guard<boost::mutex> lock(chunk->mutex);
+			chunk->parsed = true;
+		}
+		chunk->parsed_cond.notify_all();
+		chunk.reset();
+	}
+}
+
+/** <summary>Parses the lines of a chunk into a block of records</summary>
+ * <remarks>Lines may end in \n, \r\n or \r. Blank lines are skipped. The lines of the chunk are parsed
+ * together with RecordParser::parseLines(), which parses each field for all of them at once. Lines that
+ * can not be parsed are reported on cerr with their line number, and skipped.</remarks>
+ */
+void ImportPipeline::parseChunk(tsdb::RecordParser* parser, ImportChunk* chunk) {
+	std::vector<char>& text = chunk->text;
+
+	// Terminate the last line of the file, if it has no newline
+	if(text.back() != '\n' && text.back() != '\r') {
+		text.push_back('\n');
+	}
+
+	// Each line ends in at least one \r or \n, so this bounds the number of records
+	size_t nterminators = 0;
+	for(size_t i = 0; i < text.size(); i++) {
+		if(text[i] == '\n' || text[i] == '\r') {
+			nterminators++;
+		}
+	}
+
+	chunk->records = malloc(my_record_size * (nterminators + 1));
+	if(chunk->records == NULL) {
+		throw(std::runtime_error("Out of memory in records allocation."));
+	}
+	bool routed = (parser->router().get() != NULL);
+
+	char* buffer = &text[0];
+	char* line_start = NULL;
+	bool line_started = false;
+	long long linenumber = chunk->first_line;  // lines before the current position
+	std::vector<tsdb::TokenView> lines;
+	std::vector<long long> linenumbers;        // line number of each of the lines
+	lines.reserve(nterminators);
+	linenumbers.reserve(nterminators);
+
+	for(size_t i = 0; i < text.size(); i++) {
+		char c = buffer[i];
+		if(line_started) {
+			// If a line has been started, find the end of the line
+			if(c == '\r' || c == '\n') {
+				lines.push_back(tsdb::TokenView(line_start, (buffer + i) - line_start));
+				line_started = false;
+			}
+		} else if(c != '\n' && c != '\r' && c != '\0') {
+			// A line has just ended, so look for one non-newline or null char to start a new line
+			line_started = true;
+			line_start = buffer + i;
+			linenumbers.push_back(linenumber + 1);
+		}
+
+		if(c == '\n') {
+			linenumber++;
+		}
+	}
+
+	std::vector<tsdb::LineError> errors;
+	chunk->nrecords = (int) parser->parseLines(lines, chunk->records, routed ? &chunk->routes : NULL, &errors);
+
+	/* Output the lines that could not be parsed, which were skipped */
+	if(!errors.empty()) {
+		boost::lock_guard<boost::mutex> lock(my_output_mutex);
+		for(size_t i = 0; i < errors.size(); i++) {
+			const tsdb::TokenView& line = lines[errors[i].line];
+			std::cerr << "Error parsing line. Line was #" << linenumbers[errors[i].line] << ":\n'" << line.str() << "'\n" <<
+				"Error was:\n" << errors[i].what << std::endl;
+		}
+	}
+
+	// The text is not needed any more
+	std::vector<char>().swap(text);
+}
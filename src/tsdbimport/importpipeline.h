@@ -0,0 +1,110 @@
+#pragma once
+
+/* STL Classes */
+#include <string>
+#include <vector>
+
+/* Boost */
+#include "boost/shared_ptr.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/condition_variable.hpp"
+
+/* TSDB Includes */
+#include "recordparser.h"
+#include "timeseries.h"
+#include "reorderbuffer.h"
+
+#include "boundedqueue.h"
+
+/* -----------------------------------------------------------------
+ * ImportChunk. A piece of the input file and the records parsed
+ * from it.
+ * -----------------------------------------------------------------
+ */
+struct ImportChunk
+{
+	ImportChunk(void);
+	~ImportChunk(void);
+
+	std::vector<char> text;  // complete lines of the input file
+	long long first_line;    // number of lines in the file before this chunk
+	long long bytes_read;    // bytes of the file read up to the end of this chunk
+
+	/* Filled in by a parser thread */
+	void* records;
+	int nrecords;
+	std::vector<long> routes;  // series of each record, if the parsers have a RecordRouter
+	std::string error;
+	bool parsed;
+	boost::mutex mutex;
+	boost::condition_variable parsed_cond;
+};
+
+typedef boost::shared_ptr<ImportChunk> ImportChunkPtr;
+typedef void (*ProgressFunc)(double progress, double total, double readspeed, double writespeed);
+
+/* -----------------------------------------------------------------
+ * ImportPipeline. Reads, parses and appends a delimited file using
+ * several threads.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>Imports a delimited file into a Timeseries with a reader, several parsers and a writer</summary>
+ * <remarks><p>One reader thread reads the file into chunks that are cut at line boundaries. Each chunk
+ * is parsed into a block of records by one of the parser threads, each of which has its own
+ * RecordParser, since RecordParsers keep state between lines. The writer (the thread that calls
+ * <c>run()</c>) appends the blocks to the Timeseries in the order they were read, so the records end up
+ * in the same order as a single threaded import would write them.</p>
+ * <p>Only the writer calls into HDF5. At most two chunks per parser are in flight at a time,
+ * so the reader waits when the parsers or the writer fall behind.</p>
+ * <p>The reader reads the file through an InputStream, so gzip and bgzip files are decompressed as they
+ * are read, and the chunks always hold text.</p>
+ * <p>Records that are out of order are discarded, unless a horizon is set with setHorizon(). Then the
+ * writer passes the records through a ReorderBuffer, which keeps all of them.</p>
+ * <p>With several output series, the parsers must have a RecordRouter, whose destinations are indexes
+ * into the series. The file is still read and parsed once; the writer sorts the records of each chunk
+ * into a buffer per series, and appends a buffer when it has BUFFER_BYTES of records, and at the end.
+ * The series must all have the structure the parsers are bound to.</p></remarks>
+ */
+class ImportPipeline
+{
+public:
+	ImportPipeline(int _ifh, long long _file_size, tsdb::Timeseries* _out_ts,
+		const std::vector<tsdb::RecordParser*>& _parsers, size_t _chunk_size, ProgressFunc _progress = NULL);
+	ImportPipeline(int _ifh, long long _file_size, const std::vector<tsdb::Timeseries*>& _out_series,
+		const std::vector<tsdb::RecordParser*>& _parsers, size_t _chunk_size, ProgressFunc _progress = NULL);
+
+	void setHorizon(tsdb::timestamp_t _horizon);
+	long long run(void);
+
+private:
+	ImportPipeline(const ImportPipeline&);
+	ImportPipeline& operator=(const ImportPipeline&);
+
+	void init(int _ifh, long long _file_size, const std::vector<tsdb::Timeseries*>& _out_series,
+		const std::vector<tsdb::RecordParser*>& _parsers, size_t _chunk_size, ProgressFunc _progress);
+	long long appendToSeries(size_t series, size_t nrecords, void* records,
+		std::vector<boost::shared_ptr<tsdb::ReorderBuffer> >& reorders);
+	void recodeSymbols(size_t series, size_t nrecords, char* records);
+	void readChunks(void);
+	void parseChunks(tsdb::RecordParser* parser);
+	void parseChunk(tsdb::RecordParser* parser, ImportChunk* chunk);
+	void stop(void);
+
+	int my_ifh;
+	long long my_file_size;
+	std::vector<tsdb::Timeseries*> my_out_series;
+	std::vector<tsdb::RecordParser*> my_parsers;
+	size_t my_chunk_size;
+	size_t my_record_size;
+	ProgressFunc my_progress;
+	tsdb::timestamp_t my_horizon;  // for the ReorderBuffer, or -1 to discard misordered records
+
+	/* For each series and Symbol field, the code in the series of each code the parsers gave */
+	std::vector<std::vector<std::vector<tsdb::symbol_t> > > my_symbol_codes;
+
+	BoundedQueue<ImportChunkPtr> my_parse_queue;
+	BoundedQueue<ImportChunkPtr> my_write_queue;
+	std::string my_read_error;
+	boost::mutex my_output_mutex;  // serializes messages to cerr
+};
@@ -0,0 +1,358 @@
+/* STL Classes */
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <string.h>
+
+/* Boost */
+#include "boost/bind.hpp"
+#include "boost/thread/thread.hpp"
+
+#ifdef WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "inputstream.h"
+
+/* Bytes of the file read at a time */
+#define INPUT_READ_BYTES (1 << 20)
+
+/* Blocks a bgzip file is inflated in at a time, per thread */
+#define BGZF_BATCH_BLOCKS 16
+
+/* Size of the header of a gzip member, up to the first extra subfield */
+#define GZIP_HEADER_BYTES 12
+
+/* Bytes open() reads to tell the format of a file */
+#define SNIFF_BYTES 18
+
+/** <summary>Reads up to <c>n</c> bytes of <c>ifh</c>. Returns fewer only at the end of the file.</summary> */
+static size_t readHandle(int ifh, char* buf, size_t n) {
+	size_t done = 0;
+	while(done < n) {
+		size_t to_read = std::min(n - done, (size_t) 0x40000000);
+		#ifdef WIN32
+			int bytes_read = _read(ifh, buf + done, (unsigned int) to_read);
+		#else
+			int bytes_read = (int) ::read(ifh, buf + done, to_read);
+		#endif
+		if(bytes_read < 0) {
+			throw(std::runtime_error("read failed at the start of the file."));
+		}
+		if(bytes_read == 0) {
+			break;
+		}
+		done += bytes_read;
+	}
+	return done;
+}
+
+/* ====================================================================
+ * class InputStream - reads a plain or compressed input file
+ * ====================================================================
+ */
+
+InputStream::InputStream(int _ifh, const std::string& _format) {
+	my_ifh = _ifh;
+	my_consumed = 0;
+	my_format = _format;
+}
+
+/** <summary>Opens a stream over <c>ifh</c>, positioned at the start of the file</summary>
+ * <param name="ifh">File handle of the input file. The caller keeps ownership.</param>
+ * <param name="threads">Number of threads to inflate bgzip blocks on</param>
+ * <remarks>The caller deletes the stream.</remarks>
+ */
+InputStream* InputStream::open(int ifh, size_t threads) {
+	std::vector<char> head(SNIFF_BYTES);
+	head.resize(readHandle(ifh, &head[0], head.size()));
+	const unsigned char* magic = (const unsigned char*) (head.empty() ? NULL : &head[0]);
+
+	InputStream* stream;
+	if(head.size() >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+		if(BgzfInputStream::isBlock(magic, head.size())) {
+			stream = new BgzfInputStream(ifh, threads);
+		} else {
+			stream = new GzipInputStream(ifh);
+		}
+	} else if(head.size() >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) {
+		throw(std::runtime_error("The input file is zstd compressed, which this build of tsdbimport can not "
+			"read. Decompress it, or recompress it with gzip or bgzip."));
+	} else if(head.size() >= 4 && magic[0] == 0x04 && magic[1] == 0x22 && magic[2] == 0x4d && magic[3] == 0x18) {
+		throw(std::runtime_error("The input file is lz4 compressed, which this build of tsdbimport can not "
+			"read. Decompress it, or recompress it with gzip or bgzip."));
+	} else {
+		stream = new PlainInputStream(ifh);
+	}
+
+	stream->my_pending.swap(head);
+	return stream;
+}
+
+/** <summary>Reads up to <c>n</c> bytes of the file. Returns 0 at the end of the file.</summary> */
+size_t InputStream::readFile(char* buf, size_t n) {
+	size_t done = 0;
+	if(!my_pending.empty()) {
+		done = std::min(n, my_pending.size());
+		memcpy(buf, &my_pending[0], done);
+		my_pending.erase(my_pending.begin(), my_pending.begin() + done);
+	}
+	if(done < n && my_pending.empty()) {
+		#ifdef WIN32
+			int bytes_read = _read(my_ifh, buf + done, (unsigned int) std::min(n - done, (size_t) 0x40000000));
+		#else
+			int bytes_read = (int) ::read(my_ifh, buf + done, std::min(n - done, (size_t) 0x40000000));
+		#endif
+		if(bytes_read < 0) {
+			std::ostringstream msg;
+			msg << "read failed after " << my_consumed << " bytes.";
+			throw(std::runtime_error(msg.str()));
+		}
+		done += bytes_read;
+	}
+	my_consumed += done;
+	return done;
+}
+
+/** <summary>Reads <c>n</c> bytes of the file. Returns fewer only at the end of the file.</summary> */
+size_t InputStream::readFully(char* buf, size_t n) {
+	size_t done = 0;
+	while(done < n) {
+		size_t bytes_read = readFile(buf + done, n - done);
+		if(bytes_read == 0) {
+			break;
+		}
+		done += bytes_read;
+	}
+	return done;
+}
+
+/* ====================================================================
+ * class PlainInputStream - a file that is not compressed
+ * ====================================================================
+ */
+
+PlainInputStream::PlainInputStream(int _ifh):
+	InputStream(_ifh, "plain") {
+}
+
+size_t PlainInputStream::read(char* buf, size_t n) {
+	return readFile(buf, n);
+}
+
+/* ====================================================================
+ * class GzipInputStream - inflates a gzip file as it is read
+ * ====================================================================
+ */
+
+GzipInputStream::GzipInputStream(int _ifh):
+	InputStream(_ifh, "gzip"), my_in(INPUT_READ_BYTES) {
+	memset(&my_stream, 0, sizeof(my_stream));
+	// 16 + MAX_WBITS reads gzip headers and checks the crc of each member
+	if(inflateInit2(&my_stream, 16 + MAX_WBITS) != Z_OK) {
+		throw(std::runtime_error("Out of memory in inflateInit2."));
+	}
+	my_eof = false;
+	my_in_member = false;
+}
+
+GzipInputStream::~GzipInputStream(void) {
+	inflateEnd(&my_stream);
+}
+
+/** <remarks>Inflates until some text comes out, so it only returns 0 at the end of the last member.</remarks> */
+size_t GzipInputStream::read(char* buf, size_t n) {
+	uInt avail = (uInt) std::min(n, (size_t) 0x40000000);
+	my_stream.next_out = (Bytef*) buf;
+	my_stream.avail_out = avail;
+
+	while(avail > 0 && my_stream.avail_out == avail) {
+		if(my_stream.avail_in == 0) {
+			if(my_eof) {
+				if(my_in_member) {
+					throw(std::runtime_error("The gzip input file is truncated."));
+				}
+				break;
+			}
+			size_t bytes_read = readFile(&my_in[0], my_in.size());
+			if(bytes_read == 0) {
+				my_eof = true;
+				continue;
+			}
+			my_stream.next_in = (Bytef*) &my_in[0];
+			my_stream.avail_in = (uInt) bytes_read;
+		}
+
+		int status = ::inflate(&my_stream, Z_NO_FLUSH);
+		if(status == Z_STREAM_END) {
+			// Another member may follow, as in a file made with cat a.gz b.gz
+			inflateReset(&my_stream);
+			my_in_member = false;
+		} else if(status == Z_OK) {
+			my_in_member = true;
+		} else {
+			throw(std::runtime_error(std::string("The gzip input file is corrupt: ") +
+				(my_stream.msg != NULL ? my_stream.msg : "inflate failed") + "."));
+		}
+	}
+
+	return avail - my_stream.avail_out;
+}
+
+/* ====================================================================
+ * class BgzfInputStream - inflates a bgzip file on several threads
+ * ====================================================================
+ */
+
+BgzfInputStream::BgzfInputStream(int _ifh, size_t _threads):
+	InputStream(_ifh, "bgzip") {
+	my_threads = std::max(_threads, (size_t) 1);
+	my_blocks.resize(my_threads * BGZF_BATCH_BLOCKS);
+	my_nblocks = 0;
+	my_block = 0;
+	my_offset = 0;
+	my_eof = false;
+}
+
+/** <summary>Returns true if the first <c>n</c> bytes of a file start a bgzip block</summary>
+ * <remarks>A bgzip block is a gzip member with a 'BC' extra subfield that holds the size of the block.
+ * bgzip writes it as the first subfield, which is all this looks for.</remarks>
+ */
+bool BgzfInputStream::isBlock(const unsigned char* header, size_t n) {
+	return n >= 18 && header[0] == 0x1f && header[1] == 0x8b && header[2] == 8 && (header[3] & 4) != 0 &&
+		header[12] == 'B' && header[13] == 'C' && header[14] == 2 && header[15] == 0;
+}
+
+size_t BgzfInputStream::read(char* buf, size_t n) {
+	size_t done = 0;
+	while(done < n) {
+		if(my_block == my_nblocks) {
+			if(done > 0 || !readBlocks()) {
+				break;
+			}
+		}
+
+		Block& block = my_blocks[my_block];
+		size_t count = std::min(n - done, block.text.size() - my_offset);
+		if(count > 0) {
+			memcpy(buf + done, &block.text[my_offset], count);
+		}
+		done += count;
+		my_offset += count;
+		if(my_offset == block.text.size()) {
+			my_block++;
+			my_offset = 0;
+		}
+	}
+	return done;
+}
+
+/** <summary>Reads the next batch of blocks and inflates them. Returns false at the end of the file.</summary> */
+bool BgzfInputStream::readBlocks(void) {
+	my_nblocks = 0;
+	my_block = 0;
+	my_offset = 0;
+
+	while(!my_eof && my_nblocks < my_blocks.size()) {
+		Block& block = my_blocks[my_nblocks];
+		block.data.resize(GZIP_HEADER_BYTES);
+		size_t bytes_read = readFully(&block.data[0], GZIP_HEADER_BYTES);
+		if(bytes_read == 0) {
+			my_eof = true;
+			break;
+		}
+
+		const unsigned char* header = (const unsigned char*) &block.data[0];
+		if(bytes_read < GZIP_HEADER_BYTES || header[0] != 0x1f || header[1] != 0x8b || (header[3] & 4) == 0) {
+			throw(std::runtime_error("The bgzip input file has a block that is not a bgzip block."));
+		}
+
+		// Find the size of the block in the extra field
+		size_t xlen = header[10] | (header[11] << 8);
+		block.data.resize(GZIP_HEADER_BYTES + xlen);
+		if(readFully(&block.data[GZIP_HEADER_BYTES], xlen) < xlen) {
+			throw(std::runtime_error("The bgzip input file is truncated."));
+		}
+
+		const unsigned char* extra = (const unsigned char*) &block.data[GZIP_HEADER_BYTES];
+		size_t block_size = 0;
+		for(size_t i = 0; i + 4 <= xlen; ) {
+			size_t slen = extra[i + 2] | (extra[i + 3] << 8);
+			if(extra[i] == 'B' && extra[i + 1] == 'C' && slen == 2 && i + 6 <= xlen) {
+				block_size = (extra[i + 4] | (extra[i + 5] << 8)) + 1;
+				break;
+			}
+			i += 4 + slen;
+		}
+		if(block_size < GZIP_HEADER_BYTES + xlen + 8) {
+			throw(std::runtime_error("The bgzip input file has a block without a valid size."));
+		}
+
+		size_t have = block.data.size();
+		block.data.resize(block_size);
+		if(readFully(&block.data[have], block_size - have) < block_size - have) {
+			throw(std::runtime_error("The bgzip input file is truncated."));
+		}
+		my_nblocks++;
+	}
+
+	if(my_nblocks == 0) {
+		return false;
+	}
+
+	// Inflate block i on thread i % threads. The reading thread takes a share too.
+	size_t nthreads = std::min(my_threads, my_nblocks);
+	boost::thread_group threads;
+	for(size_t t = 1; t < nthreads; t++) {
+		threads.create_thread(boost::bind(&BgzfInputStream::inflateBlocks, this, t, nthreads));
+	}
+	inflateBlocks(0, nthreads);
+	threads.join_all();
+
+	for(size_t i = 0; i < my_nblocks; i++) {
+		if(!my_blocks[i].error.empty()) {
+			throw(std::runtime_error(my_blocks[i].error));
+		}
+	}
+	return true;
+}
+
+/** <summary>Inflates blocks <c>first</c>, <c>first + step</c>, ... of the batch</summary> */
+void BgzfInputStream::inflateBlocks(size_t first, size_t step) {
+	for(size_t i = first; i < my_nblocks; i += step) {
+		inflateBlock(&my_blocks[i]);
+	}
+}
+
+/** <summary>Inflates one block into its text. Errors are left in the block for the reading thread.</summary> */
+void BgzfInputStream::inflateBlock(Block* block) {
+	const unsigned char* trailer = (const unsigned char*) &block->data[block->data.size() - 4];
+	size_t isize = trailer[0] | (trailer[1] << 8) | (trailer[2] << 16) | ((size_t) trailer[3] << 24);
+	block->error.clear();
+	block->text.resize(isize);
+
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	if(inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) {
+		block->error = "Out of memory in inflateInit2.";
+		return;
+	}
+
+	// An empty block marks the end of a bgzip file; give zlib somewhere to write anyway
+	char dummy;
+	stream.next_in = (Bytef*) &block->data[0];
+	stream.avail_in = (uInt) block->data.size();
+	stream.next_out = (Bytef*) (isize > 0 ? &block->text[0] : &dummy);
+	stream.avail_out = (uInt) (isize > 0 ? isize : 1);
+
+	int status = ::inflate(&stream, Z_FINISH);
+	if(status != Z_STREAM_END || stream.total_out != isize) {
+		block->error = std::string("The bgzip input file is corrupt: ") +
+			(stream.msg != NULL ? stream.msg : "a block does not inflate to its size") + ".";
+	}
+	inflateEnd(&stream);
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+/* STL Classes */
+#include <string>
+#include <vector>
+
+/* External Libraries */
+#include "zlib.h"
+
+/* -----------------------------------------------------------------
+ * InputStream. Reads the input file, decompressing it if it is
+ * compressed.
+ * -----------------------------------------------------------------
+ */
+
+/** <summary>Reads a plain or compressed input file as a stream of text</summary>
+ * <remarks><p>open() looks at the first bytes of the file to tell how it is compressed, so vendors'
+ * <c>.csv.gz</c> files can be imported as they are, in one pass, without unpacking them to disk first.
+ * The file handle stays owned by the caller.</p>
+ * <p>gzip files are inflated as they are read, and files made of several gzip members (as from
+ * <c>cat a.gz b.gz</c>) are read to the end. bgzip files are gzip files cut into independent blocks of
+ * at most 64 KB, which are inflated on several threads at once, so a large import is not held up by a
+ * single core inflating.</p>
+ * <p>zstd and lz4 files are recognised, but tsdbimport is not built with those libraries, so open()
+ * throws a <c>std::runtime_error</c> saying so rather than parsing compressed bytes as text.</p></remarks>
+ */
+class InputStream
+{
+public:
+	virtual ~InputStream(void) {}
+
+	/** <summary>Reads up to <c>n</c> bytes of text into <c>buf</c>. Returns 0 at the end of the file.</summary>
+	 * <remarks>Throws a <c>std::runtime_error</c> if the file can not be read, or is corrupt.</remarks>
+	 */
+	virtual size_t read(char* buf, size_t n) = 0;
+
+	/** <summary>Returns the number of bytes read from the file so far, which is less than the text
+	 * returned if the file is compressed</summary>
+	 */
+	long long consumed(void) const { return my_consumed; }
+
+	/** <summary>Returns "plain", "gzip" or "bgzip"</summary> */
+	const std::string& format(void) const { return my_format; }
+
+	static InputStream* open(int ifh, size_t threads);
+
+protected:
+	InputStream(int _ifh, const std::string& _format);
+
+	size_t readFile(char* buf, size_t n);
+	size_t readFully(char* buf, size_t n);
+
+	int my_ifh;
+	long long my_consumed;
+	std::string my_format;
+	std::vector<char> my_pending;  // bytes open() read to look at, that read() has yet to return
+
+private:
+	InputStream(const InputStream&);
+	InputStream& operator=(const InputStream&);
+};
+
+/* -----------------------------------------------------------------
+ * PlainInputStream. Reads a file that is not compressed.
+ * -----------------------------------------------------------------
+ */
+class PlainInputStream:
+	public InputStream
+{
+public:
+	PlainInputStream(int _ifh);
+	virtual size_t read(char* buf, size_t n);
+};
+
+/* -----------------------------------------------------------------
+ * GzipInputStream. Inflates a gzip file as it is read.
+ * -----------------------------------------------------------------
+ */
+class GzipInputStream:
+	public InputStream
+{
+public:
+	GzipInputStream(int _ifh);
+	virtual ~GzipInputStream(void);
+	virtual size_t read(char* buf, size_t n);
+
+private:
+	z_stream my_stream;
+	std::vector<char> my_in;
+	bool my_eof;
+	bool my_in_member;  // part of a gzip member has been inflated, but not its end
+};
+
+/* -----------------------------------------------------------------
+ * BgzfInputStream. Inflates the blocks of a bgzip file on several
+ * threads.
+ * -----------------------------------------------------------------
+ */
+class BgzfInputStream:
+	public InputStream
+{
+public:
+	BgzfInputStream(int _ifh, size_t _threads);
+	virtual size_t read(char* buf, size_t n);
+
+	static bool isBlock(const unsigned char* header, size_t n);
+
+private:
+	struct Block {
+		std::vector<char> data;  // the whole gzip member
+		std::vector<char> text;
+		std::string error;
+	};
+
+	bool readBlocks(void);
+	void inflateBlocks(size_t first, size_t step);
+	static void inflateBlock(Block* block);
+
+	size_t my_threads;
+	std::vector<Block> my_blocks;
+	size_t my_nblocks;     // blocks in my_blocks that hold data
+	size_t my_block;       // the block read() is returning text from
+	size_t my_offset;      // offset in the text of that block
+	bool my_eof;
+};
@@ -45,6 +45,108 @@
  * > tsdbimport usdjpy.xml testdata.csv usdjpy.tsdb series1
  * \endcode
  *
+ * <p>Reading, parsing and writing run in separate threads. Parsing is usually the bottleneck, so
+ * large files import faster with more parser threads, set with the <c>--threads</c> option:</p>
+ *
+ * \code
+ * > tsdbimport --threads 4 usdjpy.xml testdata.csv usdjpy.tsdb series1
+ * \endcode
+ *
+ * <p>Records with a timestamp before the last one written are discarded. When the file is only a little
+ * out of order, as when it merges feeds from several sources, the <c>--horizon</c> option keeps them: records
+ * are held back for that many milliseconds of timestamps and written in order. Records later than that are
+ * merged into the series too, which costs a rewrite of its end.</p>
+ *
+ * \code
+ * > tsdbimport --horizon 500 usdjpy.xml testdata.csv usdjpy.tsdb series1
+ * \endcode
+ *
+ * <p>With <c>--stats</c>, the counters of the parsers and the series (see RecordParser::stats() and
+ * Timeseries::stats()) are printed after the import, one <c>name value</c> pair per line: how many lines
+ * were parsed, filtered or failed, the sizes of the batches appended, and what was written to HDF5 and how
+ * long that took.</p>
+ *
+ * \code
+ * > tsdbimport --stats usdjpy.xml testdata.csv usdjpy.tsdb series1
+ * \endcode
+ *
+ * <p>With <c>--swmr</c>, other programs can read the series while it is being imported, and see each batch
+ * as it is appended (see Swmr and Timeseries::refresh()). The file must have been created with
+ * <c>tsdbcreate --swmr</c>. Late records can not be merged into a file that is being read this way, so
+ * <c>--swmr</c> does not go with <c>--horizon</c>.</p>
+ *
+ * \code
+ * > tsdbimport --swmr usdjpy.xml testdata.csv usdjpy.tsdb series1
+ * \endcode
+ *
+ * <p>For a large backfill, <c>--defer-index</c> only writes the records while importing, and builds the
+ * indexes of the series once at the end, reading them on one thread per processor (see
+ * Timeseries::setDeferIndex() and Timeseries::rebuildIndex()). The whole series is indexed again, so this
+ * pays off when the import is most of it. It does not go with <c>--swmr</c>, as readers need the index.
+ * tsdbreindex rebuilds or checks the indexes of a file by itself.</p>
+ *
+ * \code
+ * > tsdbimport --defer-index usdjpy.xml testdata.csv usdjpy.tsdb series1
+ * \endcode
+ *
+ * <p>The input file may be gzip compressed, and is then decompressed as it is read, without unpacking it
+ * to disk first. Files compressed with <c>bgzip</c> are made of independent blocks, which are decompressed
+ * on as many threads as there are parsers, so they import about as fast as uncompressed files. zstd and lz4 files are
+ * recognised, but can't be read by this build.</p>
+ *
+ * \code
+ * > tsdbimport --threads 4 usdjpy.xml testdata.csv.gz usdjpy.tsdb series1
+ * \endcode
+ *
+ * <p>Files of fixed size binary records are loaded without parsing any text when the XML file has a
+ * <c>binaryparser</c> instead of a <c>delimparser</c>. It gives the size of a record and the byte order
+ * (<c>little</c>, <c>big</c> or <c>native</c>), and the offset and type of each field, with a size for
+ * strings and for integers of other than the usual size (see BinaryLayout). The file is mapped into
+ * memory, and its records are converted and appended a block at a time by a BinaryLoader.
+ * <c>--threads</c> is ignored.</p>
+ *
+ * \code
+ * # usdjpy_bin.xml
+ *
+ * <?xml version="1.0" encoding="UTF-8" ?>
+ * <dataimport>
+ * <binaryparser record_size="24" byte_order="big">
+ *     <field name="_TSDB_timestamp" type="timestamp" offset="0" />
+ *     <field name="price" type="double" offset="8" />
+ *     <field name="amount" type="int32" offset="16" />
+ *     <field name="side" type="int8" offset="20" />
+ * </binaryparser>
+ * </dataimport>
+ * \endcode
+ *
+ * <p>To split a file with many symbols into a series per symbol in one pass, add a <c>router</c> to the
+ * <c>delimparser</c>. Its tokens are the key, and each <c>route</c> sends the lines with one key to a series.
+ * The series are opened in the group given as <c>&lt;out series&gt;</c> (use <c>/</c> for the root of the
+ * file), must exist, and must all have the same fields. Lines whose key has no route are skipped. Each line
+ * is parsed once, whatever the number of series (see RecordRouter).</p>
+ *
+ * \code
+ * <delimparser field_delim=",">
+ *     <router tokens="2">
+ *         <route key="USD/JPY" series="usdjpy" />
+ *         <route key="EUR/USD" series="eurusd" />
+ *     </router>
+ *     <fieldparser name="_TSDB_timestamp" type="timestamp" tokens="0,1" format_string="%Y/%m/%d %H:%M:%S%F" />
+ *     <fieldparser name="price" type="double" tokens="3" />
+ * </delimparser>
+ *
+ * > tsdbimport fx.xml testdata.csv fx.tsdb /
+ * \endcode
+ *
+ * <p>A tokenfilter can also compare its tokens to a list of values, with <c>comparison="IN"</c> or
+ * <c>comparison="NOT_IN"</c> and the values separated by commas in <c>values</c>. Like NE,
+ * <c>NOT_IN</c> keeps only the lines with one of the values:
+ * <c>&lt;tokenfilter tokens="2" comparison="NOT_IN" values="USD/JPY,EUR/USD" /&gt;</c>.</p>
+ *
+ * <p>A token that repeats a few values, such as a venue or a currency pair, can go into a symbol field
+ * (<c>tsdbcreate ... symbol(16) venue</c>) with <c>type="symbol"</c>. Each record then holds a small code,
+ * and the series keeps the dictionary of the codes (see SymbolField).</p>
+ *
  * <p>A few things to note: first, in the first field parser line in the XML file, two tokens are joined 
  * with a space before parsing. You can do this when dates and times are separate tokens in your CSV file.
  * Second, tokens in the CSV file are counted starting with 0 for the first token. Last, if a tokenfilter
@@ -56,6 +158,8 @@
 
 #include <string>
 #include <stdexcept>
+#include <algorithm>
+#include <iostream>
 #include <cmath>
 #include <time.h>
 #include <stdio.h>
@@ -64,6 +168,7 @@
 #include <stdlib.h>
 
 #include "boost/tokenizer.hpp"
+#include "boost/date_time/posix_time/posix_time.hpp"
 
 #include "ticpp.h"
 #include "tsdb.h"
@@ -74,6 +179,13 @@
 #include "structure.h"
 #include "recordparser.h"
 #include "timeseries.h"
+#include "swmr.h"
+#include "binaryloader.h"
+#include "filemapping.h"
+#include "reorderbuffer.h"
+#include "recordrouter.h"
+
+#include "importpipeline.h"
 
 #ifdef WIN32
 #include <io.h>
@@ -84,7 +196,13 @@
 #define BYTES_PER_MB 1048576
 
 
-tsdb::RecordParser* record_parser_from_xml(const std::string parse_instruction_filename, tsdb::Timeseries* out_ts);
+tsdb::RecordParser* record_parser_from_xml(const std::string parse_instruction_filename, tsdb::Timeseries* out_ts,
+	std::ostream& log);
+boost::shared_ptr<tsdb::RecordRouter> router_from_xml(const std::string parse_instruction_filename,
+	std::vector<std::string>* series_names);
+tsdb::BinaryLayout* binary_layout_from_xml(const std::string parse_instruction_filename, std::ostream& log);
+long long binary_import(const tsdb::BinaryLayout& layout, const std::string& in_file, tsdb::Timeseries* out_ts,
+	long long horizon);
 void progress_func(double progress, double total, double readspeed, double writespeed);
 
 int main(int argc, char* argv[])
@@ -97,22 +215,55 @@ int main(int argc, char* argv[])
 
 	/* Parse the command line arguments */
 	string in_file, out_file, parse_instruction_filename,tsdb_series;
+	int nthreads = 1; // number of parser threads
+	long long horizon = -1; // milliseconds to hold records back for reordering, or -1 to discard them
+	bool show_stats = false;
+	bool swmr = false;
+	bool defer_index = false;
+	int arg = 1;
+
+	while(arg < argc && string(argv[arg]).substr(0,2) == "--") {
+		if(string(argv[arg]) == "--threads" && arg + 1 < argc) {
+			nthreads = atoi(argv[arg+1]);
+			arg += 2;
+		} else if(string(argv[arg]) == "--horizon" && arg + 1 < argc) {
+			horizon = atoll(argv[arg+1]);
+			arg += 2;
+		} else if(string(argv[arg]) == "--stats") {
+			show_stats = true;
+			arg += 1;
+		} else if(string(argv[arg]) == "--swmr") {
+			swmr = true;
+			arg += 1;
+		} else if(string(argv[arg]) == "--defer-index") {
+			defer_index = true;
+			arg += 1;
+		} else {
+			break;
+		}
+	}
 
-	if(argc != 5) {
-		cerr << "Usage: tsdbimport <parse instructions> <in file> <out file> <out series>" << endl;
+	if(argc - arg != 4 || nthreads < 1 || (horizon < 0 && horizon != -1) || (swmr && horizon != -1) || (swmr && defer_index)) {
+		cerr << "Usage: tsdbimport [--threads <n>] [--horizon <ms> | --swmr] [--defer-index] [--stats] <parse instructions> <in file> <out file> <out series>" << endl;
 		return -1;
 	} else {
-		parse_instruction_filename = string(argv[1]);
-		in_file = string(argv[2]);
-		out_file = string(argv[3]);
-		tsdb_series = string(argv[4]);
+		parse_instruction_filename = string(argv[arg]);
+		in_file = string(argv[arg+1]);
+		out_file = string(argv[arg+2]);
+		tsdb_series = string(argv[arg+3]);
 	}
 
 	/* Open the TSDB file */
 	hid_t ofh;
 
 	/* Copy the default property list, and make the cache size much larger */
-	hid_t fapl = H5Pcreate(H5P_FILE_ACCESS);
+	hid_t fapl;
+	try {
+		fapl = swmr ? Swmr::fileAccessList() : H5Pcreate(H5P_FILE_ACCESS);
+	} catch(runtime_error& e) {
+		cerr << e.what() << endl;
+		return -1;
+	}
 	int mdc_nelmts;
 	size_t rdcc_nbytes,  rdcc_nelmts;
 	double rdcc_w0;
@@ -128,12 +279,27 @@ int main(int argc, char* argv[])
 		return -1;
 	}
 
-	/* Open the timeseries */
+	/* Open the timeseries. With a router, these are the series of its routes, in the group tsdb_series. */
+	vector<string> series_names;
+	boost::shared_ptr<RecordRouter> router;
+	vector<Timeseries*> out_series;
 	Timeseries* out_ts = NULL;
+	string series_name = tsdb_series;
 	try {
-		out_ts = new Timeseries(ofh,tsdb_series);
+		router = router_from_xml(parse_instruction_filename, &series_names);
+		if(router.get() == NULL) {
+			series_names.push_back(tsdb_series);
+		}
+		for(size_t s = 0; s < series_names.size(); s++) {
+			series_name = series_names[s];
+			if(router.get() != NULL && tsdb_series != "/") {
+				series_name = tsdb_series + "/" + series_names[s];
+			}
+			out_series.push_back(new Timeseries(ofh,series_name));
+		}
+		out_ts = out_series[0];
 	} catch (runtime_error &e) {
-		cerr << "Unable to open timeseries '" << tsdb_series << "'.\nError:" << e.what() << endl;
+		cerr << "Unable to open timeseries '" << series_name << "'.\nError:" << e.what() << endl;
 		status = H5Fclose(ofh);
 		if(status <0) {
 			cerr << "Warning: unable to close file. The HDF5 file may be corrupt." << endl;
@@ -144,216 +310,135 @@ int main(int argc, char* argv[])
 
 	/* Begin parsing the file */
 	try {
-		/* Build the parse instructions from the xml file */
-		RecordParser* recordparser = record_parser_from_xml(parse_instruction_filename, out_ts);
-
-		/* Open the input file */
-		int ifh = 0;
-
-		#ifdef WIN32
-			/* Windows requires a separate call for opening files larger than 2GB */
-			ifh = _open(in_file.c_str(),_O_RDONLY | _O_BINARY);
-		#else
-			ifh = open(in_file.c_str(), O_RDONLY);
-		#endif
-
-		if(ifh==-1) {
-			cerr << "Unable to open input file at '" << in_file << "'." << endl;
-			H5Fclose(ofh);
-			H5close();
-			return -1;
+		/* Build the parse instructions from the xml file. Binary records need a BinaryLayout; text
+		   needs a RecordParser for each parser thread, and only the first one describes itself. */
+		auto_ptr<BinaryLayout> layout(binary_layout_from_xml(parse_instruction_filename, cout));
+		vector<RecordParser*> recordparsers;
+		ostream quiet(NULL);
+		for(int t = 0; layout.get() == NULL && t < nthreads; t++) {
+			recordparsers.push_back(record_parser_from_xml(parse_instruction_filename, out_ts,
+				t == 0 ? cout : quiet));
+			recordparsers.back()->setRouter(router);
 		}
-
-		// Determine the size of the input file
-		long long size = 0;
-		#ifdef WIN32
-			size = _lseeki64(ifh, 0, SEEK_END);
-		#else
-			size = lseek(ifh, 0, SEEK_END);
-		#endif
-
-		if(size == -1L) {
-			cerr << "Unable to seek to end of file '" << in_file << "'." << endl;
-			H5Fclose(ofh);
-			H5close();
-			return -1;
+		if(layout.get() != NULL && router.get() != NULL) {
+			throw(runtime_error("binary records can not be routed to several series"));
 		}
-
-		#ifdef WIN32
-			if(_lseeki64(ifh, 0, SEEK_SET) == -1L) {
-		#else
-			if(lseek(ifh,0,SEEK_SET) == -1L) {
-		#endif
-
-			cerr << "Unable to seek to beginning of file '" << in_file << "'." << endl;
-			H5Fclose(ofh);
-			H5close();
-			return -1;
+		if(router.get() != NULL) {
+			cout << "Routing to " << out_series.size() << " series." << endl;
 		}
-		#ifdef WIN32
-			printf("Input file size is %I64d MB\n", size / BYTES_PER_MB);
-		#else
-			printf("Input file size is %lld MB\n", size / BYTES_PER_MB);
-		#endif
-		printf("Begin reading file...\n");
-
-		/* Setup the input buffer */
-		char *buffer = NULL;
-		int buffer_size = 5*BYTES_PER_MB; // 5 MB Buffer
-		buffer = (char*) malloc(buffer_size);
-		if(buffer == NULL) {
-			cerr << "Out of memory on buffer allocation." << endl;
-			H5Fclose(ofh);
-			H5close();
-			return -1;
+
+		/* Let readers in: from here on, the file is only appended to */
+		if(swmr) {
+			for(size_t s = 0; s < out_series.size(); s++) {
+				out_series[s]->prepareSwmrWrite();
+			}
+			Swmr::startWrite(ofh);
 		}
 
-		int buffer_offset = 0;
-
-
-		/* Start processing file */
-		int ndiscrec = 0; // number of discarded records
-		long long linenumber = 0; // Line number
-		long long outnumber = 0; // number of records written
-		long long completed = 0; // bytes read up to now
-		int bytes_read = 0; // bytes read into the buffer
-		int nbuflines = 0; // number of lines in the buffer
-		int nbufrecords = 0; // number of records in the buffer
-		void* records = NULL; // pointer to a block of records
-		void* record = NULL; // pointer to a record
-		bool parsesuccess = false;
-		char* line_start = NULL; // pointer to the start of a line
-		bool line_started = false; // true if the start of a line has been encountered
-		int i = 0; // a counter
-		clock_t starttime,endtime;	
+		for(size_t s = 0; defer_index && s < out_series.size(); s++) {
+			out_series[s]->setDeferIndex(true);
+		}
 
-	
-		starttime = clock();
+		long long outnumber;
+		if(layout.get() != NULL) {
+			outnumber = binary_import(*layout, in_file, out_ts, horizon);
+		} else {
+			/* Open the input file */
+			int ifh = 0;
 
-		/* Get file */
-		std::string line = "";
-		while(1) {
 			#ifdef WIN32
-				bytes_read = _read(ifh, buffer + buffer_offset, buffer_size-buffer_offset);
+				/* Windows requires a separate call for opening files larger than 2GB */
+				ifh = _open(in_file.c_str(),_O_RDONLY | _O_BINARY);
 			#else
-				bytes_read = read(ifh, buffer + buffer_offset, buffer_size-buffer_offset);
+				ifh = open(in_file.c_str(), O_RDONLY);
 			#endif
 
-			if(bytes_read < 0) {
-				cerr << "Error reading from input file '" << in_file << "'. Already read " <<
-					completed << " bytes. Must close!" << endl;
+			if(ifh==-1) {
+				cerr << "Unable to open input file at '" << in_file << "'." << endl;
 				H5Fclose(ofh);
 				H5close();
 				return -1;
 			}
 
-			if(bytes_read == 0) {
-				// end of file reached!
-				break;
-			}
-
-			completed = completed + bytes_read;
+			// Determine the size of the input file
+			long long size = 0;
+			#ifdef WIN32
+				size = _lseeki64(ifh, 0, SEEK_END);
+			#else
+				size = lseek(ifh, 0, SEEK_END);
+			#endif
 
-			progress_func((double) completed, (double) size, 
-				((double) completed/BYTES_PER_MB)/((double) ((clock()-starttime)/CLOCKS_PER_SEC)),
-				((double) outnumber)/((double) ((clock()-starttime)/CLOCKS_PER_SEC)));
-			
-			// Count number of lines in the buffer
-			nbuflines = 0;
-			for(i=0; i < bytes_read; i++) {
-				if (buffer[i] == '\n') {
-					nbuflines++;
-				}
+			if(size == -1L) {
+				cerr << "Unable to seek to end of file '" << in_file << "'." << endl;
+				H5Fclose(ofh);
+				H5close();
+				return -1;
 			}
 
-			// Allocate some space for the the records. Have to assume that each line is going
-			// to be a record
-			size_t recordsize = out_ts->structure()->getSizeOf();
-			records = malloc( recordsize * ((size_t)(nbuflines+1)) );
-			if(records == NULL) {
-				cerr << "Out of memory in records allocation." << endl;
-				cerr << "Already read " << completed << " bytes of file '" << in_file << "'.";
+			#ifdef WIN32
+				if(_lseeki64(ifh, 0, SEEK_SET) == -1L) {
+			#else
+				if(lseek(ifh,0,SEEK_SET) == -1L) {
+			#endif
+
+				cerr << "Unable to seek to beginning of file '" << in_file << "'." << endl;
 				H5Fclose(ofh);
 				H5close();
 				return -1;
 			}
+			#ifdef WIN32
+				printf("Input file size is %I64d MB\n", size / BYTES_PER_MB);
+			#else
+				printf("Input file size is %lld MB\n", size / BYTES_PER_MB);
+			#endif
+			printf("Begin reading file with %d parser thread(s)...\n", nthreads);
 
-			// Loop through the buffer and parse the lines 
-			nbufrecords = 0;
-			line_start = buffer;
-			line_started = true;
-			for(i=0;i < (bytes_read + buffer_offset); i++) {
-				// If a line has been started, find the end of the line and null-terminate it, and parse it
-				if (line_started) {
-					if (buffer[i] == '\r' || buffer[i] == '\n') {
-						buffer[i] = '\0';
-						line = line_start; // convert a C string into a std::string
-						linenumber++;
-
-						/* Try to parse the line, unless it is a blank line */
-						if(line.size() != 0 ) {
-							try {
-								parsesuccess = recordparser->parseString(line,
-									(((char*)records) + (nbufrecords*recordsize)));
-							} catch (std::runtime_error &e) {
-								/* Not able to parse? Output the error, and skip that line */
-								cerr << "Error parsing line. Line was #" << linenumber << ":\n'" << line << "'\n" << "Error was:\n" << e.what() << endl;
-								parsesuccess = false;
-							} catch(std::exception &e) {
-								/* Not able to parse? Output the error, and skip that line */
-								cerr << "Error parsing line. Line was #" << linenumber << ":\n'" << line << "'\n" << "Error was:\n" << e.what() << endl;
-								parsesuccess = false;
-							}
-						} else {
-							parsesuccess = false;
-						}
-
-						if(parsesuccess) {
-							// record is good. Increment records counter
-							nbufrecords++;
-							parsesuccess = false;
-						}
-
-						line_started = false;
-					}
-				} else {
-					// A line has just ended, so look for one non-newline or null char to start a new line
-					if(buffer[i] != '\n' && buffer[i] != '\r' && buffer[i] != '\0') {
-						line_started = true;
-						line_start = buffer + i;
-					}
-				}
+			/* Read, parse and append the file */
+			ImportPipeline pipeline(ifh, size, out_series, recordparsers, 5*BYTES_PER_MB, progress_func);
+			if(horizon >= 0) {
+				pipeline.setHorizon(horizon);
 			}
+			outnumber = pipeline.run();
 
-			if (line_started) {
-				// A line has been started, but it has not terminated in this buffer. Move the remaining
-				// "scraps" to the top of the buffer and read in more of the file.
-				memcpy(buffer,line_start,buffer_size -(line_start-buffer));
+			#ifdef WIN32
+				_close(ifh);
+			#else
+				close(ifh);
+			#endif
+		}
+		printf("\nWrote %lld records.\n", outnumber);
 
-				// set the buffer offset to the length of the partial line that was just
-				// moved to the top
-				buffer_offset = buffer_size -(line_start-buffer);
-			} else {
-				buffer_offset = 0;
+		if(defer_index) {
+			printf("Building the indexes...\n");
+			for(size_t s = 0; s < out_series.size(); s++) {
+				out_series[s]->rebuildIndex();
+				out_series[s]->setDeferIndex(false);
 			}
+		}
 
-			// Append the records to the table
-			ndiscrec = out_ts->appendRecords(nbufrecords,records,true);
-
-			if (ndiscrec > 0) {
-				/* Some records were discarded because they overlapped. Warn the user */
-				cerr << ndiscrec << " record(s) discarded because they were misordered." << endl;
-				// This prints the records: cerr << out_ts->structure()->structsToString(records,ndiscrec,",","\n") << endl;
+		if(show_stats) {
+			RecordParserStats parser_stats;
+			for(size_t t = 0; t < recordparsers.size(); t++) {
+				parser_stats.merge(recordparsers[t]->stats());
+			}
+			StatList items = parser_stats.items("parser_");
+			for(size_t s = 0; s < out_series.size(); s++) {
+				StatList series_items = out_series[s]->stats().items();
+				for(size_t i = 0; router.get() != NULL && i < series_items.size(); i++) {
+					series_items[i].first = series_names[s] + "." + series_items[i].first;
+				}
+				items.insert(items.end(), series_items.begin(), series_items.end());
 			}
-			outnumber = outnumber + nbufrecords - ndiscrec;
 
-			// Free up the records buffer
-			free(records);
-			records = NULL;
+			printf("Statistics:\n");
+			for(size_t i = 0; i < items.size(); i++) {
+				printf("%s %llu\n", items[i].first.c_str(), items[i].second);
+			}
+		}
 
+		for(size_t t = 0; t < recordparsers.size(); t++) {
+			delete recordparsers[t];
 		}
-		endtime = clock();
-		free(buffer);
 	} catch(std::runtime_error &e) {
 		cerr << "Caught runtime error:" << endl;
 		cerr << e.what();
@@ -379,6 +464,9 @@ int main(int argc, char* argv[])
 		return -1;
 	}
 
+	for(size_t s = 0; s < out_series.size(); s++) {
+		delete out_series[s];
+	}
 	status = H5Fclose(ofh);
 	if(status < 0) {
 		cerr << "Warning: error closing TSDB file. There may be data corruption." << endl;
@@ -391,15 +479,16 @@ int main(int argc, char* argv[])
 	
 }
 
-tsdb::RecordParser* record_parser_from_xml(const std::string parse_instruction_filename, tsdb::Timeseries* out_ts) {
+tsdb::RecordParser* record_parser_from_xml(const std::string parse_instruction_filename, tsdb::Timeseries* out_ts,
+	std::ostream& log) {
 	using namespace std;
 	using namespace ticpp;
 
 	Document doc = Document(parse_instruction_filename);
 	doc.LoadFile();
 
-	cout << "Loaded '" << parse_instruction_filename << "'." << endl;
-	cout << "Creating parser..." << endl;
+	log << "Loaded '" << parse_instruction_filename << "'." << endl;
+	log << "Creating parser..." << endl;
 
 	/* Create the RecordParser */
 	tsdb::RecordParser* recordparser = new tsdb::RecordParser();
@@ -438,13 +527,13 @@ tsdb::RecordParser* record_parser_from_xml(const std::string parse_instruction_f
 		recordparser->setDelimiter(delim);				
 		recordparser->setEscapeCharacter(escape);
 		recordparser->setQuoteCharacter(quote);
-		cout << "   - field delimiter(s): '" << delim << "'" << endl;
-		cout << "   - quote character(s): '" << quote << "'" << endl;
-		cout << "   - escape character(s): '" << escape << "'" << endl;
+		log << "   - field delimiter(s): '" << delim << "'" << endl;
+		log << "   - quote character(s): '" << quote << "'" << endl;
+		log << "   - escape character(s): '" << escape << "'" << endl;
 	} else {
 		recordparser->setSimpleParse(true);
 		recordparser->setDelimiter(delim.substr(0,1));
-		cout << "   - field delimiter: '" << delim.substr(0,1) << "'" << endl;
+		log << "   - field delimiter: '" << delim.substr(0,1) << "'" << endl;
 	}
 	
 
@@ -452,12 +541,12 @@ tsdb::RecordParser* record_parser_from_xml(const std::string parse_instruction_f
 
 	
 
-	cout << "   Processing parser elements:" << endl;
+	log << "   Processing parser elements:" << endl;
 
 
 	/* Loop through the RecordParser and look for TokenFilters or FieldParsers */
 	typedef boost::tokenizer< boost::escaped_list_separator<char> > Tokenizer;
-	string tokens,comparison,format_string,type,missing_token_replacement;
+	string tokens,comparison,format_string,type,missing_token_replacement,values;
 	bool missing_tokens_ok = false;
 
 	vector<string> vec;
@@ -483,33 +572,47 @@ tsdb::RecordParser* record_parser_from_xml(const std::string parse_instruction_f
 			}
 
 			/* Write out some information */
-			cout << "      - TokenFilter:" << endl;
-			cout << "         apply to tokens: (";
+			log << "      - TokenFilter:" << endl;
+			log << "         apply to tokens: (";
 			for(i=0;i<apply_to_tokens.size();) {
-				cout << apply_to_tokens.at(i);
+				log << apply_to_tokens.at(i);
 				i++;
 				if(i<apply_to_tokens.size()) {
-					cout << ",";
+					log << ",";
 				}
 			}
-			cout << ")" << endl;
+			log << ")" << endl;
 
 			if(comparison == "NE") {
 				recordparser->addTokenFilter(new tsdb::TokenFilter(apply_to_tokens,
 					tsdb::TokenFilter::NOT_EQUAL_TO, value));
-				cout << "         comparison: NOT_EQUAL_TO" << endl;
+				log << "         comparison: NOT_EQUAL_TO" << endl;
 
 			} else if(comparison == "EQ") {
 				recordparser->addTokenFilter(new tsdb::TokenFilter(apply_to_tokens,
 					tsdb::TokenFilter::EQUAL_TO, value));
-				cout << "         comparison: EQUAL_TO" << endl;
+				log << "         comparison: EQUAL_TO" << endl;
+
+			} else if(comparison == "IN" || comparison == "NOT_IN") {
+				values = child->GetAttribute("values");
+				Tokenizer value_tok(values);
+				vec.assign(value_tok.begin(), value_tok.end());
+				if(vec.empty()) {
+					log << "         no values for " << comparison << "!" << endl;
+					throw(runtime_error("TokenFilter with comparison " + comparison + " needs a 'values' attribute"));
+				}
+				recordparser->addTokenFilter(new tsdb::TokenFilter(apply_to_tokens,
+					comparison == "IN" ? tsdb::TokenFilter::IN : tsdb::TokenFilter::NOT_IN, vec));
+				log << "         comparison: " << comparison << endl;
+				log << "         values: " << vec.size() << endl;
+				continue;
 
 			} else {
-				cout << "         comparison not recognized!" << endl;
+				log << "         comparison not recognized!" << endl;
 				throw(runtime_error("comparison operator in TokenFilter not recognized"));
 			}
 
-			cout << "         value: '" << value << "'" << endl;
+			log << "         value: '" << value << "'" << endl;
 
 		} else if(value == "fieldparser") {
 
@@ -524,16 +627,16 @@ tsdb::RecordParser* record_parser_from_xml(const std::string parse_instruction_f
 			}
 
 			/* Write out some information */
-			cout << "      - FieldParser:" << endl;
-			cout << "         apply to tokens: (";
+			log << "      - FieldParser:" << endl;
+			log << "         apply to tokens: (";
 			for(i=0;i<apply_to_tokens.size();) {
-				cout << apply_to_tokens.at(i);
+				log << apply_to_tokens.at(i);
 				i++;
 				if(i<apply_to_tokens.size()) {
-					cout << ",";
+					log << ",";
 				}
 			}
-			cout << ")" << endl;
+			log << ")" << endl;
 
 			name = child->GetAttribute("name");
 			format_string = child->GetAttribute("format_string");
@@ -546,41 +649,218 @@ tsdb::RecordParser* record_parser_from_xml(const std::string parse_instruction_f
 			if(type == "timestamp") {
 				recordparser->addFieldParser(new tsdb::TimestampFieldParser(apply_to_tokens, format_string,
 					name));
-				cout << "         type: Timestamp" << endl;
-				cout << "         format string: '" << format_string << "'" << endl;
+				log << "         type: Timestamp" << endl;
+				log << "         format string: '" << format_string << "'" << endl;
 			} else if(type == "string") {
 				recordparser->addFieldParser(new tsdb::StringFieldParser(apply_to_tokens, name));
-				cout << "         type: String" << endl;
+				log << "         type: String" << endl;
 			} else if(type == "int32") {
 				recordparser->addFieldParser(new tsdb::Int32FieldParser(apply_to_tokens.at(0), name));
-				cout << "         type: Int32" << endl;
+				log << "         type: Int32" << endl;
 			} else if(type == "int8") {
 				recordparser->addFieldParser(new tsdb::Int8FieldParser(apply_to_tokens.at(0), name));
-				cout << "         type: Int8" << endl;
+				log << "         type: Int8" << endl;
 			} else if(type == "double") {
 				recordparser->addFieldParser(new tsdb::DoubleFieldParser(apply_to_tokens.at(0), name));
-				cout << "         type: Double" << endl;
+				log << "         type: Double" << endl;
 			} else if(type == "char") {
 				recordparser->addFieldParser(new tsdb::CharFieldParser(apply_to_tokens.at(0), name));
-				cout << "         type: Char" << endl;
+				log << "         type: Char" << endl;
+			} else if(type == "symbol") {
+				recordparser->addFieldParser(new tsdb::SymbolFieldParser(apply_to_tokens.at(0), name));
+				log << "         type: Symbol" << endl;
 			} else {
-				cout << "         type: not recognized!" << endl;
+				log << "         type: not recognized!" << endl;
 				throw(runtime_error("type in FieldParser not recognized"));
 			}
 			
 			if(missing_tokens_ok) {
 				recordparser->fieldParsers().back()->setMissingTokenReplacement(missing_token_replacement);
-				cout << "         missing_token_replacement: '" << missing_token_replacement << "'" << endl;
+				log << "         missing_token_replacement: '" << missing_token_replacement << "'" << endl;
 			}
 
-			cout << "         name: '" << name << "'" << endl;
+			log << "         name: '" << name << "'" << endl;
 		}
 	}
 	
 	return recordparser;
-	cout << "   finished processing parser elements." << endl;
+	log << "   finished processing parser elements." << endl;
+}
+
+
+/** <summary>Returns the router of the delimparser element of the xml file, or an empty pointer if it has
+ * none</summary>
+ * <remarks>The names of the series of the routes are put in <c>series_names</c>, in the order they first
+ * appear. The destinations of the router are indexes into them.</remarks>
+ */
+boost::shared_ptr<tsdb::RecordRouter> router_from_xml(const std::string parse_instruction_filename,
+	std::vector<std::string>* series_names) {
+	using namespace std;
+	using namespace ticpp;
+	typedef boost::tokenizer< boost::escaped_list_separator<char> > Tokenizer;
+
+	Document doc = Document(parse_instruction_filename);
+	doc.LoadFile();
+
+	boost::shared_ptr<tsdb::RecordRouter> router;
+	Iterator<Element> parser;
+	Iterator<Element> child;
+	Iterator<Element> route;
+	string value;
+	for(parser = parser.begin(doc.FirstChildElement()); parser != parser.end(); parser++) {
+		parser->GetValue(&value);
+		if(value != "delimparser") {
+			continue;
+		}
+		for(child = child.begin(parser.Get()); child != child.end(); child++) {
+			child->GetValue(&value);
+			if(value != "router") {
+				continue;
+			}
+
+			string tokens = child->GetAttribute("tokens");
+			Tokenizer tok(tokens);
+			vector<size_t> key_tokens;
+			for(Tokenizer::iterator t = tok.begin(); t != tok.end(); ++t) {
+				key_tokens.push_back(atoi(t->c_str()));
+			}
+			router.reset(new tsdb::RecordRouter(key_tokens));
+
+			for(route = route.begin(child.Get()); route != route.end(); route++) {
+				route->GetValue(&value);
+				if(value != "route") {
+					continue;
+				}
+				string series = route->GetAttribute("series");
+				size_t destination = find(series_names->begin(), series_names->end(), series) - series_names->begin();
+				if(destination == series_names->size()) {
+					series_names->push_back(series);
+				}
+				router->addRoute(route->GetAttribute("key"), destination);
+			}
+			if(series_names->empty()) {
+				throw(runtime_error("the router has no routes"));
+			}
+			return router;
+		}
+	}
+	return router;
+}
+
+/** <summary>Returns the layout of the binaryparser element of the xml file, or NULL if it has none</summary> */
+tsdb::BinaryLayout* binary_layout_from_xml(const std::string parse_instruction_filename, std::ostream& log) {
+	using namespace std;
+	using namespace ticpp;
+
+	Document doc = Document(parse_instruction_filename);
+	doc.LoadFile();
+
+	Iterator<Element> child;
+	string value;
+	auto_ptr<Node> binaryparser;
+	for(child = child.begin(doc.FirstChildElement()); child != child.end(); child++) {
+		child->GetValue(&value);
+		if(value == "binaryparser") {
+			binaryparser = child->Clone();
+			break;
+		}
+	}
+	if(binaryparser.get() == NULL) {
+		return NULL;
+	}
+
+	log << "Loaded '" << parse_instruction_filename << "'." << endl;
+	log << "Creating binary layout..." << endl;
+
+	size_t record_size = (size_t) atol(binaryparser->ToElement()->GetAttribute("record_size").c_str());
+	string order = binaryparser->ToElement()->GetAttribute("byte_order");
+	tsdb::BinaryLayout::ByteOrder byte_order;
+	if(order == "" || order == "native") {
+		byte_order = tsdb::BinaryLayout::NATIVE_ORDER;
+	} else if(order == "little") {
+		byte_order = tsdb::BinaryLayout::LSB_FIRST;
+	} else if(order == "big") {
+		byte_order = tsdb::BinaryLayout::MSB_FIRST;
+	} else {
+		throw(runtime_error("byte_order in binaryparser not recognized"));
+	}
+	log << "   - record size: " << record_size << " bytes" << endl;
+	log << "   - byte order: " << (order == "" ? "native" : order) << endl;
+
+	auto_ptr<tsdb::BinaryLayout> layout(new tsdb::BinaryLayout(record_size, byte_order));
+	for(child = child.begin(binaryparser.get()); child != child.end(); child++) {
+		child->GetValue(&value);
+		if(value == "field") {
+			string name = child->GetAttribute("name");
+			string type = child->GetAttribute("type");
+			size_t offset = (size_t) atol(child->GetAttribute("offset").c_str());
+			size_t size = (size_t) atol(child->GetAttribute("size").c_str());
+			layout->addField(name, type, offset, size);
+			log << "      - Field '" << name << "': " << type << " of " << layout->fields().back().size
+				<< " bytes at offset " << offset << endl;
+		}
+	}
+
+	return layout.release();
 }
 
+/** <summary>Appends the binary records of <c>in_file</c> to <c>out_ts</c>. Returns the number of records
+ * written.</summary>
+ */
+long long binary_import(const tsdb::BinaryLayout& layout, const std::string& in_file, tsdb::Timeseries* out_ts,
+	long long horizon) {
+	using namespace boost::posix_time;
+
+	tsdb::BinaryLoader loader(layout, out_ts->structure());
+	tsdb::FileMapping mapping(in_file);
+
+	#ifdef WIN32
+		printf("Input file size is %I64d MB\n", (long long) mapping.size() / BYTES_PER_MB);
+	#else
+		printf("Input file size is %lld MB\n", (long long) mapping.size() / BYTES_PER_MB);
+	#endif
+	printf("Begin loading binary records...\n");
+
+	std::auto_ptr<tsdb::ReorderBuffer> reorder;
+	if(horizon >= 0) {
+		reorder.reset(new tsdb::ReorderBuffer(out_ts, horizon));
+	}
+
+	/* Load a whole number of records at a time, and show progress after each */
+	unsigned long long slice = std::max((unsigned long long) (5*BYTES_PER_MB) / loader.recordSize(), 1ULL) *
+		loader.recordSize();
+	if(mapping.size() % loader.recordSize() != 0) {
+		throw(std::runtime_error("The input file is not a whole number of records. Is the record size right?"));
+	}
+
+	long long outnumber = 0;
+	ptime starttime = microsec_clock::universal_time();
+	for(unsigned long long done = 0; done < mapping.size(); ) {
+		unsigned long long nbytes = std::min(slice, mapping.size() - done);
+		outnumber += loader.load(mapping.data() + done, nbytes, out_ts, reorder.get());
+		done += nbytes;
+
+		double seconds = (microsec_clock::universal_time() - starttime).total_milliseconds() / 1000.0;
+		if(seconds <= 0) {
+			seconds = 0.001;
+		}
+		progress_func((double) done, (double) mapping.size(), ((double) done / BYTES_PER_MB) / seconds,
+			((double) outnumber) / seconds);
+	}
+
+	if(reorder.get() != NULL) {
+		reorder->flush();
+		if(reorder->lateRecords() > 0) {
+			std::cerr << std::endl << reorder->lateRecords() << " record(s) arrived after the horizon, and were "
+				"merged into the series." << std::endl;
+		}
+	}
+	if(loader.discarded() > 0) {
+		std::cerr << std::endl << loader.discarded() << " record(s) discarded because they were misordered."
+			<< std::endl;
+	}
+	return outnumber;
+}
 
 void progress_func(double progress, double total, double readspeed, double writespeed) {
 	int totaldots = 20;
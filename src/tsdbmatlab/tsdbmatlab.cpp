@@ -8,7 +8,13 @@
 #include "cell.h"
 #include "recordset.h"
 #include "record.h"
+#include "multiseriesquery.h"
+#include "aggregate.h"
+#include "seriescache.h"
+#include "catalog.h"
+#include "chunkcache.h"
 #include <string>
+#include <vector>
 #include <time.h>
 
 #include <boost/algorithm/string.hpp>
@@ -20,6 +26,8 @@ void TSDBopen(void) {
 }
 
 void TSDBclose(void) {
+	tsdb::SeriesCache::global().clear();
+	tsdb::ChunkCache::global().clear();
 	H5close();
 }
 
@@ -104,7 +112,8 @@ void TSDBcreate_timeseries(int fid, const char * seriesname, const char * desc,
 		}
 		//creating the series
 		boost::shared_ptr<tsdb::Structure> st = boost::make_shared<tsdb::Structure>(fields,false); /* Note: no memory alignment for better space utilization */
-		tsdb::Timeseries ts = tsdb::Timeseries(fid,seriesname,"",st);
+		tsdb::SeriesCache::global().invalidate(fid,seriesname);
+		tsdb::Timeseries ts(fid,seriesname,"",st);
 		//tsdb::Timeseries out(fid,seriesname,"testing",fields);
 	}	
 	catch(std::exception &e) {
@@ -114,160 +123,219 @@ void TSDBcreate_timeseries(int fid, const char * seriesname, const char * desc,
 }
 
 
+/** <summary>Closes a TSDB file, and the timeseries of it that are cached</summary> */
 int TSDBclose_file(int fid) {
+	tsdb::SeriesCache::global().invalidateLocation(fid);
 	hid_t status = H5Fclose(fid);
 	return status;
 }
 
-mxArray* TSDBread_timeseries_by_timestamp(int loc_id, const char * series, long long start_ts, long long end_ts) {
+/** <summary>Converts a RecordSet into a MATLAB structure, with one column per field</summary>
+ * <remarks>Leading underscores of the field names become the letter "u", since MATLAB field names
+ * must start with a letter. Throws a runtime_error if MATLAB runs out of memory.</remarks>
+ */
+static mxArray* recordSetToStruct(tsdb::RecordSet& recSet) {
+	//how many columns are there?
+	size_t numFields = recSet.structure()->getNFields();
+
+	//getting the names of the columns
+	std::vector<std::string> names;
+	std::vector<const char*> fieldNames;
+	for(size_t i=0;i<numFields;i++)
+		names.push_back(recSet.structure()->getNameOfFieldsAsArray()[i]);
+
+	//dimensions of the output structure
+	mwSize dims[2];
+	dims[0]=1;
+	dims[1]=1;
+
+	// Here, we need to convert leading underscores to the letter "u", since MATLAB
+	// variables must start with a letter
+	for(size_t i=0;i<numFields;i++) {
+		if(names[i][0] == '_')
+			names[i][0] = 'u';
+		fieldNames.push_back(names[i].c_str());
+	}
 
-	try {		
-		// Open the timeseries
-		tsdb::Timeseries ts = tsdb::Timeseries(loc_id, std::string(series));
 
-		//how many columns are there?
-		size_t numFields = ts.structure()->getNFields();
+	//forming the matlab structure
+	mxArray* recordStructure = mxCreateStructArray(2,dims,numFields,&fieldNames[0]);
 
-		//getting the names of the columns
-		char** fieldNames = ts.structure()->getNameOfFieldsAsArray();
+	//how many records to be returned
+	size_t numRecords = recSet.size();
 
-		//dimensions of the output structure
-		mwSize dims[2];
-		dims[0]=1;
-		dims[1]=1;
+	for(size_t i=0;i<numFields;i++) 
+	{
+		std::string fieldType = recSet.structure()->getField(i)->getTSDBType();
+
+		if (!fieldType.compare("Timestamp"))
+		{
+			//mxArray to be placed into the record structure
+			mxArray* structureElement = mxCreateNumericMatrix(numRecords,1,mxUINT64_CLASS,mxREAL);
+
+			if (structureElement==NULL) 
+				throw std::runtime_error("too many records to fetch at once");
+
+			//setting values to mxarray, as they are stored
+			recSet.extractColumn(i, (tsdb::timestamp_t*) mxGetData(structureElement));
+			
+			//setting mxarray into the record structure
+			mxSetFieldByNumber(recordStructure,0,i,structureElement);
+		}
+		else if (!fieldType.compare("Date"))
+		{
+			//mxArray to be placed into the record structure
+			mxArray* structureElement = mxCreateNumericMatrix(numRecords,1,mxINT32_CLASS,mxREAL);
 
-		// Here, we need to convert leading underscores to the letter "u", since MATLAB
-		// variables must start with a letter
-		for(size_t i=0;i<numFields;i++) {
-			if(fieldNames[i][0] == '_')
-				fieldNames[i][0] = 'u';
+			if (structureElement==NULL) 
+				throw std::runtime_error("too many records to fetch at once");
+
+			//setting values to mxarray, as 32 bit ints whatever the size of tsdb::date_t
+			recSet.extractInts(i, (int*) mxGetData(structureElement));
+			
+			//setting mxarray into the record structure
+			mxSetFieldByNumber(recordStructure,0,i,structureElement);
+		}
+		else if (!fieldType.compare("Int8"))
+		{
+			mxArray* structureElement = mxCreateNumericMatrix(numRecords,1,mxINT8_CLASS,mxREAL);
+			
+			if (structureElement==NULL) 
+				throw std::runtime_error("too many records to fetch at once");
+			
+			//setting values to mxarray, as they are stored
+			recSet.extractColumn(i, (tsdb::int8_t*) mxGetData(structureElement));
+			
+			//setting mxarray into the record structure
+			mxSetFieldByNumber(recordStructure,0,i,structureElement);
+		}
+		else if (!fieldType.compare("Int32"))
+		{
+			mxArray* structureElement = mxCreateNumericMatrix(numRecords,1,mxINT32_CLASS,mxREAL);
+			
+			if (structureElement==NULL) 
+				throw std::runtime_error("too many records to fetch at once");
+			
+			//setting values to mxarray, as 32 bit ints whatever the size of tsdb::int32_t
+			recSet.extractInts(i, (int*) mxGetData(structureElement));
+			
+			//setting mxarray into the record structure
+			mxSetFieldByNumber(recordStructure,0,i,structureElement);
 		}
+		else if (!fieldType.compare("Double"))
+		{
+			mxArray* structureElement = mxCreateNumericMatrix(numRecords,1,mxDOUBLE_CLASS,mxREAL);
+			
+			if (structureElement==NULL) 
+				throw std::runtime_error("too many records to fetch at once");
+			
+			//setting values to mxarray
+			recSet.extractDoubles(i, (tsdb::ieee64_t*) mxGetData(structureElement));
+
+			//setting mxarray into the record structure
+			mxSetFieldByNumber(recordStructure,0,i,structureElement);
+		}
+		//else if (fieldType.find("String") != std::string::npos)
+		//symbols are decoded to their strings, like strings
+		else if (!fieldType.compare(0,6,"String") || !fieldType.compare(0,6,"Symbol"))
+		{
+			mwSize cellDims[2];
+			cellDims[0] = numRecords;
+			cellDims[1] = 1;
+			mxArray* structureElement = mxCreateCellArray(2,cellDims);
 
+			if (structureElement==NULL) 
+				throw std::runtime_error("too many records to fetch at once");
 
-		//forming the matlab structure
-		mxArray* recordStructure = mxCreateStructArray(2,dims,numFields,(const char**)fieldNames);
+			//setting values to mxarray
+			for (size_t j=0;j<numRecords;j++)
+				mxSetCell(structureElement,j,mxCreateString(recSet[j][i].toString().c_str()));
+
+			//setting mxarray into the record structure
+			mxSetFieldByNumber(recordStructure,0,i,structureElement);
+		}
+
+	}
+
+	return recordStructure;
+}
+
+mxArray* TSDBread_timeseries_by_timestamp(int loc_id, const char * series, long long start_ts, long long end_ts) {
+
+	try {		
+		// Open the timeseries, or reuse it if an earlier call opened it
+		boost::shared_ptr<tsdb::Timeseries> ts = tsdb::SeriesCache::global().open(loc_id, std::string(series));
 
 		//loading the records
-		tsdb::RecordSet recSet = ts.recordSet(
+		tsdb::RecordSet recSet = ts->recordSet(
 			(tsdb::timestamp_t) start_ts, 
 			(tsdb::timestamp_t) end_ts);
 
-		//how many records to be returned
-		size_t numRecords = recSet.size();
-
-		for(size_t i=0;i<numFields;i++) 
-		{
-			std::string fieldType = ts.structure()->getField(i)->getTSDBType();
+		return recordSetToStruct(recSet);
+	} catch(std::exception &e) {
+		std::string errormsg = std::string("Error in C code: ") + e.what();
+		mexErrMsgTxt(errormsg.c_str());
+		return mxCreateCellMatrix(0,0);
+	}
+}
 
-			if (!fieldType.compare("Timestamp"))
-			{
-				//mxArray to be placed into the record structure
-				mxArray* structureElement = mxCreateNumericMatrix(numRecords,1,mxUINT64_CLASS,mxREAL);
+/** <summary>Reads the same time range from several timeseries, on a pool of worker threads</summary>
+ * <remarks>Returns a cell array with one structure per timeseries, in the order of <c>series</c>, laid
+ * out as by TSDBread_timeseries_by_timestamp(). See tsdb::MultiSeriesQuery for how the workers share
+ * the HDF5 library.</remarks>
+ * <param name="nthreads">Number of worker threads, or 0 for one per processor</param>
+ */
+mxArray* TSDBread_multiple_timeseries_by_timestamp(int loc_id, const char * series[], int nseries,
+	long long start_ts, long long end_ts, int nthreads) {
 
-				if (structureElement==NULL) 
-					throw std::runtime_error("too many records to fetch at once");
+	try {
+		std::vector<std::string> names;
+		for(int i=0;i<nseries;i++)
+			names.push_back(std::string(series[i]));
+
+		//reading all of the timeseries
+		tsdb::MultiSeriesQuery query(loc_id, names);
+		query.setThreads(nthreads > 0 ? (size_t) nthreads : 0);
+		std::vector<tsdb::RecordSet> recSets = query.run(
+			(tsdb::timestamp_t) start_ts,
+			(tsdb::timestamp_t) end_ts);
 
-				//ptr to set values of mxarray
-				tsdb::timestamp_t* dataPtr = (tsdb::timestamp_t*) mxGetData(structureElement);
+		mxArray* recordCells = mxCreateCellMatrix(recSets.size(),1);
+		for(size_t i=0;i<recSets.size();i++)
+			mxSetCell(recordCells,i,recordSetToStruct(recSets[i]));
 
-				//setting values to mxarray
-				for (size_t j=0;j<numRecords;j++)
-					dataPtr[j] = recSet[j][i].toTimestamp();
-				
-				//setting mxarray into the record structure
-				mxSetFieldByNumber(recordStructure,0,i,structureElement);
-			}
-			else if (!fieldType.compare("Date"))
-			{
-				//mxArray to be placed into the record structure
-				mxArray* structureElement = mxCreateNumericMatrix(numRecords,1,mxINT32_CLASS,mxREAL);
-
-				if (structureElement==NULL) 
-					throw std::runtime_error("too many records to fetch at once");
-
-				//ptr to set values of mxarray
-				tsdb::date_t* dataPtr = (tsdb::date_t*) mxGetData(structureElement);
-				
-				//setting values to mxarray
-				for (size_t j=0;j<numRecords;j++)
-					dataPtr[j] = recSet[j][i].toDate();	
-				
-				//setting mxarray into the record structure
-				mxSetFieldByNumber(recordStructure,0,i,structureElement);
-			}
-			else if (!fieldType.compare("Int8"))
-			{
-				mxArray* structureElement = mxCreateNumericMatrix(numRecords,1,mxINT8_CLASS,mxREAL);
-				
-				if (structureElement==NULL) 
-					throw std::runtime_error("too many records to fetch at once");
-				
-				//ptr to set values of mxarray
-				tsdb::int8_t* dataPtr = (tsdb::int8_t* ) mxGetData(structureElement);
-				
-				//setting values to mxarray
-				for (size_t j=0;j<numRecords;j++)
-					dataPtr[j] = recSet[j][i].toInt8();	
-				
-				//setting mxarray into the record structure
-				mxSetFieldByNumber(recordStructure,0,i,structureElement);
-			}
-			else if (!fieldType.compare("Int32"))
-			{
-				mxArray* structureElement = mxCreateNumericMatrix(numRecords,1,mxINT32_CLASS,mxREAL);
-				
-				if (structureElement==NULL) 
-					throw std::runtime_error("too many records to fetch at once");
-				
-				//ptr to set values of mxarray
-				tsdb::int32_t* dataPtr = (tsdb::int32_t*) mxGetData(structureElement);
-				
-				//setting values to mxarray
-				for (size_t j=0;j<numRecords;j++)
-					dataPtr[j] = recSet[j][i].toInt32();	
-				
-				//setting mxarray into the record structure
-				mxSetFieldByNumber(recordStructure,0,i,structureElement);
-			}
-			else if (!fieldType.compare("Double"))
-			{
-				mxArray* structureElement = mxCreateNumericMatrix(numRecords,1,mxDOUBLE_CLASS,mxREAL);
-				
-				if (structureElement==NULL) 
-					throw std::runtime_error("too many records to fetch at once");
-				
-				//ptr to set values of mxarray
-				tsdb::ieee64_t* dataPtr = (tsdb::ieee64_t*) mxGetData(structureElement);
-				
-				//setting values to mxarray
-				for (size_t j=0;j<numRecords;j++)
-					dataPtr[j] = recSet[j][i].toDouble();	
-
-				//setting mxarray into the record structure
-				mxSetFieldByNumber(recordStructure,0,i,structureElement);
-			}
-			//else if (fieldType.find("String") != std::string::npos)
-			else if (!fieldType.compare(0,6,"String"))
-			{
-				mwSize cellDims[2];
-				cellDims[0] = numRecords;
-				cellDims[1] = 1;
-				mxArray* structureElement = mxCreateCellArray(2,cellDims);
+		return recordCells;
+	} catch(std::exception &e) {
+		std::string errormsg = std::string("Error in C code: ") + e.what();
+		mexErrMsgTxt(errormsg.c_str());
+		return mxCreateCellMatrix(0,0);
+	}
+}
 
-				if (structureElement==NULL) 
-					throw std::runtime_error("too many records to fetch at once");
+/** <summary>Reduces the records between two timestamps to one row per time bucket</summary>
+ * <remarks>Returns a structure laid out as by TSDBread_timeseries_by_timestamp(), with the start of
+ * each bucket, followed by one column per spec. See tsdb::AggregateSpec::fromString() for the specs.</remarks>
+ * <param name="bucket_ms">Length of a bucket, in milliseconds</param>
+ * <param name="specs">The aggregated columns, such as "max(price)" or "vwap(price,amount)"</param>
+ */
+mxArray* TSDBaggregate_timeseries(int loc_id, const char * series, long long start_ts, long long end_ts,
+	long long bucket_ms, const char * specs[], int nspecs) {
 
-				//setting values to mxarray
-				for (size_t j=0;j<numRecords;j++)
-					mxSetCell(structureElement,j,mxCreateString(recSet[j][i].toString().c_str()));
+	try {
+		std::vector<tsdb::AggregateSpec> aggregates;
+		for(int i=0;i<nspecs;i++)
+			aggregates.push_back(tsdb::AggregateSpec::fromString(specs[i]));
 
-				//setting mxarray into the record structure
-				mxSetFieldByNumber(recordStructure,0,i,structureElement);
-			}
+		// Open the timeseries, or reuse it if an earlier call opened it
+		boost::shared_ptr<tsdb::Timeseries> ts = tsdb::SeriesCache::global().open(loc_id, std::string(series));
 
-		}
+		tsdb::RecordSet recSet = ts->aggregate(
+			(tsdb::timestamp_t) start_ts,
+			(tsdb::timestamp_t) end_ts,
+			(tsdb::timestamp_t) bucket_ms,
+			aggregates);
 
-		return recordStructure;
+		return recordSetToStruct(recSet);
 	} catch(std::exception &e) {
 		std::string errormsg = std::string("Error in C code: ") + e.what();
 		mexErrMsgTxt(errormsg.c_str());
@@ -294,37 +362,37 @@ mxArray* TSDBget_timeseries_info(int loc_id, const char * series) {
 		mxArray* infoStructure = mxCreateStructArray(2,dims,5,structureNames);
 		mxArray* structureElement;
 
-		// Open the timeseries
-		tsdb::Timeseries ts = tsdb::Timeseries(loc_id, std::string(series));
+		// Open the timeseries, or reuse it if an earlier call opened it
+		boost::shared_ptr<tsdb::Timeseries> ts = tsdb::SeriesCache::global().open(loc_id, std::string(series));
 
 		//number of records
 		structureElement = mxCreateNumericMatrix(1,1,mxUINT64_CLASS,mxREAL);
 		//setting value into mxArray
-		*((hsize_t*) mxGetData(structureElement)) = ts.getNRecords();
+		*((hsize_t*) mxGetData(structureElement)) = ts->getNRecords();
 		//setting mxArray into structure
 		mxSetFieldByNumber(infoStructure,0,0,structureElement);
 
 		//beginning/ending timestamps
-		if (ts.getNRecords())
+		if (ts->getNRecords())
 		{
 			//beginning timestamp
 			void * record = NULL;
-			record = ts.getRecordsById(0,0);
+			record = ts->getRecordsById(0,0);
 			structureElement  = mxCreateString(
-				ts.structure()->getField(0)->toString(record).c_str()
+				ts->structure()->getField(0)->toString(record).c_str()
 				);
 			mxSetFieldByNumber(infoStructure,0,1,structureElement);
 			//ending timestamp
-			record = ts.getLastRecord();
+			record = ts->getLastRecord();
 			structureElement  = mxCreateString(
-				ts.structure()->getField(0)->toString(record).c_str()
+				ts->structure()->getField(0)->toString(record).c_str()
 				);			
 			mxSetFieldByNumber(infoStructure,0,2,structureElement);
 		}
 
 		//fieldNames
-		size_t numFields = ts.structure()->getNFields();
-		char** fieldNames = ts.structure()->getNameOfFieldsAsArray();
+		size_t numFields = ts->structure()->getNFields();
+		char** fieldNames = ts->structure()->getNameOfFieldsAsArray();
 		dims[0] = 1;
 		dims[1] = numFields;
 		//setting field names into mxArray cell array
@@ -341,7 +409,7 @@ mxArray* TSDBget_timeseries_info(int loc_id, const char * series) {
 		{
 			//setting field names into mxArray cell array
 			mxSetCell(structureElement,i,
-				mxCreateString(ts.structure()->getField(i)->getTSDBType().c_str())
+				mxCreateString(ts->structure()->getField(i)->getTSDBType().c_str())
 				);
 		}
 		//setting cell array into the output structure
@@ -355,27 +423,15 @@ mxArray* TSDBget_timeseries_info(int loc_id, const char * series) {
 	}
 }
 
+/** <summary>Lists the timeseries in a file, from its catalog if it has one (see tsdb::Catalog)</summary> */
 mxArray* TSDBget_timeseries_names(int fid)
 {
 	try {
-		//code grabbed from TSDB GUI
-		herr_t status;
-		herr_t size;
-		H5G_info_t group_info;
-		status = H5Gget_info(fid, &group_info);
-		char * name = NULL;
-
-		mxArray* cells = mxCreateCellMatrix(1, (mwSize) group_info.nlinks);
-
-		for(hsize_t i = 0; i< group_info.nlinks; i++) {
-			size = H5Lget_name_by_idx(fid, ".", H5_INDEX_NAME, H5_ITER_INC, i, NULL, 0, H5P_DEFAULT);
-			// allocate some space
-			name = (char *) malloc(size+1);
-			memset(name,0,size+1);
-			status = H5Lget_name_by_idx(fid, ".", H5_INDEX_NAME, H5_ITER_INC, i, name, size+1, H5P_DEFAULT);
-			mxSetCell(cells,(mwIndex) i,mxCreateString(name));
-			free(name);
-		}
+		std::vector<std::string> names = tsdb::Catalog::seriesNames(fid);
+
+		mxArray* cells = mxCreateCellMatrix(1, (mwSize) names.size());
+		for(size_t i = 0; i < names.size(); i++)
+			mxSetCell(cells,(mwIndex) i,mxCreateString(names[i].c_str()));
 
 		return cells;
 	} catch(std::exception &e) {
@@ -385,10 +441,91 @@ mxArray* TSDBget_timeseries_names(int fid)
 	}
 }
 
+/** <summary>Returns the counters of a timeseries as a struct, with one uint64 field per counter</summary>
+ * <remarks>The counters are those of the Timeseries the bindings keep open (see tsdb::SeriesCache), so they
+ * add up over the calls made since the series was first used. See tsdb::TimeseriesStats for what each one
+ * counts; times are in microseconds.</remarks>
+ * <param name="reset">Non-zero to set the counters back to zero after they are read</param>
+ */
+mxArray* TSDBget_timeseries_stats(int loc_id, const char * series, int reset)
+{
+	try {
+		boost::shared_ptr<tsdb::Timeseries> ts = tsdb::SeriesCache::global().open(loc_id, std::string(series));
+
+		tsdb::StatList items = ts->stats().items();
+		if(reset)
+			ts->resetStats();
+
+		std::vector<const char*> names;
+		for(size_t i = 0; i < items.size(); i++)
+			names.push_back(items[i].first.c_str());
+
+		mwSize dims[2] = {1, 1};
+		mxArray* statsStructure = mxCreateStructArray(2, dims, (int) names.size(), &names[0]);
+		for(size_t i = 0; i < items.size(); i++) {
+			mxArray* value = mxCreateNumericMatrix(1,1,mxUINT64_CLASS,mxREAL);
+			*((unsigned long long*) mxGetData(value)) = items[i].second;
+			mxSetFieldByNumber(statsStructure,0,(int) i,value);
+		}
+
+		return statsStructure;
+	} catch(std::exception &e) {
+		std::string errormsg = std::string("Error in C code: ") + e.what();
+		mexErrMsgTxt(errormsg.c_str());
+		return mxCreateCellMatrix(0,0);
+	}
+}
+
+/** <summary>Sets how many bytes of decompressed chunks the process keeps for reuse across queries</summary>
+ * <remarks>The cache is shared by every timeseries that is open (see tsdb::ChunkCache). 0 turns it off.</remarks>
+ */
+void TSDBset_chunk_cache(long long bytes)
+{
+	try {
+		if(bytes < 0)
+			throw std::runtime_error("Invalid capacity");
+		tsdb::ChunkCache::global().setCapacity((size_t) bytes);
+	} catch(std::exception &e) {
+		std::string errormsg = std::string("Error in C code: ") + e.what();
+		mexErrMsgTxt(errormsg.c_str());
+	}
+}
+
+/** <summary>Returns the counters of the chunk cache as a struct, with one uint64 field per counter</summary>
+ * <remarks>See tsdb::ChunkCacheStats for what each one counts.</remarks>
+ * <param name="reset">Non-zero to set the counters back to zero after they are read</param>
+ */
+mxArray* TSDBget_chunk_cache_stats(int reset)
+{
+	try {
+		tsdb::StatList items = tsdb::ChunkCache::global().stats().items();
+		if(reset)
+			tsdb::ChunkCache::global().resetStats();
+
+		std::vector<const char*> names;
+		for(size_t i = 0; i < items.size(); i++)
+			names.push_back(items[i].first.c_str());
+
+		mwSize dims[2] = {1, 1};
+		mxArray* statsStructure = mxCreateStructArray(2, dims, (int) names.size(), &names[0]);
+		for(size_t i = 0; i < items.size(); i++) {
+			mxArray* value = mxCreateNumericMatrix(1,1,mxUINT64_CLASS,mxREAL);
+			*((unsigned long long*) mxGetData(value)) = items[i].second;
+			mxSetFieldByNumber(statsStructure,0,(int) i,value);
+		}
+
+		return statsStructure;
+	} catch(std::exception &e) {
+		std::string errormsg = std::string("Error in C code: ") + e.what();
+		mexErrMsgTxt(errormsg.c_str());
+		return mxCreateCellMatrix(0,0);
+	}
+}
+
 int TSDBtimeseries_append(int loc_id, const char * series,mxArray * data)
 {
 	try {
-		tsdb::Timeseries ts(loc_id, std::string(series));
+		boost::shared_ptr<tsdb::Timeseries> ts = tsdb::SeriesCache::global().open(loc_id, std::string(series));
 
 		int inNumColumns = mxGetN(data);
 
@@ -400,7 +537,7 @@ int TSDBtimeseries_append(int loc_id, const char * series,mxArray * data)
 			std::string matlabType = std::string(mxGetClassName(cellElement));
 			//matlab int64 needs translating to "Timestamp"
 			if (!matlabType.compare("int64")) matlabType = "Timestamp"; 
-			std::string tsType = ts.structure()->getField(i)->getTSDBType();
+			std::string tsType = ts->structure()->getField(i)->getTSDBType();
 			//comparison of field types
 			if(!boost::algorithm::iequals(matlabType,tsType))
 			{
@@ -414,13 +551,13 @@ int TSDBtimeseries_append(int loc_id, const char * series,mxArray * data)
 			mxGetN(mxGetCell(data,0)):mxGetM(mxGetCell(data,0));
 
 		//vector of formatted input, ready for appending
-		tsdb::RecordSet records(inNumRows,ts.structure());
+		tsdb::RecordSet records(inNumRows,ts->structure());
 
 		//populating vector
 		for (int column=0;column<inNumColumns;column++)
 		{
 			mxArray * cellElement = mxGetCell(data,column);
-			std::string tsType = ts.structure()->getField(column)->getTSDBType();
+			std::string tsType = ts->structure()->getField(column)->getTSDBType();
 
 			if (boost::algorithm::iequals(tsType,"Timestamp")) {
 				tsdb::timestamp_t * values = (tsdb::timestamp_t *) mxGetData(cellElement);
@@ -440,8 +577,14 @@ int TSDBtimeseries_append(int loc_id, const char * series,mxArray * data)
 			}
 		}
 
-		//appending the data
-		ts.appendRecordSet(records,false);
+		//appending the data. The cached timeseries keeps track of what it appends, but
+		//after a failed append it is reopened from the file.
+		try {
+			ts->appendRecordSet(records,false);
+		} catch(...) {
+			tsdb::SeriesCache::global().invalidate(loc_id, std::string(series));
+			throw;
+		}
 
 		return 1;
 	}	catch(std::exception &e) {
@@ -8,6 +8,13 @@ int TSDBcreate_file(const char * filename);
 void TSDBcreate_timeseries(int fid, const char * seriesname, const char * desc,
 					char * columnTypes[], char * columnNames[],int numColumns);
 mxArray* TSDBread_timeseries_by_timestamp(int loc_id, const char * series, long long start_ts, long long end_ts);
+mxArray* TSDBread_multiple_timeseries_by_timestamp(int loc_id, const char * series[], int nseries,
+					long long start_ts, long long end_ts, int nthreads);
+mxArray* TSDBaggregate_timeseries(int loc_id, const char * series, long long start_ts, long long end_ts,
+					long long bucket_ms, const char * specs[], int nspecs);
 mxArray* TSDBget_timeseries_info(int loc_id,const char * series);
 int TSDBtimeseries_append(int loc_id, const char * series, void * data);
 mxArray* TSDBget_timeseries_names(int loc_id);
+mxArray* TSDBget_timeseries_stats(int loc_id, const char * series, int reset);
+void TSDBset_chunk_cache(long long bytes);
+mxArray* TSDBget_chunk_cache_stats(int reset);
@@ -0,0 +1,140 @@
+/** \file
+ * <summary>Rebuilds the indexes of the series in a TSDB file, or checks and repairs them.</summary>
+ * <remarks><p>By default, the index, the zone map and the segment index of every series in the file are
+ * built again from the records, reading each data table on several threads; see Timeseries::rebuildIndex().
+ * This is the second half of a bulk load with <c>tsdbimport --defer-index</c>. Name some series after the
+ * file name to only rebuild those.</p>
+ *
+ * \code
+ * > tsdbreindex --threads 8 usdjpy.tsdb
+ * \endcode
+ *
+ * <p>With <c>--verify</c>, the indexes are only checked against the records, and a line with what
+ * Timeseries::verifyIndex() found is written for each series. The exit code is not 0 if any of them is
+ * bad. With <c>--repair</c>, the series that are bad are rebuilt. A series whose index can not even be
+ * opened, as after a writer crashed in the middle of an append, has its index removed and built again.</p>
+ *
+ * \code
+ * > tsdbreindex --repair usdjpy.tsdb series1 series2
+ * \endcode
+ *
+ * <p><c>--threads 0</c>, the default, reads on one thread per processor.</p></remarks>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "boost/shared_ptr.hpp"
+#include "tsdb.h"
+#include "timeseries.h"
+#include "catalog.h"
+#include "hdf5.h"
+
+
+void usage(void) {
+	using namespace std;
+	cerr << "Usage: tsdbreindex [--verify | --repair] [--threads <n>] <filename> [<series> ...]" << endl;
+	cerr << "Rebuilds the indexes of the series, or of every series in the file if none is named." << endl <<
+		"--verify only checks them, and --repair rebuilds the ones that are bad." << endl;
+}
+
+/* Opens a series. If repairing, a series that fails to open has its index removed first. */
+boost::shared_ptr<tsdb::Timeseries> openSeries(hid_t fid, const std::string& name, bool repair) {
+	using namespace std;
+	using namespace tsdb;
+
+	try {
+		return boost::shared_ptr<Timeseries>(new Timeseries(fid, name));
+	} catch(std::exception &e) {
+		if(!repair) {
+			throw;
+		}
+		cerr << name << ": " << e.what() << endl << name << ": removing the index." << endl;
+	}
+
+	Timeseries::dropIndex(fid, name);
+	return boost::shared_ptr<Timeseries>(new Timeseries(fid, name));
+}
+
+int main(int argc, char* argv[])
+{
+	using namespace std;
+	using namespace tsdb;
+
+	bool verify = false;
+	bool repair = false;
+	int nthreads = 0;
+
+	int arg = 1;
+	while(arg < argc && string(argv[arg]).substr(0,2) == "--") {
+		if(string(argv[arg]) == "--verify") {
+			verify = true;
+			arg += 1;
+		} else if(string(argv[arg]) == "--repair") {
+			repair = true;
+			arg += 1;
+		} else if(string(argv[arg]) == "--threads" && arg + 1 < argc) {
+			nthreads = atoi(argv[arg+1]);
+			arg += 2;
+		} else {
+			break;
+		}
+	}
+
+	if(argc - arg < 1 || (verify && repair) || nthreads < 0) {
+		cerr << "Error: Not enough or invalid arguments." << endl;
+		usage();
+		return -1;
+	}
+
+	string filename = argv[arg];
+	hid_t fid = H5Fopen(filename.c_str(), verify ? H5F_ACC_RDONLY : H5F_ACC_RDWR, H5P_DEFAULT);
+	if(fid < 0) {
+		cerr << "Error: Unable to open TSDB file: '" << filename << "'." << endl;
+		return -1;
+	}
+
+	int ret = 0;
+	try {
+		vector<string> names(argv + arg + 1, argv + argc);
+		if(names.empty()) {
+			names = Catalog::seriesNames(fid);
+		}
+
+		for(size_t i = 0; i < names.size(); i++) {
+			boost::shared_ptr<Timeseries> ts = openSeries(fid, names[i], repair);
+
+			if(verify || repair) {
+				IndexCheck check = ts->verifyIndex(nthreads);
+				StatList items = check.items();
+				cout << names[i] << ":";
+				for(size_t j = 0; j < items.size(); j++) {
+					cout << " " << items[j].first << "=" << items[j].second;
+				}
+				cout << (check.ok() ? " ok" : " BAD") << endl;
+
+				if(check.ok()) {
+					continue;
+				}
+				if(verify) {
+					ret = 1;
+					continue;
+				}
+			}
+
+			ts->rebuildIndex(nthreads);
+			cout << names[i] << ": rebuilt the index of " << ts->getNRecords() << " records." << endl;
+		}
+	} catch(std::exception &e) {
+		cerr << "Exception:" << endl;
+		cerr << e.what() << endl;
+		ret = -1;
+	}
+
+	if(H5Fclose(fid) < 0) {
+		cerr << "Warning: error closing TSDB file. There may be data corruption." << endl;
+		ret = -1;
+	}
+	return ret;
+}
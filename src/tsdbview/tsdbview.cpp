@@ -1,100 +1,133 @@
 // tsdbview.cpp : Defines the entry point for the console application.
 //
 
+#include <stdio.h>
+#include <stdlib.h>
 #include "boost/date_time/posix_time/posix_time.hpp"
 #include "tsdb.h"
 #include "timeseries.h"
+#include "bufferedrecordset.h"
+#include "recordformatter.h"
 #include "hdf5.h"
 
 
+void usage(void) {
+	using namespace std;
+	cout << "Usage: tsdbview [--format csv|tsv] [--delimiter <text>] [--header] [--ids] [--epoch-ms]" << endl <<
+		"                [--buffer <bytes>] <filename> <series> <start_date> <end_date>" << endl;
+	cout << "Date format is YYYYMMDDThhmmssffff. Fractional seconds optional." << endl <<
+		"For example, 20080201T010000" << endl;
+	cout << "  --format     csv (the default) separates fields with commas, tsv with tabs" << endl <<
+		"  --delimiter  separates fields with the given text instead" << endl <<
+		"  --header     writes a first line with the field names" << endl <<
+		"  --ids        writes the record id before the fields of each record" << endl <<
+		"  --epoch-ms   writes timestamps as milliseconds since 1970-01-01" << endl <<
+		"  --buffer     size of the output buffer in bytes (default " << FORMAT_BUFFER_BYTES << ")" << endl;
+}
 
 int main(int argc, char* argv[])
 {
 	using namespace std;
 	using namespace boost::posix_time;
 	using namespace tsdb;
-	hid_t ofh; 
+	hid_t ofh;
 	string filename,series,start_date_s,end_date_s;
-	if(argc < 5) {
-		cerr << "Error: Not enough arguments." << endl;
-		cout << "Usage: tsdbview <filename> <series> <start_date> <end_date>." << endl;
-		cout << "Date format is YYYYMMDDThhmmssffff. Fractional seconds optional." << endl <<
-			"For example, 20080201T010000" << endl;
+	string field_delim = ",";
+	bool header = false;
+	bool record_ids = false;
+	bool epoch_ms = false;
+	long long buffer_bytes = FORMAT_BUFFER_BYTES;
+
+	int arg = 1;
+	while(arg < argc && string(argv[arg]).substr(0,2) == "--") {
+		string option(argv[arg]);
+		if(option == "--format" && arg + 1 < argc && string(argv[arg+1]) == "csv") {
+			field_delim = ",";
+			arg += 2;
+		} else if(option == "--format" && arg + 1 < argc && string(argv[arg+1]) == "tsv") {
+			field_delim = "\t";
+			arg += 2;
+		} else if(option == "--delimiter" && arg + 1 < argc) {
+			field_delim = argv[arg+1];
+			arg += 2;
+		} else if(option == "--buffer" && arg + 1 < argc) {
+			buffer_bytes = atoll(argv[arg+1]);
+			arg += 2;
+		} else if(option == "--header") {
+			header = true;
+			arg++;
+		} else if(option == "--ids") {
+			record_ids = true;
+			arg++;
+		} else if(option == "--epoch-ms") {
+			epoch_ms = true;
+			arg++;
+		} else {
+			break;
+		}
+	}
+
+	if(argc - arg != 4 || buffer_bytes < 1) {
+		cerr << "Error: Not enough or invalid arguments." << endl;
+		usage();
 		return -1;
 	}
 
-	filename = argv[1]; series = argv[2]; start_date_s = argv[3]; end_date_s = argv[4];
+	filename = argv[arg]; series = argv[arg+1]; start_date_s = argv[arg+2]; end_date_s = argv[arg+3];
 
 	ofh = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
 	if(ofh < 0) {
 		cerr << "Error: Unable to opening TSDB file: '" << filename << "'." << endl;
 		return -1;
 	}
+	int ret = 0;
 	try {
-		// Open the timeseries
-		Timeseries* Ts = new Timeseries(ofh,series);
+		// Open the timeseries. The file is read only, so an uncompressed series is read through a mapping.
+		Timeseries ts(ofh,series);
+		ts.mapRecords();
 
 		// Parse the dates
 		ptime start(from_iso_string(start_date_s));
 		ptime end(from_iso_string(end_date_s));
 
-		hsize_t start_id = 0;
-		hsize_t end_id = 0;
-		hsize_t nrecords = 0;
-		herr_t status;
-
-
 		if(start > end) {
 			throw(TimeseriesException("Start timestamp cannot be greater than end timestamp."));
 		}
 
+		/* The records are read a buffer at a time, with the next buffer read ahead while one is
+		   formatted, and written through the formatter's output buffer. */
+		BufferedRecordSet records = ts.bufferedRecordSet(start, end);
 
-		status = Ts->recordId_GE(start, &start_id);
-		if(status == -1) {
-			throw(TimeseriesException("The start timestamp is greater then the last record in the timeseries."));
-		}
+		RecordFormatter formatter(ts.structure(), stdout, (size_t) buffer_bytes);
+		formatter.setDelimiters(field_delim, "\n");
+		formatter.setRecordIds(record_ids);
+		formatter.setTimestampFormat(epoch_ms ? RecordFormatter::MILLISECONDS : RecordFormatter::ISO);
 
-		status = Ts->recordId_LE(end, &end_id);
-		if(status == -1) {
-			throw(TimeseriesException("The end timestamp was less than the first record in the timeseries."));
+		if(header) {
+			formatter.writeHeader();
 		}
 
-		status = Ts->recordId_GE(tsdb::ptime_to_timestamp(end)+1, &end_id);
-		if(status == -1) {
-			end_id = Ts->getNRecords() - 1;
-		} else {
-			end_id = end_id -1;
+		// Record ids are ids in the series, so they start at the first id of the range
+		hsize_t first_id = 0;
+		if(records.size() > 0) {
+			ts.recordId_GE(start, &first_id);
+			records.setPrefetch(true);
 		}
-	
-		size_t record_block = 10000; // how many records to load at a time
-
 
-	
-		/* Load one block of records at a time, and print it out to stdout. */
-		void * records = NULL;
-		unsigned int k = 0;
-		hsize_t i,j;
-		for(i=start_id;i<=end_id; i+=record_block) {
-			if((i+record_block-1) <= end_id) {
-				j = i + record_block -1;
-			} else {
-				j=end_id;
-			}
-
-			records = Ts->getRecordsById(i,j);
-			nrecords = j-i+1;
-
-			for( k =0; k<nrecords; k+=100) {
-				cout << i+k << Ts->structure()->structsToString(Ts->structure()->pointerToMember(records,k,0),
-					(((unsigned int) nrecords) - k < 100 ? ((unsigned int) nrecords)-k : 100),",","\n") << endl;
-			}
-			free(records);
+		hsize_t i = 0;
+		while(i < records.size()) {
+			hsize_t buf_first;
+			size_t nbufrecords;
+			const char* buf = records.buffer(i, &buf_first, &nbufrecords);
+			formatter.write(buf, nbufrecords, first_id + buf_first);
+			i = buf_first + nbufrecords;
 		}
+		formatter.flush();
 	} catch(std::exception &e) {
 		cerr << "Exception:" << endl;
 		cerr << e.what() << endl;
+		ret = -1;
 	}
 	H5Fclose(ofh);
-	return 0;
+	return ret;
 }
-